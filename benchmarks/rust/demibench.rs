@@ -0,0 +1,958 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#![cfg_attr(feature = "strict", deny(warnings))]
+#![deny(clippy::all)]
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use ::anyhow::{
+    bail,
+    Result,
+};
+use ::clap::{
+    Arg,
+    ArgMatches,
+    Command,
+};
+use ::demikernel::{
+    demi_sgarray_t,
+    perftools::histogram::Histogram,
+    runtime::{
+        fail::Fail,
+        stats,
+        types::{
+            demi_opcode_t,
+            demi_qresult_t,
+            demi_stats_t,
+        },
+    },
+    LibOS,
+    LibOSName,
+    QDesc,
+    QToken,
+};
+use ::std::{
+    collections::{
+        HashMap,
+        VecDeque,
+    },
+    env,
+    mem,
+    net::{
+        Ipv4Addr,
+        SocketAddrV4,
+    },
+    slice,
+    str::FromStr,
+    time::{
+        Duration,
+        Instant,
+        SystemTime,
+    },
+};
+
+//======================================================================================================================
+// Constants
+//======================================================================================================================
+
+/// Byte that requests are filled with.
+const FILL_CHAR: u8 = 0x65;
+
+/// Time given to requests that are still in flight at the end of a trial to come back (in seconds).
+const DRAIN_TIMEOUT: u64 = 1;
+
+/// Quantiles of latency that are reported.
+const QUANTILES: [(&str, f64); 5] = [
+    ("p50", 0.5),
+    ("p90", 0.9),
+    ("p99", 0.99),
+    ("p999", 0.999),
+    ("p9999", 0.9999),
+];
+
+//======================================================================================================================
+// Program Arguments
+//======================================================================================================================
+
+/// Transport Protocols
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+enum Protocol {
+    Tcp,
+    Udp,
+}
+
+/// Load Generation Modes
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+enum Mode {
+    /// Ping-pong: a single request in flight per connection, to measure round-trip time.
+    Rtt,
+    /// Closed loop: a fixed number of requests in flight per connection, to measure peak throughput.
+    ClosedLoop,
+    /// Open loop: requests are issued at a fixed rate regardless of responses, to measure latency under load.
+    OpenLoop,
+}
+
+/// Program Arguments
+#[derive(Debug)]
+pub struct ProgramArguments {
+    /// Runs as the echo server, instead of as the load generator.
+    server: bool,
+    /// Address of the server.
+    addr: SocketAddrV4,
+    /// Local address of the load generator, for UDP.
+    local: Option<SocketAddrV4>,
+    /// Transport protocol.
+    protocol: Protocol,
+    /// Load generation mode.
+    mode: Mode,
+    /// Size of requests (in bytes).
+    bufsize: usize,
+    /// Numbers of connections, one trial each.
+    connections: Vec<usize>,
+    /// Maximum number of requests in flight per connection.
+    outstanding: usize,
+    /// Request rate of the open loop (in requests per second).
+    rate: u64,
+    /// Duration of the measurement of a trial.
+    duration: Duration,
+    /// Duration of the warm-up of a trial, whose requests are not measured.
+    warmup: Duration,
+}
+
+/// Associate functions for Program Arguments
+impl ProgramArguments {
+    /// Default buffer size.
+    const DEFAULT_BUFSIZE: usize = 64;
+    /// Default number of connections.
+    const DEFAULT_CONNECTIONS: &'static str = "1";
+    /// Default duration of a trial (in seconds).
+    const DEFAULT_DURATION: u64 = 10;
+    /// Default number of requests in flight per connection, in the closed loop.
+    const DEFAULT_OUTSTANDING: usize = 16;
+    /// Default request rate of the open loop.
+    const DEFAULT_RATE: u64 = 100000;
+    /// Default duration of the warm-up of a trial (in seconds).
+    const DEFAULT_WARMUP: u64 = 2;
+
+    /// Parses the program arguments from the command line interface.
+    pub fn new(app_name: &'static str, app_author: &'static str, app_about: &'static str) -> Result<Self> {
+        let matches: ArgMatches = Command::new(app_name)
+            .author(app_author)
+            .about(app_about)
+            .arg(
+                Arg::new("peer")
+                    .long("peer")
+                    .value_parser(["server", "client"])
+                    .required(true)
+                    .value_name("server|client")
+                    .help("Sets whether to run the echo server or the load generator"),
+            )
+            .arg(
+                Arg::new("addr")
+                    .long("addr")
+                    .value_parser(clap::value_parser!(String))
+                    .required(true)
+                    .value_name("ADDRESS:PORT")
+                    .help("Sets server address"),
+            )
+            .arg(
+                Arg::new("local")
+                    .long("local")
+                    .value_parser(clap::value_parser!(String))
+                    .required(false)
+                    .value_name("ADDRESS:PORT")
+                    .help("Sets local address of the load generator, for UDP"),
+            )
+            .arg(
+                Arg::new("protocol")
+                    .long("protocol")
+                    .value_parser(["tcp", "udp"])
+                    .default_value("tcp")
+                    .help("Sets transport protocol"),
+            )
+            .arg(
+                Arg::new("mode")
+                    .long("mode")
+                    .value_parser(["rtt", "closed-loop", "open-loop"])
+                    .default_value("rtt")
+                    .help("Sets load generation mode"),
+            )
+            .arg(
+                Arg::new("bufsize")
+                    .long("bufsize")
+                    .value_parser(clap::value_parser!(String))
+                    .value_name("SIZE")
+                    .help("Sets request size"),
+            )
+            .arg(
+                Arg::new("connections")
+                    .long("connections")
+                    .value_parser(clap::value_parser!(String))
+                    .value_name("N[,N...]")
+                    .help("Sets numbers of connections, one trial each"),
+            )
+            .arg(
+                Arg::new("outstanding")
+                    .long("outstanding")
+                    .value_parser(clap::value_parser!(String))
+                    .value_name("N")
+                    .help("Sets maximum number of requests in flight per connection"),
+            )
+            .arg(
+                Arg::new("rate")
+                    .long("rate")
+                    .value_parser(clap::value_parser!(String))
+                    .value_name("RPS")
+                    .help("Sets request rate of the open loop"),
+            )
+            .arg(
+                Arg::new("duration")
+                    .long("duration")
+                    .value_parser(clap::value_parser!(String))
+                    .value_name("SECONDS")
+                    .help("Sets duration of the measurement of each trial"),
+            )
+            .arg(
+                Arg::new("warmup")
+                    .long("warmup")
+                    .value_parser(clap::value_parser!(String))
+                    .value_name("SECONDS")
+                    .help("Sets duration of the warm-up of each trial"),
+            )
+            .get_matches();
+
+        // Default arguments.
+        let mut args: ProgramArguments = ProgramArguments {
+            server: false,
+            addr: SocketAddrV4::new(Ipv4Addr::LOCALHOST, 0),
+            local: None,
+            protocol: Protocol::Tcp,
+            mode: Mode::Rtt,
+            bufsize: Self::DEFAULT_BUFSIZE,
+            connections: Vec::new(),
+            outstanding: Self::DEFAULT_OUTSTANDING,
+            rate: Self::DEFAULT_RATE,
+            duration: Duration::from_secs(Self::DEFAULT_DURATION),
+            warmup: Duration::from_secs(Self::DEFAULT_WARMUP),
+        };
+        args.set_connections(Self::DEFAULT_CONNECTIONS)?;
+
+        // Peer type.
+        if let Some(peer) = matches.get_one::<String>("peer") {
+            args.server = peer == "server";
+        }
+
+        // Server address.
+        if let Some(addr) = matches.get_one::<String>("addr") {
+            args.addr = SocketAddrV4::from_str(addr)?;
+        }
+
+        // Local address.
+        if let Some(local) = matches.get_one::<String>("local") {
+            args.local = Some(SocketAddrV4::from_str(local)?);
+        }
+
+        // Transport protocol.
+        if let Some(protocol) = matches.get_one::<String>("protocol") {
+            args.protocol = if protocol == "udp" {
+                Protocol::Udp
+            } else {
+                Protocol::Tcp
+            };
+        }
+
+        // Load generation mode.
+        if let Some(mode) = matches.get_one::<String>("mode") {
+            args.mode = match mode.as_str() {
+                "closed-loop" => Mode::ClosedLoop,
+                "open-loop" => Mode::OpenLoop,
+                _ => Mode::Rtt,
+            };
+        }
+
+        // Buffer size.
+        if let Some(bufsize) = matches.get_one::<String>("bufsize") {
+            args.bufsize = Self::parse_positive(bufsize, "invalid buffer size")?;
+        }
+
+        // Numbers of connections.
+        if let Some(connections) = matches.get_one::<String>("connections") {
+            args.set_connections(connections)?;
+        }
+
+        // Requests in flight.
+        if let Some(outstanding) = matches.get_one::<String>("outstanding") {
+            args.outstanding = Self::parse_positive(outstanding, "invalid number of outstanding requests")?;
+        }
+
+        // Request rate.
+        if let Some(rate) = matches.get_one::<String>("rate") {
+            args.rate = Self::parse_positive(rate, "invalid request rate")? as u64;
+            if args.rate > 1_000_000_000 {
+                bail!("request rate is too high")
+            }
+        }
+
+        // Durations.
+        if let Some(duration) = matches.get_one::<String>("duration") {
+            args.duration = Duration::from_secs(Self::parse_positive(duration, "invalid duration")? as u64);
+        }
+        if let Some(warmup) = matches.get_one::<String>("warmup") {
+            args.warmup = Duration::from_secs(warmup.parse()?);
+        }
+
+        // A ping-pong has a single request in flight per connection.
+        if args.mode == Mode::Rtt {
+            args.outstanding = 1;
+        }
+
+        // The load generator needs a local address to receive UDP responses on.
+        if !args.server && args.protocol == Protocol::Udp && args.local.is_none() {
+            bail!("missing local address for UDP")
+        }
+
+        Ok(args)
+    }
+
+    /// Sets the numbers of connections parameter in the target program arguments.
+    fn set_connections(&mut self, connections_str: &str) -> Result<()> {
+        self.connections = connections_str
+            .split(',')
+            .map(|n| Self::parse_positive(n, "invalid number of connections"))
+            .collect::<Result<Vec<usize>>>()?;
+        Ok(())
+    }
+
+    /// Parses a positive integer.
+    fn parse_positive(value: &str, msg: &'static str) -> Result<usize> {
+        let n: usize = value.trim().parse()?;
+        if n > 0 {
+            Ok(n)
+        } else {
+            bail!(msg)
+        }
+    }
+}
+
+//======================================================================================================================
+// Server
+//======================================================================================================================
+
+/// Echo Server
+struct Server {
+    /// Underlying libOS.
+    libos: LibOS,
+    /// Transport protocol.
+    protocol: Protocol,
+    /// Pending operations.
+    qts: Vec<QToken>,
+    /// Scatter-gather arrays of pending pushes.
+    pushes: HashMap<QToken, demi_sgarray_t>,
+}
+
+/// Associated Functions for the Echo Server
+impl Server {
+    /// Instantiates the echo server.
+    pub fn new(mut libos: LibOS, args: &ProgramArguments) -> Result<Self> {
+        let mut qts: Vec<QToken> = Vec::new();
+
+        match args.protocol {
+            Protocol::Tcp => {
+                let sockqd: QDesc = match libos.socket(libc::AF_INET, libc::SOCK_STREAM, 0) {
+                    Ok(qd) => qd,
+                    Err(e) => bail!("failed to create socket: {:?}", e.cause),
+                };
+                if let Err(e) = libos.bind(sockqd, args.addr) {
+                    bail!("bind failed: {:?}", e.cause)
+                }
+                if let Err(e) = libos.listen(sockqd, 1024) {
+                    bail!("listen failed: {:?}", e.cause)
+                }
+                match libos.accept(sockqd) {
+                    Ok(qt) => qts.push(qt),
+                    Err(e) => bail!("accept failed: {:?}", e.cause),
+                }
+            },
+            Protocol::Udp => {
+                let sockqd: QDesc = match libos.socket(libc::AF_INET, libc::SOCK_DGRAM, 0) {
+                    Ok(qd) => qd,
+                    Err(e) => bail!("failed to create socket: {:?}", e.cause),
+                };
+                if let Err(e) = libos.bind(sockqd, args.addr) {
+                    bail!("bind failed: {:?}", e.cause)
+                }
+                match libos.pop(sockqd) {
+                    Ok(qt) => qts.push(qt),
+                    Err(e) => bail!("pop failed: {:?}", e.cause),
+                }
+            },
+        }
+
+        eprintln!("listening on {:?}", args.addr);
+
+        Ok(Self {
+            libos,
+            protocol: args.protocol,
+            qts,
+            pushes: HashMap::new(),
+        })
+    }
+
+    /// Echoes requests back until the program is killed.
+    pub fn run(&mut self) -> Result<()> {
+        let mut qrs: Vec<demi_qresult_t> = Vec::new();
+
+        loop {
+            qrs.resize_with(self.qts.len(), || unsafe { mem::zeroed() });
+            let nready: usize = match self.libos.wait_many(&self.qts, &mut qrs, None) {
+                Ok(nready) => nready,
+                Err(e) => bail!("wait failed: {:?}", e.cause),
+            };
+
+            for qr in &qrs[..nready] {
+                let qt: QToken = qr.qr_qt.into();
+                let qd: QDesc = qr.qr_qd.into();
+                remove_qtoken(&mut self.qts, qt);
+
+                match qr.qr_opcode {
+                    // A client connected.
+                    demi_opcode_t::DEMI_OPC_ACCEPT => {
+                        let connqd: QDesc = unsafe { qr.qr_value.ares.qd.into() };
+                        self.pop(connqd)?;
+                        match self.libos.accept(qd) {
+                            Ok(qt) => self.qts.push(qt),
+                            Err(e) => bail!("accept failed: {:?}", e.cause),
+                        }
+                    },
+                    // A request arrived, so echo it back and wait for the next one.
+                    demi_opcode_t::DEMI_OPC_POP => {
+                        let sga: demi_sgarray_t = unsafe { qr.qr_value.sga };
+                        if sga.sga_segs[0].sgaseg_len == 0 {
+                            // The client closed the connection.
+                            self.free(sga);
+                            if let Err(e) = self.libos.close(qd) {
+                                eprintln!("failed to close socket: {:?}", e.cause);
+                            }
+                            continue;
+                        }
+                        let r: Result<QToken, Fail> = match self.protocol {
+                            Protocol::Tcp => self.libos.push(qd, &sga),
+                            Protocol::Udp => match sockaddr_to_socketaddrv4(&sga.sga_addr) {
+                                Ok(remote) => self.libos.pushto(qd, &sga, remote),
+                                Err(e) => bail!("failed to parse remote address: {:?}", e),
+                            },
+                        };
+                        match r {
+                            Ok(qt) => {
+                                self.qts.push(qt);
+                                self.pushes.insert(qt, sga);
+                            },
+                            Err(e) => bail!("push failed: {:?}", e.cause),
+                        }
+                        self.pop(qd)?;
+                    },
+                    // A response went out.
+                    demi_opcode_t::DEMI_OPC_PUSH => {
+                        if let Some(sga) = self.pushes.remove(&qt) {
+                            self.free(sga);
+                        }
+                    },
+                    // An operation failed, most likely because the client went away.
+                    demi_opcode_t::DEMI_OPC_FAILED => {
+                        eprintln!("operation failed on queue {:?}", qd);
+                        if let Some(sga) = self.pushes.remove(&qt) {
+                            self.free(sga);
+                        }
+                    },
+                    _ => bail!("unexpected result"),
+                }
+            }
+        }
+    }
+
+    /// Pops the next request of a queue.
+    fn pop(&mut self, qd: QDesc) -> Result<()> {
+        match self.libos.pop(qd) {
+            Ok(qt) => self.qts.push(qt),
+            Err(e) => bail!("pop failed: {:?}", e.cause),
+        }
+        Ok(())
+    }
+
+    /// Releases a scatter-gather array.
+    fn free(&mut self, sga: demi_sgarray_t) {
+        if let Err(e) = self.libos.sgafree(sga) {
+            eprintln!("failed to release scatter-gather array: {:?}", e);
+        }
+    }
+}
+
+//======================================================================================================================
+// Client
+//======================================================================================================================
+
+/// Connection of the Load Generator
+struct Connection {
+    /// Underlying queue.
+    qd: QDesc,
+    /// Time at which each request in flight was due, oldest first.
+    inflight: VecDeque<Instant>,
+    /// Number of bytes of the oldest response that were received so far, for TCP.
+    received: usize,
+}
+
+/// Results of a Trial
+struct Report {
+    /// Number of connections.
+    connections: usize,
+    /// Duration of the measurement.
+    elapsed: Duration,
+    /// Number of responses received during the measurement.
+    requests: u64,
+    /// Number of open-loop requests that were not issued because their connection had too many in flight.
+    skipped: u64,
+    /// Round-trip times of requests (in nanoseconds).
+    latency: Box<Histogram>,
+    /// Runtime counters recorded during the trial.
+    stats: demi_stats_t,
+}
+
+/// Load Generator
+struct Client {
+    /// Underlying libOS.
+    libos: LibOS,
+    /// Program arguments.
+    args: ProgramArguments,
+    /// Connections of the ongoing trial.
+    conns: Vec<Connection>,
+    /// Connections of the ongoing trial, by queue descriptor.
+    conns_by_qd: HashMap<QDesc, usize>,
+    /// Pending operations.
+    qts: Vec<QToken>,
+    /// Scatter-gather arrays of pending pushes.
+    pushes: HashMap<QToken, demi_sgarray_t>,
+}
+
+/// Associated Functions for the Load Generator
+impl Client {
+    /// Instantiates the load generator.
+    pub fn new(libos: LibOS, args: ProgramArguments) -> Self {
+        Self {
+            libos,
+            args,
+            conns: Vec::new(),
+            conns_by_qd: HashMap::new(),
+            qts: Vec::new(),
+            pushes: HashMap::new(),
+        }
+    }
+
+    /// Runs one trial for each number of connections, and prints one report for each.
+    pub fn run(&mut self) -> Result<()> {
+        let libos_name: String = env::var("LIBOS").unwrap_or_default();
+        for nconns in self.args.connections.clone() {
+            let report: Report = self.trial(nconns)?;
+            println!("{}", self.format_report(&libos_name, &report));
+        }
+        Ok(())
+    }
+
+    /// Runs a trial with `nconns` connections.
+    fn trial(&mut self, nconns: usize) -> Result<Report> {
+        self.connect(nconns)?;
+
+        let mut latency: Box<Histogram> = Box::new(Histogram::new());
+        let mut requests: u64 = 0;
+        let mut skipped: u64 = 0;
+        let mut qrs: Vec<demi_qresult_t> = Vec::new();
+
+        let start: Instant = Instant::now();
+        let measure: Instant = start + self.args.warmup;
+        let end: Instant = measure + self.args.duration;
+        let mut stats_start: Option<demi_stats_t> = None;
+
+        // The open loop issues requests on a fixed schedule, and the closed loop starts with full windows.
+        let interval: Duration = Duration::from_nanos(1_000_000_000 / self.args.rate);
+        let mut next_due: Instant = start;
+        let mut next_conn: usize = 0;
+        if self.args.mode != Mode::OpenLoop {
+            for i in 0..self.conns.len() {
+                for _ in 0..self.args.outstanding {
+                    self.push_request(i, start)?;
+                }
+            }
+        }
+
+        loop {
+            let now: Instant = Instant::now();
+            if now >= end {
+                break;
+            }
+            if stats_start.is_none() && now >= measure {
+                stats_start = Some(stats::global());
+            }
+
+            // Issue open-loop requests that are due. Latency is measured from when a request was due rather than
+            // from when it was sent, so that a stalled server cannot hide its queueing delay.
+            let mut deadline: Instant = end;
+            if self.args.mode == Mode::OpenLoop {
+                while next_due <= now {
+                    if self.conns[next_conn].inflight.len() < self.args.outstanding {
+                        self.push_request(next_conn, next_due)?;
+                    } else if next_due >= measure {
+                        skipped += 1;
+                    }
+                    next_conn = (next_conn + 1) % self.conns.len();
+                    next_due += interval;
+                }
+                deadline = deadline.min(next_due);
+            }
+            if stats_start.is_none() {
+                deadline = deadline.min(measure);
+            }
+
+            // Wait for responses.
+            let nready: usize = self.wait(&mut qrs, deadline)?;
+            let now: Instant = Instant::now();
+            for qr in &qrs[..nready] {
+                for due in self.on_completion(qr)? {
+                    if due >= measure && now < end {
+                        latency.record((now - due).as_nanos() as u64);
+                        requests += 1;
+                    }
+                    // The closed loop replaces each response with a new request.
+                    if self.args.mode != Mode::OpenLoop {
+                        let i: usize = self.conns_by_qd[&QDesc::from(qr.qr_qd)];
+                        self.push_request(i, now)?;
+                    }
+                }
+            }
+        }
+
+        let stats_start: demi_stats_t = stats_start.unwrap_or_else(stats::global);
+        let stats_end: demi_stats_t = stats::global();
+        self.disconnect()?;
+
+        Ok(Report {
+            connections: nconns,
+            elapsed: self.args.duration,
+            requests,
+            skipped,
+            latency,
+            stats: stats_delta(&stats_start, &stats_end),
+        })
+    }
+
+    /// Opens `nconns` connections to the server.
+    fn connect(&mut self, nconns: usize) -> Result<()> {
+        for i in 0..nconns {
+            let qd: QDesc = match self.args.protocol {
+                Protocol::Tcp => {
+                    let qd: QDesc = match self.libos.socket(libc::AF_INET, libc::SOCK_STREAM, 0) {
+                        Ok(qd) => qd,
+                        Err(e) => bail!("failed to create socket: {:?}", e.cause),
+                    };
+                    let qt: QToken = match self.libos.connect(qd, self.args.addr) {
+                        Ok(qt) => qt,
+                        Err(e) => bail!("connect failed: {:?}", e.cause),
+                    };
+                    match self.libos.wait(qt) {
+                        Ok(qr) if qr.qr_opcode == demi_opcode_t::DEMI_OPC_CONNECT => (),
+                        Err(e) => bail!("operation failed: {:?}", e.cause),
+                        _ => bail!("connect failed"),
+                    }
+                    qd
+                },
+                Protocol::Udp => {
+                    // Each UDP connection gets a port of its own, so responses can be told apart.
+                    let base: SocketAddrV4 = self.args.local.expect("missing local address");
+                    let local: SocketAddrV4 = SocketAddrV4::new(*base.ip(), base.port() + i as u16);
+                    let qd: QDesc = match self.libos.socket(libc::AF_INET, libc::SOCK_DGRAM, 0) {
+                        Ok(qd) => qd,
+                        Err(e) => bail!("failed to create socket: {:?}", e.cause),
+                    };
+                    if let Err(e) = self.libos.bind(qd, local) {
+                        bail!("bind failed: {:?}", e.cause)
+                    }
+                    qd
+                },
+            };
+
+            match self.libos.pop(qd) {
+                Ok(qt) => self.qts.push(qt),
+                Err(e) => bail!("pop failed: {:?}", e.cause),
+            }
+            self.conns_by_qd.insert(qd, self.conns.len());
+            self.conns.push(Connection {
+                qd,
+                inflight: VecDeque::with_capacity(self.args.outstanding),
+                received: 0,
+            });
+        }
+
+        Ok(())
+    }
+
+    /// Waits for responses that are in flight to come back, and then closes all connections.
+    fn disconnect(&mut self) -> Result<()> {
+        let mut qrs: Vec<demi_qresult_t> = Vec::new();
+        let deadline: Instant = Instant::now() + Duration::from_secs(DRAIN_TIMEOUT);
+        while Instant::now() < deadline && self.conns.iter().any(|c| !c.inflight.is_empty()) {
+            let nready: usize = self.wait(&mut qrs, deadline)?;
+            for qr in &qrs[..nready] {
+                self.on_completion(qr)?;
+            }
+        }
+
+        for conn in self.conns.drain(..) {
+            if let Err(e) = self.libos.close(conn.qd) {
+                eprintln!("failed to close socket: {:?}", e.cause);
+            }
+        }
+        self.conns_by_qd.clear();
+        self.qts.clear();
+        for (_, sga) in self.pushes.drain() {
+            if let Err(e) = self.libos.sgafree(sga) {
+                eprintln!("failed to release scatter-gather array: {:?}", e);
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Sends a request on the `i`-th connection, that was due at `due`.
+    fn push_request(&mut self, i: usize, due: Instant) -> Result<()> {
+        let sga: demi_sgarray_t = match self.libos.sgaalloc(self.args.bufsize) {
+            Ok(sga) => sga,
+            Err(e) => bail!("failed to allocate scatter-gather array: {:?}", e.cause),
+        };
+        let ptr: *mut u8 = sga.sga_segs[0].sgaseg_buf as *mut u8;
+        let len: usize = sga.sga_segs[0].sgaseg_len as usize;
+        let data: &mut [u8] = unsafe { slice::from_raw_parts_mut(ptr, len) };
+        data.fill(FILL_CHAR);
+
+        let qd: QDesc = self.conns[i].qd;
+        let r: Result<QToken, Fail> = match self.args.protocol {
+            Protocol::Tcp => self.libos.push(qd, &sga),
+            Protocol::Udp => self.libos.pushto(qd, &sga, self.args.addr),
+        };
+        match r {
+            Ok(qt) => {
+                self.qts.push(qt);
+                self.pushes.insert(qt, sga);
+            },
+            Err(e) => bail!("push failed: {:?}", e.cause),
+        }
+        self.conns[i].inflight.push_back(due);
+
+        Ok(())
+    }
+
+    /// Waits for operations to complete until `deadline`, and returns how many did.
+    fn wait(&mut self, qrs: &mut Vec<demi_qresult_t>, deadline: Instant) -> Result<usize> {
+        let timeout: Duration = deadline.saturating_duration_since(Instant::now());
+        qrs.resize_with(self.qts.len(), || unsafe { mem::zeroed() });
+        match self.libos.wait_many(&self.qts, qrs, Some(SystemTime::now() + timeout)) {
+            Ok(nready) => {
+                for qr in &qrs[..nready] {
+                    remove_qtoken(&mut self.qts, qr.qr_qt.into());
+                }
+                Ok(nready)
+            },
+            Err(e) if e.errno == libc::ETIMEDOUT => Ok(0),
+            Err(e) => bail!("wait failed: {:?}", e.cause),
+        }
+    }
+
+    /// Handles a completed operation, and returns when the requests that it completed were due.
+    fn on_completion(&mut self, qr: &demi_qresult_t) -> Result<Vec<Instant>> {
+        let qt: QToken = qr.qr_qt.into();
+        let qd: QDesc = qr.qr_qd.into();
+        let mut completed: Vec<Instant> = Vec::new();
+
+        match qr.qr_opcode {
+            demi_opcode_t::DEMI_OPC_PUSH => {
+                if let Some(sga) = self.pushes.remove(&qt) {
+                    if let Err(e) = self.libos.sgafree(sga) {
+                        bail!("failed to release scatter-gather array: {:?}", e);
+                    }
+                }
+            },
+            demi_opcode_t::DEMI_OPC_POP => {
+                let sga: demi_sgarray_t = unsafe { qr.qr_value.sga };
+                let len: usize = sga.sga_segs[0].sgaseg_len as usize;
+                if let Err(e) = self.libos.sgafree(sga) {
+                    bail!("failed to release scatter-gather array: {:?}", e);
+                }
+                if len == 0 {
+                    bail!("server closed connection");
+                }
+
+                let bufsize: usize = self.args.bufsize;
+                let conn: &mut Connection = match self.conns_by_qd.get(&qd) {
+                    Some(&i) => &mut self.conns[i],
+                    None => bail!("response on unknown queue"),
+                };
+                match self.args.protocol {
+                    // A TCP response may arrive in several pieces, or together with the next ones.
+                    Protocol::Tcp => {
+                        conn.received += len;
+                        while conn.received >= bufsize {
+                            conn.received -= bufsize;
+                            if let Some(due) = conn.inflight.pop_front() {
+                                completed.push(due);
+                            }
+                        }
+                    },
+                    Protocol::Udp => {
+                        if let Some(due) = conn.inflight.pop_front() {
+                            completed.push(due);
+                        }
+                    },
+                }
+
+                match self.libos.pop(qd) {
+                    Ok(qt) => self.qts.push(qt),
+                    Err(e) => bail!("pop failed: {:?}", e.cause),
+                }
+            },
+            demi_opcode_t::DEMI_OPC_FAILED => bail!("operation failed on queue {:?}", qd),
+            _ => bail!("unexpected result"),
+        }
+
+        Ok(completed)
+    }
+
+    /// Formats a report as a single line of JSON.
+    fn format_report(&self, libos_name: &str, report: &Report) -> String {
+        let secs: f64 = report.elapsed.as_secs_f64();
+        let throughput_rps: f64 = report.requests as f64 / secs;
+        let throughput_bps: f64 = throughput_rps * (self.args.bufsize * 8) as f64;
+        let quantiles: String = QUANTILES
+            .iter()
+            .map(|(name, q)| format!("\"{}\":{}", name, report.latency.value_at_quantile(*q)))
+            .collect::<Vec<String>>()
+            .join(",");
+        let s: &demi_stats_t = &report.stats;
+
+        format!(
+            concat!(
+                "{{\"libos\":\"{}\",\"protocol\":\"{}\",\"mode\":\"{}\",\"bufsize\":{},\"connections\":{},",
+                "\"outstanding\":{},\"rate\":{},\"duration_s\":{:.3},\"requests\":{},\"skipped\":{},",
+                "\"throughput_rps\":{:.1},\"throughput_bps\":{:.1},",
+                "\"latency_ns\":{{\"min\":{},{},\"max\":{}}},",
+                "\"stats\":{{\"rx_packets\":{},\"tx_packets\":{},\"rx_burst_avg\":{:.2},\"tx_burst_avg\":{:.2},",
+                "\"mempool_exhausted\":{},\"retransmissions\":{},\"sched_polls\":{},\"sched_poll_cycles\":{}}}}}"
+            ),
+            libos_name,
+            match self.args.protocol {
+                Protocol::Tcp => "tcp",
+                Protocol::Udp => "udp",
+            },
+            match self.args.mode {
+                Mode::Rtt => "rtt",
+                Mode::ClosedLoop => "closed-loop",
+                Mode::OpenLoop => "open-loop",
+            },
+            self.args.bufsize,
+            report.connections,
+            self.args.outstanding,
+            if self.args.mode == Mode::OpenLoop {
+                self.args.rate
+            } else {
+                0
+            },
+            secs,
+            report.requests,
+            report.skipped,
+            throughput_rps,
+            throughput_bps,
+            report.latency.min(),
+            quantiles,
+            report.latency.max(),
+            s.rx_packets,
+            s.tx_packets,
+            s.rx_burst_avg,
+            s.tx_burst_avg,
+            s.mempool_exhausted,
+            s.retransmissions,
+            s.sched_polls,
+            s.sched_poll_cycles,
+        )
+    }
+}
+
+//======================================================================================================================
+// Standalone Functions
+//======================================================================================================================
+
+/// Removes a queue token from a set of pending operations.
+fn remove_qtoken(qts: &mut Vec<QToken>, qt: QToken) {
+    if let Some(i) = qts.iter().position(|&x| x == qt) {
+        qts.swap_remove(i);
+    }
+}
+
+/// Returns the runtime counters that were recorded between two snapshots.
+fn stats_delta(start: &demi_stats_t, end: &demi_stats_t) -> demi_stats_t {
+    let mut delta: demi_stats_t = demi_stats_t {
+        rx_packets: end.rx_packets.wrapping_sub(start.rx_packets),
+        rx_bursts: end.rx_bursts.wrapping_sub(start.rx_bursts),
+        tx_packets: end.tx_packets.wrapping_sub(start.tx_packets),
+        tx_bursts: end.tx_bursts.wrapping_sub(start.tx_bursts),
+        mempool_exhausted: end.mempool_exhausted.wrapping_sub(start.mempool_exhausted),
+        retransmissions: end.retransmissions.wrapping_sub(start.retransmissions),
+        sched_polls: end.sched_polls.wrapping_sub(start.sched_polls),
+        sched_poll_cycles: end.sched_poll_cycles.wrapping_sub(start.sched_poll_cycles),
+        ..Default::default()
+    };
+    if delta.rx_bursts > 0 {
+        delta.rx_burst_avg = delta.rx_packets as f64 / delta.rx_bursts as f64;
+    }
+    if delta.tx_bursts > 0 {
+        delta.tx_burst_avg = delta.tx_packets as f64 / delta.tx_bursts as f64;
+    }
+    delta
+}
+
+/// Converts a [sockaddr] into a [SocketAddrV4].
+fn sockaddr_to_socketaddrv4(saddr: *const libc::sockaddr) -> Result<SocketAddrV4> {
+    let sin: libc::sockaddr_in = unsafe { *mem::transmute::<*const libc::sockaddr, *const libc::sockaddr_in>(saddr) };
+    if sin.sin_family != libc::AF_INET as u16 {
+        bail!("communication domain not supported");
+    };
+    let addr: Ipv4Addr = Ipv4Addr::from(u32::from_be(sin.sin_addr.s_addr));
+    let port: u16 = u16::from_be(sin.sin_port);
+    Ok(SocketAddrV4::new(addr, port))
+}
+
+//======================================================================================================================
+// main()
+//======================================================================================================================
+
+/// Drives the benchmark.
+fn main() -> Result<()> {
+    let args: ProgramArguments = ProgramArguments::new(
+        "demibench",
+        "Microsoft Corporation",
+        "Measures latency and throughput of a LibOS",
+    )?;
+
+    let libos_name: LibOSName = match LibOSName::from_env() {
+        Ok(libos_name) => libos_name,
+        Err(e) => bail!("{:?}", e),
+    };
+    let libos: LibOS = match LibOS::new(libos_name) {
+        Ok(libos) => libos,
+        Err(e) => bail!("failed to initialize libos: {:?}", e.cause),
+    };
+
+    if args.server {
+        Server::new(libos, &args)?.run()
+    } else {
+        Client::new(libos, args).run()
+    }
+}
@@ -0,0 +1,16 @@
+# Copyright (c) Microsoft Corporation.
+# Licensed under the MIT license.
+
+# Suffix for executable files.
+export EXEC_SUFFIX := elf
+
+all: all-benchmarks
+	mkdir -p $(BINDIR)/benchmarks/rust
+	cp -f $(BUILD_DIR)/demibench $(BINDIR)/benchmarks/rust/demibench.$(EXEC_SUFFIX)
+
+all-benchmarks:
+	@echo "$(CARGO) build --bin demibench $(CARGO_FEATURES) $(CARGO_FLAGS)"
+	$(CARGO) build --bin demibench $(CARGO_FEATURES) $(CARGO_FLAGS)
+
+clean:
+	@rm -rf $(BINDIR)/benchmarks/rust/demibench.$(EXEC_SUFFIX)
@@ -35,6 +35,28 @@ extern "C"
      */
     extern int demi_socket(int *sockqd_out, int domain, int type, int protocol);
 
+    /**
+     * @brief Creates a shared-memory pipe I/O queue. The returned queue is the write end of the pipe: it only
+     * supports pushes, and pops on it fail with EINVAL.
+     *
+     * @param memqd_out Store location for the memory I/O queue descriptor.
+     * @param name      Name of the new pipe.
+     *
+     * @return On successful completion, zero is returned. On failure, a positive error code is returned instead.
+     */
+    extern int demi_create_pipe(int *memqd_out, const char *name);
+
+    /**
+     * @brief Opens a shared-memory pipe I/O queue that was created by another process. The returned queue is the read
+     * end of the pipe: it only supports pops, and pushes on it fail with EINVAL.
+     *
+     * @param memqd_out Store location for the memory I/O queue descriptor.
+     * @param name      Name of the target pipe.
+     *
+     * @return On successful completion, zero is returned. On failure, a positive error code is returned instead.
+     */
+    extern int demi_open_pipe(int *memqd_out, const char *name);
+
     /**
      * @brief Sets as passive a socket I/O queue.
      *
@@ -122,6 +144,61 @@ extern "C"
      */
     extern int demi_pop(demi_qtoken_t *qt_out, int qd);
 
+    /**
+     * @brief Asynchronously pushes scatter-gather arrays to several I/O queues at once.
+     *
+     * Operations are issued in order. If some operation fails, none of the following ones are issued. The I/O queue
+     * tokens of the operations that precede it are still stored in @p qts_out, and the entries of the failed operation
+     * and of those that follow it are set to #DEMI_QTOKEN_INVALID.
+     *
+     * @param qts_out Store location for I/O queue tokens. Must hold @p n entries.
+     * @param qds     Target I/O queue descriptors.
+     * @param sgas    Scatter-gather arrays to push, one for each I/O queue descriptor.
+     * @param n       Number of operations to issue.
+     *
+     * @return On successful completion, zero is returned. On failure, a positive error code is returned instead.
+     */
+    extern int demi_push_many(demi_qtoken_t qts_out[], const int qds[], const demi_sgarray_t sgas[], int n);
+
+    /**
+     * @brief Asynchronously pops scatter-gather arrays from several I/O queues at once.
+     *
+     * Operations are issued in order. If some operation fails, none of the following ones are issued. The I/O queue
+     * tokens of the operations that precede it are still stored in @p qts_out, and the entries of the failed operation
+     * and of those that follow it are set to #DEMI_QTOKEN_INVALID.
+     *
+     * @param qts_out Store location for I/O queue tokens. Must hold @p n entries.
+     * @param qds     Target I/O queue descriptors.
+     * @param n       Number of operations to issue.
+     *
+     * @return On successful completion, zero is returned. On failure, a positive error code is returned instead.
+     */
+    extern int demi_pop_many(demi_qtoken_t qts_out[], const int qds[], int n);
+
+    /**
+     * @brief Retrieves statistics of an I/O queue.
+     *
+     * @details Counters are those of the LibOS instance that runs on the calling thread. Retransmissions and the depth
+     * of the out-of-order queue are those of the connection, if @p qd is a TCP socket, and zero otherwise.
+     *
+     * @param qd        Target I/O queue descriptor.
+     * @param stats_out Store location for statistics.
+     *
+     * @return On successful completion, zero is returned. On failure, a positive error code is returned instead.
+     */
+    extern int demi_getstats(int qd, demi_stats_t *stats_out);
+
+    /**
+     * @brief Retrieves statistics of all LibOS instances in the process.
+     *
+     * @details This may be called from any thread, including threads that do not run a LibOS.
+     *
+     * @param stats_out Store location for statistics.
+     *
+     * @return On successful completion, zero is returned. On failure, a positive error code is returned instead.
+     */
+    extern int demi_getstats_global(demi_stats_t *stats_out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,13 +17,18 @@ extern "C"
 /**
  * @brief Maximum number of segments in a scatter-gather array.
  */
-#define DEMI_SGARRAY_MAXSIZE 1
+#define DEMI_SGARRAY_MAXSIZE 16
 
     /**
      * @brief An I/O queue token.
      */
     typedef uint64_t demi_qtoken_t;
 
+/**
+ * @brief I/O queue token that stands for no operation.
+ */
+#define DEMI_QTOKEN_INVALID UINT64_MAX
+
     /**
      * @brief A segment of a scatter-gather array.
      */
@@ -84,6 +89,27 @@ extern "C"
         } qr_value;
     } demi_qresult_t;
 
+    /**
+     * @brief Runtime statistics.
+     */
+    typedef struct demi_stats
+    {
+        uint64_t rx_packets;        /**< Number of packets received.                                  */
+        uint64_t rx_bytes;          /**< Number of bytes received.                                    */
+        uint64_t rx_bursts;         /**< Number of bursts of packets received.                        */
+        double rx_burst_avg;        /**< Average number of packets in a receive burst.                */
+        uint64_t tx_packets;        /**< Number of packets transmitted.                               */
+        uint64_t tx_bytes;          /**< Number of bytes transmitted.                                 */
+        uint64_t tx_bursts;         /**< Number of bursts of packets transmitted.                     */
+        double tx_burst_avg;        /**< Average number of packets in a transmit burst.               */
+        uint64_t mempool_exhausted; /**< Number of allocations that failed on an exhausted pool.      */
+        uint64_t retransmissions;   /**< Number of TCP segments retransmitted.                        */
+        uint64_t ooo_depth;         /**< Number of runs of out-of-order data held in TCP queues.      */
+        uint64_t sched_tasks;       /**< Number of tasks in schedulers.                               */
+        uint64_t sched_polls;       /**< Number of times that schedulers were polled.                 */
+        uint64_t sched_poll_cycles; /**< Number of cycles spent running tasks in schedulers.          */
+    } demi_stats_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -45,6 +45,21 @@ extern "C"
      */
     extern int demi_wait_any(demi_qresult_t *qr_out, int *ready_offset, const demi_qtoken_t qts[], int num_qts);
 
+    /**
+     * @brief Waits for at least one asynchronous I/O operation in a list to complete or a timeout to expire, and
+     * retrieves the results of all operations in the list that have completed by then.
+     *
+     * @param qrs_out Store location for the results of the completed I/O operations. Must hold @p num_qts entries.
+     * @param nready  Store location for the number of completed I/O operations stored in @p qrs_out.
+     * @param qts     List of I/O queue tokens to wait for completion.
+     * @param num_qts Length of the list of I/O queue tokens to wait for completion.
+     * @param abstime Absolute timeout in seconds and nanoseconds since Epoch. If NULL, waits indefinitely.
+     *
+     * @return On successful completion, zero is returned. On failure, a positive error code is returned instead.
+     */
+    extern int demi_wait_many(demi_qresult_t *qrs_out, int *nready, const demi_qtoken_t qts[], int num_qts,
+                              const struct timespec *abstime);
+
 #ifdef __cplusplus
 }
 #endif
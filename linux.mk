@@ -69,7 +69,7 @@ CARGO_FEATURES += $(FEATURES)
 
 #=======================================================================================================================
 
-all: all-libs all-tests all-examples
+all: all-libs all-tests all-examples all-benchmarks
 
 # Builds documentation.
 doc:
@@ -141,6 +141,24 @@ clean-examples-c:
 clean-examples-rust:
 	$(MAKE) -C examples/rust clean
 
+#=======================================================================================================================
+# Benchmarks
+#=======================================================================================================================
+
+# Builds all benchmarks.
+all-benchmarks: all-benchmarks-rust
+
+# Builds all Rust benchmarks.
+all-benchmarks-rust: all-libs
+	$(MAKE) -C benchmarks/rust all
+
+# Cleans all benchmarks.
+clean-benchmarks: clean-benchmarks-rust
+
+# Cleans all Rust benchmarks.
+clean-benchmarks-rust:
+	$(MAKE) -C benchmarks/rust clean
+
 #=======================================================================================================================
 # Check
 #=======================================================================================================================
@@ -162,7 +180,7 @@ check-fmt-rust:
 #=======================================================================================================================
 
 # Cleans up all build artifacts.
-clean: clean-examples clean-tests
+clean: clean-examples clean-benchmarks clean-tests
 	rm -rf target ; \
 	rm -f Cargo.lock ; \
 	$(CARGO) clean
@@ -183,6 +201,13 @@ test-system: test-system-rust
 test-system-rust:
 	timeout $(TIMEOUT) $(BINDIR)/examples/rust/$(TEST).elf $(ARGS)
 
+# Runs benchmarks.
+test-bench: test-bench-rust
+
+# Rust benchmarks.
+test-bench-rust:
+	timeout $(TIMEOUT) $(BINDIR)/benchmarks/rust/demibench.elf --peer $(PEER) $(ARGS)
+
 # Runs unit tests.
 test-unit: test-unit-rust
 
@@ -0,0 +1,29 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::demikernel::config::Config;
+
+//======================================================================================================================
+// Associated Functions
+//======================================================================================================================
+
+impl Config {
+    /// Reads the "submission queue polling" parameter from the underlying configuration file.
+    pub fn sqpoll(&self) -> Option<bool> {
+        self.0["catcollar"]["sqpoll"].as_bool()
+    }
+
+    /// Reads the "submission queue polling CPU" parameter from the underlying configuration file.
+    pub fn sqpoll_cpu(&self) -> Option<u32> {
+        self.0["catcollar"]["sqpoll_cpu"].as_i64().map(|n| n.max(0) as u32)
+    }
+
+    /// Reads the "submission queue polling idle time" parameter from the underlying configuration file.
+    pub fn sqpoll_idle_ms(&self) -> Option<u32> {
+        self.0["catcollar"]["sqpoll_idle_ms"].as_i64().map(|n| n.max(0) as u32)
+    }
+}
@@ -10,6 +10,7 @@ pub mod connect;
 pub mod pop;
 pub mod push;
 pub mod pushto;
+pub mod recv;
 
 //==============================================================================
 // Imports
@@ -21,6 +22,7 @@ use self::{
     pop::PopFuture,
     push::PushFuture,
     pushto::PushtoFuture,
+    recv::RecvFuture,
 };
 use crate::{
     inetstack::operations::OperationResult,
@@ -57,6 +59,8 @@ pub enum Operation {
     Pushto(FutureResult<PushtoFuture>),
     /// Pop operation.
     Pop(FutureResult<PopFuture>),
+    /// Receive operation.
+    Recv(FutureResult<RecvFuture>),
 }
 
 //==============================================================================
@@ -128,6 +132,16 @@ impl Operation {
                 done: Some(Err(e)),
             }) => (future.get_qd(), None, None, OperationResult::Failed(e)),
 
+            // Receive operation.
+            Operation::Recv(FutureResult {
+                future,
+                done: Some(Ok((addr, buf))),
+            }) => (future.get_qd(), None, None, OperationResult::Pop(addr, buf)),
+            Operation::Recv(FutureResult {
+                future,
+                done: Some(Err(e)),
+            }) => (future.get_qd(), None, None, OperationResult::Failed(e)),
+
             _ => panic!("future not ready"),
         }
     }
@@ -160,6 +174,7 @@ impl Future for Operation {
             Operation::Push(ref mut f) => Future::poll(Pin::new(f), ctx),
             Operation::Pushto(ref mut f) => Future::poll(Pin::new(f), ctx),
             Operation::Pop(ref mut f) => Future::poll(Pin::new(f), ctx),
+            Operation::Recv(ref mut f) => Future::poll(Pin::new(f), ctx),
         }
     }
 }
@@ -198,3 +213,10 @@ impl From<PopFuture> for Operation {
         Operation::Pop(FutureResult::new(f, None))
     }
 }
+
+/// From Trait Implementation for Operation Descriptors
+impl From<RecvFuture> for Operation {
+    fn from(f: RecvFuture) -> Self {
+        Operation::Recv(FutureResult::new(f, None))
+    }
+}
@@ -13,6 +13,7 @@ use crate::{
     runtime::{
         fail::Fail,
         memory::Buffer,
+        stats,
         QDesc,
     },
 };
@@ -79,6 +80,7 @@ impl Future for PopFuture {
             // Operation completed.
             Ok((addr, Some(size))) if size >= 0 => {
                 trace!("data received ({:?} bytes)", size);
+                stats::record_rx_burst(1, size as usize);
                 let trim_size: usize = self_.buf.len() - (size as usize);
                 let mut buf: Buffer = self_.buf.clone();
                 buf.trim(trim_size);
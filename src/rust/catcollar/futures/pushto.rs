@@ -12,6 +12,7 @@ use crate::{
     },
     runtime::{
         fail::Fail,
+        stats,
         QDesc,
     },
 };
@@ -70,6 +71,7 @@ impl Future for PushtoFuture {
             // Operation completed.
             Ok((_, Some(size))) if size >= 0 => {
                 trace!("data pushed ({:?} bytes)", size);
+                stats::record_tx_burst(1, size as usize);
                 Poll::Ready(Ok(()))
             },
             // Operation in progress, re-schedule future.
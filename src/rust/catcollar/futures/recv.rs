@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::{
+    catcollar::IoUringRuntime,
+    runtime::{
+        fail::Fail,
+        memory::Buffer,
+        stats,
+        QDesc,
+    },
+};
+use ::std::{
+    future::Future,
+    net::SocketAddrV4,
+    os::unix::prelude::RawFd,
+    pin::Pin,
+    task::{
+        Context,
+        Poll,
+    },
+};
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Receive Operation Descriptor
+///
+/// A pop operation that is served by the multishot receive that is armed on a socket, rather than by a request of
+/// its own.
+pub struct RecvFuture {
+    /// Underlying runtime.
+    rt: IoUringRuntime,
+    /// Associated queue descriptor.
+    qd: QDesc,
+    /// Associated socket.
+    fd: RawFd,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Receive Operation Descriptors
+impl RecvFuture {
+    /// Creates a descriptor for a receive operation.
+    pub fn new(rt: IoUringRuntime, qd: QDesc, fd: RawFd) -> Self {
+        Self { rt, qd, fd }
+    }
+
+    /// Returns the queue descriptor associated to the target receive operation descriptor.
+    pub fn get_qd(&self) -> QDesc {
+        self.qd
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Future Trait Implementation for Receive Operation Descriptors
+impl Future for RecvFuture {
+    type Output = Result<(Option<SocketAddrV4>, Buffer), Fail>;
+
+    /// Polls the underlying receive operation.
+    fn poll(self: Pin<&mut Self>, ctx: &mut Context<'_>) -> Poll<Self::Output> {
+        let self_: &mut RecvFuture = self.get_mut();
+        match self_.rt.peek_recv(self_.fd) {
+            // Operation completed.
+            Ok(Some(buf)) => {
+                trace!("data received ({:?} bytes)", buf.len());
+                stats::record_rx_burst(1, buf.len());
+                Poll::Ready(Ok((None, buf)))
+            },
+            // Operation in progress, re-schedule future.
+            Ok(None) => {
+                trace!("recv in progress");
+                ctx.waker().wake_by_ref();
+                Poll::Pending
+            },
+            // Operation failed.
+            Err(e) => {
+                warn!("recv failed ({:?})", e);
+                Poll::Ready(Err(e))
+            },
+        }
+    }
+}
@@ -5,11 +5,18 @@
 // Imports
 //==============================================================================
 
+use super::runtime::arena::BufferArena;
 use crate::runtime::{
     fail::Fail,
     liburing,
-    memory::Buffer,
+    memory::{
+        Buffer,
+        DataBuffer,
+    },
+    stats,
+    types::DEMI_SGARRAY_MAXLEN,
 };
+use ::arrayvec::ArrayVec;
 use ::libc::socklen_t;
 use ::nix::{
     errno,
@@ -20,11 +27,22 @@ use ::nix::{
     },
 };
 use ::std::{
+    collections::{
+        HashMap,
+        VecDeque,
+    },
     ffi::{
         c_void,
         CString,
     },
-    mem::MaybeUninit,
+    mem::{
+        self,
+        MaybeUninit,
+    },
+    net::{
+        Ipv4Addr,
+        SocketAddrV4,
+    },
     os::{
         raw::c_int,
         unix::prelude::RawFd,
@@ -36,14 +54,127 @@ use ::std::{
     rc::Rc,
 };
 
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Maximum number of requests that may be in flight in an IO user ring.
+const MAX_INFLIGHT_REQUESTS: usize = 1024;
+
+/// Number of entries in the table of registered files.
+const MAX_REGISTERED_FILES: usize = 1024;
+
+/// Flag of a submission queue entry that states that its file descriptor is an index in the table of registered
+/// files. This and the following flags are part of the kernel ABI.
+const IOSQE_FIXED_FILE: u8 = 1 << 0;
+
+/// Flag of a submission queue entry that lets the kernel pick a buffer from a provided buffer ring.
+const IOSQE_BUFFER_SELECT: u8 = 1 << 5;
+
+/// Flag of a receive request that keeps it armed after each completion.
+const IORING_RECV_MULTISHOT: u16 = 1 << 1;
+
+/// Flag of a completion queue entry that states that the kernel picked a buffer for it.
+const IORING_CQE_F_BUFFER: u32 = 1 << 0;
+
+/// Flag of a completion queue entry that states that more completions will follow for the same request.
+const IORING_CQE_F_MORE: u32 = 1 << 1;
+
+/// Offset of the buffer ID in the flags of a completion queue entry.
+const IORING_CQE_BUFFER_SHIFT: u32 = 16;
+
+/// Number of buffers in the provided buffer ring. This should be a power of two.
+const BUF_RING_NUM_ENTRIES: usize = 512;
+
+/// Buffer group ID of the provided buffer ring.
+const BUF_RING_GROUP_ID: u16 = 0;
+
+/// User data of requests whose completion is ignored.
+const IGNORED_REQUEST_ID: usize = usize::MAX;
+
+/// Maximum number of completions that are reaped at once.
+const REAP_BATCH_SIZE: usize = 64;
+
+/// Setup flag that makes a kernel thread poll the submission queue. This and the following flag are part of the
+/// kernel ABI.
+const IORING_SETUP_SQPOLL: u32 = 1 << 1;
+
+/// Setup flag that pins the submission queue polling thread to a given CPU.
+const IORING_SETUP_SQ_AFF: u32 = 1 << 2;
+
 //==============================================================================
 // Structures
 //==============================================================================
 
+/// Resources of an In-Flight Request
+///
+/// The kernel reads these until the request completes, so they live in a slab that is allocated once and is never
+/// resized.
+struct RequestSlot {
+    /// Message header.
+    msg: liburing::msghdr,
+    /// I/O vectors referenced by the message header.
+    iovs: [liburing::iovec; DEMI_SGARRAY_MAXLEN],
+    /// Socket address referenced by the message header.
+    addr: libc::sockaddr_in,
+    /// Buffers referenced by the I/O vectors, in order.
+    bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+    /// Socket of a multishot receive. Receives whose socket was closed have this set to `-1`.
+    recv_fd: Option<RawFd>,
+    /// Result of the request, once it has completed.
+    result: Option<i32>,
+}
+
+/// Submission Queue Polling Parameters
+#[derive(Clone, Copy, Debug)]
+pub struct SqPoll {
+    /// CPU to pin the polling thread to, if any.
+    pub cpu: Option<u32>,
+    /// Idle time after which the polling thread goes to sleep (in milliseconds).
+    pub idle_ms: u32,
+}
+
+/// Provided Buffer Ring
+///
+/// Buffers of the arena that are lent to the kernel, which picks one of them each time that data arrives on a
+/// multishot receive. Buffer IDs are indexes in the arena.
+struct BufRing {
+    /// Shared memory ring through which buffers are handed to the kernel.
+    ring: *mut liburing::io_uring_buf_ring,
+    /// Arena from which buffers are taken.
+    arena: Rc<BufferArena>,
+    /// Buffers that are owned by the kernel, by ID.
+    in_kernel: HashMap<u16, DataBuffer>,
+}
+
 /// IO User Ring
 pub struct IoUring {
     /// Underlying io_uring.
     io_uring: liburing::io_uring,
+    /// Is the submission queue polled by a kernel thread?
+    sqpoll: bool,
+    /// Defer submission of new requests until the next flush?
+    defer_submit: bool,
+    /// Number of requests that were prepared but not yet submitted.
+    nunsubmitted: usize,
+    /// Number of times that prepared requests were handed to the kernel.
+    nsubmits: usize,
+    /// Slab of in-flight requests.
+    requests: Box<[RequestSlot]>,
+    /// Free slots in the slab of in-flight requests.
+    free_requests: Vec<usize>,
+    /// Were buffers registered in the target IO user ring?
+    fixed_buffers: bool,
+    /// Indexes of registered files, or `None` if files cannot be registered.
+    fixed_files: Option<HashMap<RawFd, u32>>,
+    /// Free entries in the table of registered files.
+    free_files: Vec<u32>,
+    /// Provided buffer ring, or `None` if multishot receives are not supported.
+    buf_ring: Option<BufRing>,
+    /// Armed multishot receives, by socket.
+    armed: HashMap<RawFd, usize>,
+    /// Data received on multishot receives that was not popped yet, by socket.
+    received: HashMap<RawFd, VecDeque<Result<Buffer, Fail>>>,
 }
 
 //==============================================================================
@@ -52,11 +183,35 @@ pub struct IoUring {
 
 impl IoUring {
     /// Instantiates an IO user ring.
-    pub fn new(nentries: u32) -> Result<Self, Fail> {
+    ///
+    /// If `sqpoll` is set, a kernel thread polls the submission queue, so that submitting requests does not need a
+    /// system call. If the kernel refuses to create that thread (e.g. because of missing privileges), the IO user ring
+    /// falls back to regular submissions.
+    pub fn new(nentries: u32, sqpoll: Option<SqPoll>) -> Result<Self, Fail> {
         unsafe {
-            let mut params: MaybeUninit<liburing::io_uring_params> = MaybeUninit::zeroed();
             let mut io_uring: MaybeUninit<liburing::io_uring> = MaybeUninit::zeroed();
-            let ret: c_int = liburing::io_uring_queue_init_params(nentries, io_uring.as_mut_ptr(), params.as_mut_ptr());
+            let mut ret: c_int = -libc::EINVAL;
+            let mut sqpoll_enabled: bool = false;
+            if let Some(sqpoll) = sqpoll {
+                let mut params: liburing::io_uring_params = mem::zeroed();
+                params.flags = IORING_SETUP_SQPOLL;
+                params.sq_thread_idle = sqpoll.idle_ms;
+                if let Some(cpu) = sqpoll.cpu {
+                    params.flags |= IORING_SETUP_SQ_AFF;
+                    params.sq_thread_cpu = cpu;
+                }
+                ret = liburing::io_uring_queue_init_params(nentries, io_uring.as_mut_ptr(), &mut params);
+                if ret < 0 {
+                    warn!("cannot enable submission queue polling ({:?})", -ret);
+                    io_uring = MaybeUninit::zeroed();
+                } else {
+                    sqpoll_enabled = true;
+                }
+            }
+            if !sqpoll_enabled {
+                let mut params: MaybeUninit<liburing::io_uring_params> = MaybeUninit::zeroed();
+                ret = liburing::io_uring_queue_init_params(nentries, io_uring.as_mut_ptr(), params.as_mut_ptr());
+            }
             // Failed to initialize io_uring structure.
             if ret < 0 {
                 let errno: i32 = -ret;
@@ -64,172 +219,707 @@ impl IoUring {
                 let cause: &str = strerror.to_str().unwrap_or("failed to initialize io_uring");
                 return Err(Fail::new(errno, cause));
             }
+            let mut io_uring: liburing::io_uring = io_uring.assume_init();
+
+            // Register an empty table of files. Sockets are added to it as they are created.
+            let mut files: Vec<c_int> = vec![-1; MAX_REGISTERED_FILES];
+            let ret: c_int = liburing::io_uring_register_files(&mut io_uring, files.as_mut_ptr(), files.len() as u32);
+            let fixed_files: Option<HashMap<RawFd, u32>> = if ret < 0 {
+                warn!("cannot register files ({:?})", -ret);
+                None
+            } else {
+                Some(HashMap::new())
+            };
+
+            let requests: Box<[RequestSlot]> = (0..MAX_INFLIGHT_REQUESTS)
+                .map(|_| RequestSlot {
+                    msg: mem::zeroed(),
+                    iovs: mem::zeroed(),
+                    addr: mem::zeroed(),
+                    bufs: ArrayVec::new(),
+                    recv_fd: None,
+                    result: None,
+                })
+                .collect();
 
             Ok(Self {
-                io_uring: io_uring.assume_init(),
+                io_uring,
+                sqpoll: sqpoll_enabled,
+                defer_submit: false,
+                nunsubmitted: 0,
+                nsubmits: 0,
+                requests,
+                free_requests: (0..MAX_INFLIGHT_REQUESTS).rev().collect(),
+                fixed_buffers: false,
+                fixed_files,
+                free_files: (0..MAX_REGISTERED_FILES as u32).rev().collect(),
+                buf_ring: None,
+                armed: HashMap::new(),
+                received: HashMap::new(),
             })
         }
     }
 
-    /// Pushes a buffer to the target IO user ring.
-    pub fn push(&mut self, sockfd: RawFd, buf: Buffer) -> Result<*const liburing::msghdr, Fail> {
-        let len: usize = buf.len();
-        let data: &[u8] = &buf[..];
-        let data_ptr: *const u8 = data.as_ptr();
-        let io_uring: &mut liburing::io_uring = &mut self.io_uring;
+    /// Registers buffers in the target IO user ring. Requests may then refer to these buffers by their index in
+    /// `iovecs`.
+    pub fn register_buffers(&mut self, iovecs: &[liburing::iovec]) -> Result<(), Fail> {
+        let ret: c_int =
+            unsafe { liburing::io_uring_register_buffers(&mut self.io_uring, iovecs.as_ptr(), iovecs.len() as u32) };
+        if ret < 0 {
+            return Err(Fail::new(-ret, "failed to register buffers"));
+        }
+        self.fixed_buffers = true;
+        Ok(())
+    }
 
+    /// Sets up a provided buffer ring in the target IO user ring, which enables multishot receives. Buffers are taken
+    /// from `arena`.
+    pub fn register_buf_ring(&mut self, arena: Rc<BufferArena>) -> Result<(), Fail> {
+        let ring_size: usize = BUF_RING_NUM_ENTRIES * mem::size_of::<liburing::io_uring_buf>();
         unsafe {
-            // Allocate a submission queue entry.
-            let sqe: *mut liburing::io_uring_sqe = liburing::io_uring_get_sqe(io_uring);
-            if sqe.is_null() {
-                let errno: i32 = errno::errno();
-                let strerror: CString = CString::from_raw(libc::strerror(errno));
-                let cause: &str = strerror.to_str().unwrap_or("failed to get sqe");
-                return Err(Fail::new(errno, cause));
+            // The ring is shared with the kernel and should be page-aligned.
+            let ring: *mut c_void = libc::mmap(
+                ptr::null_mut(),
+                ring_size,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_ANONYMOUS | libc::MAP_PRIVATE,
+                -1,
+                0,
+            );
+            if ring == libc::MAP_FAILED {
+                return Err(Fail::new(errno::errno(), "failed to allocate buffer ring"));
             }
 
-            // Submit operation.
-            let mut iov: Box<liburing::iovec> = Box::new(liburing::iovec {
-                iov_base: data_ptr as *mut c_void,
-                iov_len: len as u64,
-            });
-            let iov_ptr: *mut liburing::iovec = iov.as_mut() as *mut liburing::iovec;
-            let msg: Rc<liburing::msghdr> = Rc::new(liburing::msghdr {
-                msg_name: ptr::null_mut() as *mut _,
-                msg_namelen: 0,
-                msg_iov: iov_ptr,
-                msg_iovlen: 1,
-                msg_control: ptr::null_mut() as *mut _,
-                msg_controllen: 0,
-                msg_flags: 0,
-            });
-            let msg_ptr: *const liburing::msghdr = Rc::into_raw(msg);
-            liburing::io_uring_sqe_set_data(sqe, msg_ptr as *mut c_void);
-            liburing::io_uring_prep_sendmsg(sqe, sockfd, msg_ptr, 0);
-            if liburing::io_uring_submit(io_uring) < 1 {
-                return Err(Fail::new(libc::EAGAIN, "failed to submit push operation"));
+            let mut reg: liburing::io_uring_buf_reg = mem::zeroed();
+            reg.ring_addr = ring as u64;
+            reg.ring_entries = BUF_RING_NUM_ENTRIES as u32;
+            reg.bgid = BUF_RING_GROUP_ID;
+            let ret: c_int = liburing::io_uring_register_buf_ring(&mut self.io_uring, &mut reg, 0);
+            if ret < 0 {
+                libc::munmap(ring, ring_size);
+                return Err(Fail::new(-ret, "failed to register buffer ring"));
             }
 
-            Ok(msg_ptr)
+            let ring: *mut liburing::io_uring_buf_ring = ring as *mut liburing::io_uring_buf_ring;
+            liburing::io_uring_buf_ring_init(ring);
+            self.buf_ring = Some(BufRing {
+                ring,
+                arena,
+                in_kernel: HashMap::new(),
+            });
         }
+
+        self.replenish_buf_ring();
+        Ok(())
     }
 
-    /// Pushes a buffer to the target IO user ring.
+    /// Arms a multishot receive on a socket, unless one is armed already. Data that it receives is retrieved with
+    /// [IoUring::take_received].
+    pub fn arm_recv(&mut self, sockfd: RawFd) -> Result<(), Fail> {
+        if self.buf_ring.is_none() {
+            return Err(Fail::new(libc::ENOTSUP, "multishot receives are not supported"));
+        }
+        if self.armed.contains_key(&sockfd) {
+            return Ok(());
+        }
+
+        self.replenish_buf_ring();
+        let request_id: usize = self.alloc_request()?;
+        let sqe: *mut liburing::io_uring_sqe = match self.get_sqe() {
+            Ok(sqe) => sqe,
+            Err(e) => {
+                self.free_requests.push(request_id);
+                return Err(e);
+            },
+        };
+        let (fd, flags): (c_int, u8) = self.get_file(sockfd);
+
+        unsafe {
+            liburing::io_uring_prep_recv(sqe, fd, ptr::null_mut(), 0, 0);
+            (*sqe).ioprio |= IORING_RECV_MULTISHOT;
+            (*sqe).flags |= flags | IOSQE_BUFFER_SELECT;
+            (*sqe).__bindgen_anon_4.buf_group = BUF_RING_GROUP_ID;
+            liburing::io_uring_sqe_set_data(sqe, request_id as *mut c_void);
+        }
+        // Completions of this request are routed to the socket, even if it goes out with a later submission.
+        self.requests[request_id].recv_fd = Some(sockfd);
+        self.armed.insert(sockfd, request_id);
+        self.submit_or_defer("failed to submit multishot receive")
+    }
+
+    /// Takes the oldest data that was received on a socket by a multishot receive, if any.
+    pub fn take_received(&mut self, sockfd: RawFd) -> Option<Result<Buffer, Fail>> {
+        self.received.get_mut(&sockfd)?.pop_front()
+    }
+
+    /// Cancels the multishot receive on a socket, if any, and drops data that was received but not popped.
+    pub fn cancel_recv(&mut self, sockfd: RawFd) -> Result<(), Fail> {
+        self.received.remove(&sockfd);
+        let request_id: usize = match self.armed.remove(&sockfd) {
+            Some(request_id) => request_id,
+            None => return Ok(()),
+        };
+
+        // Further completions of this request are dropped, and its slot is released once the kernel is done with it.
+        self.requests[request_id].recv_fd = Some(-1);
+        let sqe: *mut liburing::io_uring_sqe = self.get_sqe()?;
+        unsafe {
+            liburing::io_uring_prep_cancel(sqe, request_id as *mut c_void, 0);
+            liburing::io_uring_sqe_set_data(sqe, IGNORED_REQUEST_ID as *mut c_void);
+        }
+        self.submit_or_defer("failed to cancel multishot receive")
+    }
+
+    /// Registers a file in the target IO user ring. If the file cannot be registered, requests on it fall back to
+    /// using its file descriptor.
+    pub fn register_file(&mut self, fd: RawFd) {
+        let fixed_files: &mut HashMap<RawFd, u32> = match self.fixed_files.as_mut() {
+            Some(fixed_files) => fixed_files,
+            None => return,
+        };
+        let index: u32 = match self.free_files.pop() {
+            Some(index) => index,
+            None => {
+                warn!("table of registered files is full");
+                return;
+            },
+        };
+
+        let mut file: c_int = fd;
+        let ret: c_int = unsafe { liburing::io_uring_register_files_update(&mut self.io_uring, index, &mut file, 1) };
+        if ret < 0 {
+            warn!("cannot register file (fd={:?}, errno={:?})", fd, -ret);
+            self.free_files.push(index);
+            return;
+        }
+        fixed_files.insert(fd, index);
+    }
+
+    /// Unregisters a file in the target IO user ring.
+    pub fn unregister_file(&mut self, fd: RawFd) {
+        let index: u32 = match self
+            .fixed_files
+            .as_mut()
+            .and_then(|fixed_files| fixed_files.remove(&fd))
+        {
+            Some(index) => index,
+            None => return,
+        };
+
+        let mut file: c_int = -1;
+        let ret: c_int = unsafe { liburing::io_uring_register_files_update(&mut self.io_uring, index, &mut file, 1) };
+        if ret < 0 {
+            // Do not reuse this entry, because it may still refer to the file.
+            warn!("cannot unregister file (fd={:?}, errno={:?})", fd, -ret);
+            return;
+        }
+        self.free_files.push(index);
+    }
+
+    /// Pushes buffers to the target IO user ring, which sends them in order with a single request. If `buf_index` is
+    /// set, there is a single buffer and it lies in the registered buffer at that index.
+    pub fn push(
+        &mut self,
+        sockfd: RawFd,
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+        buf_index: Option<u16>,
+    ) -> Result<usize, Fail> {
+        let request_id: usize = self.alloc_request()?;
+        let sqe: *mut liburing::io_uring_sqe = match self.get_sqe() {
+            Ok(sqe) => sqe,
+            Err(e) => {
+                self.free_requests.push(request_id);
+                return Err(e);
+            },
+        };
+        let (fd, flags): (c_int, u8) = self.get_file(sockfd);
+
+        let slot: &mut RequestSlot = &mut self.requests[request_id];
+        slot.bufs = bufs;
+        let niovs: usize = Self::fill_iovs(slot);
+
+        unsafe {
+            match buf_index {
+                // Write straight from the registered buffer.
+                Some(buf_index) if self.fixed_buffers && niovs == 1 => {
+                    liburing::io_uring_prep_write_fixed(
+                        sqe,
+                        fd,
+                        slot.iovs[0].iov_base,
+                        slot.iovs[0].iov_len as u32,
+                        0,
+                        buf_index as c_int,
+                    );
+                },
+                _ => {
+                    slot.msg = liburing::msghdr {
+                        msg_name: ptr::null_mut() as *mut _,
+                        msg_namelen: 0,
+                        msg_iov: slot.iovs.as_mut_ptr(),
+                        msg_iovlen: niovs as u64,
+                        msg_control: ptr::null_mut() as *mut _,
+                        msg_controllen: 0,
+                        msg_flags: 0,
+                    };
+                    liburing::io_uring_prep_sendmsg(sqe, fd, &slot.msg, 0);
+                },
+            }
+            (*sqe).flags |= flags;
+            liburing::io_uring_sqe_set_data(sqe, request_id as *mut c_void);
+        }
+        self.submit_or_defer("failed to submit push operation")?;
+
+        Ok(request_id)
+    }
+
+    /// Pushes buffers to the target IO user ring, which sends them in order as a single datagram.
     pub fn pushto(
         &mut self,
         sockfd: RawFd,
         addr: SockaddrStorage,
-        buf: Buffer,
-    ) -> Result<*const liburing::msghdr, Fail> {
-        let len: usize = buf.len();
-        let data: &[u8] = &buf[..];
-        let data_ptr: *const u8 = data.as_ptr();
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+    ) -> Result<usize, Fail> {
         let saddr: &SockaddrIn = match addr.as_sockaddr_in() {
             Some(addr) => addr,
             None => return Err(Fail::new(libc::EINVAL, "invalid socket address")),
         };
-        let (sockaddr, addrlen): (&libc::sockaddr_in, socklen_t) = (saddr.as_ref(), saddr.len());
-        let sockaddr_ptr: *const libc::sockaddr_in = sockaddr as *const libc::sockaddr_in;
-        let io_uring: &mut liburing::io_uring = &mut self.io_uring;
+        let addrlen: socklen_t = saddr.len();
+
+        let request_id: usize = self.alloc_request()?;
+        let sqe: *mut liburing::io_uring_sqe = match self.get_sqe() {
+            Ok(sqe) => sqe,
+            Err(e) => {
+                self.free_requests.push(request_id);
+                return Err(e);
+            },
+        };
+        let (fd, flags): (c_int, u8) = self.get_file(sockfd);
+
+        let slot: &mut RequestSlot = &mut self.requests[request_id];
+        slot.bufs = bufs;
+        let niovs: usize = Self::fill_iovs(slot);
+        slot.addr = *saddr.as_ref();
+        slot.msg = liburing::msghdr {
+            msg_name: &mut slot.addr as *mut libc::sockaddr_in as *mut c_void,
+            msg_namelen: addrlen as u32,
+            msg_iov: slot.iovs.as_mut_ptr(),
+            msg_iovlen: niovs as u64,
+            msg_control: ptr::null_mut() as *mut _,
+            msg_controllen: 0,
+            msg_flags: 0,
+        };
 
         unsafe {
-            // Allocate a submission queue entry.
-            let sqe: *mut liburing::io_uring_sqe = liburing::io_uring_get_sqe(io_uring);
-            if sqe.is_null() {
-                let errno: i32 = errno::errno();
-                let strerror: CString = CString::from_raw(libc::strerror(errno));
-                let cause: &str = strerror.to_str().unwrap_or("failed to get sqe");
-                return Err(Fail::new(errno, cause));
+            liburing::io_uring_prep_sendmsg(sqe, fd, &slot.msg, 0);
+            (*sqe).flags |= flags;
+            liburing::io_uring_sqe_set_data(sqe, request_id as *mut c_void);
+        }
+        self.submit_or_defer("failed to submit push operation")?;
+
+        Ok(request_id)
+    }
+
+    /// Pops a buffer from the target IO user ring. If `buf_index` is set, the buffer lies in the registered buffer at
+    /// that index.
+    pub fn pop(&mut self, sockfd: RawFd, buf: Buffer, buf_index: Option<u16>) -> Result<usize, Fail> {
+        let request_id: usize = self.alloc_request()?;
+        let sqe: *mut liburing::io_uring_sqe = match self.get_sqe() {
+            Ok(sqe) => sqe,
+            Err(e) => {
+                self.free_requests.push(request_id);
+                return Err(e);
+            },
+        };
+        let (fd, flags): (c_int, u8) = self.get_file(sockfd);
+
+        let slot: &mut RequestSlot = &mut self.requests[request_id];
+        let len: usize = buf.len();
+        let data_ptr: *const u8 = buf.as_ptr();
+        slot.bufs.push(buf);
+
+        unsafe {
+            match buf_index {
+                // Read straight into the registered buffer.
+                Some(buf_index) if self.fixed_buffers => {
+                    liburing::io_uring_prep_read_fixed(
+                        sqe,
+                        fd,
+                        data_ptr as *mut c_void,
+                        len as u32,
+                        0,
+                        buf_index as c_int,
+                    );
+                },
+                _ => {
+                    slot.iovs[0] = liburing::iovec {
+                        iov_base: data_ptr as *mut c_void,
+                        iov_len: len as u64,
+                    };
+                    slot.msg = liburing::msghdr {
+                        msg_name: ptr::null_mut() as *mut _,
+                        msg_namelen: 0,
+                        msg_iov: slot.iovs.as_mut_ptr(),
+                        msg_iovlen: 1,
+                        msg_control: ptr::null_mut() as *mut _,
+                        msg_controllen: 0,
+                        msg_flags: 0,
+                    };
+                    liburing::io_uring_prep_recvmsg(sqe, fd, &mut slot.msg, 0);
+                },
             }
+            (*sqe).flags |= flags;
+            liburing::io_uring_sqe_set_data(sqe, request_id as *mut c_void);
+        }
+        self.submit_or_defer("failed to submit pop operation")?;
 
-            // Submit operation.
-            let mut iov: Box<liburing::iovec> = Box::new(liburing::iovec {
-                iov_base: data_ptr as *mut c_void,
-                iov_len: len as u64,
-            });
-            let iov_ptr: *mut liburing::iovec = iov.as_mut() as *mut liburing::iovec;
-            let msg: Rc<liburing::msghdr> = Rc::new(liburing::msghdr {
-                msg_name: sockaddr_ptr as *mut c_void,
-                msg_namelen: addrlen as u32,
-                msg_iov: iov_ptr,
-                msg_iovlen: 1,
-                msg_control: ptr::null_mut() as *mut _,
-                msg_controllen: 0,
-                msg_flags: 0,
-            });
-            let msg_ptr: *const liburing::msghdr = Rc::into_raw(msg);
-            liburing::io_uring_sqe_set_data(sqe, msg_ptr as *mut c_void);
-            liburing::io_uring_prep_sendmsg(sqe, sockfd, msg_ptr, 0);
-            if liburing::io_uring_submit(io_uring) < 1 {
-                return Err(Fail::new(libc::EAGAIN, "failed to submit push operation"));
+        Ok(request_id)
+    }
+
+    /// Releases the resources of a request that has completed. Returns the socket address that was attached to it,
+    /// if any.
+    pub fn release(&mut self, request_id: usize) -> Option<SocketAddrV4> {
+        let slot: &mut RequestSlot = &mut self.requests[request_id];
+        let addr: Option<SocketAddrV4> = if slot.msg.msg_name.is_null() {
+            None
+        } else {
+            let addr: Ipv4Addr = Ipv4Addr::from(u32::from_be(slot.addr.sin_addr.s_addr));
+            let port: u16 = u16::from_be(slot.addr.sin_port);
+            Some(SocketAddrV4::new(addr, port))
+        };
+
+        slot.msg = unsafe { mem::zeroed() };
+        slot.bufs.clear();
+        slot.recv_fd = None;
+        slot.result = None;
+        self.free_requests.push(request_id);
+
+        addr
+    }
+
+    /// Points the I/O vectors of a request slot at its buffers. Returns the number of I/O vectors.
+    fn fill_iovs(slot: &mut RequestSlot) -> usize {
+        for (iov, buf) in slot.iovs.iter_mut().zip(slot.bufs.iter()) {
+            *iov = liburing::iovec {
+                iov_base: buf.as_ptr() as *mut c_void,
+                iov_len: buf.len() as u64,
+            };
+        }
+        slot.bufs.len()
+    }
+
+    /// Defers the submission of new requests to the target IO user ring until [IoUring::flush] is called.
+    pub fn defer_submit(&mut self) {
+        self.defer_submit = true;
+    }
+
+    /// Submits all requests that were deferred in the target IO user ring, with a single system call.
+    pub fn flush(&mut self) -> Result<(), Fail> {
+        trace!(
+            "flush(): nunsubmitted={:?}, nsubmits={:?}",
+            self.nunsubmitted,
+            self.nsubmits
+        );
+        self.defer_submit = false;
+        self.submit_unsubmitted()
+    }
+
+    /// Lends free buffers of the arena to the kernel, until the provided buffer ring is full or the arena is exhausted.
+    fn replenish_buf_ring(&mut self) {
+        let buf_ring: &mut BufRing = match self.buf_ring.as_mut() {
+            Some(buf_ring) => buf_ring,
+            None => return,
+        };
+
+        let mask: c_int = unsafe { liburing::io_uring_buf_ring_mask(BUF_RING_NUM_ENTRIES as u32) };
+        let mut nadded: c_int = 0;
+        while buf_ring.in_kernel.len() < BUF_RING_NUM_ENTRIES {
+            let dbuf: DataBuffer = match buf_ring.arena.alloc() {
+                Some(dbuf) => dbuf,
+                None => break,
+            };
+            // Buffers of the arena are indexed by a 16-bit value, so this does not truncate.
+            let bid: u16 = buf_ring.arena.lookup(dbuf.as_ptr()).unwrap() as u16;
+            unsafe {
+                liburing::io_uring_buf_ring_add(
+                    buf_ring.ring,
+                    dbuf.as_ptr() as *mut c_void,
+                    dbuf.len() as u32,
+                    bid,
+                    mask,
+                    nadded,
+                );
             }
+            buf_ring.in_kernel.insert(bid, dbuf);
+            nadded += 1;
+        }
 
-            Ok(msg_ptr)
+        if nadded > 0 {
+            unsafe { liburing::io_uring_buf_ring_advance(buf_ring.ring, nadded) };
         }
     }
 
-    /// Pops a buffer from the target IO user ring.
-    pub fn pop(&mut self, sockfd: RawFd, buf: Buffer) -> Result<*const liburing::msghdr, Fail> {
-        let len: usize = buf.len();
-        let data: &[u8] = &buf[..];
-        let data_ptr: *const u8 = data.as_ptr();
-        let io_uring: &mut liburing::io_uring = &mut self.io_uring;
+    /// Handles a completion of a multishot receive on a socket.
+    fn complete_recv(&mut self, request_id: usize, sockfd: RawFd, res: i32, flags: u32) {
+        // Take the buffer that the kernel picked.
+        let dbuf: Option<DataBuffer> = if flags & IORING_CQE_F_BUFFER != 0 {
+            let bid: u16 = (flags >> IORING_CQE_BUFFER_SHIFT) as u16;
+            self.buf_ring
+                .as_mut()
+                .and_then(|buf_ring| buf_ring.in_kernel.remove(&bid))
+        } else {
+            None
+        };
+
+        // The receive was cancelled, so nobody will pop this.
+        if sockfd >= 0 {
+            let result: Option<Result<Buffer, Fail>> = match (res, dbuf) {
+                // Data was received.
+                (nbytes, Some(mut dbuf)) if nbytes >= 0 => {
+                    dbuf.trim(dbuf.len() - nbytes as usize);
+                    Some(Ok(Buffer::Heap(dbuf)))
+                },
+                // Connection was closed by the remote peer.
+                (0, None) => match self.buf_ring.as_ref().and_then(|buf_ring| buf_ring.arena.alloc()) {
+                    Some(mut dbuf) => {
+                        dbuf.trim(dbuf.len());
+                        Some(Ok(Buffer::Heap(dbuf)))
+                    },
+                    None => Some(Err(Fail::new(libc::ENOBUFS, "cannot allocate buffer"))),
+                },
+                // We ran out of buffers, so the receive is re-armed on the next pop.
+                (nbytes, _) if nbytes == -libc::ENOBUFS => {
+                    stats::record_mempool_exhausted();
+                    None
+                },
+                // Receive failed.
+                (nbytes, _) => Some(Err(Fail::new(-nbytes, "I/O error"))),
+            };
+            if let Some(result) = result {
+                self.received.entry(sockfd).or_default().push_back(result);
+            }
+        }
+
+        // The kernel disarmed the receive.
+        if flags & IORING_CQE_F_MORE == 0 {
+            if self.armed.get(&sockfd) == Some(&request_id) {
+                self.armed.remove(&sockfd);
+            }
+            self.release(request_id);
+        }
+
+        if let Some(buf_ring) = self.buf_ring.as_ref() {
+            if buf_ring.in_kernel.len() < BUF_RING_NUM_ENTRIES / 2 {
+                self.replenish_buf_ring();
+            }
+        }
+    }
+
+    /// Allocates a slot for a new request.
+    fn alloc_request(&mut self) -> Result<usize, Fail> {
+        match self.free_requests.pop() {
+            Some(request_id) => Ok(request_id),
+            None => Err(Fail::new(libc::EAGAIN, "too many operations in flight")),
+        }
+    }
+
+    /// Returns the file descriptor and the submission flags to use for a request on a given file.
+    fn get_file(&self, fd: RawFd) -> (c_int, u8) {
+        match self.fixed_files.as_ref().and_then(|fixed_files| fixed_files.get(&fd)) {
+            Some(&index) => (index as c_int, IOSQE_FIXED_FILE),
+            None => (fd, 0),
+        }
+    }
 
+    /// Allocates a submission queue entry, submitting deferred requests if we run out of entries.
+    fn get_sqe(&mut self) -> Result<*mut liburing::io_uring_sqe, Fail> {
         unsafe {
-            // Allocate a submission queue entry.
-            let sqe: *mut liburing::io_uring_sqe = liburing::io_uring_get_sqe(io_uring);
+            let mut sqe: *mut liburing::io_uring_sqe = liburing::io_uring_get_sqe(&mut self.io_uring);
+            if sqe.is_null() && self.nunsubmitted > 0 {
+                self.submit_unsubmitted()?;
+                sqe = liburing::io_uring_get_sqe(&mut self.io_uring);
+            }
             if sqe.is_null() {
                 let errno: i32 = errno::errno();
                 let strerror: CString = CString::from_raw(libc::strerror(errno));
                 let cause: &str = strerror.to_str().unwrap_or("failed to get sqe");
                 return Err(Fail::new(errno, cause));
             }
+            Ok(sqe)
+        }
+    }
 
-            // Submit operation.
-            let mut iov: Box<liburing::iovec> = Box::new(liburing::iovec {
-                iov_base: data_ptr as *mut c_void,
-                iov_len: len as u64,
-            });
-            let iov_ptr: *mut liburing::iovec = iov.as_mut() as *mut liburing::iovec;
-            let msg: Rc<liburing::msghdr> = Rc::new(liburing::msghdr {
-                msg_name: ptr::null_mut() as *mut _,
-                msg_namelen: 0,
-                msg_iov: iov_ptr,
-                msg_iovlen: 1,
-                msg_control: ptr::null_mut() as *mut _,
-                msg_controllen: 0,
-                msg_flags: 0,
-            });
-            let msg_ptr: *const liburing::msghdr = Rc::into_raw(msg);
-            liburing::io_uring_sqe_set_data(sqe, msg_ptr as *mut c_void);
-            liburing::io_uring_prep_recvmsg(sqe, sockfd, msg_ptr as *mut liburing::msghdr, 0);
-            if liburing::io_uring_submit(io_uring) < 1 {
-                return Err(Fail::new(libc::EAGAIN, "failed to submit pop operation"));
-            }
+    /// Submits the request that was last prepared, or defers its submission if we are batching requests.
+    fn submit_or_defer(&mut self, cause: &'static str) -> Result<(), Fail> {
+        if self.defer_submit {
+            self.nunsubmitted += 1;
+            return Ok(());
+        }
 
-            Ok(msg_ptr)
+        if self.submit() < 1 {
+            return Err(Fail::new(libc::EAGAIN, cause));
         }
+
+        Ok(())
     }
 
-    /// Waits for an operation to complete in the target IO user ring.
-    pub fn wait(&mut self) -> Result<(*mut liburing::msghdr, i32), Fail> {
-        let io_uring: &mut liburing::io_uring = &mut self.io_uring;
+    /// Submits all requests that were prepared but not yet submitted.
+    fn submit_unsubmitted(&mut self) -> Result<(), Fail> {
+        if self.nunsubmitted == 0 {
+            return Ok(());
+        }
+
+        let ret: c_int = self.submit();
+        if ret < 0 {
+            return Err(Fail::new(-ret, "failed to submit deferred operations"));
+        }
+
+        self.nunsubmitted -= (ret as usize).min(self.nunsubmitted);
+        if self.nunsubmitted > 0 {
+            return Err(Fail::new(libc::EAGAIN, "failed to submit deferred operations"));
+        }
+
+        Ok(())
+    }
+
+    /// Hands all prepared requests to the kernel. Returns the number of requests that were submitted, or a negated
+    /// error code.
+    fn submit(&mut self) -> c_int {
+        self.nsubmits += 1;
+        unsafe { liburing::io_uring_submit(&mut self.io_uring) }
+    }
+
+    /// Takes the result of a request, if it has completed.
+    pub fn take_completion(&mut self, request_id: usize) -> Option<i32> {
+        self.requests[request_id].result.take()
+    }
+
+    /// Reaps completions in the target IO user ring. If no completion is ready and the submission queue is not polled
+    /// by a kernel thread, this blocks until some request completes. Results of regular requests are retrieved with
+    /// [IoUring::take_completion], and data received on multishot receives with [IoUring::take_received].
+    pub fn poll(&mut self) -> Result<usize, Fail> {
+        let nreaped: usize = self.reap();
+        if nreaped > 0 || self.sqpoll {
+            return Ok(nreaped);
+        }
+
+        // Enter the kernel and wait, which also gives it a chance to run pending work.
         unsafe {
             let mut cqe_ptr: *mut liburing::io_uring_cqe = null_mut();
-            let cqe_ptr_ptr: *mut *mut liburing::io_uring_cqe = ptr::addr_of_mut!(cqe_ptr);
-            let wait_nr: c_int = liburing::io_uring_wait_cqe(io_uring, cqe_ptr_ptr);
-            if wait_nr < 0 {
-                let errno: i32 = -wait_nr;
+            let ret: c_int = liburing::io_uring_wait_cqe(&mut self.io_uring, &mut cqe_ptr);
+            if ret < 0 {
+                let errno: i32 = -ret;
                 warn!("io_uring_wait_cqe() failed ({:?})", errno);
                 return Err(Fail::new(errno, "operation in progress"));
-            } else if wait_nr == 0 {
-                let size: i32 = (*cqe_ptr).res;
-                let msg_ptr: *mut liburing::msghdr = liburing::io_uring_cqe_get_data(cqe_ptr) as *mut liburing::msghdr;
-                liburing::io_uring_cqe_seen(io_uring, cqe_ptr);
-                return Ok((msg_ptr, size));
             }
         }
+        Ok(self.reap())
+    }
+
+    /// Drains the completion queue of the target IO user ring, without blocking.
+    fn reap(&mut self) -> usize {
+        let mut nreaped: usize = 0;
+        loop {
+            // Copy completions out of the ring, so that their slots can be handed back to the kernel at once.
+            let mut cqes: [(usize, i32, u32); REAP_BATCH_SIZE] = [(0, 0, 0); REAP_BATCH_SIZE];
+            let ncqes: usize = unsafe {
+                let mut cqe_ptrs: [*mut liburing::io_uring_cqe; REAP_BATCH_SIZE] = [null_mut(); REAP_BATCH_SIZE];
+                let ncqes: usize = liburing::io_uring_peek_batch_cqe(
+                    &mut self.io_uring,
+                    cqe_ptrs.as_mut_ptr(),
+                    REAP_BATCH_SIZE as u32,
+                ) as usize;
+                for (cqe, &cqe_ptr) in cqes.iter_mut().zip(cqe_ptrs[..ncqes].iter()) {
+                    let request_id: usize = liburing::io_uring_cqe_get_data(cqe_ptr) as usize;
+                    *cqe = (request_id, (*cqe_ptr).res, (*cqe_ptr).flags);
+                }
+                liburing::io_uring_cq_advance(&mut self.io_uring, ncqes as u32);
+                ncqes
+            };
+
+            for &(request_id, res, flags) in &cqes[..ncqes] {
+                if request_id == IGNORED_REQUEST_ID {
+                    continue;
+                }
+                match self.requests[request_id].recv_fd {
+                    Some(sockfd) => self.complete_recv(request_id, sockfd, res, flags),
+                    None => self.requests[request_id].result = Some(res),
+                }
+            }
+
+            nreaped += ncqes;
+            if ncqes < REAP_BATCH_SIZE {
+                break nreaped;
+            }
+        }
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::IoUring;
+    use crate::runtime::{
+        memory::{
+            Buffer,
+            DataBuffer,
+        },
+        types::DEMI_SGARRAY_MAXLEN,
+    };
+    use ::arrayvec::ArrayVec;
+    use ::std::{
+        net::UdpSocket,
+        os::unix::prelude::AsRawFd,
+    };
+
+    /// Tests that requests that are prepared while submission is deferred reach the kernel with a single submission.
+    #[test]
+    fn test_io_uring_defer_submit() {
+        let mut io_uring: IoUring = IoUring::new(16, None).unwrap();
+        let rx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        let tx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        tx.connect(rx.local_addr().unwrap()).unwrap();
+
+        io_uring.defer_submit();
+        let request_ids: Vec<usize> = (0..4)
+            .map(|i| {
+                let mut bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN> = ArrayVec::new();
+                bufs.push(Buffer::Heap(DataBuffer::from_slice(&[i as u8; 32])));
+                io_uring.push(tx.as_raw_fd(), bufs, None).unwrap()
+            })
+            .collect();
+        assert_eq!(io_uring.nsubmits, 0);
+        assert_eq!(io_uring.nunsubmitted, 4);
+
+        io_uring.flush().unwrap();
+        assert_eq!(io_uring.nsubmits, 1);
+        assert_eq!(io_uring.nunsubmitted, 0);
+
+        // All requests complete, and datagrams arrive in the order in which requests were prepared.
+        for &request_id in &request_ids {
+            let nbytes: i32 = loop {
+                match io_uring.take_completion(request_id) {
+                    Some(nbytes) => break nbytes,
+                    None => {
+                        io_uring.poll().unwrap();
+                    },
+                }
+            };
+            assert_eq!(nbytes, 32);
+            io_uring.release(request_id);
+        }
+        let mut buf: [u8; 64] = [0; 64];
+        for i in 0..4 {
+            assert_eq!(rx.recv(&mut buf).unwrap(), 32);
+            assert!(buf[..32].iter().all(|b| *b == i as u8));
+        }
 
-        unreachable!("should not happen")
+        // Requests that are prepared afterwards are submitted right away.
+        let mut bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN> = ArrayVec::new();
+        bufs.push(Buffer::Heap(DataBuffer::from_slice(&[0; 32])));
+        io_uring.push(tx.as_raw_fd(), bufs, None).unwrap();
+        assert_eq!(io_uring.nsubmits, 2);
     }
 }
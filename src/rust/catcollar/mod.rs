@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+mod config;
 mod futures;
 mod iouring;
 mod runtime;
@@ -22,13 +23,22 @@ use self::{
         pop::PopFuture,
         push::PushFuture,
         pushto::PushtoFuture,
+        recv::RecvFuture,
         Operation,
     },
-    runtime::RequestId,
+    iouring::SqPoll,
+    runtime::{
+        RequestId,
+        CATCOLLAR_ARENA_BUFFER_SIZE,
+    },
 };
 use crate::{
-    demikernel::config::Config,
+    demikernel::{
+        config::Config,
+        shard,
+    },
     inetstack::operations::OperationResult,
+    pal::linux,
     runtime::{
         fail::Fail,
         memory::{
@@ -37,19 +47,27 @@ use crate::{
             MemoryRuntime,
         },
         queue::IoQueueTable,
+        stats,
         types::{
             demi_accept_result_t,
             demi_opcode_t,
             demi_qr_value_t,
             demi_qresult_t,
             demi_sgarray_t,
+            demi_stats_t,
+            DEMI_QTOKEN_INVALID,
+            DEMI_SGARRAY_MAXLEN,
         },
         QDesc,
         QToken,
         QType,
     },
-    scheduler::SchedulerHandle,
+    scheduler::{
+        Scheduler,
+        SchedulerHandle,
+    },
 };
+use ::arrayvec::ArrayVec;
 use ::libc::c_int;
 use ::nix::{
     sys::socket::{
@@ -65,6 +83,7 @@ use ::nix::{
 use ::std::{
     any::Any,
     collections::HashMap,
+    fmt::Debug,
     mem,
     net::{
         Ipv4Addr,
@@ -84,6 +103,9 @@ use crate::timer;
 // Size of receive buffers.
 const CATCOLLAR_RECVBUF_SIZE: usize = 9000;
 
+// Default idle time of the submission queue polling thread (in milliseconds).
+const CATCOLLAR_SQPOLL_IDLE_MS: u32 = 1000;
+
 //======================================================================================================================
 // Structures
 //======================================================================================================================
@@ -105,10 +127,17 @@ pub struct CatcollarLibOS {
 /// Associate Functions for Catcollar LibOS
 impl CatcollarLibOS {
     /// Instantiates a Catcollar LibOS.
-    pub fn new(_config: &Config) -> Self {
+    pub fn new(config: &Config) -> Self {
         let qtable: IoQueueTable = IoQueueTable::new();
         let sockets: HashMap<QDesc, RawFd> = HashMap::new();
-        let runtime: IoUringRuntime = IoUringRuntime::new();
+        let sqpoll: Option<SqPoll> = match config.sqpoll() {
+            Some(true) => Some(SqPoll {
+                cpu: config.sqpoll_cpu(),
+                idle_ms: config.sqpoll_idle_ms().unwrap_or(CATCOLLAR_SQPOLL_IDLE_MS),
+            }),
+            _ => None,
+        };
+        let runtime: IoUringRuntime = IoUringRuntime::new(sqpoll, config.slab_config());
         Self {
             qtable,
             sockets,
@@ -153,6 +182,7 @@ impl CatcollarLibOS {
                 }
                 let qd: QDesc = self.qtable.alloc(qtype.into());
                 assert_eq!(self.sockets.insert(qd, fd).is_none(), true);
+                self.runtime.register_socket(fd);
                 Ok(qd)
             },
             Err(err) => Err(Fail::new(err as i32, "failed to create socket")),
@@ -182,6 +212,14 @@ impl CatcollarLibOS {
         match self.sockets.get(&qd) {
             Some(&fd) => {
                 socket::listen(fd, backlog).unwrap();
+
+                // Steer connections that arrive on the core of this shard to this socket. If we fail, keep going
+                // because this is non-critical.
+                if let Some(cpu) = shard::current_cpu() {
+                    if unsafe { linux::set_so_incoming_cpu(fd, cpu) } != 0 {
+                        warn!("cannot set SO_INCOMING_CPU option");
+                    }
+                }
                 Ok(())
             },
             _ => Err(Fail::new(libc::EBADF, "invalid queue descriptor")),
@@ -233,20 +271,26 @@ impl CatcollarLibOS {
     pub fn close(&mut self, qd: QDesc) -> Result<(), Fail> {
         trace!("close() qd={:?}", qd);
         match self.sockets.get(&qd) {
-            Some(&fd) => match unistd::close(fd) {
-                Ok(_) => Ok(()),
-                _ => Err(Fail::new(libc::EBADF, "invalid queue descriptor")),
+            Some(&fd) => {
+                if let Err(e) = self.runtime.cancel_recv(fd) {
+                    warn!("cannot cancel multishot receive: {:?}", e);
+                }
+                self.runtime.unregister_socket(fd);
+                match unistd::close(fd) {
+                    Ok(_) => Ok(()),
+                    _ => Err(Fail::new(libc::EBADF, "invalid queue descriptor")),
+                }
             },
             _ => Err(Fail::new(libc::EBADF, "invalid queue descriptor")),
         }
     }
 
     // Handles a push operation.
-    fn do_push(&mut self, qd: QDesc, buf: Buffer) -> Result<QToken, Fail> {
+    fn do_push(&mut self, qd: QDesc, bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>) -> Result<QToken, Fail> {
         match self.sockets.get(&qd) {
             Some(&fd) => {
                 // Issue operation.
-                let request_id: RequestId = self.runtime.push(fd, buf.clone())?;
+                let request_id: RequestId = self.runtime.push(fd, bufs)?;
 
                 let future: Operation = Operation::from(PushFuture::new(self.runtime.clone(), request_id, qd));
                 let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
@@ -263,14 +307,15 @@ impl CatcollarLibOS {
     pub fn push(&mut self, qd: QDesc, sga: &demi_sgarray_t) -> Result<QToken, Fail> {
         trace!("push() qd={:?}", qd);
 
-        let buf: Buffer = self.runtime.clone_sgarray(sga)?;
+        // Segments are sent with a single request, without gathering them.
+        let bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN> = self.runtime.clone_sgarray_segments(sga)?;
 
-        if buf.len() == 0 {
+        if bufs.iter().all(|buf| buf.len() == 0) {
             return Err(Fail::new(libc::EINVAL, "zero-length buffer"));
         }
 
         // Issue push operation.
-        self.do_push(qd, buf)
+        self.do_push(qd, bufs)
     }
 
     // Pushes raw data to a socket.
@@ -283,16 +328,21 @@ impl CatcollarLibOS {
         }
 
         // Issue pushto operation.
-        self.do_push(qd, buf)
+        self.do_push(qd, ArrayVec::from_iter([buf]))
     }
 
     /// Handles a pushto operation.
-    fn do_pushto(&mut self, qd: QDesc, buf: Buffer, remote: SocketAddrV4) -> Result<QToken, Fail> {
+    fn do_pushto(
+        &mut self,
+        qd: QDesc,
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+        remote: SocketAddrV4,
+    ) -> Result<QToken, Fail> {
         match self.sockets.get(&qd) {
             Some(&fd) => {
                 // Issue operation.
                 let addr: SockaddrStorage = parse_addr(remote);
-                let request_id: RequestId = self.runtime.pushto(fd, addr, buf.clone())?;
+                let request_id: RequestId = self.runtime.pushto(fd, addr, bufs)?;
 
                 let future: Operation = Operation::from(PushtoFuture::new(self.runtime.clone(), request_id, qd));
                 let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
@@ -309,14 +359,15 @@ impl CatcollarLibOS {
     pub fn pushto(&mut self, qd: QDesc, sga: &demi_sgarray_t, remote: SocketAddrV4) -> Result<QToken, Fail> {
         trace!("pushto() qd={:?}", qd);
 
-        match self.runtime.clone_sgarray(sga) {
-            Ok(buf) => {
-                if buf.len() == 0 {
+        // Segments are sent as a single datagram, without gathering them.
+        match self.runtime.clone_sgarray_segments(sga) {
+            Ok(bufs) => {
+                if bufs.iter().all(|buf| buf.len() == 0) {
                     return Err(Fail::new(libc::EINVAL, "zero-length buffer"));
                 }
 
                 // Issue pushto operation.
-                self.do_pushto(qd, buf, remote)
+                self.do_pushto(qd, bufs, remote)
             },
             Err(e) => Err(e),
         }
@@ -332,29 +383,115 @@ impl CatcollarLibOS {
         }
 
         // Issue pushto operation.
-        self.do_pushto(qd, buf, remote)
+        self.do_pushto(qd, ArrayVec::from_iter([buf]), remote)
     }
 
     /// Pops data from a socket.
     pub fn pop(&mut self, qd: QDesc) -> Result<QToken, Fail> {
         trace!("pop() qd={:?}", qd);
 
-        let buf: Buffer = Buffer::Heap(DataBuffer::new(CATCOLLAR_RECVBUF_SIZE)?);
+        let fd: RawFd = match self.sockets.get(&qd) {
+            Some(&fd) => fd,
+            None => return Err(Fail::new(libc::EBADF, "invalid queue descriptor")),
+        };
 
-        // Issue pop operation.
-        match self.sockets.get(&qd) {
-            Some(&fd) => {
-                let request_id: RequestId = self.runtime.pop(fd, buf.clone())?;
-                let future: Operation = Operation::from(PopFuture::new(self.runtime.clone(), request_id, qd, buf));
-                let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
-                    Some(handle) => handle,
-                    None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
-                };
-                let qt: QToken = handle.into_raw().into();
-                Ok(qt)
+        // Receive through the multishot receive that is armed on the socket, if multishot receives are supported.
+        if self.runtime.arm_recv(fd).is_ok() {
+            let future: Operation = Operation::from(RecvFuture::new(self.runtime.clone(), qd, fd));
+            let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
+                Some(handle) => handle,
+                None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
+            };
+            let qt: QToken = handle.into_raw().into();
+            return Ok(qt);
+        }
+
+        // Receive into a registered buffer, if one is available.
+        let dbuf: DataBuffer = match self.runtime.alloc_buffer() {
+            Some(mut dbuf) => {
+                dbuf.trim(CATCOLLAR_ARENA_BUFFER_SIZE - CATCOLLAR_RECVBUF_SIZE);
+                dbuf
             },
-            _ => Err(Fail::new(libc::EBADF, "invalid queue descriptor")),
+            None => DataBuffer::new(CATCOLLAR_RECVBUF_SIZE)?,
+        };
+        let buf: Buffer = Buffer::Heap(dbuf);
+
+        // Issue pop operation.
+        let request_id: RequestId = self.runtime.pop(fd, buf.clone())?;
+        let future: Operation = Operation::from(PopFuture::new(self.runtime.clone(), request_id, qd, buf));
+        let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
+            Some(handle) => handle,
+            None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
+        };
+        let qt: QToken = handle.into_raw().into();
+        Ok(qt)
+    }
+
+    /// Pushes scatter-gather arrays to several sockets at once, submitting all operations to the kernel with a single
+    /// system call. Operations are issued in order and this function stops at the first one that fails, so that `qts`
+    /// holds the queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn push_many<Q: Copy + Debug + Into<QDesc>>(
+        &mut self,
+        qds: &[Q],
+        sgas: &[demi_sgarray_t],
+        qts: &mut [QToken],
+    ) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catcollar::push_many");
+        trace!("push_many() qds={:?}", qds);
+
+        // Check arguments.
+        if sgas.len() != qds.len() || qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+
+        self.runtime.defer_submit();
+        let mut ret: Result<(), Fail> = Ok(());
+        for (i, (&qd, sga)) in qds.iter().zip(sgas.iter()).enumerate() {
+            match self.push(qd.into(), sga) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    ret = Err(e);
+                    break;
+                },
+            }
+        }
+
+        // Submit operations that were issued, even if some operation failed.
+        let flushed: Result<(), Fail> = self.runtime.flush();
+        ret.and(flushed)
+    }
+
+    /// Pops data from several sockets at once, submitting all operations to the kernel with a single system call.
+    /// Operations are issued in order and this function stops at the first one that fails, so that `qts` holds the
+    /// queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn pop_many<Q: Copy + Debug + Into<QDesc>>(&mut self, qds: &[Q], qts: &mut [QToken]) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catcollar::pop_many");
+        trace!("pop_many() qds={:?}", qds);
+
+        // Check arguments.
+        if qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+
+        self.runtime.defer_submit();
+        let mut ret: Result<(), Fail> = Ok(());
+        for (i, &qd) in qds.iter().enumerate() {
+            match self.pop(qd.into()) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    ret = Err(e);
+                    break;
+                },
+            }
         }
+
+        // Submit operations that were issued, even if some operation failed.
+        let flushed: Result<(), Fail> = self.runtime.flush();
+        ret.and(flushed)
     }
 
     /// Waits for an operation to complete.
@@ -463,6 +600,39 @@ impl CatcollarLibOS {
         }
     }
 
+    /// Waits for at least one operation to complete or a timeout to expire, and packs the results of all operations
+    /// that have completed into `qrs`. If `abstime` is `None`, this function blocks until some operation completes.
+    /// Returns the number of results that were written.
+    pub fn wait_many(
+        &mut self,
+        qts: &[QToken],
+        qrs: &mut [demi_qresult_t],
+        abstime: Option<SystemTime>,
+    ) -> Result<usize, Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catcollar::wait_many");
+        trace!("wait_many() qts={:?}, timeout={:?}", qts, abstime);
+
+        if qrs.len() < qts.len() {
+            return Err(Fail::new(libc::EINVAL, "result array is too small"));
+        }
+
+        let mut nready: usize = 0;
+        let scheduler: Scheduler = self.runtime.scheduler.clone();
+        scheduler.wait_many(
+            self,
+            qts,
+            abstime,
+            |catcollar: &mut Self| catcollar.runtime.scheduler.poll(),
+            |_: &mut Self, _: Option<SystemTime>| (),
+            |catcollar: &mut Self, i: usize, handle: SchedulerHandle| {
+                let (qd, r): (QDesc, OperationResult) = catcollar.take_result(handle);
+                qrs[nready] = pack_result(&catcollar.runtime, r, qd, qts[i].into());
+                nready += 1;
+            },
+        )
+    }
+
     /// Allocates a scatter-gather array.
     pub fn sgaalloc(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
         trace!("sgalloc() size={:?}", size);
@@ -475,6 +645,15 @@ impl CatcollarLibOS {
         self.runtime.free_sgarray(sga)
     }
 
+    /// Retrieves statistics of the LibOS instance that serves an I/O queue.
+    pub fn getstats(&self, qd: QDesc) -> Result<demi_stats_t, Fail> {
+        trace!("getstats() qd={:?}", qd);
+        match self.sockets.get(&qd) {
+            Some(_) => Ok(stats::local()),
+            _ => Err(Fail::new(libc::EBADF, "invalid queue descriptor")),
+        }
+    }
+
     #[deprecated]
     pub fn local_ipv4_addr(&self) -> Ipv4Addr {
         todo!()
@@ -499,6 +678,7 @@ impl CatcollarLibOS {
             // Associate raw file descriptor with queue descriptor.
             if let Some(new_fd) = new_fd {
                 assert_eq!(self.sockets.insert(new_qd, new_fd).is_none(), true);
+                self.runtime.register_socket(new_fd);
             }
             // Release entry in queue table.
             else {
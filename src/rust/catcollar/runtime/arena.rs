@@ -0,0 +1,166 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::runtime::{
+    liburing,
+    memory::DataBuffer,
+};
+use ::std::{
+    cell::Cell,
+    ffi::c_void,
+    ptr,
+    sync::Arc,
+};
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Buffer Arena
+///
+/// A fixed set of equally-sized buffers that is allocated once and then registered with the kernel, so that I/O
+/// operations on them need neither a heap allocation nor pinning pages on every request. The arena keeps a reference
+/// to each buffer, thus a buffer is free when the arena holds the only reference to it.
+pub struct BufferArena {
+    /// Buffers, sorted by address.
+    slots: Vec<Arc<[u8]>>,
+    /// Size of each buffer.
+    slot_size: usize,
+    /// Next buffer to look at when allocating.
+    next: Cell<usize>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Buffer Arenas
+impl BufferArena {
+    /// Creates a buffer arena.
+    pub fn new(nslots: usize, slot_size: usize) -> Self {
+        let mut slots: Vec<Arc<[u8]>> = (0..nslots)
+            .map(|_| unsafe { Arc::new_zeroed_slice(slot_size).assume_init() })
+            .collect();
+        slots.sort_by_key(|slot| slot.as_ptr() as usize);
+        Self {
+            slots,
+            slot_size,
+            next: Cell::new(0),
+        }
+    }
+
+    /// Returns the size of the buffers in the target arena.
+    pub fn slot_size(&self) -> usize {
+        self.slot_size
+    }
+
+    /// Returns the I/O vectors that describe the buffers in the target arena, in index order.
+    pub fn iovecs(&self) -> Vec<liburing::iovec> {
+        self.slots
+            .iter()
+            .map(|slot| liburing::iovec {
+                iov_base: slot.as_ptr() as *mut c_void,
+                iov_len: self.slot_size as u64,
+            })
+            .collect()
+    }
+
+    /// Allocates a buffer from the target arena. Returns `None` if all buffers are in use.
+    pub fn alloc(&self) -> Option<DataBuffer> {
+        let nslots: usize = self.slots.len();
+        for i in 0..nslots {
+            let index: usize = (self.next.get() + i) % nslots;
+            let slot: &Arc<[u8]> = &self.slots[index];
+            if Arc::strong_count(slot) == 1 {
+                self.next.set((index + 1) % nslots);
+                let data_ptr: *const [u8] = Arc::into_raw(slot.clone());
+                return DataBuffer::from_raw_parts(data_ptr as *mut u8, self.slot_size).ok();
+            }
+        }
+        None
+    }
+
+    /// Returns the index of the buffer that contains a given address, if any.
+    pub fn lookup(&self, addr: *const u8) -> Option<usize> {
+        let addr: usize = addr as usize;
+        let index: usize = match self.slots.binary_search_by_key(&addr, |slot| slot.as_ptr() as usize) {
+            Ok(index) => index,
+            Err(0) => return None,
+            Err(index) => index - 1,
+        };
+        let base: usize = self.slots[index].as_ptr() as usize;
+        if addr < base + self.slot_size {
+            Some(index)
+        } else {
+            None
+        }
+    }
+
+    /// Returns the base address of a buffer in the target arena.
+    pub fn base(&self, index: usize) -> *const u8 {
+        self.slots[index].as_ptr()
+    }
+
+    /// Takes an additional reference to a buffer in the target arena, and returns it as a data buffer.
+    pub fn share(&self, index: usize) -> DataBuffer {
+        let data_ptr: *const [u8] = ptr::slice_from_raw_parts(self.base(index), self.slot_size);
+        unsafe { Arc::increment_strong_count(data_ptr) };
+        // The buffer has a non-null base address and a non-zero size, thus this does not fail.
+        DataBuffer::from_raw_parts(data_ptr as *mut u8, self.slot_size).unwrap()
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::BufferArena;
+    use crate::runtime::memory::DataBuffer;
+
+    /// Tests that buffers are handed out once and reused after they are released.
+    #[test]
+    fn test_arena_alloc_release() {
+        let arena: BufferArena = BufferArena::new(2, 64);
+        let a: DataBuffer = arena.alloc().unwrap();
+        let b: DataBuffer = arena.alloc().unwrap();
+        assert_ne!(a.as_ptr(), b.as_ptr());
+        assert!(arena.alloc().is_none());
+
+        let a_ptr: *const u8 = a.as_ptr();
+        drop(a);
+        let c: DataBuffer = arena.alloc().unwrap();
+        assert_eq!(c.as_ptr(), a_ptr);
+    }
+
+    /// Tests that addresses are mapped back to their buffers.
+    #[test]
+    fn test_arena_lookup() {
+        let arena: BufferArena = BufferArena::new(4, 64);
+        for index in 0..4 {
+            let base: *const u8 = arena.base(index);
+            assert_eq!(arena.lookup(base), Some(index));
+            assert_eq!(arena.lookup(unsafe { base.add(63) }), Some(index));
+        }
+        let heap: Vec<u8> = vec![0; 64];
+        assert_eq!(arena.lookup(heap.as_ptr()), None);
+    }
+
+    /// Tests that a shared buffer is not handed out until all references are released.
+    #[test]
+    fn test_arena_share() {
+        let arena: BufferArena = BufferArena::new(1, 64);
+        let a: DataBuffer = arena.alloc().unwrap();
+        let index: usize = arena.lookup(a.as_ptr()).unwrap();
+        let b: DataBuffer = arena.share(index);
+        drop(a);
+        assert!(arena.alloc().is_none());
+        drop(b);
+        assert!(arena.alloc().is_some());
+    }
+}
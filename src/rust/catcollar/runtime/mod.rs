@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+pub mod arena;
 mod memory;
 mod network;
 
@@ -8,28 +9,33 @@ mod network;
 // Imports
 //==============================================================================
 
-use super::iouring::IoUring;
+use self::arena::BufferArena;
+use super::iouring::{
+    IoUring,
+    SqPoll,
+};
 use crate::{
     runtime::{
         fail::Fail,
-        liburing,
-        memory::Buffer,
+        memory::{
+            Buffer,
+            DataBuffer,
+            SlabAllocator,
+            SlabConfig,
+        },
+        types::DEMI_SGARRAY_MAXLEN,
         Runtime,
     },
     scheduler::scheduler::Scheduler,
 };
+use ::arrayvec::ArrayVec;
 use ::nix::sys::socket::SockaddrStorage;
 use ::std::{
-    cell::RefCell,
-    collections::{
-        HashMap,
-        HashSet,
-    },
-    mem,
-    net::{
-        Ipv4Addr,
-        SocketAddrV4,
+    cell::{
+        RefCell,
+        RefMut,
     },
+    net::SocketAddrV4,
     os::unix::prelude::RawFd,
     rc::Rc,
 };
@@ -41,13 +47,19 @@ use ::std::{
 /// Number of slots in an I/O User ring.
 const CATCOLLAR_NUM_RINGS: u32 = 128;
 
+/// Number of buffers in the arena that is registered with the I/O user ring.
+const CATCOLLAR_ARENA_NUM_BUFFERS: usize = 1024;
+
+/// Size of the buffers in the arena that is registered with the I/O user ring.
+pub const CATCOLLAR_ARENA_BUFFER_SIZE: usize = 16384;
+
 //==============================================================================
 // Structures
 //==============================================================================
 
 /// Request ID
 #[derive(Clone, Copy, Hash, Debug, Eq, PartialEq)]
-pub struct RequestId(pub *const liburing::msghdr);
+pub struct RequestId(pub usize);
 
 /// I/O User Ring Runtime
 #[derive(Clone)]
@@ -56,10 +68,10 @@ pub struct IoUringRuntime {
     pub scheduler: Scheduler,
     /// Underlying io_uring.
     io_uring: Rc<RefCell<IoUring>>,
-    /// Pending requests.
-    pending: HashSet<RequestId>,
-    /// Completed requests.
-    completed: HashMap<RequestId, i32>,
+    /// Buffers that are registered with the underlying io_uring.
+    arena: Rc<BufferArena>,
+    /// Allocator for buffers of scatter-gather arrays that the arena cannot serve.
+    slab: Rc<SlabAllocator>,
 }
 
 //==============================================================================
@@ -68,105 +80,153 @@ pub struct IoUringRuntime {
 
 /// Associate Functions for I/O User Ring Runtime
 impl IoUringRuntime {
-    /// Creates an I/O user ring runtime.
-    pub fn new() -> Self {
-        let io_uring: IoUring = IoUring::new(CATCOLLAR_NUM_RINGS).expect("cannot create io_uring");
+    /// Creates an I/O user ring runtime. If `sqpoll` is set, the submission queue is polled by a kernel thread. `slab`
+    /// sizes the allocator that serves scatter-gather arrays that do not fit in the arena.
+    pub fn new(sqpoll: Option<SqPoll>, slab: SlabConfig) -> Self {
+        let mut io_uring: IoUring = IoUring::new(CATCOLLAR_NUM_RINGS, sqpoll).expect("cannot create io_uring");
+
+        // Register buffers with the kernel, so that it does not have to pin them on every operation. If this fails
+        // (e.g. because of RLIMIT_MEMLOCK), we keep using the arena, but operations go through regular opcodes.
+        let arena: BufferArena = BufferArena::new(CATCOLLAR_ARENA_NUM_BUFFERS, CATCOLLAR_ARENA_BUFFER_SIZE);
+        if let Err(e) = io_uring.register_buffers(&arena.iovecs()) {
+            warn!("cannot register buffers: {:?}", e);
+        }
+
+        // Lend buffers of the arena to the kernel, so that it can pick them on multishot receives. If this fails (e.g.
+        // because the kernel is too old), receives go through one request per pop.
+        let arena: Rc<BufferArena> = Rc::new(arena);
+        if let Err(e) = io_uring.register_buf_ring(arena.clone()) {
+            warn!("cannot register buffer ring: {:?}", e);
+        }
+
         Self {
             scheduler: Scheduler::default(),
             io_uring: Rc::new(RefCell::new(io_uring)),
-            pending: HashSet::new(),
-            completed: HashMap::new(),
+            arena,
+            slab: Rc::new(SlabAllocator::new(slab)),
         }
     }
 
-    /// Pushes a buffer to the target I/O user ring.
-    pub fn push(&mut self, sockfd: RawFd, buf: Buffer) -> Result<RequestId, Fail> {
-        let msg_ptr: *const liburing::msghdr = self.io_uring.borrow_mut().push(sockfd, buf)?;
-        let request_id: RequestId = RequestId(msg_ptr);
-        self.pending.insert(request_id);
+    /// Allocates a buffer from the arena that is registered with the target I/O user ring. Returns `None` if the
+    /// arena is exhausted.
+    pub fn alloc_buffer(&self) -> Option<DataBuffer> {
+        self.arena.alloc()
+    }
+
+    /// Registers a socket with the target I/O user ring.
+    pub fn register_socket(&mut self, sockfd: RawFd) {
+        self.io_uring.borrow_mut().register_file(sockfd);
+    }
+
+    /// Unregisters a socket from the target I/O user ring.
+    pub fn unregister_socket(&mut self, sockfd: RawFd) {
+        self.io_uring.borrow_mut().unregister_file(sockfd);
+    }
+
+    /// Pushes buffers to the target I/O user ring, which sends them in order with a single request.
+    pub fn push(&mut self, sockfd: RawFd, bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>) -> Result<RequestId, Fail> {
+        // Only single buffers may be written straight from the registered buffer that they lie in.
+        let buf_index: Option<u16> = match bufs.as_slice() {
+            [buf] => self.arena.lookup(buf.as_ptr()).map(|index| index as u16),
+            _ => None,
+        };
+        let request_id: RequestId = RequestId(self.io_uring.borrow_mut().push(sockfd, bufs, buf_index)?);
         Ok(request_id)
     }
 
-    /// Pushes a buffer to the target I/O user ring.
-    pub fn pushto(&mut self, sockfd: i32, addr: SockaddrStorage, buf: Buffer) -> Result<RequestId, Fail> {
-        let msg_ptr: *const liburing::msghdr = self.io_uring.borrow_mut().pushto(sockfd, addr, buf)?;
-        let request_id: RequestId = RequestId(msg_ptr);
-        self.pending.insert(request_id);
+    /// Pushes buffers to the target I/O user ring, which sends them in order as a single datagram.
+    pub fn pushto(
+        &mut self,
+        sockfd: i32,
+        addr: SockaddrStorage,
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+    ) -> Result<RequestId, Fail> {
+        let request_id: RequestId = RequestId(self.io_uring.borrow_mut().pushto(sockfd, addr, bufs)?);
         Ok(request_id)
     }
 
     /// Pops a buffer from the target I/O user ring.
     pub fn pop(&mut self, sockfd: RawFd, buf: Buffer) -> Result<RequestId, Fail> {
-        let msg_ptr: *const liburing::msghdr = self.io_uring.borrow_mut().pop(sockfd, buf)?;
-        let request_id: RequestId = RequestId(msg_ptr);
-        self.pending.insert(request_id);
+        let buf_index: Option<u16> = self.arena.lookup(buf.as_ptr()).map(|index| index as u16);
+        let request_id: RequestId = RequestId(self.io_uring.borrow_mut().pop(sockfd, buf, buf_index)?);
         Ok(request_id)
     }
 
+    /// Arms a multishot receive on a socket of the target I/O user ring, unless one is armed already.
+    pub fn arm_recv(&mut self, sockfd: RawFd) -> Result<(), Fail> {
+        self.io_uring.borrow_mut().arm_recv(sockfd)
+    }
+
+    /// Cancels the multishot receive on a socket of the target I/O user ring, if any.
+    pub fn cancel_recv(&mut self, sockfd: RawFd) -> Result<(), Fail> {
+        self.io_uring.borrow_mut().cancel_recv(sockfd)
+    }
+
+    /// Peeks for data received by the multishot receive on a socket of the target I/O user ring.
+    pub fn peek_recv(&mut self, sockfd: RawFd) -> Result<Option<Buffer>, Fail> {
+        if let Some(result) = self.io_uring.borrow_mut().take_received(sockfd) {
+            return result.map(Some);
+        }
+
+        // The kernel may have disarmed the receive (e.g. because it ran out of buffers).
+        self.arm_recv(sockfd)?;
+
+        // Reap completions in the underlying io_uring.
+        let result: Result<usize, Fail> = self.io_uring.borrow_mut().poll();
+        match result {
+            Ok(_) => (),
+            // Operation in progress.
+            Err(e) if e.errno == libc::EAGAIN => (),
+            // Something bad has happened.
+            Err(e) => return Err(e),
+        }
+
+        match self.io_uring.borrow_mut().take_received(sockfd) {
+            Some(result) => result.map(Some),
+            None => Ok(None),
+        }
+    }
+
+    /// Defers the submission of new operations to the target I/O user ring until [IoUringRuntime::flush] is called.
+    pub fn defer_submit(&mut self) {
+        self.io_uring.borrow_mut().defer_submit();
+    }
+
+    /// Submits all deferred operations in the target I/O user ring at once.
+    pub fn flush(&mut self) -> Result<(), Fail> {
+        self.io_uring.borrow_mut().flush()
+    }
+
     /// Peeks for the completion of an operation in the target I/O user ring.
     pub fn peek(&mut self, request_id: RequestId) -> Result<(Option<SocketAddrV4>, Option<i32>), Fail> {
-        // Check if pending request has completed.
-        match self.completed.remove(&request_id) {
-            // The target request has already completed.
-            Some(size) => {
-                let msg: Rc<liburing::msghdr> = unsafe { Rc::from_raw(request_id.0) };
-                let addr: Option<SocketAddrV4> = if msg.msg_name.is_null() {
-                    None
-                } else {
-                    let saddr: *const libc::sockaddr = msg.msg_name as *const libc::sockaddr;
-                    let sin: libc::sockaddr_in =
-                        unsafe { *mem::transmute::<*const libc::sockaddr, *const libc::sockaddr_in>(saddr) };
-                    let addr: Ipv4Addr = Ipv4Addr::from(u32::from_be(sin.sin_addr.s_addr));
-                    let port: u16 = u16::from_be(sin.sin_port);
-                    Some(SocketAddrV4::new(addr, port))
-                };
-
-                // Done.
-                Ok((addr, Some(size)))
-            },
-            // The target request may not be completed.
-            None => {
-                // Peek the underlying io_uring.
-                match self.io_uring.borrow_mut().wait() {
-                    // Some operation has completed.
-                    Ok((other_request_id, size)) => {
-                        // This is not the request that we are waiting for.
-                        if request_id.0 != other_request_id {
-                            let other_request_id: RequestId = RequestId(other_request_id);
-                            match self.pending.remove(&other_request_id) {
-                                true => self.completed.insert(other_request_id, size),
-                                false => None,
-                            };
-                            return Ok((None, None));
-                        }
-                        let msg: Rc<liburing::msghdr> = unsafe { Rc::from_raw(request_id.0) };
-                        let addr: Option<SocketAddrV4> = if msg.msg_name.is_null() {
-                            None
-                        } else {
-                            let saddr: *const libc::sockaddr = msg.msg_name as *const libc::sockaddr;
-                            let sin: libc::sockaddr_in =
-                                unsafe { *mem::transmute::<*const libc::sockaddr, *const libc::sockaddr_in>(saddr) };
-                            let addr: Ipv4Addr = Ipv4Addr::from(u32::from_be(sin.sin_addr.s_addr));
-                            let port: u16 = u16::from_be(sin.sin_port);
-                            Some(SocketAddrV4::new(addr, port))
-                        };
-
-                        // Done.
-                        Ok((addr, Some(size)))
-                    },
-                    // Something bad has happened.
-                    Err(e) => {
-                        match e.errno {
-                            // Operation in progress.
-                            libc::EAGAIN => Ok((None, None)),
-                            // Operation failed.
-                            _ => Err(e),
-                        }
-                    },
+        // Check if the target request has already completed.
+        if let Some(size) = self.take_completion(request_id) {
+            return Ok(size);
+        }
+
+        // Reap completions in the underlying io_uring.
+        let result: Result<usize, Fail> = self.io_uring.borrow_mut().poll();
+        match result {
+            Ok(_) => Ok(self.take_completion(request_id).unwrap_or((None, None))),
+            // Something bad has happened.
+            Err(e) => {
+                match e.errno {
+                    // Operation in progress.
+                    libc::EAGAIN => Ok((None, None)),
+                    // Operation failed.
+                    _ => Err(e),
                 }
             },
         }
     }
+
+    /// Takes the result of an operation in the target I/O user ring and releases it, if it has completed.
+    fn take_completion(&mut self, request_id: RequestId) -> Option<(Option<SocketAddrV4>, Option<i32>)> {
+        let mut io_uring: RefMut<IoUring> = self.io_uring.borrow_mut();
+        let size: i32 = io_uring.take_completion(request_id.0)?;
+        let addr: Option<SocketAddrV4> = io_uring.release(request_id.0);
+        Some((addr, Some(size)))
+    }
 }
 
 //==============================================================================
@@ -0,0 +1,84 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::{
+    catmem::pipe::SharedPipe,
+    runtime::{
+        fail::Fail,
+        QDesc,
+    },
+};
+use ::std::{
+    future::Future,
+    pin::Pin,
+    rc::Rc,
+    task::{
+        Context,
+        Poll,
+    },
+};
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Pop Operation Descriptor
+pub struct PopFuture {
+    /// Associated queue descriptor.
+    qd: QDesc,
+    /// Underlying pipe.
+    pipe: Rc<SharedPipe>,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for Pop Operation Descriptors
+impl PopFuture {
+    /// Creates a descriptor for a pop operation that reads from `pipe`.
+    pub fn new(qd: QDesc, pipe: Rc<SharedPipe>) -> Self {
+        Self { qd, pipe }
+    }
+
+    /// Returns the queue descriptor associated to the target [PopFuture].
+    pub fn get_qd(&self) -> QDesc {
+        self.qd
+    }
+
+    /// Returns the pipe associated to the target [PopFuture].
+    pub fn get_pipe(&self) -> Rc<SharedPipe> {
+        self.pipe.clone()
+    }
+}
+
+//======================================================================================================================
+// Trait Implementations
+//======================================================================================================================
+
+/// Future Trait Implementation for Pop Operation Descriptors
+impl Future for PopFuture {
+    /// Index, address and length of the slot of the pipe that holds the popped data.
+    type Output = Result<(u32, *mut u8, usize), Fail>;
+
+    /// Polls the target [PopFuture].
+    fn poll(self: Pin<&mut Self>, ctx: &mut Context<'_>) -> Poll<Self::Output> {
+        let self_: &mut PopFuture = self.get_mut();
+        match self_.pipe.read() {
+            // Operation completed.
+            Some((slot, ptr, len)) => {
+                trace!("data popped ({:?} bytes)", len);
+                Poll::Ready(Ok((slot, ptr, len)))
+            },
+            // Operation in progress. The writer lives in another process and it cannot notify us, so poll again.
+            None => {
+                ctx.waker().wake_by_ref();
+                Poll::Pending
+            },
+        }
+    }
+}
@@ -0,0 +1,190 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::{
+    catmem::pipe::SharedPipe,
+    runtime::{
+        fail::Fail,
+        memory::Buffer,
+        QDesc,
+    },
+};
+use ::std::{
+    future::Future,
+    pin::Pin,
+    rc::Rc,
+    task::{
+        Context,
+        Poll,
+    },
+};
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Push Operation Descriptor
+pub struct PushFuture {
+    /// Associated queue descriptor.
+    qd: QDesc,
+    /// Underlying pipe.
+    pipe: Rc<SharedPipe>,
+    /// Ticket that orders this push among others on the same pipe, until it is given back.
+    ticket: Option<u64>,
+    /// Data to write to the pipe as a whole, if it was not written when the push was issued.
+    buf: Option<Buffer>,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for Push Operation Descriptors
+impl PushFuture {
+    /// Creates a descriptor for a push operation that writes `buf` to `pipe`. If `buf` is `None`, the data was already
+    /// written, and the push operation completes right away.
+    pub fn new(qd: QDesc, pipe: Rc<SharedPipe>, buf: Option<Buffer>) -> Self {
+        let ticket: Option<u64> = buf.as_ref().map(|_| pipe.take_ticket());
+        Self { qd, pipe, ticket, buf }
+    }
+
+    /// Returns the queue descriptor associated to the target [PushFuture].
+    pub fn get_qd(&self) -> QDesc {
+        self.qd
+    }
+
+    /// Gives back the ticket of the target [PushFuture], if it still holds it, so that later pushes may proceed.
+    fn release_ticket(&mut self) {
+        if let Some(ticket) = self.ticket.take() {
+            self.pipe.release_ticket(ticket);
+        }
+    }
+}
+
+//======================================================================================================================
+// Trait Implementations
+//======================================================================================================================
+
+/// Future Trait Implementation for Push Operation Descriptors
+impl Future for PushFuture {
+    type Output = Result<(), Fail>;
+
+    /// Polls the target [PushFuture].
+    fn poll(self: Pin<&mut Self>, ctx: &mut Context<'_>) -> Poll<Self::Output> {
+        let self_: &mut PushFuture = self.get_mut();
+
+        let buf: &Buffer = match self_.buf.as_ref() {
+            Some(buf) => buf,
+            None => return Poll::Ready(Ok(())),
+        };
+
+        // Wait for preceding pushes to complete, and then for enough free slots to write the data as a whole.
+        if let Some(ticket) = self_.ticket {
+            if self_.pipe.is_serving(ticket) {
+                let len: usize = buf.len();
+                match self_.pipe.write(&[&buf[..]]) {
+                    // Operation completed.
+                    Ok(true) => {
+                        trace!("data pushed ({:?} bytes)", len);
+                        self_.release_ticket();
+                        return Poll::Ready(Ok(()));
+                    },
+                    Ok(false) => (),
+                    Err(e) => {
+                        warn!("push failed ({:?})", e);
+                        self_.release_ticket();
+                        return Poll::Ready(Err(e));
+                    },
+                }
+            }
+        }
+
+        // Operation in progress. The reader lives in another process and it cannot notify us, so poll again.
+        ctx.waker().wake_by_ref();
+        Poll::Pending
+    }
+}
+
+/// Drop Trait Implementation for Push Operation Descriptors
+impl Drop for PushFuture {
+    /// Gives back the ticket of a push operation that was dropped before it completed, e.g. because it could not be
+    /// scheduled, so that later pushes do not wait for it forever.
+    fn drop(&mut self) {
+        self.release_ticket();
+    }
+}
+
+//======================================================================================================================
+// Unit Tests
+//======================================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::PushFuture;
+    use crate::{
+        catmem::pipe::SharedPipe,
+        runtime::{
+            memory::{
+                Buffer,
+                DataBuffer,
+            },
+            QDesc,
+        },
+    };
+    use ::futures::task::noop_waker_ref;
+    use ::std::{
+        future::Future,
+        pin::Pin,
+        rc::Rc,
+        slice,
+        task::{
+            Context,
+            Poll,
+        },
+    };
+
+    /// Creates a push operation that writes `bytes` to `pipe`.
+    fn push(pipe: &Rc<SharedPipe>, bytes: &[u8]) -> PushFuture {
+        PushFuture::new(
+            QDesc::from(0),
+            pipe.clone(),
+            Some(Buffer::Heap(DataBuffer::from_slice(bytes))),
+        )
+    }
+
+    /// Tests that pushes that are dropped before they complete do not hold back later pushes.
+    #[test]
+    fn test_push_dropped() {
+        let writer: Rc<SharedPipe> = Rc::new(SharedPipe::create("shm-test-push-dropped").unwrap());
+        let reader: SharedPipe = SharedPipe::open("shm-test-push-dropped").unwrap();
+        let mut ctx: Context = Context::from_waker(noop_waker_ref());
+
+        // A push that is dropped on its turn lets the next one proceed.
+        let first: PushFuture = push(&writer, &[1]);
+        let mut second: PushFuture = push(&writer, &[2]);
+        drop(first);
+        assert!(matches!(Pin::new(&mut second).poll(&mut ctx), Poll::Ready(Ok(()))));
+
+        // A push that is dropped before its turn is skipped once the preceding one completes.
+        let mut third: PushFuture = push(&writer, &[3]);
+        let fourth: PushFuture = push(&writer, &[4]);
+        let mut fifth: PushFuture = push(&writer, &[5]);
+        drop(fourth);
+        assert!(Pin::new(&mut fifth).poll(&mut ctx).is_pending());
+        assert!(matches!(Pin::new(&mut third).poll(&mut ctx), Poll::Ready(Ok(()))));
+        assert!(matches!(Pin::new(&mut fifth).poll(&mut ctx), Poll::Ready(Ok(()))));
+        assert!(writer.is_idle());
+
+        // Only data of the pushes that completed reaches the reader.
+        let mut popped: Vec<u8> = Vec::new();
+        while let Some((slot, ptr, len)) = reader.read() {
+            popped.extend_from_slice(unsafe { slice::from_raw_parts(ptr, len) });
+            reader.release(slot);
+        }
+        assert_eq!(popped, vec![2, 3, 5]);
+    }
+}
@@ -0,0 +1,479 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+mod futures;
+mod pipe;
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use self::{
+    futures::{
+        pop::PopFuture,
+        push::PushFuture,
+        Operation,
+        OperationResult,
+    },
+    pipe::{
+        count_slots,
+        PipeEnd,
+        SharedPipe,
+    },
+};
+use crate::{
+    demikernel::config::Config,
+    runtime::{
+        fail::Fail,
+        memory::{
+            sgarray_segments,
+            Buffer,
+            DataBuffer,
+        },
+        queue::IoQueueTable,
+        stats,
+        types::{
+            demi_opcode_t,
+            demi_qr_value_t,
+            demi_qresult_t,
+            demi_sgarray_t,
+            demi_sgaseg_t,
+            demi_stats_t,
+            DEMI_QTOKEN_INVALID,
+            DEMI_SGARRAY_MAXLEN,
+        },
+        QDesc,
+        QToken,
+        QType,
+    },
+    scheduler::{
+        Scheduler,
+        SchedulerHandle,
+    },
+};
+use ::libc::{
+    c_void,
+    EBADF,
+    EINVAL,
+};
+use ::std::{
+    any::Any,
+    cell::RefCell,
+    collections::HashMap,
+    fmt::Debug,
+    mem,
+    rc::Rc,
+    slice,
+    time::SystemTime,
+};
+
+#[cfg(feature = "profiler")]
+use crate::timer;
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Catmem LibOS
+///
+/// Queues of this LibOS are shared-memory pipes between processes on the same host. Pushes copy data into the buffer
+/// arena of a pipe, and pops hand out scatter-gather arrays that point straight into it.
+pub struct CatmemLibOS {
+    /// Table of queue descriptors.
+    qtable: IoQueueTable,
+    /// Open pipes.
+    pipes: HashMap<QDesc, Rc<SharedPipe>>,
+    /// Slots of pipes that were handed to the application by pop operations, keyed by their address. The pipe is kept
+    /// alive until the application releases the slot, even if the pipe is closed.
+    loans: RefCell<HashMap<*const u8, (Rc<SharedPipe>, u32)>>,
+    /// Scheduler.
+    scheduler: Scheduler,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for Catmem LibOS
+impl CatmemLibOS {
+    /// Instantiates a Catmem LibOS.
+    pub fn new(_config: &Config) -> Self {
+        Self {
+            qtable: IoQueueTable::new(),
+            pipes: HashMap::new(),
+            loans: RefCell::new(HashMap::new()),
+            scheduler: Scheduler::default(),
+        }
+    }
+
+    /// Creates a named pipe, and returns a queue descriptor for its write end.
+    pub fn create_pipe(&mut self, name: &str) -> Result<QDesc, Fail> {
+        trace!("create_pipe() name={:?}", name);
+        let pipe: SharedPipe = SharedPipe::create(name)?;
+        Ok(self.insert_pipe(pipe))
+    }
+
+    /// Opens a named pipe that was created by another process, and returns a queue descriptor for its read end.
+    pub fn open_pipe(&mut self, name: &str) -> Result<QDesc, Fail> {
+        trace!("open_pipe() name={:?}", name);
+        let pipe: SharedPipe = SharedPipe::open(name)?;
+        Ok(self.insert_pipe(pipe))
+    }
+
+    /// Closes a pipe.
+    pub fn close(&mut self, qd: QDesc) -> Result<(), Fail> {
+        trace!("close() qd={:?}", qd);
+        match self.pipes.remove(&qd) {
+            Some(_) => {
+                self.qtable.free(qd);
+                Ok(())
+            },
+            None => Err(Fail::new(EBADF, "invalid queue descriptor")),
+        }
+    }
+
+    /// Pushes a scatter-gather array to the write end of a pipe.
+    pub fn push(&mut self, qd: QDesc, sga: &demi_sgarray_t) -> Result<QToken, Fail> {
+        trace!("push() qd={:?}", qd);
+        let segs: &[demi_sgaseg_t] = sgarray_segments(sga)?;
+        let segs: Vec<&[u8]> = segs
+            .iter()
+            .map(|seg| unsafe { slice::from_raw_parts(seg.sgaseg_buf as *const u8, seg.sgaseg_len as usize) })
+            .collect();
+        self.do_push(qd, &segs)
+    }
+
+    /// Pushes raw data to the write end of a pipe.
+    pub fn push2(&mut self, qd: QDesc, data: &[u8]) -> Result<QToken, Fail> {
+        trace!("push2() qd={:?}", qd);
+        self.do_push(qd, &[data])
+    }
+
+    /// Pops data from the read end of a pipe.
+    pub fn pop(&mut self, qd: QDesc) -> Result<QToken, Fail> {
+        trace!("pop() qd={:?}", qd);
+        match self.pipes.get(&qd) {
+            Some(pipe) if pipe.end() != PipeEnd::Read => {
+                Err(Fail::new(EINVAL, "cannot pop from the write end of a pipe"))
+            },
+            Some(pipe) => {
+                let future: Operation = Operation::from(PopFuture::new(qd, pipe.clone()));
+                let handle: SchedulerHandle = match self.scheduler.insert(future) {
+                    Some(handle) => handle,
+                    None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
+                };
+                Ok(handle.into_raw().into())
+            },
+            None => Err(Fail::new(EBADF, "invalid queue descriptor")),
+        }
+    }
+
+    /// Pushes scatter-gather arrays to several pipes at once. Operations are issued in order and this function stops
+    /// at the first one that fails, so that `qts` holds the queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn push_many<Q: Copy + Debug + Into<QDesc>>(
+        &mut self,
+        qds: &[Q],
+        sgas: &[demi_sgarray_t],
+        qts: &mut [QToken],
+    ) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catmem::push_many");
+        trace!("push_many() qds={:?}", qds);
+
+        // Check arguments.
+        if sgas.len() != qds.len() || qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+        for (i, (&qd, sga)) in qds.iter().zip(sgas.iter()).enumerate() {
+            match self.push(qd.into(), sga) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    return Err(e);
+                },
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Pops data from several pipes at once. Operations are issued in order and this function stops at the first one
+    /// that fails, so that `qts` holds the queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn pop_many<Q: Copy + Debug + Into<QDesc>>(&mut self, qds: &[Q], qts: &mut [QToken]) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catmem::pop_many");
+        trace!("pop_many() qds={:?}", qds);
+
+        // Check arguments.
+        if qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+        for (i, &qd) in qds.iter().enumerate() {
+            match self.pop(qd.into()) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    return Err(e);
+                },
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Waits for an operation to complete.
+    pub fn wait(&mut self, qt: QToken) -> Result<demi_qresult_t, Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catmem::wait");
+        trace!("wait() qt={:?}", qt);
+
+        // Retrieve associated schedule handle.
+        let handle: SchedulerHandle = match self.scheduler.from_raw_handle(qt.into()) {
+            Some(handle) => handle,
+            None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
+        };
+
+        loop {
+            // Poll first, so as to give pending operations a chance to complete.
+            self.scheduler.poll();
+
+            // The operation has completed, so extract the result and return.
+            if handle.has_completed() {
+                let (qd, result): (QDesc, OperationResult) = self.take_result(handle);
+                return Ok(self.pack_result(result, qd, qt.into()));
+            }
+        }
+    }
+
+    /// Waits for an I/O operation to complete or a timeout to expire.
+    pub fn timedwait(&mut self, qt: QToken, abstime: Option<SystemTime>) -> Result<demi_qresult_t, Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catmem::timedwait");
+        trace!("timedwait() qt={:?}, timeout={:?}", qt, abstime);
+
+        // Retrieve associated schedule handle.
+        let mut handle: SchedulerHandle = match self.scheduler.from_raw_handle(qt.into()) {
+            Some(handle) => handle,
+            None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
+        };
+
+        loop {
+            // Poll first, so as to give pending operations a chance to complete.
+            self.scheduler.poll();
+
+            // The operation has completed, so extract the result and return.
+            if handle.has_completed() {
+                let (qd, result): (QDesc, OperationResult) = self.take_result(handle);
+                return Ok(self.pack_result(result, qd, qt.into()));
+            }
+
+            if abstime.is_none() || SystemTime::now() >= abstime.unwrap() {
+                // Return this operation to the scheduling queue by removing the associated key
+                // (which would otherwise cause the operation to be freed).
+                handle.take_key();
+                return Err(Fail::new(libc::ETIMEDOUT, "timer expired"));
+            }
+        }
+    }
+
+    /// Waits for any operation to complete.
+    pub fn wait_any(&mut self, qts: &[QToken]) -> Result<(usize, demi_qresult_t), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catmem::wait_any");
+        trace!("wait_any(): qts={:?}", qts);
+
+        loop {
+            // Poll first, so as to give pending operations a chance to complete.
+            self.scheduler.poll();
+
+            // Search for any operation that has completed.
+            for (i, &qt) in qts.iter().enumerate() {
+                // Retrieve associated schedule handle.
+                let mut handle: SchedulerHandle = match self.scheduler.from_raw_handle(qt.into()) {
+                    Some(handle) => handle,
+                    None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
+                };
+
+                // Found one, so extract the result and return.
+                if handle.has_completed() {
+                    let (qd, result): (QDesc, OperationResult) = self.take_result(handle);
+                    return Ok((i, self.pack_result(result, qd, qt.into())));
+                }
+
+                // Return this operation to the scheduling queue by removing the associated key
+                // (which would otherwise cause the operation to be freed).
+                handle.take_key();
+            }
+        }
+    }
+
+    /// Waits for at least one operation to complete or a timeout to expire, and packs the results of all operations
+    /// that have completed into `qrs`. If `abstime` is `None`, this function blocks until some operation completes.
+    /// Returns the number of results that were written.
+    pub fn wait_many(
+        &mut self,
+        qts: &[QToken],
+        qrs: &mut [demi_qresult_t],
+        abstime: Option<SystemTime>,
+    ) -> Result<usize, Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catmem::wait_many");
+        trace!("wait_many() qts={:?}, timeout={:?}", qts, abstime);
+
+        if qrs.len() < qts.len() {
+            return Err(Fail::new(libc::EINVAL, "result array is too small"));
+        }
+
+        let mut nready: usize = 0;
+        let scheduler: Scheduler = self.scheduler.clone();
+        scheduler.wait_many(
+            self,
+            qts,
+            abstime,
+            |catmem: &mut Self| catmem.scheduler.poll(),
+            |_: &mut Self, _: Option<SystemTime>| (),
+            |catmem: &mut Self, i: usize, handle: SchedulerHandle| {
+                let (qd, result): (QDesc, OperationResult) = catmem.take_result(handle);
+                qrs[nready] = catmem.pack_result(result, qd, qts[i].into());
+                nready += 1;
+            },
+        )
+    }
+
+    /// Allocates a scatter-gather array.
+    pub fn sgaalloc(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
+        trace!("sgalloc() size={:?}", size);
+        let dbuf: DataBuffer = DataBuffer::new(size)?;
+        let (dbuf_ptr, data_ptr): (*const u8, *const u8) = DataBuffer::into_raw_parts(dbuf)?;
+        Ok(make_sgarray(dbuf_ptr, data_ptr, size))
+    }
+
+    /// Frees a scatter-gather array. Arrays that were popped from a pipe give their slot back to it.
+    pub fn sgafree(&self, sga: demi_sgarray_t) -> Result<(), Fail> {
+        trace!("sgafree()");
+
+        // Check arguments.
+        sgarray_segments(&sga)?;
+
+        let dbuf_ptr: *const u8 = sga.sga_buf as *const u8;
+        if let Some((pipe, slot)) = self.loans.borrow_mut().remove(&dbuf_ptr) {
+            pipe.release(slot);
+            return Ok(());
+        }
+
+        // Slots of pipes that are not lent out (e.g. that were already freed) are not heap-managed buffers.
+        if self.pipes.values().any(|pipe| pipe.contains(dbuf_ptr)) {
+            return Err(Fail::new(EINVAL, "scatter-gather array is not lent out"));
+        }
+
+        // Release heap-managed buffer.
+        let (dbuf_ptr, length): (*mut u8, usize) = (sga.sga_buf as *mut u8, sga.sga_segs[0].sgaseg_len as usize);
+        DataBuffer::from_raw_parts(dbuf_ptr, length)?;
+
+        Ok(())
+    }
+
+    /// Retrieves statistics of the LibOS instance that serves an I/O queue.
+    pub fn getstats(&self, qd: QDesc) -> Result<demi_stats_t, Fail> {
+        trace!("getstats() qd={:?}", qd);
+        match self.pipes.get(&qd) {
+            Some(_) => Ok(stats::local()),
+            _ => Err(Fail::new(EBADF, "invalid queue descriptor")),
+        }
+    }
+
+    /// Registers a pipe in the table of queue descriptors.
+    fn insert_pipe(&mut self, pipe: SharedPipe) -> QDesc {
+        let qd: QDesc = self.qtable.alloc(QType::MemoryQueue.into());
+        assert!(self.pipes.insert(qd, Rc::new(pipe)).is_none());
+        qd
+    }
+
+    /// Handles a push operation. The data is written to the pipe right away if no preceding push is in progress and
+    /// there are enough free slots for all of it. Otherwise, it is copied for the push operation to write later on. In
+    /// both cases, it is written as a whole, so that the message is never torn.
+    fn do_push(&mut self, qd: QDesc, segs: &[&[u8]]) -> Result<QToken, Fail> {
+        let pipe: Rc<SharedPipe> = match self.pipes.get(&qd) {
+            Some(pipe) if pipe.end() != PipeEnd::Write => {
+                return Err(Fail::new(EINVAL, "cannot push to the read end of a pipe"))
+            },
+            Some(pipe) => pipe.clone(),
+            None => return Err(Fail::new(EBADF, "invalid queue descriptor")),
+        };
+        if segs.iter().all(|seg| seg.is_empty()) {
+            return Err(Fail::new(EINVAL, "zero-length buffer"));
+        }
+        // Check the size of all segments before writing any of them.
+        count_slots(segs)?;
+
+        let written: bool = pipe.is_idle() && pipe.write(segs)?;
+        let buf: Option<Buffer> = if written {
+            None
+        } else {
+            Some(Buffer::Heap(DataBuffer::from_slice(&segs.concat())))
+        };
+        let future: Operation = Operation::from(PushFuture::new(qd, pipe, buf));
+        let handle: SchedulerHandle = match self.scheduler.insert(future) {
+            Some(handle) => handle,
+            None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
+        };
+        Ok(handle.into_raw().into())
+    }
+
+    /// Takes out the [OperationResult] associated with the target [SchedulerHandle].
+    fn take_result(&mut self, handle: SchedulerHandle) -> (QDesc, OperationResult) {
+        let boxed_future: Box<dyn Any> = self.scheduler.take(handle).as_any();
+        let boxed_concrete_type: Operation = *boxed_future.downcast::<Operation>().expect("Wrong type!");
+        boxed_concrete_type.get_result()
+    }
+
+    /// Packs a [OperationResult] into a [demi_qresult_t]. Popped data is lent to the application in place.
+    fn pack_result(&self, result: OperationResult, qd: QDesc, qt: u64) -> demi_qresult_t {
+        match result {
+            OperationResult::Push => demi_qresult_t {
+                qr_opcode: demi_opcode_t::DEMI_OPC_PUSH,
+                qr_qd: qd.into(),
+                qr_qt: qt,
+                qr_value: unsafe { mem::zeroed() },
+            },
+            OperationResult::Pop(pipe, slot, ptr, len) => {
+                self.loans.borrow_mut().insert(ptr as *const u8, (pipe, slot));
+                let sga: demi_sgarray_t = make_sgarray(ptr, ptr, len);
+                demi_qresult_t {
+                    qr_opcode: demi_opcode_t::DEMI_OPC_POP,
+                    qr_qd: qd.into(),
+                    qr_qt: qt,
+                    qr_value: demi_qr_value_t { sga },
+                }
+            },
+            OperationResult::Failed(e) => {
+                warn!("Operation Failed: {:?}", e);
+                demi_qresult_t {
+                    qr_opcode: demi_opcode_t::DEMI_OPC_FAILED,
+                    qr_qd: qd.into(),
+                    qr_qt: qt,
+                    qr_value: unsafe { mem::zeroed() },
+                }
+            },
+        }
+    }
+}
+
+//======================================================================================================================
+// Standalone Functions
+//======================================================================================================================
+
+/// Builds a single-segment scatter-gather array.
+fn make_sgarray(buf_ptr: *const u8, data_ptr: *const u8, len: usize) -> demi_sgarray_t {
+    let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+    sga_segs[0] = demi_sgaseg_t {
+        sgaseg_buf: data_ptr as *mut c_void,
+        sgaseg_len: len as u32,
+    };
+    demi_sgarray_t {
+        sga_buf: buf_ptr as *mut c_void,
+        sga_numsegs: 1,
+        sga_segs,
+        sga_addr: unsafe { mem::zeroed() },
+    }
+}
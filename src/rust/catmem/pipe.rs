@@ -0,0 +1,385 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::{
+    collections::shared_ring::SharedRingBuffer,
+    pal::linux::shm::SharedMemory,
+    runtime::{
+        fail::Fail,
+        stats,
+    },
+};
+use ::std::{
+    cell::{
+        Cell,
+        RefCell,
+        RefMut,
+    },
+    collections::HashSet,
+    mem,
+    ptr,
+};
+
+//======================================================================================================================
+// Constants
+//======================================================================================================================
+
+/// Size of a slot of the buffer arena of a pipe. Pushes that are larger than this are split across several slots.
+pub const PIPE_SLOT_SIZE: usize = 9216;
+
+/// Number of slots in the buffer arena of a pipe.
+const PIPE_SLOT_COUNT: usize = 1024;
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Slot of the Buffer Arena that Holds Pushed Data
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct Descriptor {
+    /// Index of the slot.
+    slot: u32,
+    /// Number of bytes in the slot.
+    len: u32,
+}
+
+/// End of a Pipe
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum PipeEnd {
+    /// End that pushes, which is the one that created the pipe.
+    Write,
+    /// End that pops, which is the one that opened the pipe.
+    Read,
+}
+
+/// Shared-Memory Pipe
+///
+/// A pipe carries data one way, from a process that pushes to a process that pops. The process that creates the pipe
+/// holds its write end, and the process that opens it holds its read end, so that each ring has a single producer and a
+/// single consumer. It is made of three named shared
+/// memory regions: a buffer arena that is split into fixed-size slots, a ring of descriptors of the slots that were
+/// filled by the writer, and a ring of the slots that the reader gave back. Pushed data is copied into free slots
+/// once, and it is popped in place: the reader hands slots to the application, and gives them back when it releases
+/// them.
+pub struct SharedPipe {
+    /// End of the pipe that this process holds.
+    end: PipeEnd,
+    /// Descriptors of filled slots, from the writer to the reader.
+    data: SharedRingBuffer<Descriptor>,
+    /// Free slots, from the reader back to the writer.
+    free: SharedRingBuffer<u32>,
+    /// Buffer arena.
+    _arena: SharedMemory,
+    /// Base address of the buffer arena.
+    base: *mut u8,
+    /// Ticket of the next push operation on this end of the pipe.
+    next_ticket: Cell<u64>,
+    /// Ticket of the push operation that may write to the pipe. Pushes are served in order, so that data that is split
+    /// across several slots is not interleaved.
+    serving: Cell<u64>,
+    /// Tickets of push operations that were dropped before their turn came, which are skipped once it does.
+    skipped: RefCell<HashSet<u64>>,
+    /// Whether the reader handed back an invalid slot, after which this end of the pipe does not write anymore.
+    broken: Cell<bool>,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for Shared-Memory Pipes
+impl SharedPipe {
+    /// Creates a pipe named `name`, and returns its write end.
+    pub fn create(name: &str) -> Result<Self, Fail> {
+        let data: SharedRingBuffer<Descriptor> =
+            SharedRingBuffer::create(&format!("{}-data", name), ring_size::<Descriptor>())?;
+        let free: SharedRingBuffer<u32> = SharedRingBuffer::create(&format!("{}-free", name), ring_size::<u32>())?;
+        let mut arena: SharedMemory =
+            SharedMemory::create(&format!("{}-arena", name), PIPE_SLOT_COUNT * PIPE_SLOT_SIZE)?;
+
+        // All slots start out free.
+        for slot in 0..PIPE_SLOT_COUNT as u32 {
+            if free.try_enqueue(slot).is_err() {
+                return Err(Fail::new(libc::ENOMEM, "ring of free slots is too small"));
+            }
+        }
+
+        let base: *mut u8 = arena.as_mut_ptr();
+        Ok(Self::new(PipeEnd::Write, data, free, arena, base))
+    }
+
+    /// Opens the read end of the pipe named `name`, which was created by another process.
+    pub fn open(name: &str) -> Result<Self, Fail> {
+        let data: SharedRingBuffer<Descriptor> =
+            SharedRingBuffer::open(&format!("{}-data", name), ring_size::<Descriptor>())?;
+        let free: SharedRingBuffer<u32> = SharedRingBuffer::open(&format!("{}-free", name), ring_size::<u32>())?;
+        let mut arena: SharedMemory = SharedMemory::open(&format!("{}-arena", name), PIPE_SLOT_COUNT * PIPE_SLOT_SIZE)?;
+        let base: *mut u8 = arena.as_mut_ptr();
+        Ok(Self::new(PipeEnd::Read, data, free, arena, base))
+    }
+
+    fn new(
+        end: PipeEnd,
+        data: SharedRingBuffer<Descriptor>,
+        free: SharedRingBuffer<u32>,
+        arena: SharedMemory,
+        base: *mut u8,
+    ) -> Self {
+        Self {
+            end,
+            data,
+            free,
+            _arena: arena,
+            base,
+            next_ticket: Cell::new(0),
+            serving: Cell::new(0),
+            skipped: RefCell::new(HashSet::new()),
+            broken: Cell::new(false),
+        }
+    }
+
+    /// Copies all of `segs` into the target pipe as one unit, if there are enough free slots for them, and returns
+    /// whether it did. Nothing is written otherwise, so that a message is never torn. Fails if this is the read end of
+    /// the pipe, if `segs` do not fit in the pipe at all (see [count_slots]), or if the pipe is broken, i.e. if the
+    /// reader handed back a slot that does not exist.
+    pub fn write(&self, segs: &[&[u8]]) -> Result<bool, Fail> {
+        if self.end != PipeEnd::Write {
+            return Err(Fail::new(libc::EINVAL, "cannot write to the read end of a pipe"));
+        }
+        if self.broken.get() {
+            return Err(Fail::new(libc::EPIPE, "broken pipe"));
+        }
+        // The reader only ever adds free slots, so they are still there once we take them out.
+        let nslots: usize = count_slots(segs)?;
+        if self.free.len() < nslots {
+            return Ok(false);
+        }
+
+        let mut nwritten: usize = 0;
+        for chunk in segs.iter().flat_map(|seg| seg.chunks(PIPE_SLOT_SIZE)) {
+            let slot: u32 = self.free.dequeue();
+            // The reader lives in another process, so do not trust it.
+            if slot as usize >= PIPE_SLOT_COUNT {
+                warn!("reader handed back invalid slot (slot={:?})", slot);
+                self.broken.set(true);
+                return Err(Fail::new(libc::EPIPE, "broken pipe"));
+            }
+            unsafe { ptr::copy_nonoverlapping(chunk.as_ptr(), self.slot_ptr(slot), chunk.len()) };
+
+            // There are fewer slots than room in the ring, so this only fails if the reader handed back slots twice.
+            let descriptor: Descriptor = Descriptor {
+                slot,
+                len: chunk.len() as u32,
+            };
+            if self.data.try_enqueue(descriptor).is_err() {
+                warn!("ring of filled slots is full");
+                self.broken.set(true);
+                return Err(Fail::new(libc::EPIPE, "broken pipe"));
+            }
+            nwritten += chunk.len();
+        }
+        stats::record_tx_burst(nslots, nwritten);
+        Ok(true)
+    }
+
+    /// Takes the next filled slot out of the target pipe. Returns the index of the slot, its address, and how many
+    /// bytes it holds. The slot must be given back with [SharedPipe::release] once its data is consumed. This must be
+    /// the read end of the pipe.
+    pub fn read(&self) -> Option<(u32, *mut u8, usize)> {
+        debug_assert_eq!(self.end, PipeEnd::Read);
+        while let Some(descriptor) = self.data.try_dequeue() {
+            // The writer lives in another process, so do not trust it.
+            if descriptor.slot as usize >= PIPE_SLOT_COUNT || descriptor.len as usize > PIPE_SLOT_SIZE {
+                warn!(
+                    "dropping invalid descriptor (slot={:?}, len={:?})",
+                    descriptor.slot, descriptor.len
+                );
+                continue;
+            }
+            stats::record_rx_burst(1, descriptor.len as usize);
+            return Some((descriptor.slot, self.slot_ptr(descriptor.slot), descriptor.len as usize));
+        }
+        None
+    }
+
+    /// Gives a slot that was taken out with [SharedPipe::read] back to the writer.
+    pub fn release(&self, slot: u32) {
+        if self.free.try_enqueue(slot).is_err() {
+            warn!("ring of free slots is full, leaking slot {:?}", slot);
+        }
+    }
+
+    /// Checks if `ptr` lies in the buffer arena of the target pipe.
+    pub fn contains(&self, ptr: *const u8) -> bool {
+        let base: usize = self.base as usize;
+        (base..(base + PIPE_SLOT_COUNT * PIPE_SLOT_SIZE)).contains(&(ptr as usize))
+    }
+
+    /// Returns the end of the target pipe that this process holds.
+    pub fn end(&self) -> PipeEnd {
+        self.end
+    }
+
+    /// Checks if no push operation is in progress on this end of the target pipe, i.e. if data may be written right
+    /// away.
+    pub fn is_idle(&self) -> bool {
+        self.next_ticket.get() == self.serving.get()
+    }
+
+    /// Takes a ticket for a push operation.
+    pub fn take_ticket(&self) -> u64 {
+        let ticket: u64 = self.next_ticket.get();
+        self.next_ticket.set(ticket + 1);
+        ticket
+    }
+
+    /// Checks if the push operation that holds `ticket` may write to the target pipe.
+    pub fn is_serving(&self, ticket: u64) -> bool {
+        self.serving.get() == ticket
+    }
+
+    /// Gives back `ticket`, once the push operation that holds it completes or is dropped. If it is its turn, the next
+    /// push operation may write to the target pipe. Otherwise, its turn is skipped when it comes.
+    pub fn release_ticket(&self, ticket: u64) {
+        if !self.is_serving(ticket) {
+            self.skipped.borrow_mut().insert(ticket);
+            return;
+        }
+        let mut skipped: RefMut<HashSet<u64>> = self.skipped.borrow_mut();
+        let mut serving: u64 = ticket + 1;
+        while skipped.remove(&serving) {
+            serving += 1;
+        }
+        self.serving.set(serving);
+    }
+
+    /// Returns the address of `slot`.
+    fn slot_ptr(&self, slot: u32) -> *mut u8 {
+        unsafe { self.base.add(slot as usize * PIPE_SLOT_SIZE) }
+    }
+}
+
+//======================================================================================================================
+// Standalone Functions
+//======================================================================================================================
+
+/// Counts the slots that `segs` take up once written to a pipe. Each segment starts in a slot of its own. Fails if
+/// there are not as many slots in a pipe.
+pub fn count_slots(segs: &[&[u8]]) -> Result<usize, Fail> {
+    let nslots: usize = segs
+        .iter()
+        .map(|seg| (seg.len() + PIPE_SLOT_SIZE - 1) / PIPE_SLOT_SIZE)
+        .sum();
+    if nslots > PIPE_SLOT_COUNT {
+        return Err(Fail::new(libc::EMSGSIZE, "message does not fit in a pipe"));
+    }
+    Ok(nslots)
+}
+
+/// Returns the size of a shared memory region that fits a ring with room for all slots of a pipe.
+fn ring_size<T>() -> usize {
+    2 * mem::size_of::<usize>() + 2 * PIPE_SLOT_COUNT * mem::size_of::<T>()
+}
+
+//======================================================================================================================
+// Unit Tests
+//======================================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        PipeEnd,
+        SharedPipe,
+        PIPE_SLOT_COUNT,
+        PIPE_SLOT_SIZE,
+    };
+    use ::std::slice;
+
+    /// Tests that data pushed on one end of a pipe is popped in order on the other end, and that slots are reused.
+    #[test]
+    fn test_shared_pipe() {
+        let writer: SharedPipe = SharedPipe::create("shm-test-pipe").unwrap();
+        let reader: SharedPipe = SharedPipe::open("shm-test-pipe").unwrap();
+
+        // Large writes are split across slots.
+        let bytes: Vec<u8> = (0..(2 * PIPE_SLOT_SIZE + 100)).map(|i| i as u8).collect();
+        assert!(writer.write(&[&bytes]).unwrap());
+        let mut popped: Vec<u8> = Vec::new();
+        while let Some((slot, ptr, len)) = reader.read() {
+            popped.extend_from_slice(unsafe { slice::from_raw_parts(ptr, len) });
+            reader.release(slot);
+        }
+        assert_eq!(popped, bytes);
+
+        // Writes stop when all slots are taken, and resume once the reader gives them back.
+        let chunk: Vec<u8> = vec![7; PIPE_SLOT_SIZE];
+        for _ in 0..PIPE_SLOT_COUNT {
+            assert!(writer.write(&[&chunk]).unwrap());
+        }
+        assert!(!writer.write(&[&chunk]).unwrap());
+        let (slot, _, len): (u32, *mut u8, usize) = reader.read().unwrap();
+        assert_eq!(len, PIPE_SLOT_SIZE);
+        reader.release(slot);
+        assert!(writer.write(&[&chunk]).unwrap());
+    }
+
+    /// Tests that a message is written to a pipe as a whole or not at all.
+    #[test]
+    fn test_shared_pipe_whole_message() {
+        let writer: SharedPipe = SharedPipe::create("shm-test-pipe-whole-message").unwrap();
+        let reader: SharedPipe = SharedPipe::open("shm-test-pipe-whole-message").unwrap();
+
+        // Leave a single free slot.
+        let chunk: Vec<u8> = vec![7; PIPE_SLOT_SIZE];
+        for _ in 0..(PIPE_SLOT_COUNT - 1) {
+            assert!(writer.write(&[&chunk]).unwrap());
+        }
+
+        // A message with two segments does not fit, so none of its segments is written.
+        assert!(!writer.write(&[&[1, 2, 3], &[4, 5, 6]]).unwrap());
+        for _ in 0..(PIPE_SLOT_COUNT - 1) {
+            let (slot, _, len): (u32, *mut u8, usize) = reader.read().unwrap();
+            assert_eq!(len, PIPE_SLOT_SIZE);
+            reader.release(slot);
+        }
+        assert!(reader.read().is_none());
+
+        // Messages that would not fit even in an empty pipe are refused.
+        let bytes: Vec<u8> = vec![7; PIPE_SLOT_COUNT * PIPE_SLOT_SIZE + 1];
+        assert_eq!(writer.write(&[&bytes]).unwrap_err().errno, libc::EMSGSIZE);
+    }
+
+    /// Tests that a pipe breaks when the reader hands back a slot that does not exist.
+    #[test]
+    fn test_shared_pipe_invalid_slot() {
+        let writer: SharedPipe = SharedPipe::create("shm-test-pipe-invalid-slot").unwrap();
+        let reader: SharedPipe = SharedPipe::open("shm-test-pipe-invalid-slot").unwrap();
+
+        // Take all slots, and hand back one that lies past the end of the arena.
+        let chunk: Vec<u8> = vec![7; PIPE_SLOT_SIZE];
+        for _ in 0..PIPE_SLOT_COUNT {
+            assert!(writer.write(&[&chunk]).unwrap());
+        }
+        reader.release(PIPE_SLOT_COUNT as u32);
+        assert_eq!(writer.write(&[&chunk]).unwrap_err().errno, libc::EPIPE);
+        assert_eq!(writer.write(&[&chunk]).unwrap_err().errno, libc::EPIPE);
+    }
+
+    /// Tests that each end of a pipe only goes one way.
+    #[test]
+    fn test_shared_pipe_ends() {
+        let writer: SharedPipe = SharedPipe::create("shm-test-pipe-ends").unwrap();
+        let reader: SharedPipe = SharedPipe::open("shm-test-pipe-ends").unwrap();
+        assert_eq!(writer.end(), PipeEnd::Write);
+        assert_eq!(reader.end(), PipeEnd::Read);
+        assert!(writer.contains(writer.slot_ptr(0)) && writer.contains(writer.slot_ptr(PIPE_SLOT_COUNT as u32 - 1)));
+        assert!(!writer.contains(writer.slot_ptr(PIPE_SLOT_COUNT as u32)));
+        assert_eq!(reader.write(&[&[1, 2, 3]]).unwrap_err().errno, libc::EINVAL);
+        assert!(reader.read().is_none());
+    }
+}
@@ -0,0 +1,23 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::demikernel::config::Config;
+use ::std::time::Duration;
+
+//======================================================================================================================
+// Associated Functions
+//======================================================================================================================
+
+impl Config {
+    /// Reads the "busy-poll duration" parameter from the underlying configuration file. Waits poll for this long
+    /// before they block on readiness notifications. If it is not set, waits never block.
+    pub fn busy_poll_duration(&self) -> Option<Duration> {
+        self.0["catnap"]["busy_poll_us"]
+            .as_i64()
+            .map(|n| Duration::from_micros(n.max(0) as u64))
+    }
+}
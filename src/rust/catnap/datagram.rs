@@ -0,0 +1,575 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::runtime::{
+    fail::Fail,
+    memory::{
+        Buffer,
+        DataBuffer,
+    },
+    stats,
+    types::DEMI_SGARRAY_MAXLEN,
+};
+use ::arrayvec::ArrayVec;
+use ::nix::errno;
+use ::std::{
+    cell::{
+        Cell,
+        RefCell,
+    },
+    collections::{
+        HashMap,
+        VecDeque,
+    },
+    mem,
+    net::{
+        Ipv4Addr,
+        SocketAddrV4,
+    },
+    os::unix::prelude::RawFd,
+    ptr,
+    task::Poll,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Maximum number of messages that are sent or received with a single system call.
+const DATAGRAM_BATCH_SIZE: usize = 32;
+
+/// Maximum size of a datagram, when the kernel does not coalesce received datagrams.
+const DATAGRAM_MAX_SIZE: usize = 9216;
+
+/// Maximum size of a message that the kernel coalesces received datagrams into.
+const GRO_MAX_SIZE: usize = 65535;
+
+/// Maximum number of datagrams that are coalesced into a single outgoing message.
+const GSO_MAX_SEGMENTS: usize = 64;
+
+/// Maximum number of payload bytes of a single outgoing message.
+const GSO_MAX_BYTES: usize = 65000;
+
+/// Maximum size of a datagram that is coalesced into an outgoing message. Larger datagrams may not fit in the MTU of
+/// the outgoing interface, which the kernel refuses to segment.
+const GSO_MAX_SEGMENT_SIZE: usize = 1472;
+
+/// UDP socket options, from `linux/udp.h`.
+const UDP_SEGMENT: libc::c_int = 103;
+const UDP_GRO: libc::c_int = 104;
+
+/// Size of the control messages of each message.
+const CMSG_BUFFER_SIZE: usize = 32;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Control Messages of a Message
+#[repr(C, align(8))]
+#[derive(Clone, Copy)]
+struct CmsgBuffer([u8; CMSG_BUFFER_SIZE]);
+
+/// Datagram Waiting to be Sent
+struct OutgoingDatagram {
+    /// Pushto operation that sends the datagram.
+    id: u64,
+    /// Destination address.
+    remote: SocketAddrV4,
+    /// Payload, which may be scattered across several buffers.
+    bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+    /// Size of the payload.
+    len: usize,
+}
+
+/// Batched I/O on a UDP Socket
+///
+/// Pop and pushto operations on a UDP socket go through this structure instead of issuing a system call each. The
+/// first pending pop that is polled receives as many datagrams as there are pending pops with a single `recvmmsg`, and
+/// the datagrams that it does not take are handed to the other pops. Similarly, pushtos are queued when issued, and
+/// the first of them that is polled sends all queued datagrams with a single `sendmmsg`.
+///
+/// On kernels that support it, runs of datagrams to the same destination are coalesced into a single message that the
+/// kernel segments (`UDP_SEGMENT`), and the kernel is allowed to coalesce received datagrams (`UDP_GRO`), which are then
+/// split back here.
+pub struct DatagramBatch {
+    /// Underlying file descriptor.
+    fd: RawFd,
+    /// Coalesce outgoing datagrams?
+    gso: Cell<bool>,
+    /// Does the kernel coalesce received datagrams?
+    gro: bool,
+    /// Number of pop operations that wait for a datagram.
+    pending_pops: Cell<usize>,
+    /// Datagrams that were received for pending pops.
+    received: RefCell<VecDeque<(Option<SocketAddrV4>, Buffer)>>,
+    /// Buffer that datagrams are received into.
+    rx_buf: RefCell<Vec<u8>>,
+    /// Datagrams that wait to be sent.
+    outgoing: RefCell<VecDeque<OutgoingDatagram>>,
+    /// Results of pushto operations whose datagram was sent.
+    sent: RefCell<HashMap<u64, Result<(), Fail>>>,
+    /// Identifier of the next pushto operation.
+    next_id: Cell<u64>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Batched I/O on UDP Sockets
+impl DatagramBatch {
+    /// Sets up batched I/O on the UDP socket `fd`, and probes the kernel for segmentation offloads.
+    pub fn new(fd: RawFd) -> Self {
+        // Setting a zero segment size leaves outgoing datagrams alone, but it fails if the kernel does not know about it.
+        let gso: bool = unsafe { set_udp_option(fd, UDP_SEGMENT, 0) } == 0;
+        let gro: bool = unsafe { set_udp_option(fd, UDP_GRO, 1) } == 0;
+        trace!("datagram batching fd={:?} gso={:?} gro={:?}", fd, gso, gro);
+        Self {
+            fd,
+            gso: Cell::new(gso),
+            gro,
+            pending_pops: Cell::new(0),
+            received: RefCell::new(VecDeque::new()),
+            rx_buf: RefCell::new(Vec::new()),
+            outgoing: RefCell::new(VecDeque::new()),
+            sent: RefCell::new(HashMap::new()),
+            next_id: Cell::new(0),
+        }
+    }
+
+    /// Registers a pop operation, which then polls for its datagram with [DatagramBatch::poll_pop].
+    pub fn add_pop(&self) {
+        self.pending_pops.set(self.pending_pops.get() + 1);
+    }
+
+    /// Polls for a datagram on behalf of a pop operation.
+    pub fn poll_pop(&self) -> Poll<Result<(Option<SocketAddrV4>, Buffer), Fail>> {
+        if self.received.borrow().is_empty() {
+            if let Err(e) = self.receive() {
+                if e.errno == libc::EAGAIN || e.errno == libc::EWOULDBLOCK {
+                    return Poll::Pending;
+                }
+                self.pending_pops.set(self.pending_pops.get() - 1);
+                return Poll::Ready(Err(e));
+            }
+        }
+
+        match self.received.borrow_mut().pop_front() {
+            Some(datagram) => {
+                self.pending_pops.set(self.pending_pops.get() - 1);
+                Poll::Ready(Ok(datagram))
+            },
+            None => Poll::Pending,
+        }
+    }
+
+    /// Queues a datagram for sending on behalf of a pushto operation, which then polls for its completion with
+    /// [DatagramBatch::poll_pushto]. The payload of the datagram is the concatenation of `bufs`. Returns the identifier
+    /// of the pushto operation.
+    pub fn add_pushto(&self, remote: SocketAddrV4, bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>) -> u64 {
+        let id: u64 = self.next_id.get();
+        self.next_id.set(id.wrapping_add(1));
+        let len: usize = bufs.iter().map(|buf| buf.len()).sum();
+        self.outgoing
+            .borrow_mut()
+            .push_back(OutgoingDatagram { id, remote, bufs, len });
+        id
+    }
+
+    /// Polls for the completion of the pushto operation `id`. Datagrams are sent until either that of the pushto
+    /// operation is or the socket would block, so that pending only means that the socket must become writable.
+    pub fn poll_pushto(&self, id: u64) -> Poll<Result<(), Fail>> {
+        while !self.sent.borrow().contains_key(&id) {
+            if !self.send() {
+                break;
+            }
+        }
+        match self.sent.borrow_mut().remove(&id) {
+            Some(result) => Poll::Ready(result),
+            None => Poll::Pending,
+        }
+    }
+
+    /// Deregisters a pop operation that is dropped before it gets its datagram.
+    pub fn cancel_pop(&self) {
+        self.pending_pops.set(self.pending_pops.get() - 1);
+    }
+
+    /// Forgets the pushto operation `id`, which is dropped before it completes. Its datagram is not sent if it is still
+    /// queued, and its result is discarded if it was sent.
+    pub fn cancel_pushto(&self, id: u64) {
+        if self.sent.borrow_mut().remove(&id).is_none() {
+            self.outgoing.borrow_mut().retain(|datagram| datagram.id != id);
+        }
+    }
+
+    /// Are there datagrams that were received for pending pops?
+    pub fn has_received(&self) -> bool {
+        !self.received.borrow().is_empty()
+    }
+
+    /// Are there pushto operations whose datagram was sent?
+    pub fn has_sent(&self) -> bool {
+        !self.sent.borrow().is_empty()
+    }
+
+    /// Receives a batch of datagrams with a single system call.
+    fn receive(&self) -> Result<(), Fail> {
+        let vlen: usize = self.pending_pops.get().clamp(1, DATAGRAM_BATCH_SIZE);
+        let slot_size: usize = if self.gro { GRO_MAX_SIZE } else { DATAGRAM_MAX_SIZE };
+        let mut rx_buf = self.rx_buf.borrow_mut();
+        if rx_buf.len() < vlen * slot_size {
+            rx_buf.resize(vlen * slot_size, 0);
+        }
+
+        let mut names: [libc::sockaddr_in; DATAGRAM_BATCH_SIZE] = unsafe { mem::zeroed() };
+        let mut cmsgs: [CmsgBuffer; DATAGRAM_BATCH_SIZE] = [CmsgBuffer([0; CMSG_BUFFER_SIZE]); DATAGRAM_BATCH_SIZE];
+        let mut iovs: [libc::iovec; DATAGRAM_BATCH_SIZE] = unsafe { mem::zeroed() };
+        let mut msgs: [libc::mmsghdr; DATAGRAM_BATCH_SIZE] = unsafe { mem::zeroed() };
+        for i in 0..vlen {
+            iovs[i] = libc::iovec {
+                iov_base: unsafe { rx_buf.as_mut_ptr().add(i * slot_size) } as *mut libc::c_void,
+                iov_len: slot_size,
+            };
+            let hdr: &mut libc::msghdr = &mut msgs[i].msg_hdr;
+            hdr.msg_name = &mut names[i] as *mut libc::sockaddr_in as *mut libc::c_void;
+            hdr.msg_namelen = mem::size_of::<libc::sockaddr_in>() as libc::socklen_t;
+            hdr.msg_iov = &mut iovs[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = cmsgs[i].0.as_mut_ptr() as *mut libc::c_void;
+            hdr.msg_controllen = CMSG_BUFFER_SIZE as _;
+        }
+
+        let nmsgs: libc::c_int = unsafe {
+            libc::recvmmsg(
+                self.fd,
+                msgs.as_mut_ptr(),
+                vlen as libc::c_uint,
+                libc::MSG_DONTWAIT,
+                ptr::null_mut(),
+            )
+        };
+        if nmsgs == -1 {
+            return Err(Fail::new(errno::errno(), "operation failed"));
+        }
+
+        let mut received = self.received.borrow_mut();
+        let nreceived: usize = received.len();
+        let mut nbytes: usize = 0;
+        for i in 0..(nmsgs as usize) {
+            let hdr: &libc::msghdr = &msgs[i].msg_hdr;
+            let len: usize = msgs[i].msg_len as usize;
+            nbytes += len;
+            if hdr.msg_flags & libc::MSG_TRUNC != 0 {
+                warn!("datagram truncated to {:?} bytes", len);
+            }
+            let addr: Option<SocketAddrV4> = if hdr.msg_namelen as usize >= mem::size_of::<libc::sockaddr_in>() {
+                let sin: &libc::sockaddr_in = &names[i];
+                Some(SocketAddrV4::new(
+                    Ipv4Addr::from(u32::from_be(sin.sin_addr.s_addr)),
+                    u16::from_be(sin.sin_port),
+                ))
+            } else {
+                None
+            };
+
+            // Split datagrams that the kernel coalesced.
+            let data: &[u8] = &rx_buf[(i * slot_size)..(i * slot_size + len)];
+            let segment_size: usize = match unsafe { gro_segment_size(hdr) } {
+                Some(size) if size > 0 => size,
+                _ => len.max(1),
+            };
+            if data.is_empty() {
+                received.push_back((addr, Buffer::Heap(DataBuffer::from_slice(data))));
+            }
+            for segment in data.chunks(segment_size) {
+                trace!("data received ({:?}/{:?} bytes)", segment.len(), slot_size);
+                received.push_back((addr, Buffer::Heap(DataBuffer::from_slice(segment))));
+            }
+        }
+        stats::record_rx_burst(received.len() - nreceived, nbytes);
+
+        Ok(())
+    }
+
+    /// Sends queued datagrams with a single system call, and records the results of their pushto operations. Returns
+    /// `false` if no progress was made, either because there is nothing to send or because the socket would block.
+    fn send(&self) -> bool {
+        let mut outgoing = self.outgoing.borrow_mut();
+        if outgoing.is_empty() {
+            return false;
+        }
+
+        // Group queued datagrams into messages. A message holds either a single datagram or, if the kernel segments
+        // messages, a run of datagrams to the same destination, all with the same size but the last one.
+        let gso: bool = self.gso.get();
+        let mut groups: Vec<(usize, usize, usize)> = Vec::with_capacity(DATAGRAM_BATCH_SIZE);
+        let mut start: usize = 0;
+        while start < outgoing.len() && groups.len() < DATAGRAM_BATCH_SIZE {
+            let segment_size: usize = outgoing[start].len;
+            let mut end: usize = start + 1;
+            let mut total: usize = segment_size;
+            if gso && segment_size <= GSO_MAX_SEGMENT_SIZE {
+                while end < outgoing.len()
+                    && end - start < GSO_MAX_SEGMENTS
+                    && outgoing[end].remote == outgoing[start].remote
+                    && outgoing[end].len <= segment_size
+                    && outgoing[end].len > 0
+                    && total + outgoing[end].len <= GSO_MAX_BYTES
+                {
+                    total += outgoing[end].len;
+                    end += 1;
+                    // Only the last datagram of a message may be shorter.
+                    if outgoing[end - 1].len < segment_size {
+                        break;
+                    }
+                }
+            }
+            groups.push((start, end, segment_size));
+            start = end;
+        }
+
+        let mut names: Vec<libc::sockaddr_in> = Vec::with_capacity(groups.len());
+        let mut cmsgs: Vec<CmsgBuffer> = vec![CmsgBuffer([0; CMSG_BUFFER_SIZE]); groups.len()];
+        // Each message takes one I/O vector for each buffer of its datagrams, and the kernel segments the concatenation.
+        let mut iovs: Vec<libc::iovec> = Vec::with_capacity(start);
+        let mut iov_ranges: Vec<(usize, usize)> = Vec::with_capacity(groups.len());
+        for &(first, last, _) in &groups {
+            names.push(sockaddr_in(&outgoing[first].remote));
+            let iov_start: usize = iovs.len();
+            for datagram in outgoing.range(first..last) {
+                for buf in &datagram.bufs {
+                    iovs.push(libc::iovec {
+                        iov_base: buf.as_ptr() as *mut libc::c_void,
+                        iov_len: buf.len(),
+                    });
+                }
+            }
+            iov_ranges.push((iov_start, iovs.len()));
+        }
+        let mut msgs: Vec<libc::mmsghdr> = Vec::with_capacity(groups.len());
+        for (i, &(first, last, segment_size)) in groups.iter().enumerate() {
+            let (iov_start, iov_end): (usize, usize) = iov_ranges[i];
+            let mut msg: libc::mmsghdr = unsafe { mem::zeroed() };
+            msg.msg_hdr.msg_name = &mut names[i] as *mut libc::sockaddr_in as *mut libc::c_void;
+            msg.msg_hdr.msg_namelen = mem::size_of::<libc::sockaddr_in>() as libc::socklen_t;
+            msg.msg_hdr.msg_iov = unsafe { iovs.as_mut_ptr().add(iov_start) };
+            msg.msg_hdr.msg_iovlen = (iov_end - iov_start) as _;
+            if last - first > 1 {
+                unsafe { set_gso_segment_size(&mut msg.msg_hdr, &mut cmsgs[i], segment_size as u16) };
+            }
+            msgs.push(msg);
+        }
+
+        let nmsgs: libc::c_int = unsafe {
+            libc::sendmmsg(
+                self.fd,
+                msgs.as_mut_ptr(),
+                msgs.len() as libc::c_uint,
+                libc::MSG_DONTWAIT,
+            )
+        };
+        let mut sent = self.sent.borrow_mut();
+        if nmsgs == -1 {
+            let e: i32 = errno::errno();
+            match e {
+                // Try again once the socket becomes writable.
+                libc::EAGAIN => return false,
+                // The kernel failed to segment the message, so stop coalescing datagrams and try again.
+                libc::EIO | libc::EINVAL if groups[0].1 - groups[0].0 > 1 => {
+                    warn!("UDP segmentation offload failed (errno={:?}), disabling it", e);
+                    self.gso.set(false);
+                },
+                // The first message failed.
+                _ => {
+                    warn!("pushto failed ({:?})", e);
+                    for datagram in outgoing.drain(groups[0].0..groups[0].1) {
+                        sent.insert(datagram.id, Err(Fail::new(e, "operation failed")));
+                    }
+                },
+            }
+            return true;
+        }
+
+        let nsent: usize = groups[..(nmsgs as usize)]
+            .iter()
+            .map(|&(_, last, _)| last)
+            .max()
+            .unwrap_or(0);
+        let mut nbytes: usize = 0;
+        for datagram in outgoing.drain(..nsent) {
+            trace!("data pushed ({:?} bytes)", datagram.len);
+            nbytes += datagram.len;
+            sent.insert(datagram.id, Ok(()));
+        }
+        stats::record_tx_burst(nsent, nbytes);
+        true
+    }
+}
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Sets an integer option of the UDP protocol in a socket.
+unsafe fn set_udp_option(fd: RawFd, option: libc::c_int, value: libc::c_int) -> i32 {
+    let value_ptr: *const libc::c_int = &value as *const libc::c_int;
+    let option_len: libc::socklen_t = mem::size_of_val(&value) as libc::socklen_t;
+    libc::setsockopt(fd, libc::SOL_UDP, option, value_ptr as *const libc::c_void, option_len)
+}
+
+/// Attaches a control message to a message, which asks the kernel to segment it into datagrams of `segment_size`
+/// bytes.
+unsafe fn set_gso_segment_size(hdr: &mut libc::msghdr, cmsg_buf: &mut CmsgBuffer, segment_size: u16) {
+    hdr.msg_control = cmsg_buf.0.as_mut_ptr() as *mut libc::c_void;
+    hdr.msg_controllen = libc::CMSG_SPACE(mem::size_of::<u16>() as u32) as _;
+    let cmsg: *mut libc::cmsghdr = libc::CMSG_FIRSTHDR(hdr);
+    (*cmsg).cmsg_level = libc::SOL_UDP;
+    (*cmsg).cmsg_type = UDP_SEGMENT;
+    (*cmsg).cmsg_len = libc::CMSG_LEN(mem::size_of::<u16>() as u32) as _;
+    ptr::write_unaligned(libc::CMSG_DATA(cmsg) as *mut u16, segment_size);
+}
+
+/// Returns the size of the datagrams that the kernel coalesced into a received message, if it did.
+unsafe fn gro_segment_size(hdr: &libc::msghdr) -> Option<usize> {
+    let mut cmsg: *mut libc::cmsghdr = libc::CMSG_FIRSTHDR(hdr);
+    while !cmsg.is_null() {
+        if (*cmsg).cmsg_level == libc::SOL_UDP && (*cmsg).cmsg_type == UDP_GRO {
+            return Some(ptr::read_unaligned(libc::CMSG_DATA(cmsg) as *const libc::c_int) as usize);
+        }
+        cmsg = libc::CMSG_NXTHDR(hdr, cmsg);
+    }
+    None
+}
+
+/// Converts a [SocketAddrV4] into a `sockaddr_in`.
+fn sockaddr_in(addr: &SocketAddrV4) -> libc::sockaddr_in {
+    libc::sockaddr_in {
+        sin_family: libc::AF_INET as libc::sa_family_t,
+        sin_port: addr.port().to_be(),
+        sin_addr: libc::in_addr {
+            s_addr: u32::from_ne_bytes(addr.ip().octets()),
+        },
+        sin_zero: [0; 8],
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::DatagramBatch;
+    use crate::runtime::{
+        memory::{
+            Buffer,
+            DataBuffer,
+        },
+        types::DEMI_SGARRAY_MAXLEN,
+    };
+    use ::arrayvec::ArrayVec;
+    use ::std::{
+        net::{
+            SocketAddrV4,
+            UdpSocket,
+        },
+        os::unix::prelude::AsRawFd,
+        task::Poll,
+    };
+
+    /// Tests that batched pushtos and pops exchange datagrams in order, whether or not they are coalesced, and whether
+    /// or not their payload is scattered across several buffers.
+    #[test]
+    fn test_datagram_batch() {
+        let tx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        let rx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        tx.set_nonblocking(true).unwrap();
+        rx.set_nonblocking(true).unwrap();
+        let remote: SocketAddrV4 = match rx.local_addr().unwrap() {
+            ::std::net::SocketAddr::V4(addr) => addr,
+            _ => unreachable!(),
+        };
+
+        let sender: DatagramBatch = DatagramBatch::new(tx.as_raw_fd());
+        let receiver: DatagramBatch = DatagramBatch::new(rx.as_raw_fd());
+        let sizes: [usize; 5] = [1000, 1000, 1000, 400, 2000];
+        let ids: Vec<u64> = sizes
+            .iter()
+            .enumerate()
+            .map(|(i, size)| {
+                // Scatter odd datagrams across two buffers.
+                let bytes: Vec<u8> = vec![i as u8; *size];
+                let split: usize = if i % 2 == 1 { size / 3 } else { *size };
+                let mut bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN> = ArrayVec::new();
+                bufs.push(Buffer::Heap(DataBuffer::from_slice(&bytes[..split])));
+                if split < *size {
+                    bufs.push(Buffer::Heap(DataBuffer::from_slice(&bytes[split..])));
+                }
+                sender.add_pushto(remote, bufs)
+            })
+            .collect();
+        for id in ids {
+            assert!(matches!(sender.poll_pushto(id), Poll::Ready(Ok(()))));
+        }
+
+        for _ in 0..sizes.len() {
+            receiver.add_pop();
+        }
+        for (i, size) in sizes.iter().enumerate() {
+            let (addr, buf): (Option<SocketAddrV4>, Buffer) = loop {
+                match receiver.poll_pop() {
+                    Poll::Ready(result) => break result.unwrap(),
+                    Poll::Pending => continue,
+                }
+            };
+            assert_eq!(addr.unwrap().port(), tx.local_addr().unwrap().port());
+            assert_eq!(buf.len(), *size);
+            assert!(buf.iter().all(|byte| *byte == i as u8));
+        }
+        assert!(matches!(receiver.poll_pop(), Poll::Pending));
+    }
+
+    /// Tests that cancelled pushtos and pops leave nothing behind in the batch.
+    #[test]
+    fn test_datagram_batch_cancel() {
+        let tx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        let rx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        tx.set_nonblocking(true).unwrap();
+        let remote: SocketAddrV4 = match rx.local_addr().unwrap() {
+            ::std::net::SocketAddr::V4(addr) => addr,
+            _ => unreachable!(),
+        };
+        let datagram = || -> ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN> {
+            let mut bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN> = ArrayVec::new();
+            bufs.push(Buffer::Heap(DataBuffer::from_slice(&[1; 64])));
+            bufs
+        };
+
+        // A pushto that is cancelled while queued is not sent.
+        let sender: DatagramBatch = DatagramBatch::new(tx.as_raw_fd());
+        let queued: u64 = sender.add_pushto(remote, datagram());
+        sender.cancel_pushto(queued);
+        assert!(sender.outgoing.borrow().is_empty());
+
+        // A pushto that is cancelled once sent leaves no result behind.
+        let first: u64 = sender.add_pushto(remote, datagram());
+        let second: u64 = sender.add_pushto(remote, datagram());
+        assert!(matches!(sender.poll_pushto(first), Poll::Ready(Ok(()))));
+        assert!(sender.has_sent());
+        sender.cancel_pushto(second);
+        assert!(!sender.has_sent());
+
+        // A cancelled pop no longer waits for a datagram.
+        let receiver: DatagramBatch = DatagramBatch::new(rx.as_raw_fd());
+        receiver.add_pop();
+        receiver.add_pop();
+        receiver.cancel_pop();
+        assert_eq!(receiver.pending_pops.get(), 1);
+    }
+}
@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::runtime::fail::Fail;
+use ::nix::errno;
+use ::std::{
+    cell::RefCell,
+    collections::HashMap,
+    mem,
+    os::unix::prelude::RawFd,
+    task::Waker,
+    time::Duration,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Maximum number of events that are retrieved with a single system call.
+const EPOLL_MAX_EVENTS: usize = 64;
+
+/// Events that wake up operations that wait for a file descriptor to become readable.
+const EPOLL_READ_EVENTS: u32 = (libc::EPOLLIN | libc::EPOLLRDHUP | libc::EPOLLHUP | libc::EPOLLERR) as u32;
+
+/// Events that wake up operations that wait for a file descriptor to become writable.
+const EPOLL_WRITE_EVENTS: u32 = (libc::EPOLLOUT | libc::EPOLLHUP | libc::EPOLLERR) as u32;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Readiness that an Operation Waits For
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum Interest {
+    /// The file descriptor is readable, or has a connection to accept.
+    Read,
+    /// The file descriptor is writable, or has finished connecting.
+    Write,
+}
+
+/// Operations Waiting on a File Descriptor
+#[derive(Default)]
+struct Waiters {
+    /// Operations that wait for the file descriptor to become readable.
+    readers: Vec<Waker>,
+    /// Operations that wait for the file descriptor to become writable.
+    writers: Vec<Waker>,
+}
+
+/// Readiness Notifications
+///
+/// Operations that would block park themselves on their file descriptor, instead of asking the scheduler to poll them
+/// again right away. File descriptors are registered in edge-triggered mode, so an operation must only park after its
+/// system call failed with `EAGAIN` (or alike), and it is woken up when the file descriptor becomes ready afterwards.
+/// Operations on file descriptors that are not registered are polled again right away.
+pub struct Epoll {
+    /// Underlying file descriptor.
+    epfd: RawFd,
+    /// Parked operations, keyed by file descriptor.
+    waiters: RefCell<HashMap<RawFd, Waiters>>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Readiness Notifications
+impl Epoll {
+    /// Creates an epoll instance.
+    pub fn new() -> Result<Self, Fail> {
+        let epfd: RawFd = unsafe { libc::epoll_create1(libc::EPOLL_CLOEXEC) };
+        if epfd == -1 {
+            return Err(Fail::new(errno::errno(), "failed to create epoll instance"));
+        }
+        Ok(Self {
+            epfd,
+            waiters: RefCell::new(HashMap::new()),
+        })
+    }
+
+    /// Registers a file descriptor for readiness notifications.
+    pub fn register(&self, fd: RawFd) -> Result<(), Fail> {
+        let mut event: libc::epoll_event = libc::epoll_event {
+            events: (libc::EPOLLIN | libc::EPOLLOUT | libc::EPOLLRDHUP | libc::EPOLLET) as u32,
+            u64: fd as u64,
+        };
+        if unsafe { libc::epoll_ctl(self.epfd, libc::EPOLL_CTL_ADD, fd, &mut event) } == -1 {
+            return Err(Fail::new(errno::errno(), "failed to register file descriptor"));
+        }
+        self.waiters.borrow_mut().insert(fd, Waiters::default());
+        Ok(())
+    }
+
+    /// Unregisters a file descriptor from readiness notifications. Operations that were parked on it are woken up, so
+    /// that they fail.
+    pub fn unregister(&self, fd: RawFd) {
+        if let Some(waiters) = self.waiters.borrow_mut().remove(&fd) {
+            unsafe { libc::epoll_ctl(self.epfd, libc::EPOLL_CTL_DEL, fd, ::std::ptr::null_mut()) };
+            waiters.readers.into_iter().chain(waiters.writers).for_each(Waker::wake);
+        }
+    }
+
+    /// Parks an operation until `fd` becomes ready for `interest`.
+    pub fn park(&self, fd: RawFd, interest: Interest, waker: &Waker) {
+        match self.waiters.borrow_mut().get_mut(&fd) {
+            Some(waiters) => {
+                let wakers: &mut Vec<Waker> = match interest {
+                    Interest::Read => &mut waiters.readers,
+                    Interest::Write => &mut waiters.writers,
+                };
+                if !wakers.iter().any(|w| w.will_wake(waker)) {
+                    wakers.push(waker.clone());
+                }
+            },
+            // Fall back to polling.
+            None => waker.wake_by_ref(),
+        }
+    }
+
+    /// Wakes up the operations that are parked on `fd` for `interest`. This is needed when an operation completes work
+    /// on behalf of others, since the kernel then has no readiness left to report for them.
+    pub fn notify(&self, fd: RawFd, interest: Interest) {
+        if let Some(waiters) = self.waiters.borrow_mut().get_mut(&fd) {
+            let wakers: &mut Vec<Waker> = match interest {
+                Interest::Read => &mut waiters.readers,
+                Interest::Write => &mut waiters.writers,
+            };
+            wakers.drain(..).for_each(Waker::wake);
+        }
+    }
+
+    /// Waits for registered file descriptors to become ready, and wakes up the operations that are parked on them. If
+    /// `timeout` is `None`, this function blocks until some file descriptor is ready. Returns the number of file
+    /// descriptors that were ready.
+    pub fn wait(&self, timeout: Option<Duration>) -> Result<usize, Fail> {
+        let timeout_ms: libc::c_int = match timeout {
+            // Round up, so that we do not spin until a deadline that is less than a millisecond away.
+            Some(timeout) => ((timeout.as_micros() + 999) / 1000).min(libc::c_int::MAX as u128) as libc::c_int,
+            None => -1,
+        };
+
+        let mut events: [libc::epoll_event; EPOLL_MAX_EVENTS] = unsafe { mem::zeroed() };
+        let nevents: libc::c_int = unsafe {
+            libc::epoll_wait(
+                self.epfd,
+                events.as_mut_ptr(),
+                EPOLL_MAX_EVENTS as libc::c_int,
+                timeout_ms,
+            )
+        };
+        if nevents == -1 {
+            let e: i32 = errno::errno();
+            if e == libc::EINTR {
+                return Ok(0);
+            }
+            return Err(Fail::new(e, "failed to wait for events"));
+        }
+
+        let mut waiters = self.waiters.borrow_mut();
+        for event in &events[..(nevents as usize)] {
+            let (fd, flags): (RawFd, u32) = (event.u64 as RawFd, event.events);
+            if let Some(waiters) = waiters.get_mut(&fd) {
+                if flags & EPOLL_READ_EVENTS != 0 {
+                    waiters.readers.drain(..).for_each(Waker::wake);
+                }
+                if flags & EPOLL_WRITE_EVENTS != 0 {
+                    waiters.writers.drain(..).for_each(Waker::wake);
+                }
+            }
+        }
+
+        Ok(nevents as usize)
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Drop Trait Implementation for Readiness Notifications
+impl Drop for Epoll {
+    fn drop(&mut self) {
+        unsafe { libc::close(self.epfd) };
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        Epoll,
+        Interest,
+    };
+    use ::std::{
+        net::UdpSocket,
+        os::unix::prelude::AsRawFd,
+        sync::{
+            atomic::{
+                AtomicUsize,
+                Ordering,
+            },
+            Arc,
+        },
+        task::{
+            Wake,
+            Waker,
+        },
+        time::Duration,
+    };
+
+    /// Waker that counts how many times it was woken up.
+    struct CountingWaker(AtomicUsize);
+
+    impl Wake for CountingWaker {
+        fn wake(self: Arc<Self>) {
+            self.0.fetch_add(1, Ordering::SeqCst);
+        }
+    }
+
+    /// Tests that parked operations are only woken up once their file descriptor becomes ready.
+    #[test]
+    fn test_epoll_park() {
+        let epoll: Epoll = Epoll::new().unwrap();
+        let rx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        let tx: UdpSocket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        rx.set_nonblocking(true).unwrap();
+        epoll.register(rx.as_raw_fd()).unwrap();
+
+        // Drain the initial events of the socket.
+        epoll.wait(Some(Duration::ZERO)).unwrap();
+
+        let counter: Arc<CountingWaker> = Arc::new(CountingWaker(AtomicUsize::new(0)));
+        let waker: Waker = Waker::from(counter.clone());
+        epoll.park(rx.as_raw_fd(), Interest::Read, &waker);
+        epoll.park(rx.as_raw_fd(), Interest::Read, &waker);
+        assert_eq!(epoll.wait(Some(Duration::ZERO)).unwrap(), 0);
+        assert_eq!(counter.0.load(Ordering::SeqCst), 0);
+
+        tx.send_to(&[1, 2, 3], rx.local_addr().unwrap()).unwrap();
+        assert_eq!(epoll.wait(Some(Duration::from_secs(1))).unwrap(), 1);
+        assert_eq!(counter.0.load(Ordering::SeqCst), 1);
+
+        // Operations on file descriptors that are not registered are woken up right away.
+        epoll.park(tx.as_raw_fd(), Interest::Read, &waker);
+        assert_eq!(counter.0.load(Ordering::SeqCst), 2);
+    }
+}
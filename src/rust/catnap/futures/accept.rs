@@ -6,6 +6,10 @@
 //==============================================================================
 
 use crate::{
+    catnap::epoll::{
+        Epoll,
+        Interest,
+    },
     pal::linux,
     runtime::{
         fail::Fail,
@@ -20,6 +24,7 @@ use ::std::{
     future::Future,
     os::unix::prelude::RawFd,
     pin::Pin,
+    rc::Rc,
     task::{
         Context,
         Poll,
@@ -38,6 +43,8 @@ pub struct AcceptFuture {
     fd: RawFd,
     /// Queue descriptor of incoming connection.
     new_qd: QDesc,
+    /// Readiness notifications.
+    epoll: Rc<Epoll>,
 }
 
 //==============================================================================
@@ -47,8 +54,8 @@ pub struct AcceptFuture {
 /// Associate Functions for Accept Operation Descriptors
 impl AcceptFuture {
     /// Creates a descriptor for an accept operation.
-    pub fn new(qd: QDesc, fd: RawFd, new_qd: QDesc) -> Self {
-        Self { qd, fd, new_qd }
+    pub fn new(qd: QDesc, fd: RawFd, new_qd: QDesc, epoll: Rc<Epoll>) -> Self {
+        Self { qd, fd, new_qd, epoll }
     }
 
     /// Returns the queue descriptor associated to the target [AcceptFuture].
@@ -95,7 +102,7 @@ impl Future for AcceptFuture {
             },
             // Operation in progress.
             Err(e) if e == Errno::EWOULDBLOCK || e == Errno::EAGAIN => {
-                ctx.waker().wake_by_ref();
+                self_.epoll.park(self_.fd, Interest::Read, ctx.waker());
                 Poll::Pending
             },
             // Operation failed.
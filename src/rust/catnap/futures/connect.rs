@@ -5,9 +5,15 @@
 // Imports
 //==============================================================================
 
-use crate::runtime::{
-    fail::Fail,
-    QDesc,
+use crate::{
+    catnap::epoll::{
+        Epoll,
+        Interest,
+    },
+    runtime::{
+        fail::Fail,
+        QDesc,
+    },
 };
 use ::nix::{
     errno::Errno,
@@ -20,6 +26,7 @@ use ::std::{
     future::Future,
     os::unix::prelude::RawFd,
     pin::Pin,
+    rc::Rc,
     task::{
         Context,
         Poll,
@@ -38,6 +45,8 @@ pub struct ConnectFuture {
     fd: RawFd,
     /// Destination address.
     addr: SockaddrStorage,
+    /// Readiness notifications.
+    epoll: Rc<Epoll>,
 }
 
 //==============================================================================
@@ -47,8 +56,8 @@ pub struct ConnectFuture {
 /// Associate Functions for Connect Operation Descriptors
 impl ConnectFuture {
     /// Creates a descriptor for a connect operation.
-    pub fn new(qd: QDesc, fd: RawFd, addr: SockaddrStorage) -> Self {
-        Self { qd, fd, addr }
+    pub fn new(qd: QDesc, fd: RawFd, addr: SockaddrStorage, epoll: Rc<Epoll>) -> Self {
+        Self { qd, fd, addr, epoll }
     }
 
     /// Returns the queue descriptor associated to the target [ConnectFuture].
@@ -76,7 +85,7 @@ impl Future for ConnectFuture {
             },
             // Operation not ready yet.
             Err(e) if e == Errno::EINPROGRESS || e == Errno::EALREADY => {
-                ctx.waker().wake_by_ref();
+                self_.epoll.park(self_.fd, Interest::Write, ctx.waker());
                 Poll::Pending
             },
             // Operation failed.
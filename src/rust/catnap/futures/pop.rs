@@ -5,13 +5,23 @@
 // Imports
 //==============================================================================
 
-use crate::runtime::{
-    fail::Fail,
-    memory::{
-        Buffer,
-        DataBuffer,
+use crate::{
+    catnap::{
+        datagram::DatagramBatch,
+        epoll::{
+            Epoll,
+            Interest,
+        },
+    },
+    runtime::{
+        fail::Fail,
+        memory::{
+            Buffer,
+            DataBuffer,
+        },
+        stats,
+        QDesc,
     },
-    QDesc,
 };
 use ::nix::{
     errno::Errno,
@@ -28,6 +38,7 @@ use ::std::{
     },
     os::unix::prelude::RawFd,
     pin::Pin,
+    rc::Rc,
     task::{
         Context,
         Poll,
@@ -51,6 +62,12 @@ pub struct PopFuture {
     qd: QDesc,
     /// Underlying file descriptor.
     fd: RawFd,
+    /// Batched I/O of the underlying socket, if it is a UDP socket.
+    batch: Option<Rc<DatagramBatch>>,
+    /// Readiness notifications.
+    epoll: Rc<Epoll>,
+    /// Did the operation complete?
+    done: bool,
 }
 
 //==============================================================================
@@ -59,9 +76,18 @@ pub struct PopFuture {
 
 /// Associate Functions for Pop Operation Descriptors
 impl PopFuture {
-    /// Creates a descriptor for a pop operation.
-    pub fn new(qd: QDesc, fd: RawFd) -> Self {
-        Self { qd, fd }
+    /// Creates a descriptor for a pop operation. Pops on UDP sockets receive their datagram through `batch`.
+    pub fn new(qd: QDesc, fd: RawFd, batch: Option<Rc<DatagramBatch>>, epoll: Rc<Epoll>) -> Self {
+        if let Some(ref batch) = batch {
+            batch.add_pop();
+        }
+        Self {
+            qd,
+            fd,
+            batch,
+            epoll,
+            done: false,
+        }
     }
 
     /// Returns the queue descriptor associated to the target [PopFuture].
@@ -81,11 +107,32 @@ impl Future for PopFuture {
     /// Polls the target [PopFuture].
     fn poll(self: Pin<&mut Self>, ctx: &mut Context<'_>) -> Poll<Self::Output> {
         let self_: &mut PopFuture = self.get_mut();
+        if let Some(ref batch) = self_.batch {
+            return match batch.poll_pop() {
+                // Operation completed.
+                Poll::Ready(result) => {
+                    self_.done = true;
+                    // Datagrams that were received along with this one are left for other pops, whose file descriptor
+                    // will not become readable again for them.
+                    if batch.has_received() {
+                        self_.epoll.notify(self_.fd, Interest::Read);
+                    }
+                    Poll::Ready(result)
+                },
+                // Operation in progress.
+                Poll::Pending => {
+                    self_.epoll.park(self_.fd, Interest::Read, ctx.waker());
+                    Poll::Pending
+                },
+            };
+        }
+
         let mut bytes: [u8; POP_SIZE] = [0; POP_SIZE];
         match socket::recvfrom::<SockaddrStorage>(self_.fd, &mut bytes[..]) {
             // Operation completed.
             Ok((nbytes, socketaddr)) => {
                 trace!("data received ({:?}/{:?} bytes)", nbytes, POP_SIZE);
+                stats::record_rx_burst(1, nbytes);
                 let buf: Buffer = Buffer::Heap(DataBuffer::from_slice(&bytes[0..nbytes]));
                 let addr: Option<SocketAddrV4> = match socketaddr {
                     Some(addr) => match addr.as_sockaddr_in() {
@@ -102,7 +149,7 @@ impl Future for PopFuture {
             },
             // Operation in progress.
             Err(e) if e == Errno::EWOULDBLOCK || e == Errno::EAGAIN => {
-                ctx.waker().wake_by_ref();
+                self_.epoll.park(self_.fd, Interest::Read, ctx.waker());
                 Poll::Pending
             },
             // Error.
@@ -113,3 +160,15 @@ impl Future for PopFuture {
         }
     }
 }
+
+/// Drop Trait Implementation for Pop Operation Descriptors
+impl Drop for PopFuture {
+    fn drop(&mut self) {
+        // Pops that are cancelled no longer wait for a datagram.
+        if let Some(ref batch) = self.batch {
+            if !self.done {
+                batch.cancel_pop();
+            }
+        }
+    }
+}
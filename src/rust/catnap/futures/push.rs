@@ -5,19 +5,33 @@
 // Imports
 //==============================================================================
 
-use crate::runtime::{
-    fail::Fail,
-    memory::Buffer,
-    QDesc,
+use crate::{
+    catnap::epoll::{
+        Epoll,
+        Interest,
+    },
+    runtime::{
+        fail::Fail,
+        memory::Buffer,
+        stats,
+        types::DEMI_SGARRAY_MAXLEN,
+        QDesc,
+    },
 };
+use ::arrayvec::ArrayVec;
 use ::nix::{
     errno::Errno,
-    sys::socket,
+    sys::socket::{
+        self,
+        SockaddrStorage,
+    },
 };
 use ::std::{
     future::Future,
+    io::IoSlice,
     os::unix::prelude::RawFd,
     pin::Pin,
+    rc::Rc,
     task::{
         Context,
         Poll,
@@ -34,8 +48,10 @@ pub struct PushFuture {
     qd: QDesc,
     // Underlying file descriptor.
     fd: RawFd,
-    /// Buffer to send.
-    buf: Buffer,
+    /// Buffers to send, in order.
+    bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+    /// Readiness notifications.
+    epoll: Rc<Epoll>,
 }
 
 //==============================================================================
@@ -44,9 +60,9 @@ pub struct PushFuture {
 
 /// Associate Functions for Push Operation Descriptors
 impl PushFuture {
-    /// Creates a descriptor for a push operation.
-    pub fn new(qd: QDesc, fd: RawFd, buf: Buffer) -> Self {
-        Self { qd, fd, buf }
+    /// Creates a descriptor for a push operation, which sends `bufs` with a single system call.
+    pub fn new(qd: QDesc, fd: RawFd, bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>, epoll: Rc<Epoll>) -> Self {
+        Self { qd, fd, bufs, epoll }
     }
 
     /// Returns the queue descriptor associated to the target [PushFuture].
@@ -66,15 +82,19 @@ impl Future for PushFuture {
     /// Polls the target [PushFuture].
     fn poll(self: Pin<&mut Self>, ctx: &mut Context<'_>) -> Poll<Self::Output> {
         let self_: &mut PushFuture = self.get_mut();
-        match socket::send(self_.fd, &self_.buf[..], socket::MsgFlags::empty()) {
+        let iovs: ArrayVec<IoSlice, DEMI_SGARRAY_MAXLEN> =
+            self_.bufs.iter().map(|buf| IoSlice::new(&buf[..])).collect();
+        match socket::sendmsg::<SockaddrStorage>(self_.fd, &iovs, &[], socket::MsgFlags::empty(), None) {
             // Operation completed.
             Ok(nbytes) => {
-                trace!("data pushed ({:?}/{:?} bytes)", nbytes, self_.buf.len());
+                let len: usize = self_.bufs.iter().map(|buf| buf.len()).sum();
+                trace!("data pushed ({:?}/{:?} bytes)", nbytes, len);
+                stats::record_tx_burst(1, nbytes);
                 Poll::Ready(Ok(()))
             },
             // Operation in progress.
             Err(e) if e == Errno::EWOULDBLOCK || e == Errno::EAGAIN => {
-                ctx.waker().wake_by_ref();
+                self_.epoll.park(self_.fd, Interest::Write, ctx.waker());
                 Poll::Pending
             },
             // Error.
@@ -5,11 +5,22 @@
 // Imports
 //==============================================================================
 
-use crate::runtime::{
-    fail::Fail,
-    memory::Buffer,
-    QDesc,
+use crate::{
+    catnap::{
+        datagram::DatagramBatch,
+        epoll::{
+            Epoll,
+            Interest,
+        },
+    },
+    runtime::{
+        fail::Fail,
+        memory::Buffer,
+        types::DEMI_SGARRAY_MAXLEN,
+        QDesc,
+    },
 };
+use ::arrayvec::ArrayVec;
 use ::nix::{
     errno::Errno,
     sys::socket::{
@@ -20,8 +31,11 @@ use ::nix::{
 };
 use ::std::{
     future::Future,
+    io::IoSlice,
+    net::SocketAddrV4,
     os::unix::prelude::RawFd,
     pin::Pin,
+    rc::Rc,
     task::{
         Context,
         Poll,
@@ -32,16 +46,38 @@ use ::std::{
 // Structures
 //==============================================================================
 
+/// Datagram of a Pushto Operation
+enum Datagram {
+    /// Datagram that is sent on its own.
+    Single {
+        /// Destination address.
+        addr: SockaddrStorage,
+        // Underlying file descriptor.
+        fd: RawFd,
+        /// Buffers to send, in order.
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+    },
+    /// Datagram that is sent along with others that are queued on the same socket.
+    Batched {
+        /// Batched I/O of the underlying socket.
+        batch: Rc<DatagramBatch>,
+        // Underlying file descriptor.
+        fd: RawFd,
+        /// Identifier of the pushto operation in the batch.
+        id: u64,
+    },
+}
+
 /// Pushto Operation Descriptor
 pub struct PushtoFuture {
     /// Associated queue descriptor.
     qd: QDesc,
-    /// Destination address.
-    addr: SockaddrStorage,
-    // Underlying file descriptor.
-    fd: RawFd,
-    /// Buffer to send.
-    buf: Buffer,
+    /// Datagram to send.
+    datagram: Datagram,
+    /// Readiness notifications.
+    epoll: Rc<Epoll>,
+    /// Did the operation complete?
+    done: bool,
 }
 
 //==============================================================================
@@ -50,9 +86,38 @@ pub struct PushtoFuture {
 
 /// Associate Functions for Pushto Operation Descriptors
 impl PushtoFuture {
-    /// Creates a descriptor for a pushto operation.
-    pub fn new(qd: QDesc, fd: RawFd, addr: SockaddrStorage, buf: Buffer) -> Self {
-        Self { qd, addr, fd, buf }
+    /// Creates a descriptor for a pushto operation, whose datagram is the concatenation of `bufs`.
+    pub fn new(
+        qd: QDesc,
+        fd: RawFd,
+        addr: SockaddrStorage,
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+        epoll: Rc<Epoll>,
+    ) -> Self {
+        Self {
+            qd,
+            datagram: Datagram::Single { addr, fd, bufs },
+            epoll,
+            done: false,
+        }
+    }
+
+    /// Creates a descriptor for a pushto operation on a UDP socket, whose datagram is queued in `batch` right away.
+    pub fn batched(
+        qd: QDesc,
+        fd: RawFd,
+        batch: Rc<DatagramBatch>,
+        remote: SocketAddrV4,
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+        epoll: Rc<Epoll>,
+    ) -> Self {
+        let id: u64 = batch.add_pushto(remote, bufs);
+        Self {
+            qd,
+            datagram: Datagram::Batched { batch, fd, id },
+            epoll,
+            done: false,
+        }
     }
 
     /// Returns the queue descriptor associated to the target [PushtoFuture].
@@ -72,15 +137,38 @@ impl Future for PushtoFuture {
     /// Polls the target [PushtoFuture].
     fn poll(self: Pin<&mut Self>, ctx: &mut Context<'_>) -> Poll<Self::Output> {
         let self_: &mut PushtoFuture = self.get_mut();
-        match socket::sendto(self_.fd, &self_.buf[..], &self_.addr, MsgFlags::empty()) {
+        let (fd, addr, bufs): (RawFd, &SockaddrStorage, &ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>) = match self_.datagram {
+            Datagram::Single { fd, ref addr, ref bufs } => (fd, addr, bufs),
+            Datagram::Batched { ref batch, fd, id } => {
+                return match batch.poll_pushto(id) {
+                    // Operation completed.
+                    Poll::Ready(result) => {
+                        self_.done = true;
+                        // Datagrams of other pushtos may have been sent along with this one.
+                        if batch.has_sent() {
+                            self_.epoll.notify(fd, Interest::Write);
+                        }
+                        Poll::Ready(result)
+                    },
+                    // Operation in progress.
+                    Poll::Pending => {
+                        self_.epoll.park(fd, Interest::Write, ctx.waker());
+                        Poll::Pending
+                    },
+                };
+            },
+        };
+        let iovs: ArrayVec<IoSlice, DEMI_SGARRAY_MAXLEN> = bufs.iter().map(|buf| IoSlice::new(&buf[..])).collect();
+        match socket::sendmsg(fd, &iovs, &[], MsgFlags::empty(), Some(addr)) {
             // Operation completed.
             Ok(nbytes) => {
-                trace!("data pushed ({:?}/{:?} bytes)", nbytes, self_.buf.len());
+                let len: usize = bufs.iter().map(|buf| buf.len()).sum();
+                trace!("data pushed ({:?}/{:?} bytes)", nbytes, len);
                 Poll::Ready(Ok(()))
             },
             // Operation in progress.
             Err(e) if e == Errno::EWOULDBLOCK || e == Errno::EAGAIN => {
-                ctx.waker().wake_by_ref();
+                self_.epoll.park(fd, Interest::Write, ctx.waker());
                 Poll::Pending
             },
             // Error.
@@ -91,3 +179,15 @@ impl Future for PushtoFuture {
         }
     }
 }
+
+/// Drop Trait Implementation for Pushto Operation Descriptors
+impl Drop for PushtoFuture {
+    fn drop(&mut self) {
+        // Pushtos that are cancelled leave neither their datagram nor their result in the batch.
+        if let Datagram::Batched { ref batch, id, .. } = self.datagram {
+            if !self.done {
+                batch.cancel_pushto(id);
+            }
+        }
+    }
+}
@@ -1,6 +1,9 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+mod config;
+mod datagram;
+mod epoll;
 mod futures;
 mod runtime;
 
@@ -14,17 +17,25 @@ pub use self::runtime::PosixRuntime;
 // Imports
 //==============================================================================
 
-use self::futures::{
-    accept::AcceptFuture,
-    connect::ConnectFuture,
-    pop::PopFuture,
-    push::PushFuture,
-    pushto::PushtoFuture,
-    Operation,
+use self::{
+    datagram::DatagramBatch,
+    epoll::Epoll,
+    futures::{
+        accept::AcceptFuture,
+        connect::ConnectFuture,
+        pop::PopFuture,
+        push::PushFuture,
+        pushto::PushtoFuture,
+        Operation,
+    },
 };
 use crate::{
-    demikernel::config::Config,
+    demikernel::{
+        config::Config,
+        shard,
+    },
     inetstack::operations::OperationResult,
+    pal::linux,
     runtime::{
         fail::Fail,
         memory::{
@@ -33,19 +44,27 @@ use crate::{
             MemoryRuntime,
         },
         queue::IoQueueTable,
+        stats,
         types::{
             demi_accept_result_t,
             demi_opcode_t,
             demi_qr_value_t,
             demi_qresult_t,
             demi_sgarray_t,
+            demi_stats_t,
+            DEMI_QTOKEN_INVALID,
+            DEMI_SGARRAY_MAXLEN,
         },
         QDesc,
         QToken,
         QType,
     },
-    scheduler::SchedulerHandle,
+    scheduler::{
+        Scheduler,
+        SchedulerHandle,
+    },
 };
+use ::arrayvec::ArrayVec;
 use ::libc::{
     c_int,
     AF_INET,
@@ -71,13 +90,19 @@ use ::nix::{
 use ::std::{
     any::Any,
     collections::HashMap,
+    fmt::Debug,
     mem,
     net::{
         Ipv4Addr,
         SocketAddrV4,
     },
     os::unix::prelude::RawFd,
-    time::SystemTime,
+    rc::Rc,
+    time::{
+        Duration,
+        Instant,
+        SystemTime,
+    },
 };
 
 #[cfg(feature = "profiler")]
@@ -93,8 +118,12 @@ pub struct CatnapLibOS {
     qtable: IoQueueTable, // TODO: Move this to Demikernel module.
     /// Established sockets.
     sockets: HashMap<QDesc, RawFd>,
+    /// Batched I/O of UDP sockets.
+    batches: HashMap<QDesc, Rc<DatagramBatch>>,
     /// Underlying runtime.
     runtime: PosixRuntime,
+    /// How long waits poll before they block, if they ever do.
+    busy_poll: Option<Duration>,
 }
 
 //==============================================================================
@@ -104,14 +133,16 @@ pub struct CatnapLibOS {
 /// Associate Functions for Catnap LibOS
 impl CatnapLibOS {
     /// Instantiates a Catnap LibOS.
-    pub fn new(_config: &Config) -> Self {
+    pub fn new(config: &Config) -> Self {
         let qtable: IoQueueTable = IoQueueTable::new();
         let sockets: HashMap<QDesc, RawFd> = HashMap::new();
-        let runtime: PosixRuntime = PosixRuntime::new();
+        let runtime: PosixRuntime = PosixRuntime::new(config.slab_config());
         Self {
             qtable,
             sockets,
+            batches: HashMap::new(),
             runtime,
+            busy_poll: config.busy_poll_duration(),
         }
     }
 
@@ -150,8 +181,16 @@ impl CatnapLibOS {
                 if socket::setsockopt(fd, socket::sockopt::ReusePort, &true).is_err() {
                     warn!("cannot set SO_REUSEPORT option");
                 }
+                // Try to register the socket for readiness notifications. If we fail, keep going because operations on
+                // it then fall back to polling.
+                if let Err(e) = self.runtime.epoll.register(fd) {
+                    warn!("cannot register socket for readiness notifications ({:?})", e);
+                }
                 let qd: QDesc = self.qtable.alloc(qtype.into());
                 assert_eq!(self.sockets.insert(qd, fd).is_none(), true);
+                if qtype == QType::UdpSocket {
+                    self.batches.insert(qd, Rc::new(DatagramBatch::new(fd)));
+                }
                 Ok(qd)
             },
             Err(err) => Err(Fail::new(err as i32, "failed to create socket")),
@@ -181,6 +220,14 @@ impl CatnapLibOS {
         match self.sockets.get(&qd) {
             Some(&fd) => {
                 socket::listen(fd, backlog).unwrap();
+
+                // Steer connections that arrive on the core of this shard to this socket. If we fail, keep going
+                // because this is non-critical.
+                if let Some(cpu) = shard::current_cpu() {
+                    if unsafe { linux::set_so_incoming_cpu(fd, cpu) } != 0 {
+                        warn!("cannot set SO_INCOMING_CPU option");
+                    }
+                }
                 Ok(())
             },
             _ => Err(Fail::new(EBADF, "invalid queue descriptor")),
@@ -195,7 +242,7 @@ impl CatnapLibOS {
         match self.sockets.get(&qd) {
             Some(&fd) => {
                 let new_qd: QDesc = self.qtable.alloc(QType::TcpSocket.into());
-                let future: Operation = Operation::from(AcceptFuture::new(qd, fd, new_qd));
+                let future: Operation = Operation::from(AcceptFuture::new(qd, fd, new_qd, self.runtime.epoll.clone()));
                 let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
                     Some(handle) => handle,
                     None => {
@@ -217,7 +264,7 @@ impl CatnapLibOS {
         match self.sockets.get(&qd) {
             Some(&fd) => {
                 let addr: SockaddrStorage = parse_addr(remote);
-                let future: Operation = Operation::from(ConnectFuture::new(qd, fd, addr));
+                let future: Operation = Operation::from(ConnectFuture::new(qd, fd, addr, self.runtime.epoll.clone()));
                 let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
                     Some(handle) => handle,
                     None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
@@ -231,20 +278,24 @@ impl CatnapLibOS {
     /// Closes a socket.
     pub fn close(&mut self, qd: QDesc) -> Result<(), Fail> {
         trace!("close() qd={:?}", qd);
+        self.batches.remove(&qd);
         match self.sockets.get(&qd) {
-            Some(&fd) => match unistd::close(fd) {
-                Ok(_) => Ok(()),
-                _ => Err(Fail::new(EBADF, "invalid queue descriptor")),
+            Some(&fd) => {
+                self.runtime.epoll.unregister(fd);
+                match unistd::close(fd) {
+                    Ok(_) => Ok(()),
+                    _ => Err(Fail::new(EBADF, "invalid queue descriptor")),
+                }
             },
             _ => Err(Fail::new(EBADF, "invalid queue descriptor")),
         }
     }
 
     // Handles a push operation.
-    fn do_push(&mut self, qd: QDesc, buf: Buffer) -> Result<QToken, Fail> {
+    fn do_push(&mut self, qd: QDesc, bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>) -> Result<QToken, Fail> {
         match self.sockets.get(&qd) {
             Some(&fd) => {
-                let future: Operation = Operation::from(PushFuture::new(qd, fd, buf));
+                let future: Operation = Operation::from(PushFuture::new(qd, fd, bufs, self.runtime.epoll.clone()));
                 let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
                     Some(handle) => handle,
                     None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
@@ -259,14 +310,15 @@ impl CatnapLibOS {
     pub fn push(&mut self, qd: QDesc, sga: &demi_sgarray_t) -> Result<QToken, Fail> {
         trace!("push() qd={:?}", qd);
 
-        match self.runtime.clone_sgarray(sga) {
-            Ok(buf) => {
-                if buf.len() == 0 {
+        // Segments are sent with a single system call, without gathering them.
+        match self.runtime.clone_sgarray_segments(sga) {
+            Ok(bufs) => {
+                if bufs.iter().all(|buf| buf.len() == 0) {
                     return Err(Fail::new(EINVAL, "zero-length buffer"));
                 }
 
                 // Issue push operation.
-                self.do_push(qd, buf)
+                self.do_push(qd, bufs)
             },
             Err(e) => Err(e),
         }
@@ -282,15 +334,23 @@ impl CatnapLibOS {
         }
 
         // Issue pushto operation.
-        self.do_push(qd, buf)
+        self.do_push(qd, ArrayVec::from_iter([buf]))
     }
 
     /// Handles a pushto operation.
-    fn do_pushto(&mut self, qd: QDesc, buf: Buffer, remote: SocketAddrV4) -> Result<QToken, Fail> {
+    fn do_pushto(
+        &mut self,
+        qd: QDesc,
+        bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>,
+        remote: SocketAddrV4,
+    ) -> Result<QToken, Fail> {
         match self.sockets.get(&qd) {
             Some(&fd) => {
-                let addr: SockaddrStorage = parse_addr(remote);
-                let future: Operation = Operation::from(PushtoFuture::new(qd, fd, addr, buf));
+                let epoll: Rc<Epoll> = self.runtime.epoll.clone();
+                let future: Operation = match self.batches.get(&qd) {
+                    Some(batch) => Operation::from(PushtoFuture::batched(qd, fd, batch.clone(), remote, bufs, epoll)),
+                    None => Operation::from(PushtoFuture::new(qd, fd, parse_addr(remote), bufs, epoll)),
+                };
                 let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
                     Some(handle) => handle,
                     None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
@@ -305,14 +365,15 @@ impl CatnapLibOS {
     pub fn pushto(&mut self, qd: QDesc, sga: &demi_sgarray_t, remote: SocketAddrV4) -> Result<QToken, Fail> {
         trace!("pushto() qd={:?}", qd);
 
-        match self.runtime.clone_sgarray(sga) {
-            Ok(buf) => {
-                if buf.len() == 0 {
+        // Segments are sent as a single datagram, without gathering them.
+        match self.runtime.clone_sgarray_segments(sga) {
+            Ok(bufs) => {
+                if bufs.iter().all(|buf| buf.len() == 0) {
                     return Err(Fail::new(EINVAL, "zero-length buffer"));
                 }
 
                 // Issue pushto operation.
-                self.do_pushto(qd, buf, remote)
+                self.do_pushto(qd, bufs, remote)
             },
             Err(e) => Err(e),
         }
@@ -328,7 +389,7 @@ impl CatnapLibOS {
         }
 
         // Issue pushto operation.
-        self.do_pushto(qd, buf, remote)
+        self.do_pushto(qd, ArrayVec::from_iter([buf]), remote)
     }
 
     /// Pops data from a socket.
@@ -338,7 +399,8 @@ impl CatnapLibOS {
         // Issue pop operation.
         match self.sockets.get(&qd) {
             Some(&fd) => {
-                let future: Operation = Operation::from(PopFuture::new(qd, fd));
+                let batch: Option<Rc<DatagramBatch>> = self.batches.get(&qd).cloned();
+                let future: Operation = Operation::from(PopFuture::new(qd, fd, batch, self.runtime.epoll.clone()));
                 let handle: SchedulerHandle = match self.runtime.scheduler.insert(future) {
                     Some(handle) => handle,
                     None => return Err(Fail::new(libc::EAGAIN, "cannot schedule co-routine")),
@@ -350,6 +412,60 @@ impl CatnapLibOS {
         }
     }
 
+    /// Pushes scatter-gather arrays to several sockets at once. Operations are issued in order and this function
+    /// stops at the first one that fails, so that `qts` holds the queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn push_many<Q: Copy + Debug + Into<QDesc>>(
+        &mut self,
+        qds: &[Q],
+        sgas: &[demi_sgarray_t],
+        qts: &mut [QToken],
+    ) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catnap::push_many");
+        trace!("push_many() qds={:?}", qds);
+
+        // Check arguments.
+        if sgas.len() != qds.len() || qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+        for (i, (&qd, sga)) in qds.iter().zip(sgas.iter()).enumerate() {
+            match self.push(qd.into(), sga) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    return Err(e);
+                },
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Pops data from several sockets at once. Operations are issued in order and this function stops at the first
+    /// one that fails, so that `qts` holds the queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn pop_many<Q: Copy + Debug + Into<QDesc>>(&mut self, qds: &[Q], qts: &mut [QToken]) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catnap::pop_many");
+        trace!("pop_many() qds={:?}", qds);
+
+        // Check arguments.
+        if qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+
+        for (i, &qd) in qds.iter().enumerate() {
+            match self.pop(qd.into()) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    return Err(e);
+                },
+            }
+        }
+
+        Ok(())
+    }
+
     /// Waits for an operation to complete.
     pub fn wait(&mut self, qt: QToken) -> Result<demi_qresult_t, Fail> {
         #[cfg(feature = "profiler")]
@@ -372,6 +488,7 @@ impl CatnapLibOS {
             None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
         };
 
+        let start: Instant = Instant::now();
         let (qd, result): (QDesc, OperationResult) = loop {
             // Poll first, so as to give pending operations a chance to complete.
             self.runtime.scheduler.poll();
@@ -381,6 +498,12 @@ impl CatnapLibOS {
                 break self.take_result(handle);
             }
 
+            let timeout: Duration = match abstime {
+                Some(abstime) => abstime.duration_since(SystemTime::now()).unwrap_or(Duration::ZERO),
+                None => Duration::ZERO,
+            };
+            self.poll_events(start, Some(timeout));
+
             if abstime.is_none() || SystemTime::now() >= abstime.unwrap() {
                 // Return this operation to the scheduling queue by removing the associated key
                 // (which would otherwise cause the operation to be freed).
@@ -404,6 +527,7 @@ impl CatnapLibOS {
             None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
         };
 
+        let start: Instant = Instant::now();
         loop {
             // Poll first, so as to give pending operations a chance to complete.
             self.runtime.scheduler.poll();
@@ -412,6 +536,8 @@ impl CatnapLibOS {
             if handle.has_completed() {
                 return Ok(self.take_result(handle));
             }
+
+            self.poll_events(start, None);
         }
     }
 
@@ -431,6 +557,7 @@ impl CatnapLibOS {
         timer!("catnap::wait_any2");
         trace!("wait_any2() {:?}", qts);
 
+        let start: Instant = Instant::now();
         loop {
             // Poll first, so as to give pending operations a chance to complete.
             self.runtime.scheduler.poll();
@@ -453,7 +580,47 @@ impl CatnapLibOS {
                 // (which would otherwise cause the operation to be freed).
                 handle.take_key();
             }
+
+            self.poll_events(start, None);
+        }
+    }
+
+    /// Waits for at least one operation to complete or a timeout to expire, and packs the results of all operations
+    /// that have completed into `qrs`. If `abstime` is `None`, this function blocks until some operation completes.
+    /// Returns the number of results that were written.
+    pub fn wait_many(
+        &mut self,
+        qts: &[QToken],
+        qrs: &mut [demi_qresult_t],
+        abstime: Option<SystemTime>,
+    ) -> Result<usize, Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catnap::wait_many");
+        trace!("wait_many() qts={:?}, timeout={:?}", qts, abstime);
+
+        if qrs.len() < qts.len() {
+            return Err(Fail::new(libc::EINVAL, "result array is too small"));
         }
+
+        let start: Instant = Instant::now();
+        let mut nready: usize = 0;
+        let scheduler: Scheduler = self.runtime.scheduler.clone();
+        scheduler.wait_many(
+            self,
+            qts,
+            abstime,
+            |catnap: &mut Self| catnap.runtime.scheduler.poll(),
+            |catnap: &mut Self, abstime: Option<SystemTime>| {
+                let timeout: Option<Duration> =
+                    abstime.map(|abstime| abstime.duration_since(SystemTime::now()).unwrap_or(Duration::ZERO));
+                catnap.poll_events(start, timeout);
+            },
+            |catnap: &mut Self, i: usize, handle: SchedulerHandle| {
+                let (qd, r): (QDesc, OperationResult) = catnap.take_result(handle);
+                qrs[nready] = pack_result(&catnap.runtime, r, qd, qts[i].into());
+                nready += 1;
+            },
+        )
     }
 
     /// Allocates a scatter-gather array.
@@ -468,6 +635,15 @@ impl CatnapLibOS {
         self.runtime.free_sgarray(sga)
     }
 
+    /// Retrieves statistics of the LibOS instance that serves an I/O queue.
+    pub fn getstats(&self, qd: QDesc) -> Result<demi_stats_t, Fail> {
+        trace!("getstats() qd={:?}", qd);
+        match self.sockets.get(&qd) {
+            Some(_) => Ok(stats::local()),
+            _ => Err(Fail::new(EBADF, "invalid queue descriptor")),
+        }
+    }
+
     #[deprecated]
     pub fn local_ipv4_addr(&self) -> Ipv4Addr {
         todo!()
@@ -478,6 +654,19 @@ impl CatnapLibOS {
         &self.runtime
     }
 
+    /// Wakes up operations whose socket became ready, so that the scheduler polls them next. This does not block while
+    /// a wait that started at `start` is within its busy-poll budget or some operation is ready. Otherwise, it blocks
+    /// until some socket becomes ready or `timeout` expires. If `timeout` is `None`, it blocks indefinitely.
+    fn poll_events(&self, start: Instant, timeout: Option<Duration>) {
+        let timeout: Option<Duration> = match self.busy_poll {
+            Some(budget) if start.elapsed() >= budget && !self.runtime.scheduler.has_ready() => timeout,
+            _ => Some(Duration::ZERO),
+        };
+        if let Err(e) = self.runtime.epoll.wait(timeout) {
+            warn!("failed to wait for readiness notifications ({:?})", e);
+        }
+    }
+
     /// Takes out the [OperationResult] associated with the target [SchedulerHandle].
     fn take_result(&mut self, handle: SchedulerHandle) -> (QDesc, OperationResult) {
         let boxed_future: Box<dyn Any> = self.runtime.scheduler.take(handle).as_any();
@@ -490,6 +679,9 @@ impl CatnapLibOS {
         if let Some(new_qd) = new_qd {
             // Associate raw file descriptor with queue descriptor.
             if let Some(new_fd) = new_fd {
+                if let Err(e) = self.runtime.epoll.register(new_fd) {
+                    warn!("cannot register socket for readiness notifications ({:?})", e);
+                }
                 assert!(self.sockets.insert(new_qd, new_fd).is_none());
             } else {
                 // Release entry in queue table.
@@ -588,3 +780,171 @@ fn pack_result(rt: &PosixRuntime, result: OperationResult, qd: QDesc, qt: u64) -
         },
     }
 }
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::CatnapLibOS;
+    use crate::{
+        demikernel::config::Config,
+        inetstack::operations::OperationResult,
+        runtime::{
+            fail::Fail,
+            types::{
+                demi_sgarray_t,
+                DEMI_QTOKEN_INVALID,
+            },
+            QDesc,
+            QToken,
+        },
+    };
+    use ::std::{
+        net::{
+            Ipv4Addr,
+            SocketAddrV4,
+        },
+        slice,
+    };
+    use ::yaml_rust::YamlLoader;
+
+    /// Base port of the sockets that are used in these tests.
+    const PORT_BASE: u16 = 47312;
+
+    /// Queue descriptor that names no socket.
+    const BAD_QD: usize = 1 << 20;
+
+    /// Queue token that is stored in slots that a batch leaves alone.
+    const UNSET_QT: u64 = u64::MAX - 1;
+
+    /// Opens `n` pairs of UDP sockets on the loopback interface, and connects the first socket of each pair to the
+    /// second one. Returns the sending and the receiving sockets.
+    fn setup(libos: &mut CatnapLibOS, port_base: u16, n: usize) -> (Vec<QDesc>, Vec<QDesc>) {
+        let mut txs: Vec<QDesc> = Vec::with_capacity(n);
+        let mut rxs: Vec<QDesc> = Vec::with_capacity(n);
+        for i in 0..n {
+            let local: SocketAddrV4 = SocketAddrV4::new(Ipv4Addr::LOCALHOST, port_base + 2 * i as u16);
+            let remote: SocketAddrV4 = SocketAddrV4::new(Ipv4Addr::LOCALHOST, port_base + 2 * i as u16 + 1);
+            let tx: QDesc = libos.socket(libc::AF_INET, libc::SOCK_DGRAM, 0).unwrap();
+            let rx: QDesc = libos.socket(libc::AF_INET, libc::SOCK_DGRAM, 0).unwrap();
+            libos.bind(tx, local).unwrap();
+            libos.bind(rx, remote).unwrap();
+            let qt: QToken = libos.connect(tx, remote).unwrap();
+            assert!(matches!(libos.wait2(qt), Ok((_, OperationResult::Connect))));
+            txs.push(tx);
+            rxs.push(rx);
+        }
+        (txs, rxs)
+    }
+
+    /// Allocates a scatter-gather array that holds `len` copies of `byte`.
+    fn cook_sga(libos: &CatnapLibOS, byte: u8, len: usize) -> demi_sgarray_t {
+        let sga: demi_sgarray_t = libos.sgaalloc(len).unwrap();
+        let data: &mut [u8] = unsafe {
+            slice::from_raw_parts_mut(
+                sga.sga_segs[0].sgaseg_buf as *mut u8,
+                sga.sga_segs[0].sgaseg_len as usize,
+            )
+        };
+        data.fill(byte);
+        sga
+    }
+
+    /// Waits for a push, and checks that it was issued on `qd`.
+    fn wait_push(libos: &mut CatnapLibOS, qt: QToken, qd: QDesc) {
+        match libos.wait2(qt) {
+            Ok((push_qd, OperationResult::Push)) => assert_eq!(push_qd, qd),
+            Ok(_) => panic!("push() failed"),
+            Err(e) => panic!("wait() failed: {:?}", e.cause),
+        }
+    }
+
+    /// Waits for a pop, and checks that it was issued on `qd` and that it got `len` copies of `byte`.
+    fn wait_pop(libos: &mut CatnapLibOS, qt: QToken, qd: QDesc, byte: u8, len: usize) {
+        match libos.wait2(qt) {
+            Ok((pop_qd, OperationResult::Pop(_, buf))) => {
+                assert_eq!(pop_qd, qd);
+                assert_eq!(buf.len(), len);
+                assert!(buf.iter().all(|b| *b == byte));
+            },
+            Ok(_) => panic!("pop() failed"),
+            Err(e) => panic!("wait() failed: {:?}", e.cause),
+        }
+    }
+
+    /// Tests that batches of pushes and pops hand out one queue token per operation, in order.
+    #[test]
+    fn test_push_pop_many() {
+        let config: Config = Config(YamlLoader::load_from_str("catnap: {}").unwrap().remove(0));
+        let mut libos: CatnapLibOS = CatnapLibOS::new(&config);
+        let (txs, rxs): (Vec<QDesc>, Vec<QDesc>) = setup(&mut libos, PORT_BASE, 3);
+        let sgas: Vec<demi_sgarray_t> = (0..3).map(|i| cook_sga(&libos, i as u8 + 1, 64 << i)).collect();
+
+        let mut pop_qts: [QToken; 3] = [QToken::from(UNSET_QT); 3];
+        libos.pop_many(&rxs, &mut pop_qts).unwrap();
+        let mut push_qts: [QToken; 3] = [QToken::from(UNSET_QT); 3];
+        libos.push_many(&txs, &sgas, &mut push_qts).unwrap();
+
+        // Each socket got its own datagram, so results tell which operation each queue token stands for.
+        for i in 0..3 {
+            wait_push(&mut libos, push_qts[i], txs[i]);
+        }
+        for i in 0..3 {
+            wait_pop(&mut libos, pop_qts[i], rxs[i], i as u8 + 1, 64 << i);
+        }
+
+        for sga in sgas {
+            libos.sgafree(sga).unwrap();
+        }
+        for qd in txs.into_iter().chain(rxs.into_iter()) {
+            libos.close(qd).unwrap();
+        }
+    }
+
+    /// Tests that batches of pushes and pops stop at the first operation that fails, that the queue tokens of the
+    /// operations before it are still handed out, and that the others are invalid.
+    #[test]
+    fn test_push_pop_many_partial() {
+        let config: Config = Config(YamlLoader::load_from_str("catnap: {}").unwrap().remove(0));
+        let mut libos: CatnapLibOS = CatnapLibOS::new(&config);
+        let (txs, rxs): (Vec<QDesc>, Vec<QDesc>) = setup(&mut libos, PORT_BASE + 16, 2);
+        let sgas: Vec<demi_sgarray_t> = (0..3).map(|i| cook_sga(&libos, i as u8 + 1, 32)).collect();
+
+        let mut pop_qts: [QToken; 3] = [QToken::from(UNSET_QT); 3];
+        let e: Fail = libos
+            .pop_many(&[rxs[0], QDesc::from(BAD_QD), rxs[1]], &mut pop_qts)
+            .unwrap_err();
+        assert_eq!(e.errno, libc::EBADF);
+        assert_ne!(pop_qts[0], QToken::from(UNSET_QT));
+        assert_eq!(&pop_qts[1..], &[QToken::from(DEMI_QTOKEN_INVALID); 2]);
+
+        let mut push_qts: [QToken; 3] = [QToken::from(UNSET_QT); 3];
+        let e: Fail = libos
+            .push_many(&[txs[0], QDesc::from(BAD_QD), txs[1]], &sgas, &mut push_qts)
+            .unwrap_err();
+        assert_eq!(e.errno, libc::EBADF);
+        assert_ne!(push_qts[0], QToken::from(UNSET_QT));
+        assert_eq!(&push_qts[1..], &[QToken::from(DEMI_QTOKEN_INVALID); 2]);
+
+        // The operations that were issued before the failure still complete.
+        wait_push(&mut libos, push_qts[0], txs[0]);
+        wait_pop(&mut libos, pop_qts[0], rxs[0], 1, 32);
+
+        // Mismatched batches are rejected upfront.
+        let mut qts: [QToken; 1] = [QToken::from(UNSET_QT); 1];
+        let e: Fail = libos.push_many(&txs, &sgas[..1], &mut qts).unwrap_err();
+        assert_eq!(e.errno, libc::EINVAL);
+        let e: Fail = libos.pop_many(&rxs, &mut qts).unwrap_err();
+        assert_eq!(e.errno, libc::EINVAL);
+        assert_eq!(qts[0], QToken::from(UNSET_QT));
+
+        for sga in sgas {
+            libos.sgafree(sga).unwrap();
+        }
+        for qd in txs.into_iter().chain(rxs.into_iter()) {
+            libos.close(qd).unwrap();
+        }
+    }
+}
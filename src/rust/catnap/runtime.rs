@@ -5,25 +5,35 @@
 // Imports
 //==============================================================================
 
+use super::epoll::Epoll;
 use crate::{
     runtime::{
         fail::Fail,
         memory::{
+            gather_sgarray,
+            sgarray_len,
+            sgarray_segments,
             Buffer,
             DataBuffer,
             MemoryRuntime,
+            SlabAllocator,
+            SlabConfig,
         },
         types::{
             demi_sgarray_t,
             demi_sgaseg_t,
+            DEMI_SGARRAY_MAXLEN,
         },
         Runtime,
     },
     scheduler::scheduler::Scheduler,
 };
+use ::arrayvec::ArrayVec;
 use ::libc::c_void;
 use ::std::{
     mem,
+    ptr,
+    rc::Rc,
     slice,
 };
 
@@ -36,6 +46,10 @@ use ::std::{
 pub struct PosixRuntime {
     /// Scheduler
     pub scheduler: Scheduler,
+    /// Readiness notifications of sockets.
+    pub epoll: Rc<Epoll>,
+    /// Allocator for buffers of scatter-gather arrays.
+    slab: Rc<SlabAllocator>,
 }
 
 //==============================================================================
@@ -44,11 +58,51 @@ pub struct PosixRuntime {
 
 /// Associate Functions for POSIX Runtime
 impl PosixRuntime {
-    pub fn new() -> Self {
+    pub fn new(slab: SlabConfig) -> Self {
         Self {
             scheduler: Scheduler::default(),
+            epoll: Rc::new(Epoll::new().expect("cannot create epoll instance")),
+            slab: Rc::new(SlabAllocator::new(slab)),
         }
     }
+
+    /// Clones each segment of a scatter-gather array into its own buffer, so that the segments are handed to the
+    /// kernel as an I/O vector instead of being gathered.
+    pub fn clone_sgarray_segments(&self, sga: &demi_sgarray_t) -> Result<ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN>, Fail> {
+        // Check arguments.
+        let segs: &[demi_sgaseg_t] = sgarray_segments(sga)?;
+
+        // Only the first segment is known to lie in the buffer that backs the scatter-gather array.
+        let mut bufs: ArrayVec<Buffer, DEMI_SGARRAY_MAXLEN> = ArrayVec::new();
+        for (i, sgaseg) in segs.iter().enumerate() {
+            let dbuf_ptr: *const u8 = if i == 0 { sga.sga_buf as *const u8 } else { ptr::null() };
+            bufs.push(self.clone_sgaseg(dbuf_ptr, sgaseg));
+        }
+        Ok(bufs)
+    }
+
+    /// Clones a scatter-gather segment, which lies in the buffer at `dbuf_ptr` if that is not null.
+    ///
+    /// Buffers of the slab allocator are shared instead of copied. The shared reference keeps the buffer from being
+    /// handed out again until the operation completes.
+    fn clone_sgaseg(&self, dbuf_ptr: *const u8, sgaseg: &demi_sgaseg_t) -> Buffer {
+        let (data_ptr, len): (*const u8, usize) = (sgaseg.sgaseg_buf as *const u8, sgaseg.sgaseg_len as usize);
+
+        if !dbuf_ptr.is_null() {
+            if let Some(mut dbuf) = self.slab.share(dbuf_ptr) {
+                let offset: usize = unsafe { data_ptr.sub_ptr(dbuf_ptr) };
+                if offset + len <= dbuf.len() {
+                    dbuf.adjust(offset);
+                    dbuf.trim(dbuf.len() - len);
+                    return Buffer::Heap(dbuf);
+                }
+            }
+        }
+
+        // Clone heap-managed buffer.
+        let seg_slice: &[u8] = unsafe { slice::from_raw_parts(data_ptr, len) };
+        Buffer::Heap(DataBuffer::from_slice(seg_slice))
+    }
 }
 
 //==============================================================================
@@ -74,27 +128,34 @@ impl MemoryRuntime for PosixRuntime {
             },
             _ => return Err(Fail::new(libc::EINVAL, "invalid buffer type")),
         };
+        let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+        sga_segs[0] = sgaseg;
         Ok(demi_sgarray_t {
             sga_buf: dbuf_ptr as *mut c_void,
             sga_numsegs: 1,
-            sga_segs: [sgaseg],
+            sga_segs,
             sga_addr: unsafe { mem::zeroed() },
         })
     }
 
-    /// Allocates a scatter-gather array.
+    /// Allocates a scatter-gather array. Arrays come from the slab allocator, unless they are too large for it.
     fn alloc_sgarray(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
-        // Allocate a heap-managed buffer.
-        let dbuf: DataBuffer = DataBuffer::new(size)?;
+        let dbuf: DataBuffer = match self.slab.alloc(size) {
+            Some(dbuf) => dbuf,
+            // Allocate a heap-managed buffer.
+            None => DataBuffer::new(size)?,
+        };
         let (dbuf_ptr, data_ptr): (*const u8, *const u8) = DataBuffer::into_raw_parts(dbuf)?;
         let sgaseg: demi_sgaseg_t = demi_sgaseg_t {
             sgaseg_buf: data_ptr as *mut c_void,
             sgaseg_len: size as u32,
         };
+        let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+        sga_segs[0] = sgaseg;
         Ok(demi_sgarray_t {
             sga_buf: dbuf_ptr as *mut c_void,
             sga_numsegs: 1,
-            sga_segs: [sgaseg],
+            sga_segs,
             sga_addr: unsafe { mem::zeroed() },
         })
     }
@@ -102,35 +163,33 @@ impl MemoryRuntime for PosixRuntime {
     /// Releases a scatter-gather array.
     fn free_sgarray(&self, sga: demi_sgarray_t) -> Result<(), Fail> {
         // Check arguments.
-        // TODO: Drop this check once we support scatter-gather arrays with multiple segments.
-        if sga.sga_numsegs != 1 {
-            return Err(Fail::new(libc::EINVAL, "scatter-gather array with invalid size"));
-        }
+        sgarray_segments(&sga)?;
 
-        // Release heap-managed buffer.
+        // Release underlying buffer. Only the buffer that backs the first segment is owned by the scatter-gather
+        // array, any other segments are owned by the application. Buffers of the slab allocator go back to it.
+        if self.slab.release(sga.sga_buf as *const u8)? {
+            return Ok(());
+        }
         let (dbuf_ptr, length): (*mut u8, usize) = (sga.sga_buf as *mut u8, sga.sga_segs[0].sgaseg_len as usize);
         DataBuffer::from_raw_parts(dbuf_ptr, length)?;
 
         Ok(())
     }
 
-    /// Clones a scatter-gather array.
+    /// Clones a scatter-gather array into a single buffer. Pushes do not go through this, but rather through
+    /// [PosixRuntime::clone_sgarray_segments], which does not gather segments.
     fn clone_sgarray(&self, sga: &demi_sgarray_t) -> Result<Buffer, Fail> {
         // Check arguments.
-        // TODO: Drop this check once we support scatter-gather arrays with multiple segments.
-        if sga.sga_numsegs != 1 {
-            return Err(Fail::new(libc::EINVAL, "scatter-gather array with invalid size"));
-        }
+        let segs: &[demi_sgaseg_t] = sgarray_segments(sga)?;
 
-        let sgaseg: demi_sgaseg_t = sga.sga_segs[0];
-        let (dbuf_ptr, len): (*mut c_void, usize) = (sga.sga_buf, sgaseg.sgaseg_len as usize);
+        // Gather multiple segments into a single heap-managed buffer.
+        if segs.len() > 1 {
+            let mut dbuf: DataBuffer = DataBuffer::new(sgarray_len(segs))?;
+            gather_sgarray(segs, &mut dbuf);
+            return Ok(Buffer::Heap(dbuf));
+        }
 
-        // Clone heap-managed buffer.
-        let seg_slice: &[u8] = unsafe { slice::from_raw_parts(dbuf_ptr as *const u8, len) };
-        let mut dbuf: DataBuffer = DataBuffer::from_slice(seg_slice);
-        let nbytes: usize = unsafe { sgaseg.sgaseg_buf.sub_ptr(sga.sga_buf) };
-        dbuf.adjust(nbytes);
-        Ok(Buffer::Heap(dbuf))
+        Ok(self.clone_sgaseg(sga.sga_buf as *const u8, &segs[0]))
     }
 }
 
@@ -6,6 +6,7 @@
 //======================================================================================================================
 
 use crate::{
+    catnip::runtime::memory::SizeClass,
     demikernel::config::Config,
     runtime::network::types::MacAddress,
 };
@@ -14,6 +15,7 @@ use ::std::{
     collections::HashMap,
     ffi::CString,
     net::Ipv4Addr,
+    time::Duration,
 };
 use ::yaml_rust::Yaml;
 
@@ -75,6 +77,52 @@ impl Config {
         disable_arp
     }
 
+    /// Reads the "TX flush deadline" parameter, in microseconds, from the underlying configuration file.
+    pub fn tx_flush_deadline(&self) -> Option<Duration> {
+        self.0["catnip"]["tx_flush_deadline_us"]
+            .as_i64()
+            .map(|us| Duration::from_micros(us.max(0) as u64))
+    }
+
+    /// Reads the "wait spin budget" parameter, in microseconds, from the underlying configuration file. This is either a
+    /// single budget for all queues, or a list with one budget per queue. Waits spin for this long before they start to
+    /// save power. If it is not set, waits spin forever.
+    pub fn wait_spin_budgets(&self) -> Option<Vec<Duration>> {
+        let to_duration = |us: i64| Duration::from_micros(us.max(0) as u64);
+        match self.0["catnip"]["wait_spin_us"] {
+            Yaml::Integer(us) => Some(vec![to_duration(us)]),
+            Yaml::Array(ref arr) => Some(
+                arr.iter()
+                    .map(|us| {
+                        us.as_i64()
+                            .map(to_duration)
+                            .ok_or_else(|| anyhow::format_err!("Non integer spin budget"))
+                            .unwrap()
+                    })
+                    .collect(),
+            ),
+            _ => None,
+        }
+    }
+
+    /// Reads the "wait pause duration" parameter, in microseconds, from the underlying configuration file. Once their
+    /// spin budget is spent, waits pause the core for this long before they block on RX interrupts.
+    pub fn wait_pause_duration(&self) -> Option<Duration> {
+        self.0["catnip"]["wait_pause_us"]
+            .as_i64()
+            .map(|us| Duration::from_micros(us.max(0) as u64))
+    }
+
+    /// Reads the "RX interrupts" parameter from the underlying configuration file.
+    pub fn rx_interrupts(&self) -> bool {
+        self.0["catnip"]["rx_interrupts"].as_bool().unwrap_or(false)
+    }
+
+    /// Reads the "number of queues" parameter from the underlying configuration file.
+    pub fn num_queues(&self) -> Option<u16> {
+        self.0["catnip"]["num_queues"].as_i64().map(|n| n.max(0) as u16)
+    }
+
     /// Gets the "MTU" parameter from environment variables.
     pub fn mtu(&self) -> u16 {
         // FIXME: this function should return a Result.
@@ -92,6 +140,46 @@ impl Config {
         ::std::env::var("TCP_CHECKSUM_OFFLOAD").is_ok()
     }
 
+    /// Reads the "TCP segmentation offload" parameter from the underlying configuration file.
+    pub fn tcp_segmentation_offload(&self) -> bool {
+        self.0["catnip"]["tcp_segmentation_offload"].as_bool().unwrap_or(false)
+    }
+
+    /// Reads the "mempool cache size" parameter, i.e. the number of buffers in per-thread caches of memory pools, from
+    /// the underlying configuration file.
+    pub fn mempool_cache_size(&self) -> Option<usize> {
+        self.0["catnip"]["mempool_cache_size"]
+            .as_i64()
+            .map(|n| n.max(0) as usize)
+    }
+
+    /// Reads the "mempool size classes" parameter from the underlying configuration file. Each size class is a pair of
+    /// data room size and number of buffers.
+    pub fn mempool_size_classes(&self) -> Option<Vec<SizeClass>> {
+        // FIXME: this function should return a Result.
+        match self.0["catnip"]["mempool_size_classes"] {
+            Yaml::Array(ref arr) => Some(
+                arr.iter()
+                    .map(|class| {
+                        let data_room_size: i64 = class["data_room_size"]
+                            .as_i64()
+                            .ok_or_else(|| anyhow::format_err!("Couldn't find data_room_size of size class in config"))
+                            .unwrap();
+                        let pool_size: i64 = class["pool_size"]
+                            .as_i64()
+                            .ok_or_else(|| anyhow::format_err!("Couldn't find pool_size of size class in config"))
+                            .unwrap();
+                        SizeClass {
+                            data_room_size: data_room_size.max(0) as usize,
+                            pool_size: pool_size.max(0) as usize,
+                        }
+                    })
+                    .collect(),
+            ),
+            _ => None,
+        }
+    }
+
     /// Gets the "UDP_CHECKSUM_OFFLOAD" parameter from environment variables.
     pub fn udp_checksum_offload(&self) -> bool {
         ::std::env::var("UDP_CHECKSUM_OFFLOAD").is_ok()
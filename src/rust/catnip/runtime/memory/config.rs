@@ -10,6 +10,8 @@ use super::consts::{
     DEFAULT_CACHE_SIZE,
     DEFAULT_HEADER_POOL_SIZE,
     DEFAULT_INLINE_BODY_SIZE,
+    DEFAULT_LARGE_BODY_POOL_SIZE,
+    DEFAULT_LARGE_BODY_SIZE,
     DEFAULT_MAX_BODY_SIZE,
 };
 
@@ -17,6 +19,15 @@ use super::consts::{
 // Structures
 //==============================================================================
 
+/// Size Class of Body Buffers
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct SizeClass {
+    /// Data room of buffers in this class, including RTE_PKTMBUF_HEADROOM.
+    pub data_room_size: usize,
+    /// Number of buffers in this class.
+    pub pool_size: usize,
+}
+
 //// Memory Configuration Descriptor
 #[derive(Debug)]
 pub struct MemoryConfig {
@@ -36,6 +47,10 @@ pub struct MemoryConfig {
 
     /// How many buffers should remain within `rte_mempool`'s per-thread cache?
     cache_size: usize,
+
+    /// Additional size classes for application buffers, each one backed by its own pool. The body pool is always a
+    /// size class of its own.
+    size_classes: Vec<SizeClass>,
 }
 
 //==============================================================================
@@ -50,6 +65,7 @@ impl MemoryConfig {
         max_body_size: Option<usize>,
         body_pool_size: Option<usize>,
         cache_size: Option<usize>,
+        size_classes: Option<Vec<SizeClass>>,
     ) -> Self {
         let mut config: Self = Self::default();
 
@@ -78,6 +94,11 @@ impl MemoryConfig {
             config.cache_size = cache_size;
         }
 
+        // Sets the size classes config option.
+        if let Some(size_classes) = size_classes {
+            config.size_classes = size_classes;
+        }
+
         config
     }
 
@@ -105,6 +126,18 @@ impl MemoryConfig {
     pub fn get_cache_size(&self) -> usize {
         self.cache_size
     }
+
+    /// Returns all size classes in the target [MemoryConfig], including the body pool, sorted by data room size.
+    pub fn get_size_classes(&self) -> Vec<SizeClass> {
+        let mut size_classes: Vec<SizeClass> = self.size_classes.clone();
+        size_classes.push(SizeClass {
+            data_room_size: self.max_body_size,
+            pool_size: self.body_pool_size,
+        });
+        size_classes.sort_by_key(|class| class.data_room_size);
+        size_classes.dedup_by_key(|class| class.data_room_size);
+        size_classes
+    }
 }
 
 //==============================================================================
@@ -120,6 +153,10 @@ impl Default for MemoryConfig {
             max_body_size: DEFAULT_MAX_BODY_SIZE,
             body_pool_size: DEFAULT_BODY_POOL_SIZE,
             cache_size: DEFAULT_CACHE_SIZE,
+            size_classes: vec![SizeClass {
+                data_room_size: DEFAULT_LARGE_BODY_SIZE,
+                pool_size: DEFAULT_LARGE_BODY_POOL_SIZE,
+            }],
         }
     }
 }
@@ -26,5 +26,17 @@ pub const DEFAULT_BODY_POOL_SIZE: usize = 8192 - 1;
 /// Default value for maximum body size.
 pub const DEFAULT_MAX_BODY_SIZE: usize = (RTE_MBUF_DEFAULT_BUF_SIZE + RTE_PKTMBUF_HEADROOM) as usize;
 
+/// Default data room size of the large body pool, which backs application buffers that do not fit in the body pool.
+pub const DEFAULT_LARGE_BODY_SIZE: usize = 16384 + RTE_PKTMBUF_HEADROOM as usize;
+
+/// Default number of buffers in the large body pool.
+pub const DEFAULT_LARGE_BODY_POOL_SIZE: usize = 1024 - 1;
+
 /// Default per-thread cache size.
 pub const DEFAULT_CACHE_SIZE: usize = 250;
+
+/// Maximum per-thread cache size (RTE_MEMPOOL_CACHE_MAX_SIZE).
+pub const MAX_CACHE_SIZE: usize = 512;
+
+/// Maximum data room size of a buffer, as mbufs store lengths in 16 bits.
+pub const MAX_DATA_ROOM_SIZE: usize = u16::max_value() as usize;
@@ -5,7 +5,17 @@
 // Imports
 //==============================================================================
 
-use super::mempool::MemoryPool;
+use super::{
+    config::SizeClass,
+    consts::{
+        MAX_CACHE_SIZE,
+        MAX_DATA_ROOM_SIZE,
+    },
+    mempool::{
+        MemoryPool,
+        MemoryPoolStats,
+    },
+};
 use crate::{
     inetstack::protocols::{
         ethernet2::ETHERNET2_HEADER_SIZE,
@@ -17,8 +27,13 @@ use crate::{
         libdpdk::{
             rte_mbuf,
             rte_mempool,
+            rte_pktmbuf_chain,
+            RTE_PKTMBUF_HEADROOM,
         },
         memory::{
+            gather_sgarray,
+            sgarray_len,
+            sgarray_segments,
             Buffer,
             DPDKBuffer,
             DataBuffer,
@@ -26,6 +41,7 @@ use crate::{
         types::{
             demi_sgarray_t,
             demi_sgaseg_t,
+            DEMI_SGARRAY_MAXLEN,
         },
     },
 };
@@ -60,6 +76,10 @@ pub struct Inner {
 
     // Large body pool for buffers given to the application for zero-copy.
     body_pool: Rc<MemoryPool>,
+
+    // Pools of all size classes, sorted by capacity, including the body pool. Application buffers are served by the
+    // smallest class that fits them, and chained across mbufs of the largest class if none does.
+    size_classes: Vec<Rc<MemoryPool>>,
 }
 
 /// Memory Manager
@@ -74,22 +94,35 @@ pub struct MemoryManager {
 
 /// Associated Functions for Memory Managers
 impl MemoryManager {
-    /// Instantiates a memory manager.
-    pub fn new(max_body_size: usize) -> Result<Self, Error> {
-        let memory_config: MemoryConfig = MemoryConfig::new(None, None, Some(max_body_size), None, None);
+    /// Instantiates a memory manager for the runtime that owns a given queue.
+    pub fn new(
+        max_body_size: usize,
+        queue_id: u16,
+        cache_size: Option<usize>,
+        size_classes: Option<Vec<SizeClass>>,
+    ) -> Result<Self, Error> {
+        let memory_config: MemoryConfig =
+            MemoryConfig::new(None, None, Some(max_body_size), None, cache_size, size_classes);
 
         Ok(Self {
-            inner: Rc::new(Inner::new(memory_config)?),
+            inner: Rc::new(Inner::new(memory_config, queue_id)?),
         })
     }
 
     /// Converts a runtime buffer into a scatter-gather array.
+    ///
+    /// Received packets are DPDK-managed buffers, and these are handed over without copying: the segment points to the
+    /// payload inside the mbuf, the mbuf is kept alive by the scatter-gather array, and it goes back to its memory
+    /// pool when the scatter-gather array is released.
     pub fn into_sgarray(&self, buf: Buffer) -> Result<demi_sgarray_t, Fail> {
         let (mbuf_ptr, sgaseg): (*mut rte_mbuf, demi_sgaseg_t) = match buf {
             // Heap-managed buffer.
             Buffer::Heap(dbuf) => {
+                // A heap-managed buffer may be shared or may start past the beginning of its allocation, but we
+                // release the scatter-gather array from its segment. So we copy the data into an allocation of our own.
                 let len: usize = dbuf.len();
-                let (dbuf_ptr, _): (*const u8, *const u8) = DataBuffer::into_raw_parts(Clone::clone(&dbuf))?;
+                let dbuf: DataBuffer = DataBuffer::from_slice(&dbuf[..]);
+                let (dbuf_ptr, _): (*const u8, *const u8) = DataBuffer::into_raw_parts(dbuf)?;
                 (
                     ptr::null_mut(),
                     demi_sgaseg_t {
@@ -111,10 +144,12 @@ impl MemoryManager {
         };
 
         // TODO: Drop the sga_addr field in the scatter-gather array.
+        let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+        sga_segs[0] = sgaseg;
         Ok(demi_sgarray_t {
             sga_buf: mbuf_ptr as *mut c_void,
             sga_numsegs: 1,
-            sga_segs: [sgaseg],
+            sga_segs,
             sga_addr: unsafe { mem::zeroed() },
         })
     }
@@ -134,43 +169,85 @@ impl MemoryManager {
     }
 
     /// Allocates a scatter-gather array.
+    ///
+    /// Small buffers are heap-managed, as they are copied inline into header mbufs anyway. Larger buffers are served by
+    /// the smallest size class that fits them, or else by a chain of mbufs of the largest size class, with one
+    /// scatter-gather segment per mbuf. Buffers that would need more segments than a scatter-gather array holds are
+    /// heap-managed.
     pub fn alloc_sgarray(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
-        // Allocate underlying buffer.
-        let (mbuf_ptr, sgaseg): (*mut rte_mbuf, demi_sgaseg_t) =
-            if size > self.inner.config.get_inline_body_size() && size <= self.inner.config.get_max_body_size() {
-                // Allocate a DPDK-managed buffer.
-                let mbuf_ptr: *mut rte_mbuf = self.inner.body_pool.alloc_mbuf(Some(size))?;
-
-                // Adjust various fields in the mbuf and create a scatter-gather segment out of it.
-                unsafe {
-                    let buf_ptr: *mut u8 = (*mbuf_ptr).buf_addr as *mut u8;
-                    let data_ptr: *mut u8 = buf_ptr.offset((*mbuf_ptr).data_off as isize);
-                    (
-                        mbuf_ptr,
-                        demi_sgaseg_t {
-                            sgaseg_buf: data_ptr as *mut c_void,
-                            sgaseg_len: size as u32,
-                        },
-                    )
-                }
-            } else {
-                // Allocate a heap-managed buffer.
-                let dbuf: DataBuffer = DataBuffer::new(size)?;
-                let (dbuf_ptr, _): (*const u8, *const u8) = DataBuffer::into_raw_parts(dbuf)?;
-                (
-                    ptr::null_mut(),
-                    demi_sgaseg_t {
-                        sgaseg_buf: dbuf_ptr as *mut c_void,
-                        sgaseg_len: size as u32,
-                    },
-                )
-            };
+        if size > self.inner.config.get_inline_body_size() {
+            if let Some(pool) = self.inner.size_class_for(size) {
+                return self.alloc_sgarray_mbufs(pool, &[size]);
+            }
+
+            let pool: &Rc<MemoryPool> = self.inner.size_classes.last().expect("there should be a size class");
+            let capacity: usize = pool.get_mbuf_capacity();
+            let num_segs: usize = (size + capacity - 1) / capacity;
+            if num_segs <= DEMI_SGARRAY_MAXLEN {
+                let mut sizes: [usize; DEMI_SGARRAY_MAXLEN] = [capacity; DEMI_SGARRAY_MAXLEN];
+                sizes[num_segs - 1] = size - (num_segs - 1) * capacity;
+                return self.alloc_sgarray_mbufs(pool, &sizes[..num_segs]);
+            }
+        }
+
+        // Allocate a heap-managed buffer.
+        let dbuf: DataBuffer = DataBuffer::new(size)?;
+        let (dbuf_ptr, _): (*const u8, *const u8) = DataBuffer::into_raw_parts(dbuf)?;
 
         // TODO: Drop the sga_addr field in the scatter-gather array.
+        let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+        sga_segs[0] = demi_sgaseg_t {
+            sgaseg_buf: dbuf_ptr as *mut c_void,
+            sgaseg_len: size as u32,
+        };
         Ok(demi_sgarray_t {
-            sga_buf: mbuf_ptr as *mut c_void,
+            sga_buf: ptr::null_mut(),
             sga_numsegs: 1,
-            sga_segs: [sgaseg],
+            sga_segs,
+            sga_addr: unsafe { mem::zeroed() },
+        })
+    }
+
+    /// Allocates a scatter-gather array that is backed by a chain of DPDK-managed buffers, one for each size in
+    /// `sizes`. The scatter-gather array owns the head mbuf, and releasing it releases the whole chain.
+    fn alloc_sgarray_mbufs(&self, pool: &MemoryPool, sizes: &[usize]) -> Result<demi_sgarray_t, Fail> {
+        debug_assert!(!sizes.is_empty() && sizes.len() <= DEMI_SGARRAY_MAXLEN);
+
+        let mut head: *mut rte_mbuf = ptr::null_mut();
+        let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+        for (i, size) in sizes.iter().enumerate() {
+            let mbuf_ptr: *mut rte_mbuf = match pool.alloc_mbuf(Some(*size)) {
+                Ok(mbuf_ptr) => mbuf_ptr,
+                Err(e) => {
+                    // Rollback the allocation of previous segments.
+                    if !head.is_null() {
+                        MemoryPool::free_mbuf(head);
+                    }
+                    return Err(e);
+                },
+            };
+
+            // Create a scatter-gather segment out of the mbuf and chain it.
+            unsafe {
+                let buf_ptr: *mut u8 = (*mbuf_ptr).buf_addr as *mut u8;
+                let data_ptr: *mut u8 = buf_ptr.offset((*mbuf_ptr).data_off as isize);
+                sga_segs[i] = demi_sgaseg_t {
+                    sgaseg_buf: data_ptr as *mut c_void,
+                    sgaseg_len: *size as u32,
+                };
+                if head.is_null() {
+                    head = mbuf_ptr;
+                } else {
+                    assert_eq!(rte_pktmbuf_chain(head, mbuf_ptr), 0);
+                }
+            }
+        }
+
+        // TODO: Drop the sga_addr field in the scatter-gather array.
+        Ok(demi_sgarray_t {
+            sga_buf: head as *mut c_void,
+            sga_numsegs: sizes.len() as u32,
+            sga_segs,
             sga_addr: unsafe { mem::zeroed() },
         })
     }
@@ -178,12 +255,11 @@ impl MemoryManager {
     /// Releases a scatter-gather array.
     pub fn free_sgarray(&self, sga: demi_sgarray_t) -> Result<(), Fail> {
         // Check arguments.
-        // TODO: Drop this check once we support scatter-gather arrays with multiple segments.
-        if sga.sga_numsegs != 1 {
-            return Err(Fail::new(libc::EINVAL, "scatter-gather array with invalid size"));
-        }
+        sgarray_segments(&sga)?;
 
-        // Release underlying buffer.
+        // Release underlying buffer. DPDK-managed scatter-gather arrays own the head of a chain of mbufs, which backs
+        // all of their segments, and releasing the head releases the whole chain. Heap-managed ones have a single
+        // segment.
         // NOTE: In contrast to the other LibOses we store in the sga.sga_buf a pointer to an MBuf, and use this to
         // differentiate a DPDKBuffer for a DataBuffer. This only works because in the receive path, all buffers are
         // allocated from the DPDK pool, thus we don't need to keep track of data pointer. We should revisit this when
@@ -207,12 +283,20 @@ impl MemoryManager {
     /// Clones a scatter-gather array.
     pub fn clone_sgarray(&self, sga: &demi_sgarray_t) -> Result<Buffer, Fail> {
         // Check arguments.
-        // TODO: Drop this check once we support scatter-gather arrays with multiple segments.
-        if sga.sga_numsegs != 1 {
-            return Err(Fail::new(libc::EINVAL, "scatter-gather array with invalid size"));
+        let segs: &[demi_sgaseg_t] = sgarray_segments(sga)?;
+
+        // Multiple segments should go out in the same packet. Chains of mbufs that back them are cloned as a whole, and
+        // any other segments are gathered into a single buffer.
+        if segs.len() > 1 {
+            if !sga.sga_buf.is_null() {
+                if let Some(buf) = self.clone_sgarray_mbufs(sga.sga_buf as *mut rte_mbuf, segs)? {
+                    return Ok(buf);
+                }
+            }
+            return self.gather_sgarray(segs);
         }
 
-        let sgaseg: demi_sgaseg_t = sga.sga_segs[0];
+        let sgaseg: demi_sgaseg_t = segs[0];
         let (ptr, len): (*mut c_void, usize) = (sgaseg.sgaseg_buf, sgaseg.sgaseg_len as usize);
 
         // Clone underlying buffer.
@@ -238,6 +322,76 @@ impl MemoryManager {
         Ok(buf)
     }
 
+    /// Clones a chain of DPDK-managed buffers that backs a scatter-gather array, with one mbuf for each segment, without
+    /// copying any data. The clone spans exactly the segments, so that applications may shrink them before pushing.
+    /// Returns `None` if the segments do not lie in the mbufs of the chain.
+    fn clone_sgarray_mbufs(&self, head: *mut rte_mbuf, segs: &[demi_sgaseg_t]) -> Result<Option<Buffer>, Fail> {
+        unsafe {
+            if (*head).nb_segs as usize != segs.len() {
+                return Ok(None);
+            }
+
+            // Find where each segment starts in its mbuf.
+            let mut offsets: [usize; DEMI_SGARRAY_MAXLEN] = [0; DEMI_SGARRAY_MAXLEN];
+            let mut mbuf_ptr: *mut rte_mbuf = head;
+            for (i, sgaseg) in segs.iter().enumerate() {
+                let data_ptr: *const u8 = ((*mbuf_ptr).buf_addr as *const u8).offset((*mbuf_ptr).data_off as isize);
+                let offset: usize = (sgaseg.sgaseg_buf as usize).wrapping_sub(data_ptr as usize);
+                match offset.checked_add(sgaseg.sgaseg_len as usize) {
+                    Some(end) if end <= (*mbuf_ptr).data_len as usize => offsets[i] = offset,
+                    _ => return Ok(None),
+                }
+                mbuf_ptr = (*mbuf_ptr).next;
+            }
+
+            // Clone the chain, and narrow each mbuf of the clone down to its segment.
+            let clone: *mut rte_mbuf = MemoryPool::clone_mbuf(head)?;
+            let mut mbuf_ptr: *mut rte_mbuf = clone;
+            let mut pkt_len: u32 = 0;
+            for (i, sgaseg) in segs.iter().enumerate() {
+                (*mbuf_ptr).data_off += offsets[i] as u16;
+                (*mbuf_ptr).data_len = sgaseg.sgaseg_len as u16;
+                pkt_len += sgaseg.sgaseg_len;
+                mbuf_ptr = (*mbuf_ptr).next;
+            }
+            (*clone).pkt_len = pkt_len;
+
+            Ok(Some(Buffer::DPDK(DPDKBuffer::new(clone))))
+        }
+    }
+
+    /// Gathers the segments of a scatter-gather array into a single buffer. If the data fits in a body mbuf, it is
+    /// copied straight into DPDK-managed memory, so that it can later be chained to a header mbuf without further
+    /// copies.
+    fn gather_sgarray(&self, segs: &[demi_sgaseg_t]) -> Result<Buffer, Fail> {
+        let len: usize = sgarray_len(segs);
+        if len > self.inner.config.get_inline_body_size() && len <= self.inner.body_pool.get_mbuf_capacity() {
+            // Gather into a DPDK-managed buffer.
+            let mut mbuf: DPDKBuffer = self.alloc_body_mbuf()?;
+            if mbuf.len() < len {
+                return Err(Fail::new(
+                    libc::ENOMEM,
+                    "body mbuf is too small to gather scatter-gather array",
+                ));
+            }
+            gather_sgarray(segs, unsafe { &mut mbuf.slice_mut()[..len] });
+            mbuf.trim(mbuf.len() - len);
+            Ok(Buffer::DPDK(mbuf))
+        } else {
+            // Gather into a heap-managed buffer.
+            let mut dbuf: DataBuffer = DataBuffer::new(len)?;
+            gather_sgarray(segs, &mut dbuf);
+            Ok(Buffer::Heap(dbuf))
+        }
+    }
+
+    /// Returns occupancy statistics of all memory pools in the target memory manager.
+    pub fn stats(&self) -> Vec<MemoryPoolStats> {
+        let mut stats: Vec<MemoryPoolStats> = vec![self.inner.header_pool.stats()];
+        stats.extend(self.inner.size_classes.iter().map(|pool| pool.stats()));
+        stats
+    }
+
     /// Returns a raw pointer to the underlying body pool.
     /// TODO: Review the need of this function after we are done with the refactor of the DPDK runtime.
     pub fn body_pool(&self) -> *mut rte_mempool {
@@ -247,31 +401,61 @@ impl MemoryManager {
 
 /// Associated Functions for Memory Managers
 impl Inner {
-    fn new(config: MemoryConfig) -> Result<Self, Error> {
+    fn new(config: MemoryConfig, queue_id: u16) -> Result<Self, Error> {
         // TODO: The following computation for header size is bad. It should be fixed to maximum possible size.
         let header_size: usize = ETHERNET2_HEADER_SIZE + IPV4_HEADER_DEFAULT_SIZE + MAX_TCP_HEADER_SIZE;
         let header_mbuf_size: usize = header_size + config.get_inline_body_size();
 
         // Create memory pool for holding packet headers.
         let header_pool: MemoryPool = MemoryPool::new(
-            CString::new("header_pool")?,
+            CString::new(format!("header_pool_{}", queue_id))?,
             header_mbuf_size,
             config.get_header_pool_size(),
-            config.get_cache_size(),
+            Self::cache_size(&config, config.get_header_pool_size()),
         )?;
 
-        // Create memory pool for holding packet bodies.
-        let body_pool: MemoryPool = MemoryPool::new(
-            CString::new("body_pool")?,
-            config.get_max_body_size(),
-            config.get_body_pool_size(),
-            config.get_cache_size(),
-        )?;
+        // Create memory pools for holding packet bodies, one for each size class.
+        let mut body_pool: Option<Rc<MemoryPool>> = None;
+        let mut size_classes: Vec<Rc<MemoryPool>> = Vec::new();
+        for class in config.get_size_classes() {
+            if class.data_room_size > MAX_DATA_ROOM_SIZE || class.data_room_size <= RTE_PKTMBUF_HEADROOM as usize {
+                anyhow::bail!("invalid size class (data_room_size={})", class.data_room_size);
+            }
+
+            // The body pool keeps its name, other pools are named after their data room size.
+            let name: String = if class.data_room_size == config.get_max_body_size() {
+                format!("body_pool_{}", queue_id)
+            } else {
+                format!("body_pool_{}_{}", class.data_room_size, queue_id)
+            };
+            let pool: Rc<MemoryPool> = Rc::new(MemoryPool::new(
+                CString::new(name)?,
+                class.data_room_size,
+                class.pool_size,
+                Self::cache_size(&config, class.pool_size),
+            )?);
+            if class.data_room_size == config.get_max_body_size() {
+                body_pool = Some(pool.clone());
+            }
+            size_classes.push(pool);
+        }
 
         Ok(Self {
             config,
             header_pool: Rc::new(header_pool),
-            body_pool: Rc::new(body_pool),
+            body_pool: body_pool.expect("the body pool should be a size class"),
+            size_classes,
         })
     }
+
+    /// Computes the per-thread cache size of a pool, which DPDK bounds both by RTE_MEMPOOL_CACHE_MAX_SIZE and by the
+    /// number of buffers in the pool.
+    fn cache_size(config: &MemoryConfig, pool_size: usize) -> usize {
+        config.get_cache_size().min(MAX_CACHE_SIZE).min(pool_size * 2 / 3)
+    }
+
+    /// Returns the pool of the smallest size class whose mbufs fit `size` bytes, if any.
+    fn size_class_for(&self, size: usize) -> Option<&Rc<MemoryPool>> {
+        self.size_classes.iter().find(|pool| pool.get_mbuf_capacity() >= size)
+    }
 }
@@ -10,12 +10,16 @@ use crate::runtime::{
     libdpdk::{
         rte_mbuf,
         rte_mempool,
+        rte_mempool_avail_count,
+        rte_mempool_in_use_count,
         rte_pktmbuf_alloc,
         rte_pktmbuf_clone,
         rte_pktmbuf_free,
         rte_pktmbuf_pool_create,
         rte_socket_id,
+        RTE_PKTMBUF_HEADROOM,
     },
+    stats,
 };
 use ::std::ffi::CString;
 
@@ -28,6 +32,27 @@ use ::std::ffi::CString;
 pub struct MemoryPool {
     /// Underlying memory pool.
     pool: *mut rte_mempool,
+    /// Name of the underlying memory pool.
+    name: String,
+    /// Data room size of mbufs in the underlying memory pool.
+    data_room_size: usize,
+    /// Number of mbufs in the underlying memory pool.
+    pool_size: usize,
+}
+
+/// Occupancy Statistics of a Memory Pool
+#[derive(Clone, Debug)]
+pub struct MemoryPoolStats {
+    /// Name of the memory pool.
+    pub name: String,
+    /// Data room size of mbufs in the memory pool.
+    pub data_room_size: usize,
+    /// Number of mbufs in the memory pool.
+    pub capacity: usize,
+    /// Number of mbufs that are allocated, or sit in per-thread caches.
+    pub in_use: usize,
+    /// Number of mbufs that can be allocated.
+    pub available: usize,
 }
 
 //==============================================================================
@@ -54,7 +79,12 @@ impl MemoryPool {
             return Err(Fail::new(libc::EAGAIN, "failed to create memory pool"));
         }
 
-        Ok(Self { pool })
+        Ok(Self {
+            pool,
+            name: name.to_string_lossy().into_owned(),
+            data_room_size,
+            pool_size,
+        })
     }
 
     /// Gets a raw pointer to the underlying memory pool.
@@ -62,6 +92,24 @@ impl MemoryPool {
         self.pool
     }
 
+    /// Returns the number of bytes that an mbuf of the target memory pool can hold.
+    pub fn get_mbuf_capacity(&self) -> usize {
+        self.data_room_size - RTE_PKTMBUF_HEADROOM as usize
+    }
+
+    /// Returns occupancy statistics of the target memory pool.
+    pub fn stats(&self) -> MemoryPoolStats {
+        let (available, in_use): (u32, u32) =
+            unsafe { (rte_mempool_avail_count(self.pool), rte_mempool_in_use_count(self.pool)) };
+        MemoryPoolStats {
+            name: self.name.clone(),
+            data_room_size: self.data_room_size,
+            capacity: self.pool_size,
+            in_use: in_use as usize,
+            available: available as usize,
+        }
+    }
+
     /// Allocates a mbuf in the target memory pool.
     pub fn alloc_mbuf(&self, size: Option<usize>) -> Result<*mut rte_mbuf, Fail> {
         // TODO: Drop the following warning once DPDK memory management is more stable.
@@ -70,6 +118,7 @@ impl MemoryPool {
         // Allocate mbuf.
         let mut mbuf_ptr: *mut rte_mbuf = unsafe { rte_pktmbuf_alloc(self.pool) };
         if mbuf_ptr.is_null() {
+            stats::record_mempool_exhausted();
             return Err(Fail::new(libc::ENOMEM, "cannot allocate more mbufs"));
         }
 
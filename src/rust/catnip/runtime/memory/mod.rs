@@ -4,13 +4,16 @@
 mod config;
 pub mod consts;
 mod manager;
-mod mempool;
+pub mod mempool;
 
 //==============================================================================
 // Exports
 //==============================================================================
 
-pub use self::manager::MemoryManager;
+pub use self::{
+    config::SizeClass,
+    manager::MemoryManager,
+};
 
 //==============================================================================
 // Imports
@@ -3,14 +3,30 @@
 
 pub mod memory;
 mod network;
+mod wait;
 
 //==============================================================================
 // Imports
 //==============================================================================
 
-use self::memory::{
-    consts::DEFAULT_MAX_BODY_SIZE,
-    MemoryManager,
+use self::{
+    memory::{
+        consts::{
+            DEFAULT_BODY_POOL_SIZE,
+            DEFAULT_CACHE_SIZE,
+            DEFAULT_MAX_BODY_SIZE,
+        },
+        mempool::MemoryPool,
+        MemoryManager,
+        SizeClass,
+    },
+    network::{
+        FlowSteering,
+        ForwardedMbuf,
+        TxRing,
+        DEFAULT_TRANSMIT_DEADLINE,
+    },
+    wait::AdaptiveWait,
 };
 use crate::runtime::{
     libdpdk::{
@@ -22,6 +38,7 @@ use crate::runtime::{
         rte_eth_dev_get_mtu,
         rte_eth_dev_info_get,
         rte_eth_dev_is_valid_port,
+        rte_eth_dev_rss_reta_update,
         rte_eth_dev_set_mtu,
         rte_eth_dev_start,
         rte_eth_find_next_owned_by,
@@ -29,6 +46,7 @@ use crate::runtime::{
         rte_eth_link_get_nowait,
         rte_eth_macaddr_get,
         rte_eth_promiscuous_enable,
+        rte_eth_rss_reta_entry64,
         rte_eth_rx_mq_mode_ETH_MQ_RX_RSS as ETH_MQ_RX_RSS,
         rte_eth_rx_queue_setup,
         rte_eth_rxconf,
@@ -39,23 +57,35 @@ use crate::runtime::{
         DEV_RX_OFFLOAD_JUMBO_FRAME,
         DEV_RX_OFFLOAD_TCP_CKSUM,
         DEV_RX_OFFLOAD_UDP_CKSUM,
+        DEV_TX_OFFLOAD_IPV4_CKSUM,
         DEV_TX_OFFLOAD_MULTI_SEGS,
         DEV_TX_OFFLOAD_TCP_CKSUM,
+        DEV_TX_OFFLOAD_TCP_TSO,
         DEV_TX_OFFLOAD_UDP_CKSUM,
         ETH_LINK_FULL_DUPLEX,
         ETH_LINK_UP,
         ETH_RSS_IP,
+        ETH_RSS_NONFRAG_IPV4_TCP,
+        ETH_RSS_TCP,
+        ETH_RSS_UDP,
         RTE_ETHER_MAX_JUMBO_FRAME_LEN,
         RTE_ETHER_MAX_LEN,
         RTE_ETH_DEV_NO_OWNER,
         RTE_PKTMBUF_HEADROOM,
+        RTE_RETA_GROUP_SIZE,
     },
     network::{
+        burst::RxBurst,
         config::{
             ArpConfig,
+            CongestionControlAlgorithm,
             TcpConfig,
             UdpConfig,
         },
+        rss::{
+            RSS_KEY,
+            RSS_KEY_LEN,
+        },
         types::MacAddress,
     },
     Runtime,
@@ -65,11 +95,21 @@ use ::anyhow::{
     format_err,
     Error,
 };
+use ::crossbeam_channel::{
+    Receiver,
+    Sender,
+};
 use ::std::{
+    cell::RefCell,
     collections::HashMap,
     ffi::CString,
     mem::MaybeUninit,
     net::Ipv4Addr,
+    rc::Rc,
+    sync::{
+        Mutex,
+        MutexGuard,
+    },
     time::Duration,
 };
 
@@ -88,15 +128,76 @@ macro_rules! expect_zero {
     }};
 }
 
+//==============================================================================
+// Static Variables
+//==============================================================================
+
+/// DPDK port that is shared by all runtimes in this process. The port is initialized by the first runtime that is
+/// instantiated, and every runtime then claims one RX/TX queue pair of it.
+static DPDK_PORT: Mutex<Option<DPDKPort>> = Mutex::new(None);
+
 //==============================================================================
 // Structures
 //==============================================================================
 
+/// DPDK Port
+struct DPDKPort {
+    port_id: u16,
+    link_addr: MacAddress,
+    /// Number of RX/TX queue pairs that the port was configured with.
+    num_queues: u16,
+    /// Next queue pair to be claimed by a runtime.
+    next_queue_id: u16,
+    /// Whether the port segments large TCP packets in hardware.
+    tcp_segmentation_offload: bool,
+    /// Whether the port hashes TCP flows with [RSS_KEY], so that its hashes can be reused.
+    rss_hash: bool,
+    /// Size of the RSS redirection table, if it spreads flows round-robin across queues. Otherwise, this is zero.
+    reta_size: u16,
+    /// Whether the port raises RX interrupts.
+    rx_interrupts: bool,
+    /// Senders of ARP frames to the runtimes of all queues but the first one.
+    arp_queues: Vec<Sender<ForwardedMbuf>>,
+}
+
+/// Queue Pair of a DPDK Port
+///
+/// What a runtime gets when it claims a queue pair of the shared port.
+struct DPDKQueue {
+    port_id: u16,
+    queue_id: u16,
+    /// Number of RX/TX queue pairs of the port.
+    num_queues: u16,
+    link_addr: MacAddress,
+    tcp_segmentation_offload: bool,
+    rss_hash: bool,
+    reta_size: u16,
+    rx_interrupts: bool,
+    /// Receiver of the ARP frames that the runtime of the first queue forwards, for all queues but that one.
+    arp_rx: Option<Receiver<ForwardedMbuf>>,
+}
+
 /// DPDK Runtime
 #[derive(Clone)]
 pub struct DPDKRuntime {
     mm: MemoryManager,
     port_id: u16,
+    /// RX/TX queue pair that is owned by this runtime.
+    queue_id: u16,
+    /// Packets staged for transmission.
+    tx_ring: Rc<RefCell<TxRing>>,
+    /// Number of packets to ask the NIC for on each receive.
+    rx_burst: Rc<RxBurst>,
+    /// Whether RSS hashes of received packets can be handed to the network stack.
+    rss_hash: bool,
+    /// Number of RX/TX queue pairs of the port.
+    num_queues: u16,
+    /// Which queue flows are steered to, if there are several queues and the port tells.
+    flow_steering: Option<Rc<FlowSteering>>,
+    /// ARP frames that the runtime of the first queue forwards to this one.
+    arp_rx: Option<Receiver<ForwardedMbuf>>,
+    /// What waits do while they find no work.
+    wait: Rc<AdaptiveWait>,
     pub link_addr: MacAddress,
     pub ipv4_addr: Ipv4Addr,
     pub arp_options: ArpConfig,
@@ -110,6 +211,10 @@ pub struct DPDKRuntime {
 
 /// Associate Functions for DPDK Runtime
 impl DPDKRuntime {
+    /// Instantiates a DPDK runtime. When the port is configured with multiple queues, each thread should instantiate
+    /// its own runtime, which then owns one RX/TX queue pair. Packets are steered to queues by RSS on the IPv4 and
+    /// TCP/UDP headers. Non-IP traffic (e.g. ARP) only reaches the runtime that owns the first queue, which forwards
+    /// ARP frames to the others.
     pub fn new(
         ipv4_addr: Ipv4Addr,
         eal_init_args: &[CString],
@@ -120,16 +225,56 @@ impl DPDKRuntime {
         mss: usize,
         tcp_checksum_offload: bool,
         udp_checksum_offload: bool,
+        tx_flush_deadline: Option<Duration>,
+        rx_burst_size: Option<usize>,
+        rx_burst_adaptive: Option<bool>,
+        num_queues: Option<u16>,
+        tcp_selective_ack: Option<bool>,
+        tcp_congestion_control: Option<CongestionControlAlgorithm>,
+        tcp_segmentation_offload: bool,
+        tcp_receive_coalescing: Option<bool>,
+        mempool_cache_size: Option<usize>,
+        mempool_size_classes: Option<Vec<SizeClass>>,
+        wait_spin_budgets: Option<Vec<Duration>>,
+        wait_pause_duration: Option<Duration>,
+        rx_interrupts: bool,
     ) -> DPDKRuntime {
-        let (mm, port_id, link_addr) = Self::initialize_dpdk(
+        let DPDKQueue {
+            port_id,
+            queue_id,
+            num_queues,
+            link_addr,
+            tcp_segmentation_offload,
+            rss_hash,
+            reta_size,
+            rx_interrupts,
+            arp_rx,
+        }: DPDKQueue = Self::initialize_dpdk(
             eal_init_args,
             use_jumbo_frames,
             mtu,
             tcp_checksum_offload,
             udp_checksum_offload,
+            tcp_segmentation_offload,
+            rx_interrupts,
+            num_queues.unwrap_or(1),
         )
         .unwrap();
 
+        // Active opens pick local ports that RSS steers back to this queue.
+        let flow_steering: Option<Rc<FlowSteering>> = if num_queues > 1 && rss_hash && reta_size > 0 {
+            Some(Rc::new(FlowSteering::new(reta_size, num_queues)))
+        } else {
+            if num_queues > 1 {
+                warn!("cannot tell which queue flows are steered to, so active opens may not come back");
+            }
+            None
+        };
+
+        let max_body_size: usize = Self::max_body_size(use_jumbo_frames);
+        let mm: MemoryManager =
+            MemoryManager::new(max_body_size, queue_id, mempool_cache_size, mempool_size_classes).unwrap();
+
         let arp_options = ArpConfig::new(
             Some(Duration::from_secs(15)),
             Some(Duration::from_secs(20)),
@@ -147,13 +292,34 @@ impl DPDKRuntime {
             None,
             Some(tcp_checksum_offload),
             Some(tcp_checksum_offload),
+            tcp_selective_ack,
+            tcp_congestion_control,
+            Some(tcp_segmentation_offload),
+            tcp_receive_coalescing,
         );
 
         let udp_options = UdpConfig::new(Some(udp_checksum_offload), Some(udp_checksum_offload));
 
+        let tx_ring: TxRing = TxRing::new(tx_flush_deadline.unwrap_or(DEFAULT_TRANSMIT_DEADLINE));
+        let rx_burst: RxBurst = RxBurst::new(rx_burst_size, rx_burst_adaptive);
+
+        // Queues past the end of the list of spin budgets use its last entry.
+        let wait_spin_budget: Option<Duration> =
+            wait_spin_budgets.and_then(|budgets| budgets.get(queue_id as usize).or(budgets.last()).copied());
+        let wait: AdaptiveWait =
+            AdaptiveWait::new(port_id, queue_id, wait_spin_budget, wait_pause_duration, rx_interrupts);
+
         Self {
             mm,
             port_id,
+            queue_id,
+            tx_ring: Rc::new(RefCell::new(tx_ring)),
+            rx_burst: Rc::new(rx_burst),
+            rss_hash,
+            num_queues,
+            flow_steering,
+            arp_rx,
+            wait: Rc::new(wait),
             link_addr,
             ipv4_addr,
             arp_options,
@@ -162,17 +328,98 @@ impl DPDKRuntime {
         }
     }
 
-    /// Initializes DPDK.
+    /// Computes the maximum body size of packet buffers.
+    fn max_body_size(use_jumbo_frames: bool) -> usize {
+        if use_jumbo_frames {
+            (RTE_ETHER_MAX_JUMBO_FRAME_LEN + RTE_PKTMBUF_HEADROOM) as usize
+        } else {
+            DEFAULT_MAX_BODY_SIZE
+        }
+    }
+
+    /// Initializes DPDK, if this was not done yet, and claims a queue pair of the shared port for the caller.
     fn initialize_dpdk(
         eal_init_args: &[CString],
         use_jumbo_frames: bool,
         mtu: u16,
         tcp_checksum_offload: bool,
         udp_checksum_offload: bool,
-    ) -> Result<(MemoryManager, u16, MacAddress), Error> {
+        tcp_segmentation_offload: bool,
+        rx_interrupts: bool,
+        num_queues: u16,
+    ) -> Result<DPDKQueue, Error> {
+        let mut dpdk_port: MutexGuard<Option<DPDKPort>> = match DPDK_PORT.lock() {
+            Ok(dpdk_port) => dpdk_port,
+            Err(_) => bail!("DPDK port is poisoned"),
+        };
+
+        if dpdk_port.is_none() {
+            *dpdk_port = Some(Self::initialize_dpdk_once(
+                eal_init_args,
+                use_jumbo_frames,
+                mtu,
+                tcp_checksum_offload,
+                udp_checksum_offload,
+                tcp_segmentation_offload,
+                rx_interrupts,
+                num_queues,
+            )?);
+        }
+
+        let port: &mut DPDKPort = dpdk_port.as_mut().unwrap();
+        if port.next_queue_id >= port.num_queues {
+            bail!(
+                "all {} queues of port {} are already in use",
+                port.num_queues,
+                port.port_id
+            );
+        }
+        let queue_id: u16 = port.next_queue_id;
+        port.next_queue_id += 1;
+
+        // The runtime of the first queue receives ARP frames from the NIC, and forwards them to other runtimes.
+        let arp_rx: Option<Receiver<ForwardedMbuf>> = if queue_id > 0 {
+            let (arp_tx, arp_rx): (Sender<ForwardedMbuf>, Receiver<ForwardedMbuf>) = crossbeam_channel::unbounded();
+            port.arp_queues.push(arp_tx);
+            Some(arp_rx)
+        } else {
+            None
+        };
+
+        Ok(DPDKQueue {
+            port_id: port.port_id,
+            queue_id,
+            num_queues: port.num_queues,
+            link_addr: port.link_addr,
+            tcp_segmentation_offload: port.tcp_segmentation_offload,
+            rss_hash: port.rss_hash,
+            reta_size: port.reta_size,
+            rx_interrupts: port.rx_interrupts,
+            arp_rx,
+        })
+    }
+
+    /// Initializes the DPDK environment and the port that is shared by all runtimes.
+    fn initialize_dpdk_once(
+        eal_init_args: &[CString],
+        use_jumbo_frames: bool,
+        mtu: u16,
+        tcp_checksum_offload: bool,
+        udp_checksum_offload: bool,
+        tcp_segmentation_offload: bool,
+        rx_interrupts: bool,
+        num_queues: u16,
+    ) -> Result<DPDKPort, Error> {
+        if num_queues == 0 {
+            bail!("number of queues should be at least one");
+        }
+
         std::env::set_var("MLX5_SHUT_UP_BF", "1");
-        std::env::set_var("MLX5_SINGLE_THREADED", "1");
-        std::env::set_var("MLX4_SINGLE_THREADED", "1");
+        // Drivers may only skip locking if a single thread uses the port.
+        if num_queues == 1 {
+            std::env::set_var("MLX5_SINGLE_THREADED", "1");
+            std::env::set_var("MLX4_SINGLE_THREADED", "1");
+        }
         let eal_init_refs = eal_init_args.iter().map(|s| s.as_ptr() as *mut u8).collect::<Vec<_>>();
         unsafe {
             rte_eal_init(eal_init_refs.len() as i32, eal_init_refs.as_ptr() as *mut _);
@@ -183,30 +430,31 @@ impl DPDKRuntime {
         }
         eprintln!("DPDK reports that {} ports (interfaces) are available.", nb_ports);
 
-        let max_body_size: usize = if use_jumbo_frames {
-            (RTE_ETHER_MAX_JUMBO_FRAME_LEN + RTE_PKTMBUF_HEADROOM) as usize
-        } else {
-            DEFAULT_MAX_BODY_SIZE
-        };
-
-        let memory_manager = MemoryManager::new(max_body_size)?;
+        // Create one memory pool per queue for holding received packets.
+        let max_body_size: usize = Self::max_body_size(use_jumbo_frames);
+        let mut rx_pools: Vec<MemoryPool> = Vec::with_capacity(num_queues as usize);
+        for queue_id in 0..num_queues {
+            rx_pools.push(MemoryPool::new(
+                CString::new(format!("rx_pool_{}", queue_id))?,
+                max_body_size,
+                DEFAULT_BODY_POOL_SIZE,
+                DEFAULT_CACHE_SIZE,
+            )?);
+        }
 
         let owner: u64 = RTE_ETH_DEV_NO_OWNER as u64;
         let port_id: u16 = unsafe { rte_eth_find_next_owned_by(0, owner) as u16 };
-        Self::initialize_dpdk_port(
+        let (tcp_segmentation_offload, rss_hash, reta_size): (bool, bool, u16) = Self::initialize_dpdk_port(
             port_id,
-            &memory_manager,
+            &rx_pools,
             use_jumbo_frames,
             mtu,
             tcp_checksum_offload,
             udp_checksum_offload,
+            tcp_segmentation_offload,
+            rx_interrupts,
         )?;
 
-        // TODO: Where is this function?
-        // if unsafe { rte_lcore_count() } > 1 {
-        //     eprintln!("WARNING: Too many lcores enabled. Only 1 used.");
-        // }
-
         let local_link_addr: MacAddress = unsafe {
             let mut m: MaybeUninit<rte_ether_addr> = MaybeUninit::zeroed();
             // TODO: Why does bindgen say this function doesn't return an int?
@@ -217,20 +465,35 @@ impl DPDKRuntime {
             Err(format_err!("Invalid mac address"))?;
         }
 
-        Ok((memory_manager, port_id, local_link_addr))
+        Ok(DPDKPort {
+            port_id,
+            link_addr: local_link_addr,
+            num_queues,
+            next_queue_id: 0,
+            tcp_segmentation_offload,
+            rss_hash,
+            reta_size,
+            rx_interrupts,
+            arp_queues: Vec::new(),
+        })
     }
 
-    /// Initializes a DPDK port.
+    /// Initializes a DPDK port. Returns whether TCP segmentation offload is enabled on it, whether it hashes TCP
+    /// flows with [RSS_KEY], as the NIC may support neither, and the size of its RSS redirection table if it was filled
+    /// in round-robin.
     fn initialize_dpdk_port(
         port_id: u16,
-        memory_manager: &MemoryManager,
+        rx_pools: &[MemoryPool],
         use_jumbo_frames: bool,
         mtu: u16,
         tcp_checksum_offload: bool,
         udp_checksum_offload: bool,
-    ) -> Result<(), Error> {
-        let rx_rings = 1;
-        let tx_rings = 1;
+        tcp_segmentation_offload: bool,
+        rx_interrupts: bool,
+    ) -> Result<(bool, bool, u16), Error> {
+        // One RX/TX queue pair per memory pool.
+        let rx_rings: u16 = rx_pools.len() as u16;
+        let tx_rings: u16 = rx_pools.len() as u16;
         let rx_ring_size = 2048;
         let tx_ring_size = 2048;
         let nb_rxd = rx_ring_size;
@@ -276,7 +539,20 @@ impl DPDKRuntime {
             port_conf.rxmode.offloads |= DEV_RX_OFFLOAD_JUMBO_FRAME as u64;
         }
         port_conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
-        port_conf.rx_adv_conf.rss_conf.rss_hf = ETH_RSS_IP as u64 | dev_info.flow_type_rss_offloads;
+        // Steer TCP and UDP flows by their 4-tuples, so that all packets of a flow land on the same queue.
+        port_conf.rx_adv_conf.rss_conf.rss_hf =
+            (ETH_RSS_IP | ETH_RSS_TCP | ETH_RSS_UDP) as u64 & dev_info.flow_type_rss_offloads;
+        // Program a known hash key, so that the hashes of TCP packets match those of the TCP flow table.
+        let rss_hash: bool = if dev_info.hash_key_size as usize == RSS_KEY_LEN
+            && port_conf.rx_adv_conf.rss_conf.rss_hf & ETH_RSS_NONFRAG_IPV4_TCP as u64 != 0
+        {
+            port_conf.rx_adv_conf.rss_conf.rss_key = RSS_KEY.as_ptr() as *mut u8;
+            port_conf.rx_adv_conf.rss_conf.rss_key_len = RSS_KEY_LEN as u8;
+            true
+        } else {
+            warn!("RSS hashes of port {} cannot be reused by the TCP flow table", port_id);
+            false
+        };
 
         port_conf.txmode.mq_mode = ETH_MQ_TX_NONE;
         if tcp_checksum_offload {
@@ -286,6 +562,24 @@ impl DPDKRuntime {
             port_conf.txmode.offloads |= DEV_TX_OFFLOAD_UDP_CKSUM as u64;
         }
         port_conf.txmode.offloads |= DEV_TX_OFFLOAD_MULTI_SEGS as u64;
+        // Segmentation requires the NIC to fill in the IPv4 and TCP checksums of every segment.
+        let tso_offloads: u64 = (DEV_TX_OFFLOAD_TCP_TSO | DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM) as u64;
+        let tcp_segmentation_offload: bool = if tcp_segmentation_offload {
+            if dev_info.tx_offload_capa & tso_offloads == tso_offloads {
+                port_conf.txmode.offloads |= tso_offloads;
+                true
+            } else {
+                warn!("TCP segmentation offload is not supported by port {}", port_id);
+                false
+            }
+        } else {
+            false
+        };
+
+        // Let idle waits block until packets arrive.
+        if rx_interrupts {
+            port_conf.intr_conf.set_rxq(1);
+        }
 
         let mut rx_conf: rte_eth_rxconf = unsafe { MaybeUninit::zeroed().assume_init() };
         rx_conf.rx_thresh.pthresh = rx_pthresh;
@@ -318,7 +612,7 @@ impl DPDKRuntime {
                     nb_rxd,
                     socket_id,
                     &rx_conf as *const _,
-                    memory_manager.body_pool(),
+                    rx_pools[i as usize].into_raw(),
                 ))?;
             }
             for i in 0..tx_rings {
@@ -334,6 +628,13 @@ impl DPDKRuntime {
             rte_eth_promiscuous_enable(port_id);
         }
 
+        // Spread the redirection table across queues in a known way, so that runtimes can tell where flows go.
+        let reta_size: u16 = if rx_rings > 1 && rss_hash {
+            Self::initialize_dpdk_reta(port_id, dev_info.reta_size, rx_rings)
+        } else {
+            0
+        };
+
         if unsafe { rte_eth_dev_is_valid_port(port_id) } == 0 {
             bail!("Invalid port");
         }
@@ -366,7 +667,36 @@ impl DPDKRuntime {
             retry_count -= 1;
         }
 
-        Ok(())
+        Ok((tcp_segmentation_offload, rss_hash, reta_size))
+    }
+
+    /// Fills the RSS redirection table of a port, which has `reta_size` entries, round-robin with `num_queues` queues.
+    /// Returns the size of the table, or zero if the port does not let it be filled in.
+    fn initialize_dpdk_reta(port_id: u16, reta_size: u16, num_queues: u16) -> u16 {
+        let group_size: usize = RTE_RETA_GROUP_SIZE as usize;
+        if reta_size == 0 || reta_size as usize % group_size != 0 {
+            warn!(
+                "RSS redirection table of port {} has an unsupported size ({})",
+                port_id, reta_size
+            );
+            return 0;
+        }
+
+        let mut reta_conf: Vec<rte_eth_rss_reta_entry64> = Vec::with_capacity(reta_size as usize / group_size);
+        for group in 0..(reta_size as usize / group_size) {
+            let mut entry: rte_eth_rss_reta_entry64 = unsafe { MaybeUninit::zeroed().assume_init() };
+            entry.mask = u64::MAX;
+            for (i, queue_id) in entry.reta.iter_mut().enumerate() {
+                *queue_id = ((group * group_size + i) % num_queues as usize) as u16;
+            }
+            reta_conf.push(entry);
+        }
+        if unsafe { rte_eth_dev_rss_reta_update(port_id, reta_conf.as_mut_ptr(), reta_size) } != 0 {
+            warn!("cannot fill in RSS redirection table of port {}", port_id);
+            return 0;
+        }
+
+        reta_size
     }
 }
 
@@ -5,15 +5,29 @@
 // Imports
 //==============================================================================
 
-use super::DPDKRuntime;
+use super::{
+    DPDKPort,
+    DPDKRuntime,
+    DPDK_PORT,
+};
 use crate::{
-    inetstack::protocols::ethernet2::MIN_PAYLOAD_SIZE,
+    inetstack::protocols::ethernet2::{
+        EtherType2,
+        ETHERNET2_HEADER_SIZE,
+        MIN_PAYLOAD_SIZE,
+    },
     runtime::{
         libdpdk::{
             rte_eth_rx_burst,
             rte_eth_tx_burst,
             rte_mbuf,
             rte_pktmbuf_chain,
+            rte_pktmbuf_clone,
+            rte_pktmbuf_free,
+            PKT_RX_RSS_HASH,
+            PKT_TX_IPV4,
+            PKT_TX_IP_CKSUM,
+            PKT_TX_TCP_SEG,
         },
         memory::{
             Buffer,
@@ -21,17 +35,251 @@ use crate::{
         },
         network::{
             consts::RECEIVE_BATCH_SIZE,
+            rss::ToeplitzHasher,
             NetworkRuntime,
             PacketBuf,
+            SegmentationOffload,
         },
+        stats,
     },
 };
 use ::arrayvec::ArrayVec;
-use ::std::mem;
+use ::crossbeam_channel::Sender;
+use ::std::{
+    cell::RefMut,
+    mem,
+    net::SocketAddrV4,
+    sync::MutexGuard,
+    time::{
+        Duration,
+        Instant,
+    },
+};
 
 #[cfg(feature = "profiler")]
 use crate::timer;
 
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Number of packets that are staged for transmission before being handed to the NIC.
+const TRANSMIT_BATCH_SIZE: usize = 32;
+
+/// Number of times that we retry to hand staged packets to the NIC, before giving up until the next flush.
+const TRANSMIT_MAX_RETRIES: usize = 8;
+
+/// Default maximum time that a packet may be staged for transmission.
+pub const DEFAULT_TRANSMIT_DEADLINE: Duration = Duration::from_micros(10);
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Transmit Staging Ring
+///
+/// Packets are collected here and handed to the NIC in bursts, so that we ring the NIC doorbell once per burst
+/// instead of once per packet. The ring is flushed when it fills up, when the oldest packet in it has been waiting
+/// for longer than a deadline, and when the runtime is explicitly flushed at the end of each poll iteration.
+pub struct TxRing {
+    /// Staged packets, oldest first.
+    mbufs: ArrayVec<*mut rte_mbuf, TRANSMIT_BATCH_SIZE>,
+    /// Time at which the oldest staged packet was staged.
+    oldest: Option<Instant>,
+    /// Maximum time that a packet may be staged for.
+    deadline: Duration,
+}
+
+/// Forwarded Frame
+///
+/// A frame that the runtime of the first queue received and hands to the runtime of another queue. Each runtime gets an
+/// indirect clone of the frame, so that runtimes parse it independently.
+pub struct ForwardedMbuf(DPDKBuffer);
+
+/// Flow Steering
+///
+/// Tells which queue RSS steers a flow to. The NIC hashes the 4-tuple of each received packet with
+/// [crate::runtime::network::rss::RSS_KEY], and looks the hash up in a redirection table whose entries are spread
+/// round-robin across queues.
+pub struct FlowSteering {
+    /// Software implementation of the hash of the NIC.
+    hasher: ToeplitzHasher,
+    /// Number of entries in the redirection table.
+    reta_size: usize,
+    /// Number of queues that the redirection table spreads flows across.
+    num_queues: usize,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Flow Steering
+impl FlowSteering {
+    /// Creates a flow steering for a redirection table of `reta_size` entries that spreads flows across `num_queues`.
+    pub fn new(reta_size: u16, num_queues: u16) -> Self {
+        Self {
+            hasher: ToeplitzHasher::default(),
+            reta_size: reta_size as usize,
+            num_queues: num_queues as usize,
+        }
+    }
+
+    /// Returns the queue that packets which `remote` sends to `local` are steered to.
+    pub fn queue(&self, local: SocketAddrV4, remote: SocketAddrV4) -> u16 {
+        let hash: u32 = self.hasher.hash_ipv4_tuple(&remote, &local);
+        ((hash as usize % self.reta_size) % self.num_queues) as u16
+    }
+}
+
+/// Associate Functions for DPDK Runtime
+impl DPDKRuntime {
+    /// Hands a clone of an ARP frame to the runtimes of all other queues, since NICs only steer non-IP traffic to the
+    /// first queue. This keeps the ARP caches of all runtimes up to date.
+    fn forward_arp(&self, packet: *mut rte_mbuf) {
+        let dpdk_port: MutexGuard<Option<DPDKPort>> = match DPDK_PORT.lock() {
+            Ok(dpdk_port) => dpdk_port,
+            Err(_) => return,
+        };
+        let arp_queues: &Vec<Sender<ForwardedMbuf>> = match dpdk_port.as_ref() {
+            Some(port) => &port.arp_queues,
+            None => return,
+        };
+        for arp_tx in arp_queues {
+            let clone_ptr: *mut rte_mbuf = unsafe { rte_pktmbuf_clone(packet, (*packet).pool) };
+            if clone_ptr.is_null() {
+                warn!("dropping forwarded ARP frame: cannot clone mbuf");
+                continue;
+            }
+            // Frames that are sent to runtimes which are gone are released on the spot.
+            let _ = arp_tx.send(ForwardedMbuf(DPDKBuffer::new(clone_ptr)));
+        }
+    }
+}
+
+/// Associate Functions for Transmit Staging Rings
+impl TxRing {
+    /// Creates a transmit staging ring.
+    pub fn new(deadline: Duration) -> Self {
+        Self {
+            mbufs: ArrayVec::new(),
+            oldest: None,
+            deadline,
+        }
+    }
+
+    /// Stages a packet for transmission on a given queue of a given port.
+    pub fn push(&mut self, port_id: u16, queue_id: u16, mbuf_ptr: *mut rte_mbuf) {
+        // Make room for this packet.
+        if self.mbufs.is_full() {
+            self.flush(port_id, queue_id);
+
+            // The NIC is not keeping up, so drop the packet just like it would.
+            if self.mbufs.is_full() {
+                warn!("dropping packet: transmit ring is full");
+                unsafe { rte_pktmbuf_free(mbuf_ptr) };
+                return;
+            }
+        }
+
+        let now: Instant = Instant::now();
+        if self.mbufs.is_empty() {
+            self.oldest = Some(now);
+        }
+        self.mbufs.push(mbuf_ptr);
+
+        // Flush if the ring is full or if the oldest packet has waited for long enough.
+        let expired: bool = match self.oldest {
+            Some(oldest) => now.duration_since(oldest) >= self.deadline,
+            None => false,
+        };
+        if self.mbufs.is_full() || expired {
+            self.flush(port_id, queue_id);
+        }
+    }
+
+    /// Hands all staged packets to the NIC on a given queue of a given port. Packets that the NIC cannot take right away
+    /// are retried a few times, and are otherwise kept in the ring for the next flush.
+    pub fn flush(&mut self, port_id: u16, queue_id: u16) {
+        #[cfg(feature = "profiler")]
+        timer!("catnip_libos::flush");
+
+        // Packets that the NIC takes are no longer ours to look at, so size them up front.
+        let nbytes: usize = Self::count_bytes(&self.mbufs);
+
+        let mut nsent: usize = 0;
+        let mut nretries: usize = 0;
+        while nsent < self.mbufs.len() && nretries < TRANSMIT_MAX_RETRIES {
+            let nremaining: u16 = (self.mbufs.len() - nsent) as u16;
+            let n: u16 = unsafe { rte_eth_tx_burst(port_id, queue_id, self.mbufs.as_mut_ptr().add(nsent), nremaining) };
+            if n == 0 {
+                nretries += 1;
+            }
+            nsent += n as usize;
+        }
+        self.mbufs.drain(..nsent);
+        stats::record_tx_burst(nsent, nbytes - Self::count_bytes(&self.mbufs));
+
+        self.oldest = if self.mbufs.is_empty() {
+            None
+        } else {
+            warn!("NIC did not take {} staged packets", self.mbufs.len());
+            Some(Instant::now())
+        };
+    }
+
+    /// Counts the bytes in a list of packets.
+    fn count_bytes(mbufs: &[*mut rte_mbuf]) -> usize {
+        mbufs
+            .iter()
+            .map(|&mbuf_ptr| unsafe { (*mbuf_ptr).pkt_len } as usize)
+            .sum()
+    }
+}
+
+/// Associate Functions for DPDK Runtime
+impl DPDKRuntime {
+    /// Copies a body into body mbufs, chaining as many of them as needed.
+    fn copy_body(&self, bytes: &[u8]) -> DPDKBuffer {
+        let (head, mut remaining): (DPDKBuffer, &[u8]) = self.copy_body_segment(bytes);
+        while !remaining.is_empty() {
+            let (mbuf, rest): (DPDKBuffer, &[u8]) = self.copy_body_segment(remaining);
+            unsafe {
+                assert_eq!(rte_pktmbuf_chain(head.get_ptr(), mbuf.into_raw()), 0);
+            }
+            remaining = rest;
+        }
+        head
+    }
+
+    /// Copies as much of a body as fits into a single body mbuf. Returns the mbuf and the rest of the body.
+    fn copy_body_segment<'a>(&self, bytes: &'a [u8]) -> (DPDKBuffer, &'a [u8]) {
+        let mut mbuf: DPDKBuffer = match self.mm.alloc_body_mbuf() {
+            Ok(mbuf) => mbuf,
+            Err(e) => panic!("failed to allocate body mbuf: {:?}", e.cause),
+        };
+        let len: usize = bytes.len().min(mbuf.len());
+        unsafe { mbuf.slice_mut()[..len].copy_from_slice(&bytes[..len]) };
+        mbuf.trim(mbuf.len() - len);
+        (mbuf, &bytes[len..])
+    }
+
+    /// Asks the NIC to split a packet into segments, each with a copy of its headers (TCP segmentation offload).
+    fn request_segmentation(mbuf_ptr: *mut rte_mbuf, offload: &SegmentationOffload) {
+        unsafe {
+            (*mbuf_ptr).ol_flags |= (PKT_TX_TCP_SEG | PKT_TX_IPV4 | PKT_TX_IP_CKSUM) as u64;
+            // The tx_offload union is the third anonymous union of an mbuf, and its bit fields are in an anonymous
+            // structure. Clear it first, so that the lengths of outer headers are zero.
+            (*mbuf_ptr).__bindgen_anon_3.tx_offload = 0;
+            let lengths = &mut (*mbuf_ptr).__bindgen_anon_3.__bindgen_anon_1;
+            lengths.set_l2_len(offload.l2_len as u64);
+            lengths.set_l3_len(offload.l3_len as u64);
+            lengths.set_l4_len(offload.l4_len as u64);
+            lengths.set_tso_segsz(offload.segment_size as u64);
+        }
+    }
+}
+
 //==============================================================================
 // Trait Implementations
 //==============================================================================
@@ -58,6 +306,7 @@ impl NetworkRuntime for DPDKRuntime {
         let header_size = buf.header_size();
         assert!(header_size <= header_mbuf.len());
         buf.write_header(unsafe { &mut header_mbuf.slice_mut()[..header_size] });
+        let segmentation: Option<SegmentationOffload> = buf.segmentation_offload();
 
         if let Some(body) = buf.take_body() {
             // Next, see how much space we have remaining and inline the body if we have room.
@@ -70,30 +319,30 @@ impl NetworkRuntime for DPDKRuntime {
                 // We're only using the header_mbuf for, well, the header.
                 header_mbuf.trim(header_mbuf.len() - header_size);
 
+                // Bodies may span several body mbufs, either because the NIC segments them, or because they were pushed
+                // as scatter-gather arrays with one mbuf for each segment.
                 let body_mbuf = match body {
                     Buffer::DPDK(mbuf) => mbuf.clone(),
-                    Buffer::Heap(bytes) => {
-                        let mut mbuf = match self.mm.alloc_body_mbuf() {
-                            Ok(mbuf) => mbuf,
-                            Err(e) => panic!("failed to allocate body mbuf: {:?}", e.cause),
-                        };
-                        assert!(mbuf.len() >= bytes.len());
-                        unsafe { mbuf.slice_mut()[..bytes.len()].copy_from_slice(&bytes[..]) };
-                        mbuf.trim(mbuf.len() - bytes.len());
-                        mbuf
-                    },
+                    Buffer::Heap(bytes) => self.copy_body(&bytes[..]),
                 };
                 unsafe {
                     assert_eq!(rte_pktmbuf_chain(header_mbuf.get_ptr(), body_mbuf.into_raw()), 0);
                 }
-                let mut header_mbuf_ptr = header_mbuf.into_raw();
-                let num_sent = unsafe { rte_eth_tx_burst(self.port_id, 0, &mut header_mbuf_ptr, 1) };
-                assert_eq!(num_sent, 1);
+                if let Some(segmentation) = segmentation.as_ref() {
+                    Self::request_segmentation(header_mbuf.get_ptr(), segmentation);
+                }
+                self.tx_ring
+                    .borrow_mut()
+                    .push(self.port_id, self.queue_id, header_mbuf.into_raw());
             }
             // Otherwise, write in the inline space.
             else {
                 let body_buf = unsafe { &mut header_mbuf.slice_mut()[header_size..(header_size + body.len())] };
-                body_buf.copy_from_slice(&body[..]);
+                let mut offset: usize = 0;
+                for bytes in body.segments() {
+                    body_buf[offset..(offset + bytes.len())].copy_from_slice(bytes);
+                    offset += bytes.len();
+                }
 
                 if header_size + body.len() < MIN_PAYLOAD_SIZE {
                     let padding_bytes = MIN_PAYLOAD_SIZE - (header_size + body.len());
@@ -106,10 +355,13 @@ impl NetworkRuntime for DPDKRuntime {
 
                 let frame_size = std::cmp::max(header_size + body.len(), MIN_PAYLOAD_SIZE);
                 header_mbuf.trim(header_mbuf.len() - frame_size);
+                if let Some(segmentation) = segmentation.as_ref() {
+                    Self::request_segmentation(header_mbuf.get_ptr(), segmentation);
+                }
 
-                let mut header_mbuf_ptr = header_mbuf.into_raw();
-                let num_sent = unsafe { rte_eth_tx_burst(self.port_id, 0, &mut header_mbuf_ptr, 1) };
-                assert_eq!(num_sent, 1);
+                self.tx_ring
+                    .borrow_mut()
+                    .push(self.port_id, self.queue_id, header_mbuf.into_raw());
             }
         }
         // No body on our packet, just send the headers.
@@ -123,34 +375,107 @@ impl NetworkRuntime for DPDKRuntime {
             }
             let frame_size = std::cmp::max(header_size, MIN_PAYLOAD_SIZE);
             header_mbuf.trim(header_mbuf.len() - frame_size);
-            let mut header_mbuf_ptr = header_mbuf.into_raw();
-            let num_sent = unsafe { rte_eth_tx_burst(self.port_id, 0, &mut header_mbuf_ptr, 1) };
-            assert_eq!(num_sent, 1);
+            self.tx_ring
+                .borrow_mut()
+                .push(self.port_id, self.queue_id, header_mbuf.into_raw());
         }
     }
 
     fn receive(&self) -> ArrayVec<Buffer, RECEIVE_BATCH_SIZE> {
         let mut out = ArrayVec::new();
 
+        let burst_size: usize = self.rx_burst.size();
         let mut packets: [*mut rte_mbuf; RECEIVE_BATCH_SIZE] = unsafe { mem::zeroed() };
         let nb_rx = unsafe {
             #[cfg(feature = "profiler")]
             timer!("catnip_libos::receive::rte_eth_rx_burst");
 
-            rte_eth_rx_burst(self.port_id, 0, packets.as_mut_ptr(), RECEIVE_BATCH_SIZE as u16)
+            rte_eth_rx_burst(self.port_id, self.queue_id, packets.as_mut_ptr(), burst_size as u16)
         };
-        assert!(nb_rx as usize <= RECEIVE_BATCH_SIZE);
+        assert!(nb_rx as usize <= burst_size);
+        self.rx_burst.update(nb_rx as usize);
 
         {
             #[cfg(feature = "profiler")]
             timer!("catnip_libos:receive::for");
             for &packet in &packets[..nb_rx as usize] {
+                // Hide hashes that were not computed with the key of the TCP flow table.
+                if !self.rss_hash {
+                    unsafe { (*packet).ol_flags &= !(PKT_RX_RSS_HASH as u64) };
+                }
+                if self.queue_id == 0 && self.num_queues > 1 && is_arp(packet) {
+                    self.forward_arp(packet);
+                }
                 let mbuf: DPDKBuffer = DPDKBuffer::new(packet);
                 let buf: Buffer = Buffer::DPDK(mbuf);
                 out.push(buf);
             }
         }
 
+        // Take in ARP frames that the runtime of the first queue forwarded.
+        if let Some(arp_rx) = self.arp_rx.as_ref() {
+            while !out.is_full() {
+                match arp_rx.try_recv() {
+                    Ok(ForwardedMbuf(mbuf)) => out.push(Buffer::DPDK(mbuf)),
+                    Err(_) => break,
+                }
+            }
+        }
+
         out
     }
+
+    fn receives_flow(&self, local: SocketAddrV4, remote: SocketAddrV4) -> bool {
+        match self.flow_steering.as_ref() {
+            Some(flow_steering) => flow_steering.queue(local, remote) == self.queue_id,
+            // Either all flows come to this runtime, or there is no telling where they go.
+            None => true,
+        }
+    }
+
+    fn flush(&self) {
+        let mut tx_ring: RefMut<TxRing> = self.tx_ring.borrow_mut();
+        if !tx_ring.mbufs.is_empty() {
+            tx_ring.flush(self.port_id, self.queue_id);
+        }
+    }
+
+    fn idle(&self, idle: Duration, timeout: Option<Duration>) {
+        // Packets that the NIC did not take yet are retried on the next flush, so keep polling.
+        if !self.tx_ring.borrow().mbufs.is_empty() {
+            return;
+        }
+        self.wait.idle(idle, timeout);
+    }
+}
+
+/// Send Trait Implementation for Forwarded Frames
+///
+/// The runtime that forwards a frame does not keep any reference to its clone, and mbufs go back to pools that are
+/// safe to use from any thread.
+unsafe impl Send for ForwardedMbuf {}
+
+/// Drop Trait Implementation for Transmit Staging Rings
+impl Drop for TxRing {
+    fn drop(&mut self) {
+        for mbuf_ptr in self.mbufs.drain(..) {
+            unsafe { rte_pktmbuf_free(mbuf_ptr) };
+        }
+    }
+}
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Checks if a received frame carries an ARP packet.
+fn is_arp(packet: *mut rte_mbuf) -> bool {
+    unsafe {
+        if ((*packet).data_len as usize) < ETHERNET2_HEADER_SIZE {
+            return false;
+        }
+        let data_ptr: *const u8 = ((*packet).buf_addr as *const u8).offset((*packet).data_off as isize);
+        let ether_type: u16 = u16::from_be_bytes([*data_ptr.add(12), *data_ptr.add(13)]);
+        ether_type == EtherType2::Arp as u16
+    }
 }
@@ -0,0 +1,221 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::runtime::libdpdk::{
+    rte_epoll_event,
+    rte_epoll_wait,
+    rte_eth_dev_rx_intr_ctl_q,
+    rte_eth_dev_rx_intr_disable,
+    rte_eth_dev_rx_intr_enable,
+    RTE_EPOLL_PER_THREAD,
+    RTE_INTR_EVENT_ADD,
+};
+use ::std::{
+    cell::Cell,
+    hint,
+    mem,
+    ptr,
+    time::Duration,
+};
+
+#[cfg(target_arch = "x86_64")]
+use ::std::arch::{
+    asm,
+    x86_64::__cpuid_count,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Number of TSC cycles that the core is put to sleep for on each pause, when it supports TPAUSE. This bounds the
+/// wake-up latency of the pausing stage to a few microseconds.
+#[cfg(target_arch = "x86_64")]
+const PAUSE_CYCLES: u64 = 10_000;
+
+/// Number of PAUSE instructions that are issued on each pause, when the core does not support TPAUSE.
+const PAUSE_SPINS: usize = 64;
+
+/// Maximum time that a wait blocks on RX interrupts for. This bounds how late timers fire while idle.
+const MAX_BLOCK: Duration = Duration::from_millis(1);
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Adaptive Wait
+///
+/// Decides what a wait on an RX queue does between polls that found no work. For the first `spin` of idleness, it
+/// polls right away. For the following `pause`, it puts the core into a light sleep (TPAUSE, or PAUSE on cores that
+/// lack it, including all cores that are not x86_64) for a few microseconds between polls. After that, it blocks until the NIC raises an RX interrupt. Without
+/// RX interrupts, it keeps pausing.
+#[derive(Debug)]
+pub struct AdaptiveWait {
+    port_id: u16,
+    queue_id: u16,
+    /// Time that a wait spins for before it starts saving power. If `None`, waits spin forever.
+    spin: Option<Duration>,
+    /// Time that a wait pauses for before it blocks on RX interrupts.
+    pause: Duration,
+    /// Can waits block on RX interrupts?
+    interrupts: bool,
+    /// Does the core support TPAUSE?
+    tpause: bool,
+    /// Are RX interrupts enabled?
+    armed: Cell<bool>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Adaptive Waits
+impl AdaptiveWait {
+    /// Creates an adaptive wait for an RX queue. When `interrupts` is set, RX interrupts of the queue are registered
+    /// with the epoll instance of the calling thread, so this should be called by the thread that polls the queue.
+    pub fn new(port_id: u16, queue_id: u16, spin: Option<Duration>, pause: Option<Duration>, interrupts: bool) -> Self {
+        let interrupts: bool = interrupts && spin.is_some() && {
+            let ret: i32 = unsafe {
+                rte_eth_dev_rx_intr_ctl_q(
+                    port_id,
+                    queue_id,
+                    RTE_EPOLL_PER_THREAD,
+                    RTE_INTR_EVENT_ADD as i32,
+                    ptr::null_mut(),
+                )
+            };
+            if ret != 0 {
+                warn!(
+                    "cannot register RX interrupts of queue {} of port {} ({:?})",
+                    queue_id, port_id, ret
+                );
+            }
+            ret == 0
+        };
+
+        Self {
+            port_id,
+            queue_id,
+            spin,
+            pause: pause.unwrap_or(Duration::ZERO),
+            interrupts,
+            tpause: has_tpause(),
+            armed: Cell::new(false),
+        }
+    }
+
+    /// Called between the polls of a wait that has found no work for `idle`. Returns once packets may have arrived or
+    /// `timeout` expires.
+    pub fn idle(&self, idle: Duration, timeout: Option<Duration>) {
+        let spin: Duration = match self.spin {
+            Some(spin) => spin,
+            None => return,
+        };
+
+        if idle < spin {
+            self.disarm();
+        } else if !self.interrupts || idle < spin + self.pause {
+            self.disarm();
+            self.pause();
+        } else if !self.armed.get() {
+            // Poll once more before blocking, so that packets that arrived before interrupts were enabled are not
+            // left waiting for the next one.
+            self.arm();
+        } else {
+            self.block(timeout);
+            self.disarm();
+        }
+    }
+
+    /// Puts the core into a light sleep for a few microseconds.
+    fn pause(&self) {
+        if self.tpause {
+            tpause();
+        } else {
+            for _ in 0..PAUSE_SPINS {
+                hint::spin_loop();
+            }
+        }
+    }
+
+    /// Enables RX interrupts of the target queue.
+    fn arm(&self) {
+        if unsafe { rte_eth_dev_rx_intr_enable(self.port_id, self.queue_id) } == 0 {
+            self.armed.set(true);
+        } else {
+            warn!("cannot enable RX interrupts of queue {}", self.queue_id);
+            self.pause();
+        }
+    }
+
+    /// Disables RX interrupts of the target queue, if they are enabled.
+    fn disarm(&self) {
+        if self.armed.replace(false) {
+            unsafe { rte_eth_dev_rx_intr_disable(self.port_id, self.queue_id) };
+        }
+    }
+
+    /// Blocks until an RX interrupt is raised or `timeout` expires.
+    fn block(&self, timeout: Option<Duration>) {
+        let timeout: Duration = timeout.map_or(MAX_BLOCK, |timeout| timeout.min(MAX_BLOCK));
+        // The epoll timeout is in milliseconds, and rounding down would return early.
+        let timeout_ms: i32 = ((timeout.as_micros() + 999) / 1000) as i32;
+        let mut event: rte_epoll_event = unsafe { mem::zeroed() };
+        if unsafe { rte_epoll_wait(RTE_EPOLL_PER_THREAD, &mut event, 1, timeout_ms) } < 0 {
+            warn!("failed to wait for RX interrupts of queue {}", self.queue_id);
+        }
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Drop Trait Implementation for Adaptive Waits
+impl Drop for AdaptiveWait {
+    fn drop(&mut self) {
+        self.disarm();
+    }
+}
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Checks if the core supports TPAUSE, which is part of the WAITPKG extension (CPUID.(EAX=7,ECX=0):ECX[bit 5]).
+#[cfg(target_arch = "x86_64")]
+fn has_tpause() -> bool {
+    unsafe { __cpuid_count(7, 0) }.ecx & (1 << 5) != 0
+}
+
+/// Checks if the core supports TPAUSE, which only x86_64 cores do.
+#[cfg(not(target_arch = "x86_64"))]
+fn has_tpause() -> bool {
+    false
+}
+
+/// Puts the core to sleep for [PAUSE_CYCLES] TSC cycles with TPAUSE, which the core must support.
+#[cfg(target_arch = "x86_64")]
+fn tpause() {
+    let deadline: u64 = unsafe { x86::time::rdtsc() } + PAUSE_CYCLES;
+    // Request the C0.2 state, which saves more power than C0.1 at a slightly higher wake-up latency.
+    unsafe {
+        asm!(
+            "tpause {ctrl:e}",
+            ctrl = in(reg) 0u32,
+            in("edx") (deadline >> 32) as u32,
+            in("eax") deadline as u32,
+            options(nomem, nostack),
+        );
+    }
+}
+
+/// Never called, as [has_tpause] is always `false` on cores that are not x86_64.
+#[cfg(not(target_arch = "x86_64"))]
+fn tpause() {
+    unreachable!("TPAUSE is only supported on x86_64")
+}
@@ -5,6 +5,7 @@
 // Imports
 //======================================================================================================================
 
+use super::runtime::XdpConfig;
 use crate::{
     demikernel::config::Config,
     runtime::network::types::MacAddress,
@@ -43,4 +44,19 @@ impl Config {
         .unwrap();
         local_link_addr
     }
+
+    /// Reads the "AF_XDP" parameters from the underlying configuration file. Returns `None` if frames should go through
+    /// a raw packet socket instead.
+    pub fn xdp_config(&self) -> Option<XdpConfig> {
+        if !self.0["catpowder"]["xdp"].as_bool().unwrap_or(false) {
+            return None;
+        }
+
+        Some(XdpConfig {
+            queue_id: self.0["catpowder"]["xdp_queue_id"].as_i64().unwrap_or(0).max(0) as u32,
+            zero_copy: self.0["catpowder"]["xdp_zero_copy"].as_bool().unwrap_or(true),
+            frame_count: self.0["catpowder"]["xdp_frame_count"].as_i64().unwrap_or(4096).max(2) as usize,
+            xsk_map: self.0["catpowder"]["xdp_xsk_map"].as_str().map(|path| path.to_string()),
+        })
+    }
 }
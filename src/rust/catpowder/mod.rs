@@ -24,11 +24,13 @@ use crate::{
         memory::MemoryRuntime,
         timer::{
             Timer,
+            TimerBackend,
             TimerRc,
         },
         types::{
             demi_qresult_t,
             demi_sgarray_t,
+            DEMI_QTOKEN_INVALID,
         },
         QDesc,
         QToken,
@@ -40,6 +42,7 @@ use crate::{
 };
 use ::std::{
     collections::HashMap,
+    fmt::Debug,
     net::SocketAddrV4,
     ops::{
         Deref,
@@ -79,10 +82,17 @@ impl CatpowderLibOS {
             config.local_ipv4_addr(),
             &config.local_interface_name(),
             HashMap::default(),
+            config.rx_burst_size(),
+            config.rx_burst_adaptive(),
+            config.tcp_selective_ack(),
+            config.tcp_congestion_control(),
+            config.tcp_receive_coalescing(),
+            config.xdp_config(),
         ));
         let now: Instant = Instant::now();
         let scheduler: Scheduler = Scheduler::default();
-        let clock: TimerRc = TimerRc(Rc::new(Timer::new(now)));
+        let timer_backend: TimerBackend = config.timer_backend();
+        let clock: TimerRc = TimerRc(Rc::new(Timer::with_backend(now, timer_backend)));
         let rng_seed: [u8; 32] = [0; 32];
         let inetstack: InetStack = InetStack::new(
             rt.clone(),
@@ -148,6 +158,61 @@ impl CatpowderLibOS {
         }
     }
 
+    /// Pushes scatter-gather arrays to several sockets at once. Operations are issued in order and this function
+    /// stops at the first one that fails, so that `qts` holds the queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn push_many<Q: Copy + Debug + Into<QDesc>>(
+        &mut self,
+        qds: &[Q],
+        sgas: &[demi_sgarray_t],
+        qts: &mut [QToken],
+    ) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catpowder::push_many");
+        trace!("push_many(): qds={:?}", qds);
+
+        // Check arguments.
+        if sgas.len() != qds.len() || qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+
+        for (i, (&qd, sga)) in qds.iter().zip(sgas.iter()).enumerate() {
+            match self.push(qd.into(), sga) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    return Err(e);
+                },
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Pops data from several sockets at once. Operations are issued in order and this function stops at the first
+    /// one that fails, so that `qts` holds the queue tokens of all operations that precede it and [DEMI_QTOKEN_INVALID] for the others.
+    pub fn pop_many<Q: Copy + Debug + Into<QDesc>>(&mut self, qds: &[Q], qts: &mut [QToken]) -> Result<(), Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catpowder::pop_many");
+        trace!("pop_many(): qds={:?}", qds);
+
+        // Check arguments.
+        if qts.len() < qds.len() {
+            return Err(Fail::new(libc::EINVAL, "invalid number of operations"));
+        }
+
+        for (i, &qd) in qds.iter().enumerate() {
+            match self.pop(qd.into()) {
+                Ok(qt) => qts[i] = qt,
+                Err(e) => {
+                    qts[i..qds.len()].fill(QToken::from(DEMI_QTOKEN_INVALID));
+                    return Err(e);
+                },
+            }
+        }
+
+        Ok(())
+    }
+
     /// Waits for an operation to complete.
     pub fn wait(&mut self, qt: QToken) -> Result<demi_qresult_t, Fail> {
         #[cfg(feature = "profiler")]
@@ -178,6 +243,30 @@ impl CatpowderLibOS {
         Ok((i, pack_result(self.rt.clone(), r, qd, qts[i].into())))
     }
 
+    /// Waits for at least one operation to complete or a timeout to expire, and packs the results of all operations
+    /// that have completed into `qrs`. Returns the number of results that were written.
+    pub fn wait_many(
+        &mut self,
+        qts: &[QToken],
+        qrs: &mut [demi_qresult_t],
+        abstime: Option<SystemTime>,
+    ) -> Result<usize, Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("catpowder::wait_many");
+        trace!("wait_many(): qts={:?}, timeout={:?}", qts, abstime);
+
+        if qrs.len() < qts.len() {
+            return Err(Fail::new(libc::EINVAL, "result array is too small"));
+        }
+
+        let rt: Rc<LinuxRuntime> = self.rt.clone();
+        let mut nready: usize = 0;
+        self.inetstack.wait_many2(qts, abstime, |i, qd, r| {
+            qrs[nready] = pack_result(rt.clone(), r, qd, qts[i].into());
+            nready += 1;
+        })
+    }
+
     /// Allocates a scatter-gather array.
     pub fn sgaalloc(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
         self.rt.alloc_sgarray(size)
@@ -5,10 +5,16 @@
 // Imports
 //==============================================================================
 
-use super::LinuxRuntime;
+use super::{
+    Link,
+    LinuxRuntime,
+};
 use crate::runtime::{
     fail::Fail,
     memory::{
+        gather_sgarray,
+        sgarray_len,
+        sgarray_segments,
         Buffer,
         DataBuffer,
         MemoryRuntime,
@@ -16,6 +22,7 @@ use crate::runtime::{
     types::{
         demi_sgarray_t,
         demi_sgaseg_t,
+        DEMI_SGARRAY_MAXLEN,
     },
 };
 use ::libc::c_void;
@@ -24,6 +31,22 @@ use ::std::{
     slice,
 };
 
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Linux Runtime
+impl LinuxRuntime {
+    /// Allocates a buffer of `size` bytes from a UMEM frame, after `init` fills it in. Returns `None` if frames do not
+    /// go through an AF_XDP socket, or if the buffer does not fit in a free frame.
+    fn alloc_xdp_buffer<F: FnOnce(&mut [u8])>(&self, size: usize, init: F) -> Option<DataBuffer> {
+        match *self.link.borrow_mut() {
+            Link::Xdp(ref mut xsk) => xsk.alloc_buffer(size, init),
+            Link::Raw(_) => None,
+        }
+    }
+}
+
 //==============================================================================
 // Trait Implementations
 //==============================================================================
@@ -47,27 +70,35 @@ impl MemoryRuntime for LinuxRuntime {
             },
             _ => return Err(Fail::new(libc::EINVAL, "invalid buffer type")),
         };
+        let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+        sga_segs[0] = sgaseg;
         Ok(demi_sgarray_t {
             sga_buf: dbuf_ptr as *mut c_void,
             sga_numsegs: 1,
-            sga_segs: [sgaseg],
+            sga_segs,
             sga_addr: unsafe { mem::zeroed() },
         })
     }
 
-    /// Allocates a scatter-gather array.
+    /// Allocates a scatter-gather array. Arrays come from UMEM frames if frames go through an AF_XDP socket, so that
+    /// they are transmitted without being copied, unless there are no free frames or arrays do not fit in one.
     fn alloc_sgarray(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
-        // Allocate a heap-managed buffer.
-        let dbuf: DataBuffer = DataBuffer::new(size)?;
+        let dbuf: DataBuffer = match self.alloc_xdp_buffer(size, |_| ()) {
+            Some(dbuf) => dbuf,
+            // Allocate a heap-managed buffer.
+            None => DataBuffer::new(size)?,
+        };
         let (dbuf_ptr, data_ptr): (*const u8, *const u8) = DataBuffer::into_raw_parts(dbuf)?;
         let sgaseg: demi_sgaseg_t = demi_sgaseg_t {
             sgaseg_buf: data_ptr as *mut c_void,
             sgaseg_len: size as u32,
         };
+        let mut sga_segs: [demi_sgaseg_t; DEMI_SGARRAY_MAXLEN] = unsafe { mem::zeroed() };
+        sga_segs[0] = sgaseg;
         Ok(demi_sgarray_t {
             sga_buf: dbuf_ptr as *mut c_void,
             sga_numsegs: 1,
-            sga_segs: [sgaseg],
+            sga_segs,
             sga_addr: unsafe { mem::zeroed() },
         })
     }
@@ -75,34 +106,48 @@ impl MemoryRuntime for LinuxRuntime {
     /// Releases a scatter-gather array.
     fn free_sgarray(&self, sga: demi_sgarray_t) -> Result<(), Fail> {
         // Check arguments.
-        // TODO: Drop this check once we support scatter-gather arrays with multiple segments.
-        if sga.sga_numsegs != 1 {
-            return Err(Fail::new(libc::EINVAL, "scatter-gather array with invalid size"));
-        }
+        sgarray_segments(&sga)?;
 
-        // Release heap-managed buffer.
+        // Release underlying buffer. Only the buffer that backs the first segment is owned by the scatter-gather
+        // array, any other segments are owned by the application. UMEM frames go back to the AF_XDP socket.
+        if let Link::Xdp(ref mut xsk) = *self.link.borrow_mut() {
+            if xsk.release_buffer(sga.sga_buf as *const u8)? {
+                return Ok(());
+            }
+        }
         let (dbuf_ptr, length): (*mut u8, usize) = (sga.sga_buf as *mut u8, sga.sga_segs[0].sgaseg_len as usize);
         DataBuffer::from_raw_parts(dbuf_ptr, length)?;
 
         Ok(())
     }
 
-    /// Clones a scatter-gather array.
+    /// Clones a scatter-gather array. Buffers that lie in UMEM frames are shared instead of copied.
     fn clone_sgarray(&self, sga: &demi_sgarray_t) -> Result<Buffer, Fail> {
         // Check arguments.
-        // TODO: Drop this check once we support scatter-gather arrays with multiple segments.
-        if sga.sga_numsegs != 1 {
-            return Err(Fail::new(libc::EINVAL, "scatter-gather array with invalid size"));
+        let segs: &[demi_sgaseg_t] = sgarray_segments(sga)?;
+
+        // Gather multiple segments into a single buffer. This goes straight into a UMEM frame if it fits, and then the
+        // frame is transmitted in place, so this is the only copy on the way to the NIC.
+        if segs.len() > 1 {
+            let len: usize = sgarray_len(segs);
+            if let Some(dbuf) = self.alloc_xdp_buffer(len, |dst: &mut [u8]| gather_sgarray(segs, dst)) {
+                return Ok(Buffer::Heap(dbuf));
+            }
+            let mut dbuf: DataBuffer = DataBuffer::new(len)?;
+            gather_sgarray(segs, &mut dbuf);
+            return Ok(Buffer::Heap(dbuf));
         }
 
-        let sgaseg: demi_sgaseg_t = sga.sga_segs[0];
-        let (dbuf_ptr, len): (*mut c_void, usize) = (sga.sga_buf, sgaseg.sgaseg_len as usize);
+        let sgaseg: demi_sgaseg_t = segs[0];
+        if let Link::Xdp(ref xsk) = *self.link.borrow() {
+            if let Some(dbuf) = xsk.share_buffer(sgaseg.sgaseg_buf as *const u8, sgaseg.sgaseg_len as usize) {
+                return Ok(Buffer::Heap(dbuf));
+            }
+        }
+        let (data_ptr, len): (*const u8, usize) = (sgaseg.sgaseg_buf as *const u8, sgaseg.sgaseg_len as usize);
 
-        // Clone heap-managed buffer.
-        let seg_slice: &[u8] = unsafe { slice::from_raw_parts(dbuf_ptr as *const u8, len) };
-        let mut dbuf: DataBuffer = DataBuffer::from_slice(seg_slice);
-        let nbytes: usize = unsafe { sgaseg.sgaseg_buf.sub_ptr(sga.sga_buf) };
-        dbuf.adjust(nbytes);
-        Ok(Buffer::Heap(dbuf))
+        // Clone heap-managed buffer, starting at the segment, which may lie past the beginning of the buffer.
+        let seg_slice: &[u8] = unsafe { slice::from_raw_parts(data_ptr, len) };
+        Ok(Buffer::Heap(DataBuffer::from_slice(seg_slice)))
     }
 }
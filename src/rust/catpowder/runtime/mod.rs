@@ -4,19 +4,25 @@
 mod memory;
 mod network;
 mod rawsocket;
+mod xdp;
 
 //==============================================================================
 // Imports
 //==============================================================================
 
-use self::rawsocket::{
-    RawSocket,
-    RawSocketAddr,
+use self::{
+    rawsocket::{
+        RawSocket,
+        RawSocketAddr,
+    },
+    xdp::XdpSocket,
 };
 use crate::runtime::{
     network::{
+        burst::RxBurst,
         config::{
             ArpConfig,
+            CongestionControlAlgorithm,
             TcpConfig,
             UdpConfig,
         },
@@ -34,10 +40,24 @@ use ::std::{
     time::Duration,
 };
 
+//==============================================================================
+// Exports
+//==============================================================================
+
+pub use self::xdp::XdpConfig;
+
 //==============================================================================
 // Constants & Structures
 //==============================================================================
 
+/// Socket through which a Linux Runtime sends and receives frames.
+enum Link {
+    /// Raw packet socket, which takes a system call to send or receive each frame.
+    Raw(RawSocket),
+    /// AF_XDP socket, which shares rings of frames with the kernel.
+    Xdp(XdpSocket),
+}
+
 /// Linux Runtime
 #[derive(Clone)]
 pub struct LinuxRuntime {
@@ -47,7 +67,9 @@ pub struct LinuxRuntime {
     pub link_addr: MacAddress,
     pub ipv4_addr: Ipv4Addr,
     ifindex: i32,
-    socket: Rc<RefCell<RawSocket>>,
+    link: Rc<RefCell<Link>>,
+    /// Number of packets to read from the socket on each receive.
+    rx_burst: Rc<RxBurst>,
 }
 
 //==============================================================================
@@ -57,7 +79,18 @@ pub struct LinuxRuntime {
 /// Associate Functions for Linux Runtime
 impl LinuxRuntime {
     /// Instantiates a Linux Runtime.
-    pub fn new(link_addr: MacAddress, ipv4_addr: Ipv4Addr, ifname: &str, arp: HashMap<Ipv4Addr, MacAddress>) -> Self {
+    pub fn new(
+        link_addr: MacAddress,
+        ipv4_addr: Ipv4Addr,
+        ifname: &str,
+        arp: HashMap<Ipv4Addr, MacAddress>,
+        rx_burst_size: Option<usize>,
+        rx_burst_adaptive: Option<bool>,
+        tcp_selective_ack: Option<bool>,
+        tcp_congestion_control: Option<CongestionControlAlgorithm>,
+        tcp_receive_coalescing: Option<bool>,
+        xdp: Option<XdpConfig>,
+    ) -> Self {
         let arp_options: ArpConfig = ArpConfig::new(
             Some(Duration::from_secs(600)),
             Some(Duration::from_secs(1)),
@@ -69,18 +102,38 @@ impl LinuxRuntime {
         // TODO: Make this constructor return a Result and drop expect() calls bellow.
         let mac_addr: [u8; 6] = [0; 6];
         let ifindex: i32 = Self::get_ifindex(ifname).expect("could not parse ifindex");
-        let socket: RawSocket = RawSocket::new().expect("could not create raw socket");
-        let sockaddr: RawSocketAddr = RawSocketAddr::new(ifindex, &mac_addr);
-        socket.bind(&sockaddr).expect("could not bind raw socket");
+        let link: Link = match xdp {
+            Some(config) => Link::Xdp(XdpSocket::new(ifindex as u32, &config).expect("could not create AF_XDP socket")),
+            None => {
+                let socket: RawSocket = RawSocket::new().expect("could not create raw socket");
+                let sockaddr: RawSocketAddr = RawSocketAddr::new(ifindex, &mac_addr);
+                socket.bind(&sockaddr).expect("could not bind raw socket");
+                Link::Raw(socket)
+            },
+        };
 
         Self {
-            tcp_options: TcpConfig::default(),
+            tcp_options: TcpConfig::new(
+                None,
+                None,
+                None,
+                None,
+                None,
+                None,
+                None,
+                None,
+                tcp_selective_ack,
+                tcp_congestion_control,
+                None,
+                tcp_receive_coalescing,
+            ),
             udp_options: UdpConfig::default(),
             arp_options,
             link_addr,
             ipv4_addr,
             ifindex,
-            socket: Rc::new(RefCell::new(socket)),
+            link: Rc::new(RefCell::new(link)),
+            rx_burst: Rc::new(RxBurst::new(rx_burst_size, rx_burst_adaptive)),
         }
     }
 
@@ -6,12 +6,18 @@
 //==============================================================================
 
 use super::{
-    rawsocket::RawSocketAddr,
+    rawsocket::{
+        RawSocket,
+        RawSocketAddr,
+    },
+    xdp::XdpSocket,
+    Link,
     LinuxRuntime,
 };
 use crate::{
     inetstack::protocols::ethernet2::Ethernet2Header,
     runtime::{
+        fail::Fail,
         memory::{
             Buffer,
             DataBuffer,
@@ -21,6 +27,7 @@ use crate::{
             NetworkRuntime,
             PacketBuf,
         },
+        stats,
     },
 };
 use ::arrayvec::ArrayVec;
@@ -30,13 +37,13 @@ use ::std::mem::{
 };
 
 //==============================================================================
-// Trait Implementations
+// Associate Functions
 //==============================================================================
 
-/// Network Runtime Trait Implementation for Linux Runtime
-impl NetworkRuntime for LinuxRuntime {
-    /// Transmits a single [PacketBuf].
-    fn transmit(&self, pkt: Box<dyn PacketBuf>) {
+/// Associate Functions for Linux Runtime
+impl LinuxRuntime {
+    /// Transmits a single [PacketBuf] through a raw socket.
+    fn transmit_raw(&self, socket: &RawSocket, pkt: Box<dyn PacketBuf>) {
         let header_size: usize = pkt.header_size();
         let body_size: usize = pkt.body_size();
 
@@ -52,30 +59,95 @@ impl NetworkRuntime for LinuxRuntime {
         let dest_sockaddr: RawSocketAddr = RawSocketAddr::new(self.ifindex, &dest_addr_arr);
 
         // Send packet.
-        match self.socket.borrow().sendto(&buf, &dest_sockaddr) {
+        match socket.sendto(&buf, &dest_sockaddr) {
             // Operation succeeded.
-            Ok(_) => (),
+            Ok(_) => stats::record_tx_burst(1, buf.len()),
             // Operation failed, drop packet.
             Err(e) => warn!("dropping packet: {:?}", e),
         };
     }
 
+    /// Transmits a single [PacketBuf] through an AF_XDP socket. A body that lies in a UMEM frame is sent in place, with
+    /// the headers written in front of it. Otherwise, the packet is written straight into a UMEM frame.
+    fn transmit_xdp(xsk: &mut XdpSocket, pkt: Box<dyn PacketBuf>) {
+        let header_size: usize = pkt.header_size();
+        let body_size: usize = pkt.body_size();
+        let body: Option<Buffer> = pkt.take_body();
+
+        let ret: Result<(), Fail> = match body {
+            Some(Buffer::Heap(dbuf)) if xsk.can_transmit_in_place(header_size, &dbuf) => {
+                xsk.transmit_in_place(header_size, dbuf, |headers: &mut [u8]| pkt.write_header(headers))
+            },
+            body => xsk.transmit(header_size + body_size, |frame: &mut [u8]| {
+                pkt.write_header(&mut frame[..header_size]);
+                if let Some(body) = body {
+                    frame[header_size..].copy_from_slice(&body[..]);
+                }
+            }),
+        };
+
+        // Operation failed, drop packet.
+        if let Err(e) = ret {
+            warn!("dropping packet: {:?}", e);
+        }
+    }
+
+    /// Receives a batch of [PacketBuf] from a raw socket.
+    fn receive_raw(socket: &RawSocket, burst_size: usize, ret: &mut ArrayVec<Buffer, RECEIVE_BATCH_SIZE>) {
+        // The raw socket is non-blocking, so drain it until either it is empty or the burst is complete.
+        while ret.len() < burst_size {
+            // 4096B buffer size chosen arbitrarily, seems fine for now.
+            // This use-case is an example for MaybeUninit in the docs
+            let mut out: [MaybeUninit<u8>; 4096] = [unsafe { MaybeUninit::uninit().assume_init() }; 4096];
+            if let Ok((nbytes, _origin_addr)) = socket.recvfrom(&mut out[..]) {
+                unsafe {
+                    let bytes: [u8; 4096] = mem::transmute::<[MaybeUninit<u8>; 4096], [u8; 4096]>(out);
+                    let mut dbuf: Buffer = Buffer::Heap(DataBuffer::from_slice(&bytes));
+                    dbuf.trim(4096 - nbytes);
+                    ret.push(dbuf);
+                }
+            } else {
+                break;
+            }
+        }
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Network Runtime Trait Implementation for Linux Runtime
+impl NetworkRuntime for LinuxRuntime {
+    /// Transmits a single [PacketBuf].
+    fn transmit(&self, pkt: Box<dyn PacketBuf>) {
+        match *self.link.borrow_mut() {
+            Link::Raw(ref socket) => self.transmit_raw(socket, pkt),
+            Link::Xdp(ref mut xsk) => Self::transmit_xdp(xsk, pkt),
+        }
+    }
+
     /// Receives a batch of [PacketBuf].
     fn receive(&self) -> ArrayVec<Buffer, RECEIVE_BATCH_SIZE> {
-        // 4096B buffer size chosen arbitrarily, seems fine for now.
-        // This use-case is an example for MaybeUninit in the docs
-        let mut out: [MaybeUninit<u8>; 4096] = [unsafe { MaybeUninit::uninit().assume_init() }; 4096];
-        if let Ok((nbytes, _origin_addr)) = self.socket.borrow().recvfrom(&mut out[..]) {
-            let mut ret: ArrayVec<Buffer, RECEIVE_BATCH_SIZE> = ArrayVec::new();
-            unsafe {
-                let bytes: [u8; 4096] = mem::transmute::<[MaybeUninit<u8>; 4096], [u8; 4096]>(out);
-                let mut dbuf: Buffer = Buffer::Heap(DataBuffer::from_slice(&bytes));
-                dbuf.trim(4096 - nbytes);
-                ret.push(dbuf);
-            }
-            ret
-        } else {
-            ArrayVec::new()
+        let burst_size: usize = self.rx_burst.size();
+        let mut ret: ArrayVec<Buffer, RECEIVE_BATCH_SIZE> = ArrayVec::new();
+
+        match *self.link.borrow_mut() {
+            Link::Raw(ref socket) => Self::receive_raw(socket, burst_size, &mut ret),
+            // Received frames are lent to the stack, so packets are not copied out of them.
+            Link::Xdp(ref mut xsk) => {
+                xsk.receive(burst_size, |dbuf: DataBuffer| ret.push(Buffer::Heap(dbuf)));
+            },
+        }
+
+        self.rx_burst.update(ret.len());
+        ret
+    }
+
+    /// Wakes up the kernel to send packets that were staged in the TX ring of an AF_XDP socket.
+    fn flush(&self) {
+        if let Link::Xdp(ref mut xsk) = *self.link.borrow_mut() {
+            xsk.flush();
         }
     }
 }
@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//! Kernel interface of AF_XDP sockets, as defined in `linux/if_xdp.h` and `linux/bpf.h`.
+
+#![allow(non_camel_case_types)]
+
+//======================================================================================================================
+// Constants
+//======================================================================================================================
+
+/// Address family of AF_XDP sockets.
+pub const AF_XDP: libc::c_int = 44;
+
+/// Socket option level of AF_XDP sockets.
+pub const SOL_XDP: libc::c_int = 283;
+
+/// Socket options.
+pub const XDP_MMAP_OFFSETS: libc::c_int = 1;
+pub const XDP_RX_RING: libc::c_int = 2;
+pub const XDP_TX_RING: libc::c_int = 3;
+pub const XDP_UMEM_REG: libc::c_int = 4;
+pub const XDP_UMEM_FILL_RING: libc::c_int = 5;
+pub const XDP_UMEM_COMPLETION_RING: libc::c_int = 6;
+
+/// Bind flags.
+pub const XDP_COPY: u16 = 1 << 1;
+pub const XDP_ZEROCOPY: u16 = 1 << 2;
+pub const XDP_USE_NEED_WAKEUP: u16 = 1 << 3;
+
+/// Ring flags.
+pub const XDP_RING_NEED_WAKEUP: u32 = 1 << 0;
+
+/// Offsets at which each ring is mapped.
+pub const XDP_PGOFF_RX_RING: libc::off_t = 0;
+pub const XDP_PGOFF_TX_RING: libc::off_t = 0x80000000;
+pub const XDP_UMEM_PGOFF_FILL_RING: libc::off_t = 0x100000000;
+pub const XDP_UMEM_PGOFF_COMPLETION_RING: libc::off_t = 0x180000000;
+
+/// BPF commands.
+pub const BPF_MAP_UPDATE_ELEM: libc::c_long = 2;
+pub const BPF_OBJ_GET: libc::c_long = 7;
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Address of an AF_XDP socket.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct sockaddr_xdp {
+    pub sxdp_family: u16,
+    pub sxdp_flags: u16,
+    pub sxdp_ifindex: u32,
+    pub sxdp_queue_id: u32,
+    pub sxdp_shared_umem_fd: u32,
+}
+
+/// Offsets of the fields of a ring in its mapping.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct xdp_ring_offset {
+    pub producer: u64,
+    pub consumer: u64,
+    pub desc: u64,
+    pub flags: u64,
+}
+
+/// Offsets of the fields of all rings of an AF_XDP socket.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct xdp_mmap_offsets {
+    pub rx: xdp_ring_offset,
+    pub tx: xdp_ring_offset,
+    pub fr: xdp_ring_offset,
+    pub cr: xdp_ring_offset,
+}
+
+/// Registration of a UMEM.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct xdp_umem_reg {
+    pub addr: u64,
+    pub len: u64,
+    pub chunk_size: u32,
+    pub headroom: u32,
+    pub flags: u32,
+    pub tx_metadata_len: u32,
+}
+
+/// Descriptor of the RX and TX rings.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct xdp_desc {
+    pub addr: u64,
+    pub len: u32,
+    pub options: u32,
+}
+
+/// Attributes of the [BPF_OBJ_GET] command.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct bpf_obj_get_attr {
+    pub pathname: u64,
+    pub bpf_fd: u32,
+    pub file_flags: u32,
+}
+
+/// Attributes of the [BPF_MAP_UPDATE_ELEM] command.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct bpf_map_update_attr {
+    pub map_fd: u32,
+    pub pad: u32,
+    pub key: u64,
+    pub value: u64,
+    pub flags: u64,
+}
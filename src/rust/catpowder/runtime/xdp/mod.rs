@@ -0,0 +1,16 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+mod abi;
+mod ring;
+mod socket;
+mod umem;
+
+//======================================================================================================================
+// Exports
+//======================================================================================================================
+
+pub use socket::{
+    XdpConfig,
+    XdpSocket,
+};
@@ -0,0 +1,285 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use super::abi::{
+    xdp_ring_offset,
+    XDP_RING_NEED_WAKEUP,
+};
+use crate::runtime::fail::Fail;
+use ::nix::errno;
+use ::std::{
+    mem,
+    ptr,
+    sync::atomic::{
+        AtomicU32,
+        Ordering,
+    },
+};
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Single-Producer Single-Consumer Ring Shared with the Kernel
+///
+/// The fill and TX rings are produced by us and consumed by the kernel, whereas the completion and RX rings go the
+/// other way around. Each side keeps a local copy of the index of the other side, and only reads the shared index when
+/// that copy says that the ring is full (or empty), so that the shared cache line is seldom touched.
+pub struct Ring<T: Copy> {
+    /// Index of the next descriptor that the producer writes.
+    producer: *const AtomicU32,
+    /// Index of the next descriptor that the consumer reads.
+    consumer: *const AtomicU32,
+    /// Flags that the kernel sets on the ring.
+    flags: *const AtomicU32,
+    /// Descriptors.
+    descs: *mut T,
+    /// Number of descriptors, which is a power of two.
+    size: u32,
+    /// Local copy of the producer index.
+    cached_producer: u32,
+    /// Local copy of the consumer index.
+    cached_consumer: u32,
+    /// Mapping of the ring.
+    mmap_addr: *mut libc::c_void,
+    /// Length of the mapping of the ring.
+    mmap_len: usize,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for Rings
+impl<T: Copy> Ring<T> {
+    /// Maps a ring of `size` descriptors of an AF_XDP socket, at the page offset `pgoff`.
+    pub fn map(fd: libc::c_int, offsets: &xdp_ring_offset, size: u32, pgoff: libc::off_t) -> Result<Self, Fail> {
+        let mmap_len: usize = offsets.desc as usize + size as usize * mem::size_of::<T>();
+        let mmap_addr: *mut libc::c_void = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                mmap_len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd,
+                pgoff,
+            )
+        };
+        if mmap_addr == libc::MAP_FAILED {
+            return Err(Fail::new(errno::errno(), "failed to map ring of AF_XDP socket"));
+        }
+
+        Ok(unsafe { Self::from_raw_parts(mmap_addr, mmap_len, offsets, size) })
+    }
+
+    /// Builds a ring of `size` descriptors on top of the mapping at `mmap_addr`, whose fields lie at `offsets`.
+    ///
+    /// # Safety
+    ///
+    /// The mapping must be `mmap_len` bytes long and hold the fields of a ring at `offsets`. It is unmapped once the
+    /// ring is dropped.
+    unsafe fn from_raw_parts(
+        mmap_addr: *mut libc::c_void,
+        mmap_len: usize,
+        offsets: &xdp_ring_offset,
+        size: u32,
+    ) -> Self {
+        debug_assert!(size.is_power_of_two(), "ring size must be a power of two");
+        let base: *mut u8 = mmap_addr as *mut u8;
+        let (producer, consumer, flags, descs): (*const AtomicU32, *const AtomicU32, *const AtomicU32, *mut T) = (
+            base.add(offsets.producer as usize) as *const AtomicU32,
+            base.add(offsets.consumer as usize) as *const AtomicU32,
+            base.add(offsets.flags as usize) as *const AtomicU32,
+            base.add(offsets.desc as usize) as *mut T,
+        );
+        let (cached_producer, cached_consumer): (u32, u32) =
+            ((*producer).load(Ordering::Relaxed), (*consumer).load(Ordering::Relaxed));
+
+        Self {
+            producer,
+            consumer,
+            flags,
+            descs,
+            size,
+            cached_producer,
+            cached_consumer,
+            mmap_addr,
+            mmap_len,
+        }
+    }
+
+    /// Produces as many descriptors of `descs` as fit in the target ring, and returns how many those were.
+    pub fn produce(&mut self, descs: &[T]) -> usize {
+        let mut free: u32 = self.size - self.cached_producer.wrapping_sub(self.cached_consumer);
+        if (free as usize) < descs.len() {
+            self.cached_consumer = unsafe { (*self.consumer).load(Ordering::Acquire) };
+            free = self.size - self.cached_producer.wrapping_sub(self.cached_consumer);
+        }
+
+        let n: usize = descs.len().min(free as usize);
+        for (i, desc) in descs[..n].iter().enumerate() {
+            let index: u32 = self.cached_producer.wrapping_add(i as u32) & (self.size - 1);
+            unsafe { ptr::write(self.descs.add(index as usize), *desc) };
+        }
+        if n > 0 {
+            self.cached_producer = self.cached_producer.wrapping_add(n as u32);
+            // Publish the descriptors only after they are written.
+            unsafe { (*self.producer).store(self.cached_producer, Ordering::Release) };
+        }
+        n
+    }
+
+    /// Consumes up to `max` descriptors from the target ring, handing each of them to `f`. Returns how many descriptors
+    /// were consumed.
+    pub fn consume<F: FnMut(T)>(&mut self, max: usize, mut f: F) -> usize {
+        let mut available: u32 = self.cached_producer.wrapping_sub(self.cached_consumer);
+        if (available as usize) < max {
+            self.cached_producer = unsafe { (*self.producer).load(Ordering::Acquire) };
+            available = self.cached_producer.wrapping_sub(self.cached_consumer);
+        }
+
+        let n: usize = max.min(available as usize);
+        for i in 0..n {
+            let index: u32 = self.cached_consumer.wrapping_add(i as u32) & (self.size - 1);
+            f(unsafe { ptr::read(self.descs.add(index as usize)) });
+        }
+        if n > 0 {
+            self.cached_consumer = self.cached_consumer.wrapping_add(n as u32);
+            // Hand the descriptors back only after they are read.
+            unsafe { (*self.consumer).store(self.cached_consumer, Ordering::Release) };
+        }
+        n
+    }
+
+    /// Checks if the kernel has to be woken up to process the target ring.
+    pub fn needs_wakeup(&self) -> bool {
+        unsafe { (*self.flags).load(Ordering::Relaxed) & XDP_RING_NEED_WAKEUP != 0 }
+    }
+}
+
+//======================================================================================================================
+// Trait Implementations
+//======================================================================================================================
+
+/// Drop Trait Implementation for Rings
+impl<T: Copy> Drop for Ring<T> {
+    fn drop(&mut self) {
+        unsafe { libc::munmap(self.mmap_addr, self.mmap_len) };
+    }
+}
+
+//======================================================================================================================
+// Unit Tests
+//======================================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::Ring;
+    use crate::catpowder::runtime::xdp::abi::xdp_ring_offset;
+    use ::std::{
+        mem,
+        ptr,
+        sync::atomic::{
+            AtomicU32,
+            Ordering,
+        },
+    };
+
+    /// Offsets of the fields of the test rings, which are laid out like those of the kernel.
+    const OFFSETS: xdp_ring_offset = xdp_ring_offset {
+        producer: 0,
+        consumer: 64,
+        flags: 128,
+        desc: 192,
+    };
+
+    /// Maps an anonymous ring of `size` descriptors whose indices start at `index`. The test plays the kernel side of
+    /// the ring through the returned indices.
+    fn map_ring(size: u32, index: u32) -> (Ring<u64>, &'static AtomicU32, &'static AtomicU32) {
+        let mmap_len: usize = OFFSETS.desc as usize + size as usize * mem::size_of::<u64>();
+        let mmap_addr: *mut libc::c_void = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                mmap_len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_PRIVATE | libc::MAP_ANONYMOUS,
+                -1,
+                0,
+            )
+        };
+        assert_ne!(mmap_addr, libc::MAP_FAILED);
+        let (producer, consumer): (&'static AtomicU32, &'static AtomicU32) = unsafe {
+            (
+                &*((mmap_addr as *mut u8).add(OFFSETS.producer as usize) as *const AtomicU32),
+                &*((mmap_addr as *mut u8).add(OFFSETS.consumer as usize) as *const AtomicU32),
+            )
+        };
+        producer.store(index, Ordering::Relaxed);
+        consumer.store(index, Ordering::Relaxed);
+        let ring: Ring<u64> = unsafe { Ring::from_raw_parts(mmap_addr, mmap_len, &OFFSETS, size) };
+        (ring, producer, consumer)
+    }
+
+    /// Tests that a producer does not overrun the consumer, and sees room again once the consumer moves on.
+    #[test]
+    fn test_ring_produce_full() {
+        let (mut ring, producer, consumer): (Ring<u64>, &AtomicU32, &AtomicU32) = map_ring(4, 0);
+        assert_eq!(ring.produce(&[1, 2, 3]), 3);
+        assert_eq!(ring.produce(&[4, 5, 6]), 1);
+        assert_eq!(ring.produce(&[7]), 0);
+        assert_eq!(producer.load(Ordering::Relaxed), 4);
+
+        // The consumer takes two descriptors.
+        consumer.store(2, Ordering::Relaxed);
+        assert_eq!(ring.produce(&[7, 8, 9]), 2);
+        assert_eq!(producer.load(Ordering::Relaxed), 6);
+    }
+
+    /// Tests that descriptors are consumed in order and that a consumer never reads past the producer.
+    #[test]
+    fn test_ring_consume() {
+        let (mut ring, producer, consumer): (Ring<u64>, &AtomicU32, &AtomicU32) = map_ring(4, 0);
+        let mut consumed: Vec<u64> = Vec::new();
+        assert_eq!(ring.consume(4, |desc| consumed.push(desc)), 0);
+
+        unsafe {
+            for (i, desc) in [10, 11, 12].iter().enumerate() {
+                ptr::write(ring.descs.add(i), *desc);
+            }
+        }
+        producer.store(3, Ordering::Relaxed);
+        assert_eq!(ring.consume(2, |desc| consumed.push(desc)), 2);
+        assert_eq!(ring.consume(4, |desc| consumed.push(desc)), 1);
+        assert_eq!(consumed, vec![10, 11, 12]);
+        assert_eq!(consumer.load(Ordering::Relaxed), 3);
+    }
+
+    /// Tests that indices wrap around both the ring and the 32-bit counters that the kernel keeps.
+    #[test]
+    fn test_ring_wrap_around() {
+        let start: u32 = u32::MAX - 1;
+        let (mut producer_ring, producer, _): (Ring<u64>, &AtomicU32, &AtomicU32) = map_ring(4, start);
+        assert_eq!(producer_ring.produce(&[1, 2, 3, 4]), 4);
+        assert_eq!(producer.load(Ordering::Relaxed), start.wrapping_add(4));
+        assert_eq!(producer_ring.produce(&[5]), 0);
+
+        // Descriptors land at the slots that the counters point to, modulo the size of the ring.
+        let descs: Vec<u64> = (0..4)
+            .map(|i| unsafe { ptr::read(producer_ring.descs.add(i)) })
+            .collect();
+        assert_eq!(descs, vec![3, 4, 1, 2]);
+
+        // A consumer on the same descriptors sees them in order.
+        let (mut consumer_ring, consumer_producer, consumer): (Ring<u64>, &AtomicU32, &AtomicU32) = map_ring(4, start);
+        unsafe { ptr::copy_nonoverlapping(producer_ring.descs, consumer_ring.descs, 4) };
+        consumer_producer.store(start.wrapping_add(4), Ordering::Relaxed);
+        let mut consumed: Vec<u64> = Vec::new();
+        assert_eq!(consumer_ring.consume(usize::MAX, |desc| consumed.push(desc)), 4);
+        assert_eq!(consumed, vec![1, 2, 3, 4]);
+        assert_eq!(consumer.load(Ordering::Relaxed), start.wrapping_add(4));
+    }
+}
@@ -0,0 +1,529 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use super::{
+    abi::{
+        bpf_map_update_attr,
+        bpf_obj_get_attr,
+        sockaddr_xdp,
+        xdp_desc,
+        xdp_mmap_offsets,
+        xdp_umem_reg,
+        AF_XDP,
+        BPF_MAP_UPDATE_ELEM,
+        BPF_OBJ_GET,
+        SOL_XDP,
+        XDP_COPY,
+        XDP_MMAP_OFFSETS,
+        XDP_PGOFF_RX_RING,
+        XDP_PGOFF_TX_RING,
+        XDP_RX_RING,
+        XDP_TX_RING,
+        XDP_UMEM_COMPLETION_RING,
+        XDP_UMEM_FILL_RING,
+        XDP_UMEM_PGOFF_COMPLETION_RING,
+        XDP_UMEM_PGOFF_FILL_RING,
+        XDP_UMEM_REG,
+        XDP_USE_NEED_WAKEUP,
+        XDP_ZEROCOPY,
+    },
+    ring::Ring,
+    umem::{
+        Umem,
+        UMEM_FRAME_DATA_LEN,
+        UMEM_FRAME_HEADROOM,
+        UMEM_FRAME_SIZE,
+    },
+};
+use crate::runtime::{
+    fail::Fail,
+    memory::DataBuffer,
+    stats,
+};
+use ::nix::errno;
+use ::std::{
+    ffi::CString,
+    mem,
+    ptr,
+};
+
+//======================================================================================================================
+// Constants
+//======================================================================================================================
+
+/// Number of frames that may be staged in the TX ring before the kernel is woken up to send them.
+const XDP_TX_BATCH_SIZE: usize = 32;
+
+/// Room that is left for headers in front of the data of buffers that come from UMEM frames, so that packets can be
+/// built around them in place. This fits Ethernet, IPv4 and TCP headers with options.
+const XDP_TX_HEADROOM: usize = 128;
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// AF_XDP Socket Configuration
+#[derive(Clone, Debug)]
+pub struct XdpConfig {
+    /// Queue of the network interface that the socket is bound to.
+    pub queue_id: u32,
+    /// Asks the driver to map the UMEM for DMA, instead of copying packets in and out of it.
+    pub zero_copy: bool,
+    /// Number of frames in the UMEM.
+    pub frame_count: usize,
+    /// Path of a pinned XSKMAP, where the socket is registered for its queue. The XDP program that is attached to the
+    /// network interface redirects packets to sockets through this map.
+    pub xsk_map: Option<String>,
+}
+
+/// AF_XDP Socket
+///
+/// Sends and receives packets through rings that are shared with the kernel, and whose descriptors point to frames
+/// of a [Umem]. Up to half of the frames are lent to the kernel through the fill ring for reception. Received frames are
+/// lent to the application as they are, and the fill ring is topped up with free frames. Frames also back the buffers
+/// of scatter-gather arrays, and a buffer that starts right after [XDP_TX_HEADROOM] bytes of a frame is transmitted in
+/// place, with its headers written in front of it. Other packets are copied into a free frame. Frames are staged in
+/// the TX ring, the kernel is only woken up once per batch, and frames are reclaimed from the completion ring once sent.
+pub struct XdpSocket {
+    /// Underlying file descriptor.
+    fd: libc::c_int,
+    /// Ring of received packets.
+    rx: Ring<xdp_desc>,
+    /// Ring of packets to transmit.
+    tx: Ring<xdp_desc>,
+    /// Ring of frames that the kernel may receive into.
+    fill: Ring<u64>,
+    /// Ring of frames that the kernel has transmitted.
+    completion: Ring<u64>,
+    /// Frames.
+    umem: Umem,
+    /// Number of frames that the kernel holds for reception.
+    rx_frames: usize,
+    /// Number of frames that the kernel should hold for reception.
+    rx_target: usize,
+    /// Buffers that are transmitted in place, by frame. They are kept until their frame is completed.
+    tx_in_place: Vec<Option<DataBuffer>>,
+    /// Number of frames that were staged in the TX ring since the kernel was last woken up.
+    tx_pending: usize,
+    /// Number of bytes in the frames that were staged in the TX ring since the kernel was last woken up.
+    tx_pending_bytes: usize,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for AF_XDP Sockets
+impl XdpSocket {
+    /// Creates an AF_XDP socket and binds it to a queue of the network interface `ifindex`.
+    pub fn new(ifindex: u32, config: &XdpConfig) -> Result<Self, Fail> {
+        let fd: libc::c_int = unsafe { libc::socket(AF_XDP, libc::SOCK_RAW | libc::SOCK_CLOEXEC, 0) };
+        if fd == -1 {
+            return Err(Fail::new(errno::errno(), "failed to create AF_XDP socket"));
+        }
+
+        match Self::setup(fd, ifindex, config) {
+            Ok(socket) => Ok(socket),
+            Err(e) => {
+                unsafe { libc::close(fd) };
+                Err(e)
+            },
+        }
+    }
+
+    /// Registers a UMEM with an AF_XDP socket, maps its rings and binds it.
+    fn setup(fd: libc::c_int, ifindex: u32, config: &XdpConfig) -> Result<Self, Fail> {
+        let umem: Umem = Umem::new(config.frame_count)?;
+        let umem_reg: xdp_umem_reg = xdp_umem_reg {
+            addr: umem.as_ptr() as u64,
+            len: umem.len() as u64,
+            chunk_size: UMEM_FRAME_SIZE as u32,
+            headroom: UMEM_FRAME_HEADROOM as u32,
+            ..Default::default()
+        };
+        Self::setsockopt(fd, XDP_UMEM_REG, &umem_reg)?;
+
+        // Rings are large enough to hold all frames that are lent to the kernel in either direction.
+        let rx_frames: usize = (config.frame_count / 2).max(1);
+        let ring_size: u32 = rx_frames.next_power_of_two() as u32;
+        for option in [XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING] {
+            Self::setsockopt(fd, option, &ring_size)?;
+        }
+
+        let mut offsets: xdp_mmap_offsets = xdp_mmap_offsets::default();
+        let mut optlen: libc::socklen_t = mem::size_of::<xdp_mmap_offsets>() as libc::socklen_t;
+        let ret: libc::c_int = unsafe {
+            libc::getsockopt(
+                fd,
+                SOL_XDP,
+                XDP_MMAP_OFFSETS,
+                &mut offsets as *mut xdp_mmap_offsets as *mut libc::c_void,
+                &mut optlen,
+            )
+        };
+        if ret == -1 {
+            return Err(Fail::new(errno::errno(), "failed to get ring offsets of AF_XDP socket"));
+        }
+
+        let rx: Ring<xdp_desc> = Ring::map(fd, &offsets.rx, ring_size, XDP_PGOFF_RX_RING)?;
+        let tx: Ring<xdp_desc> = Ring::map(fd, &offsets.tx, ring_size, XDP_PGOFF_TX_RING)?;
+        let fill: Ring<u64> = Ring::map(fd, &offsets.fr, ring_size, XDP_UMEM_PGOFF_FILL_RING)?;
+        let completion: Ring<u64> = Ring::map(fd, &offsets.cr, ring_size, XDP_UMEM_PGOFF_COMPLETION_RING)?;
+
+        // Fall back to copy mode if the driver does not support zero-copy mode.
+        if !config.zero_copy || Self::bind(fd, ifindex, config.queue_id, XDP_ZEROCOPY).is_err() {
+            if config.zero_copy {
+                warn!("driver does not support zero-copy AF_XDP sockets, falling back to copy mode");
+            }
+            Self::bind(fd, ifindex, config.queue_id, XDP_COPY)?;
+        }
+
+        match config.xsk_map {
+            Some(ref path) => Self::register(fd, path, config.queue_id)?,
+            None => warn!("no XSKMAP configured, the AF_XDP socket only receives packets if registered elsewhere"),
+        }
+
+        let mut socket: Self = Self {
+            fd,
+            rx,
+            tx,
+            fill,
+            completion,
+            umem,
+            rx_frames: 0,
+            rx_target: rx_frames,
+            tx_in_place: (0..config.frame_count).map(|_| None).collect(),
+            tx_pending: 0,
+            tx_pending_bytes: 0,
+        };
+        socket.refill();
+        Ok(socket)
+    }
+
+    /// Receives up to `max` packets from the target AF_XDP socket, handing each of them to `f`. Packets are not copied,
+    /// but rather lent to `f` along with their frames, which go back to the kernel once released. Returns the number of
+    /// packets received.
+    pub fn receive<F: FnMut(DataBuffer)>(&mut self, max: usize, mut f: F) -> usize {
+        let umem: &mut Umem = &mut self.umem;
+        let nreceived: usize = self.rx.consume(max, |desc| {
+            let offset: usize = (desc.addr - Umem::frame(desc.addr)) as usize - UMEM_FRAME_HEADROOM;
+            let mut dbuf: DataBuffer = umem.loan(desc.addr);
+            dbuf.adjust(offset);
+            dbuf.trim(UMEM_FRAME_DATA_LEN - offset - desc.len as usize);
+            f(dbuf);
+        });
+        self.rx_frames -= nreceived;
+
+        // Hand frames that were released since the last call back to the kernel, in a single batch.
+        self.umem.reclaim();
+        self.refill();
+
+        // The kernel stops receiving when it runs out of frames, until it is woken up.
+        if nreceived == 0 && self.fill.needs_wakeup() {
+            unsafe {
+                libc::recvfrom(
+                    self.fd,
+                    ptr::null_mut(),
+                    0,
+                    libc::MSG_DONTWAIT,
+                    ptr::null_mut(),
+                    ptr::null_mut(),
+                )
+            };
+        }
+
+        nreceived
+    }
+
+    /// Stages a packet of `len` bytes for transmission, which `write` fills in. Staged packets are sent on the next
+    /// call to [XdpSocket::flush], or once a batch of them builds up.
+    pub fn transmit<F: FnOnce(&mut [u8])>(&mut self, len: usize, write: F) -> Result<(), Fail> {
+        if len > UMEM_FRAME_DATA_LEN {
+            return Err(Fail::new(libc::EMSGSIZE, "packet does not fit in a UMEM frame"));
+        }
+
+        let addr: u64 = match self.umem.alloc_frame() {
+            Some(addr) => addr,
+            None => {
+                self.reclaim();
+                match self.umem.alloc_frame() {
+                    Some(addr) => addr,
+                    None => return Err(Fail::new(libc::ENOBUFS, "no free UMEM frames")),
+                }
+            },
+        };
+        let addr: u64 = addr + UMEM_FRAME_HEADROOM as u64;
+        write(self.umem.slice_mut(addr, len));
+
+        if let Err(e) = self.stage(addr, len) {
+            self.umem.free_frame(addr);
+            return Err(e);
+        }
+        Ok(())
+    }
+
+    /// Checks if a packet with `header_size` bytes of headers in front of `body` can be transmitted in place. This is
+    /// the case if `body` starts right where buffers of the target AF_XDP socket do, and no other packet is in flight
+    /// from the same frame, since headers are written in front of `body`.
+    pub fn can_transmit_in_place(&self, header_size: usize, body: &[u8]) -> bool {
+        let addr: u64 = match self.umem.lookup(body.as_ptr()) {
+            Some(addr) => addr,
+            None => return false,
+        };
+        let frame: u64 = Umem::frame(addr);
+        header_size <= XDP_TX_HEADROOM
+            && addr - frame == (UMEM_FRAME_HEADROOM + XDP_TX_HEADROOM) as u64
+            && self.tx_in_place[frame as usize / UMEM_FRAME_SIZE].is_none()
+    }
+
+    /// Stages a packet for transmission without copying its body, which `write_header` prefixes with `header_size`
+    /// bytes of headers. The body is kept until the packet is sent. [XdpSocket::can_transmit_in_place] must hold.
+    pub fn transmit_in_place<F: FnOnce(&mut [u8])>(
+        &mut self,
+        header_size: usize,
+        body: DataBuffer,
+        write_header: F,
+    ) -> Result<(), Fail> {
+        debug_assert!(self.can_transmit_in_place(header_size, &body));
+        // The body lies in the UMEM, thus this does not fail.
+        let addr: u64 = self.umem.lookup(body.as_ptr()).unwrap() - header_size as u64;
+        write_header(self.umem.slice_mut(addr, header_size));
+
+        self.stage(addr, header_size + body.len())?;
+        self.tx_in_place[addr as usize / UMEM_FRAME_SIZE] = Some(body);
+        Ok(())
+    }
+
+    /// Returns the largest buffer that can be allocated from the target AF_XDP socket.
+    pub fn buffer_capacity(&self) -> usize {
+        UMEM_FRAME_DATA_LEN - XDP_TX_HEADROOM
+    }
+
+    /// Allocates a buffer of `size` bytes from a frame of the target AF_XDP socket, after `init` fills it in. Returns
+    /// `None` if `size` is zero or larger than [XdpSocket::buffer_capacity], or if there are no free frames.
+    pub fn alloc_buffer<F: FnOnce(&mut [u8])>(&mut self, size: usize, init: F) -> Option<DataBuffer> {
+        if size == 0 || size > self.buffer_capacity() {
+            return None;
+        }
+        let frame: u64 = match self.umem.alloc_frame() {
+            Some(frame) => frame,
+            None => {
+                self.umem.reclaim();
+                self.umem.alloc_frame()?
+            },
+        };
+        init(
+            self.umem
+                .slice_mut(frame + (UMEM_FRAME_HEADROOM + XDP_TX_HEADROOM) as u64, size),
+        );
+
+        let mut dbuf: DataBuffer = self.umem.loan(frame);
+        dbuf.adjust(XDP_TX_HEADROOM);
+        dbuf.trim(self.buffer_capacity() - size);
+        Some(dbuf)
+    }
+
+    /// Takes an additional reference to the `len` bytes at `ptr`, and returns them as a data buffer. Returns `None` if
+    /// these bytes do not lie in a frame that the target AF_XDP socket has lent out.
+    pub fn share_buffer(&self, ptr: *const u8, len: usize) -> Option<DataBuffer> {
+        let addr: u64 = self.umem.lookup(ptr)?;
+        let frame: u64 = Umem::frame(addr);
+        let offset: usize = (addr - frame) as usize;
+        if offset < UMEM_FRAME_HEADROOM || offset + len > UMEM_FRAME_SIZE {
+            return None;
+        }
+        let mut dbuf: DataBuffer = self.umem.share(addr)?;
+        dbuf.adjust(offset - UMEM_FRAME_HEADROOM);
+        dbuf.trim(dbuf.len() - len);
+        Some(dbuf)
+    }
+
+    /// Releases a reference to a frame that was leaked from a buffer (e.g. by a scatter-gather array), and whose data
+    /// starts at `ptr`. Frames that are no longer referenced go back to the fill ring right away, if it needs them.
+    /// Returns `false` if `ptr` does not lie in a frame of the target AF_XDP socket, and fails if it lies in a frame
+    /// that is not lent out.
+    pub fn release_buffer(&mut self, ptr: *const u8) -> Result<bool, Fail> {
+        let addr: u64 = match self.umem.lookup(ptr) {
+            Some(addr) => addr,
+            None => return Ok(false),
+        };
+        if self.umem.release(addr)? {
+            self.refill();
+        }
+        Ok(true)
+    }
+
+    /// Hands free frames to the kernel through the fill ring, until it holds as many frames as it should for
+    /// reception.
+    fn refill(&mut self) {
+        let mut frames: Vec<u64> = Vec::new();
+        while self.rx_frames + frames.len() < self.rx_target {
+            match self.umem.alloc_frame() {
+                Some(frame) => frames.push(frame),
+                None => break,
+            }
+        }
+        if frames.is_empty() {
+            return;
+        }
+
+        let nfilled: usize = self.fill.produce(&frames);
+        for frame in &frames[nfilled..] {
+            self.umem.free_frame(*frame);
+        }
+        self.rx_frames += nfilled;
+    }
+
+    /// Stages a packet of `len` bytes at `addr` in the TX ring and wakes the kernel up once a batch of packets builds
+    /// up.
+    fn stage(&mut self, addr: u64, len: usize) -> Result<(), Fail> {
+        let desc: xdp_desc = xdp_desc {
+            addr,
+            len: len as u32,
+            options: 0,
+        };
+        if self.tx.produce(&[desc]) == 0 {
+            return Err(Fail::new(libc::EAGAIN, "TX ring is full"));
+        }
+
+        self.tx_pending += 1;
+        self.tx_pending_bytes += len;
+        if self.tx_pending >= XDP_TX_BATCH_SIZE {
+            self.flush();
+        }
+        Ok(())
+    }
+
+    /// Wakes the kernel up to send staged packets, if it needs to, and reclaims frames whose packets were sent.
+    pub fn flush(&mut self) {
+        if self.tx_pending > 0 {
+            if self.tx.needs_wakeup() {
+                let ret: isize = unsafe { libc::sendto(self.fd, ptr::null(), 0, libc::MSG_DONTWAIT, ptr::null(), 0) };
+                if ret == -1 {
+                    match errno::errno() {
+                        // The kernel is still busy with a previous batch, and it picks this one up afterwards.
+                        libc::EAGAIN | libc::EBUSY | libc::ENOBUFS => (),
+                        e => warn!("failed to wake up AF_XDP socket (errno={:?})", e),
+                    }
+                }
+            }
+            stats::record_tx_burst(self.tx_pending, self.tx_pending_bytes);
+            self.tx_pending = 0;
+            self.tx_pending_bytes = 0;
+        }
+        self.reclaim();
+    }
+
+    /// Gives frames whose packets were sent back to the UMEM. Frames of packets that were transmitted in place remain
+    /// lent out, until the buffers that they back are released.
+    fn reclaim(&mut self) {
+        let umem: &mut Umem = &mut self.umem;
+        let tx_in_place: &mut Vec<Option<DataBuffer>> = &mut self.tx_in_place;
+        self.completion.consume(usize::MAX, |addr| {
+            if tx_in_place[addr as usize / UMEM_FRAME_SIZE].take().is_none() {
+                umem.free_frame(addr);
+            }
+        });
+    }
+
+    /// Binds an AF_XDP socket to a queue of a network interface.
+    fn bind(fd: libc::c_int, ifindex: u32, queue_id: u32, mode: u16) -> Result<(), Fail> {
+        let addr: sockaddr_xdp = sockaddr_xdp {
+            sxdp_family: AF_XDP as u16,
+            sxdp_flags: mode | XDP_USE_NEED_WAKEUP,
+            sxdp_ifindex: ifindex,
+            sxdp_queue_id: queue_id,
+            sxdp_shared_umem_fd: 0,
+        };
+        let ret: libc::c_int = unsafe {
+            libc::bind(
+                fd,
+                &addr as *const sockaddr_xdp as *const libc::sockaddr,
+                mem::size_of::<sockaddr_xdp>() as libc::socklen_t,
+            )
+        };
+        if ret == -1 {
+            return Err(Fail::new(errno::errno(), "failed to bind AF_XDP socket"));
+        }
+        Ok(())
+    }
+
+    /// Registers an AF_XDP socket for a queue in the pinned XSKMAP at `path`.
+    fn register(fd: libc::c_int, path: &str, queue_id: u32) -> Result<(), Fail> {
+        let pathname: CString = match CString::new(path) {
+            Ok(pathname) => pathname,
+            Err(_) => return Err(Fail::new(libc::EINVAL, "invalid XSKMAP path")),
+        };
+        let obj_get: bpf_obj_get_attr = bpf_obj_get_attr {
+            pathname: pathname.as_ptr() as u64,
+            ..Default::default()
+        };
+        let map_fd: libc::c_long = unsafe {
+            libc::syscall(
+                libc::SYS_bpf,
+                BPF_OBJ_GET,
+                &obj_get as *const bpf_obj_get_attr,
+                mem::size_of::<bpf_obj_get_attr>(),
+            )
+        };
+        if map_fd == -1 {
+            return Err(Fail::new(errno::errno(), "failed to open XSKMAP"));
+        }
+
+        let value: u32 = fd as u32;
+        let map_update: bpf_map_update_attr = bpf_map_update_attr {
+            map_fd: map_fd as u32,
+            key: &queue_id as *const u32 as u64,
+            value: &value as *const u32 as u64,
+            ..Default::default()
+        };
+        let ret: libc::c_long = unsafe {
+            libc::syscall(
+                libc::SYS_bpf,
+                BPF_MAP_UPDATE_ELEM,
+                &map_update as *const bpf_map_update_attr,
+                mem::size_of::<bpf_map_update_attr>(),
+            )
+        };
+        let e: i32 = errno::errno();
+        unsafe { libc::close(map_fd as libc::c_int) };
+        if ret == -1 {
+            return Err(Fail::new(e, "failed to register AF_XDP socket in XSKMAP"));
+        }
+        Ok(())
+    }
+
+    /// Sets an option of an AF_XDP socket.
+    fn setsockopt<T>(fd: libc::c_int, option: libc::c_int, value: &T) -> Result<(), Fail> {
+        let ret: libc::c_int = unsafe {
+            libc::setsockopt(
+                fd,
+                SOL_XDP,
+                option,
+                value as *const T as *const libc::c_void,
+                mem::size_of::<T>() as libc::socklen_t,
+            )
+        };
+        if ret == -1 {
+            return Err(Fail::new(errno::errno(), "failed to set option of AF_XDP socket"));
+        }
+        Ok(())
+    }
+}
+
+//======================================================================================================================
+// Trait Implementations
+//======================================================================================================================
+
+/// Drop Trait Implementation for AF_XDP Sockets
+impl Drop for XdpSocket {
+    fn drop(&mut self) {
+        // Buffers that are transmitted in place hold references to frames of the UMEM, which goes away first.
+        self.tx_in_place.clear();
+        unsafe { libc::close(self.fd) };
+    }
+}
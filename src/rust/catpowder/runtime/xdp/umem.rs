@@ -0,0 +1,244 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::runtime::{
+    fail::Fail,
+    memory::{
+        DataBuffer,
+        Mapping,
+        SlotRegion,
+    },
+};
+use ::std::slice;
+
+//======================================================================================================================
+// Constants
+//======================================================================================================================
+
+/// Size of a UMEM frame.
+pub const UMEM_FRAME_SIZE: usize = 4096;
+
+/// Headroom at the start of each UMEM frame, which the kernel leaves alone.
+pub const UMEM_FRAME_HEADROOM: usize = 64;
+
+/// Number of bytes of a UMEM frame that hold packet data.
+pub const UMEM_FRAME_DATA_LEN: usize = UMEM_FRAME_SIZE - UMEM_FRAME_HEADROOM;
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// UMEM
+///
+/// Region of memory that is registered with an AF_XDP socket, and that is split into equally-sized frames. The NIC
+/// writes received packets into frames that we hand to it through the fill ring, and it reads packets to transmit from
+/// frames that we hand to it through the TX ring. In zero-copy mode, the NIC does so by DMA.
+///
+/// Frames may also be lent to the application as [DataBuffer]s, be it to hand out received packets without copying
+/// them or to back scatter-gather arrays. A lent frame is reclaimed once all references to it are dropped, and the
+/// region stays mapped until then, even if the UMEM itself is dropped first.
+pub struct Umem {
+    /// Base address of the region.
+    addr: *mut u8,
+    /// Length of the region.
+    len: usize,
+    /// Frames, which own the region.
+    frames: SlotRegion,
+    /// Addresses of frames that are owned by neither the kernel, a ring, nor the application.
+    free: Vec<u64>,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for UMEMs
+impl Umem {
+    /// Allocates a UMEM with `frame_count` frames.
+    pub fn new(frame_count: usize) -> Result<Self, Fail> {
+        if frame_count == 0 {
+            return Err(Fail::new(libc::EINVAL, "UMEM must have at least one frame"));
+        }
+
+        let len: usize = frame_count * UMEM_FRAME_SIZE;
+        let memory: Mapping = Mapping::new(len, libc::MAP_POPULATE)?;
+
+        Ok(Self {
+            addr: memory.as_ptr(),
+            len,
+            frames: SlotRegion::new(memory, frame_count, UMEM_FRAME_SIZE, UMEM_FRAME_HEADROOM),
+            free: (0..frame_count as u64)
+                .rev()
+                .map(|i| i * UMEM_FRAME_SIZE as u64)
+                .collect(),
+        })
+    }
+
+    /// Returns the base address of the target UMEM.
+    pub fn as_ptr(&self) -> *mut u8 {
+        self.addr
+    }
+
+    /// Returns the length of the target UMEM.
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Returns the number of free frames in the target UMEM.
+    pub fn nfree(&self) -> usize {
+        self.free.len()
+    }
+
+    /// Takes a free frame from the target UMEM.
+    pub fn alloc_frame(&mut self) -> Option<u64> {
+        self.free.pop()
+    }
+
+    /// Gives a frame back to the target UMEM. `addr` may point anywhere inside the frame.
+    pub fn free_frame(&mut self, addr: u64) {
+        self.free.push(Self::frame(addr));
+    }
+
+    /// Returns the address of the frame that contains `addr`.
+    pub fn frame(addr: u64) -> u64 {
+        addr & !(UMEM_FRAME_SIZE as u64 - 1)
+    }
+
+    /// Returns the address of the byte at `ptr` in the target UMEM, if it lies there.
+    pub fn lookup(&self, ptr: *const u8) -> Option<u64> {
+        self.frames.lookup(ptr)?;
+        Some(ptr as u64 - self.addr as u64)
+    }
+
+    /// Lends the data of the frame that contains `addr` to the application. The frame is reclaimed once all references
+    /// to it are dropped.
+    pub fn loan(&mut self, addr: u64) -> DataBuffer {
+        self.frames.share(Self::index(addr))
+    }
+
+    /// Takes an additional reference to the frame that contains `addr`, which must be lent out. Returns `None` if the
+    /// frame is not lent out.
+    pub fn share(&self, addr: u64) -> Option<DataBuffer> {
+        let index: usize = Self::index(addr);
+        if self.frames.is_shared(index) {
+            Some(self.frames.share(index))
+        } else {
+            None
+        }
+    }
+
+    /// Drops a reference to the frame that contains `addr`, that the application leaked from a data buffer. Returns
+    /// `true` if the frame is free afterwards, and fails if the frame is not lent out.
+    pub fn release(&mut self, addr: u64) -> Result<bool, Fail> {
+        if !self.frames.release(Self::index(addr))? {
+            return Ok(false);
+        }
+        self.reclaim();
+        Ok(true)
+    }
+
+    /// Gives back lent frames that are no longer referenced to the target UMEM.
+    pub fn reclaim(&mut self) {
+        let free: &mut Vec<u64> = &mut self.free;
+        self.frames.reclaim(|index| free.push((index * UMEM_FRAME_SIZE) as u64));
+    }
+
+    /// Returns `len` bytes of the target UMEM for modification, starting at `addr`.
+    pub fn slice_mut(&mut self, addr: u64, len: usize) -> &mut [u8] {
+        assert!(addr as usize + len <= self.len, "slice past end of UMEM");
+        unsafe { slice::from_raw_parts_mut(self.addr.add(addr as usize), len) }
+    }
+
+    /// Returns the index of the frame that contains `addr`.
+    fn index(addr: u64) -> usize {
+        addr as usize / UMEM_FRAME_SIZE
+    }
+}
+
+//======================================================================================================================
+// Unit Tests
+//======================================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        Umem,
+        UMEM_FRAME_DATA_LEN,
+        UMEM_FRAME_HEADROOM,
+        UMEM_FRAME_SIZE,
+    };
+    use crate::runtime::memory::DataBuffer;
+
+    /// Tests that frames are handed out at frame boundaries, and that addresses inside a frame map back to it.
+    #[test]
+    fn test_umem_frames() {
+        let mut umem: Umem = Umem::new(4).unwrap();
+        assert_eq!(umem.len(), 4 * UMEM_FRAME_SIZE);
+
+        let frames: Vec<u64> = (0..4).map(|_| umem.alloc_frame().unwrap()).collect();
+        assert_eq!(frames, vec![0, 4096, 8192, 12288]);
+        assert!(umem.alloc_frame().is_none());
+
+        umem.free_frame(8192 + 300);
+        assert_eq!(umem.alloc_frame(), Some(8192));
+        assert_eq!(Umem::frame(4095), 0);
+        assert_eq!(Umem::frame(4096), 4096);
+
+        let inside: *const u8 = unsafe { umem.as_ptr().add(4096 + 10) };
+        assert_eq!(umem.lookup(inside), Some(4096 + 10));
+        let outside: *const u8 = umem.as_ptr().wrapping_add(4 * UMEM_FRAME_SIZE);
+        assert_eq!(umem.lookup(outside), None);
+    }
+
+    /// Tests that a lent frame is only reclaimed once all references to it are dropped.
+    #[test]
+    fn test_umem_loan() {
+        let mut umem: Umem = Umem::new(2).unwrap();
+        let frame: u64 = umem.alloc_frame().unwrap();
+        let dbuf: DataBuffer = umem.loan(frame + 500);
+        assert_eq!(dbuf.len(), UMEM_FRAME_DATA_LEN);
+        assert_eq!(umem.lookup(dbuf.as_ptr()), Some(frame + UMEM_FRAME_HEADROOM as u64));
+
+        let shared: DataBuffer = umem.share(frame + 1000).unwrap();
+        drop(dbuf);
+        umem.reclaim();
+        assert_eq!(umem.nfree(), 1);
+        drop(shared);
+        umem.reclaim();
+        assert_eq!(umem.nfree(), 2);
+        assert!(umem.share(frame).is_none());
+    }
+
+    /// Tests that a frame goes back to the UMEM once the application releases the last reference that it leaked.
+    #[test]
+    fn test_umem_release() {
+        let mut umem: Umem = Umem::new(1).unwrap();
+        let frame: u64 = umem.alloc_frame().unwrap();
+        let a: DataBuffer = umem.loan(frame);
+        let b: DataBuffer = umem.loan(frame);
+        let (a_ptr, _): (*const u8, *const u8) = DataBuffer::into_raw_parts(a).unwrap();
+        DataBuffer::into_raw_parts(b).unwrap();
+
+        let addr: u64 = umem.lookup(a_ptr).unwrap();
+        assert!(!umem.release(addr).unwrap());
+        assert_eq!(umem.nfree(), 0);
+        assert!(umem.release(addr).unwrap());
+        assert_eq!(umem.alloc_frame(), Some(frame));
+        assert!(umem.release(addr).is_err());
+    }
+
+    /// Tests that lent frames stay mapped after the UMEM is dropped.
+    #[test]
+    fn test_umem_drop_with_loans() {
+        let mut umem: Umem = Umem::new(1).unwrap();
+        let frame: u64 = umem.alloc_frame().unwrap();
+        let mut dbuf: DataBuffer = umem.loan(frame);
+        dbuf[0] = 42;
+        drop(umem);
+        assert_eq!(dbuf[0], 42);
+    }
+}
@@ -190,6 +190,15 @@ where
         false
     }
 
+    /// Peeks the target ring buffer and returns how many items it holds. As the other end runs concurrently, this is a
+    /// lower bound for the reader, and an upper bound for the writer.
+    #[allow(unused)]
+    pub fn len(&self) -> usize {
+        let front_cached: usize = self.get_front();
+        let back_cached: usize = self.get_back();
+        back_cached.wrapping_sub(front_cached) & self.mask
+    }
+
     /// Attempts to insert an item at the back of the target ring buffer.
     #[allow(unused)]
     pub fn try_enqueue(&self, item: T) -> Result<(), T> {
@@ -256,10 +265,11 @@ where
         }
     }
 
-    /// Atomically gets the `front` index.
+    /// Atomically gets the `front` index. This synchronizes with the reader that set it, so that it has finished
+    /// reading the items that it released.
     fn get_front(&self) -> usize {
         let front: &mut AtomicUsize = AtomicUsize::from_mut(unsafe { &mut *self.front_ptr });
-        let front_cached: usize = front.load(atomic::Ordering::Relaxed);
+        let front_cached: usize = front.load(atomic::Ordering::Acquire);
         front_cached
     }
 
@@ -267,13 +277,14 @@ where
     #[allow(unused)]
     fn set_front(&self, val: usize) {
         let front: &AtomicUsize = AtomicUsize::from_mut(unsafe { &mut *self.front_ptr });
-        front.store(val, atomic::Ordering::Relaxed);
+        front.store(val, atomic::Ordering::Release);
     }
 
-    /// Atomically gets the `back` index.
+    /// Atomically gets the `back` index. This synchronizes with the writer that set it, so that the items that it
+    /// inserted, and whatever was written before them, are visible.
     fn get_back(&self) -> usize {
         let back: &mut AtomicUsize = AtomicUsize::from_mut(unsafe { &mut *self.back_ptr });
-        let back_cached: usize = back.load(atomic::Ordering::Relaxed);
+        let back_cached: usize = back.load(atomic::Ordering::Acquire);
         back_cached
     }
 
@@ -281,7 +292,7 @@ where
     #[allow(unused)]
     fn set_back(&self, val: usize) {
         let back: &AtomicUsize = AtomicUsize::from_mut(unsafe { &mut *self.back_ptr });
-        back.store(val, atomic::Ordering::Relaxed);
+        back.store(val, atomic::Ordering::Release);
     }
 }
 
@@ -368,6 +379,7 @@ mod test {
         // Check if buffer state is consistent.
         assert!(ring.is_empty() == false);
         assert!(ring.is_full() == true);
+        assert!(ring.len() == ring.capacity());
 
         // Remove items from the ring buffer.
         for i in 0..ring.capacity() {
@@ -378,6 +390,7 @@ mod test {
         // Check if buffer state is consistent.
         assert!(ring.is_empty() == true);
         assert!(ring.is_full() == false);
+        assert!(ring.len() == 0);
     }
 
     /// Tests if we succeed to create a ring buffer with a valid capacity.
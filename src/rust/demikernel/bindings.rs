@@ -6,19 +6,27 @@
 //======================================================================================================================
 
 use crate::{
-    demikernel::libos::{
-        name::LibOSName,
-        LibOS,
+    demikernel::{
+        libos::{
+            name::LibOSName,
+            LibOS,
+        },
+        shard,
     },
     runtime::{
         fail::Fail,
         logging,
+        stats,
         types::{
             demi_qresult_t,
             demi_qtoken_t,
             demi_sgarray_t,
             demi_sgaseg_t,
+            demi_stats_t,
+            DEMI_QTOKEN_INVALID,
+            DEMI_SGARRAY_MAXLEN,
         },
+        QDesc,
         QToken,
     },
 };
@@ -31,6 +39,7 @@ use ::libc::{
 };
 use ::std::{
     cell::RefCell,
+    ffi::CStr,
     mem,
     net::{
         Ipv4Addr,
@@ -48,9 +57,16 @@ use ::std::{
 // DEMIKERNEL
 //======================================================================================================================
 
-/// Demikernel state.
+/// Demikernel state, which serves the whole process unless the configuration runs one LibOS instance per thread.
 static mut DEMIKERNEL: RefCell<Option<LibOS>> = RefCell::new(None);
 
+thread_local! {
+    /// Demikernel state of the calling thread, when the configuration runs one LibOS instance per thread (see
+    /// [crate::demikernel::config::Config::sharded]). Then, each thread that calls [demi_init] gets its own LibOS
+    /// instance, so that a multi-queue libOS can run one instance per core.
+    static DEMIKERNEL_SHARD: RefCell<Option<LibOS>> = RefCell::new(None);
+}
+
 //======================================================================================================================
 // init
 //======================================================================================================================
@@ -61,6 +77,12 @@ pub extern "C" fn demi_init(argc: c_int, argv: *mut *mut c_char) -> c_int {
     logging::initialize();
     trace!("demi_init()");
 
+    // Dump profiling information on demand, from a running process.
+    #[cfg(feature = "profiler")]
+    if let Err(e) = crate::perftools::profiler::install_dump_handler(libc::SIGUSR1) {
+        warn!("failed to install profiler dump handler: {:?}", e.cause);
+    }
+
     let libos_name: LibOSName = match LibOSName::from_env() {
         Ok(libos_name) => libos_name.into(),
         Err(e) => panic!("{:?}", e),
@@ -75,7 +97,7 @@ pub extern "C" fn demi_init(argc: c_int, argv: *mut *mut c_char) -> c_int {
         },
     };
 
-    unsafe { DEMIKERNEL = RefCell::new(Some(libos)) };
+    with_demikernel(|demikernel| *demikernel.borrow_mut() = Some(libos));
 
     0
 }
@@ -106,6 +128,76 @@ pub extern "C" fn demi_socket(qd_out: *mut c_int, domain: c_int, socket_type: c_
     }
 }
 
+//======================================================================================================================
+// create_pipe
+//======================================================================================================================
+
+#[no_mangle]
+pub extern "C" fn demi_create_pipe(memqd_out: *mut c_int, name: *const c_char) -> c_int {
+    trace!("demi_create_pipe()");
+
+    // Get name of pipe.
+    let name: &str = match pipe_name(name) {
+        Ok(name) => name,
+        Err(e) => {
+            warn!("create_pipe() failed: {:?}", e);
+            return e.errno;
+        },
+    };
+
+    // Issue create_pipe operation.
+    let ret: Result<i32, Fail> = do_syscall(|libos| match libos.create_pipe(name) {
+        Ok(qd) => {
+            unsafe { *memqd_out = qd.into() };
+            0
+        },
+        Err(e) => {
+            warn!("create_pipe() failed: {:?}", e);
+            e.errno
+        },
+    });
+
+    match ret {
+        Ok(ret) => ret,
+        Err(e) => e.errno,
+    }
+}
+
+//======================================================================================================================
+// open_pipe
+//======================================================================================================================
+
+#[no_mangle]
+pub extern "C" fn demi_open_pipe(memqd_out: *mut c_int, name: *const c_char) -> c_int {
+    trace!("demi_open_pipe()");
+
+    // Get name of pipe.
+    let name: &str = match pipe_name(name) {
+        Ok(name) => name,
+        Err(e) => {
+            warn!("open_pipe() failed: {:?}", e);
+            return e.errno;
+        },
+    };
+
+    // Issue open_pipe operation.
+    let ret: Result<i32, Fail> = do_syscall(|libos| match libos.open_pipe(name) {
+        Ok(qd) => {
+            unsafe { *memqd_out = qd.into() };
+            0
+        },
+        Err(e) => {
+            warn!("open_pipe() failed: {:?}", e);
+            e.errno
+        },
+    });
+
+    match ret {
+        Ok(ret) => ret,
+        Err(e) => e.errno,
+    }
+}
+
 //======================================================================================================================
 // bind
 //======================================================================================================================
@@ -393,6 +485,84 @@ pub extern "C" fn demi_pop(qtok_out: *mut demi_qtoken_t, qd: c_int) -> c_int {
     }
 }
 
+//======================================================================================================================
+// push_many
+//======================================================================================================================
+
+#[no_mangle]
+pub extern "C" fn demi_push_many(
+    qts_out: *mut demi_qtoken_t,
+    qds: *const c_int,
+    sgas: *const demi_sgarray_t,
+    n: c_int,
+) -> c_int {
+    trace!("demi_push_many() {:?} {:?} {:?} {:?}", qts_out, qds, sgas, n);
+
+    // Check arguments.
+    if n <= 0 || qts_out.is_null() || qds.is_null() || sgas.is_null() {
+        return libc::EINVAL;
+    }
+
+    // Get queue descriptors, scatter-gather arrays and store locations for queue tokens.
+    let qds: &[c_int] = unsafe { slice::from_raw_parts(qds, n as usize) };
+    let sgas: &[demi_sgarray_t] = unsafe { slice::from_raw_parts(sgas, n as usize) };
+    let qts: &mut [QToken] = unsafe { slice::from_raw_parts_mut(qts_out as *mut QToken, n as usize) };
+
+    // Issue push operations.
+    let ret: Result<i32, Fail> = do_syscall(|libos| match libos.push_many(qds, sgas, qts) {
+        Ok(()) => 0,
+        Err(e) => {
+            warn!("push_many() failed: {:?}", e);
+            e.errno
+        },
+    });
+
+    match ret {
+        Ok(ret) => ret,
+        Err(e) => {
+            // No operation was issued.
+            qts.fill(QToken::from(DEMI_QTOKEN_INVALID));
+            e.errno
+        },
+    }
+}
+
+//======================================================================================================================
+// pop_many
+//======================================================================================================================
+
+#[no_mangle]
+pub extern "C" fn demi_pop_many(qts_out: *mut demi_qtoken_t, qds: *const c_int, n: c_int) -> c_int {
+    trace!("demi_pop_many() {:?} {:?} {:?}", qts_out, qds, n);
+
+    // Check arguments.
+    if n <= 0 || qts_out.is_null() || qds.is_null() {
+        return libc::EINVAL;
+    }
+
+    // Get queue descriptors and store locations for queue tokens.
+    let qds: &[c_int] = unsafe { slice::from_raw_parts(qds, n as usize) };
+    let qts: &mut [QToken] = unsafe { slice::from_raw_parts_mut(qts_out as *mut QToken, n as usize) };
+
+    // Issue pop operations.
+    let ret: Result<i32, Fail> = do_syscall(|libos| match libos.pop_many(qds, qts) {
+        Ok(()) => 0,
+        Err(e) => {
+            warn!("pop_many() failed: {:?}", e);
+            e.errno
+        },
+    });
+
+    match ret {
+        Ok(ret) => ret,
+        Err(e) => {
+            // No operation was issued.
+            qts.fill(QToken::from(DEMI_QTOKEN_INVALID));
+            e.errno
+        },
+    }
+}
+
 //======================================================================================================================
 // timedwait
 //======================================================================================================================
@@ -412,19 +582,7 @@ pub extern "C" fn demi_timedwait(
     }
 
     // Convert timespec to SystemTime.
-    let abstime: Option<SystemTime> = {
-        if abstime.is_null() {
-            None
-        } else {
-            let timeout: Duration = Duration::from_nanos(
-                unsafe { (*abstime).tv_sec } as u64 * 1_000_000_000_ + unsafe { (*abstime).tv_nsec } as u64,
-            );
-            match SystemTime::UNIX_EPOCH.checked_add(timeout) {
-                Some(abstime) => Some(abstime),
-                None => Some(SystemTime::now()),
-            }
-        }
-    };
+    let abstime: Option<SystemTime> = timespec_to_systemtime(abstime);
 
     // Issue operation.
     let ret: Result<i32, Fail> = do_syscall(|libos| match libos.timedwait(qt.into(), abstime) {
@@ -519,6 +677,51 @@ pub extern "C" fn demi_wait_any(
     }
 }
 
+//======================================================================================================================
+// wait_many
+//======================================================================================================================
+
+#[no_mangle]
+pub extern "C" fn demi_wait_many(
+    qrs_out: *mut demi_qresult_t,
+    nready: *mut c_int,
+    qts: *const demi_qtoken_t,
+    num_qts: c_int,
+    abstime: *const libc::timespec,
+) -> c_int {
+    trace!("demi_wait_many() {:?} {:?} {:?} {:?}", qrs_out, qts, num_qts, abstime);
+
+    // Check arguments.
+    if num_qts <= 0 || qrs_out.is_null() || nready.is_null() || qts.is_null() {
+        return libc::EINVAL;
+    }
+
+    // Get queue tokens and result slots. Queue tokens are transparent over raw ones, so no copy is needed here.
+    let qts: &[QToken] = unsafe { slice::from_raw_parts(qts as *const QToken, num_qts as usize) };
+    let qrs: &mut [demi_qresult_t] = unsafe { slice::from_raw_parts_mut(qrs_out, num_qts as usize) };
+
+    // Convert timespec to SystemTime. A null timeout means that we should wait indefinitely.
+    let abstime: Option<SystemTime> = timespec_to_systemtime(abstime);
+
+    // Issue wait_many operation.
+    let ret: Result<i32, Fail> = do_syscall(|libos| match libos.wait_many(qts, qrs, abstime) {
+        Ok(n) => {
+            unsafe { *nready = n as c_int };
+            0
+        },
+        Err(e) => {
+            warn!("wait_many() failed: {:?}", e);
+            unsafe { *nready = 0 };
+            e.errno
+        },
+    });
+
+    match ret {
+        Ok(ret) => ret,
+        Err(e) => e.errno,
+    }
+}
+
 //======================================================================================================================
 // sgaalloc
 //======================================================================================================================
@@ -534,7 +737,7 @@ pub extern "C" fn demi_sgaalloc(size: libc::size_t) -> demi_sgarray_t {
             sga_segs: [demi_sgaseg_t {
                 sgaseg_buf: ptr::null_mut() as *mut c_void,
                 sgaseg_len: 0,
-            }; 1],
+            }; DEMI_SGARRAY_MAXLEN],
             sga_addr: unsafe { mem::zeroed() },
         }
     };
@@ -626,18 +829,94 @@ pub extern "C" fn demi_getsockopt(
     libc::ENOSYS
 }
 
+//======================================================================================================================
+// getstats
+//======================================================================================================================
+
+#[no_mangle]
+pub extern "C" fn demi_getstats(qd: c_int, stats_out: *mut demi_stats_t) -> c_int {
+    trace!("demi_getstats()");
+
+    // Check arguments.
+    if stats_out.is_null() {
+        warn!("getstats() failed: invalid storage location");
+        return libc::EINVAL;
+    }
+
+    // Issue getstats operation.
+    let ret: Result<i32, Fail> = do_syscall(|libos| match libos.getstats(qd.into()) {
+        Ok(stats) => {
+            unsafe { *stats_out = stats };
+            0
+        },
+        Err(e) => {
+            warn!("getstats() failed: {:?}", e);
+            e.errno
+        },
+    });
+
+    match ret {
+        Ok(ret) => ret,
+        Err(e) => e.errno,
+    }
+}
+
+//======================================================================================================================
+// getstats_global
+//======================================================================================================================
+
+#[no_mangle]
+pub extern "C" fn demi_getstats_global(stats_out: *mut demi_stats_t) -> c_int {
+    trace!("demi_getstats_global()");
+
+    // Check arguments.
+    if stats_out.is_null() {
+        warn!("getstats_global() failed: invalid storage location");
+        return libc::EINVAL;
+    }
+
+    // Statistics of all threads are readable from any thread, even one that runs no LibOS.
+    unsafe { *stats_out = stats::global() };
+
+    0
+}
+
 //======================================================================================================================
 // Standalone Functions
 //======================================================================================================================
 
 /// Issues a system call.
 fn do_syscall<T>(f: impl FnOnce(&mut LibOS) -> T) -> Result<T, Fail> {
-    match unsafe { DEMIKERNEL.try_borrow_mut() } {
+    with_demikernel(|demikernel| match demikernel.try_borrow_mut() {
         Ok(mut libos) => match libos.as_mut() {
             Some(libos) => Ok(f(libos)),
             None => Err(Fail::new(libc::ENOSYS, "Demikernel is not initialized")),
         },
         Err(_) => Err(Fail::new(libc::EBUSY, "Demikernel is busy")),
+    })
+}
+
+/// Runs `f` on the Demikernel state that serves the calling thread.
+fn with_demikernel<T>(f: impl FnOnce(&RefCell<Option<LibOS>>) -> T) -> T {
+    if shard::is_sharded() {
+        DEMIKERNEL_SHARD.with(f)
+    } else {
+        f(unsafe { &DEMIKERNEL })
+    }
+}
+
+/// Converts a [libc::timespec] into a [SystemTime]. Returns `None` if `abstime` is a null pointer.
+fn timespec_to_systemtime(abstime: *const libc::timespec) -> Option<SystemTime> {
+    if abstime.is_null() {
+        None
+    } else {
+        let timeout: Duration = Duration::from_nanos(
+            unsafe { (*abstime).tv_sec } as u64 * 1_000_000_000_ + unsafe { (*abstime).tv_nsec } as u64,
+        );
+        match SystemTime::UNIX_EPOCH.checked_add(timeout) {
+            Some(abstime) => Some(abstime),
+            None => Some(SystemTime::now()),
+        }
     }
 }
 
@@ -653,6 +932,17 @@ fn sockaddr_to_socketaddrv4(saddr: *const sockaddr) -> Result<SocketAddrV4, Fail
     Ok(SocketAddrV4::new(addr, port))
 }
 
+/// Converts a C string into the name of a pipe.
+fn pipe_name<'a>(name: *const c_char) -> Result<&'a str, Fail> {
+    if name.is_null() {
+        return Err(Fail::new(libc::EINVAL, "invalid pipe name"));
+    }
+    match unsafe { CStr::from_ptr(name) }.to_str() {
+        Ok(name) => Ok(name),
+        Err(_) => Err(Fail::new(libc::EINVAL, "pipe name is not valid UTF-8")),
+    }
+}
+
 #[test]
 fn test_sockaddr_to_socketaddrv4() {
     // TODO: assign something meaningful to sa_family and check it once we support V6 addresses as well.
@@ -5,6 +5,10 @@
 // Imports
 //======================================================================================================================
 
+use crate::runtime::{
+    fail::Fail,
+    memory::SlabConfig,
+};
 use ::std::{
     fs::File,
     io::Read,
@@ -41,6 +45,54 @@ impl Config {
         Self { 0: config_obj.clone() }
     }
 
+    /// Reads the "shard CPUs" parameter from the underlying configuration file. This should be a list of CPU numbers.
+    pub fn shard_cpus(&self) -> Result<Option<Vec<u32>>, Fail> {
+        let cpus: &Vec<Yaml> = match &self.0["demikernel"]["shard_cpus"] {
+            Yaml::BadValue => return Ok(None),
+            Yaml::Array(cpus) => cpus,
+            _ => return Err(Fail::new(libc::EINVAL, "shard_cpus should be a list")),
+        };
+        let mut shard_cpus: Vec<u32> = Vec::with_capacity(cpus.len());
+        for cpu in cpus {
+            match cpu.as_i64().and_then(|cpu| u32::try_from(cpu).ok()) {
+                Some(cpu) => shard_cpus.push(cpu),
+                None => {
+                    return Err(Fail::new(
+                        libc::EINVAL,
+                        "shard_cpus should only list non-negative integers",
+                    ))
+                },
+            }
+        }
+        Ok(Some(shard_cpus))
+    }
+
+    /// Checks if the configuration runs one LibOS instance per thread, i.e. if it lists shard CPUs or asks catnip for
+    /// several queues. Otherwise, a single LibOS instance serves the whole process.
+    pub fn sharded(&self) -> Result<bool, Fail> {
+        let has_shard_cpus: bool = self.shard_cpus()?.map_or(false, |cpus| !cpus.is_empty());
+        let has_queues: bool = self.0["catnip"]["num_queues"].as_i64().map_or(false, |n| n > 1);
+        Ok(has_shard_cpus || has_queues)
+    }
+
+    /// Reads the "slab" parameters from the underlying configuration file, which size the chunks and classes of the
+    /// slab allocator that backs scatter-gather arrays. Slab classes are only backed by huge pages if asked for.
+    pub fn slab_config(&self) -> SlabConfig {
+        let default: SlabConfig = SlabConfig::default();
+        let size = |key: &str, default: usize| -> usize {
+            self.0["demikernel"][key]
+                .as_i64()
+                .map_or(default, |n| n.max(0) as usize)
+        };
+        SlabConfig {
+            chunk_size: size("slab_chunk_size", default.chunk_size),
+            max_class_size: size("slab_max_class_size", default.max_class_size),
+            huge_pages: self.0["demikernel"]["slab_huge_pages"]
+                .as_bool()
+                .unwrap_or(default.huge_pages),
+        }
+    }
+
     /// Reads the local IPv4 address parameter from the underlying configuration file.
     #[cfg(any(feature = "catnip-libos", feature = "catpowder-libos"))]
     pub fn local_ipv4_addr(&self) -> ::std::net::Ipv4Addr {
@@ -59,4 +111,117 @@ impl Config {
         }
         local_ipv4_addr
     }
+
+    /// Reads the "RX burst size" parameter from the underlying configuration file.
+    #[cfg(any(feature = "catnip-libos", feature = "catpowder-libos"))]
+    pub fn rx_burst_size(&self) -> Option<usize> {
+        // FIXME: Change the follow key from "catnip" to "demikernel".
+        self.0["catnip"]["rx_burst_size"].as_i64().map(|n| n.max(0) as usize)
+    }
+
+    /// Reads the "RX burst adaptive" parameter from the underlying configuration file.
+    #[cfg(any(feature = "catnip-libos", feature = "catpowder-libos"))]
+    pub fn rx_burst_adaptive(&self) -> Option<bool> {
+        // FIXME: Change the follow key from "catnip" to "demikernel".
+        self.0["catnip"]["rx_burst_adaptive"].as_bool()
+    }
+
+    /// Reads the "TCP selective acknowledgement" parameter from the underlying configuration file.
+    #[cfg(any(feature = "catnip-libos", feature = "catpowder-libos"))]
+    pub fn tcp_selective_ack(&self) -> Option<bool> {
+        // FIXME: Change the follow key from "catnip" to "demikernel".
+        self.0["catnip"]["tcp_selective_ack"].as_bool()
+    }
+
+    /// Reads the "TCP congestion control" parameter from the underlying configuration file.
+    #[cfg(any(feature = "catnip-libos", feature = "catpowder-libos"))]
+    pub fn tcp_congestion_control(&self) -> Option<crate::runtime::network::config::CongestionControlAlgorithm> {
+        use crate::runtime::network::config::CongestionControlAlgorithm;
+
+        // FIXME: Change the follow key from "catnip" to "demikernel".
+        match self.0["catnip"]["tcp_congestion_control"].as_str() {
+            Some("none") => Some(CongestionControlAlgorithm::None),
+            Some("cubic") => Some(CongestionControlAlgorithm::Cubic),
+            Some("bbr") => Some(CongestionControlAlgorithm::Bbr),
+            None => None,
+            Some(algorithm) => panic!("Invalid congestion control algorithm ({:?})", algorithm),
+        }
+    }
+
+    /// Reads the "TCP receive coalescing" parameter from the underlying configuration file.
+    #[cfg(any(feature = "catnip-libos", feature = "catpowder-libos"))]
+    pub fn tcp_receive_coalescing(&self) -> Option<bool> {
+        // FIXME: Change the follow key from "catnip" to "demikernel".
+        self.0["catnip"]["tcp_receive_coalescing"].as_bool()
+    }
+
+    /// Reads the "timer backend" parameter from the underlying configuration file, defaulting to a pairing heap.
+    #[cfg(any(feature = "catnip-libos", feature = "catpowder-libos"))]
+    pub fn timer_backend(&self) -> crate::runtime::timer::TimerBackend {
+        use crate::runtime::timer::TimerBackend;
+
+        // FIXME: Change the follow key from "catnip" to "demikernel".
+        match self.0["catnip"]["timer_backend"].as_str() {
+            Some("wheel") => TimerBackend::Wheel,
+            Some("heap") | None => TimerBackend::Heap,
+            Some(backend) => panic!("Invalid timer backend ({:?})", backend),
+        }
+    }
+}
+
+//======================================================================================================================
+// Unit Tests
+//======================================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::Config;
+    use crate::runtime::memory::SlabConfig;
+    use ::yaml_rust::YamlLoader;
+
+    /// Parses a configuration from a string.
+    fn parse(config_s: &str) -> Config {
+        Config(YamlLoader::load_from_str(config_s).unwrap().remove(0))
+    }
+
+    #[test]
+    fn test_shard_cpus() {
+        assert_eq!(parse("demikernel: {}").shard_cpus().unwrap(), None);
+        assert_eq!(
+            parse("demikernel: {shard_cpus: []}").shard_cpus().unwrap(),
+            Some(vec![])
+        );
+        assert_eq!(
+            parse("demikernel: {shard_cpus: [0, 3]}").shard_cpus().unwrap(),
+            Some(vec![0, 3])
+        );
+        assert!(parse("demikernel: {shard_cpus: [0, -1]}").shard_cpus().is_err());
+        assert!(parse("demikernel: {shard_cpus: [0, 1.5]}").shard_cpus().is_err());
+        assert!(parse("demikernel: {shard_cpus: [0, \"1\"]}").shard_cpus().is_err());
+        assert!(parse("demikernel: {shard_cpus: 1}").shard_cpus().is_err());
+    }
+
+    #[test]
+    fn test_sharded() {
+        assert!(!parse("demikernel: {}").sharded().unwrap());
+        assert!(!parse("demikernel: {shard_cpus: []}\ncatnip: {num_queues: 1}")
+            .sharded()
+            .unwrap());
+        assert!(parse("demikernel: {shard_cpus: [0]}").sharded().unwrap());
+        assert!(parse("demikernel: {}\ncatnip: {num_queues: 2}").sharded().unwrap());
+    }
+
+    #[test]
+    fn test_slab_config() {
+        let config: SlabConfig = parse("demikernel: {}").slab_config();
+        assert!(!config.huge_pages);
+        assert_eq!(config.chunk_size, 2 * 1024 * 1024);
+
+        let config: SlabConfig =
+            parse("demikernel: {slab_chunk_size: 65536, slab_max_class_size: 1048576, slab_huge_pages: true}")
+                .slab_config();
+        assert!(config.huge_pages);
+        assert_eq!(config.chunk_size, 65536);
+        assert_eq!(config.max_class_size, 1048576);
+    }
 }
@@ -0,0 +1,171 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::runtime::{
+    fail::Fail,
+    types::{
+        demi_qresult_t,
+        demi_sgarray_t,
+        demi_stats_t,
+    },
+    QDesc,
+    QToken,
+};
+use ::std::{
+    fmt::Debug,
+    time::SystemTime,
+};
+
+#[cfg(feature = "catmem-libos")]
+use crate::catmem::CatmemLibOS;
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Memory LIBOS.
+pub enum MemoryLibOS {
+    #[cfg(feature = "catmem-libos")]
+    Catmem(CatmemLibOS),
+}
+
+//======================================================================================================================
+// Associated Functions
+//======================================================================================================================
+
+/// Associated functions for memory LibOSes.
+impl MemoryLibOS {
+    /// Creates a named pipe.
+    pub fn create_pipe(&mut self, name: &str) -> Result<QDesc, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.create_pipe(name),
+        }
+    }
+
+    /// Opens a named pipe.
+    pub fn open_pipe(&mut self, name: &str) -> Result<QDesc, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.open_pipe(name),
+        }
+    }
+
+    /// Closes a pipe.
+    pub fn close(&mut self, memqd: QDesc) -> Result<(), Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.close(memqd),
+        }
+    }
+
+    /// Pushes a scatter-gather array to a pipe.
+    pub fn push(&mut self, memqd: QDesc, sga: &demi_sgarray_t) -> Result<QToken, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.push(memqd, sga),
+        }
+    }
+
+    /// Pushes raw data to a pipe.
+    pub fn push2(&mut self, memqd: QDesc, data: &[u8]) -> Result<QToken, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.push2(memqd, data),
+        }
+    }
+
+    /// Pops data from a pipe.
+    pub fn pop(&mut self, memqd: QDesc) -> Result<QToken, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.pop(memqd),
+        }
+    }
+
+    /// Pushes scatter-gather arrays to several pipes at once.
+    pub fn push_many<Q: Copy + Debug + Into<QDesc>>(
+        &mut self,
+        qds: &[Q],
+        sgas: &[demi_sgarray_t],
+        qts: &mut [QToken],
+    ) -> Result<(), Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.push_many(qds, sgas, qts),
+        }
+    }
+
+    /// Pops data from several pipes at once.
+    pub fn pop_many<Q: Copy + Debug + Into<QDesc>>(&mut self, qds: &[Q], qts: &mut [QToken]) -> Result<(), Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.pop_many(qds, qts),
+        }
+    }
+
+    /// Waits for a pending operation in a pipe.
+    pub fn wait(&mut self, qt: QToken) -> Result<demi_qresult_t, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.wait(qt),
+        }
+    }
+
+    /// Waits for an I/O operation to complete or a timeout to expire.
+    pub fn timedwait(&mut self, qt: QToken, abstime: Option<SystemTime>) -> Result<demi_qresult_t, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.timedwait(qt, abstime),
+        }
+    }
+
+    /// Waits for any operation in a pipe.
+    pub fn wait_any(&mut self, qts: &[QToken]) -> Result<(usize, demi_qresult_t), Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.wait_any(qts),
+        }
+    }
+
+    /// Waits for at least one operation in a set of pipes to complete and drains all completed ones.
+    pub fn wait_many(
+        &mut self,
+        qts: &[QToken],
+        qrs: &mut [demi_qresult_t],
+        abstime: Option<SystemTime>,
+    ) -> Result<usize, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.wait_many(qts, qrs, abstime),
+        }
+    }
+
+    /// Allocates a scatter-gather array.
+    pub fn sgaalloc(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.sgaalloc(size),
+        }
+    }
+
+    /// Releases a scatter-gather array.
+    pub fn sgafree(&self, sga: demi_sgarray_t) -> Result<(), Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.sgafree(sga),
+        }
+    }
+
+    /// Retrieves statistics of an I/O queue.
+    pub fn getstats(&self, qd: QDesc) -> Result<demi_stats_t, Fail> {
+        match self {
+            #[cfg(feature = "catmem-libos")]
+            MemoryLibOS::Catmem(libos) => libos.getstats(qd),
+        }
+    }
+}
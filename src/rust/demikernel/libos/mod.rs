@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+pub mod memory;
 pub mod name;
 pub mod network;
 
@@ -9,6 +10,7 @@ pub mod network;
 //======================================================================================================================
 
 use self::{
+    memory::MemoryLibOS,
     name::LibOSName,
     network::{
         NetworkLibOS,
@@ -16,13 +18,17 @@ use self::{
     },
 };
 use crate::{
-    demikernel::config::Config,
+    demikernel::{
+        config::Config,
+        shard,
+    },
     runtime::{
         fail::Fail,
         logging,
         types::{
             demi_qresult_t,
             demi_sgarray_t,
+            demi_stats_t,
         },
         QDesc,
         QToken,
@@ -30,12 +36,15 @@ use crate::{
 };
 use ::std::{
     env,
+    fmt::Debug,
     net::SocketAddrV4,
     time::SystemTime,
 };
 
 #[cfg(feature = "catcollar-libos")]
 use crate::catcollar::CatcollarLibOS;
+#[cfg(feature = "catmem-libos")]
+use crate::catmem::CatmemLibOS;
 #[cfg(feature = "catnap-libos")]
 use crate::catnap::CatnapLibOS;
 #[cfg(feature = "catnip-libos")]
@@ -51,6 +60,8 @@ use crate::catpowder::CatpowderLibOS;
 pub enum LibOS {
     /// Network LibOS
     NetworkLibOS(NetworkLibOS),
+    /// Memory LibOS
+    MemoryLibOS(MemoryLibOS),
 }
 
 //======================================================================================================================
@@ -75,6 +86,10 @@ impl LibOS {
         };
         let config: Config = Config::new(config_path);
 
+        // Register this thread as a shard, so that the LibOS instance is set up on the right core.
+        let shard_id: usize = shard::register(&config)?;
+        trace!("registered shard {:?}", shard_id);
+
         // Instantiate LibOS.
         #[allow(unreachable_patterns)]
         let libos: LibOS = match libos_name {
@@ -86,6 +101,8 @@ impl LibOS {
             LibOSName::Catpowder => Self::NetworkLibOS(NetworkLibOS::Catpowder(CatpowderLibOS::new(&config))),
             #[cfg(feature = "catnip-libos")]
             LibOSName::Catnip => Self::NetworkLibOS(NetworkLibOS::Catnip(CatnipLibOS::new(&config))),
+            #[cfg(feature = "catmem-libos")]
+            LibOSName::Catmem => Self::MemoryLibOS(MemoryLibOS::Catmem(CatmemLibOS::new(&config))),
             _ => panic!("unsupported libos"),
         };
 
@@ -97,6 +114,7 @@ impl LibOS {
     pub fn wait_any2(&mut self, qts: &[QToken]) -> Result<(usize, QDesc, OperationResult), Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.wait_any2(qts),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -105,6 +123,7 @@ impl LibOS {
     pub fn wait2(&mut self, qt: QToken) -> Result<(QDesc, OperationResult), Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.wait2(qt),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -117,6 +136,7 @@ impl LibOS {
     ) -> Result<QDesc, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.socket(domain, socket_type, protocol),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -124,6 +144,7 @@ impl LibOS {
     pub fn bind(&mut self, sockqd: QDesc, local: SocketAddrV4) -> Result<(), Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.bind(sockqd, local),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -131,6 +152,7 @@ impl LibOS {
     pub fn listen(&mut self, sockqd: QDesc, backlog: usize) -> Result<(), Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.listen(sockqd, backlog),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -138,6 +160,7 @@ impl LibOS {
     pub fn accept(&mut self, sockqd: QDesc) -> Result<QToken, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.accept(sockqd),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -145,13 +168,31 @@ impl LibOS {
     pub fn connect(&mut self, sockqd: QDesc, remote: SocketAddrV4) -> Result<QToken, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.connect(sockqd, remote),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
+        }
+    }
+
+    /// Creates a named pipe.
+    pub fn create_pipe(&mut self, name: &str) -> Result<QDesc, Fail> {
+        match self {
+            LibOS::NetworkLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by network libOS")),
+            LibOS::MemoryLibOS(libos) => libos.create_pipe(name),
+        }
+    }
+
+    /// Opens a named pipe.
+    pub fn open_pipe(&mut self, name: &str) -> Result<QDesc, Fail> {
+        match self {
+            LibOS::NetworkLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by network libOS")),
+            LibOS::MemoryLibOS(libos) => libos.open_pipe(name),
         }
     }
 
-    /// Closes a socket.
+    /// Closes an I/O queue.
     pub fn close(&mut self, qd: QDesc) -> Result<(), Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.close(qd),
+            LibOS::MemoryLibOS(libos) => libos.close(qd),
         }
     }
 
@@ -159,6 +200,7 @@ impl LibOS {
     pub fn push(&mut self, qd: QDesc, sga: &demi_sgarray_t) -> Result<QToken, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.push(qd, sga),
+            LibOS::MemoryLibOS(libos) => libos.push(qd, sga),
         }
     }
 
@@ -167,6 +209,7 @@ impl LibOS {
     pub fn push2(&mut self, qd: QDesc, data: &[u8]) -> Result<QToken, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.push2(qd, data),
+            LibOS::MemoryLibOS(libos) => libos.push2(qd, data),
         }
     }
 
@@ -174,6 +217,7 @@ impl LibOS {
     pub fn pushto(&mut self, qd: QDesc, sga: &demi_sgarray_t, to: SocketAddrV4) -> Result<QToken, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.pushto(qd, sga, to),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -182,6 +226,7 @@ impl LibOS {
     pub fn pushto2(&mut self, qd: QDesc, data: &[u8], remote: SocketAddrV4) -> Result<QToken, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.pushto2(qd, data, remote),
+            LibOS::MemoryLibOS(_) => Err(Fail::new(libc::ENOTSUP, "operation not supported by memory libOS")),
         }
     }
 
@@ -189,6 +234,28 @@ impl LibOS {
     pub fn pop(&mut self, qd: QDesc) -> Result<QToken, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.pop(qd),
+            LibOS::MemoryLibOS(libos) => libos.pop(qd),
+        }
+    }
+
+    /// Pushes scatter-gather arrays to several I/O queues at once.
+    pub fn push_many<Q: Copy + Debug + Into<QDesc>>(
+        &mut self,
+        qds: &[Q],
+        sgas: &[demi_sgarray_t],
+        qts: &mut [QToken],
+    ) -> Result<(), Fail> {
+        match self {
+            LibOS::NetworkLibOS(libos) => libos.push_many(qds, sgas, qts),
+            LibOS::MemoryLibOS(libos) => libos.push_many(qds, sgas, qts),
+        }
+    }
+
+    /// Pops data from several I/O queues at once.
+    pub fn pop_many<Q: Copy + Debug + Into<QDesc>>(&mut self, qds: &[Q], qts: &mut [QToken]) -> Result<(), Fail> {
+        match self {
+            LibOS::NetworkLibOS(libos) => libos.pop_many(qds, qts),
+            LibOS::MemoryLibOS(libos) => libos.pop_many(qds, qts),
         }
     }
 
@@ -196,6 +263,7 @@ impl LibOS {
     pub fn wait(&mut self, qt: QToken) -> Result<demi_qresult_t, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.wait(qt),
+            LibOS::MemoryLibOS(libos) => libos.wait(qt),
         }
     }
 
@@ -203,6 +271,7 @@ impl LibOS {
     pub fn timedwait(&mut self, qt: QToken, abstime: Option<SystemTime>) -> Result<demi_qresult_t, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.timedwait(qt, abstime),
+            LibOS::MemoryLibOS(libos) => libos.timedwait(qt, abstime),
         }
     }
 
@@ -210,6 +279,20 @@ impl LibOS {
     pub fn wait_any(&mut self, qts: &[QToken]) -> Result<(usize, demi_qresult_t), Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.wait_any(qts),
+            LibOS::MemoryLibOS(libos) => libos.wait_any(qts),
+        }
+    }
+
+    /// Waits for at least one operation in a set of I/O queues to complete and drains all completed ones.
+    pub fn wait_many(
+        &mut self,
+        qts: &[QToken],
+        qrs: &mut [demi_qresult_t],
+        abstime: Option<SystemTime>,
+    ) -> Result<usize, Fail> {
+        match self {
+            LibOS::NetworkLibOS(libos) => libos.wait_many(qts, qrs, abstime),
+            LibOS::MemoryLibOS(libos) => libos.wait_many(qts, qrs, abstime),
         }
     }
 
@@ -217,6 +300,7 @@ impl LibOS {
     pub fn sgaalloc(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.sgaalloc(size),
+            LibOS::MemoryLibOS(libos) => libos.sgaalloc(size),
         }
     }
 
@@ -224,6 +308,15 @@ impl LibOS {
     pub fn sgafree(&self, sga: demi_sgarray_t) -> Result<(), Fail> {
         match self {
             LibOS::NetworkLibOS(libos) => libos.sgafree(sga),
+            LibOS::MemoryLibOS(libos) => libos.sgafree(sga),
+        }
+    }
+
+    /// Retrieves statistics of an I/O queue.
+    pub fn getstats(&self, qd: QDesc) -> Result<demi_stats_t, Fail> {
+        match self {
+            LibOS::NetworkLibOS(libos) => libos.getstats(qd),
+            LibOS::MemoryLibOS(libos) => libos.getstats(qd),
         }
     }
 }
@@ -18,6 +18,7 @@ pub enum LibOSName {
     Catnap,
     Catcollar,
     Catnip,
+    Catmem,
 }
 
 //======================================================================================================================
@@ -46,6 +47,7 @@ impl From<String> for LibOSName {
             "catnap" => LibOSName::Catnap,
             "catcollar" => LibOSName::Catcollar,
             "catnip" => LibOSName::Catnip,
+            "catmem" => LibOSName::Catmem,
             _ => panic!("unkown libos"),
         }
     }
@@ -10,11 +10,13 @@ use crate::runtime::{
     types::{
         demi_qresult_t,
         demi_sgarray_t,
+        demi_stats_t,
     },
     QDesc,
     QToken,
 };
 use ::std::{
+    fmt::Debug,
     net::SocketAddrV4,
     time::SystemTime,
 };
@@ -247,6 +249,39 @@ impl NetworkLibOS {
         }
     }
 
+    /// Pushes scatter-gather arrays to several I/O queues at once.
+    pub fn push_many<Q: Copy + Debug + Into<QDesc>>(
+        &mut self,
+        qds: &[Q],
+        sgas: &[demi_sgarray_t],
+        qts: &mut [QToken],
+    ) -> Result<(), Fail> {
+        match self {
+            #[cfg(feature = "catpowder-libos")]
+            NetworkLibOS::Catpowder(libos) => libos.push_many(qds, sgas, qts),
+            #[cfg(feature = "catnap-libos")]
+            NetworkLibOS::Catnap(libos) => libos.push_many(qds, sgas, qts),
+            #[cfg(feature = "catcollar-libos")]
+            NetworkLibOS::Catcollar(libos) => libos.push_many(qds, sgas, qts),
+            #[cfg(feature = "catnip-libos")]
+            NetworkLibOS::Catnip(libos) => libos.push_many(qds, sgas, qts),
+        }
+    }
+
+    /// Pops data from several I/O queues at once.
+    pub fn pop_many<Q: Copy + Debug + Into<QDesc>>(&mut self, qds: &[Q], qts: &mut [QToken]) -> Result<(), Fail> {
+        match self {
+            #[cfg(feature = "catpowder-libos")]
+            NetworkLibOS::Catpowder(libos) => libos.pop_many(qds, qts),
+            #[cfg(feature = "catnap-libos")]
+            NetworkLibOS::Catnap(libos) => libos.pop_many(qds, qts),
+            #[cfg(feature = "catcollar-libos")]
+            NetworkLibOS::Catcollar(libos) => libos.pop_many(qds, qts),
+            #[cfg(feature = "catnip-libos")]
+            NetworkLibOS::Catnip(libos) => libos.pop_many(qds, qts),
+        }
+    }
+
     /// Waits for a pending operation in an I/O queue.
     pub fn wait(&mut self, qt: QToken) -> Result<demi_qresult_t, Fail> {
         match self {
@@ -289,6 +324,25 @@ impl NetworkLibOS {
         }
     }
 
+    /// Waits for at least one operation in a set of I/O queues to complete and drains all completed ones.
+    pub fn wait_many(
+        &mut self,
+        qts: &[QToken],
+        qrs: &mut [demi_qresult_t],
+        abstime: Option<SystemTime>,
+    ) -> Result<usize, Fail> {
+        match self {
+            #[cfg(feature = "catpowder-libos")]
+            NetworkLibOS::Catpowder(libos) => libos.wait_many(qts, qrs, abstime),
+            #[cfg(feature = "catnap-libos")]
+            NetworkLibOS::Catnap(libos) => libos.wait_many(qts, qrs, abstime),
+            #[cfg(feature = "catcollar-libos")]
+            NetworkLibOS::Catcollar(libos) => libos.wait_many(qts, qrs, abstime),
+            #[cfg(feature = "catnip-libos")]
+            NetworkLibOS::Catnip(libos) => libos.wait_many(qts, qrs, abstime),
+        }
+    }
+
     /// Allocates a scatter-gather array.
     pub fn sgaalloc(&self, size: usize) -> Result<demi_sgarray_t, Fail> {
         match self {
@@ -316,4 +370,18 @@ impl NetworkLibOS {
             NetworkLibOS::Catnip(libos) => libos.sgafree(sga),
         }
     }
+
+    /// Retrieves statistics of an I/O queue.
+    pub fn getstats(&self, qd: QDesc) -> Result<demi_stats_t, Fail> {
+        match self {
+            #[cfg(feature = "catpowder-libos")]
+            NetworkLibOS::Catpowder(libos) => libos.getstats(qd),
+            #[cfg(feature = "catnap-libos")]
+            NetworkLibOS::Catnap(libos) => libos.getstats(qd),
+            #[cfg(feature = "catcollar-libos")]
+            NetworkLibOS::Catcollar(libos) => libos.getstats(qd),
+            #[cfg(feature = "catnip-libos")]
+            NetworkLibOS::Catnip(libos) => libos.getstats(qd),
+        }
+    }
 }
@@ -4,3 +4,4 @@
 pub mod bindings;
 pub mod config;
 pub mod libos;
+pub mod shard;
@@ -0,0 +1,125 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//! Scheduler shards.
+//!
+//! Each thread that runs a LibOS instance is a shard, with its own scheduler, and it may be pinned to a core. Only
+//! sharding is implemented: futures are not stolen across shards, as they capture `Rc` handles to the state of their
+//! LibOS instance and thus cannot move to another thread. Load is spread when connections are placed on shards.
+
+//======================================================================================================================
+// Imports
+//======================================================================================================================
+
+use crate::{
+    demikernel::config::Config,
+    pal::linux,
+    runtime::fail::Fail,
+};
+use ::std::{
+    cell::Cell,
+    sync::atomic::{
+        AtomicU8,
+        AtomicUsize,
+        Ordering,
+    },
+};
+
+//======================================================================================================================
+// Constants
+//======================================================================================================================
+
+/// No shard was registered yet, so whether the process is sharded is unknown.
+const SHARDING_UNSET: u8 = 0;
+
+/// A single LibOS instance serves the whole process.
+const SHARDING_OFF: u8 = 1;
+
+/// Each thread runs its own LibOS instance.
+const SHARDING_ON: u8 = 2;
+
+//======================================================================================================================
+// Global Variables
+//======================================================================================================================
+
+/// ID of the next shard.
+static NEXT_SHARD_ID: AtomicUsize = AtomicUsize::new(0);
+
+/// Does each thread run its own LibOS instance? This is set by the first shard, and then never changes.
+static SHARDING: AtomicU8 = AtomicU8::new(SHARDING_UNSET);
+
+thread_local! {
+    /// CPU that the shard of this thread is pinned to, if any.
+    static SHARD_CPU: Cell<Option<u32>> = Cell::new(None);
+}
+
+//======================================================================================================================
+// Standalone Functions
+//======================================================================================================================
+
+/// Registers the calling thread as a new shard. If the configuration is sharded, each thread that calls
+/// [crate::demikernel::bindings::demi_init] runs its own LibOS instance, with its own scheduler, so a shard owns all
+/// futures that it creates. If the configuration lists shard CPUs, the calling thread is pinned to the next one in
+/// round-robin order.
+pub fn register(config: &Config) -> Result<usize, Fail> {
+    let cpus: Option<Vec<u32>> = config.shard_cpus()?;
+    set_sharded(config.sharded()?)?;
+    let shard_id: usize = NEXT_SHARD_ID.fetch_add(1, Ordering::Relaxed);
+
+    if let Some(cpus) = cpus {
+        if !cpus.is_empty() {
+            let cpu: u32 = cpus[shard_id % cpus.len()];
+            if unsafe { linux::pin_to_cpu(cpu) } != 0 {
+                warn!("cannot pin shard {:?} to cpu {:?}", shard_id, cpu);
+            } else {
+                trace!("shard {:?} pinned to cpu {:?}", shard_id, cpu);
+                SHARD_CPU.with(|shard_cpu| shard_cpu.set(Some(cpu)));
+            }
+        }
+    }
+
+    Ok(shard_id)
+}
+
+/// Checks if each thread runs its own LibOS instance, as the configuration asks for (see [Config::sharded]).
+pub fn is_sharded() -> bool {
+    SHARDING.load(Ordering::Acquire) == SHARDING_ON
+}
+
+/// Returns the CPU that the shard of the calling thread is pinned to, if any.
+pub fn current_cpu() -> Option<u32> {
+    SHARD_CPU.with(|shard_cpu| shard_cpu.get())
+}
+
+/// Records whether each thread runs its own LibOS instance. Only the first shard sets it, as LibOS instances already
+/// live where it asked for, so later shards must agree with it.
+fn set_sharded(sharded: bool) -> Result<(), Fail> {
+    let sharding: u8 = if sharded { SHARDING_ON } else { SHARDING_OFF };
+    match SHARDING.compare_exchange(SHARDING_UNSET, sharding, Ordering::AcqRel, Ordering::Acquire) {
+        Ok(_) => Ok(()),
+        Err(current) if current == sharding => Ok(()),
+        Err(_) => Err(Fail::new(libc::EINVAL, "sharding differs from the first shard")),
+    }
+}
+
+//======================================================================================================================
+// Unit Tests
+//======================================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        is_sharded,
+        set_sharded,
+    };
+
+    /// Tests that sharding is set once, by the first shard.
+    #[test]
+    fn test_shard_set_sharded() {
+        assert!(set_sharded(false).is_ok());
+        assert!(set_sharded(false).is_ok());
+        assert!(!is_sharded());
+        assert_eq!(set_sharded(true).unwrap_err().errno, libc::EINVAL);
+        assert!(!is_sharded());
+    }
+}
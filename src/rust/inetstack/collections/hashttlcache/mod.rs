@@ -135,8 +135,8 @@ where
         })
     }
 
-    /// Collect dead entries in the cache.
-    pub fn cleanup(&mut self) {
+    /// Collect dead entries in the cache. Returns the number of entries that were collected.
+    pub fn cleanup(&mut self) -> usize {
         let mut dead_entries: Vec<K> = Vec::new();
 
         // Collect dead entries.
@@ -147,9 +147,12 @@ where
         }
 
         // Put dead_entries entries in the graveyard.
+        let ndead: usize = dead_entries.len();
         for k in dead_entries {
             let (k, v) = self.map.remove_entry(&k).unwrap();
             self.graveyard.insert(k, v.value);
         }
+
+        ndead
     }
 }
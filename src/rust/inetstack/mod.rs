@@ -36,7 +36,9 @@ use crate::{
             NetworkRuntime,
         },
         queue::IoQueueTable,
+        stats,
         timer::TimerRc,
+        types::demi_stats_t,
         QDesc,
         QToken,
         QType,
@@ -62,6 +64,7 @@ use ::std::{
     },
     rc::Rc,
     time::{
+        Duration,
         Instant,
         SystemTime,
     },
@@ -99,6 +102,8 @@ pub struct InetStack {
     scheduler: Scheduler,
     clock: TimerRc,
     ts_iters: usize,
+    /// Time since which the ongoing wait has found no work.
+    idle_since: Option<Instant>,
 }
 
 impl InetStack {
@@ -142,6 +147,7 @@ impl InetStack {
             scheduler,
             clock,
             ts_iters: 0,
+            idle_since: None,
         })
     }
 
@@ -363,6 +369,26 @@ impl InetStack {
         Ok(())
     }
 
+    /// Retrieves statistics of the LibOS instance that serves an I/O queue. Retransmissions and the depth of the
+    /// out-of-order queue are those of the connection, for TCP sockets, and zero otherwise.
+    pub fn getstats(&self, qd: QDesc) -> Result<demi_stats_t, Fail> {
+        trace!("getstats(): qd={:?}", qd);
+
+        let (retransmissions, ooo_depth): (u64, usize) = match self.file_table.get(qd) {
+            Some(qtype) => match QType::try_from(qtype) {
+                Ok(QType::TcpSocket) => self.ipv4.tcp.connection_stats(qd).unwrap_or((0, 0)),
+                Ok(QType::UdpSocket) => (0, 0),
+                _ => return Err(Fail::new(EINVAL, "invalid queue type")),
+            },
+            _ => return Err(Fail::new(EBADF, "bad queue descriptor")),
+        };
+
+        let mut stats: demi_stats_t = stats::local();
+        stats.retransmissions = retransmissions;
+        stats.ooo_depth = ooo_depth as u64;
+        Ok(stats)
+    }
+
     /// Pushes a buffer to a TCP socket.
     /// TODO: Rename this function to push() once we have a common representation across all libOSes.
     pub fn do_push(&mut self, qd: QDesc, buf: Buffer) -> Result<FutureOperation, Fail> {
@@ -479,6 +505,7 @@ impl InetStack {
             None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
         };
 
+        self.idle_since = None;
         loop {
             // Poll first, so as to give pending operations a chance to complete.
             self.poll_bg_work();
@@ -488,6 +515,8 @@ impl InetStack {
                 trace!("wait2() qt={:?} completed!", qt);
                 return Ok(self.take_operation(handle));
             }
+
+            self.idle(None);
         }
     }
 
@@ -503,6 +532,7 @@ impl InetStack {
             None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
         };
 
+        self.idle_since = None;
         loop {
             // Poll first, so as to give pending operations a chance to complete.
             self.poll_bg_work();
@@ -518,6 +548,8 @@ impl InetStack {
                 handle.take_key();
                 return Err(Fail::new(libc::ETIMEDOUT, "timer expired"));
             }
+
+            self.idle(abstime);
         }
     }
 
@@ -527,6 +559,7 @@ impl InetStack {
         timer!("inetstack::wait_any2");
         trace!("wait_any2(): qts={:?}", qts);
 
+        self.idle_since = None;
         loop {
             // Poll first, so as to give pending operations a chance to complete.
             self.poll_bg_work();
@@ -550,9 +583,57 @@ impl InetStack {
                 // (which would otherwise cause the operation to be freed).
                 handle.take_key();
             }
+
+            self.idle(None);
         }
     }
 
+    /// Waits for at least one operation to complete or a timeout to expire, and then hands out the results of all
+    /// operations that have completed by then. If `abstime` is `None`, this function blocks until some operation
+    /// completes. On success, the number of completed operations is returned.
+    pub fn wait_many2<F: FnMut(usize, QDesc, OperationResult)>(
+        &mut self,
+        qts: &[QToken],
+        abstime: Option<SystemTime>,
+        mut on_completion: F,
+    ) -> Result<usize, Fail> {
+        #[cfg(feature = "profiler")]
+        timer!("inetstack::wait_many2");
+        trace!("wait_many2(): qts={:?}, timeout={:?}", qts, abstime);
+
+        self.idle_since = None;
+        let scheduler: Scheduler = self.scheduler.clone();
+        scheduler.wait_many(
+            self,
+            qts,
+            abstime,
+            |inetstack: &mut Self| inetstack.poll_bg_work(),
+            |inetstack: &mut Self, abstime: Option<SystemTime>| inetstack.idle(abstime),
+            |inetstack: &mut Self, i: usize, handle: SchedulerHandle| {
+                let (qd, r): (QDesc, OperationResult) = inetstack.take_operation(handle);
+                on_completion(i, qd, r);
+            },
+        )
+    }
+
+    /// Lets the runtime save power between the polls of a wait that found no work, until `abstime`. Waits only become
+    /// idle once no task is ready to run, and they stop being idle whenever packets arrive.
+    fn idle(&mut self, abstime: Option<SystemTime>) {
+        if self.scheduler.has_ready() {
+            self.idle_since = None;
+            return;
+        }
+
+        let now: Instant = Instant::now();
+        let idle_since: Instant = *self.idle_since.get_or_insert(now);
+        let timeout: Option<Duration> =
+            abstime.map(|abstime| abstime.duration_since(SystemTime::now()).unwrap_or(Duration::ZERO));
+        self.rt.idle(now - idle_since, timeout);
+
+        // The runtime may have blocked, so advance the clock on the next poll for timers to fire on time.
+        self.ts_iters = 0;
+    }
+
     /// Given a handle representing a task in our scheduler. Return the results of this future
     /// and the file descriptor for this connection.
     ///
@@ -637,6 +718,13 @@ impl InetStack {
                     if batch.is_empty() {
                         break;
                     }
+                    self.idle_since = None;
+                    stats::record_rx_burst(batch.len(), batch.iter().map(|pkt| pkt.len()).sum());
+
+                    // Look up the flows of the whole batch ahead of time, so that cache misses overlap.
+                    for pkt in &batch {
+                        self.ipv4.tcp.prefetch(pkt);
+                    }
 
                     for pkt in batch {
                         if let Err(e) = self.do_receive(pkt) {
@@ -645,10 +733,21 @@ impl InetStack {
                         // TODO: This is a workaround for https://github.com/demikernel/inetstack/issues/149.
                         self.scheduler.poll();
                     }
+
+                    // Hand out segments that were coalesced during this batch.
+                    self.ipv4.tcp.flush_coalesced();
                 }
             }
         }
 
+        {
+            #[cfg(feature = "profiler")]
+            timer!("inetstack::poll_bg_work::flush");
+
+            // Hand out packets that were staged for transmission during this iteration.
+            self.rt.flush();
+        }
+
         if self.ts_iters == 0 {
             self.clock.advance_clock(Instant::now());
         }
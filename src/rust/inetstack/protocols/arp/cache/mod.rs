@@ -47,6 +47,10 @@ pub struct ArpCache {
 
     /// Disable ARP?
     disable: bool,
+
+    /// Number of times that address resolutions were changed or dropped. Users that hold on to resolutions compare it
+    /// to the generation that they resolved at to tell whether they are stale.
+    generation: u64,
 }
 
 //==============================================================================
@@ -64,6 +68,7 @@ impl ArpCache {
         let mut peer = ArpCache {
             cache: HashTtlCache::new(clock.now(), default_ttl),
             disable,
+            generation: 0,
         };
 
         // Populate cache.
@@ -78,8 +83,17 @@ impl ArpCache {
 
     /// Caches an address resolution.
     pub fn insert(&mut self, ipv4_addr: Ipv4Addr, link_addr: MacAddress) -> Option<MacAddress> {
+        // Collect expired address resolutions first, as the cache would otherwise drop them silently while inserting.
+        if self.cache.cleanup() > 0 {
+            self.generation += 1;
+        }
+
         let record = Record { link_addr };
-        self.cache.insert(ipv4_addr, record).map(|r| r.link_addr)
+        let old_link_addr: Option<MacAddress> = self.cache.insert(ipv4_addr, record).map(|r| r.link_addr);
+        if old_link_addr.map_or(false, |old_link_addr| old_link_addr != link_addr) {
+            self.generation += 1;
+        }
+        old_link_addr
     }
 
     /// Gets the MAC address of given IPv4 address.
@@ -100,6 +114,12 @@ impl ArpCache {
     #[allow(unused)]
     pub fn clear(&mut self) {
         self.cache.clear();
+        self.generation += 1;
+    }
+
+    /// Returns the generation of the ARP cache, which changes whenever an address resolution is changed or dropped.
+    pub fn generation(&self) -> u64 {
+        self.generation
     }
 
     // Exports address resolutions that are stored in the ARP cache.
@@ -66,3 +66,34 @@ fn export() {
         map.get_key_value(&test_helpers::ALICE_IPV4) == Some((&test_helpers::ALICE_IPV4, &test_helpers::ALICE_MAC))
     );
 }
+
+/// Tests that the generation of the ARP Cache changes when address resolutions change.
+#[test]
+fn generation() {
+    let now = Instant::now();
+    let ttl = Duration::from_secs(1);
+    let clock = TimerRc(Rc::new(Timer::new(now)));
+
+    // New address resolutions do not change the generation.
+    let mut cache = ArpCache::new(clock, Some(ttl), None, false);
+    cache.insert(test_helpers::ALICE_IPV4, test_helpers::ALICE_MAC);
+    assert_eq!(cache.generation(), 0);
+
+    // Refreshed address resolutions do not change the generation either.
+    cache.insert(test_helpers::ALICE_IPV4, test_helpers::ALICE_MAC);
+    assert_eq!(cache.generation(), 0);
+
+    // Changed and dropped address resolutions do.
+    cache.insert(test_helpers::ALICE_IPV4, test_helpers::BOB_MAC);
+    assert_eq!(cache.generation(), 1);
+    cache.clear();
+    assert_eq!(cache.generation(), 2);
+
+    // So do address resolutions that expire, once the cache collects them.
+    cache.insert(test_helpers::ALICE_IPV4, test_helpers::ALICE_MAC);
+    cache.advance_clock(now + ttl);
+    assert_eq!(cache.generation(), 2);
+    cache.insert(test_helpers::BOB_IPV4, test_helpers::BOB_MAC);
+    assert_eq!(cache.generation(), 3);
+    assert!(cache.get(test_helpers::ALICE_IPV4).is_none());
+}
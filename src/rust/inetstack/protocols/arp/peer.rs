@@ -241,6 +241,12 @@ impl ArpPeer {
         self.cache.borrow().get(ipv4_addr).cloned()
     }
 
+    /// Returns the generation of the ARP cache. Address resolutions that were obtained at an older generation may be
+    /// stale.
+    pub fn generation(&self) -> u64 {
+        self.cache.borrow().generation()
+    }
+
     pub fn query(&self, ipv4_addr: Ipv4Addr) -> impl Future<Output = Result<MacAddress, Fail>> {
         let rt = self.rt.clone();
         let mut arp = self.clone();
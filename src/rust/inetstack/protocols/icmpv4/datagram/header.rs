@@ -2,9 +2,12 @@
 // Licensed under the MIT license.
 
 use super::protocol::Icmpv4Type2;
-use crate::runtime::{
-    fail::Fail,
-    memory::Buffer,
+use crate::{
+    inetstack::protocols::ip::checksum::Checksum,
+    runtime::{
+        fail::Fail,
+        memory::Buffer,
+    },
 };
 use ::byteorder::{
     ByteOrder,
@@ -75,25 +78,12 @@ impl Icmpv4Header {
     }
 
     fn checksum(buf: &[u8; ICMPV4_HEADER_SIZE], body: &[u8]) -> u16 {
-        let mut state = 0xffffu32;
-        state += NetworkEndian::read_u16(&buf[0..2]) as u32;
+        let mut checksum: Checksum = Checksum::new();
+        checksum.add_bytes(&buf[0..2]);
         // Skip the checksum.
-        state += 0;
-        state += NetworkEndian::read_u16(&buf[4..6]) as u32;
-        state += NetworkEndian::read_u16(&buf[6..8]) as u32;
-
-        let mut chunks_iter = body.chunks_exact(2);
-        while let Some(chunk) = chunks_iter.next() {
-            state += NetworkEndian::read_u16(chunk) as u32;
-        }
-        if let Some(&b) = chunks_iter.remainder().get(0) {
-            state += NetworkEndian::read_u16(&[b, 0]) as u32;
-        }
-
-        while state > 0xFFFF {
-            state -= 0xFFFF;
-        }
-        !state as u16
+        checksum.add_bytes(&buf[4..8]);
+        checksum.add_bytes(body);
+        checksum.finish()
     }
 
     pub fn get_protocol(&self) -> Icmpv4Type2 {
@@ -0,0 +1,346 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use ::std::net::Ipv4Addr;
+
+#[cfg(target_arch = "x86_64")]
+use ::std::arch::x86_64::{
+    __m256i,
+    _mm256_add_epi32,
+    _mm256_cvtepu16_epi32,
+    _mm256_setzero_si256,
+    _mm256_storeu_si256,
+    _mm_loadu_si128,
+};
+
+#[cfg(all(target_arch = "aarch64", target_endian = "little"))]
+use ::std::arch::aarch64::{
+    uint32x4_t,
+    vaddlvq_u32,
+    vdupq_n_u32,
+    vld1q_u8,
+    vpadalq_u16,
+    vreinterpretq_u16_u8,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Number of bytes that vector kernels sum into 32-bit lanes before they widen them, so that lanes never overflow.
+#[cfg(any(target_arch = "x86_64", all(target_arch = "aarch64", target_endian = "little")))]
+const VECTOR_BLOCK_SIZE: usize = 64 * 1024;
+
+/// Inputs shorter than this are summed by the scalar kernel, as vector kernels don't pay off.
+#[cfg(any(target_arch = "x86_64", all(target_arch = "aarch64", target_endian = "little")))]
+const VECTOR_MIN_SIZE: usize = 64;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Internet Checksum (RFC 1071)
+///
+/// Accumulates the ones-complement sum of 16-bit big-endian words. Since the ones-complement sum does not depend on
+/// byte order (RFC 1071, section 2), bytes are summed as little-endian words by the widest kernel that the CPU supports
+/// (AVX2, NEON, or 64-bit scalar words) and the result is swapped back. Slices that are added to a checksum may have
+/// any length, so that data which is scattered across buffers can be summed one buffer at a time.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct Checksum {
+    /// Ones-complement sum of 16-bit big-endian words, not folded yet.
+    sum: u64,
+    /// Whether an odd number of bytes was added so far, so that the next byte is the low octet of a word.
+    odd: bool,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Internet Checksums
+impl Checksum {
+    /// Creates an empty checksum.
+    pub fn new() -> Self {
+        Self { sum: 0, odd: false }
+    }
+
+    /// Adds a 16-bit word to the target checksum.
+    pub fn add_u16(&mut self, word: u16) {
+        self.sum += word as u64;
+    }
+
+    /// Adds an IPv4 address to the target checksum.
+    pub fn add_ipv4_addr(&mut self, addr: Ipv4Addr) {
+        self.sum += u32::from(addr) as u64;
+    }
+
+    /// Adds the pseudo-IP header of a TCP or UDP segment (RFC 793, section 3.1) to the target checksum, without the
+    /// segment length.
+    pub fn add_pseudo_header(&mut self, src_addr: Ipv4Addr, dst_addr: Ipv4Addr, protocol: u8) {
+        self.add_ipv4_addr(src_addr);
+        self.add_ipv4_addr(dst_addr);
+        self.add_u16(protocol as u16);
+    }
+
+    /// Adds a slice of bytes to the target checksum. A trailing odd byte is padded with zero, unless more bytes follow.
+    pub fn add_bytes(&mut self, bytes: &[u8]) {
+        // Little-endian words that start at an odd offset are already big-endian words, shifted by one byte.
+        let sum: u16 = fold(sum_bytes(bytes));
+        self.sum += if self.odd { sum } else { sum.swap_bytes() } as u64;
+        self.odd ^= bytes.len() % 2 == 1;
+    }
+
+    /// Returns the ones-complement sum of the target checksum, folded to 16 bits but not complemented. This is what
+    /// NICs expect to find in the checksum field of packets whose checksum they complete.
+    pub fn fold(&self) -> u16 {
+        fold(self.sum)
+    }
+
+    /// Returns the value of the checksum field for the data that was added to the target checksum.
+    pub fn finish(&self) -> u16 {
+        !self.fold()
+    }
+}
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Updates a checksum field after a 16-bit word that it covers changed from `old` to `new`, without summing the rest
+/// of the data again (RFC 1624, equation 3).
+pub fn update_u16(checksum: u16, old: u16, new: u16) -> u16 {
+    let sum: u64 = (!checksum) as u64 + (!old) as u64 + new as u64;
+    !fold(sum)
+}
+
+/// Updates a checksum field after a 32-bit word that it covers (e.g. an IPv4 address or a sequence number) changed.
+pub fn update_u32(checksum: u16, old: u32, new: u32) -> u16 {
+    let checksum: u16 = update_u16(checksum, (old >> 16) as u16, (new >> 16) as u16);
+    update_u16(checksum, old as u16, new as u16)
+}
+
+/// Folds a ones-complement sum to 16 bits.
+fn fold(mut sum: u64) -> u16 {
+    while sum > 0xffff {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    sum as u16
+}
+
+/// Returns the ones-complement sum of a slice of bytes, as little-endian 16-bit words, using the widest kernel that
+/// the CPU supports.
+fn sum_bytes(bytes: &[u8]) -> u64 {
+    #[cfg(target_arch = "x86_64")]
+    if bytes.len() >= VECTOR_MIN_SIZE && is_x86_feature_detected!("avx2") {
+        return unsafe { sum_bytes_avx2(bytes) };
+    }
+
+    #[cfg(all(target_arch = "aarch64", target_endian = "little"))]
+    if bytes.len() >= VECTOR_MIN_SIZE {
+        return unsafe { sum_bytes_neon(bytes) };
+    }
+
+    sum_bytes_scalar(bytes)
+}
+
+/// Adds two 64-bit words in ones-complement arithmetic.
+fn add_with_carry(a: u64, b: u64) -> u64 {
+    let (sum, carry): (u64, bool) = a.overflowing_add(b);
+    sum + carry as u64
+}
+
+/// Scalar kernel, which sums 64-bit words with an end-around carry.
+fn sum_bytes_scalar(bytes: &[u8]) -> u64 {
+    let mut sum: u64 = 0;
+    let mut words = bytes.chunks_exact(8);
+    for word in &mut words {
+        sum = add_with_carry(sum, u64::from_le_bytes(word.try_into().unwrap()));
+    }
+
+    let mut tail = words.remainder().chunks_exact(2);
+    for word in &mut tail {
+        sum = add_with_carry(sum, u16::from_le_bytes([word[0], word[1]]) as u64);
+    }
+    if let Some(&byte) = tail.remainder().get(0) {
+        sum = add_with_carry(sum, byte as u64);
+    }
+    fold(sum) as u64
+}
+
+/// AVX2 kernel, which zero-extends 16-bit words into 32-bit lanes.
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx2")]
+unsafe fn sum_bytes_avx2(bytes: &[u8]) -> u64 {
+    let mut sum: u64 = 0;
+    let mut blocks = bytes.chunks(VECTOR_BLOCK_SIZE);
+    for block in &mut blocks {
+        let mut lanes: __m256i = _mm256_setzero_si256();
+        let mut vectors = block.chunks_exact(16);
+        for vector in &mut vectors {
+            let words = _mm_loadu_si128(vector.as_ptr() as *const _);
+            lanes = _mm256_add_epi32(lanes, _mm256_cvtepu16_epi32(words));
+        }
+
+        let mut partial: [u32; 8] = [0; 8];
+        _mm256_storeu_si256(partial.as_mut_ptr() as *mut __m256i, lanes);
+        sum += partial.iter().map(|lane| *lane as u64).sum::<u64>();
+        sum += sum_bytes_scalar(vectors.remainder());
+    }
+    sum
+}
+
+/// NEON kernel, which pairwise adds 16-bit words into 32-bit lanes.
+#[cfg(all(target_arch = "aarch64", target_endian = "little"))]
+#[target_feature(enable = "neon")]
+unsafe fn sum_bytes_neon(bytes: &[u8]) -> u64 {
+    let mut sum: u64 = 0;
+    for block in bytes.chunks(VECTOR_BLOCK_SIZE) {
+        let mut lanes: uint32x4_t = vdupq_n_u32(0);
+        let mut vectors = block.chunks_exact(16);
+        for vector in &mut vectors {
+            lanes = vpadalq_u16(lanes, vreinterpretq_u16_u8(vld1q_u8(vector.as_ptr())));
+        }
+        sum += vaddlvq_u32(lanes);
+        sum += sum_bytes_scalar(vectors.remainder());
+    }
+    sum
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        sum_bytes_scalar,
+        update_u16,
+        update_u32,
+        Checksum,
+    };
+    use ::test::{
+        black_box,
+        Bencher,
+    };
+
+    /// Reference implementation, which sums big-endian words one at a time.
+    fn reference(bytes: &[u8]) -> u16 {
+        let mut sum: u64 = 0;
+        for word in bytes.chunks(2) {
+            sum += ((word[0] as u64) << 8) | word.get(1).map_or(0, |byte| *byte as u64);
+        }
+        while sum > 0xffff {
+            sum = (sum & 0xffff) + (sum >> 16);
+        }
+        !(sum as u16)
+    }
+
+    fn checksum(bytes: &[u8]) -> u16 {
+        let mut checksum: Checksum = Checksum::new();
+        checksum.add_bytes(bytes);
+        checksum.finish()
+    }
+
+    fn payload(len: usize) -> Vec<u8> {
+        (0..len).map(|i| (i * 131 + 7) as u8).collect()
+    }
+
+    /// Tests the example of RFC 1071, section 3.
+    #[test]
+    fn test_checksum_rfc1071() {
+        let bytes: [u8; 8] = [0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7];
+        assert_eq!(!checksum(&bytes), 0xddf2);
+    }
+
+    /// Tests that all kernels match the reference implementation for any length and alignment.
+    #[test]
+    fn test_checksum_kernels() {
+        let bytes: Vec<u8> = payload(9000 + 16);
+        for offset in 0..16 {
+            for len in (0..300).chain([1499, 1500, 8999, 9000].iter().copied()) {
+                let bytes: &[u8] = &bytes[offset..(offset + len)];
+                assert_eq!(checksum(bytes), reference(bytes), "offset={} len={}", offset, len);
+            }
+        }
+
+        // Many large words make the scalar kernel carry.
+        let bytes: Vec<u8> = vec![0xff; 4096];
+        assert_eq!(checksum(&bytes), reference(&bytes));
+    }
+
+    /// Tests that checksums of data that is added in pieces match the checksum of the whole data.
+    #[test]
+    fn test_checksum_pieces() {
+        let bytes: Vec<u8> = payload(1501);
+        let mut pieces: Checksum = Checksum::new();
+        pieces.add_bytes(&bytes[..20]);
+        pieces.add_bytes(&bytes[20..1000]);
+        pieces.add_bytes(&bytes[1000..]);
+        assert_eq!(pieces.finish(), reference(&bytes));
+
+        // Pieces of odd length.
+        for len in [1, 7, 333] {
+            let mut pieces: Checksum = Checksum::new();
+            for piece in bytes.chunks(len) {
+                pieces.add_bytes(piece);
+            }
+            assert_eq!(pieces.finish(), reference(&bytes), "len={}", len);
+        }
+
+        let mut words: Checksum = Checksum::new();
+        words.add_u16(0x1234);
+        words.add_bytes(&bytes);
+        let mut whole: Vec<u8> = vec![0x12, 0x34];
+        whole.extend_from_slice(&bytes);
+        assert_eq!(words.finish(), reference(&whole));
+    }
+
+    /// Tests that incremental updates match checksums that are computed from scratch.
+    #[test]
+    fn test_checksum_update() {
+        let mut bytes: Vec<u8> = payload(40);
+        let before: u16 = checksum(&bytes);
+
+        bytes[10..12].copy_from_slice(&0xbeefu16.to_be_bytes());
+        let old: u16 = u16::from_be_bytes([payload(40)[10], payload(40)[11]]);
+        assert_eq!(update_u16(before, old, 0xbeef), checksum(&bytes));
+
+        let before: u16 = checksum(&bytes);
+        let old: u32 = u32::from_be_bytes(bytes[4..8].try_into().unwrap());
+        bytes[4..8].copy_from_slice(&0x0a000001u32.to_be_bytes());
+        assert_eq!(update_u32(before, old, 0x0a000001), checksum(&bytes));
+    }
+
+    fn bench_checksum(b: &mut Bencher, len: usize) {
+        let bytes: Vec<u8> = payload(len);
+        b.bytes = len as u64;
+        b.iter(|| black_box(checksum(black_box(&bytes))));
+    }
+
+    #[bench]
+    fn bench_checksum_64(b: &mut Bencher) {
+        bench_checksum(b, 64);
+    }
+
+    #[bench]
+    fn bench_checksum_1500(b: &mut Bencher) {
+        bench_checksum(b, 1500);
+    }
+
+    #[bench]
+    fn bench_checksum_9000(b: &mut Bencher) {
+        bench_checksum(b, 9000);
+    }
+
+    /// Benchmarks the scalar kernel, for comparison with the vector ones.
+    #[bench]
+    fn bench_checksum_scalar_9000(b: &mut Bencher) {
+        let bytes: Vec<u8> = payload(9000);
+        b.bytes = bytes.len() as u64;
+        b.iter(|| black_box(sum_bytes_scalar(black_box(&bytes))));
+    }
+}
@@ -45,10 +45,18 @@ impl EphemeralPorts {
     }
 
     pub fn alloc_any(&mut self) -> Result<u16, Fail> {
-        self.ports.pop().ok_or(Fail::new(
-            libc::EADDRINUSE,
-            "all port numbers in the ephemeral port range are currently in use",
-        ))
+        self.alloc_any_if(|_| true)
+    }
+
+    /// Allocates any port from the pool that satisfies `predicate`.
+    pub fn alloc_any_if<P: Fn(u16) -> bool>(&mut self, predicate: P) -> Result<u16, Fail> {
+        match self.ports.iter().rposition(|&port| predicate(port)) {
+            Some(i) => Ok(self.ports.swap_remove(i)),
+            None => Err(Fail::new(
+                libc::EADDRINUSE,
+                "all port numbers in the ephemeral port range are currently in use",
+            )),
+        }
     }
 
     /// Allocates the specified port from the pool.
@@ -68,3 +76,35 @@ impl EphemeralPorts {
         self.ports.push(port);
     }
 }
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        EphemeralPorts,
+        FIRST_PRIVATE_PORT,
+        LAST_PRIVATE_PORT,
+    };
+    use ::rand::{
+        rngs::SmallRng,
+        SeedableRng,
+    };
+
+    /// Tests that ports are only allocated if they satisfy a predicate, until none is left.
+    #[test]
+    fn test_alloc_any_if() {
+        let mut ports: EphemeralPorts = EphemeralPorts::new(&mut SmallRng::seed_from_u64(0));
+        let num_even: usize = (FIRST_PRIVATE_PORT..LAST_PRIVATE_PORT)
+            .filter(|port| port % 2 == 0)
+            .count();
+        for _ in 0..num_even {
+            let port: u16 = ports.alloc_any_if(|port| port % 2 == 0).unwrap();
+            assert_eq!(port % 2, 0);
+        }
+        assert!(ports.alloc_any_if(|port| port % 2 == 0).is_err());
+        assert_eq!(ports.alloc_any().unwrap() % 2, 1);
+    }
+}
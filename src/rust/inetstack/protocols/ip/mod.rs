@@ -1,8 +1,10 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+pub mod checksum;
 mod ephemeral;
 mod protocol;
+pub mod template;
 
 pub use self::{
     ephemeral::EphemeralPorts,
@@ -0,0 +1,109 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::{
+    inetstack::protocols::{
+        ethernet2::ETHERNET2_HEADER_SIZE,
+        ip::checksum::update_u16,
+        ipv4::IPV4_HEADER_DEFAULT_SIZE,
+        tcp::MIN_TCP_HEADER_SIZE,
+    },
+    runtime::network::{
+        types::MacAddress,
+        PacketBuf,
+    },
+};
+use ::byteorder::{
+    ByteOrder,
+    NetworkEndian,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Offset of the transport header in a template (in bytes).
+const TRANSPORT_HEADER_OFFSET: usize = ETHERNET2_HEADER_SIZE + IPV4_HEADER_DEFAULT_SIZE;
+
+/// Maximum size of a template (in bytes). This fits TCP headers without options.
+const MAX_TEMPLATE_SIZE: usize = TRANSPORT_HEADER_OFFSET + MIN_TCP_HEADER_SIZE;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Header Template
+///
+/// Ethernet, IPv4 and transport headers of a packet with an empty payload, that are built once for a flow and then
+/// copied into every packet that it sends, so that only the fields that change across packets have to be written. The
+/// checksums of the template are filled in, so that they are updated with the fields instead of being summed again
+/// (RFC 1624).
+#[derive(Clone, Copy, Debug)]
+pub struct HeaderTemplate {
+    /// Serialized headers.
+    bytes: [u8; MAX_TEMPLATE_SIZE],
+    /// Size of the serialized headers.
+    size: usize,
+    /// Link address that the headers are sent to.
+    remote_link_addr: MacAddress,
+    /// Generation of the ARP cache that `remote_link_addr` was resolved at.
+    arp_generation: u64,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Header Templates
+impl HeaderTemplate {
+    /// Builds a template from a packet with an empty payload and without checksum offloading, that is sent to
+    /// `remote_link_addr` as resolved at generation `arp_generation` of the ARP cache.
+    pub fn new(pkt: &dyn PacketBuf, remote_link_addr: MacAddress, arp_generation: u64) -> Self {
+        debug_assert_eq!(pkt.body_size(), 0);
+        let size: usize = pkt.header_size();
+        assert!(size > TRANSPORT_HEADER_OFFSET && size <= MAX_TEMPLATE_SIZE);
+
+        let mut bytes: [u8; MAX_TEMPLATE_SIZE] = [0; MAX_TEMPLATE_SIZE];
+        pkt.write_header(&mut bytes[..size]);
+        Self {
+            bytes,
+            size,
+            remote_link_addr,
+            arp_generation,
+        }
+    }
+
+    /// Returns the size of the headers of the target template.
+    pub fn size(&self) -> usize {
+        self.size
+    }
+
+    /// Returns the link address that the target template sends to.
+    pub fn remote_link_addr(&self) -> MacAddress {
+        self.remote_link_addr
+    }
+
+    /// Returns the generation of the ARP cache that the target template was built at.
+    pub fn arp_generation(&self) -> u64 {
+        self.arp_generation
+    }
+
+    /// Copies the target template into `buf`, sets the length of the IPv4 datagram to fit `ipv4_payload_len` bytes
+    /// and returns the transport header, for the caller to fill in.
+    pub fn write<'a>(&self, buf: &'a mut [u8], ipv4_payload_len: usize) -> &'a mut [u8] {
+        buf[..self.size].copy_from_slice(&self.bytes[..self.size]);
+
+        let ipv4_hdr: &mut [u8] = &mut buf[ETHERNET2_HEADER_SIZE..TRANSPORT_HEADER_OFFSET];
+        let old_len: u16 = NetworkEndian::read_u16(&ipv4_hdr[2..4]);
+        let new_len: u16 = (IPV4_HEADER_DEFAULT_SIZE + ipv4_payload_len) as u16;
+        NetworkEndian::write_u16(&mut ipv4_hdr[2..4], new_len);
+        let checksum: u16 = update_u16(NetworkEndian::read_u16(&ipv4_hdr[10..12]), old_len, new_len);
+        NetworkEndian::write_u16(&mut ipv4_hdr[10..12], checksum);
+
+        &mut buf[TRANSPORT_HEADER_OFFSET..self.size]
+    }
+}
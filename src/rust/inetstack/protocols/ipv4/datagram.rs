@@ -6,7 +6,10 @@
 //==============================================================================
 
 use crate::{
-    inetstack::protocols::ip::IpProtocol,
+    inetstack::protocols::ip::{
+        checksum::Checksum,
+        IpProtocol,
+    },
     runtime::{
         fail::Fail,
         memory::Buffer,
@@ -312,18 +315,10 @@ impl Ipv4Header {
 
     /// Computes the checksum of the target IPv4 header.
     pub fn compute_checksum(buf: &[u8]) -> u16 {
-        let mut state: u32 = 0xffffu32;
-        for i in 0..5 {
-            state += NetworkEndian::read_u16(&buf[(2 * i)..(2 * i + 2)]) as u32;
-        }
-        // Skip the 5th u16 since octets 10-12 are the header checksum, whose value should be zero when
-        // computing a checksum.
-        for i in 6..10 {
-            state += NetworkEndian::read_u16(&buf[(2 * i)..(2 * i + 2)]) as u32;
-        }
-        while state > 0xffff {
-            state -= 0xffff;
-        }
-        !state as u16
+        let mut checksum: Checksum = Checksum::new();
+        // Skip octets 10-12 since they are the header checksum, whose value should be zero when computing a checksum.
+        checksum.add_bytes(&buf[0..10]);
+        checksum.add_bytes(&buf[12..20]);
+        checksum.finish()
     }
 }
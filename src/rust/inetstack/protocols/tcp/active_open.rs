@@ -195,11 +195,14 @@ impl ActiveOpenSocket {
             tcp_hdr,
             data: None,
             tx_checksum_offload: self.tcp_config.get_rx_checksum_offload(),
+            tx_segment_size: None,
+            template: None,
         };
         self.rt.transmit(Box::new(segment));
 
         let mut remote_window_scale = None;
         let mut mss = FALLBACK_MSS;
+        let mut sack_permitted: bool = false;
         for option in header.iter_options() {
             match option {
                 TcpOptions2::WindowScale(w) => {
@@ -210,6 +213,10 @@ impl ActiveOpenSocket {
                     info!("Received advertised MSS: {}", m);
                     mss = *m as usize;
                 },
+                TcpOptions2::SelectiveAcknowlegementPermitted => {
+                    info!("Received SACK permitted");
+                    sack_permitted = self.tcp_config.get_selective_ack();
+                },
                 _ => continue,
             }
         }
@@ -257,7 +264,8 @@ impl ActiveOpenSocket {
             tx_window_size,
             remote_window_scale,
             mss,
-            congestion_control::None::new,
+            sack_permitted,
+            congestion_control::constructor(self.tcp_config.get_congestion_control()),
             None,
         );
         self.set_result(Ok(cb));
@@ -299,6 +307,11 @@ impl ActiveOpenSocket {
                 tcp_hdr.push_option(TcpOptions2::WindowScale(tcp_config.get_window_scale()));
                 info!("Advertising window scale: {}", tcp_config.get_window_scale());
 
+                if tcp_config.get_selective_ack() {
+                    tcp_hdr.push_option(TcpOptions2::SelectiveAcknowlegementPermitted);
+                    info!("Advertising SACK permitted");
+                }
+
                 debug!("Sending SYN {:?}", tcp_hdr);
                 let segment = TcpSegment {
                     ethernet2_hdr: Ethernet2Header::new(remote_link_addr, local_link_addr, EtherType2::Ipv4),
@@ -306,6 +319,8 @@ impl ActiveOpenSocket {
                     tcp_hdr,
                     data: None,
                     tx_checksum_offload: tcp_config.get_rx_checksum_offload(),
+                    tx_segment_size: None,
+                    template: None,
                 };
                 rt.transmit(Box::new(segment));
                 clock.wait(clock.clone(), handshake_timeout).await;
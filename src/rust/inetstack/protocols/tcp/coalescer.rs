@@ -0,0 +1,190 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::{
+    inetstack::protocols::tcp::{
+        segment::TcpHeader,
+        SeqNumber,
+    },
+    runtime::{
+        memory::Buffer,
+        network::consts::MAX_SEGMENTATION_OFFLOAD_SIZE,
+    },
+};
+use ::std::net::SocketAddrV4;
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Maximum number of segments that are coalesced together.
+const MAX_COALESCED_SEGMENTS: usize = 64;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Batch of Coalesced Segments
+pub struct CoalescedSegments {
+    /// Connection that the segments belong to.
+    pub key: (SocketAddrV4, SocketAddrV4),
+    /// Header of the first segment.
+    pub header: TcpHeader,
+    /// Data of the first segment.
+    pub data: Buffer,
+    /// Sequence numbers and data of the segments that follow the first one.
+    pub rest: Vec<(SeqNumber, Buffer)>,
+    /// Sequence number that the next segment should start at to join the batch.
+    next_seq_num: SeqNumber,
+    /// Number of bytes in the batch.
+    len: usize,
+}
+
+/// Receive Segment Coalescer
+///
+/// Software counterpart of Generic Receive Offload (GRO): consecutive in-order data segments of a connection that
+/// arrive in the same receive batch, and that only differ by their sequence numbers, are held here and handed to the
+/// connection at once, so that their headers are processed (and acknowledged) a single time. Data buffers are never
+/// copied.
+pub struct SegmentCoalescer {
+    /// Segments being coalesced, if any.
+    pending: Option<CoalescedSegments>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Receive Segment Coalescers
+impl SegmentCoalescer {
+    /// Creates an empty coalescer.
+    pub fn new() -> Self {
+        Self { pending: None }
+    }
+
+    /// Checks if a segment may be coalesced, i.e. if it carries data and nothing but an acknowledgement.
+    pub fn can_coalesce(header: &TcpHeader, data: &Buffer) -> bool {
+        !data.is_empty()
+            && header.ack
+            && !(header.syn || header.fin || header.rst || header.urg || header.cwr || header.ece)
+            && header.num_options == 0
+    }
+
+    /// Adds a segment that [Self::can_coalesce] to the target coalescer. Returns the pending batch if the segment
+    /// cannot join it, in which case the segment starts a new batch.
+    pub fn push(
+        &mut self,
+        key: (SocketAddrV4, SocketAddrV4),
+        header: TcpHeader,
+        data: Buffer,
+    ) -> Option<CoalescedSegments> {
+        debug_assert!(Self::can_coalesce(&header, &data));
+
+        if let Some(pending) = self.pending.as_mut() {
+            let joins: bool = pending.key == key
+                && pending.next_seq_num == header.seq_num
+                && pending.header.ack_num == header.ack_num
+                && pending.header.window_size == header.window_size
+                && pending.len + data.len() <= MAX_SEGMENTATION_OFFLOAD_SIZE
+                && pending.rest.len() + 1 < MAX_COALESCED_SEGMENTS;
+            if joins {
+                pending.next_seq_num = pending.next_seq_num + SeqNumber::from(data.len() as u32);
+                pending.len += data.len();
+                pending.header.psh |= header.psh;
+                pending.rest.push((header.seq_num, data));
+                return None;
+            }
+        }
+
+        let next_seq_num: SeqNumber = header.seq_num + SeqNumber::from(data.len() as u32);
+        let len: usize = data.len();
+        self.pending.replace(CoalescedSegments {
+            key,
+            header,
+            data,
+            rest: Vec::new(),
+            next_seq_num,
+            len,
+        })
+    }
+
+    /// Takes the pending batch out of the target coalescer, if any.
+    pub fn take(&mut self) -> Option<CoalescedSegments> {
+        self.pending.take()
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        CoalescedSegments,
+        SegmentCoalescer,
+    };
+    use crate::{
+        inetstack::protocols::tcp::{
+            segment::TcpHeader,
+            SeqNumber,
+        },
+        runtime::memory::{
+            Buffer,
+            DataBuffer,
+        },
+    };
+    use ::std::net::{
+        Ipv4Addr,
+        SocketAddrV4,
+    };
+
+    fn segment(seq_num: u32, len: usize) -> (TcpHeader, Buffer) {
+        let mut header: TcpHeader = TcpHeader::new(80, 8080);
+        header.seq_num = SeqNumber::from(seq_num);
+        header.ack = true;
+        header.ack_num = SeqNumber::from(1);
+        (header, Buffer::Heap(DataBuffer::new(len).unwrap()))
+    }
+
+    /// Tests that contiguous segments of a connection are coalesced, and that anything else starts a new batch.
+    #[test]
+    fn test_segment_coalescer() {
+        let local: SocketAddrV4 = SocketAddrV4::new(Ipv4Addr::new(10, 0, 0, 1), 80);
+        let remote: SocketAddrV4 = SocketAddrV4::new(Ipv4Addr::new(10, 0, 0, 2), 8080);
+        let mut coalescer: SegmentCoalescer = SegmentCoalescer::new();
+
+        for i in 0..4 {
+            let (header, data): (TcpHeader, Buffer) = segment(100 + i * 10, 10);
+            assert!(SegmentCoalescer::can_coalesce(&header, &data));
+            assert!(coalescer.push((local, remote), header, data).is_none());
+        }
+
+        // A gap in the sequence space ends the batch.
+        let (header, data): (TcpHeader, Buffer) = segment(150, 10);
+        let batch: CoalescedSegments = coalescer.push((local, remote), header, data).unwrap();
+        assert_eq!(batch.header.seq_num, SeqNumber::from(100));
+        assert_eq!(batch.rest.len(), 3);
+        assert_eq!(batch.rest[2].0, SeqNumber::from(130));
+
+        // So does a segment that acknowledges something else.
+        let (mut header, data): (TcpHeader, Buffer) = segment(160, 10);
+        header.ack_num = SeqNumber::from(2);
+        let batch: CoalescedSegments = coalescer.push((local, remote), header, data).unwrap();
+        assert_eq!(batch.header.seq_num, SeqNumber::from(150));
+        assert!(batch.rest.is_empty());
+
+        let batch: CoalescedSegments = coalescer.take().unwrap();
+        assert_eq!(batch.header.seq_num, SeqNumber::from(160));
+        assert!(coalescer.take().is_none());
+
+        // Segments that carry anything but data and an acknowledgement are not coalesced.
+        let (mut header, data): (TcpHeader, Buffer) = segment(170, 10);
+        header.fin = true;
+        assert!(!SegmentCoalescer::can_coalesce(&header, &data));
+    }
+}
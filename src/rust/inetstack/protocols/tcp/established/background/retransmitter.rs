@@ -6,6 +6,7 @@ use crate::{
     inetstack::protocols::tcp::segment::TcpHeader,
     runtime::{
         fail::Fail,
+        memory::Buffer,
         network::types::MacAddress,
     },
 };
@@ -33,13 +34,10 @@ pub enum RetransmitCause {
 async fn retransmit(cause: RetransmitCause, cb: &Rc<ControlBlock>) -> Result<(), Fail> {
     // ToDo: Handle retransmission of FIN.
 
-    // ToDo: Fix this routine.  It is currently trashing our unacknowledged queue state.  It shouldn't remove any
-    // unacknowledged data from the unacknowledged queue, as retransmiting data doesn't magically make it acknowledged.
-    // Any sent data, whether sent once or multiple times, must remain on the unacknowledged queue until it is ACKed.
-
-    // Pop unack'ed segment.
-    let mut segment = match cb.pop_unacked_segment() {
-        Some(s) => s,
+    // Get the oldest unacknowledged segment.  It stays on the unacknowledged queue, as retransmitting data doesn't
+    // magically make it acknowledged.  This also unsets its initial timestamp, so we don't use it for RTT estimation.
+    let bytes: Buffer = match cb.retransmit_first_unacked_segment() {
+        Some(bytes) => bytes,
         None => {
             // We shouldn't enter the retransmit routine with an empty unacknowledged queue.  So maybe we should assert
             // here?  But this is relatively benign if it happens, and could be the result of a race-condition or a
@@ -62,16 +60,13 @@ async fn retransmit(cause: RetransmitCause, cb: &Rc<ControlBlock>) -> Result<(),
     };
 
     // Our retransmission timer fired, so we need to resend a packet.
-    let remote_link_addr: MacAddress = cb.arp().query(cb.get_remote().ip().clone()).await?;
-
-    // Unset the initial timestamp so we don't use this for RTT estimation.
-    segment.initial_tx.take();
+    let remote_link_addr: MacAddress = cb.resolve_remote_link_addr().await?;
 
     // Prepare and send the segment.
     let (seq_no, _) = cb.get_send_unacked();
     let mut header: TcpHeader = cb.tcp_header();
     header.seq_num = seq_no;
-    cb.emit(header, Some(segment.bytes), remote_link_addr);
+    cb.emit(header, Some(bytes), remote_link_addr);
 
     // Set new retransmit deadline.
     // ToDo: Review this.  Shouldn't we only do this for RetransmitCause::Timeout?
@@ -93,6 +88,15 @@ pub async fn retransmitter(cb: Rc<ControlBlock>) -> Result<!, Fail> {
         };
         futures::pin_mut!(rtx_future);
 
+        // Pin future for RACK-TLP loss recovery.
+        let (loss_deadline, loss_deadline_changed) = cb.watch_loss_deadline();
+        futures::pin_mut!(loss_deadline_changed);
+        let loss_future = match loss_deadline {
+            Some((t, timer)) => Either::Left(cb.clock.wait_until(cb.clock.clone(), t).map(move |_| timer).fuse()),
+            None => Either::Right(future::pending()),
+        };
+        futures::pin_mut!(loss_future);
+
         // Pin future for fast retransmission.
         let (rtx_fast_retransmit, rtx_fast_retransmit_changed) = cb.congestion_control_watch_retransmit_now_flag();
         if rtx_fast_retransmit {
@@ -105,6 +109,11 @@ pub async fn retransmitter(cb: Rc<ControlBlock>) -> Result<!, Fail> {
         futures::select_biased! {
             _ = rtx_deadline_changed => continue,
             _ = rtx_fast_retransmit_changed => continue,
+            _ = loss_deadline_changed => continue,
+            timer = loss_future => {
+                trace!("Loss Recovery Timer Expired ({:?})", timer);
+                cb.on_loss_timeout(timer);
+            },
             _ = rtx_future => {
                 trace!("Retransmission Timer Expired");
                 let (send_unacknowledged, _) = cb.get_send_unacked();
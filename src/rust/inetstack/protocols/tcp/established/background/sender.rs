@@ -48,7 +48,7 @@ pub async fn sender(cb: Rc<ControlBlock>) -> Result<!, Fail> {
         // repeatedly send window probes until window opens up.
         if win_sz == 0 {
             // Send a window probe (this is a one-byte packet designed to elicit a window update from our peer).
-            let remote_link_addr = cb.arp().query(cb.get_remote().ip().clone()).await?;
+            let remote_link_addr = cb.resolve_remote_link_addr().await?;
             let buf: Buffer = cb
                 .pop_one_unsent_byte()
                 .unwrap_or_else(|| panic!("No unsent data? {}, {}", send_next, unsent_seq));
@@ -57,10 +57,7 @@ pub async fn sender(cb: Rc<ControlBlock>) -> Result<!, Fail> {
             cb.modify_send_next(|s| s + SeqNumber::from(1));
 
             // Add the probe byte (as a new separate buffer) to our unacknowledged queue.
-            let unacked_segment = UnackedSegment {
-                bytes: buf.clone(),
-                initial_tx: Some(cb.clock.now()),
-            };
+            let unacked_segment = UnackedSegment::new(buf.clone(), cb.clock.now());
             cb.push_unacked_segment(unacked_segment);
 
             let mut header: TcpHeader = cb.tcp_header();
@@ -114,17 +111,23 @@ pub async fn sender(cb: Rc<ControlBlock>) -> Result<!, Fail> {
             }
         }
 
+        // Hold the segment back until the pacer releases it, instead of bursting out the whole cwnd.
+        if let Some(release_time) = cb.pacing_release_time() {
+            cb.clock.wait_until(cb.clock.clone(), release_time).await;
+            continue 'top;
+        }
+
         // Past this point we have data to send and it's valid to send it!
 
         // TODO: Nagle's algorithm - We need to coalese small buffers together to send MSS sized packets.
         // TODO: Silly window syndrome - See RFC 1122's discussion of the SWS avoidance algorithm.
 
         // ToDo: Link-level concerns don't belong here, we should call an IP-level send routine below.
-        let remote_link_addr = cb.arp().query(cb.get_remote().ip().clone()).await?;
+        let remote_link_addr = cb.resolve_remote_link_addr().await?;
 
         // Form an outgoing packet.
         let max_size: usize = cmp::min(
-            cmp::min((win_sz - sent_data) as usize, cb.get_mss()),
+            cmp::min((win_sz - sent_data) as usize, cb.get_send_segment_size()),
             (effective_cwnd - sent_data) as usize,
         );
         let segment_data: Buffer = cb
@@ -146,15 +149,13 @@ pub async fn sender(cb: Rc<ControlBlock>) -> Result<!, Fail> {
             segment_data_len = 1;
         }
         cb.emit(header, Some(segment_data.clone()), remote_link_addr);
+        cb.pacing_on_send(segment_data.len());
 
         // Update SND.NXT.
         cb.modify_send_next(|s| s + SeqNumber::from(segment_data_len));
 
         // Put this segment on the unacknowledged list.
-        let unacked_segment = UnackedSegment {
-            bytes: segment_data,
-            initial_tx: Some(cb.clock.now()),
-        };
+        let unacked_segment = UnackedSegment::new(segment_data, cb.clock.now());
         cb.push_unacked_segment(unacked_segment);
 
         // Set the retransmit timer.
@@ -164,5 +165,8 @@ pub async fn sender(cb: Rc<ControlBlock>) -> Result<!, Fail> {
             let rto: Duration = cb.rto_estimate();
             cb.set_retransmit_deadline(Some(cb.clock.now() + rto));
         }
+
+        // Schedule a tail loss probe, in case this is the last segment of a flight.
+        cb.schedule_loss_probe(cb.clock.now());
     }
 }
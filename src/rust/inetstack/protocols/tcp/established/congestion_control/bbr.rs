@@ -0,0 +1,549 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This is a BBR (Bottleneck Bandwidth and Round-trip propagation time) style congestion control algorithm, as
+// described in draft-cardwell-iccrg-bbr-congestion-control.  Instead of reacting to losses like CUBIC does, BBR builds
+// an explicit model of the path (its bottleneck bandwidth and its minimum round-trip time) and paces data out at the
+// estimated bandwidth, keeping about one bandwidth-delay product (BDP) in flight so that bottleneck queues stay short.
+// Like BBRv2, it also caps the data in flight when it sees losses, so that it does not keep overflowing shallow buffers,
+// and raises that cap again when it probes for more bandwidth.
+//
+// ToDo: Bandwidth samples are taken per ACK over the last round trip, rather than per segment as the delivery rate
+// estimation draft describes, as our congestion control hooks don't carry per-segment state.
+
+use super::{
+    CongestionControl,
+    FastRetransmitRecovery,
+    LimitedTransmit,
+    Options,
+    SlowStartCongestionAvoidance,
+};
+use crate::{
+    inetstack::protocols::tcp::SeqNumber,
+    runtime::watched::{
+        WatchFuture,
+        WatchedValue,
+    },
+};
+use ::std::{
+    cell::{
+        Cell,
+        RefCell,
+    },
+    cmp::{
+        max,
+        min,
+    },
+    collections::VecDeque,
+    convert::TryInto,
+    fmt::Debug,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+// Gain used to double the sending rate every round trip in STARTUP (i.e. 2/ln(2)).
+const HIGH_GAIN: f64 = 2.885;
+
+// Pacing gains of the eight phases of a PROBE_BW cycle.
+const PROBE_BW_GAINS: [f64; 8] = [1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0];
+
+// Gain applied to the BDP to compute cwnd outside of STARTUP and DRAIN.
+const CWND_GAIN: f64 = 2.0;
+
+// Number of round trips over which the maximum bandwidth filter runs.
+const BW_FILTER_ROUNDS: u64 = 10;
+
+// Number of rounds without significant bandwidth growth after which we consider the pipe full.
+const FULL_BW_ROUNDS: u32 = 3;
+
+// Bandwidth growth that counts as significant in STARTUP.
+const FULL_BW_THRESHOLD: f64 = 1.25;
+
+// Lifetime of a minimum RTT estimate, after which we enter PROBE_RTT to refresh it.
+const MIN_RTT_FILTER_LEN: Duration = Duration::from_secs(10);
+
+// Time we spend in PROBE_RTT with a minimal cwnd.
+const PROBE_RTT_DURATION: Duration = Duration::from_millis(200);
+
+// Minimum cwnd, in segments.
+const MIN_CWND_SEGMENTS: u32 = 4;
+
+// Multiplicative decrease of the inflight cap on loss.
+const BETA: f64 = 0.7;
+
+// Maximum number of delivery samples that we keep for bandwidth estimation.
+const MAX_DELIVERY_SAMPLES: usize = 1024;
+
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum BbrState {
+    Startup,
+    Drain,
+    ProbeBw,
+    ProbeRtt,
+}
+
+#[derive(Debug)]
+pub struct Bbr {
+    pub mss: u32,
+    pub initial_cwnd: u32,
+    pub state: Cell<BbrState>,
+    pub cwnd: WatchedValue<u32>,
+    pub pacing_rate: Cell<u64>, // Bytes per second.  Zero until we have a model of the path.
+
+    // Bandwidth model.
+    pub delivered: Cell<u64>,                                // Total number of bytes delivered.
+    pub delivery_samples: RefCell<VecDeque<(Instant, u64)>>, // Recent (time, delivered) pairs.
+    pub max_bw_samples: RefCell<VecDeque<(u64, u64)>>,       // Maximum bandwidth (bytes per second) of recent rounds.
+    pub round_count: Cell<u64>,                              // Number of round trips so far.
+    pub next_round_delivered: Cell<u64>,                     // Value of delivered at which the current round ends.
+
+    // Round-trip propagation time model.
+    pub min_rtt: Cell<Option<Duration>>,
+    pub min_rtt_stamp: Cell<Instant>,
+    pub probe_rtt_done_stamp: Cell<Option<Instant>>,
+    pub probe_rtt_round_done: Cell<bool>,
+    pub prior_cwnd: Cell<u32>, // cwnd before we entered PROBE_RTT or recovery.
+
+    // STARTUP state.
+    pub filled_pipe: Cell<bool>,
+    pub full_bw: Cell<u64>,
+    pub full_bw_count: Cell<u32>,
+
+    // PROBE_BW state.
+    pub cycle_index: Cell<usize>,
+    pub cycle_stamp: Cell<Instant>,
+
+    // Upper bound on the data in flight, which we lower when we see losses, and raise when we probe for bandwidth.
+    pub inflight_hi: Cell<u32>,
+}
+
+impl CongestionControl for Bbr {
+    fn new(mss: usize, _seq_no: SeqNumber, _options: Option<Options>) -> Box<dyn CongestionControl> {
+        Box::new(Self::with_start_time(mss, Instant::now()))
+    }
+}
+
+impl Bbr {
+    fn with_start_time(mss: usize, now: Instant) -> Self {
+        let mss: u32 = mss.try_into().unwrap();
+        // The initial value of cwnd is set according to RFC5681, section 3.1, page 7, as for CUBIC.
+        let initial_cwnd: u32 = match mss {
+            0..=1095 => 4 * mss,
+            1096..=2190 => 3 * mss,
+            _ => 2 * mss,
+        };
+        Self {
+            mss,
+            initial_cwnd,
+            state: Cell::new(BbrState::Startup),
+            cwnd: WatchedValue::new(initial_cwnd),
+            pacing_rate: Cell::new(0),
+
+            delivered: Cell::new(0),
+            delivery_samples: RefCell::new(VecDeque::new()),
+            max_bw_samples: RefCell::new(VecDeque::new()),
+            round_count: Cell::new(0),
+            next_round_delivered: Cell::new(0),
+
+            min_rtt: Cell::new(None),
+            min_rtt_stamp: Cell::new(now),
+            probe_rtt_done_stamp: Cell::new(None),
+            probe_rtt_round_done: Cell::new(false),
+            prior_cwnd: Cell::new(initial_cwnd),
+
+            filled_pipe: Cell::new(false),
+            full_bw: Cell::new(0),
+            full_bw_count: Cell::new(0),
+
+            cycle_index: Cell::new(0),
+            cycle_stamp: Cell::new(now),
+
+            inflight_hi: Cell::new(u32::MAX),
+        }
+    }
+
+    // Returns the current estimate of the bottleneck bandwidth, in bytes per second.
+    fn max_bw(&self) -> u64 {
+        self.max_bw_samples
+            .borrow()
+            .iter()
+            .map(|(_, bw)| *bw)
+            .max()
+            .unwrap_or(0)
+    }
+
+    // Returns the estimated bandwidth-delay product, if we have a model of the path.
+    fn bdp(&self, gain: f64) -> Option<u32> {
+        let min_rtt: Duration = self.min_rtt.get()?;
+        let bw: u64 = self.max_bw();
+        if bw == 0 {
+            return None;
+        }
+        Some((gain * bw as f64 * min_rtt.as_secs_f64()) as u32)
+    }
+
+    fn pacing_gain(&self) -> f64 {
+        match self.state.get() {
+            BbrState::Startup => HIGH_GAIN,
+            BbrState::Drain => 1.0 / HIGH_GAIN,
+            BbrState::ProbeBw => PROBE_BW_GAINS[self.cycle_index.get()],
+            BbrState::ProbeRtt => 1.0,
+        }
+    }
+
+    fn cwnd_gain(&self) -> f64 {
+        match self.state.get() {
+            BbrState::Startup | BbrState::Drain => HIGH_GAIN,
+            BbrState::ProbeBw | BbrState::ProbeRtt => CWND_GAIN,
+        }
+    }
+
+    fn min_cwnd(&self) -> u32 {
+        MIN_CWND_SEGMENTS * self.mss
+    }
+
+    // Takes a bandwidth sample over (about) the last round trip, and feeds the maximum bandwidth filter.
+    fn update_bw(&self, now: Instant, bytes_acknowledged: u32, bytes_in_flight: u32) {
+        let delivered: u64 = self.delivered.get() + bytes_acknowledged as u64;
+        self.delivered.set(delivered);
+
+        // Count round trips: a round ends once the data that was in flight when it started is delivered.
+        if delivered >= self.next_round_delivered.get() {
+            self.round_count.set(self.round_count.get() + 1);
+            self.next_round_delivered.set(delivered + bytes_in_flight as u64);
+            self.probe_rtt_round_done.set(true);
+        }
+
+        let window: Duration = self.min_rtt.get().unwrap_or(Duration::from_millis(1));
+        let mut samples = self.delivery_samples.borrow_mut();
+        samples.push_back((now, delivered));
+        while samples.len() > MAX_DELIVERY_SAMPLES
+            || (samples.len() > 2 && now.saturating_duration_since(samples[1].0) >= window)
+        {
+            samples.pop_front();
+        }
+        let (then, delivered_then): (Instant, u64) = samples[0];
+        let elapsed: Duration = now.saturating_duration_since(then);
+        if elapsed.is_zero() {
+            return;
+        }
+        let bw: u64 = ((delivered - delivered_then) as f64 / elapsed.as_secs_f64()) as u64;
+
+        let round: u64 = self.round_count.get();
+        let mut max_bw_samples = self.max_bw_samples.borrow_mut();
+        while let Some((sample_round, _)) = max_bw_samples.front() {
+            if sample_round + BW_FILTER_ROUNDS > round {
+                break;
+            }
+            max_bw_samples.pop_front();
+        }
+        match max_bw_samples.back_mut() {
+            Some((sample_round, sample_bw)) if *sample_round == round => *sample_bw = max(*sample_bw, bw),
+            _ => max_bw_samples.push_back((round, bw)),
+        }
+    }
+
+    // Checks if the bandwidth stopped growing in STARTUP, which means the pipe is full.
+    fn check_full_pipe(&self, round_start: bool) {
+        if self.filled_pipe.get() || !round_start {
+            return;
+        }
+        let bw: u64 = self.max_bw();
+        if bw as f64 >= self.full_bw.get() as f64 * FULL_BW_THRESHOLD {
+            self.full_bw.set(bw);
+            self.full_bw_count.set(0);
+            return;
+        }
+        self.full_bw_count.set(self.full_bw_count.get() + 1);
+        if self.full_bw_count.get() >= FULL_BW_ROUNDS {
+            self.filled_pipe.set(true);
+        }
+    }
+
+    fn enter_probe_bw(&self, now: Instant) {
+        self.state.set(BbrState::ProbeBw);
+        // Start by probing for more bandwidth, then drain the queue this created, and cruise until the next cycle.
+        self.cycle_index.set(0);
+        self.cycle_stamp.set(now);
+    }
+
+    fn update_state(&self, now: Instant, bytes_in_flight: u32, round_start: bool) {
+        self.check_full_pipe(round_start);
+
+        match self.state.get() {
+            BbrState::Startup if self.filled_pipe.get() => self.state.set(BbrState::Drain),
+            BbrState::Drain if self.bdp(1.0).map_or(false, |bdp| bytes_in_flight <= bdp) => self.enter_probe_bw(now),
+            BbrState::ProbeBw => {
+                // Move on to the next phase after (about) one round trip.
+                let min_rtt: Duration = self.min_rtt.get().unwrap_or(Duration::ZERO);
+                if now.saturating_duration_since(self.cycle_stamp.get()) > min_rtt {
+                    self.cycle_index
+                        .set((self.cycle_index.get() + 1) % PROBE_BW_GAINS.len());
+                    self.cycle_stamp.set(now);
+                }
+            },
+            _ => (),
+        }
+
+        // Refresh the minimum RTT estimate once it gets stale, by briefly draining the path.
+        let min_rtt_expired: bool = now.saturating_duration_since(self.min_rtt_stamp.get()) > MIN_RTT_FILTER_LEN;
+        if min_rtt_expired && self.state.get() != BbrState::ProbeRtt {
+            self.state.set(BbrState::ProbeRtt);
+            self.prior_cwnd.set(self.cwnd.get());
+            self.probe_rtt_done_stamp.set(None);
+        }
+        if self.state.get() == BbrState::ProbeRtt {
+            match self.probe_rtt_done_stamp.get() {
+                None if bytes_in_flight <= self.min_cwnd() => {
+                    self.probe_rtt_done_stamp.set(Some(now + PROBE_RTT_DURATION));
+                    self.probe_rtt_round_done.set(false);
+                },
+                Some(done) if self.probe_rtt_round_done.get() && now >= done => {
+                    self.min_rtt_stamp.set(now);
+                    let cwnd: u32 = max(self.cwnd.get(), self.prior_cwnd.get());
+                    self.cwnd.set(max(min(cwnd, self.inflight_hi.get()), self.min_cwnd()));
+                    if self.filled_pipe.get() {
+                        self.enter_probe_bw(now);
+                    } else {
+                        self.state.set(BbrState::Startup);
+                    }
+                },
+                _ => (),
+            }
+        }
+    }
+
+    // Raises the inflight cap while it limits cwnd in the phase of PROBE_BW that probes for more bandwidth, so that the
+    // cap doubles every such round trip until we see losses again. Otherwise, cwnd would only ever shrink after losses.
+    fn probe_inflight_hi(&self, bytes_acknowledged: u32) {
+        let inflight_hi: u32 = self.inflight_hi.get();
+        let probing: bool = self.state.get() == BbrState::ProbeBw && PROBE_BW_GAINS[self.cycle_index.get()] > 1.0;
+        if probing && inflight_hi != u32::MAX && self.cwnd.get() >= inflight_hi {
+            self.inflight_hi.set(inflight_hi.saturating_add(bytes_acknowledged));
+        }
+    }
+
+    fn update_cwnd(&self, bytes_acknowledged: u32) {
+        if self.state.get() == BbrState::ProbeRtt {
+            self.cwnd.set(self.min_cwnd());
+            return;
+        }
+
+        let cwnd: u32 = self.cwnd.get();
+        let new_cwnd: u32 = match self.bdp(self.cwnd_gain()) {
+            // Grow towards the target, and never beyond it once the pipe is full.
+            Some(target) if self.filled_pipe.get() => min(cwnd.saturating_add(bytes_acknowledged), target),
+            Some(target) if cwnd < target => cwnd.saturating_add(bytes_acknowledged),
+            Some(_) => cwnd,
+            // Until we have a model of the path, grow like slow start does.
+            None => cwnd.saturating_add(bytes_acknowledged),
+        };
+        self.cwnd
+            .set(max(min(new_cwnd, self.inflight_hi.get()), self.min_cwnd()));
+    }
+
+    fn update_pacing_rate(&self) {
+        let bw: u64 = self.max_bw();
+        if bw == 0 {
+            return;
+        }
+        let rate: u64 = (self.pacing_gain() * bw as f64) as u64;
+        // Don't slow down in STARTUP before the pipe is full, as bandwidth samples may still be distorted.
+        if self.filled_pipe.get() || rate > self.pacing_rate.get() {
+            self.pacing_rate.set(rate);
+        }
+    }
+
+    fn on_ack_received_at(&self, now: Instant, send_unacked: SeqNumber, send_next: SeqNumber, ack_seq_no: SeqNumber) {
+        let bytes_acknowledged: u32 = (ack_seq_no - send_unacked).into();
+        if bytes_acknowledged == 0 {
+            return;
+        }
+        let bytes_in_flight: u32 = (send_next - ack_seq_no).into();
+
+        let round_count: u64 = self.round_count.get();
+        self.update_bw(now, bytes_acknowledged, bytes_in_flight);
+        let round_start: bool = self.round_count.get() != round_count;
+
+        self.update_state(now, bytes_in_flight, round_start);
+        self.probe_inflight_hi(bytes_acknowledged);
+        self.update_cwnd(bytes_acknowledged);
+        self.update_pacing_rate();
+    }
+
+    fn on_rtt_sample_at(&self, now: Instant, rtt: Duration) {
+        let expired: bool = now.saturating_duration_since(self.min_rtt_stamp.get()) > MIN_RTT_FILTER_LEN;
+        if expired || self.min_rtt.get().map_or(true, |min_rtt| rtt < min_rtt) {
+            self.min_rtt.set(Some(rtt));
+            self.min_rtt_stamp.set(now);
+        }
+    }
+
+    // Caps the data in flight after a loss, so that we don't keep overflowing the bottleneck buffer.
+    fn on_loss(&self) {
+        let cwnd: u32 = self.cwnd.get();
+        let inflight_hi: u32 = max((cwnd as f64 * BETA) as u32, self.min_cwnd());
+        self.inflight_hi.set(inflight_hi);
+        self.cwnd.set(min(cwnd, inflight_hi));
+
+        // Losses in STARTUP mean that we already filled the pipe.
+        if self.state.get() == BbrState::Startup {
+            self.filled_pipe.set(true);
+        }
+    }
+}
+
+impl SlowStartCongestionAvoidance for Bbr {
+    fn get_cwnd(&self) -> u32 {
+        self.cwnd.get()
+    }
+
+    fn watch_cwnd(&self) -> (u32, WatchFuture<'_, u32>) {
+        self.cwnd.watch()
+    }
+
+    fn on_ack_received(&self, _rto: Duration, send_unacked: SeqNumber, send_next: SeqNumber, ack_seq_no: SeqNumber) {
+        self.on_ack_received_at(Instant::now(), send_unacked, send_next, ack_seq_no)
+    }
+
+    fn on_rto(&self, _send_unacked: SeqNumber) {
+        // Every segment in flight may be lost, so restart from a minimal window and let the model grow it again.
+        self.prior_cwnd.set(self.cwnd.get());
+        self.on_loss();
+        self.cwnd.set(self.mss);
+    }
+
+    fn on_rtt_sample(&self, rtt: Duration) {
+        self.on_rtt_sample_at(Instant::now(), rtt)
+    }
+
+    fn get_pacing_rate(&self) -> Option<u64> {
+        match self.pacing_rate.get() {
+            0 => None,
+            rate => Some(rate),
+        }
+    }
+}
+
+impl FastRetransmitRecovery for Bbr {
+    fn on_loss_detected(&self, _send_unacked: SeqNumber, _send_next: SeqNumber) {
+        self.on_loss();
+    }
+}
+
+impl LimitedTransmit for Bbr {}
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        Bbr,
+        BbrState,
+        SlowStartCongestionAvoidance,
+    };
+    use crate::inetstack::protocols::tcp::SeqNumber;
+    use ::std::time::{
+        Duration,
+        Instant,
+    };
+
+    const MSS: u32 = 1000;
+
+    // Delivers a cwnd worth of data per round trip over a path with a given bandwidth (in bytes per second) and
+    // round-trip time, and returns the next sequence number and time.
+    fn run_rounds(
+        bbr: &Bbr,
+        mut seq_no: SeqNumber,
+        mut now: Instant,
+        bw: u64,
+        rtt: Duration,
+        rounds: usize,
+    ) -> (SeqNumber, Instant) {
+        for _ in 0..rounds {
+            let cwnd: u32 = bbr.get_cwnd();
+            let send_next: SeqNumber = seq_no + SeqNumber::from(cwnd);
+            let num_acks: u32 = cwnd / MSS;
+            // The path delivers at most its bandwidth, so ACKs are spaced by at least the transmission time of a segment.
+            let spacing: Duration = Duration::from_secs_f64(MSS as f64 / bw as f64).max(rtt / num_acks);
+            for _ in 0..num_acks {
+                now += spacing;
+                bbr.on_rtt_sample_at(now, rtt);
+                bbr.on_ack_received_at(now, seq_no, send_next, seq_no + SeqNumber::from(MSS));
+                seq_no = seq_no + SeqNumber::from(MSS);
+            }
+        }
+        (seq_no, now)
+    }
+
+    // Tests that BBR leaves STARTUP once the bandwidth stops growing, and keeps cwnd around the BDP afterwards.
+    #[test]
+    fn test_bbr_converges() {
+        let now: Instant = Instant::now();
+        let bbr: Bbr = Bbr::with_start_time(MSS as usize, now);
+        let bw: u64 = 10_000_000;
+        let rtt: Duration = Duration::from_millis(10);
+        let bdp: u32 = (bw as f64 * rtt.as_secs_f64()) as u32;
+
+        let (seq_no, now): (SeqNumber, Instant) = run_rounds(&bbr, SeqNumber::from(0), now, bw, rtt, 30);
+        assert!(bbr.filled_pipe.get());
+        assert_eq!(bbr.state.get(), BbrState::ProbeBw);
+
+        // The bandwidth estimate matches the bottleneck, and cwnd stays within the cwnd gain of the BDP.
+        let max_bw: u64 = bbr.max_bw();
+        assert!(max_bw >= bw * 9 / 10 && max_bw <= bw * 11 / 10, "max_bw={}", max_bw);
+        run_rounds(&bbr, seq_no, now, bw, rtt, 10);
+        assert!(bbr.get_cwnd() <= 3 * bdp, "cwnd={} bdp={}", bbr.get_cwnd(), bdp);
+        assert!(bbr.get_pacing_rate().is_some());
+    }
+
+    // Tests that losses cap cwnd.
+    #[test]
+    fn test_bbr_loss() {
+        let now: Instant = Instant::now();
+        let bbr: Bbr = Bbr::with_start_time(MSS as usize, now);
+        run_rounds(&bbr, SeqNumber::from(0), now, 10_000_000, Duration::from_millis(10), 5);
+
+        let cwnd: u32 = bbr.get_cwnd();
+        bbr.on_loss();
+        assert!(bbr.filled_pipe.get());
+        assert_eq!(bbr.get_cwnd(), (cwnd as f64 * super::BETA) as u32);
+        assert_eq!(bbr.inflight_hi.get(), bbr.get_cwnd());
+    }
+
+    // Tests that cwnd grows back after a loss episode, as probing for bandwidth raises the inflight cap again.
+    #[test]
+    fn test_bbr_loss_recovery() {
+        let now: Instant = Instant::now();
+        let bbr: Bbr = Bbr::with_start_time(MSS as usize, now);
+        let bw: u64 = 10_000_000;
+        let rtt: Duration = Duration::from_millis(10);
+        let (seq_no, now): (SeqNumber, Instant) = run_rounds(&bbr, SeqNumber::from(0), now, bw, rtt, 30);
+        assert_eq!(bbr.state.get(), BbrState::ProbeBw);
+
+        let cwnd: u32 = bbr.get_cwnd();
+        bbr.on_loss();
+        let inflight_hi: u32 = bbr.inflight_hi.get();
+        assert!(bbr.get_cwnd() < cwnd);
+
+        run_rounds(&bbr, seq_no, now, bw, rtt, 2 * super::PROBE_BW_GAINS.len());
+        assert!(bbr.inflight_hi.get() > inflight_hi);
+        assert!(bbr.get_cwnd() >= cwnd, "cwnd={} before={}", bbr.get_cwnd(), cwnd);
+    }
+
+    // Tests that BBR drains the path to refresh a stale minimum RTT.
+    #[test]
+    fn test_bbr_probe_rtt() {
+        let now: Instant = Instant::now();
+        let bbr: Bbr = Bbr::with_start_time(MSS as usize, now);
+        let rtt: Duration = Duration::from_millis(10);
+        let (seq_no, now): (SeqNumber, Instant) = run_rounds(&bbr, SeqNumber::from(0), now, 10_000_000, rtt, 5);
+
+        // Pretend the minimum RTT estimate is stale.
+        bbr.min_rtt_stamp.set(now - super::MIN_RTT_FILTER_LEN - rtt);
+        let send_next: SeqNumber = seq_no + SeqNumber::from(MSS);
+        bbr.on_ack_received_at(now, seq_no, send_next, send_next);
+        assert_eq!(bbr.state.get(), BbrState::ProbeRtt);
+        assert_eq!(bbr.get_cwnd(), bbr.min_cwnd());
+    }
+}
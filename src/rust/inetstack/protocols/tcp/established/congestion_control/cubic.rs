@@ -349,6 +349,25 @@ impl FastRetransmitRecovery for Cubic {
         // I should really use some other mechanism here just because it would be nicer...
         self.fast_retransmit_now.set_without_notify(false);
     }
+
+    fn on_loss_detected(&self, _send_unacked: SeqNumber, send_next: SeqNumber) {
+        if self.in_fast_recovery.get() {
+            return;
+        }
+
+        // Same window reduction as when entering fast recovery on duplicate ACKs, but RACK does the retransmissions.
+        let cwnd: u32 = self.cwnd.get();
+        let reduced_cwnd: u32 = (cwnd as f32 * Self::BETA_CUBIC) as u32;
+        self.in_fast_recovery.set(true);
+        self.recover.set(send_next);
+        if self.fast_convergence {
+            self.fast_convergence();
+        } else {
+            self.w_max.set(cwnd);
+        }
+        self.ssthresh.set(max(reduced_cwnd, 2 * self.mss));
+        self.cwnd.set(reduced_cwnd);
+    }
 }
 
 impl LimitedTransmit for Cubic {
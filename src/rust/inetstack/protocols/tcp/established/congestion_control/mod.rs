@@ -1,13 +1,17 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+mod bbr;
 mod cubic;
 mod none;
 mod options;
 
 use crate::{
     inetstack::protocols::tcp::SeqNumber,
-    runtime::watched::WatchFuture,
+    runtime::{
+        network::config::CongestionControlAlgorithm,
+        watched::WatchFuture,
+    },
 };
 use ::std::{
     fmt::Debug,
@@ -15,6 +19,7 @@ use ::std::{
 };
 
 pub use self::{
+    bbr::Bbr,
     cubic::Cubic,
     none::None,
     options::{
@@ -42,6 +47,14 @@ pub trait SlowStartCongestionAvoidance {
 
     // Called immediately before a segment is sent for the 1st time.
     fn on_send(&self, _rto: Duration, _num_sent_bytes: u32) {}
+
+    // Called when a new round-trip time sample is taken.
+    fn on_rtt_sample(&self, _rtt: Duration) {}
+
+    // Rate (in bytes per second) at which the sender should pace segments out, if any.
+    fn get_pacing_rate(&self) -> Option<u64> {
+        None
+    }
 }
 
 pub trait FastRetransmitRecovery
@@ -60,6 +73,10 @@ where
     }
 
     fn on_fast_retransmit(&self) {}
+
+    // Called when time-based loss detection (RACK) finds lost segments, at most once per recovery episode.  The
+    // caller retransmits these segments itself.
+    fn on_loss_detected(&self, _send_unacked: SeqNumber, _send_next: SeqNumber) {}
 }
 
 pub trait LimitedTransmit
@@ -81,3 +98,12 @@ pub trait CongestionControl: SlowStartCongestionAvoidance + FastRetransmitRecove
 }
 
 pub type CongestionControlConstructor = fn(usize, SeqNumber, Option<options::Options>) -> Box<dyn CongestionControl>;
+
+/// Returns the constructor of a congestion control algorithm.
+pub fn constructor(algorithm: CongestionControlAlgorithm) -> CongestionControlConstructor {
+    match algorithm {
+        CongestionControlAlgorithm::None => self::None::new,
+        CongestionControlAlgorithm::Cubic => Cubic::new,
+        CongestionControlAlgorithm::Bbr => Bbr::new,
+    }
+}
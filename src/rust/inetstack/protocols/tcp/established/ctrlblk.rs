@@ -6,6 +6,15 @@ use super::{
         self,
         CongestionControlConstructor,
     },
+    pacer::Pacer,
+    rack::{
+        LossTimer,
+        Rack,
+    },
+    reassembly::{
+        ReassemblyQueue,
+        MAX_SACK_BLOCKS,
+    },
     rto::RtoCalculator,
     sender::{
         Sender,
@@ -19,11 +28,16 @@ use crate::{
             EtherType2,
             Ethernet2Header,
         },
-        ip::IpProtocol,
+        ip::{
+            template::HeaderTemplate,
+            IpProtocol,
+        },
         ipv4::Ipv4Header,
         tcp::{
             segment::{
+                SelectiveAcknowlegement,
                 TcpHeader,
+                TcpOptions2,
                 TcpSegment,
             },
             SeqNumber,
@@ -37,6 +51,7 @@ use crate::{
         },
         network::{
             config::TcpConfig,
+            consts::MAX_SEGMENTATION_OFFLOAD_SIZE,
             types::MacAddress,
             NetworkRuntime,
         },
@@ -52,6 +67,7 @@ use ::std::{
     cell::{
         Cell,
         RefCell,
+        RefMut,
     },
     collections::VecDeque,
     convert::TryInto,
@@ -74,10 +90,11 @@ use ::std::{
 // mechanism used to manage the receive queue (a VecDeque) than anything else.
 const RECV_QUEUE_SZ: usize = 2048;
 
-// ToDo: Review this value (and its purpose).  It (16 segments) seems awfully small (would make fast retransmit less
-// useful), and this mechanism isn't the best way to protect ourselves against deliberate out-of-order segment attacks.
-// Ideally, we'd limit out-of-order data to that which (along with the unread data) will fit in the receive window.
-const MAX_OUT_OF_ORDER: usize = 16;
+// ToDo: Review this value (and its purpose).  It limits the number of holes (not segments) that we track in the
+// out-of-order store, which is searched in logarithmic time, to protect ourselves against deliberate out-of-order
+// segment attacks.  Ideally, we'd limit out-of-order data to that which (along with the unread data) will fit in the
+// receive window.
+const MAX_OUT_OF_ORDER: usize = 1024;
 
 // TCP Connection State.
 // Note: This ControlBlock structure is only used after we've reached the ESTABLISHED state, so states LISTEN,
@@ -161,6 +178,10 @@ pub struct ControlBlock {
     // this along with other remote IP information (such as routing, path MTU, etc).
     arp: Rc<ArpPeer>,
 
+    // Prebuilt headers of the segments that we send, which also hold the link address of our peer.  It is rebuilt
+    // whenever the ARP cache changes.
+    header_template: Cell<Option<HeaderTemplate>>,
+
     // Send-side state information.  ToDo: Consider incorporating this directly into ControlBlock.
     sender: Sender,
 
@@ -188,7 +209,7 @@ pub struct ControlBlock {
     // receive window) but can't yet present to the user because we're missing some other data that comes between this
     // and what we've already presented to the user.
     //
-    out_of_order: RefCell<VecDeque<(SeqNumber, Buffer)>>,
+    out_of_order: RefCell<ReassemblyQueue>,
 
     // The sequence number of the FIN, if we received it out-of-order.
     // Note: This could just be a boolean to remember if we got a FIN; the sequence number is for checking correctness.
@@ -210,6 +231,18 @@ pub struct ControlBlock {
 
     // Retransmission Timeout (RTO) calculator.
     rto: RefCell<RtoCalculator>,
+
+    // Whether both ends agreed to use selective acknowledgements (RFC 2018).  This also enables RACK-TLP loss recovery.
+    sack_permitted: bool,
+
+    // RACK-TLP loss detection state (RFC 8985).
+    rack: RefCell<Rack>,
+
+    // Expiration time of the RACK reordering timer or of the tail loss probe timer, whichever is armed.
+    loss_deadline: WatchedValue<Option<(Instant, LossTimer)>>,
+
+    // Paces new segments out at the rate of the congestion control algorithm, if it has one.
+    pacer: Pacer,
 }
 
 //==============================================================================
@@ -232,6 +265,7 @@ impl ControlBlock {
         sender_window_size: u32,
         sender_window_scale: u8,
         sender_mss: usize,
+        sack_permitted: bool,
         cc_constructor: CongestionControlConstructor,
         congestion_control_options: Option<congestion_control::Options>,
     ) -> Self {
@@ -245,6 +279,7 @@ impl ControlBlock {
             local_link_addr,
             tcp_config,
             arp: Rc::new(arp),
+            header_template: Cell::new(None),
             sender: sender,
             state: Cell::new(State::Established),
             ack_delay_timeout,
@@ -252,13 +287,17 @@ impl ControlBlock {
             receive_buffer_size: receiver_window_size,
             window_scale: receiver_window_scale,
             waker: RefCell::new(None),
-            out_of_order: RefCell::new(VecDeque::new()),
+            out_of_order: RefCell::new(ReassemblyQueue::new(receiver_seq_no, MAX_OUT_OF_ORDER)),
             out_of_order_fin: Cell::new(Option::None),
             receiver: Receiver::new(receiver_seq_no, receiver_seq_no),
             user_is_done_sending: Cell::new(false),
             cc: cc_constructor(sender_mss, sender_seq_no, congestion_control_options),
             retransmit_deadline: WatchedValue::new(None),
             rto: RefCell::new(RtoCalculator::new()),
+            sack_permitted,
+            rack: RefCell::new(Rack::new()),
+            loss_deadline: WatchedValue::new(None),
+            pacer: Pacer::new(),
         }
     }
 
@@ -270,9 +309,42 @@ impl ControlBlock {
         self.remote
     }
 
-    // ToDo: Remove this.  ARP doesn't belong at this layer.
-    pub fn arp(&self) -> Rc<ArpPeer> {
-        self.arp.clone()
+    /// Returns the link address of our peer, if it is resolved.
+    pub fn remote_link_addr(&self) -> Option<MacAddress> {
+        self.header_template().map(|template| template.remote_link_addr())
+    }
+
+    /// Resolves the link address of our peer, querying it through ARP if needed.
+    pub async fn resolve_remote_link_addr(&self) -> Result<MacAddress, Fail> {
+        match self.remote_link_addr() {
+            Some(remote_link_addr) => Ok(remote_link_addr),
+            None => self.arp.query(self.remote.ip().clone()).await,
+        }
+    }
+
+    /// Returns the header template of this connection, which is rebuilt if the ARP cache changed since it was built,
+    /// or `None` if the link address of our peer is not resolved.
+    fn header_template(&self) -> Option<HeaderTemplate> {
+        let arp_generation: u64 = self.arp.generation();
+        if let Some(template) = self.header_template.get() {
+            if template.arp_generation() == arp_generation {
+                return Some(template);
+            }
+        }
+
+        let remote_link_addr: MacAddress = self.arp.try_query(self.remote.ip().clone())?;
+        let segment: TcpSegment = TcpSegment {
+            ethernet2_hdr: Ethernet2Header::new(remote_link_addr, self.local_link_addr, EtherType2::Ipv4),
+            ipv4_hdr: Ipv4Header::new(self.local.ip().clone(), self.remote.ip().clone(), IpProtocol::TCP),
+            tcp_hdr: TcpHeader::new(self.local.port(), self.remote.port()),
+            data: None,
+            tx_checksum_offload: false,
+            tx_segment_size: None,
+            template: None,
+        };
+        let template: HeaderTemplate = HeaderTemplate::new(&segment, remote_link_addr, arp_generation);
+        self.header_template.set(Some(template));
+        Some(template)
     }
 
     pub fn send(&self, buf: Buffer) -> Result<(), Fail> {
@@ -307,6 +379,16 @@ impl ControlBlock {
         self.cc.watch_cwnd()
     }
 
+    // Returns the time at which the next new segment may be sent, if pacing holds it back.
+    pub fn pacing_release_time(&self) -> Option<Instant> {
+        self.pacer.release_time(self.clock.now())
+    }
+
+    pub fn pacing_on_send(&self, num_sent_bytes: usize) {
+        self.pacer
+            .on_send(self.clock.now(), num_sent_bytes, self.cc.get_pacing_rate())
+    }
+
     pub fn congestion_control_get_limited_transmit_cwnd_increase(&self) -> u32 {
         self.cc.get_limited_transmit_cwnd_increase()
     }
@@ -319,6 +401,16 @@ impl ControlBlock {
         self.sender.get_mss()
     }
 
+    // Returns the size of the largest segment that we may hand to the runtime, which exceeds the MSS when the NIC
+    // segments packets for us.
+    pub fn get_send_segment_size(&self) -> usize {
+        if self.tcp_config.get_tx_segmentation_offload() {
+            MAX_SEGMENTATION_OFFLOAD_SIZE
+        } else {
+            self.get_mss()
+        }
+    }
+
     pub fn get_send_window(&self) -> (u32, WatchFuture<u32>) {
         self.sender.get_send_window()
     }
@@ -351,8 +443,18 @@ impl ControlBlock {
         self.retransmit_deadline.watch()
     }
 
-    pub fn pop_unacked_segment(&self) -> Option<UnackedSegment> {
-        self.sender.pop_unacked_segment()
+    pub fn retransmit_first_unacked_segment(&self) -> Option<Buffer> {
+        self.sender.retransmit_first_unacked_segment(self.clock.now())
+    }
+
+    pub fn watch_loss_deadline(&self) -> (Option<(Instant, LossTimer)>, WatchFuture<Option<(Instant, LossTimer)>>) {
+        self.loss_deadline.watch()
+    }
+
+    pub fn rack_on_delivered(&self, xmit_ts: Instant, end_seq: SeqNumber, retransmitted: bool, now: Instant) {
+        self.rack
+            .borrow_mut()
+            .on_delivered(xmit_ts, end_seq, retransmitted, now)
     }
 
     pub fn push_unacked_segment(&self, segment: UnackedSegment) {
@@ -360,7 +462,8 @@ impl ControlBlock {
     }
 
     pub fn rto_add_sample(&self, rtt: Duration) {
-        self.rto.borrow_mut().add_sample(rtt)
+        self.rto.borrow_mut().add_sample(rtt);
+        self.cc.on_rtt_sample(rtt)
     }
 
     pub fn rto_estimate(&self) -> Duration {
@@ -383,6 +486,42 @@ impl ControlBlock {
         self.sender.pop_one_unsent_byte()
     }
 
+    // This routine receives a batch of in-order segments that only differ by their sequence numbers, as coalesced by
+    // the TCP peer.  The data that follows the first segment is placed in the out-of-order store, so that the header
+    // is processed (and acknowledged) once and all the data is received along with the first segment.
+    //
+    pub fn receive_coalesced(&self, header: &mut TcpHeader, data: Buffer, rest: Vec<(SeqNumber, Buffer)>) {
+        let batch_end: SeqNumber = match rest.last() {
+            Some((seq_num, buf)) => *seq_num + SeqNumber::from(buf.len() as u32),
+            None => return self.receive(header, data),
+        };
+        let receive_next: SeqNumber = self.receiver.receive_next.get();
+        let after_receive_window: SeqNumber = receive_next + SeqNumber::from(self.get_receive_window_size());
+
+        match self.state.get() {
+            State::Established | State::FinWait1 | State::FinWait2
+                if header.seq_num == receive_next && batch_end <= after_receive_window =>
+            {
+                {
+                    let mut out_of_order: RefMut<ReassemblyQueue> = self.out_of_order.borrow_mut();
+                    for (seq_num, buf) in rest {
+                        out_of_order.insert(receive_next, seq_num, buf);
+                    }
+                }
+                self.receive(header, data);
+            },
+            // Otherwise, fall back to receiving the segments one by one.
+            _ => {
+                let mut next_header: TcpHeader = header.clone();
+                self.receive(header, data);
+                for (seq_num, buf) in rest {
+                    next_header.seq_num = seq_num;
+                    self.receive(&mut next_header.clone(), buf);
+                }
+            },
+        }
+    }
+
     // This is the main TCP receive routine.
     //
     pub fn receive(&self, mut header: &mut TcpHeader, mut data: Buffer) {
@@ -658,6 +797,11 @@ impl ControlBlock {
             // ToDo: Implement fast-retransmit.  In which case, we'd increment our dup-ack counter here.
         }
 
+        // Detect and retransmit lost segments, now that we know what our peer received.
+        if self.sack_permitted {
+            self.recover_losses(header, now);
+        }
+
         // ToDo: Check the URG bit.  If we decide to support this, how should we do it?
         if header.urg {
             warn!("Got packet with URG bit set!");
@@ -796,6 +940,14 @@ impl ControlBlock {
         header.ack = true;
         header.ack_num = self.receiver.receive_next.get();
 
+        // Tell our peer about the out-of-order data that we hold, if it understands.
+        if self.sack_permitted {
+            let (sacks, num_sacks): ([SelectiveAcknowlegement; MAX_SACK_BLOCKS], usize) = self.get_sack_blocks();
+            if num_sacks > 0 {
+                header.push_option(TcpOptions2::SelectiveAcknowlegement { num_sacks, sacks });
+            }
+        }
+
         // Return this header.
         header
     }
@@ -810,7 +962,7 @@ impl ControlBlock {
 
         // ToDo: Remove this if clause once emit() is fixed to not require the remote hardware addr (this should be
         // left to the ARP layer and not exposed to TCP).
-        if let Some(remote_link_addr) = self.arp().try_query(self.remote.ip().clone()) {
+        if let Some(remote_link_addr) = self.remote_link_addr() {
             self.emit(header, None, remote_link_addr);
         }
     }
@@ -831,6 +983,11 @@ impl ControlBlock {
 
         let sent_fin: bool = header.fin;
 
+        // Segments with options don't fit the header template, and neither do those to another link address.
+        let template: Option<HeaderTemplate> = self
+            .header_template()
+            .filter(|template| template.remote_link_addr() == remote_link_addr && header.num_options == 0);
+
         // Prepare description of TCP segment to send.
         // ToDo: Change this to call lower levels to fill in their header information, handle routing, ARPing, etc.
         let segment = TcpSegment {
@@ -839,6 +996,12 @@ impl ControlBlock {
             tcp_hdr: header,
             data: body,
             tx_checksum_offload: self.tcp_config.get_tx_checksum_offload(),
+            tx_segment_size: if self.tcp_config.get_tx_segmentation_offload() {
+                Some(self.get_mss())
+            } else {
+                None
+            },
+            template,
         };
 
         // Call the runtime to send the segment.
@@ -869,6 +1032,133 @@ impl ControlBlock {
         self.sender.remote_mss()
     }
 
+    /// Returns the number of segments that were retransmitted on this connection.
+    pub fn retransmissions(&self) -> u64 {
+        self.sender.retransmissions()
+    }
+
+    /// Returns the number of runs of out-of-order data that this connection holds.
+    pub fn out_of_order_len(&self) -> usize {
+        self.out_of_order.borrow().len()
+    }
+
+    /// Runs RACK-TLP loss detection (RFC 8985) after an acknowledgement comes in, and retransmits lost segments.
+    fn recover_losses(&self, header: &TcpHeader, now: Instant) {
+        let mut rack = self.rack.borrow_mut();
+        rack.on_ack(header.ack_num);
+
+        // Update the scoreboard with the segments that our peer selectively acknowledged.
+        for option in header.iter_options() {
+            if let TcpOptions2::SelectiveAcknowlegement { num_sacks, sacks } = option {
+                self.sender.on_sack(&sacks[..*num_sacks], &mut rack, now);
+            }
+        }
+
+        let (newly_lost, reordering): (bool, Option<Duration>) = self.sender.detect_loss(&rack, now);
+        if newly_lost {
+            let (send_unacknowledged, _): (SeqNumber, _) = self.sender.get_send_unacked();
+            let (send_next, _): (SeqNumber, _) = self.sender.get_send_next();
+            if rack.enter_recovery(send_next) {
+                self.cc.on_loss_detected(send_unacknowledged, send_next);
+            }
+        }
+        drop(rack);
+
+        if newly_lost {
+            self.retransmit_lost_segments(now);
+        }
+        match reordering {
+            Some(timeout) => self.loss_deadline.set(Some((now + timeout, LossTimer::Reordering))),
+            None => {
+                self.loss_deadline.set(None);
+                self.schedule_loss_probe(now);
+            },
+        }
+    }
+
+    /// Handles the expiration of the RACK reordering timer or of the tail loss probe timer.
+    pub fn on_loss_timeout(&self, timer: LossTimer) {
+        let now: Instant = self.clock.now();
+        self.loss_deadline.set(None);
+        match timer {
+            LossTimer::Reordering => {
+                // Segments whose reordering window closed are now lost.
+                let (newly_lost, reordering): (bool, Option<Duration>) =
+                    self.sender.detect_loss(&self.rack.borrow(), now);
+                if newly_lost {
+                    let (send_unacknowledged, _): (SeqNumber, _) = self.sender.get_send_unacked();
+                    let (send_next, _): (SeqNumber, _) = self.sender.get_send_next();
+                    if self.rack.borrow_mut().enter_recovery(send_next) {
+                        self.cc.on_loss_detected(send_unacknowledged, send_next);
+                    }
+                    self.retransmit_lost_segments(now);
+                }
+                if let Some(timeout) = reordering {
+                    self.loss_deadline.set(Some((now + timeout, LossTimer::Reordering)));
+                }
+            },
+            LossTimer::Probe => {
+                // Retransmit the last segment, so that its acknowledgement (or lack thereof) reveals any tail loss.
+                // ToDo: Send new data instead, if we have some that fits in the send window.
+                if let Some((seq_no, bytes)) = self.sender.retransmit_last_unacked_segment(now) {
+                    trace!("Sending tail loss probe at {}", seq_no);
+                    let (send_next, _): (SeqNumber, _) = self.sender.get_send_next();
+                    self.rack.borrow_mut().on_probe_sent(send_next);
+                    self.retransmit(seq_no, bytes);
+                }
+            },
+        }
+    }
+
+    /// Arms the tail loss probe timer, unless loss recovery is already under way.
+    pub fn schedule_loss_probe(&self, now: Instant) {
+        if !self.sack_permitted {
+            return;
+        }
+        if let Some((_, LossTimer::Reordering)) = self.loss_deadline.get() {
+            return;
+        }
+
+        // We probe only with data in flight, outside of recovery, and once we have a round-trip time estimate.
+        let (send_unacknowledged, _): (SeqNumber, _) = self.sender.get_send_unacked();
+        let (send_next, _): (SeqNumber, _) = self.sender.get_send_next();
+        let srtt: Option<Duration> = self.rto.borrow().smoothed_rtt();
+        match srtt {
+            Some(srtt) if send_unacknowledged != send_next && self.rack.borrow().can_probe() => {
+                let pto: Duration = Rack::probe_timeout(
+                    srtt,
+                    self.rto.borrow().estimate(),
+                    self.sender.has_single_unacked_segment(),
+                );
+                self.loss_deadline.set(Some((now + pto, LossTimer::Probe)));
+            },
+            _ => self.loss_deadline.set(None),
+        }
+    }
+
+    /// Retransmits the segments that are considered lost.
+    fn retransmit_lost_segments(&self, now: Instant) {
+        for (seq_no, bytes) in self.sender.retransmit_lost_segments(now) {
+            debug!("Retransmitting lost segment at {}", seq_no);
+            self.retransmit(seq_no, bytes);
+        }
+    }
+
+    /// Retransmits a segment that starts at a given sequence number.
+    fn retransmit(&self, seq_no: SeqNumber, bytes: Buffer) {
+        let mut header: TcpHeader = self.tcp_header();
+        header.seq_num = seq_no;
+        if bytes.is_empty() {
+            // This buffer is the end-of-send marker.
+            header.fin = true;
+        }
+
+        // ToDo: Remove this if clause once emit() is fixed to not require the remote hardware addr.
+        if let Some(remote_link_addr) = self.remote_link_addr() {
+            self.emit(header, Some(bytes), remote_link_addr);
+        }
+    }
+
     pub fn get_ack_deadline(&self) -> (Option<Instant>, WatchFuture<Option<Instant>>) {
         self.ack_deadline.watch()
     }
@@ -925,100 +1215,17 @@ impl ControlBlock {
 
     // This routine takes an incoming TCP segment and adds it to the out-of-order receive queue.
     // If the new segment had a FIN it has been removed prior to this routine being called.
-    // Note: Since this is not the "fast path", this is written for clarity over efficiency.
     //
-    pub fn store_out_of_order_segment(&self, mut new_start: SeqNumber, mut new_end: SeqNumber, mut buf: Buffer) {
-        let mut out_of_order = self.out_of_order.borrow_mut();
-        let mut action_index: usize = out_of_order.len();
-        let mut another_pass_neeeded: bool = true;
-
-        while another_pass_neeeded {
-            another_pass_neeeded = false;
-
-            // Find the new segment's place in the out-of-order store.
-            // The out-of-order store is sorted by starting sequence number, and contains no duplicate data.
-            action_index = out_of_order.len();
-            for index in 0..out_of_order.len() {
-                let stored_segment: &(SeqNumber, Buffer) = &out_of_order[index];
-
-                // Properties of the segment stored at this index.
-                let stored_start: SeqNumber = stored_segment.0;
-                let stored_len: u32 = stored_segment.1.len() as u32;
-                debug_assert_ne!(stored_len, 0);
-                let stored_end: SeqNumber = stored_start + SeqNumber::from(stored_len - 1);
-
-                //
-                // The new data segment has six possibilites when compared to an existing out-of-order segment:
-                //
-                //                                |<- out-of-order segment ->|
-                //
-                // |<- new before->|    |<- new front overlap ->|    |<- new end overlap ->|    |<- new after ->|
-                //                                   |<- new duplicate ->|
-                //                            |<- new completely encompassing ->|
-                //
-                if new_start < stored_start {
-                    // The new segment starts before the start of this out-of-order segment.
-                    if new_end < stored_start {
-                        // The new segment comes completely before this out-of-order segment.
-                        // Since the out-of-order store is sorted, we don't need to check for overlap with any more.
-                        action_index = index;
-                        break;
-                    }
-                    // The end of the new segment overlaps with the start of this out-of-order segment.
-                    if stored_end < new_end {
-                        // The new segment ends after the end of this out-of-order segment.  In other words, the new
-                        // segment completely encompasses the out-of-order segment.
-
-                        // Set flags to remove the currently stored segment and re-run the insertion loop, as the
-                        // new segment may completely encompass even more segments.
-                        another_pass_neeeded = true;
-                        action_index = index;
-                        break;
-                    }
-                    // We have some data overlap between the new segment and the front of the out-of-order segment.
-                    // Trim the end of the new segment and stop checking for out-of-order overlap.
-                    let excess: u32 = u32::from(new_end - stored_start) + 1;
-                    new_end = new_end - SeqNumber::from(excess);
-                    buf.trim(excess as usize);
-                    break;
-                } else {
-                    // The new segment starts at or after the start of this out-of-order segment.
-                    // This is the stored_start <= new_start case.
-                    if new_end <= stored_end {
-                        // And the new segment ends at or before this out-of-order segment.
-                        // The new segment's data is a complete duplicate of this out-of-order segment's data.
-                        // Just drop the new segment.
-                        return;
-                    }
-                    if stored_end < new_start {
-                        // The new segment comes entirely after this out-of-order segment.
-                        // Continue to check the next out-of-order segment for potential overlap.
-                        continue;
-                    }
-                    // We have some data overlap between the new segment and the end of the out-of-order segment.
-                    // Adjust the beginning of the new segment and continue on to check the next out-of-order segment.
-                    let duplicate: u32 = u32::from(stored_end - new_start);
-                    new_start = new_start + SeqNumber::from(duplicate);
-                    buf.adjust(duplicate as usize);
-                    continue;
-                }
-            }
-
-            if another_pass_neeeded {
-                // The new segment completely encompassed an existing segment, which we will now remove.
-                out_of_order.remove(action_index);
-            }
-        }
-
-        // Insert the new segment into the correct position.
-        out_of_order.insert(action_index, (new_start, buf));
+    pub fn store_out_of_order_segment(&self, new_start: SeqNumber, new_end: SeqNumber, buf: Buffer) {
+        debug_assert_eq!(u32::from(new_end - new_start) + 1, buf.len() as u32);
+        let receive_next: SeqNumber = self.receiver.receive_next.get();
+        self.out_of_order.borrow_mut().insert(receive_next, new_start, buf);
+    }
 
-        // If the out-of-order store now contains too many entries, delete the later entries.
-        // ToDo: The out-of-order store is already limited (in size) by our receive window, while the below check
-        // imposes a limit on the number of entries.  Do we need this?  Presumably for attack mitigation?
-        while out_of_order.len() > MAX_OUT_OF_ORDER {
-            out_of_order.pop_back();
-        }
+    // This routine returns the SACK blocks (RFC 2018) that describe the data held in the out-of-order receive queue.
+    //
+    pub fn get_sack_blocks(&self) -> ([SelectiveAcknowlegement; MAX_SACK_BLOCKS], usize) {
+        self.out_of_order.borrow().sack_blocks()
     }
 
     // This routine takes an incoming in-order TCP segment and adds the data to the user's receive queue.  If the new
@@ -1041,24 +1248,17 @@ impl ControlBlock {
 
         // Okay, we've successfully received some new data.  Check if any of the formerly out-of-order data waiting in
         // the out-of-order queue is now in-order.  If so, we can move it to the receive queue.
+        // Since the out-of-order store merges adjacent data, at most one run of segments can now be in-order.
         let mut added_out_of_order: bool = false;
-        let mut out_of_order = self.out_of_order.borrow_mut();
-        while !out_of_order.is_empty() {
-            if let Some(stored_entry) = out_of_order.front() {
-                if stored_entry.0 == recv_next {
-                    // Move this entry's buffer from the out-of-order store to the receive queue.
-                    // This data is now considered to be "received" by TCP, and included in our RCV.NXT calculation.
-                    debug!("Recovering out-of-order packet at {}", recv_next);
-                    if let Some(temp) = out_of_order.pop_front() {
-                        recv_next = recv_next + SeqNumber::from(temp.1.len() as u32);
-                        self.receiver.push(temp.1);
-                        added_out_of_order = true;
-                    }
-                } else {
-                    // Since our out-of-order list is sorted, we can stop when the next segment is not in sequence.
-                    break;
-                }
+        if let Some(segments) = self.out_of_order.borrow_mut().pop(recv_next) {
+            // Move this run's buffers from the out-of-order store to the receive queue.
+            // This data is now considered to be "received" by TCP, and included in our RCV.NXT calculation.
+            debug!("Recovering {} out-of-order packets at {}", segments.len(), recv_next);
+            for segment in segments {
+                recv_next = recv_next + SeqNumber::from(segment.len() as u32);
+                self.receiver.push(segment);
             }
+            added_out_of_order = true;
         }
 
         // ToDo: Review recent change to update control block copy of recv_next upon each push to the receiver.
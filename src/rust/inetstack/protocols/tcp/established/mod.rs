@@ -4,6 +4,9 @@
 mod background;
 pub mod congestion_control;
 mod ctrlblk;
+mod pacer;
+mod rack;
+mod reassembly;
 mod rto;
 mod sender;
 
@@ -16,7 +19,10 @@ use self::background::background;
 use crate::{
     inetstack::{
         futures::FutureOperation,
-        protocols::tcp::segment::TcpHeader,
+        protocols::tcp::{
+            segment::TcpHeader,
+            SeqNumber,
+        },
     },
     runtime::{
         fail::Fail,
@@ -65,6 +71,10 @@ impl EstablishedSocket {
         self.cb.receive(header, data)
     }
 
+    pub fn receive_coalesced(&self, mut header: TcpHeader, data: Buffer, rest: Vec<(SeqNumber, Buffer)>) {
+        self.cb.receive_coalesced(&mut header, data, rest)
+    }
+
     pub fn send(&self, buf: Buffer) -> Result<(), Fail> {
         self.cb.send(buf)
     }
@@ -88,4 +98,8 @@ impl EstablishedSocket {
     pub fn endpoints(&self) -> (SocketAddrV4, SocketAddrV4) {
         (self.cb.get_local(), self.cb.get_remote())
     }
+
+    pub fn stats(&self) -> (u64, usize) {
+        (self.cb.retransmissions(), self.cb.out_of_order_len())
+    }
 }
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use ::std::{
+    cell::Cell,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Segment Pacer
+///
+/// Spaces outgoing segments at the pacing rate of the congestion control algorithm, so that a connection sends its
+/// congestion window smoothly over a round trip instead of in a single burst. Each segment that is sent pushes the
+/// release time of the next one by its transmission time at the pacing rate. Idle periods don't build up credit.
+#[derive(Debug)]
+pub struct Pacer {
+    /// Time at which the next segment may be sent, if the last one was paced.
+    next_send: Cell<Option<Instant>>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Segment Pacers
+impl Pacer {
+    /// Creates a pacer that releases the first segment at once.
+    pub fn new() -> Self {
+        Self {
+            next_send: Cell::new(None),
+        }
+    }
+
+    /// Returns the time at which the next segment may be sent, if it should be held back at `now`.
+    pub fn release_time(&self, now: Instant) -> Option<Instant> {
+        self.next_send.get().filter(|next_send| *next_send > now)
+    }
+
+    /// Records that `num_bytes` were sent at `now`, given the current pacing rate (in bytes per second), if any.
+    pub fn on_send(&self, now: Instant, num_bytes: usize, pacing_rate: Option<u64>) {
+        let next_send: Option<Instant> = match pacing_rate {
+            Some(rate) if rate > 0 => {
+                let interval: Duration = Duration::from_secs_f64(num_bytes as f64 / rate as f64);
+                Some(self.release_time(now).unwrap_or(now) + interval)
+            },
+            _ => None,
+        };
+        self.next_send.set(next_send);
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::Pacer;
+    use ::std::time::{
+        Duration,
+        Instant,
+    };
+
+    /// Tests that segments are spaced by their transmission time at the pacing rate.
+    #[test]
+    fn test_pacer_spacing() {
+        let now: Instant = Instant::now();
+        let pacer: Pacer = Pacer::new();
+        assert_eq!(pacer.release_time(now), None);
+
+        // 1000 bytes at 1 MB/s take 1 ms.
+        pacer.on_send(now, 1000, Some(1_000_000));
+        assert_eq!(pacer.release_time(now), Some(now + Duration::from_millis(1)));
+
+        // Back-to-back segments queue up behind each other.
+        pacer.on_send(now, 1000, Some(1_000_000));
+        assert_eq!(pacer.release_time(now), Some(now + Duration::from_millis(2)));
+        assert_eq!(pacer.release_time(now + Duration::from_millis(2)), None);
+    }
+
+    /// Tests that idle periods don't let a burst through, and that segments are released at once without a rate.
+    #[test]
+    fn test_pacer_idle() {
+        let now: Instant = Instant::now();
+        let pacer: Pacer = Pacer::new();
+        pacer.on_send(now, 1000, Some(1_000_000));
+
+        let later: Instant = now + Duration::from_secs(1);
+        pacer.on_send(later, 1000, Some(1_000_000));
+        assert_eq!(pacer.release_time(later), Some(later + Duration::from_millis(1)));
+
+        pacer.on_send(later, 1000, None);
+        assert_eq!(pacer.release_time(later), None);
+    }
+}
@@ -0,0 +1,276 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::inetstack::protocols::tcp::SeqNumber;
+use ::std::time::{
+    Duration,
+    Instant,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Worst case delayed ACK timer, which is added to the probe timeout when a single segment is in flight (RFC 8985).
+const WORST_CASE_ACK_DELAY: Duration = Duration::from_millis(200);
+
+//==============================================================================
+// Enumerations
+//==============================================================================
+
+/// Timers of RACK-TLP loss recovery.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum LossTimer {
+    /// Reordering window of a segment closes.
+    Reordering,
+    /// Tail loss probe is due.
+    Probe,
+}
+
+/// Outcome of checking an unacknowledged segment for loss.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum LossCheck {
+    /// The segment is lost.
+    Lost,
+    /// The segment is lost if it is still unacknowledged once this much time elapses.
+    Reordering(Duration),
+    /// Nothing sent after this segment was delivered yet.
+    Unknown,
+}
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// RACK-TLP Loss Detection
+///
+/// Implements the time-based loss detection of RFC 8985. RACK remembers the most recently sent segment that was
+/// delivered (i.e. cumulatively or selectively acknowledged) and considers any segment that was sent sufficiently
+/// earlier than it lost, so that several losses in a window are recovered in a single round trip. A Tail Loss Probe
+/// (TLP) retransmits the last segment when acknowledgements stop coming, so that losses at the tail of a flight are
+/// detected without waiting for the retransmission timeout.
+#[derive(Debug)]
+pub struct Rack {
+    /// Transmission time of the most recently sent segment that was delivered (RACK.xmit_ts).
+    xmit_ts: Option<Instant>,
+    /// Ending sequence number of that segment (RACK.end_seq).
+    end_seq: SeqNumber,
+    /// Round-trip time of that segment (RACK.rtt).
+    rtt: Duration,
+    /// Minimum round-trip time observed.
+    min_rtt: Option<Duration>,
+    /// SND.NXT when the current recovery episode started, if any.
+    recovery_point: Option<SeqNumber>,
+    /// SND.NXT when the outstanding tail loss probe was sent, if any (TLP.end_seq).
+    probe_end: Option<SeqNumber>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for RACK-TLP Loss Detection
+impl Rack {
+    /// Creates the loss detection state of a connection.
+    pub fn new() -> Self {
+        Self {
+            xmit_ts: None,
+            end_seq: SeqNumber::from(0),
+            rtt: Duration::ZERO,
+            min_rtt: None,
+            recovery_point: None,
+            probe_end: None,
+        }
+    }
+
+    /// Records that a segment that was last sent at `xmit_ts` and ends at `end_seq` was delivered.
+    pub fn on_delivered(&mut self, xmit_ts: Instant, end_seq: SeqNumber, retransmitted: bool, now: Instant) {
+        let rtt: Duration = now.saturating_duration_since(xmit_ts);
+
+        // An acknowledgement that comes sooner than a round trip after a retransmission is for the original one.
+        if retransmitted && self.min_rtt.map_or(false, |min_rtt| rtt < min_rtt) {
+            return;
+        }
+        self.min_rtt = Some(self.min_rtt.map_or(rtt, |min_rtt| min_rtt.min(rtt)));
+
+        if self.is_newer(xmit_ts, end_seq) {
+            self.xmit_ts = Some(xmit_ts);
+            self.end_seq = end_seq;
+            self.rtt = rtt;
+        }
+    }
+
+    /// Checks if a segment that was last sent at `xmit_ts`, ends at `end_seq`, and is still unacknowledged is lost.
+    pub fn check(&self, xmit_ts: Instant, end_seq: SeqNumber, now: Instant) -> LossCheck {
+        match self.xmit_ts {
+            Some(_) if !self.is_newer(xmit_ts, end_seq) => {
+                let deadline: Instant = xmit_ts + self.rtt + self.reordering_window();
+                if deadline <= now {
+                    LossCheck::Lost
+                } else {
+                    LossCheck::Reordering(deadline - now)
+                }
+            },
+            _ => LossCheck::Unknown,
+        }
+    }
+
+    /// Returns how long a segment may be outstanding after a later one was delivered before we consider it lost.
+    pub fn reordering_window(&self) -> Duration {
+        self.min_rtt.map_or(Duration::ZERO, |min_rtt| min_rtt / 4)
+    }
+
+    /// Updates the recovery state given the cumulative acknowledgement of an incoming segment.
+    pub fn on_ack(&mut self, ack_num: SeqNumber) {
+        if self.recovery_point.map_or(false, |point| ack_num >= point) {
+            self.recovery_point = None;
+        }
+        if self.probe_end.map_or(false, |end| ack_num >= end) {
+            self.probe_end = None;
+        }
+    }
+
+    /// Starts a recovery episode, unless one is in progress. Returns true if a new episode started.
+    pub fn enter_recovery(&mut self, send_next: SeqNumber) -> bool {
+        if self.recovery_point.is_some() {
+            return false;
+        }
+        self.recovery_point = Some(send_next);
+        true
+    }
+
+    /// Checks if a recovery episode is in progress.
+    pub fn in_recovery(&self) -> bool {
+        self.recovery_point.is_some()
+    }
+
+    /// Records that a tail loss probe was sent.
+    pub fn on_probe_sent(&mut self, send_next: SeqNumber) {
+        self.probe_end = Some(send_next);
+    }
+
+    /// Checks if a tail loss probe may be scheduled: at most one probe is outstanding, and none is sent in recovery.
+    pub fn can_probe(&self) -> bool {
+        self.probe_end.is_none() && !self.in_recovery()
+    }
+
+    /// Computes the probe timeout (PTO), which never exceeds the retransmission timeout.
+    pub fn probe_timeout(srtt: Duration, rto: Duration, single_segment_in_flight: bool) -> Duration {
+        let mut pto: Duration = 2 * srtt;
+        if single_segment_in_flight {
+            pto += WORST_CASE_ACK_DELAY;
+        }
+        pto.min(rto)
+    }
+
+    /// Checks if a segment was sent after the most recently sent segment that was delivered.
+    fn is_newer(&self, xmit_ts: Instant, end_seq: SeqNumber) -> bool {
+        match self.xmit_ts {
+            Some(rack_xmit_ts) => xmit_ts > rack_xmit_ts || (xmit_ts == rack_xmit_ts && end_seq > self.end_seq),
+            None => true,
+        }
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        LossCheck,
+        Rack,
+    };
+    use crate::inetstack::protocols::tcp::SeqNumber;
+    use ::std::time::{
+        Duration,
+        Instant,
+    };
+
+    /// Tests that a segment is lost once a later one is delivered and its reordering window closes.
+    #[test]
+    fn test_rack_detect_loss() {
+        let start: Instant = Instant::now();
+        let rtt: Duration = Duration::from_millis(8);
+        let mut rack: Rack = Rack::new();
+
+        // Nothing was delivered yet.
+        assert_eq!(rack.check(start, SeqNumber::from(100), start), LossCheck::Unknown);
+
+        // The second segment is delivered a round trip after it was sent.
+        let second_tx: Instant = start + Duration::from_millis(1);
+        rack.on_delivered(second_tx, SeqNumber::from(200), false, second_tx + rtt);
+        assert_eq!(rack.reordering_window(), rtt / 4);
+
+        // The first segment is still within its reordering window.
+        let now: Instant = second_tx + rtt;
+        assert_eq!(
+            rack.check(start, SeqNumber::from(100), now),
+            LossCheck::Reordering(start + rtt + rtt / 4 - now)
+        );
+
+        // The third segment was sent later, so its fate is unknown.
+        let third_tx: Instant = start + Duration::from_millis(2);
+        assert_eq!(rack.check(third_tx, SeqNumber::from(300), now), LossCheck::Unknown);
+
+        // Once the reordering window closes, the first segment is lost.
+        assert_eq!(
+            rack.check(start, SeqNumber::from(100), start + rtt + rtt / 4),
+            LossCheck::Lost
+        );
+    }
+
+    /// Tests that acknowledgements of an original transmission do not count as deliveries of the retransmission.
+    #[test]
+    fn test_rack_spurious_retransmission() {
+        let start: Instant = Instant::now();
+        let rtt: Duration = Duration::from_millis(8);
+        let mut rack: Rack = Rack::new();
+        rack.on_delivered(start, SeqNumber::from(100), false, start + rtt);
+
+        let retransmit_tx: Instant = start + rtt;
+        rack.on_delivered(retransmit_tx, SeqNumber::from(200), true, retransmit_tx + rtt / 2);
+        assert_eq!(
+            rack.check(start + rtt / 2, SeqNumber::from(150), retransmit_tx),
+            LossCheck::Unknown
+        );
+    }
+
+    /// Tests that recovery episodes and tail loss probes end once the acknowledgements catch up.
+    #[test]
+    fn test_rack_recovery() {
+        let mut rack: Rack = Rack::new();
+        assert!(rack.can_probe());
+
+        rack.on_probe_sent(SeqNumber::from(100));
+        assert!(!rack.can_probe());
+        rack.on_ack(SeqNumber::from(100));
+        assert!(rack.can_probe());
+
+        assert!(rack.enter_recovery(SeqNumber::from(200)));
+        assert!(!rack.enter_recovery(SeqNumber::from(300)));
+        assert!(rack.in_recovery());
+        rack.on_ack(SeqNumber::from(150));
+        assert!(rack.in_recovery());
+        rack.on_ack(SeqNumber::from(200));
+        assert!(!rack.in_recovery());
+    }
+
+    /// Tests that the probe timeout accounts for delayed acknowledgements and never exceeds the retransmission timeout.
+    #[test]
+    fn test_rack_probe_timeout() {
+        let srtt: Duration = Duration::from_millis(10);
+        let rto: Duration = Duration::from_secs(1);
+        assert_eq!(Rack::probe_timeout(srtt, rto, false), Duration::from_millis(20));
+        assert_eq!(Rack::probe_timeout(srtt, rto, true), Duration::from_millis(220));
+        assert_eq!(
+            Rack::probe_timeout(srtt, Duration::from_millis(15), false),
+            Duration::from_millis(15)
+        );
+    }
+}
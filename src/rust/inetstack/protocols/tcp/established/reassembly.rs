@@ -0,0 +1,424 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::{
+    inetstack::protocols::tcp::{
+        segment::SelectiveAcknowlegement,
+        SeqNumber,
+    },
+    runtime::{
+        memory::Buffer,
+        stats,
+    },
+};
+use ::std::collections::{
+    BTreeMap,
+    VecDeque,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Maximum number of SACK blocks that fit in a TCP header (RFC 2018).
+pub const MAX_SACK_BLOCKS: usize = 4;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Run of contiguous out-of-order data.
+struct Run {
+    /// Unwrapped sequence number that follows the last byte of the run.
+    end: u64,
+    /// Segments of the run, in sequence order.
+    segments: VecDeque<Buffer>,
+}
+
+/// Reassembly Queue
+///
+/// Holds data that was received out of order, as a set of disjoint runs of contiguous data that are keyed by their
+/// starting sequence number. Sequence numbers are unwrapped to 64 bits relative to RCV.NXT, so that keys keep their
+/// order when the 32-bit sequence space wraps around. Inserting a segment is O(log n) in the number of holes, overlaps
+/// with stored data are trimmed off the new segment, and runs that become adjacent are merged. Segments are never
+/// copied: they are handed back as they were received (minus any duplicate bytes) when the hole before them fills.
+pub struct ReassemblyQueue {
+    /// Sequence number that matches `base_unwrapped`.
+    base: SeqNumber,
+    /// Unwrapped sequence number of `base`.
+    base_unwrapped: u64,
+    /// Runs of out-of-order data, by unwrapped starting sequence number.
+    runs: BTreeMap<u64, Run>,
+    /// Maximum number of runs to hold.
+    max_runs: usize,
+    /// Unwrapped starting sequence numbers of the most recently received segments, most recent first.
+    recent: VecDeque<u64>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Reassembly Queues
+impl ReassemblyQueue {
+    /// Creates an empty reassembly queue that holds at most `max_runs` runs of out-of-order data.
+    pub fn new(receive_next: SeqNumber, max_runs: usize) -> Self {
+        Self {
+            base: receive_next,
+            base_unwrapped: 0,
+            runs: BTreeMap::new(),
+            max_runs,
+            recent: VecDeque::with_capacity(MAX_SACK_BLOCKS),
+        }
+    }
+
+    /// Returns the number of runs of out-of-order data in the target queue.
+    pub fn len(&self) -> usize {
+        self.runs.len()
+    }
+
+    /// Checks if the target queue is empty.
+    pub fn is_empty(&self) -> bool {
+        self.runs.is_empty()
+    }
+
+    /// Stores an out-of-order segment that starts at `start` in the target queue. The segment should lie ahead of
+    /// `receive_next` and within the receive window.
+    pub fn insert(&mut self, receive_next: SeqNumber, start: SeqNumber, buf: Buffer) {
+        let len: usize = self.runs.len();
+        self.do_insert(receive_next, start, buf);
+        stats::record_ooo_depth(len, self.runs.len());
+    }
+
+    /// Removes the run that `receive_next` reaches from the target queue, if any. Bytes of the run that lie behind
+    /// `receive_next` are trimmed off, and the remaining segments are returned in sequence order.
+    pub fn pop(&mut self, receive_next: SeqNumber) -> Option<VecDeque<Buffer>> {
+        let len: usize = self.runs.len();
+        let segments: Option<VecDeque<Buffer>> = self.do_pop(receive_next);
+        stats::record_ooo_depth(len, self.runs.len());
+        segments
+    }
+
+    fn do_insert(&mut self, receive_next: SeqNumber, start: SeqNumber, mut buf: Buffer) {
+        self.rebase(receive_next);
+        let mut start: u64 = self.unwrap(start);
+        let mut end: u64 = start + buf.len() as u64;
+        debug_assert!(start < end);
+
+        // Remember this segment, even if it turns out to be a duplicate, so that it is reported first in a SACK.
+        self.recent.retain(|&seq| seq != start);
+        self.recent.push_front(start);
+        self.recent.truncate(MAX_SACK_BLOCKS);
+
+        // Trim off bytes that we already hold in the run that starts at or before the new segment.
+        if let Some((_, run)) = self.runs.range(..=start).next_back() {
+            if run.end >= end {
+                return;
+            }
+            if run.end > start {
+                buf.adjust((run.end - start) as usize);
+                start = run.end;
+            }
+        }
+
+        // Drop runs that the new segment covers, and trim off bytes that we already hold in the next run.
+        let mut segments: VecDeque<Buffer> = VecDeque::with_capacity(1);
+        let mut next: Option<(u64, Run)> = None;
+        while let Some(key) = self.runs.range(start..).next().map(|(&key, _)| key) {
+            if key > end {
+                break;
+            }
+            let run: Run = self.runs.remove(&key).expect("run should be stored");
+            if run.end <= end {
+                continue;
+            }
+            if key < end {
+                buf.trim((end - key) as usize);
+                end = key;
+            }
+            next = Some((key, run));
+            break;
+        }
+        if !buf.is_empty() {
+            segments.push_back(buf);
+        }
+
+        // Merge with the next run, if they are now adjacent.
+        if let Some((_, run)) = next {
+            segments.extend(run.segments);
+            end = run.end;
+        }
+
+        // Merge with the previous run, if they are now adjacent.
+        if let Some((_, run)) = self.runs.range_mut(..start).next_back() {
+            if run.end == start {
+                run.segments.extend(segments);
+                run.end = end;
+                return;
+            }
+        }
+        self.runs.insert(start, Run { end, segments });
+
+        // If we now hold too many runs, drop the ones that are farthest away.
+        while self.runs.len() > self.max_runs {
+            self.runs.pop_last();
+        }
+    }
+
+    fn do_pop(&mut self, receive_next: SeqNumber) -> Option<VecDeque<Buffer>> {
+        self.rebase(receive_next);
+        let receive_next: u64 = self.base_unwrapped;
+
+        while let Some(entry) = self.runs.first_entry() {
+            if *entry.key() > receive_next {
+                return None;
+            }
+            let (start, mut run): (u64, Run) = entry.remove_entry();
+            if run.end <= receive_next {
+                // We already received all data of this run.
+                continue;
+            }
+
+            // Trim off bytes that we already received.
+            let mut duplicate: u64 = receive_next - start;
+            while duplicate > 0 {
+                let segment: &mut Buffer = run.segments.front_mut().expect("run should not be empty");
+                let len: u64 = segment.len() as u64;
+                if len <= duplicate {
+                    run.segments.pop_front();
+                    duplicate -= len;
+                } else {
+                    segment.adjust(duplicate as usize);
+                    duplicate = 0;
+                }
+            }
+            return Some(run.segments);
+        }
+
+        None
+    }
+
+    /// Returns SACK blocks that describe the data in the target queue (RFC 2018). The first block holds the most
+    /// recently received segment, and the following ones hold other recently received segments.
+    pub fn sack_blocks(&self) -> ([SelectiveAcknowlegement; MAX_SACK_BLOCKS], usize) {
+        let mut sacks: [SelectiveAcknowlegement; MAX_SACK_BLOCKS] = [SelectiveAcknowlegement {
+            begin: SeqNumber::from(0),
+            end: SeqNumber::from(0),
+        }; MAX_SACK_BLOCKS];
+        let mut reported: [u64; MAX_SACK_BLOCKS] = [0; MAX_SACK_BLOCKS];
+        let mut num_sacks: usize = 0;
+
+        for &seq in self.recent.iter() {
+            // Find the run that holds this segment. It may have been received or dropped since.
+            let (&start, run): (&u64, &Run) = match self.runs.range(..=seq).next_back() {
+                Some((start, run)) if run.end > seq => (start, run),
+                _ => continue,
+            };
+            if reported[..num_sacks].contains(&start) {
+                continue;
+            }
+            reported[num_sacks] = start;
+            sacks[num_sacks] = SelectiveAcknowlegement {
+                begin: self.wrap(start),
+                end: self.wrap(run.end),
+            };
+            num_sacks += 1;
+        }
+
+        (sacks, num_sacks)
+    }
+
+    /// Moves the reference point for unwrapping sequence numbers to `receive_next`.
+    fn rebase(&mut self, receive_next: SeqNumber) {
+        let delta: u32 = (receive_next - self.base).into();
+        self.base = receive_next;
+        self.base_unwrapped += delta as u64;
+    }
+
+    /// Unwraps a sequence number that lies ahead of the reference point.
+    fn unwrap(&self, seq: SeqNumber) -> u64 {
+        self.base_unwrapped + u32::from(seq - self.base) as u64
+    }
+
+    /// Wraps an unwrapped sequence number.
+    fn wrap(&self, seq: u64) -> SeqNumber {
+        self.base + SeqNumber::from((seq - self.base_unwrapped) as u32)
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Drop Trait Implementation for Reassembly Queues
+impl Drop for ReassemblyQueue {
+    fn drop(&mut self) {
+        stats::record_ooo_depth(self.runs.len(), 0);
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::ReassemblyQueue;
+    use crate::{
+        inetstack::protocols::tcp::{
+            segment::SelectiveAcknowlegement,
+            SeqNumber,
+        },
+        runtime::memory::{
+            Buffer,
+            DataBuffer,
+        },
+    };
+    use ::std::collections::VecDeque;
+    use ::test::{
+        black_box,
+        Bencher,
+    };
+
+    /// Creates a segment whose bytes are the low bits of their sequence numbers.
+    fn segment(start: u32, len: u32) -> Buffer {
+        let bytes: Vec<u8> = (start..start + len).map(|seq| seq as u8).collect();
+        Buffer::Heap(DataBuffer::from_slice(&bytes))
+    }
+
+    /// Concatenates the segments of a run.
+    fn flatten(segments: VecDeque<Buffer>) -> Vec<u8> {
+        segments.iter().flat_map(|segment| segment.to_vec()).collect()
+    }
+
+    /// Checks that a SACK block spans a given range.
+    fn assert_sack(sack: &SelectiveAcknowlegement, begin: u32, end: u32) {
+        assert_eq!(sack.begin, SeqNumber::from(begin));
+        assert_eq!(sack.end, SeqNumber::from(end));
+    }
+
+    /// Tests that in-order data is drained once the hole before it fills.
+    #[test]
+    fn test_reassembly_drain() {
+        let mut queue: ReassemblyQueue = ReassemblyQueue::new(SeqNumber::from(0), 16);
+        queue.insert(SeqNumber::from(0), SeqNumber::from(20), segment(20, 10));
+        queue.insert(SeqNumber::from(0), SeqNumber::from(10), segment(10, 10));
+        assert_eq!(queue.len(), 1);
+
+        assert!(queue.pop(SeqNumber::from(0)).is_none());
+        let segments: VecDeque<Buffer> = queue.pop(SeqNumber::from(10)).unwrap();
+        assert_eq!(segments.len(), 2);
+        assert_eq!(flatten(segments), (10..30).collect::<Vec<u8>>());
+        assert!(queue.is_empty());
+    }
+
+    /// Tests that overlapping segments are trimmed and merged.
+    #[test]
+    fn test_reassembly_overlap() {
+        let mut queue: ReassemblyQueue = ReassemblyQueue::new(SeqNumber::from(0), 16);
+        queue.insert(SeqNumber::from(0), SeqNumber::from(10), segment(10, 10));
+        queue.insert(SeqNumber::from(0), SeqNumber::from(30), segment(30, 10));
+
+        // Duplicate.
+        queue.insert(SeqNumber::from(0), SeqNumber::from(12), segment(12, 4));
+        assert_eq!(queue.len(), 2);
+
+        // Overlaps both runs and fills the hole between them.
+        queue.insert(SeqNumber::from(0), SeqNumber::from(15), segment(15, 20));
+        assert_eq!(queue.len(), 1);
+
+        // Covers the whole run and extends it on both sides.
+        queue.insert(SeqNumber::from(0), SeqNumber::from(5), segment(5, 40));
+        assert_eq!(queue.len(), 1);
+
+        // Data that we already received is trimmed off.
+        let segments: VecDeque<Buffer> = queue.pop(SeqNumber::from(8)).unwrap();
+        assert_eq!(flatten(segments), (8..45).collect::<Vec<u8>>());
+    }
+
+    /// Tests that sequence numbers wrap around.
+    #[test]
+    fn test_reassembly_wrap() {
+        let receive_next: SeqNumber = SeqNumber::from(u32::MAX - 9);
+        let mut queue: ReassemblyQueue = ReassemblyQueue::new(receive_next, 16);
+        queue.insert(receive_next, SeqNumber::from(10), segment(10, 10));
+        queue.insert(receive_next, SeqNumber::from(u32::MAX - 4), segment(u32::MAX - 4, 5));
+        queue.insert(receive_next, SeqNumber::from(0), segment(0, 10));
+        assert_eq!(queue.len(), 1);
+
+        let (sacks, num_sacks): ([SelectiveAcknowlegement; 4], usize) = queue.sack_blocks();
+        assert_eq!(num_sacks, 1);
+        assert_sack(&sacks[0], u32::MAX - 4, 20);
+
+        let segments: VecDeque<Buffer> = queue.pop(SeqNumber::from(u32::MAX - 4)).unwrap();
+        assert_eq!(segments.len(), 3);
+    }
+
+    /// Tests that SACK blocks report the most recently received segments first.
+    #[test]
+    fn test_reassembly_sack_blocks() {
+        let mut queue: ReassemblyQueue = ReassemblyQueue::new(SeqNumber::from(0), 16);
+        for start in [10, 30, 50, 70, 90] {
+            queue.insert(SeqNumber::from(0), SeqNumber::from(start), segment(start, 10));
+        }
+        queue.insert(SeqNumber::from(0), SeqNumber::from(20), segment(20, 5));
+
+        let (sacks, num_sacks): ([SelectiveAcknowlegement; 4], usize) = queue.sack_blocks();
+        assert_eq!(num_sacks, 4);
+        assert_sack(&sacks[0], 10, 25);
+        assert_sack(&sacks[1], 90, 100);
+        assert_sack(&sacks[2], 70, 80);
+        assert_sack(&sacks[3], 50, 60);
+
+        // Received runs are no longer reported.
+        queue.pop(SeqNumber::from(10));
+        let (sacks, num_sacks): ([SelectiveAcknowlegement; 4], usize) = queue.sack_blocks();
+        assert_eq!(num_sacks, 3);
+        assert_sack(&sacks[0], 90, 100);
+        assert_sack(&sacks[1], 70, 80);
+        assert_sack(&sacks[2], 50, 60);
+    }
+
+    /// Tests that the runs that are farthest away are dropped when the queue is full.
+    #[test]
+    fn test_reassembly_max_runs() {
+        let mut queue: ReassemblyQueue = ReassemblyQueue::new(SeqNumber::from(0), 2);
+        for start in [50, 10, 30] {
+            queue.insert(SeqNumber::from(0), SeqNumber::from(start), segment(start, 10));
+        }
+        assert_eq!(queue.len(), 2);
+        queue.insert(SeqNumber::from(0), SeqNumber::from(0), segment(0, 10));
+        assert_eq!(
+            flatten(queue.pop(SeqNumber::from(0)).unwrap()),
+            (0..20).collect::<Vec<u8>>()
+        );
+        assert!(queue.pop(SeqNumber::from(20)).is_none());
+        assert_eq!(
+            flatten(queue.pop(SeqNumber::from(30)).unwrap()),
+            (30..40).collect::<Vec<u8>>()
+        );
+        assert!(queue.is_empty());
+    }
+
+    /// Benchmarks inserting segments into a queue with many holes.
+    #[bench]
+    fn bench_reassembly_insert(b: &mut Bencher) {
+        const NUM_HOLES: u32 = 512;
+        const MSS: u32 = 1460;
+        let payload: Buffer = segment(0, MSS);
+
+        b.iter(|| {
+            let mut queue: ReassemblyQueue = ReassemblyQueue::new(SeqNumber::from(0), NUM_HOLES as usize);
+            // Every other segment is lost, so each one that arrives opens a new hole.
+            for i in 0..NUM_HOLES {
+                let start: SeqNumber = SeqNumber::from((2 * i + 1) * MSS);
+                queue.insert(SeqNumber::from(0), start, payload.clone());
+            }
+            black_box(queue.sack_blocks());
+        });
+    }
+}
@@ -67,6 +67,15 @@ impl RtoCalculator {
         self.update_rto(self.rto * 2.0);
     }
 
+    // Returns the smoothed round-trip time (SRTT), if we have taken a sample already.
+    pub fn smoothed_rtt(&self) -> Option<Duration> {
+        if self.received_sample {
+            Some(FloatDuration::seconds(self.srtt).to_std().unwrap())
+        } else {
+            None
+        }
+    }
+
     pub fn estimate(&self) -> Duration {
         FloatDuration::seconds(self.rto).to_std().unwrap()
     }
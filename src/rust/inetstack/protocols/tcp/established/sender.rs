@@ -1,15 +1,25 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
-use super::ControlBlock;
+use super::{
+    rack::{
+        LossCheck,
+        Rack,
+    },
+    ControlBlock,
+};
 use crate::{
     inetstack::protocols::tcp::{
-        segment::TcpHeader,
+        segment::{
+            SelectiveAcknowlegement,
+            TcpHeader,
+        },
         SeqNumber,
     },
     runtime::{
         fail::Fail,
         memory::Buffer,
+        stats,
         watched::{
             WatchFuture,
             WatchedValue,
@@ -42,6 +52,41 @@ pub struct UnackedSegment {
     pub bytes: Buffer,
     // Set to `None` on retransmission to implement Karn's algorithm.
     pub initial_tx: Option<Instant>,
+    // Time of the most recent transmission, which RACK uses to detect losses (RFC 8985).
+    pub last_tx: Instant,
+    // Whether this segment was retransmitted.
+    pub retransmitted: bool,
+    // Whether our peer selectively acknowledged this segment (RFC 2018).
+    pub sacked: bool,
+    // Whether this segment is considered lost and awaits retransmission.
+    pub lost: bool,
+}
+
+impl UnackedSegment {
+    pub fn new(bytes: Buffer, now: Instant) -> Self {
+        Self {
+            bytes,
+            initial_tx: Some(now),
+            last_tx: now,
+            retransmitted: false,
+            sacked: false,
+            lost: false,
+        }
+    }
+
+    // Amount of sequence number space that this segment consumes.  The end-of-send marker consumes one for the FIN.
+    pub fn seq_len(&self) -> u32 {
+        (self.bytes.len() as u32).max(1)
+    }
+
+    // Records a retransmission of this segment, and returns the data to send.
+    fn retransmit(&mut self, now: Instant) -> Buffer {
+        self.initial_tx = None;
+        self.last_tx = now;
+        self.retransmitted = true;
+        self.lost = false;
+        self.bytes.clone()
+    }
 }
 
 /// Hard limit for unsent queue.
@@ -91,6 +136,9 @@ pub struct Sender {
     // Maximum Segment Size currently in use for this connection.
     // ToDo: Revisit this once we support path MTU discovery.
     mss: usize,
+
+    // Number of segments retransmitted on this connection.
+    retransmissions: Cell<u64>,
 }
 
 impl fmt::Debug for Sender {
@@ -121,6 +169,7 @@ impl Sender {
 
             window_scale,
             mss,
+            retransmissions: Cell::new(0),
         }
     }
 
@@ -148,8 +197,114 @@ impl Sender {
         self.unsent_seq_no.watch()
     }
 
-    pub fn pop_unacked_segment(&self) -> Option<UnackedSegment> {
-        self.unacked_queue.borrow_mut().pop_front()
+    // Retransmits the oldest unacknowledged segment.  The segment stays on the unacknowledged queue.
+    pub fn retransmit_first_unacked_segment(&self, now: Instant) -> Option<Buffer> {
+        let mut unacked_queue = self.unacked_queue.borrow_mut();
+        let segment: &mut UnackedSegment = unacked_queue.front_mut()?;
+        self.count_retransmissions(1);
+        Some(segment.retransmit(now))
+    }
+
+    // Retransmits the segments that are considered lost.  Returns their starting sequence numbers and data.
+    pub fn retransmit_lost_segments(&self, now: Instant) -> Vec<(SeqNumber, Buffer)> {
+        let mut seq_no: SeqNumber = self.send_unacked.get();
+        let mut segments: Vec<(SeqNumber, Buffer)> = Vec::new();
+        for segment in self.unacked_queue.borrow_mut().iter_mut() {
+            if segment.lost {
+                segments.push((seq_no, segment.retransmit(now)));
+            }
+            seq_no = seq_no + SeqNumber::from(segment.seq_len());
+        }
+        self.count_retransmissions(segments.len());
+        segments
+    }
+
+    // Retransmits the most recently sent segment that was not selectively acknowledged, as a tail loss probe.
+    pub fn retransmit_last_unacked_segment(&self, now: Instant) -> Option<(SeqNumber, Buffer)> {
+        let mut seq_no: SeqNumber = self.send_next.get();
+        for segment in self.unacked_queue.borrow_mut().iter_mut().rev() {
+            seq_no = seq_no - SeqNumber::from(segment.seq_len());
+            if !segment.sacked {
+                self.count_retransmissions(1);
+                return Some((seq_no, segment.retransmit(now)));
+            }
+        }
+        None
+    }
+
+    // Returns the number of segments retransmitted on this connection.
+    pub fn retransmissions(&self) -> u64 {
+        self.retransmissions.get()
+    }
+
+    fn count_retransmissions(&self, n: usize) {
+        if n > 0 {
+            self.retransmissions.set(self.retransmissions.get() + n as u64);
+            stats::record_retransmissions(n);
+        }
+    }
+
+    // Checks if exactly one segment is unacknowledged.
+    pub fn has_single_unacked_segment(&self) -> bool {
+        self.unacked_queue.borrow().len() == 1
+    }
+
+    // Marks the unacknowledged segments that SACK blocks cover, and reports their delivery to RACK.
+    // Note: We walk the whole unacknowledged queue, as SACK blocks may come in any order.
+    pub fn on_sack(&self, sacks: &[SelectiveAcknowlegement], rack: &mut Rack, now: Instant) {
+        let send_unacked: SeqNumber = self.send_unacked.get();
+        let send_next: SeqNumber = self.send_next.get();
+
+        // Ignore SACK blocks that don't lie within the unacknowledged sequence space.
+        let is_valid = |sack: &&SelectiveAcknowlegement| {
+            send_unacked <= sack.begin && sack.begin < sack.end && sack.end <= send_next
+        };
+        if !sacks.iter().any(|sack| is_valid(&sack)) {
+            return;
+        }
+
+        let mut seq_no: SeqNumber = send_unacked;
+        for segment in self.unacked_queue.borrow_mut().iter_mut() {
+            let start: SeqNumber = seq_no;
+            seq_no = seq_no + SeqNumber::from(segment.seq_len());
+            if segment.sacked {
+                continue;
+            }
+            if sacks
+                .iter()
+                .filter(is_valid)
+                .any(|sack| sack.begin <= start && seq_no <= sack.end)
+            {
+                segment.sacked = true;
+                segment.lost = false;
+                rack.on_delivered(segment.last_tx, seq_no, segment.retransmitted, now);
+            }
+        }
+    }
+
+    // Marks the unacknowledged segments that RACK considers lost.  Returns whether any segment was newly marked lost,
+    // and the time after which the segments that are still within their reordering window should be checked again.
+    pub fn detect_loss(&self, rack: &Rack, now: Instant) -> (bool, Option<Duration>) {
+        let mut seq_no: SeqNumber = self.send_unacked.get();
+        let mut newly_lost: bool = false;
+        let mut reordering: Option<Duration> = None;
+        for segment in self.unacked_queue.borrow_mut().iter_mut() {
+            seq_no = seq_no + SeqNumber::from(segment.seq_len());
+            if segment.sacked || segment.lost {
+                continue;
+            }
+            match rack.check(segment.last_tx, seq_no, now) {
+                LossCheck::Lost => {
+                    segment.lost = true;
+                    newly_lost = true;
+                },
+                LossCheck::Reordering(remaining) => {
+                    reordering = Some(reordering.map_or(remaining, |timeout| timeout.max(remaining)));
+                },
+                LossCheck::Unknown => (),
+            }
+        }
+        (newly_lost, reordering)
     }
 
     pub fn push_unacked_segment(&self, segment: UnackedSegment) {
@@ -214,8 +369,14 @@ impl Sender {
 
             let win_sz: u32 = self.send_window.get();
 
-            if win_sz > 0 && win_sz >= in_flight_after_send && effective_cwnd >= in_flight_after_send {
-                if let Some(remote_link_addr) = cb.arp().try_query(cb.get_remote().ip().clone()) {
+            // Segments that the pacer holds back go through the unsent queue, so that the background sender releases
+            // them on time.
+            if win_sz > 0
+                && win_sz >= in_flight_after_send
+                && effective_cwnd >= in_flight_after_send
+                && cb.pacing_release_time().is_none()
+            {
+                if let Some(remote_link_addr) = cb.remote_link_addr() {
                     // This hook is primarily intended to record the last time we sent data, so we can later tell if
                     // the connection has been idle.
                     let rto: Duration = cb.rto_estimate();
@@ -232,6 +393,7 @@ impl Sender {
                     }
                     trace!("Send immediate");
                     cb.emit(header, Some(buf.clone()), remote_link_addr);
+                    cb.pacing_on_send(buf.len());
 
                     // Update SND.NXT.
                     self.send_next.modify(|s| s + SeqNumber::from(buf_len));
@@ -240,10 +402,7 @@ impl Sender {
                     self.unsent_seq_no.modify(|s| s + SeqNumber::from(buf_len));
 
                     // Put the segment we just sent on the retransmission queue.
-                    let unacked_segment = UnackedSegment {
-                        bytes: buf,
-                        initial_tx: Some(cb.clock.now()),
-                    };
+                    let unacked_segment = UnackedSegment::new(buf, cb.clock.now());
                     self.unacked_queue.borrow_mut().push_back(unacked_segment);
 
                     // Start the retransmission timer if it isn't already running.
@@ -252,6 +411,9 @@ impl Sender {
                         cb.set_retransmit_deadline(Some(cb.clock.now() + rto));
                     }
 
+                    // Schedule a tail loss probe, in case this is the last segment of a flight.
+                    cb.schedule_loss_probe(cb.clock.now());
+
                     return Ok(());
                 } else {
                     warn!("no ARP cache entry for send");
@@ -277,6 +439,7 @@ impl Sender {
     //
     pub fn remove_acknowledged_data(&self, cb: &ControlBlock, bytes_acknowledged: u32, now: Instant) {
         let mut bytes_remaining: usize = bytes_acknowledged as usize;
+        let mut seq_no: SeqNumber = self.send_unacked.get();
 
         while bytes_remaining != 0 {
             if let Some(segment) = self.unacked_queue.borrow_mut().front_mut() {
@@ -296,6 +459,12 @@ impl Sender {
                     break;
                 }
 
+                // Report the delivery of this segment to RACK, unless it was already selectively acknowledged.
+                seq_no = seq_no + SeqNumber::from(segment.seq_len());
+                if !segment.sacked {
+                    cb.rack_on_delivered(segment.last_tx, seq_no, segment.retransmitted, now);
+                }
+
                 if segment.bytes.len() == 0 {
                     // This buffer is the end-of-send marker.  So we should only have one byte of acknowledged sequence
                     // space remaining (corresponding to our FIN).
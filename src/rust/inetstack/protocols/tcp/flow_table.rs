@@ -0,0 +1,340 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::runtime::network::rss::ToeplitzHasher;
+use ::std::{
+    mem,
+    net::SocketAddrV4,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Initial number of slots in a flow table.
+const FLOW_TABLE_INITIAL_CAPACITY: usize = 1024;
+
+/// Tag of an empty slot.
+const EMPTY: u32 = 0;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Key of a Flow (local and remote addresses)
+pub type FlowKey = (SocketAddrV4, SocketAddrV4);
+
+/// Flow Table
+///
+/// Open-addressing hash table of flows, keyed by their 4-tuples. Flows are hashed with the Toeplitz function and key
+/// that NICs use for Receive Side Scaling, so that the hash that a NIC computes for a packet can be used to look up
+/// its flow. Collisions are resolved by linear probing on a dense array of tags, each one being the hash of the flow in
+/// that slot, thus a lookup touches a single entry in the common case. Removals shift back the entries that follow, so
+/// that the table never fills with tombstones.
+pub struct FlowTable<V> {
+    hasher: ToeplitzHasher,
+    /// Tag of each slot. [EMPTY] marks a free slot, and is never the tag of a flow.
+    tags: Vec<u32>,
+    /// Flow in each slot.
+    entries: Vec<Option<(FlowKey, V)>>,
+    /// Number of flows in the table.
+    len: usize,
+    /// Whether RSS hashes computed by the NIC match ours. Cleared once they are seen to disagree.
+    trust_rss_hash: bool,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Flow Tables
+impl<V> FlowTable<V> {
+    /// Creates an empty flow table.
+    pub fn new() -> Self {
+        Self::with_capacity(FLOW_TABLE_INITIAL_CAPACITY)
+    }
+
+    /// Creates an empty flow table with room for `capacity` slots, rounded up to a power of two.
+    fn with_capacity(capacity: usize) -> Self {
+        let capacity: usize = capacity.next_power_of_two();
+        Self {
+            hasher: ToeplitzHasher::default(),
+            tags: vec![EMPTY; capacity],
+            entries: (0..capacity).map(|_| None).collect(),
+            len: 0,
+            trust_rss_hash: true,
+        }
+    }
+
+    /// Computes the hash of a flow, which matches the RSS hash of the packets that it receives.
+    pub fn hash(&self, key: &FlowKey) -> u32 {
+        let (local, remote): &(SocketAddrV4, SocketAddrV4) = key;
+        self.hasher.hash_ipv4_tuple(remote, local)
+    }
+
+    /// Returns the hash under which to look up the flow of a packet, given the RSS hash that the NIC computed for it, if
+    /// any. A NIC may hash with a function or key other than ours, so a flow that is not found under the NIC hash is
+    /// looked up under ours as well. If that finds it, NIC hashes are ignored from then on.
+    pub fn resolve_hash(&mut self, rss_hash: Option<u32>, key: &FlowKey) -> u32 {
+        if let Some(hash) = rss_hash.filter(|_| self.trust_rss_hash) {
+            if self.find(Self::tag(hash), key).is_some() {
+                return hash;
+            }
+            let ours: u32 = self.hash(key);
+            if ours != hash && self.find(Self::tag(ours), key).is_some() {
+                warn!("RSS hash from the NIC does not match ours, ignoring it from now on");
+                self.trust_rss_hash = false;
+            }
+            return ours;
+        }
+        self.hash(key)
+    }
+
+    /// Returns the number of flows in the target flow table.
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Looks up a flow.
+    pub fn get(&self, key: &FlowKey) -> Option<&V> {
+        self.get_with_hash(self.hash(key), key)
+    }
+
+    /// Looks up a flow, given its hash.
+    pub fn get_with_hash(&self, hash: u32, key: &FlowKey) -> Option<&V> {
+        let slot: usize = self.find(Self::tag(hash), key)?;
+        self.entries[slot].as_ref().map(|(_, value)| value)
+    }
+
+    /// Looks up a flow for modification.
+    pub fn get_mut(&mut self, key: &FlowKey) -> Option<&mut V> {
+        self.get_mut_with_hash(self.hash(key), key)
+    }
+
+    /// Looks up a flow for modification, given its hash.
+    pub fn get_mut_with_hash(&mut self, hash: u32, key: &FlowKey) -> Option<&mut V> {
+        let slot: usize = self.find(Self::tag(hash), key)?;
+        self.entries[slot].as_mut().map(|(_, value)| value)
+    }
+
+    /// Checks if a flow is in the target flow table.
+    pub fn contains_key(&self, key: &FlowKey) -> bool {
+        self.get(key).is_some()
+    }
+
+    /// Inserts a flow in the target flow table. Returns the previous value of the flow, if any.
+    pub fn insert(&mut self, key: FlowKey, value: V) -> Option<V> {
+        let tag: u32 = Self::tag(self.hash(&key));
+        if let Some(slot) = self.find(tag, &key) {
+            return self.entries[slot].replace((key, value)).map(|(_, value)| value);
+        }
+
+        // Keep the load factor under 3/4, so that probe sequences stay short.
+        if (self.len + 1) * 4 > self.tags.len() * 3 {
+            self.grow();
+        }
+        self.insert_new(tag, key, value);
+        None
+    }
+
+    /// Removes a flow from the target flow table. Returns its value, if any.
+    pub fn remove(&mut self, key: &FlowKey) -> Option<V> {
+        let mask: usize = self.tags.len() - 1;
+        let mut hole: usize = self.find(Self::tag(self.hash(key)), key)?;
+        let (_, value): (FlowKey, V) = self.entries[hole].take().unwrap();
+        self.tags[hole] = EMPTY;
+        self.len -= 1;
+
+        // Shift back entries that were displaced past the hole, so that probe sequences remain unbroken.
+        let mut slot: usize = (hole + 1) & mask;
+        while self.tags[slot] != EMPTY {
+            let home: usize = self.tags[slot] as usize & mask;
+            // Check if the entry's home slot is cyclically outside of (hole, slot].
+            if (slot.wrapping_sub(home) & mask) >= (slot.wrapping_sub(hole) & mask) {
+                self.tags[hole] = mem::replace(&mut self.tags[slot], EMPTY);
+                self.entries[hole] = self.entries[slot].take();
+                hole = slot;
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        Some(value)
+    }
+
+    /// Prefetches the slot where a flow with a given hash starts its probe sequence, and the data that `deref`
+    /// reaches from the flow in that slot (e.g. its control block), so that a later lookup does not stall on memory.
+    pub fn prefetch<T>(&self, hash: u32, deref: impl Fn(&V) -> Option<*const T>) {
+        let slot: usize = Self::tag(hash) as usize & (self.tags.len() - 1);
+        prefetch(&self.tags[slot]);
+        if self.tags[slot] == Self::tag(hash) {
+            if let Some(ptr) = self.entries[slot].as_ref().and_then(|(_, value)| deref(value)) {
+                prefetch(ptr);
+            }
+        }
+    }
+
+    /// Returns the tag of a flow with a given hash.
+    fn tag(hash: u32) -> u32 {
+        if hash == EMPTY {
+            1
+        } else {
+            hash
+        }
+    }
+
+    /// Returns the slot of a flow, if it is in the target flow table.
+    fn find(&self, tag: u32, key: &FlowKey) -> Option<usize> {
+        let mask: usize = self.tags.len() - 1;
+        let mut slot: usize = tag as usize & mask;
+        loop {
+            match self.tags[slot] {
+                EMPTY => return None,
+                t if t == tag => match self.entries[slot] {
+                    Some((ref k, _)) if k == key => return Some(slot),
+                    _ => (),
+                },
+                _ => (),
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    /// Inserts a flow that is not in the target flow table yet.
+    fn insert_new(&mut self, tag: u32, key: FlowKey, value: V) {
+        let mask: usize = self.tags.len() - 1;
+        let mut slot: usize = tag as usize & mask;
+        while self.tags[slot] != EMPTY {
+            slot = (slot + 1) & mask;
+        }
+        self.tags[slot] = tag;
+        self.entries[slot] = Some((key, value));
+        self.len += 1;
+    }
+
+    /// Doubles the number of slots in the target flow table.
+    fn grow(&mut self) {
+        let capacity: usize = self.tags.len() * 2;
+        let tags: Vec<u32> = mem::replace(&mut self.tags, vec![EMPTY; capacity]);
+        let entries: Vec<Option<(FlowKey, V)>> = mem::replace(&mut self.entries, (0..capacity).map(|_| None).collect());
+        self.len = 0;
+        for (tag, entry) in tags.into_iter().zip(entries.into_iter()) {
+            if let Some((key, value)) = entry {
+                self.insert_new(tag, key, value);
+            }
+        }
+    }
+}
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Hints the CPU to bring the cache line that holds `ptr` into the cache.
+#[inline(always)]
+fn prefetch<T>(ptr: *const T) {
+    #[cfg(target_arch = "x86_64")]
+    unsafe {
+        ::std::arch::x86_64::_mm_prefetch(ptr as *const i8, ::std::arch::x86_64::_MM_HINT_T0);
+    }
+    #[cfg(not(target_arch = "x86_64"))]
+    let _ = ptr;
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        FlowKey,
+        FlowTable,
+    };
+    use ::std::{
+        collections::HashMap,
+        net::{
+            Ipv4Addr,
+            SocketAddrV4,
+        },
+    };
+    use ::test::{
+        black_box,
+        Bencher,
+    };
+
+    fn key(i: u32) -> FlowKey {
+        (
+            SocketAddrV4::new(Ipv4Addr::new(10, 0, 0, 1), 80),
+            SocketAddrV4::new(Ipv4Addr::from(0x0b000000 + i / 1024), 1024 + (i % 1024) as u16),
+        )
+    }
+
+    /// Tests that flows are found when the NIC hash does not match ours.
+    #[test]
+    fn test_flow_table_rss_hash_mismatch() {
+        let mut table: FlowTable<u32> = FlowTable::with_capacity(4);
+        table.insert(key(0), 0);
+        let hash: u32 = table.hash(&key(0));
+
+        // A NIC hash that matches ours is used as is.
+        assert_eq!(table.resolve_hash(Some(hash), &key(0)), hash);
+        assert_eq!(table.resolve_hash(None, &key(0)), hash);
+
+        // A miss for an unknown flow says nothing about the NIC hash.
+        let other: u32 = table.hash(&key(1));
+        assert_eq!(table.resolve_hash(Some(other ^ 1), &key(1)), other);
+        assert!(table.trust_rss_hash);
+
+        // A NIC hash that disagrees with ours for a known flow is ignored from then on.
+        assert_eq!(table.resolve_hash(Some(hash ^ 1), &key(0)), hash);
+        assert!(!table.trust_rss_hash);
+        assert_eq!(table.resolve_hash(Some(other ^ 1), &key(1)), other);
+        let resolved: u32 = table.resolve_hash(Some(hash ^ 1), &key(0));
+        assert_eq!(table.get_with_hash(resolved, &key(0)), Some(&0));
+    }
+
+    /// Tests that the flow table behaves like a map while it grows and shrinks.
+    #[test]
+    fn test_flow_table() {
+        let mut table: FlowTable<u32> = FlowTable::with_capacity(4);
+        let mut reference: HashMap<FlowKey, u32> = HashMap::new();
+        for i in 0..5000 {
+            assert_eq!(table.insert(key(i), i), None);
+            reference.insert(key(i), i);
+        }
+        assert_eq!(table.insert(key(7), 70), Some(7));
+        reference.insert(key(7), 70);
+
+        // Remove every third flow, so that probe sequences get holes that shifting has to repair.
+        for i in (0..5000).step_by(3) {
+            assert_eq!(table.remove(&key(i)), reference.remove(&key(i)));
+            assert_eq!(table.remove(&key(i)), None);
+        }
+        assert_eq!(table.len(), reference.len());
+        for i in 0..5000 {
+            assert_eq!(table.get(&key(i)), reference.get(&key(i)));
+        }
+
+        *table.get_mut(&key(1)).unwrap() = 10;
+        assert_eq!(table.get_with_hash(table.hash(&key(1)), &key(1)), Some(&10));
+        assert!(!table.contains_key(&key(5001)));
+    }
+
+    /// Benchmarks lookups in a table of 64K flows.
+    #[bench]
+    fn bench_flow_table_get(b: &mut Bencher) {
+        let mut table: FlowTable<u32> = FlowTable::new();
+        for i in 0..65536 {
+            table.insert(key(i), i);
+        }
+        let mut i: u32 = 0;
+        b.iter(|| {
+            i = (i + 7919) % 65536;
+            black_box(table.get(black_box(&key(i))));
+        });
+    }
+}
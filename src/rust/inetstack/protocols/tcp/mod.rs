@@ -2,8 +2,10 @@
 // Licensed under the MIT license.
 
 mod active_open;
+mod coalescer;
 pub mod constants;
 mod established;
+mod flow_table;
 mod isn_generator;
 pub mod operations;
 mod passive_open;
@@ -76,6 +76,7 @@ struct InflightAccept {
     header_window_size: u16,
     remote_window_scale: Option<u8>,
     mss: usize,
+    sack_permitted: bool,
 
     #[allow(unused)]
     handle: SchedulerHandle,
@@ -195,6 +196,7 @@ impl PassiveSocket {
                 header_window_size,
                 remote_window_scale,
                 mss,
+                sack_permitted,
                 ..
             } = self.inflight.get(&remote).unwrap();
             if header.ack_num != local_isn + SeqNumber::from(1) {
@@ -240,7 +242,8 @@ impl PassiveSocket {
                 remote_window_size,
                 remote_window_scale,
                 mss,
-                congestion_control::None::new,
+                sack_permitted,
+                congestion_control::constructor(self.tcp_config.get_congestion_control()),
                 None,
             );
             self.ready.borrow_mut().push_ok(cb);
@@ -258,6 +261,28 @@ impl PassiveSocket {
         }
         let local_isn = self.isn_generator.generate(&self.local, &remote);
         let remote_isn = header.seq_num;
+
+        let mut remote_window_scale = None;
+        let mut mss = FALLBACK_MSS;
+        let mut sack_permitted: bool = false;
+        for option in header.iter_options() {
+            match option {
+                TcpOptions2::WindowScale(w) => {
+                    info!("Received window scale: {:?}", w);
+                    remote_window_scale = Some(*w);
+                },
+                TcpOptions2::MaximumSegmentSize(m) => {
+                    info!("Received advertised MSS: {}", m);
+                    mss = *m as usize;
+                },
+                TcpOptions2::SelectiveAcknowlegementPermitted => {
+                    info!("Received SACK permitted");
+                    sack_permitted = self.tcp_config.get_selective_ack();
+                },
+                _ => continue,
+            }
+        }
+
         let future = Self::background(
             local_isn,
             remote_isn,
@@ -269,33 +294,20 @@ impl PassiveSocket {
             self.local_link_addr,
             self.arp.clone(),
             self.ready.clone(),
+            sack_permitted,
         );
         let handle: SchedulerHandle = match self.scheduler.insert(FutureOperation::Background(future.boxed_local())) {
             Some(handle) => handle,
             None => panic!("failed to insert task in the scheduler"),
         };
 
-        let mut remote_window_scale = None;
-        let mut mss = FALLBACK_MSS;
-        for option in header.iter_options() {
-            match option {
-                TcpOptions2::WindowScale(w) => {
-                    info!("Received window scale: {:?}", w);
-                    remote_window_scale = Some(*w);
-                },
-                TcpOptions2::MaximumSegmentSize(m) => {
-                    info!("Received advertised MSS: {}", m);
-                    mss = *m as usize;
-                },
-                _ => continue,
-            }
-        }
         let accept = InflightAccept {
             local_isn,
             remote_isn,
             header_window_size: header.window_size,
             remote_window_scale,
             mss,
+            sack_permitted,
             handle,
         };
         self.inflight.insert(remote, accept);
@@ -313,6 +325,7 @@ impl PassiveSocket {
         local_link_addr: MacAddress,
         arp: ArpPeer,
         ready: Rc<RefCell<ReadySockets>>,
+        sack_permitted: bool,
     ) -> impl Future<Output = ()> {
         let handshake_retries: usize = tcp_config.get_handshake_retries();
         let handshake_timeout: Duration = tcp_config.get_handshake_timeout();
@@ -340,6 +353,12 @@ impl PassiveSocket {
                 tcp_hdr.push_option(TcpOptions2::WindowScale(tcp_config.get_window_scale()));
                 info!("Advertising window scale: {}", tcp_config.get_window_scale());
 
+                // We may only agree to selective acknowledgements if our peer asked for them (RFC 2018).
+                if sack_permitted {
+                    tcp_hdr.push_option(TcpOptions2::SelectiveAcknowlegementPermitted);
+                    info!("Advertising SACK permitted");
+                }
+
                 debug!("Sending SYN+ACK: {:?}", tcp_hdr);
                 let segment = TcpSegment {
                     ethernet2_hdr: Ethernet2Header::new(remote_link_addr, local_link_addr, EtherType2::Ipv4),
@@ -347,6 +366,8 @@ impl PassiveSocket {
                     tcp_hdr,
                     data: None,
                     tx_checksum_offload: tcp_config.get_rx_checksum_offload(),
+                    tx_segment_size: None,
+                    template: None,
                 };
                 rt.transmit(Box::new(segment));
                 clock.wait(clock.clone(), handshake_timeout).await;
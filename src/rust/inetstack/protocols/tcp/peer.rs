@@ -7,7 +7,15 @@
 
 use super::{
     active_open::ActiveOpenSocket,
+    coalescer::{
+        CoalescedSegments,
+        SegmentCoalescer,
+    },
     established::EstablishedSocket,
+    flow_table::{
+        FlowKey,
+        FlowTable,
+    },
     isn_generator::IsnGenerator,
     passive_open::PassiveSocket,
 };
@@ -88,10 +96,24 @@ use ::std::{
 #[cfg(feature = "profiler")]
 use crate::timer;
 
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Remote address under which listening sockets are keyed in the flow table.
+const ANY_REMOTE: SocketAddrV4 = SocketAddrV4::new(Ipv4Addr::UNSPECIFIED, 0);
+
 //==============================================================================
 // Enumerations
 //==============================================================================
 
+/// Socket that segments of a flow are routed to.
+enum Flow {
+    Passive(PassiveSocket),
+    Connecting(ActiveOpenSocket),
+    Established(EstablishedSocket),
+}
+
 enum Socket {
     Inactive { local: Option<SocketAddrV4> },
     Listening { local: SocketAddrV4 },
@@ -111,9 +133,8 @@ pub struct Inner {
     // FD -> local port
     sockets: HashMap<QDesc, Socket>,
 
-    passive: HashMap<SocketAddrV4, PassiveSocket>,
-    connecting: HashMap<(SocketAddrV4, SocketAddrV4), ActiveOpenSocket>,
-    established: HashMap<(SocketAddrV4, SocketAddrV4), EstablishedSocket>,
+    // (local, remote) -> connecting or established socket, and (local, ANY_REMOTE) -> passive socket
+    flows: FlowTable<Flow>,
 
     rt: Rc<dyn NetworkRuntime>,
     scheduler: Scheduler,
@@ -124,6 +145,9 @@ pub struct Inner {
     arp: ArpPeer,
     rng: Rc<RefCell<SmallRng>>,
 
+    // In-order segments that are being coalesced before they are handed to their connection.
+    coalescer: SegmentCoalescer,
+
     dead_socket_tx: mpsc::UnboundedSender<QDesc>,
 }
 
@@ -238,6 +262,24 @@ impl TcpPeer {
         self.inner.borrow_mut().receive(ip_header, buf)
     }
 
+    /// Prefetches the flow that a received frame belongs to, if the NIC hashed it. This should be called on every frame
+    /// of a receive batch before any of them is processed, so that flow lookups don't stall on cache misses one after
+    /// another.
+    pub fn prefetch(&self, frame: &Buffer) {
+        if let Some(hash) = frame.rss_hash() {
+            self.inner.borrow().flows.prefetch(hash, |flow| match flow {
+                Flow::Established(s) => Some(Rc::as_ptr(&s.cb)),
+                _ => None,
+            });
+        }
+    }
+
+    /// Hands received segments that are being coalesced to their connection. This should be called at the end of each
+    /// receive batch.
+    pub fn flush_coalesced(&self) {
+        self.inner.borrow_mut().flush_coalesced()
+    }
+
     // Marks the target socket as passive.
     pub fn listen(&self, qd: QDesc, backlog: usize) -> Result<(), Fail> {
         let mut inner: RefMut<Inner> = self.inner.borrow_mut();
@@ -259,7 +301,7 @@ impl TcpPeer {
         };
 
         // Check if there isn't a socket listening on this address/port pair.
-        if inner.passive.contains_key(&local) {
+        if inner.flows.contains_key(&(local, ANY_REMOTE)) {
             return Err(Fail::new(
                 libc::EADDRINUSE,
                 "another socket is already listening on the same address/port pair",
@@ -278,7 +320,7 @@ impl TcpPeer {
             inner.arp.clone(),
             nonce,
         );
-        assert!(inner.passive.insert(local, socket).is_none());
+        assert!(inner.flows.insert((local, ANY_REMOTE), Flow::Passive(socket)).is_none());
         inner.sockets.insert(qd, Socket::Listening { local });
         Ok(())
     }
@@ -299,7 +341,10 @@ impl TcpPeer {
             None => return Poll::Ready(Err(Fail::new(EBADF, "bad file descriptor"))),
         };
 
-        let passive: &mut PassiveSocket = inner.passive.get_mut(local).expect("sockets/local inconsistency");
+        let passive: &mut PassiveSocket = match inner.flows.get_mut(&(*local, ANY_REMOTE)) {
+            Some(Flow::Passive(passive)) => passive,
+            _ => panic!("sockets/local inconsistency"),
+        };
         let cb: ControlBlock = match passive.poll_accept(ctx) {
             Poll::Pending => return Poll::Pending,
             Poll::Ready(Ok(e)) => e,
@@ -319,7 +364,7 @@ impl TcpPeer {
         }
 
         // TODO: Reset the connection if the following following check fails, instead of panicking.
-        if inner.established.insert(key, established).is_some() {
+        if inner.flows.insert(key, Flow::Established(established)).is_some() {
             panic!("duplicate queue descriptor in established sockets table");
         }
 
@@ -333,9 +378,14 @@ impl TcpPeer {
         let local: SocketAddrV4 = match inner.sockets.get_mut(&qd) {
             // Handle unbound socket.
             Some(Socket::Inactive { local: None }) => {
+                // Pick a port that the runtime receives the replies of, as it may only receive some of the flows.
                 // TODO: we should free this when closing.
-                let local_port: u16 = inner.ephemeral_ports.alloc_any()?;
-                SocketAddrV4::new(inner.local_ipv4_addr, local_port)
+                let (rt, local_ipv4_addr): (Rc<dyn NetworkRuntime>, Ipv4Addr) =
+                    (inner.rt.clone(), inner.local_ipv4_addr);
+                let local_port: u16 = inner
+                    .ephemeral_ports
+                    .alloc_any_if(|port| rt.receives_flow(SocketAddrV4::new(local_ipv4_addr, port), remote))?;
+                SocketAddrV4::new(local_ipv4_addr, local_port)
             },
             // Handle bound socket.
             Some(Socket::Inactive { local: Some(local) }) => *local,
@@ -371,7 +421,7 @@ impl TcpPeer {
         );
 
         // Insert socket in connecting table.
-        if inner.connecting.insert((local, remote), socket).is_some() {
+        if inner.flows.insert((local, remote), Flow::Connecting(socket)).is_some() {
             // This should not happen, unless we are leaking entries when transitioning to established state.
             error!("socket is already connecting?");
             Err(Fail::new(libc::EALREADY, "socket is connecting"))?;
@@ -392,7 +442,7 @@ impl TcpPeer {
             Some(Socket::Listening { .. }) => return Poll::Ready(Err(Fail::new(ENOTCONN, "socket listening"))),
             None => return Poll::Ready(Err(Fail::new(EBADF, "bad queue descriptor"))),
         };
-        match inner.established.get(&key) {
+        match inner.get_established(&key) {
             Some(ref s) => s.poll_recv(ctx),
             None => Poll::Ready(Err(Fail::new(ENOTCONN, "connection not established"))),
         }
@@ -420,7 +470,7 @@ impl TcpPeer {
             Some(..) => return Err(Fail::new(ENOTCONN, "connection not established")),
             None => return Err(Fail::new(EBADF, "bad queue descriptor")),
         };
-        match inner.established.get(&key) {
+        match inner.get_established(&key) {
             Some(ref s) => s.send(buf),
             None => Err(Fail::new(ENOTCONN, "connection not established")),
         }
@@ -433,7 +483,7 @@ impl TcpPeer {
         match inner.sockets.remove(&qd) {
             Some(Socket::Established { local, remote }) => {
                 let key: (SocketAddrV4, SocketAddrV4) = (local, remote);
-                match inner.established.get(&key) {
+                match inner.get_established(&key) {
                     Some(ref s) => s.close()?,
                     None => return Err(Fail::new(ENOTCONN, "connection not established")),
                 }
@@ -453,7 +503,7 @@ impl TcpPeer {
             Some(..) => return Err(Fail::new(ENOTCONN, "connection not established")),
             None => return Err(Fail::new(EBADF, "bad queue descriptor")),
         };
-        match inner.established.get(&key) {
+        match inner.get_established(&key) {
             Some(ref s) => Ok(s.remote_mss()),
             None => Err(Fail::new(ENOTCONN, "connection not established")),
         }
@@ -466,12 +516,27 @@ impl TcpPeer {
             Some(..) => return Err(Fail::new(ENOTCONN, "connection not established")),
             None => return Err(Fail::new(EBADF, "bad queue descriptor")),
         };
-        match inner.established.get(&key) {
+        match inner.get_established(&key) {
             Some(ref s) => Ok(s.current_rto()),
             None => Err(Fail::new(ENOTCONN, "connection not established")),
         }
     }
 
+    /// Returns the number of segments that were retransmitted on a connection, and the number of runs of out-of-order
+    /// data that it holds.
+    pub fn connection_stats(&self, fd: QDesc) -> Result<(u64, usize), Fail> {
+        let inner = self.inner.borrow();
+        let key = match inner.sockets.get(&fd) {
+            Some(Socket::Established { local, remote }) => (*local, *remote),
+            Some(..) => return Err(Fail::new(ENOTCONN, "connection not established")),
+            None => return Err(Fail::new(EBADF, "bad queue descriptor")),
+        };
+        match inner.get_established(&key) {
+            Some(ref s) => Ok(s.stats()),
+            None => Err(Fail::new(ENOTCONN, "connection not established")),
+        }
+    }
+
     pub fn endpoints(&self, fd: QDesc) -> Result<(SocketAddrV4, SocketAddrV4), Fail> {
         let inner = self.inner.borrow();
         let key = match inner.sockets.get(&fd) {
@@ -479,7 +544,7 @@ impl TcpPeer {
             Some(..) => return Err(Fail::new(ENOTCONN, "connection not established")),
             None => return Err(Fail::new(EBADF, "bad queue descriptor")),
         };
-        match inner.established.get(&key) {
+        match inner.get_established(&key) {
             Some(ref s) => Ok(s.endpoints()),
             None => Err(Fail::new(ENOTCONN, "connection not established")),
         }
@@ -506,9 +571,7 @@ impl Inner {
             isn_generator: IsnGenerator::new(nonce),
             ephemeral_ports,
             sockets: HashMap::new(),
-            passive: HashMap::new(),
-            connecting: HashMap::new(),
-            established: HashMap::new(),
+            flows: FlowTable::new(),
             rt,
             scheduler,
             clock,
@@ -517,11 +580,21 @@ impl Inner {
             tcp_config,
             arp,
             rng: Rc::new(RefCell::new(rng)),
+            coalescer: SegmentCoalescer::new(),
             dead_socket_tx,
         }
     }
 
+    /// Returns the established socket of a flow, if any.
+    fn get_established(&self, key: &FlowKey) -> Option<&EstablishedSocket> {
+        match self.flows.get(key) {
+            Some(Flow::Established(s)) => Some(s),
+            _ => None,
+        }
+    }
+
     fn receive(&mut self, ip_hdr: &Ipv4Header, buf: Buffer) -> Result<(), Fail> {
+        let rss_hash: Option<u32> = buf.rss_hash();
         let (mut tcp_hdr, data) = TcpHeader::parse(ip_hdr, buf, self.tcp_config.get_rx_checksum_offload())?;
         debug!("TCP received {:?}", tcp_hdr);
         let local = SocketAddrV4::new(ip_hdr.get_dest_addr(), tcp_hdr.dst_port);
@@ -532,18 +605,32 @@ impl Inner {
         }
         let key = (local, remote);
 
-        if let Some(s) = self.established.get(&key) {
+        // Reuse the hash that the NIC computed, if any, as it should be the same one that the flow table uses.
+        let hash: u32 = self.flows.resolve_hash(rss_hash, &key);
+        if let Some(Flow::Established(s)) = self.flows.get_with_hash(hash, &key) {
             debug!("Routing to established connection: {:?}", key);
+            if self.tcp_config.get_rx_segment_coalescing() {
+                if SegmentCoalescer::can_coalesce(&tcp_hdr, &data) {
+                    if let Some(batch) = self.coalescer.push(key, tcp_hdr, data) {
+                        self.receive_coalesced(batch);
+                    }
+                    return Ok(());
+                }
+                // Don't let this segment overtake the ones that are being coalesced.
+                if let Some(batch) = self.coalescer.take() {
+                    self.receive_coalesced(batch);
+                }
+            }
             s.receive(&mut tcp_hdr, data);
             return Ok(());
         }
-        if let Some(s) = self.connecting.get_mut(&key) {
+        if let Some(Flow::Connecting(s)) = self.flows.get_mut_with_hash(hash, &key) {
             debug!("Routing to connecting connection: {:?}", key);
             s.receive(&tcp_hdr);
             return Ok(());
         }
         let (local, _) = key;
-        if let Some(s) = self.passive.get_mut(&local) {
+        if let Some(Flow::Passive(s)) = self.flows.get_mut(&(local, ANY_REMOTE)) {
             debug!("Routing to passive connection: {:?}", local);
             return s.receive(ip_hdr, &tcp_hdr);
         }
@@ -554,6 +641,21 @@ impl Inner {
         Ok(())
     }
 
+    // Hands the segments that are being coalesced to their connection.
+    fn flush_coalesced(&mut self) {
+        if let Some(batch) = self.coalescer.take() {
+            self.receive_coalesced(batch);
+        }
+    }
+
+    fn receive_coalesced(&self, batch: CoalescedSegments) {
+        // The connection may have gone away in the meantime.
+        if let Some(s) = self.get_established(&batch.key) {
+            debug!("Routing {} coalesced segments to {:?}", batch.rest.len() + 1, batch.key);
+            s.receive_coalesced(batch.header, batch.data, batch.rest);
+        }
+    }
+
     fn send_rst(&mut self, local: &SocketAddrV4, remote: &SocketAddrV4) -> Result<(), Fail> {
         // TODO: Make this work pending on ARP resolution if needed.
         let remote_link_addr = self
@@ -570,6 +672,8 @@ impl Inner {
             tcp_hdr,
             data: None,
             tx_checksum_offload: self.tcp_config.get_rx_checksum_offload(),
+            tx_segment_size: None,
+            template: None,
         };
         self.rt.transmit(Box::new(segment));
 
@@ -584,20 +688,20 @@ impl Inner {
         };
 
         let result = {
-            let socket = match self.connecting.get_mut(&key) {
-                Some(s) => s,
-                None => return Poll::Ready(Err(Fail::new(EAGAIN, "socket not connecting"))),
+            let socket = match self.flows.get_mut(&key) {
+                Some(Flow::Connecting(s)) => s,
+                _ => return Poll::Ready(Err(Fail::new(EAGAIN, "socket not connecting"))),
             };
             match socket.poll_result(context) {
                 Poll::Pending => return Poll::Pending,
                 Poll::Ready(r) => r,
             }
         };
-        self.connecting.remove(&key);
+        self.flows.remove(&key);
 
         let cb = result?;
         let socket = EstablishedSocket::new(cb, fd, self.dead_socket_tx.clone());
-        assert!(self.established.insert(key, socket).is_none());
+        assert!(self.flows.insert(key, Flow::Established(socket)).is_none());
         let (local, remote) = key;
         self.sockets.insert(fd, Socket::Established { local, remote });
 
@@ -3,15 +3,29 @@
 
 use crate::{
     inetstack::protocols::{
-        ethernet2::Ethernet2Header,
-        ip::IpProtocol,
+        ethernet2::{
+            Ethernet2Header,
+            ETHERNET2_HEADER_SIZE,
+        },
+        ip::{
+            checksum::{
+                update_u16,
+                update_u32,
+                Checksum,
+            },
+            template::HeaderTemplate,
+            IpProtocol,
+        },
         ipv4::Ipv4Header,
         tcp::SeqNumber,
     },
     runtime::{
         fail::Fail,
         memory::Buffer,
-        network::PacketBuf,
+        network::{
+            PacketBuf,
+            SegmentationOffload,
+        },
     },
 };
 use ::byteorder::{
@@ -35,6 +49,75 @@ pub struct TcpSegment {
     pub tcp_hdr: TcpHeader,
     pub data: Option<Buffer>,
     pub tx_checksum_offload: bool,
+    // Maximum payload of the segments that the NIC should split this segment into, if it offloads segmentation.
+    pub tx_segment_size: Option<usize>,
+    // Prebuilt headers of the connection, which the headers of this segment are patched from, if they match. Only
+    // segments without TCP options may have one.
+    pub template: Option<HeaderTemplate>,
+}
+
+impl TcpSegment {
+    // Checks if the NIC should split this segment into several ones.
+    fn is_segmented(&self) -> bool {
+        match self.tx_segment_size {
+            Some(segment_size) => self.body_size() > segment_size,
+            None => false,
+        }
+    }
+
+    // Writes the headers of this segment by patching the fields that change across the segments of a connection into
+    // its header template, and updating the checksums accordingly.
+    fn write_header_from_template(&self, template: &HeaderTemplate, buf: &mut [u8]) {
+        debug_assert_eq!(self.tcp_hdr.num_options, 0);
+        let payload_len: usize = self.body_size();
+        let segmented: bool = self.is_segmented();
+        let tcp_buf: &mut [u8] = template.write(buf, MIN_TCP_HEADER_SIZE + payload_len);
+
+        // The template leaves these fields zeroed, except for the data offset.
+        let old_checksum: u16 = NetworkEndian::read_u16(&tcp_buf[16..18]);
+        let old_flags: u16 = NetworkEndian::read_u16(&tcp_buf[12..14]);
+        let flags: u16 = self.tcp_hdr.offset_and_flags();
+        NetworkEndian::write_u32(&mut tcp_buf[4..8], self.tcp_hdr.seq_num.into());
+        NetworkEndian::write_u32(&mut tcp_buf[8..12], self.tcp_hdr.ack_num.into());
+        NetworkEndian::write_u16(&mut tcp_buf[12..14], flags);
+        NetworkEndian::write_u16(&mut tcp_buf[14..16], self.tcp_hdr.window_size);
+        NetworkEndian::write_u16(&mut tcp_buf[18..20], self.tcp_hdr.urgent_pointer);
+
+        let checksum: u16 = if segmented {
+            tcp_pseudo_header_checksum(&self.ipv4_hdr)
+        } else if self.tx_checksum_offload {
+            0
+        } else {
+            let mut checksum: u16 = old_checksum;
+            checksum = update_u32(checksum, 0, self.tcp_hdr.seq_num.into());
+            checksum = update_u32(checksum, 0, self.tcp_hdr.ack_num.into());
+            checksum = update_u16(checksum, old_flags, flags);
+            checksum = update_u16(checksum, 0, self.tcp_hdr.window_size);
+            checksum = update_u16(checksum, 0, self.tcp_hdr.urgent_pointer);
+            // TCP segment length, in the pseudo-IP header.
+            checksum = update_u16(
+                checksum,
+                MIN_TCP_HEADER_SIZE as u16,
+                (MIN_TCP_HEADER_SIZE + payload_len) as u16,
+            );
+            match &self.data {
+                Some(data) => {
+                    let mut payload: Checksum = Checksum::new();
+                    for bytes in data.segments() {
+                        payload.add_bytes(bytes);
+                    }
+                    update_u16(checksum, 0, payload.fold())
+                },
+                None => checksum,
+            }
+        };
+        NetworkEndian::write_u16(&mut tcp_buf[16..18], checksum);
+
+        if segmented {
+            // See write_header().
+            NetworkEndian::write_u16(&mut buf[(ETHERNET2_HEADER_SIZE + 10)..(ETHERNET2_HEADER_SIZE + 12)], 0);
+        }
+    }
 }
 
 impl PacketBuf for TcpSegment {
@@ -50,6 +133,10 @@ impl PacketBuf for TcpSegment {
     }
 
     fn write_header(&self, buf: &mut [u8]) {
+        if let Some(template) = &self.template {
+            return self.write_header_from_template(template, buf);
+        }
+
         let eth_hdr_size = self.ethernet2_hdr.compute_size();
         let ipv4_hdr_size = self.ipv4_hdr.compute_size();
         let tcp_hdr_size = self.tcp_hdr.compute_size();
@@ -62,18 +149,25 @@ impl PacketBuf for TcpSegment {
         let ipv4_payload_len = tcp_hdr_size + self.body_size();
         self.ipv4_hdr
             .serialize(&mut buf[cur_pos..(cur_pos + ipv4_hdr_size)], ipv4_payload_len);
+        let segmented: bool = self.is_segmented();
+        if segmented {
+            // The NIC computes the IPv4 checksum of every segment.
+            NetworkEndian::write_u16(&mut buf[(cur_pos + 10)..(cur_pos + 12)], 0);
+        }
         cur_pos += ipv4_hdr_size;
 
-        let payload: &[u8] = match &self.data {
-            Some(buf) => &buf[..],
-            None => &[],
-        };
+        let tcp_buf: &mut [u8] = &mut buf[cur_pos..(cur_pos + tcp_hdr_size)];
         self.tcp_hdr.serialize(
-            &mut buf[cur_pos..(cur_pos + tcp_hdr_size)],
+            tcp_buf,
             &self.ipv4_hdr,
-            payload,
-            self.tx_checksum_offload,
+            self.data.iter().flat_map(|data| data.segments()),
+            self.tx_checksum_offload || segmented,
         );
+        if segmented {
+            // The NIC completes the TCP checksum of every segment, starting from the pseudo-header checksum (without
+            // the length, since it differs across segments).
+            NetworkEndian::write_u16(&mut tcp_buf[16..18], tcp_pseudo_header_checksum(&self.ipv4_hdr));
+        }
     }
 
     fn take_body(&self) -> Option<Buffer> {
@@ -82,6 +176,18 @@ impl PacketBuf for TcpSegment {
             None => None,
         }
     }
+
+    fn segmentation_offload(&self) -> Option<SegmentationOffload> {
+        if !self.is_segmented() {
+            return None;
+        }
+        Some(SegmentationOffload {
+            l2_len: self.ethernet2_hdr.compute_size(),
+            l3_len: self.ipv4_hdr.compute_size(),
+            l4_len: self.tcp_hdr.compute_size(),
+            segment_size: self.tx_segment_size?,
+        })
+    }
 }
 
 #[derive(Debug, Clone, Copy)]
@@ -166,7 +272,7 @@ impl TcpOptions2 {
     }
 }
 
-#[derive(Debug)]
+#[derive(Clone, Debug)]
 pub struct TcpHeader {
     pub src_port: u16,
     pub dst_port: u16,
@@ -260,7 +366,7 @@ impl TcpHeader {
 
         if !rx_checksum_offload {
             let checksum = NetworkEndian::read_u16(&hdr_buf[16..18]);
-            if checksum != tcp_checksum(ipv4_header, hdr_buf, data_buf) {
+            if checksum != tcp_checksum(ipv4_header, hdr_buf, [data_buf]) {
                 return Err(Fail::new(EBADMSG, "TCP checksum mismatch"));
             }
         }
@@ -362,43 +468,21 @@ impl TcpHeader {
         Ok((header, buf))
     }
 
-    pub fn serialize(&self, buf: &mut [u8], ipv4_hdr: &Ipv4Header, data: &[u8], tx_checksum_offload: bool) {
+    /// Serializes the target TCP header. The payload may be scattered across several slices.
+    pub fn serialize<'a>(
+        &self,
+        buf: &mut [u8],
+        ipv4_hdr: &Ipv4Header,
+        data: impl IntoIterator<Item = &'a [u8]>,
+        tx_checksum_offload: bool,
+    ) {
         let fixed_buf: &mut [u8; MIN_TCP_HEADER_SIZE] = (&mut buf[..MIN_TCP_HEADER_SIZE]).try_into().unwrap();
         NetworkEndian::write_u16(&mut fixed_buf[0..2], self.src_port.into());
         NetworkEndian::write_u16(&mut fixed_buf[2..4], self.dst_port.into());
         NetworkEndian::write_u32(&mut fixed_buf[4..8], self.seq_num.into());
         NetworkEndian::write_u32(&mut fixed_buf[8..12], self.ack_num.into());
 
-        fixed_buf[12] = ((self.compute_size() / 4) as u8) << 4;
-        if self.ns {
-            fixed_buf[12] |= 1;
-        }
-        fixed_buf[13] = 0;
-        if self.cwr {
-            fixed_buf[13] |= 1 << 7;
-        }
-        if self.ece {
-            fixed_buf[13] |= 1 << 6;
-        }
-        if self.urg {
-            fixed_buf[13] |= 1 << 5;
-        }
-        if self.ack {
-            fixed_buf[13] |= 1 << 4;
-        }
-        if self.psh {
-            fixed_buf[13] |= 1 << 3;
-        }
-        if self.rst {
-            fixed_buf[13] |= 1 << 2;
-        }
-        if self.syn {
-            fixed_buf[13] |= 1 << 1;
-        }
-        if self.fin {
-            fixed_buf[13] |= 1 << 0;
-        }
-
+        NetworkEndian::write_u16(&mut fixed_buf[12..14], self.offset_and_flags());
         NetworkEndian::write_u16(&mut fixed_buf[14..16], self.window_size);
 
         // Write the checksum (bytes 16..18) later.
@@ -429,6 +513,39 @@ impl TcpHeader {
         }
     }
 
+    // Returns octets 12 and 13 of the header, which hold the data offset and the flags.
+    fn offset_and_flags(&self) -> u16 {
+        let mut word: u16 = ((self.compute_size() / 4) as u16) << 12;
+        if self.ns {
+            word |= 1 << 8;
+        }
+        if self.cwr {
+            word |= 1 << 7;
+        }
+        if self.ece {
+            word |= 1 << 6;
+        }
+        if self.urg {
+            word |= 1 << 5;
+        }
+        if self.ack {
+            word |= 1 << 4;
+        }
+        if self.psh {
+            word |= 1 << 3;
+        }
+        if self.rst {
+            word |= 1 << 2;
+        }
+        if self.syn {
+            word |= 1 << 1;
+        }
+        if self.fin {
+            word |= 1 << 0;
+        }
+        word
+    }
+
     // TODO: Review the use of usize here (and everywhere in inetstack, really).
     pub fn compute_size(&self) -> usize {
         let mut size = MIN_TCP_HEADER_SIZE;
@@ -455,80 +572,166 @@ impl TcpHeader {
     }
 }
 
-fn tcp_checksum(ipv4_header: &Ipv4Header, header: &[u8], data: &[u8]) -> u16 {
-    let mut state = 0xffffu32;
-
-    // First, fold in a "pseudo-IP" header of...
-    // 1) Source address (4 bytes)
-    let src_octets = ipv4_header.get_src_addr().octets();
-    state += NetworkEndian::read_u16(&src_octets[0..2]) as u32;
-    state += NetworkEndian::read_u16(&src_octets[2..4]) as u32;
-
-    // 2) Destination address (4 bytes)
-    let dst_octets = ipv4_header.get_dest_addr().octets();
-    state += NetworkEndian::read_u16(&dst_octets[0..2]) as u32;
-    state += NetworkEndian::read_u16(&dst_octets[2..4]) as u32;
-
-    // 3) 1 byte of zeros and TCP protocol number (1 byte)
-    state += NetworkEndian::read_u16(&[0, IpProtocol::TCP as u8]) as u32;
-
-    // 4) TCP segment length (2 bytes)
-    state += (header.len() + data.len()) as u32;
-
-    let fixed_header: &[u8; MIN_TCP_HEADER_SIZE] = header[..MIN_TCP_HEADER_SIZE].try_into().unwrap();
-
-    // Continue to the TCP header. First, for the fixed length parts, we have...
-    // 1) Source port (2 bytes)
-    state += NetworkEndian::read_u16(&fixed_header[0..2]) as u32;
-
-    // 2) Destination port (2 bytes)
-    state += NetworkEndian::read_u16(&fixed_header[2..4]) as u32;
-
-    // 3) Sequence number (4 bytes)
-    state += NetworkEndian::read_u16(&fixed_header[4..6]) as u32;
-    state += NetworkEndian::read_u16(&fixed_header[6..8]) as u32;
-
-    // 4) Acknowledgement number (4 bytes)
-    state += NetworkEndian::read_u16(&fixed_header[8..10]) as u32;
-    state += NetworkEndian::read_u16(&fixed_header[10..12]) as u32;
-
-    // 5) Data offset (4 bits), reserved (4 bits), and flags (1 byte)
-    state += NetworkEndian::read_u16(&fixed_header[12..14]) as u32;
-
-    // 6) Window (2 bytes)
-    state += NetworkEndian::read_u16(&fixed_header[14..16]) as u32;
-
-    // 7) Checksum (all zeros, 2 bytes)
-    state += 0;
+// Computes the (non-complemented) checksum of the pseudo-IP header without the TCP segment length, which is what NICs
+// expect to find in the checksum field of segments that they split.
+fn tcp_pseudo_header_checksum(ipv4_header: &Ipv4Header) -> u16 {
+    let mut checksum: Checksum = Checksum::new();
+    checksum.add_pseudo_header(
+        ipv4_header.get_src_addr(),
+        ipv4_header.get_dest_addr(),
+        IpProtocol::TCP as u8,
+    );
+    checksum.fold()
+}
 
-    // 8) Urgent pointer (2 bytes)
-    state += NetworkEndian::read_u16(&fixed_header[18..20]) as u32;
+fn tcp_checksum<'a>(ipv4_header: &Ipv4Header, header: &[u8], data: impl IntoIterator<Item = &'a [u8]>) -> u16 {
+    let mut checksum: Checksum = Checksum::new();
+
+    // First, fold in a "pseudo-IP" header of source address, destination address and TCP protocol number. The TCP
+    // segment length is folded in once the data is.
+    checksum.add_pseudo_header(
+        ipv4_header.get_src_addr(),
+        ipv4_header.get_dest_addr(),
+        IpProtocol::TCP as u8,
+    );
+
+    // Continue to the TCP header, skipping the checksum field (bytes 16..18). Since `data_offset` is guaranteed to be
+    // aligned to a 32-bit boundary, the options don't leave a remainder.
+    assert_eq!(header.len() % 2, 0);
+    checksum.add_bytes(&header[..16]);
+    checksum.add_bytes(&header[18..]);
+
+    // Finally, checksum the data itself, which may be scattered across several slices.
+    let mut data_len: usize = 0;
+    for bytes in data {
+        checksum.add_bytes(bytes);
+        data_len += bytes.len();
+    }
+    checksum.add_u16((header.len() + data_len) as u16);
+    checksum.finish()
+}
 
-    // Next, the variable length part of the header for TCP options. Since `data_offset` is
-    // guaranteed to be aligned to a 32-bit boundary, we don't have to handle remainders.
-    if header.len() > MIN_TCP_HEADER_SIZE {
-        assert_eq!(header.len() % 2, 0);
-        for chunk in header[MIN_TCP_HEADER_SIZE..].chunks_exact(2) {
-            state += NetworkEndian::read_u16(chunk) as u32;
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        TcpHeader,
+        TcpSegment,
+        MIN_TCP_HEADER_SIZE,
+    };
+    use crate::{
+        inetstack::protocols::{
+            ethernet2::{
+                EtherType2,
+                Ethernet2Header,
+                ETHERNET2_HEADER_SIZE,
+            },
+            ip::{
+                template::HeaderTemplate,
+                IpProtocol,
+            },
+            ipv4::{
+                Ipv4Header,
+                IPV4_HEADER_DEFAULT_SIZE,
+            },
+            tcp::SeqNumber,
+        },
+        runtime::{
+            memory::{
+                Buffer,
+                DataBuffer,
+            },
+            network::{
+                types::MacAddress,
+                PacketBuf,
+            },
+        },
+    };
+    use ::std::net::Ipv4Addr;
+
+    const HEADER_SIZE: usize = ETHERNET2_HEADER_SIZE + IPV4_HEADER_DEFAULT_SIZE + MIN_TCP_HEADER_SIZE;
+
+    fn segment(
+        tcp_hdr: TcpHeader,
+        data: Option<Buffer>,
+        tx_checksum_offload: bool,
+        tx_segment_size: Option<usize>,
+        template: Option<HeaderTemplate>,
+    ) -> TcpSegment {
+        TcpSegment {
+            ethernet2_hdr: Ethernet2Header::new(
+                MacAddress::new([0xd, 0xe, 0xa, 0xd, 0x0, 0x0]),
+                MacAddress::new([0xb, 0xe, 0xe, 0xf, 0x0, 0x0]),
+                EtherType2::Ipv4,
+            ),
+            ipv4_hdr: Ipv4Header::new(
+                Ipv4Addr::new(198, 0, 0, 1),
+                Ipv4Addr::new(198, 0, 0, 2),
+                IpProtocol::TCP,
+            ),
+            tcp_hdr,
+            data,
+            tx_checksum_offload,
+            tx_segment_size,
+            template,
         }
     }
 
-    // Finally, checksum the data itself.
-    let mut chunks_iter = data.chunks_exact(2);
-    while let Some(chunk) = chunks_iter.next() {
-        state += NetworkEndian::read_u16(chunk) as u32;
-    }
-    // Since the data may have an odd number of bytes, pad the last byte with zero if necessary.
-    if let Some(&b) = chunks_iter.remainder().get(0) {
-        state += NetworkEndian::read_u16(&[b, 0]) as u32;
-    }
+    /// Tests that headers that are patched from a template match the ones that are serialized from scratch.
+    #[test]
+    fn test_tcp_segment_template() {
+        let template: HeaderTemplate = HeaderTemplate::new(
+            &segment(TcpHeader::new(0x3132, 0x4546), None, false, None, None),
+            MacAddress::new([0xd, 0xe, 0xa, 0xd, 0x0, 0x0]),
+            0,
+        );
 
-    // NB: We don't need to subtract out 0xFFFF as we accumulate the sum. Since we use a u32 for
-    // intermediate state, we would need 2^16 additions to overflow. This is well beyond the reach
-    // of the largest jumbo frames. The upshot is that the compiler can then optimize this final
-    // loop into a single branchfree code.
-    while state > 0xFFFF {
-        state -= 0xFFFF;
+        let mut tcp_hdr: TcpHeader = TcpHeader::new(0x3132, 0x4546);
+        tcp_hdr.seq_num = SeqNumber::from(0xfffffff0);
+        tcp_hdr.ack_num = SeqNumber::from(0x12345678);
+        tcp_hdr.ack = true;
+        tcp_hdr.window_size = 0xffff;
+        let mut fin_hdr: TcpHeader = tcp_hdr.clone();
+        fin_hdr.fin = true;
+        fin_hdr.psh = true;
+
+        for tcp_hdr in [tcp_hdr, fin_hdr] {
+            for len in [0, 1, 7, 1460, 4001] {
+                let bytes: Vec<u8> = (0..len).map(|i| (i * 131 + 7) as u8).collect();
+                let data: Option<Buffer> = if len > 0 {
+                    Some(Buffer::Heap(DataBuffer::from_slice(&bytes)))
+                } else {
+                    None
+                };
+                for (tx_checksum_offload, tx_segment_size) in [(false, None), (true, None), (true, Some(1460))] {
+                    let mut expected: [u8; HEADER_SIZE] = [0; HEADER_SIZE];
+                    segment(
+                        tcp_hdr.clone(),
+                        data.clone(),
+                        tx_checksum_offload,
+                        tx_segment_size,
+                        None,
+                    )
+                    .write_header(&mut expected);
+                    let mut buf: [u8; HEADER_SIZE] = [0; HEADER_SIZE];
+                    segment(
+                        tcp_hdr.clone(),
+                        data.clone(),
+                        tx_checksum_offload,
+                        tx_segment_size,
+                        Some(template),
+                    )
+                    .write_header(&mut buf);
+                    assert_eq!(
+                        buf, expected,
+                        "len={} tx_checksum_offload={} tx_segment_size={:?}",
+                        len, tx_checksum_offload, tx_segment_size
+                    );
+                }
+            }
+        }
     }
-    !state as u16
 }
@@ -160,6 +160,8 @@ fn test_refuse_connection_early_rst() {
         },
         data: None,
         tx_checksum_offload: false,
+        tx_segment_size: None,
+        template: None,
     };
 
     // Serialize segment.
@@ -228,6 +230,8 @@ fn test_refuse_connection_early_ack() {
         },
         data: None,
         tx_checksum_offload: false,
+        tx_segment_size: None,
+        template: None,
     };
 
     // Serialize segment.
@@ -306,6 +310,8 @@ fn test_refuse_connection_missing_syn() {
         },
         data: None,
         tx_checksum_offload: false,
+        tx_segment_size: None,
+        template: None,
     };
 
     // Serialize segment.
@@ -7,15 +7,15 @@
 
 use crate::{
     inetstack::protocols::{
-        ip::IpProtocol,
+        ip::{
+            checksum::Checksum,
+            IpProtocol,
+        },
         ipv4::Ipv4Header,
     },
     runtime::{
         fail::Fail,
-        memory::{
-            Buffer,
-            DataBuffer,
-        },
+        memory::Buffer,
     },
 };
 use ::byteorder::{
@@ -98,7 +98,7 @@ impl UdpHeader {
             // Check if we should skip checksum verification.
             if checksum != 0 {
                 // No, so check if checksum value matches what we expect.
-                if checksum != Self::checksum(&ipv4_hdr, hdr_buf, payload_buf) {
+                if checksum != Self::checksum(&ipv4_hdr, hdr_buf, [payload_buf]) {
                     return Err(Fail::new(EBADMSG, "UDP checksum mismatch"));
                 }
             }
@@ -108,16 +108,22 @@ impl UdpHeader {
         Ok((header, &buf[UDP_HEADER_SIZE..]))
     }
 
-    /// Parses a buffer into a UDP header.
-    pub fn parse(ipv4_hdr: &Ipv4Header, buf: Buffer, checksum_offload: bool) -> Result<(Self, Buffer), Fail> {
-        match Self::parse_from_slice(ipv4_hdr, &buf[..], checksum_offload) {
-            Ok((udp_hdr, bytes)) => Ok((udp_hdr, Buffer::Heap(DataBuffer::from_slice(bytes)))),
-            Err(e) => Err(e),
-        }
+    /// Parses a buffer into a UDP header. The payload is returned in the same buffer, without copying it.
+    pub fn parse(ipv4_hdr: &Ipv4Header, mut buf: Buffer, checksum_offload: bool) -> Result<(Self, Buffer), Fail> {
+        let udp_hdr: UdpHeader = match Self::parse_from_slice(ipv4_hdr, &buf[..], checksum_offload) {
+            Ok((udp_hdr, _)) => udp_hdr,
+            Err(e) => return Err(e),
+        };
+        buf.adjust(UDP_HEADER_SIZE);
+        Ok((udp_hdr, buf))
     }
 
-    /// Serializes the target UDP header.
-    pub fn serialize(&self, buf: &mut [u8], ipv4_hdr: &Ipv4Header, data: &[u8], checksum_offload: bool) {
+    /// Serializes the target UDP header. The payload may be scattered across several slices.
+    pub fn serialize<'a, I>(&self, buf: &mut [u8], ipv4_hdr: &Ipv4Header, data: I, checksum_offload: bool)
+    where
+        I: IntoIterator<Item = &'a [u8]> + Clone,
+    {
+        let data_len: usize = data.clone().into_iter().map(|bytes| bytes.len()).sum();
         let fixed_buf: &mut [u8; UDP_HEADER_SIZE] = (&mut buf[..UDP_HEADER_SIZE]).try_into().unwrap();
 
         // Write source port.
@@ -127,7 +133,7 @@ impl UdpHeader {
         NetworkEndian::write_u16(&mut fixed_buf[2..4], self.dest_port.into());
 
         // Write payload length.
-        NetworkEndian::write_u16(&mut fixed_buf[4..6], (UDP_HEADER_SIZE + data.len()) as u16);
+        NetworkEndian::write_u16(&mut fixed_buf[4..6], (UDP_HEADER_SIZE + data_len) as u16);
 
         // Write checksum.
         let checksum: u16 = if checksum_offload {
@@ -146,59 +152,24 @@ impl UdpHeader {
     /// multiple of two octets.
     ///
     /// TODO: Write a unit test for this function.
-    fn checksum(ipv4_hdr: &Ipv4Header, udp_hdr: &[u8], data: &[u8]) -> u16 {
-        let mut state: u32 = 0xffffu32;
+    fn checksum<'a>(ipv4_hdr: &Ipv4Header, udp_hdr: &[u8], data: impl IntoIterator<Item = &'a [u8]>) -> u16 {
+        let mut checksum: Checksum = Checksum::new();
 
-        // Source address (4 bytes)
-        let src_octets: [u8; 4] = ipv4_hdr.get_src_addr().octets();
-        state += NetworkEndian::read_u16(&src_octets[0..2]) as u32;
-        state += NetworkEndian::read_u16(&src_octets[2..4]) as u32;
+        // Pseudo header. The UDP segment length is added along with the payload.
+        checksum.add_pseudo_header(ipv4_hdr.get_src_addr(), ipv4_hdr.get_dest_addr(), IpProtocol::UDP as u8);
 
-        // Destination address (4 bytes)
-        let dst_octets: [u8; 4] = ipv4_hdr.get_dest_addr().octets();
-        state += NetworkEndian::read_u16(&dst_octets[0..2]) as u32;
-        state += NetworkEndian::read_u16(&dst_octets[2..4]) as u32;
-
-        // Padding zeros (1 byte) and UDP protocol number (1 byte)
-        state += NetworkEndian::read_u16(&[0, IpProtocol::UDP as u8]) as u32;
-
-        // UDP segment length (2 bytes)
-        state += (udp_hdr.len() + data.len()) as u32;
-
-        // Switch to UDP header.
+        // Switch to UDP header, skipping the checksum field (bytes 6..8).
         let fixed_header: &[u8; UDP_HEADER_SIZE] = udp_hdr.try_into().unwrap();
+        checksum.add_bytes(&fixed_header[0..6]);
 
-        // Source port (2 bytes)
-        state += NetworkEndian::read_u16(&fixed_header[0..2]) as u32;
-
-        // Destination port (2 bytes)
-        state += NetworkEndian::read_u16(&fixed_header[2..4]) as u32;
-
-        // Payload Length (2 bytes)
-        state += NetworkEndian::read_u16(&fixed_header[4..6]) as u32;
-
-        // Checksum (2 bytes, all zeros)
-        state += 0;
-
-        // Payload.
-        let mut chunks_iter = data.chunks_exact(2);
-        while let Some(chunk) = chunks_iter.next() {
-            state += NetworkEndian::read_u16(chunk) as u32;
+        // Payload, padded with zeros if it has an odd number of bytes.
+        let mut data_len: usize = 0;
+        for bytes in data {
+            checksum.add_bytes(bytes);
+            data_len += bytes.len();
         }
-        // Pad with zeros with payload has an odd number of bytes.
-        if let Some(&b) = chunks_iter.remainder().get(0) {
-            state += NetworkEndian::read_u16(&[b, 0]) as u32;
-        }
-
-        // NOTE: We don't need to subtract out 0xFFFF as we accumulate the sum.
-        // Since we use a u32 for intermediate state, we would need 2^16
-        // additions to overflow. This is well beyond the reach of the largest
-        // jumbo frames. The upshot is that the compiler can then optimize this
-        // final loop into a single branch-free code.
-        while state > 0xFFFF {
-            state -= 0xFFFF;
-        }
-        !state as u16
+        checksum.add_u16((udp_hdr.len() + data_len) as u16);
+        checksum.finish()
     }
 }
 
@@ -209,6 +180,7 @@ impl UdpHeader {
 #[cfg(test)]
 mod test {
     use super::*;
+    use crate::runtime::memory::DataBuffer;
     use ::std::net::Ipv4Addr;
 
     /// Builds a fake Ipv4 Header.
@@ -238,7 +210,7 @@ mod test {
         let mut buf: [u8; 8] = [0; 8];
 
         // Do it.
-        udp_hdr.serialize(&mut buf, &ipv4_hdr, &data, checksum_offload);
+        udp_hdr.serialize(&mut buf, &ipv4_hdr, [&data[..]], checksum_offload);
         assert_eq!(buf, [0x0, 0x32, 0x0, 0x45, 0x0, 0x10, 0x0, 0x0]);
     }
 
@@ -272,4 +244,31 @@ mod test {
             },
         }
     }
+
+    /// Tests that UDP parsing hands back the payload without copying it.
+    #[test]
+    fn test_udp_header_parsing_zero_copy() {
+        // Build fake IPv4 header.
+        let ipv4_hdr: Ipv4Header = ipv4_header();
+
+        // Build input buffer.
+        let checksum_offload: bool = true;
+        let hdr: [u8; 8] = [0x0, 0x32, 0x0, 0x45, 0x0, 0x10, 0x0, 0x0];
+        let data: [u8; 8] = [0x0, 0x1, 0x0, 0x1, 0x0, 0x1, 0x0, 0x1];
+        let buf: Buffer = Buffer::Heap(DataBuffer::from_slice(&[hdr, data].concat()));
+        let payload_ptr: *const u8 = buf[UDP_HEADER_SIZE..].as_ptr();
+
+        // Do it.
+        match UdpHeader::parse(&ipv4_hdr, buf, checksum_offload) {
+            Ok((udp_hdr, payload)) => {
+                assert_eq!(udp_hdr.src_port(), 0x32);
+                assert_eq!(udp_hdr.dest_port(), 0x45);
+                assert_eq!(&payload[..], &data[..]);
+                assert_eq!(payload.as_ptr(), payload_ptr);
+            },
+            Err(e) => {
+                assert!(false, "{:?}", e);
+            },
+        }
+    }
 }
@@ -10,6 +10,13 @@ mod header;
 use crate::{
     inetstack::protocols::{
         ethernet2::Ethernet2Header,
+        ip::{
+            checksum::{
+                update_u16,
+                Checksum,
+            },
+            template::HeaderTemplate,
+        },
         ipv4::Ipv4Header,
     },
     runtime::{
@@ -17,6 +24,10 @@ use crate::{
         network::PacketBuf,
     },
 };
+use ::byteorder::{
+    ByteOrder,
+    NetworkEndian,
+};
 
 //==============================================================================
 // Exports
@@ -42,6 +53,8 @@ pub struct UdpDatagram {
     data: Buffer,
     /// Offload checksum to hardware?
     checksum_offload: bool,
+    /// Prebuilt headers of the socket, which the headers of this datagram are patched from.
+    template: Option<HeaderTemplate>,
 }
 
 //==============================================================================
@@ -57,6 +70,7 @@ impl UdpDatagram {
         udp_hdr: UdpHeader,
         data: Buffer,
         checksum_offload: bool,
+        template: Option<HeaderTemplate>,
     ) -> Self {
         Self {
             ethernet2_hdr,
@@ -64,8 +78,34 @@ impl UdpDatagram {
             udp_hdr,
             data,
             checksum_offload,
+            template,
         }
     }
+
+    /// Serializes the header of the target UDP datagram by patching its length into a header template, and updating the
+    /// checksums accordingly.
+    fn write_header_from_template(&self, template: &HeaderTemplate, buf: &mut [u8]) {
+        let udp_len: u16 = (self.udp_hdr.size() + self.data.len()) as u16;
+        let udp_buf: &mut [u8] = template.write(buf, udp_len as usize);
+
+        let old_len: u16 = NetworkEndian::read_u16(&udp_buf[4..6]);
+        NetworkEndian::write_u16(&mut udp_buf[4..6], udp_len);
+
+        let checksum: u16 = if self.checksum_offload {
+            0
+        } else {
+            // The length is covered twice, by the pseudo-IP header and by the UDP header.
+            let mut checksum: u16 = NetworkEndian::read_u16(&udp_buf[6..8]);
+            checksum = update_u16(checksum, old_len, udp_len);
+            checksum = update_u16(checksum, old_len, udp_len);
+            let mut payload: Checksum = Checksum::new();
+            for bytes in self.data.segments() {
+                payload.add_bytes(bytes);
+            }
+            update_u16(checksum, 0, payload.fold())
+        };
+        NetworkEndian::write_u16(&mut udp_buf[6..8], checksum);
+    }
 }
 
 //==============================================================================
@@ -86,6 +126,10 @@ impl PacketBuf for UdpDatagram {
 
     /// Serializes the header of the target UDP datagram.
     fn write_header(&self, buf: &mut [u8]) {
+        if let Some(template) = &self.template {
+            return self.write_header_from_template(template, buf);
+        }
+
         let mut cur_pos: usize = 0;
         let eth_hdr_size: usize = self.ethernet2_hdr.compute_size();
         let udp_hdr_size: usize = self.udp_hdr.size();
@@ -106,7 +150,7 @@ impl PacketBuf for UdpDatagram {
         self.udp_hdr.serialize(
             &mut buf[cur_pos..(cur_pos + udp_hdr_size)],
             &self.ipv4_hdr,
-            &self.data[..],
+            self.data.segments(),
             self.checksum_offload,
         );
     }
@@ -177,17 +221,54 @@ mod test {
         udp_hdr.serialize(
             &mut hdr[(ETHERNET2_HEADER_SIZE + IPV4_HEADER_DEFAULT_SIZE)..],
             &ipv4_hdr,
-            &data,
+            data.segments(),
             checksum_offload,
         );
 
         // Output buffer.
         let mut buf: [u8; HEADER_SIZE] = [0; HEADER_SIZE];
 
-        let datagram: UdpDatagram = UdpDatagram::new(ethernet2_hdr, ipv4_hdr, udp_hdr, data, checksum_offload);
+        let datagram: UdpDatagram = UdpDatagram::new(ethernet2_hdr, ipv4_hdr, udp_hdr, data, checksum_offload, None);
 
         // Do it.
         datagram.write_header(&mut buf);
         assert_eq!(buf, hdr);
     }
+
+    /// Tests that headers that are patched from a template match the ones that are serialized from scratch.
+    #[test]
+    fn test_udp_datagram_template() {
+        const HEADER_SIZE: usize = ETHERNET2_HEADER_SIZE + IPV4_HEADER_DEFAULT_SIZE + UDP_HEADER_SIZE;
+        let dst_link_addr: MacAddress = MacAddress::new([0xd, 0xe, 0xa, 0xd, 0x0, 0x0]);
+        let src_link_addr: MacAddress = MacAddress::new([0xb, 0xe, 0xe, 0xf, 0x0, 0x0]);
+        let src_addr: Ipv4Addr = Ipv4Addr::new(198, 0, 0, 1);
+        let dst_addr: Ipv4Addr = Ipv4Addr::new(198, 0, 0, 2);
+        let datagram = |data: Buffer, checksum_offload: bool, template: Option<HeaderTemplate>| {
+            UdpDatagram::new(
+                Ethernet2Header::new(dst_link_addr, src_link_addr, EtherType2::Ipv4),
+                Ipv4Header::new(src_addr, dst_addr, IpProtocol::UDP),
+                UdpHeader::new(0x32, 0x45),
+                data,
+                checksum_offload,
+                template,
+            )
+        };
+        let template: HeaderTemplate = HeaderTemplate::new(
+            &datagram(Buffer::Heap(DataBuffer::empty()), false, None),
+            dst_link_addr,
+            0,
+        );
+
+        for len in [0, 1, 7, 8, 1471] {
+            let bytes: Vec<u8> = (0..len).map(|i| (i * 131 + 7) as u8).collect();
+            for checksum_offload in [false, true] {
+                let data: Buffer = Buffer::Heap(DataBuffer::from_slice(&bytes));
+                let mut expected: [u8; HEADER_SIZE] = [0; HEADER_SIZE];
+                datagram(data.clone(), checksum_offload, None).write_header(&mut expected);
+                let mut buf: [u8; HEADER_SIZE] = [0; HEADER_SIZE];
+                datagram(data, checksum_offload, Some(template)).write_header(&mut buf);
+                assert_eq!(buf, expected, "len={} checksum_offload={}", len, checksum_offload);
+            }
+        }
+    }
 }
@@ -26,6 +26,7 @@ use crate::{
                 Ethernet2Header,
             },
             ip::{
+                template::HeaderTemplate,
                 EphemeralPorts,
                 IpProtocol,
             },
@@ -34,7 +35,10 @@ use crate::{
     },
     runtime::{
         fail::Fail,
-        memory::Buffer,
+        memory::{
+            Buffer,
+            DataBuffer,
+        },
         network::{
             types::MacAddress,
             NetworkRuntime,
@@ -57,6 +61,7 @@ use ::rand::{
     SeedableRng,
 };
 use ::std::{
+    cell::RefCell,
     collections::HashMap,
     net::{
         Ipv4Addr,
@@ -94,6 +99,8 @@ pub struct UdpPeer {
     sockets: HashMap<QDesc, Option<SocketAddrV4>>,
     /// Bound sockets.
     bound: HashMap<SocketAddrV4, SharedQueue<SharedQueueSlot<Buffer>>>,
+    /// Header templates of sockets, for the remote endpoint that each of them last pushed to.
+    templates: RefCell<HashMap<QDesc, (SocketAddrV4, HeaderTemplate)>>,
     /// Queue of unset datagrams. This is shared across fast/slow paths.
     send_queue: SharedQueue<SharedQueueSlot<Buffer>>,
     /// Local link address.
@@ -152,6 +159,7 @@ impl UdpPeer {
             ephemeral_ports,
             sockets: HashMap::new(),
             bound: HashMap::new(),
+            templates: RefCell::new(HashMap::new()),
             send_queue,
             local_link_addr,
             local_ipv4_addr,
@@ -185,6 +193,7 @@ impl UdpPeer {
                             &local,
                             &remote,
                             offload_checksum,
+                            None,
                         );
                     },
                     // ARP query failed.
@@ -276,6 +285,7 @@ impl UdpPeer {
             Some(s) => s,
             None => return Err(Fail::new(EBADF, "invalid queue descriptor")),
         };
+        self.templates.borrow_mut().remove(&qd);
 
         // Remove endpoint binding.
         match socket {
@@ -296,16 +306,17 @@ impl UdpPeer {
         };
 
         // Fast path: try to send the datagram immediately.
-        if let Some(link_addr) = self.arp.try_query(remote.ip().clone()) {
+        if let Some(template) = self.header_template(qd, &local, &remote) {
             Self::do_send(
                 self.rt.clone(),
                 self.local_ipv4_addr,
                 self.local_link_addr,
-                link_addr,
+                template.remote_link_addr(),
                 data,
                 &local,
                 &remote,
                 self.checksum_offload,
+                Some(template),
             );
         }
         // Slow path: Defer send operation to the async path.
@@ -366,6 +377,31 @@ impl UdpPeer {
         Ok(())
     }
 
+    /// Returns the header template of a socket for a remote endpoint, which is rebuilt if the socket last pushed to
+    /// another endpoint or the ARP cache changed since it was built. Returns `None` if the link address of the remote
+    /// endpoint is not resolved.
+    fn header_template(&self, qd: QDesc, local: &SocketAddrV4, remote: &SocketAddrV4) -> Option<HeaderTemplate> {
+        let arp_generation: u64 = self.arp.generation();
+        if let Some((template_remote, template)) = self.templates.borrow().get(&qd) {
+            if template_remote == remote && template.arp_generation() == arp_generation {
+                return Some(*template);
+            }
+        }
+
+        let remote_link_addr: MacAddress = self.arp.try_query(remote.ip().clone())?;
+        let datagram: UdpDatagram = UdpDatagram::new(
+            Ethernet2Header::new(remote_link_addr, self.local_link_addr, EtherType2::Ipv4),
+            Ipv4Header::new(self.local_ipv4_addr, remote.ip().clone(), IpProtocol::UDP),
+            UdpHeader::new(local.port(), remote.port()),
+            Buffer::Heap(DataBuffer::empty()),
+            false,
+            None,
+        );
+        let template: HeaderTemplate = HeaderTemplate::new(&datagram, remote_link_addr, arp_generation);
+        self.templates.borrow_mut().insert(qd, (*remote, template));
+        Some(template)
+    }
+
     /// Sends a UDP datagram.
     fn do_send(
         rt: Rc<dyn NetworkRuntime>,
@@ -376,6 +412,7 @@ impl UdpPeer {
         local: &SocketAddrV4,
         remote: &SocketAddrV4,
         offload_checksum: bool,
+        template: Option<HeaderTemplate>,
     ) {
         let udp_header: UdpHeader = UdpHeader::new(local.port(), remote.port());
         debug!("UDP send {:?}", udp_header);
@@ -385,6 +422,7 @@ impl UdpPeer {
             udp_header,
             buf,
             offload_checksum,
+            template,
         );
         rt.transmit(Box::new(datagram));
     }
@@ -18,7 +18,6 @@
 mod collections;
 mod pal;
 
-#[cfg(feature = "profiler")]
 pub mod perftools;
 
 pub mod scheduler;
@@ -50,6 +49,9 @@ mod catcollar;
 #[cfg(feature = "catnap-libos")]
 mod catnap;
 
+#[cfg(feature = "catmem-libos")]
+mod catmem;
+
 pub use crate::demikernel::libos::network::OperationResult;
 
 pub use self::demikernel::libos::{
@@ -48,6 +48,29 @@ pub unsafe fn set_so_reuseport(fd: RawFd) -> i32 {
     )
 }
 
+/// Sets SO_INCOMING_CPU option in a socket. On a listening socket, this makes the kernel prefer the socket among
+/// others that share its port for connections that arrive on `cpu`.
+pub unsafe fn set_so_incoming_cpu(fd: RawFd, cpu: u32) -> i32 {
+    let value: u32 = cpu;
+    let value_ptr: *const u32 = &value as *const u32;
+    let option_len: libc::socklen_t = mem::size_of_val(&value) as libc::socklen_t;
+    libc::setsockopt(
+        fd,
+        libc::SOL_SOCKET,
+        libc::SO_INCOMING_CPU,
+        value_ptr as *const libc::c_void,
+        option_len,
+    )
+}
+
+/// Pins the calling thread to a CPU.
+pub unsafe fn pin_to_cpu(cpu: u32) -> i32 {
+    let mut cpuset: libc::cpu_set_t = mem::zeroed();
+    libc::CPU_ZERO(&mut cpuset);
+    libc::CPU_SET(cpu as usize, &mut cpuset);
+    libc::sched_setaffinity(0, mem::size_of::<libc::cpu_set_t>(), &cpuset)
+}
+
 /// Sets NONBLOCK option in a socket.
 pub unsafe fn set_nonblock(fd: RawFd) -> i32 {
     // Get file flags.
@@ -0,0 +1,188 @@
+// Copyright(c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//======================================================================================================================
+// Constants
+//======================================================================================================================
+
+/// Number of bits of precision of a histogram. Values are recorded with a relative error below 2^-SUB_BUCKET_BITS.
+const SUB_BUCKET_BITS: u32 = 5;
+
+/// Number of buckets in each power-of-two range of values.
+const SUB_BUCKET_COUNT: usize = 1 << SUB_BUCKET_BITS;
+
+/// Number of buckets that are needed to cover all 64-bit values.
+const BUCKET_COUNT: usize = (u64::BITS - SUB_BUCKET_BITS + 1) as usize * SUB_BUCKET_COUNT;
+
+//======================================================================================================================
+// Structures
+//======================================================================================================================
+
+/// Latency Histogram
+///
+/// This is a log-linear histogram, in the style of HDR histograms: each power-of-two range of values is split into
+/// [SUB_BUCKET_COUNT] linear buckets, so that quantiles are reported with a bounded relative error across the full
+/// range of 64-bit values. Buckets are allocated up front, so recording a value never allocates.
+pub struct Histogram {
+    /// Number of values recorded in each bucket.
+    counts: [u64; BUCKET_COUNT],
+    /// Number of values recorded.
+    count: u64,
+    /// Smallest value recorded.
+    min: u64,
+    /// Largest value recorded.
+    max: u64,
+}
+
+//======================================================================================================================
+// Associate Functions
+//======================================================================================================================
+
+/// Associate Functions for Latency Histograms
+impl Histogram {
+    /// Creates an empty histogram.
+    pub fn new() -> Self {
+        Self {
+            counts: [0; BUCKET_COUNT],
+            count: 0,
+            min: u64::MAX,
+            max: 0,
+        }
+    }
+
+    /// Records a value in the target histogram.
+    #[inline]
+    pub fn record(&mut self, value: u64) {
+        self.counts[bucket_of(value)] += 1;
+        self.count += 1;
+        self.min = self.min.min(value);
+        self.max = self.max.max(value);
+    }
+
+    /// Returns the number of values that were recorded in the target histogram.
+    pub fn count(&self) -> u64 {
+        self.count
+    }
+
+    /// Returns the smallest value that was recorded in the target histogram.
+    pub fn min(&self) -> u64 {
+        if self.count == 0 {
+            0
+        } else {
+            self.min
+        }
+    }
+
+    /// Returns the largest value that was recorded in the target histogram.
+    pub fn max(&self) -> u64 {
+        self.max
+    }
+
+    /// Returns the value that `quantile` of the values recorded in the target histogram are lower than or equal to.
+    /// The value is rounded up to the highest value that falls into the same bucket.
+    pub fn value_at_quantile(&self, quantile: f64) -> u64 {
+        if self.count == 0 {
+            return 0;
+        }
+
+        let rank: u64 = ((quantile.clamp(0.0, 1.0) * self.count as f64).ceil() as u64).max(1);
+        let mut seen: u64 = 0;
+        for (i, &n) in self.counts.iter().enumerate() {
+            seen += n;
+            if seen >= rank {
+                return highest_value_of(i).clamp(self.min, self.max);
+            }
+        }
+
+        self.max
+    }
+
+    /// Discards all values that were recorded in the target histogram.
+    pub fn reset(&mut self) {
+        self.counts.fill(0);
+        self.count = 0;
+        self.min = u64::MAX;
+        self.max = 0;
+    }
+}
+
+//======================================================================================================================
+// Standalone Functions
+//======================================================================================================================
+
+/// Returns the index of the bucket that `value` falls into.
+#[inline]
+fn bucket_of(value: u64) -> usize {
+    let msb: u32 = (u64::BITS - 1).saturating_sub(value.leading_zeros());
+    if msb < SUB_BUCKET_BITS {
+        return value as usize;
+    }
+    let shift: u32 = msb - SUB_BUCKET_BITS;
+    (shift as usize + 1) * SUB_BUCKET_COUNT + ((value >> shift) as usize - SUB_BUCKET_COUNT)
+}
+
+/// Returns the highest value that falls into the bucket at `index`.
+fn highest_value_of(index: usize) -> u64 {
+    if index < SUB_BUCKET_COUNT {
+        return index as u64;
+    }
+    let shift: u32 = (index / SUB_BUCKET_COUNT - 1) as u32;
+    let lowest: u64 = ((index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT) as u64) << shift;
+    lowest + ((1 << shift) - 1)
+}
+
+//======================================================================================================================
+// Unit Tests
+//======================================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        bucket_of,
+        highest_value_of,
+        Histogram,
+        BUCKET_COUNT,
+        SUB_BUCKET_BITS,
+    };
+
+    /// Tests that buckets cover all values, in order, with a bounded relative error.
+    #[test]
+    fn test_histogram_buckets() {
+        assert_eq!(bucket_of(0), 0);
+        assert_eq!(bucket_of(u64::MAX), BUCKET_COUNT - 1);
+        assert_eq!(highest_value_of(BUCKET_COUNT - 1), u64::MAX);
+
+        for index in 1..BUCKET_COUNT {
+            // Buckets are contiguous.
+            let lowest: u64 = highest_value_of(index - 1) + 1;
+            let highest: u64 = highest_value_of(index);
+            assert_eq!(bucket_of(lowest), index);
+            assert_eq!(bucket_of(highest), index);
+            assert!(highest - lowest <= lowest >> SUB_BUCKET_BITS);
+        }
+    }
+
+    /// Tests that quantiles are reported within the precision of the histogram.
+    #[test]
+    fn test_histogram_quantiles() {
+        let mut histogram: Histogram = Histogram::new();
+        assert_eq!(histogram.value_at_quantile(0.99), 0);
+
+        for value in 1..=10000 {
+            histogram.record(value);
+        }
+        assert_eq!(histogram.count(), 10000);
+        assert_eq!(histogram.min(), 1);
+        assert_eq!(histogram.max(), 10000);
+        assert_eq!(histogram.value_at_quantile(0.0), 1);
+        assert_eq!(histogram.value_at_quantile(1.0), 10000);
+        for (quantile, expected) in [(0.5, 5000), (0.99, 9900), (0.999, 9990)] {
+            let value: u64 = histogram.value_at_quantile(quantile);
+            assert!(value >= expected && value <= expected + (expected >> SUB_BUCKET_BITS));
+        }
+
+        histogram.reset();
+        assert_eq!(histogram.count(), 0);
+        assert_eq!(histogram.value_at_quantile(0.5), 0);
+    }
+}
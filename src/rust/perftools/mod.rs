@@ -1,4 +1,7 @@
 // Copyright(c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+pub mod histogram;
+
+#[cfg(feature = "profiler")]
 pub mod profiler;
@@ -4,15 +4,30 @@
 #[cfg(test)]
 mod tests;
 
+use crate::{
+    perftools::histogram::Histogram,
+    runtime::fail::Fail,
+};
 use ::std::{
     cell::RefCell,
-    io,
+    io::{
+        self,
+        Write,
+    },
     rc::Rc,
+    sync::atomic::{
+        AtomicUsize,
+        Ordering,
+    },
 };
 
-#[cfg(feature = "auto-calibrate")]
+/// Number of samples that are taken to calibrate the overhead of reading the time stamp counter.
 const SAMPLE_SIZE: usize = 16641;
 
+/// Number of dumps that were requested with [request_dump]. Each thread compares this against the number of dumps it
+/// has served, so requests can be issued from any thread or from a signal handler.
+static DUMP_REQUESTS: AtomicUsize = AtomicUsize::new(0);
+
 thread_local!(
     /// Global thread-local instance of the profiler.
     pub static PROFILER: RefCell<Profiler> = RefCell::new(Profiler::new())
@@ -68,6 +83,70 @@ pub fn reset() {
     PROFILER.with(|p| p.borrow_mut().reset());
 }
 
+/// Takes a snapshot of the profiling information of the calling thread.
+pub fn snapshot() -> Vec<ScopeStats> {
+    PROFILER.with(|p| p.borrow().snapshot())
+}
+
+/// Takes a snapshot of the profiling information of the calling thread and resets it.
+pub fn snapshot_and_reset() -> Vec<ScopeStats> {
+    PROFILER.with(|p| {
+        let mut p = p.borrow_mut();
+        let stats: Vec<ScopeStats> = p.snapshot();
+        p.reset();
+        stats
+    })
+}
+
+/// Requests every thread to dump its profiling information to the standard error output and reset it. Threads serve
+/// the request the next time they leave a root scope. This function is async-signal-safe.
+pub fn request_dump() {
+    DUMP_REQUESTS.fetch_add(1, Ordering::Relaxed);
+}
+
+/// Installs a handler that calls [request_dump] when the process receives `signum`, so that profiling information
+/// can be retrieved from a running process (e.g. with `kill -USR1`).
+pub fn install_dump_handler(signum: libc::c_int) -> Result<(), Fail> {
+    extern "C" fn handle_dump_signal(_: libc::c_int) {
+        request_dump();
+    }
+
+    let mut action: libc::sigaction = unsafe { std::mem::zeroed() };
+    action.sa_sigaction = handle_dump_signal as libc::sighandler_t;
+    action.sa_flags = libc::SA_RESTART;
+    if unsafe { libc::sigaction(signum, &action, std::ptr::null_mut()) } != 0 {
+        return Err(Fail::new(libc::EINVAL, "failed to install signal handler"));
+    }
+    Ok(())
+}
+
+//==============================================================================
+//
+//==============================================================================
+
+/// Profiling information of a scope. Durations are in cycles of the time stamp counter.
+#[derive(Clone, Debug)]
+pub struct ScopeStats {
+    /// Name of the scope.
+    pub name: &'static str,
+    /// Depth of the scope in the tree. Root scopes have depth zero.
+    pub depth: usize,
+    /// Number of times the scope was visited.
+    pub num_calls: usize,
+    /// Total time spent in the scope.
+    pub duration_sum: u64,
+    /// Shortest visit.
+    pub min: u64,
+    /// Median visit.
+    pub p50: u64,
+    /// 99th percentile of visits.
+    pub p99: u64,
+    /// 99.9th percentile of visits.
+    pub p999: u64,
+    /// Longest visit.
+    pub max: u64,
+}
+
 //==============================================================================
 //
 //==============================================================================
@@ -88,6 +167,9 @@ struct Scope {
 
     /// In total, how much time has been spent in this scope?
     duration_sum: u64,
+
+    /// Distribution of the time spent in each visit of this scope.
+    histogram: Box<Histogram>,
 }
 
 impl Scope {
@@ -98,6 +180,7 @@ impl Scope {
             succs: Vec::new(),
             num_calls: 0,
             duration_sum: 0,
+            histogram: Box::new(Histogram::new()),
         }
     }
 
@@ -114,7 +197,26 @@ impl Scope {
         self.num_calls += 1;
 
         // Even though this is extremely unlikely, let's not panic on overflow.
-        self.duration_sum = self.duration_sum + duration;
+        self.duration_sum = self.duration_sum.wrapping_add(duration);
+        self.histogram.record(duration);
+    }
+
+    fn snapshot_recursive(&self, depth: usize, stats: &mut Vec<ScopeStats>) {
+        stats.push(ScopeStats {
+            name: self.name,
+            depth,
+            num_calls: self.num_calls,
+            duration_sum: self.duration_sum,
+            min: self.histogram.min(),
+            p50: self.histogram.value_at_quantile(0.5),
+            p99: self.histogram.value_at_quantile(0.99),
+            p999: self.histogram.value_at_quantile(0.999),
+            max: self.histogram.max(),
+        });
+
+        for succ in &self.succs {
+            succ.borrow().snapshot_recursive(depth + 1, stats);
+        }
     }
 
     fn write_recursive<W: io::Write>(
@@ -145,10 +247,14 @@ impl Scope {
         }
         writeln!(
             out,
-            "{: <60} {: >6.2}%, {: >18.4} cycles",
+            "{: <60} {: >6.2}%, {: >18.4} cycles, p50 {: >10}, p99 {: >10}, p999 {: >10}, max {: >10}",
             format!(" {}  {}", markers, self.name),
             percent,
             duration_sum_secs / (self.num_calls as f64),
+            self.histogram.value_at_quantile(0.5),
+            self.histogram.value_at_quantile(0.99),
+            self.histogram.value_at_quantile(0.999),
+            self.histogram.max(),
         )?;
 
         // Write children
@@ -200,8 +306,10 @@ impl Drop for Guard {
 pub struct Profiler {
     roots: Vec<Rc<RefCell<Scope>>>,
     current: Option<Rc<RefCell<Scope>>>,
-    #[cfg(feature = "auto-calibrate")]
+    /// Overhead of reading the time stamp counter, which is subtracted from all durations.
     clock_drift: u64,
+    /// Number of dump requests that this thread has served.
+    dumps_served: usize,
 }
 
 impl Profiler {
@@ -209,8 +317,8 @@ impl Profiler {
         Profiler {
             roots: Vec::new(),
             current: None,
-            #[cfg(feature = "auto-calibrate")]
             clock_drift: Self::clock_drift(SAMPLE_SIZE),
+            dumps_served: DUMP_REQUESTS.load(Ordering::Relaxed),
         }
     }
 
@@ -279,14 +387,7 @@ impl Profiler {
     #[inline]
     fn leave(&mut self, duration: u64) {
         self.current = if let Some(current) = self.current.as_ref() {
-            cfg_if::cfg_if! {
-                if #[cfg(feature = "auto-calibrate")] {
-                    let d = duration.checked_sub(self.clock_drift);
-                    current.borrow_mut().leave(d.unwrap_or(duration));
-                } else {
-                    current.borrow_mut().leave(duration);
-                }
-            }
+            current.borrow_mut().leave(duration.saturating_sub(self.clock_drift));
 
             // Set current scope back to the parent node (if any).
             current.borrow().pred.as_ref().cloned()
@@ -296,6 +397,35 @@ impl Profiler {
 
             None
         };
+
+        // Serve pending dump requests once we are out of all scopes.
+        if self.current.is_none() {
+            let requests: usize = DUMP_REQUESTS.load(Ordering::Relaxed);
+            if requests != self.dumps_served {
+                self.dumps_served = requests;
+                self.dump();
+            }
+        }
+    }
+
+    fn snapshot(&self) -> Vec<ScopeStats> {
+        let mut stats: Vec<ScopeStats> = Vec::new();
+        for root in self.roots.iter() {
+            root.borrow().snapshot_recursive(0, &mut stats);
+        }
+        stats
+    }
+
+    /// Dumps profiling data to the standard error output and resets it.
+    fn dump(&mut self) {
+        let mut out: io::StderrLock = io::stderr().lock();
+        if let Err(e) = writeln!(out, "profile of thread {:?}:", std::thread::current().id()) {
+            log::error!("failed to dump profile: {:?}", e);
+        }
+        if let Err(e) = self.write(&mut out, None) {
+            log::error!("failed to dump profile: {:?}", e);
+        }
+        self.reset();
     }
 
     fn write<W: io::Write>(&self, out: &mut W, max_depth: Option<usize>) -> io::Result<()> {
@@ -308,15 +438,14 @@ impl Profiler {
         out.flush()
     }
 
-    #[cfg(feature = "auto-calibrate")]
+    /// Measures the overhead of reading the time stamp counter, as it is done by a [`Guard`](struct.Guard.html).
     fn clock_drift(nsamples: usize) -> u64 {
-        let mut total = 0;
+        let mut total: u64 = 0;
 
         for _ in 0..nsamples {
-            let now: u64 = x86::time::rdtscp();
-            let duration: u64 = x86::time::rdtscp() - now;
-
-            let d = total + duration;
+            let (now, _): (u64, u32) = unsafe { x86::time::rdtscp() };
+            let (then, _): (u64, u32) = unsafe { x86::time::rdtscp() };
+            total += then - now;
         }
 
         total / (nsamples as u64)
@@ -97,3 +97,29 @@ fn test_reset_during_frame() {
         assert!(p.current.is_none());
     });
 }
+
+#[test]
+fn test_snapshot_and_reset() {
+    profiler::reset();
+
+    for i in 0..=5 {
+        timer!("a");
+        if i > 2 {
+            timer!("b");
+        }
+    }
+
+    let stats: Vec<profiler::ScopeStats> = profiler::snapshot();
+    assert_eq!(stats.len(), 2);
+    assert_eq!((stats[0].name, stats[0].depth, stats[0].num_calls), ("a", 0, 6));
+    assert_eq!((stats[1].name, stats[1].depth, stats[1].num_calls), ("b", 1, 3));
+    for scope in stats.iter() {
+        assert!(scope.min <= scope.p50 && scope.p50 <= scope.p99);
+        assert!(scope.p99 <= scope.p999 && scope.p999 <= scope.max);
+    }
+
+    // Snapshots are not destructive, unless asked for.
+    assert_eq!(profiler::snapshot().len(), 2);
+    assert_eq!(profiler::snapshot_and_reset().len(), 2);
+    assert!(profiler::snapshot().is_empty());
+}
@@ -5,7 +5,10 @@
 // Imports
 //==============================================================================
 
-use crate::runtime::fail::Fail;
+use crate::runtime::{
+    fail::Fail,
+    memory::region::SlotRef,
+};
 use std::{
     fmt::Debug,
     ops::{
@@ -20,11 +23,20 @@ use std::{
 // Structures
 //==============================================================================
 
+/// Underlying Storage of a Data Buffer
+#[derive(Clone, Debug)]
+enum Storage {
+    /// Memory of the heap allocator.
+    Heap(Arc<[u8]>),
+    /// Slot of a region that does not come from the heap allocator, which keeps its own reference counts.
+    Slot(SlotRef),
+}
+
 /// Data Buffer
 #[derive(Clone, Debug)]
 pub struct DataBuffer {
     /// Underlying data.
-    data: Option<Arc<[u8]>>,
+    data: Option<Storage>,
 
     /// Data offset.
     offset: usize,
@@ -65,13 +77,24 @@ impl DataBuffer {
 
         // Create buffer.
         Ok(Self {
-            data: unsafe { Some(Arc::new_zeroed_slice(capacity).assume_init()) },
+            data: unsafe { Some(Storage::Heap(Arc::new_zeroed_slice(capacity).assume_init())) },
             offset: 0,
             len: capacity,
         })
     }
 
-    /// Creates a data buffer from a raw pointer and a length.
+    /// Creates a data buffer that spans the whole of a slot.
+    pub fn from_slot(slot: SlotRef) -> Self {
+        let len: usize = slot.as_slice().len();
+        Self {
+            data: Some(Storage::Slot(slot)),
+            offset: 0,
+            len,
+        }
+    }
+
+    /// Creates a data buffer from a raw pointer and a length. These must come from [DataBuffer::into_raw_parts] on a
+    /// heap-managed data buffer, while buffers of slots are released through their region instead.
     pub fn from_raw_parts(data: *mut u8, len: usize) -> Result<Self, Fail> {
         // Check if arguments are valid.
         if len == 0 {
@@ -88,7 +111,7 @@ impl DataBuffer {
         };
 
         Ok(Self {
-            data: Some(data),
+            data: Some(Storage::Heap(data)),
             offset: 0,
             len,
         })
@@ -98,7 +121,10 @@ impl DataBuffer {
     pub fn into_raw_parts(dbuf: DataBuffer) -> Result<(*const u8, *const u8), Fail> {
         if let Some(data) = dbuf.data {
             let offset: usize = dbuf.offset;
-            let dbuf_ptr: *const u8 = Arc::<[u8]>::into_raw(data).as_ptr();
+            let dbuf_ptr: *const u8 = match data {
+                Storage::Heap(data) => Arc::<[u8]>::into_raw(data).as_ptr(),
+                Storage::Slot(slot) => slot.into_raw(),
+            };
             let data_ptr: *const u8 = unsafe { dbuf_ptr.add(offset) };
             return Ok((dbuf_ptr, data_ptr));
         }
@@ -132,7 +158,8 @@ impl Deref for DataBuffer {
     fn deref(&self) -> &[u8] {
         match self.data {
             None => &[],
-            Some(ref buf) => &buf[self.offset..(self.offset + self.len)],
+            Some(Storage::Heap(ref buf)) => &buf[self.offset..(self.offset + self.len)],
+            Some(Storage::Slot(ref slot)) => &slot.as_slice()[self.offset..(self.offset + self.len)],
         }
     }
 }
@@ -143,7 +170,11 @@ impl DerefMut for DataBuffer {
         match self.data {
             None => &mut [],
             Some(ref mut data) => {
-                let slice: &mut [u8] = Arc::get_mut(data).expect("cannot write to a shared buffer");
+                let slice: &mut [u8] = match data {
+                    Storage::Heap(buf) => Arc::get_mut(buf),
+                    Storage::Slot(slot) => slot.as_mut_slice(),
+                }
+                .expect("cannot write to a shared buffer");
                 &mut slice[self.offset..(self.offset + self.len)]
             },
         }
@@ -155,7 +186,7 @@ impl From<&[u8]> for DataBuffer {
     fn from(src: &[u8]) -> Self {
         let buf: Arc<[u8]> = src.into();
         Self {
-            data: Some(buf),
+            data: Some(Storage::Heap(buf)),
             offset: 0,
             len: src.len(),
         }
@@ -12,9 +12,10 @@ use ::dpdk_rs::{
     rte_pktmbuf_adj,
     rte_pktmbuf_clone,
     rte_pktmbuf_free,
-    rte_pktmbuf_trim,
+    PKT_RX_RSS_HASH,
 };
 use ::std::{
+    marker::PhantomData,
     mem,
     ops::{
         Deref,
@@ -29,32 +30,81 @@ use ::std::{
 //==============================================================================
 
 /// DPDK-Managed Buffer
+///
+/// The underlying DPDK buffer may be the head of a chain of mbufs, in which case the target buffer spans all of them.
+/// Chained buffers are not contiguous, so their contents are read through [DPDKBuffer::segments], and dereferencing
+/// them panics.
 #[derive(Debug)]
 pub struct DPDKBuffer {
     /// Underlying DPDK buffer.
     ptr: *mut rte_mbuf,
 }
 
+/// Iterator over the Segments of a DPDK-Managed Buffer
+#[derive(Clone)]
+pub struct MbufSegments<'a> {
+    /// Next mbuf of the chain.
+    next: *const rte_mbuf,
+    /// Segments borrow from the buffer that they belong to.
+    _marker: PhantomData<&'a DPDKBuffer>,
+}
+
 //==============================================================================
 // Associate Functions
 //==============================================================================
 
 /// Associate Functions for DPDK-Managed Buffers
 impl DPDKBuffer {
-    /// Removes `len` bytes at the beginning of the target [Mbuf].
+    /// Removes `len` bytes at the beginning of the target [Mbuf]. Leading mbufs of a chain that are removed as a whole
+    /// are released.
     pub fn adjust(&mut self, nbytes: usize) {
         assert!(nbytes <= self.len(), "nbytes={:?} self.len()={:?}", nbytes, self.len());
-        if unsafe { rte_pktmbuf_adj(self.ptr, nbytes as u16) } == ptr::null_mut() {
-            panic!("rte_pktmbuf_adj failed");
+        let mut nbytes: usize = nbytes;
+        unsafe {
+            while nbytes > 0 && nbytes >= (*self.ptr).data_len as usize && !(*self.ptr).next.is_null() {
+                // Unlink the head mbuf, and make the next one the head of the chain.
+                let head: *mut rte_mbuf = self.ptr;
+                let next: *mut rte_mbuf = (*head).next;
+                let head_len: u16 = (*head).data_len;
+                (*next).nb_segs = (*head).nb_segs - 1;
+                (*next).pkt_len = (*head).pkt_len - head_len as u32;
+                (*head).next = ptr::null_mut();
+                (*head).nb_segs = 1;
+                (*head).pkt_len = head_len as u32;
+                free_mbuf(head);
+                self.ptr = next;
+                nbytes -= head_len as usize;
+            }
+            if rte_pktmbuf_adj(self.ptr, nbytes as u16) == ptr::null_mut() {
+                panic!("rte_pktmbuf_adj failed");
+            }
         }
     }
 
-    /// Removes `len` bytes at the end of the target [Mbuf].
+    /// Removes `len` bytes at the end of the target [Mbuf]. Trailing mbufs of a chain that are removed as a whole are
+    /// released.
     pub fn trim(&mut self, nbytes: usize) {
         assert!(nbytes <= self.len(), "nbytes={:?} self.len()={:?}", nbytes, self.len());
-        assert!(nbytes <= self.len());
-        if unsafe { rte_pktmbuf_trim(self.ptr, nbytes as u16) } != 0 {
-            panic!("rte_pktmbuf_trim failed");
+        let len: usize = self.len() - nbytes;
+        unsafe {
+            // Find the mbuf that the data ends in.
+            let mut last: *mut rte_mbuf = self.ptr;
+            let mut offset: usize = 0;
+            let mut nb_segs: u16 = 1;
+            while offset + ((*last).data_len as usize) < len {
+                offset += (*last).data_len as usize;
+                last = (*last).next;
+                nb_segs += 1;
+            }
+
+            // Release the mbufs that follow it.
+            if !(*last).next.is_null() {
+                free_mbuf((*last).next);
+                (*last).next = ptr::null_mut();
+            }
+            (*last).data_len = (len - offset) as u16;
+            (*self.ptr).pkt_len = len as u32;
+            (*self.ptr).nb_segs = nb_segs;
         }
     }
 
@@ -71,14 +121,32 @@ impl DPDKBuffer {
         }
     }
 
-    /// Returns the length of the data stored in the target [Mbuf].
+    /// Returns the length of the data stored in the target [Mbuf], across all mbufs of its chain.
     pub fn len(&self) -> usize {
+        unsafe { (*self.ptr).pkt_len as usize }
+    }
+
+    /// Returns the length of the data stored in the first mbuf of the target [Mbuf].
+    fn head_len(&self) -> usize {
         unsafe { (*self.ptr).data_len as usize }
     }
 
-    /// Converts the target [Mbuf] into a mutable [u8] slice.
+    /// Checks if the target [Mbuf] is a single mbuf, and thus its data is contiguous.
+    pub fn is_contiguous(&self) -> bool {
+        unsafe { (*self.ptr).next.is_null() }
+    }
+
+    /// Returns an iterator over the data stored in each mbuf of the target [Mbuf].
+    pub fn segments(&self) -> MbufSegments<'_> {
+        MbufSegments {
+            next: self.ptr,
+            _marker: PhantomData,
+        }
+    }
+
+    /// Converts the first mbuf of the target [Mbuf] into a mutable [u8] slice.
     pub unsafe fn slice_mut(&mut self) -> &mut [u8] {
-        slice::from_raw_parts_mut(self.data_ptr(), self.len())
+        slice::from_raw_parts_mut(self.data_ptr(), self.head_len())
     }
 
     /// Converts the target [Mbuf] into a raw DPDK buffer.
@@ -90,6 +158,17 @@ impl DPDKBuffer {
     pub fn get_ptr(&self) -> *mut rte_mbuf {
         self.ptr
     }
+
+    /// Returns the RSS hash that the NIC computed for the target [Mbuf], if any.
+    pub fn rss_hash(&self) -> Option<u32> {
+        unsafe {
+            if (*self.ptr).ol_flags & PKT_RX_RSS_HASH as u64 == 0 {
+                return None;
+            }
+            // The hash union is the second anonymous union of an mbuf, after the one of the packet type.
+            Some((*self.ptr).__bindgen_anon_2.hash.rss)
+        }
+    }
 }
 
 //==============================================================================
@@ -101,14 +180,33 @@ impl Deref for DPDKBuffer {
     type Target = [u8];
 
     fn deref(&self) -> &[u8] {
-        unsafe { slice::from_raw_parts(self.data_ptr(), self.len()) }
+        assert!(self.is_contiguous(), "chained mbufs should be read through segments()");
+        unsafe { slice::from_raw_parts(self.data_ptr(), self.head_len()) }
     }
 }
 
 /// Mutable De-Reference Trait Implementation for DPDK-Managed Buffers
 impl DerefMut for DPDKBuffer {
     fn deref_mut(&mut self) -> &mut [u8] {
-        unsafe { slice::from_raw_parts_mut(self.data_ptr(), self.len()) }
+        assert!(self.is_contiguous(), "chained mbufs should be read through segments()");
+        unsafe { slice::from_raw_parts_mut(self.data_ptr(), self.head_len()) }
+    }
+}
+
+/// Iterator Trait Implementation for Segments of DPDK-Managed Buffers
+impl<'a> Iterator for MbufSegments<'a> {
+    type Item = &'a [u8];
+
+    fn next(&mut self) -> Option<&'a [u8]> {
+        if self.next.is_null() {
+            return None;
+        }
+        unsafe {
+            let mbuf_ptr: *const rte_mbuf = self.next;
+            self.next = (*mbuf_ptr).next;
+            let data_ptr: *const u8 = ((*mbuf_ptr).buf_addr as *const u8).offset((*mbuf_ptr).data_off as isize);
+            Some(slice::from_raw_parts(data_ptr, (*mbuf_ptr).data_len as usize))
+        }
     }
 }
 
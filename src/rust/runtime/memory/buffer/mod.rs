@@ -21,7 +21,10 @@ use ::std::fmt::Debug;
 
 pub use self::databuffer::DataBuffer;
 #[cfg(feature = "libdpdk")]
-pub use self::dpdkbuffer::DPDKBuffer;
+pub use self::dpdkbuffer::{
+    DPDKBuffer,
+    MbufSegments,
+};
 
 //==============================================================================
 // Enumerations
@@ -34,11 +37,43 @@ pub enum Buffer {
     DPDK(DPDKBuffer),
 }
 
+/// Iterator over the Contiguous Segments of a Buffer
+#[derive(Clone)]
+pub enum Segments<'a> {
+    Heap(Option<&'a [u8]>),
+    #[cfg(feature = "libdpdk")]
+    DPDK(MbufSegments<'a>),
+}
+
 //==============================================================================
 // Associated Functions
 //==============================================================================
 
 impl Buffer {
+    /// Returns the number of bytes in the target data buffer, across all of its segments.
+    pub fn len(&self) -> usize {
+        match self {
+            Buffer::Heap(dbuf) => dbuf.len(),
+            #[cfg(feature = "libdpdk")]
+            Buffer::DPDK(mbuf) => mbuf.len(),
+        }
+    }
+
+    /// Checks if the target data buffer is empty.
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Returns an iterator over the contiguous segments of the target data buffer. Only DPDK-managed buffers may have
+    /// more than one segment, and they can't be de-referenced as a whole if they do.
+    pub fn segments(&self) -> Segments<'_> {
+        match self {
+            Buffer::Heap(dbuf) => Segments::Heap(Some(&dbuf[..])),
+            #[cfg(feature = "libdpdk")]
+            Buffer::DPDK(mbuf) => Segments::DPDK(mbuf.segments()),
+        }
+    }
+
     /// Removes bytes from the front of the target data buffer.
     pub fn adjust(&mut self, nbytes: usize) {
         match self {
@@ -56,6 +91,15 @@ impl Buffer {
             Buffer::DPDK(mbuf) => mbuf.trim(nbytes),
         }
     }
+
+    /// Returns the RSS hash that the NIC computed for the target buffer, if any.
+    pub fn rss_hash(&self) -> Option<u32> {
+        match self {
+            Buffer::Heap(_) => None,
+            #[cfg(feature = "libdpdk")]
+            Buffer::DPDK(mbuf) => mbuf.rss_hash(),
+        }
+    }
 }
 
 //==============================================================================
@@ -85,3 +129,16 @@ impl DerefMut for Buffer {
         }
     }
 }
+
+/// Iterator Trait Implementation for Segments of Data Buffers
+impl<'a> Iterator for Segments<'a> {
+    type Item = &'a [u8];
+
+    fn next(&mut self) -> Option<&'a [u8]> {
+        match self {
+            Segments::Heap(bytes) => bytes.take(),
+            #[cfg(feature = "libdpdk")]
+            Segments::DPDK(segments) => segments.next(),
+        }
+    }
+}
@@ -2,6 +2,8 @@
 // Licensed under the MIT license.
 
 mod buffer;
+mod region;
+mod slab;
 
 //==============================================================================
 // Imports
@@ -9,14 +11,31 @@ mod buffer;
 
 use crate::runtime::{
     fail::Fail,
-    types::demi_sgarray_t,
+    types::{
+        demi_sgarray_t,
+        demi_sgaseg_t,
+        DEMI_SGARRAY_MAXLEN,
+    },
 };
+use ::std::slice;
 
 //==============================================================================
 // Exports
 //==============================================================================
 
-pub use self::buffer::*;
+pub use self::{
+    buffer::*,
+    region::{
+        FreeList,
+        Mapping,
+        SlotRegion,
+    },
+    slab::{
+        SlabAllocator,
+        SlabConfig,
+        SlabStats,
+    },
+};
 
 //==============================================================================
 // Traits
@@ -36,3 +55,85 @@ pub trait MemoryRuntime {
     /// Clones a [demi_sgarray_t] into a [Buffer].
     fn clone_sgarray(&self, sga: &demi_sgarray_t) -> Result<Buffer, Fail>;
 }
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Returns the segments of a [demi_sgarray_t], after checking that their number is valid.
+pub fn sgarray_segments(sga: &demi_sgarray_t) -> Result<&[demi_sgaseg_t], Fail> {
+    let numsegs: usize = sga.sga_numsegs as usize;
+    if numsegs == 0 || numsegs > DEMI_SGARRAY_MAXLEN {
+        return Err(Fail::new(libc::EINVAL, "scatter-gather array with invalid size"));
+    }
+    Ok(&sga.sga_segs[..numsegs])
+}
+
+/// Returns the total number of bytes in a list of scatter-gather segments.
+pub fn sgarray_len(segs: &[demi_sgaseg_t]) -> usize {
+    segs.iter().map(|seg| seg.sgaseg_len as usize).sum()
+}
+
+/// Copies the contents of a list of scatter-gather segments into `dst`, in order. The target slice should be at
+/// least [sgarray_len] bytes long.
+pub fn gather_sgarray(segs: &[demi_sgaseg_t], dst: &mut [u8]) {
+    let mut offset: usize = 0;
+    for seg in segs {
+        let len: usize = seg.sgaseg_len as usize;
+        let src: &[u8] = unsafe { slice::from_raw_parts(seg.sgaseg_buf as *const u8, len) };
+        dst[offset..(offset + len)].copy_from_slice(src);
+        offset += len;
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        gather_sgarray,
+        sgarray_len,
+        sgarray_segments,
+    };
+    use crate::runtime::types::{
+        demi_sgarray_t,
+        demi_sgaseg_t,
+        DEMI_SGARRAY_MAXLEN,
+    };
+    use ::libc::c_void;
+    use ::std::mem;
+
+    #[test]
+    fn gather_multiple_segments() {
+        let mut header: [u8; 4] = [1, 2, 3, 4];
+        let mut payload: [u8; 3] = [5, 6, 7];
+        let mut sga: demi_sgarray_t = unsafe { mem::zeroed() };
+        sga.sga_numsegs = 2;
+        sga.sga_segs[0] = demi_sgaseg_t {
+            sgaseg_buf: header.as_mut_ptr() as *mut c_void,
+            sgaseg_len: header.len() as u32,
+        };
+        sga.sga_segs[1] = demi_sgaseg_t {
+            sgaseg_buf: payload.as_mut_ptr() as *mut c_void,
+            sgaseg_len: payload.len() as u32,
+        };
+
+        let segs: &[demi_sgaseg_t] = sgarray_segments(&sga).unwrap();
+        assert_eq!(segs.len(), 2);
+        assert_eq!(sgarray_len(segs), 7);
+
+        let mut out: [u8; 7] = [0; 7];
+        gather_sgarray(segs, &mut out);
+        assert_eq!(out, [1, 2, 3, 4, 5, 6, 7]);
+    }
+
+    #[test]
+    fn reject_invalid_number_of_segments() {
+        let mut sga: demi_sgarray_t = unsafe { mem::zeroed() };
+        assert!(sgarray_segments(&sga).is_err());
+        sga.sga_numsegs = (DEMI_SGARRAY_MAXLEN + 1) as u32;
+        assert!(sgarray_segments(&sga).is_err());
+    }
+}
@@ -0,0 +1,521 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use super::DataBuffer;
+use crate::runtime::fail::Fail;
+use ::nix::errno;
+use ::std::{
+    fmt,
+    mem::{
+        self,
+        ManuallyDrop,
+    },
+    ptr,
+    slice,
+    sync::{
+        atomic::{
+            self,
+            AtomicUsize,
+            Ordering,
+        },
+        Arc,
+    },
+};
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Anonymous Memory Mapping
+///
+/// Private anonymous memory that is unmapped once the mapping is dropped.
+pub struct Mapping {
+    /// Base address of the mapping.
+    addr: *mut u8,
+    /// Length of the mapping.
+    len: usize,
+}
+
+/// Free List of Slots
+///
+/// Lock-free stack of slots whose last reference went away. Since these slots are free, each of them holds the address
+/// of the next one in its first bytes. Any thread may push slots, but they are only taken out all at once, by the owner
+/// of the slots, so that a slot is never pushed back while the stack is walked.
+pub struct FreeList {
+    /// Address of the slot on top of the stack, or zero if the stack is empty.
+    head: AtomicUsize,
+}
+
+/// Slots of a region, which are shared by the region and by every buffer that is handed out from it. Thus, the
+/// underlying memory stays mapped until both the region and the last of these buffers are dropped.
+struct SlotTable {
+    /// Memory that backs the slots.
+    memory: Mapping,
+    /// Number of slots.
+    nslots: usize,
+    /// Distance between the start of two consecutive slots.
+    slot_size: usize,
+    /// Offset of the data in each slot.
+    data_offset: usize,
+    /// Number of references to each slot. A slot is free when nothing references it.
+    refcounts: Box<[AtomicUsize]>,
+    /// Slots whose last reference went away, and that were not taken back yet. This may be shared by several regions.
+    returned: Arc<FreeList>,
+}
+
+/// Region of Buffer Slots
+///
+/// Carves a region of memory that does not come from the heap allocator (e.g. a UMEM or a huge-page mapping) into
+/// equally-sized slots, whose data is handed out as [DataBuffer]s. The reference counts of slots are kept aside from
+/// their data, and a slot is returned to the region once the last reference to it goes away.
+pub struct SlotRegion {
+    table: Arc<SlotTable>,
+}
+
+/// Reference to a Slot
+///
+/// Storage of a [DataBuffer] that is handed out from a [SlotRegion].
+pub struct SlotRef {
+    /// Slots of the region.
+    table: Arc<SlotTable>,
+    /// Index of the referenced slot.
+    index: usize,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Memory Mappings
+impl Mapping {
+    /// Maps `len` bytes of private anonymous memory, with additional `flags`.
+    pub fn new(len: usize, flags: libc::c_int) -> Result<Self, Fail> {
+        let addr: *mut libc::c_void = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_PRIVATE | libc::MAP_ANONYMOUS | flags,
+                -1,
+                0,
+            )
+        };
+        if addr == libc::MAP_FAILED {
+            return Err(Fail::new(errno::errno(), "failed to map memory"));
+        }
+
+        Ok(Self {
+            addr: addr as *mut u8,
+            len,
+        })
+    }
+
+    /// Returns the base address of the target mapping.
+    pub fn as_ptr(&self) -> *mut u8 {
+        self.addr
+    }
+
+    /// Returns the length of the target mapping.
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Maps `len` bytes of private anonymous memory, with additional `flags`, at an address that is a multiple of
+    /// `align`, which must be a power of two and a multiple of the page size.
+    pub fn new_aligned(len: usize, align: usize, flags: libc::c_int) -> Result<Self, Fail> {
+        assert!(align.is_power_of_two(), "alignment is not a power of two");
+
+        // Map enough memory to fit an aligned range, and then unmap what lies around it.
+        let mapping: ManuallyDrop<Self> = ManuallyDrop::new(Self::new(len + align, flags)?);
+        let addr: usize = mapping.addr as usize;
+        let start: usize = (addr + align - 1) & !(align - 1);
+        let (head, tail): (usize, usize) = (start - addr, align - (start - addr));
+        unsafe {
+            if head > 0 {
+                libc::munmap(addr as *mut libc::c_void, head);
+            }
+            if tail > 0 {
+                libc::munmap((start + len) as *mut libc::c_void, tail);
+            }
+        }
+
+        Ok(Self {
+            addr: start as *mut u8,
+            len,
+        })
+    }
+}
+
+/// Associate Functions for Free Lists
+impl FreeList {
+    /// Creates an empty free list.
+    pub fn new() -> Self {
+        Self {
+            head: AtomicUsize::new(0),
+        }
+    }
+
+    /// Pushes the slot that starts at `slot` on the target free list. The slot must be free, and at least as large as
+    /// an address.
+    fn push(&self, slot: *mut u8) {
+        let mut head: usize = self.head.load(Ordering::Relaxed);
+        loop {
+            unsafe { ptr::write_unaligned(slot as *mut usize, head) };
+            match self
+                .head
+                .compare_exchange_weak(head, slot as usize, Ordering::Release, Ordering::Relaxed)
+            {
+                Ok(_) => return,
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    /// Takes all slots out of the target free list, and passes the address of each of them to `f`. Only the owner of
+    /// the slots may call this.
+    pub fn drain<F: FnMut(*mut u8)>(&self, mut f: F) {
+        let mut slot: usize = self.head.swap(0, Ordering::Acquire);
+        while slot != 0 {
+            // Read the link before handing out the slot, which may then be overwritten.
+            let next: usize = unsafe { ptr::read_unaligned(slot as *const usize) };
+            f(slot as *mut u8);
+            slot = next;
+        }
+    }
+}
+
+/// Associate Functions for Slot Tables
+impl SlotTable {
+    /// Returns the address of the data of a slot.
+    fn data_ptr(&self, index: usize) -> *mut u8 {
+        assert!(index < self.nslots, "slot out of bounds");
+        unsafe { self.memory.as_ptr().add(index * self.slot_size + self.data_offset) }
+    }
+
+    /// Drops a reference to a slot, which is returned to the region if this was the last one. Fails if the slot is
+    /// not referenced.
+    fn put(&self, index: usize) -> Result<bool, Fail> {
+        match self.refcounts[index].fetch_update(Ordering::Release, Ordering::Relaxed, |n| n.checked_sub(1)) {
+            Ok(1) => {
+                // Synchronize with writes made through other references, before the slot is handed out again.
+                atomic::fence(Ordering::Acquire);
+                self.returned
+                    .push(unsafe { self.memory.as_ptr().add(index * self.slot_size) });
+                Ok(true)
+            },
+            Ok(_) => Ok(false),
+            Err(_) => Err(Fail::new(libc::EINVAL, "releasing slot that is not handed out")),
+        }
+    }
+}
+
+/// Associate Functions for Slot Regions
+impl SlotRegion {
+    /// Carves `nslots` slots of `slot_size` bytes out of `memory`, whose data starts `data_offset` bytes into each
+    /// slot. All slots are free.
+    pub fn new(memory: Mapping, nslots: usize, slot_size: usize, data_offset: usize) -> Self {
+        Self::with_free_list(memory, nslots, slot_size, data_offset, Arc::new(FreeList::new()))
+    }
+
+    /// Same as [SlotRegion::new], but slots whose last reference goes away are pushed on `returned`, which may be
+    /// shared with other regions. These slots are then taken back through [FreeList::drain], rather than through
+    /// [SlotRegion::reclaim].
+    pub fn with_free_list(
+        memory: Mapping,
+        nslots: usize,
+        slot_size: usize,
+        data_offset: usize,
+        returned: Arc<FreeList>,
+    ) -> Self {
+        assert!(data_offset < slot_size, "invalid data offset");
+        assert!(
+            slot_size >= mem::size_of::<usize>(),
+            "slots cannot hold a free list link"
+        );
+        assert!(nslots * slot_size <= memory.len(), "slots do not fit in memory");
+
+        Self {
+            table: Arc::new(SlotTable {
+                memory,
+                nslots,
+                slot_size,
+                data_offset,
+                refcounts: (0..nslots).map(|_| AtomicUsize::new(0)).collect(),
+                returned,
+            }),
+        }
+    }
+
+    /// Returns the base address of the target region.
+    pub fn as_ptr(&self) -> *mut u8 {
+        self.table.memory.as_ptr()
+    }
+
+    /// Returns the number of slots in the target region.
+    pub fn nslots(&self) -> usize {
+        self.table.nslots
+    }
+
+    /// Returns the number of data bytes in each slot of the target region.
+    pub fn data_len(&self) -> usize {
+        self.table.slot_size - self.table.data_offset
+    }
+
+    /// Returns the address of the data of a slot in the target region.
+    pub fn data_ptr(&self, index: usize) -> *mut u8 {
+        self.table.data_ptr(index)
+    }
+
+    /// Returns the index of the slot that contains a given address, if any. The address may point anywhere in the
+    /// slot, including before its data.
+    pub fn lookup(&self, addr: *const u8) -> Option<usize> {
+        let offset: usize = (addr as usize).checked_sub(self.as_ptr() as usize)?;
+        let index: usize = offset / self.table.slot_size;
+        if index < self.table.nslots {
+            Some(index)
+        } else {
+            None
+        }
+    }
+
+    /// Takes an additional reference to a slot in the target region, and returns its data as a data buffer.
+    pub fn share(&self, index: usize) -> DataBuffer {
+        assert!(index < self.table.nslots, "slot out of bounds");
+        self.table.refcounts[index].fetch_add(1, Ordering::Relaxed);
+        DataBuffer::from_slot(SlotRef {
+            table: self.table.clone(),
+            index,
+        })
+    }
+
+    /// Drops a reference to a slot in the target region, that was leaked from a data buffer (e.g. by a scatter-gather
+    /// array). Returns `true` if the slot was returned to the region, and fails if the slot is not handed out.
+    pub fn release(&self, index: usize) -> Result<bool, Fail> {
+        if index >= self.table.nslots {
+            return Err(Fail::new(libc::EINVAL, "slot out of bounds"));
+        }
+        self.table.put(index)
+    }
+
+    /// Checks if a slot in the target region is handed out.
+    pub fn is_shared(&self, index: usize) -> bool {
+        self.table.refcounts[index].load(Ordering::Acquire) > 0
+    }
+
+    /// Takes back the slots that were returned to the target region since the last call, and passes each of them to
+    /// `f`.
+    pub fn reclaim<F: FnMut(usize)>(&self, mut f: F) {
+        let slot_size: usize = self.table.slot_size;
+        let base: usize = self.as_ptr() as usize;
+        self.table.returned.drain(|slot| f((slot as usize - base) / slot_size));
+    }
+}
+
+/// Associate Functions for Slot References
+impl SlotRef {
+    /// Returns the data of the referenced slot.
+    pub fn as_slice(&self) -> &[u8] {
+        let data_len: usize = self.table.slot_size - self.table.data_offset;
+        unsafe { slice::from_raw_parts(self.table.data_ptr(self.index), data_len) }
+    }
+
+    /// Returns the data of the referenced slot for modification, if this is the only reference to it.
+    pub fn as_mut_slice(&mut self) -> Option<&mut [u8]> {
+        if self.table.refcounts[self.index].load(Ordering::Acquire) != 1 {
+            return None;
+        }
+        let data_len: usize = self.table.slot_size - self.table.data_offset;
+        Some(unsafe { slice::from_raw_parts_mut(self.table.data_ptr(self.index), data_len) })
+    }
+
+    /// Consumes the target reference without dropping it, and returns the address of the data of the slot. The
+    /// reference is then dropped through [SlotRegion::release].
+    pub fn into_raw(self) -> *const u8 {
+        let this: ManuallyDrop<Self> = ManuallyDrop::new(self);
+        let data_ptr: *const u8 = this.table.data_ptr(this.index);
+        // Drop the handle to the table, but not the reference to the slot.
+        drop(unsafe { ptr::read(&this.table) });
+        data_ptr
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Send Trait Implementation for Memory Mappings
+unsafe impl Send for Mapping {}
+
+/// Sync Trait Implementation for Memory Mappings
+unsafe impl Sync for Mapping {}
+
+/// Default Trait Implementation for Free Lists
+impl Default for FreeList {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Drop Trait Implementation for Memory Mappings
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        unsafe { libc::munmap(self.addr as *mut libc::c_void, self.len) };
+    }
+}
+
+/// Clone Trait Implementation for Slot References
+impl Clone for SlotRef {
+    fn clone(&self) -> Self {
+        self.table.refcounts[self.index].fetch_add(1, Ordering::Relaxed);
+        Self {
+            table: self.table.clone(),
+            index: self.index,
+        }
+    }
+}
+
+/// Drop Trait Implementation for Slot References
+impl Drop for SlotRef {
+    fn drop(&mut self) {
+        // This only fails if the slot was released more times than it was leaked.
+        if let Err(e) = self.table.put(self.index) {
+            warn!("dropping reference to slot {:?}: {:?}", self.index, e);
+        }
+    }
+}
+
+/// Debug Trait Implementation for Slot References
+impl fmt::Debug for SlotRef {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("SlotRef").field("index", &self.index).finish()
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        Mapping,
+        SlotRegion,
+    };
+    use crate::runtime::memory::DataBuffer;
+    use ::std::thread;
+
+    /// Creates a region of `nslots` slots of 64 bytes, whose data starts 16 bytes into each slot.
+    fn region(nslots: usize) -> SlotRegion {
+        SlotRegion::new(Mapping::new(nslots * 64, 0).unwrap(), nslots, 64, 16)
+    }
+
+    /// Returns the slots that were returned to a region.
+    fn reclaimed(region: &SlotRegion) -> Vec<usize> {
+        let mut slots: Vec<usize> = Vec::new();
+        region.reclaim(|slot| slots.push(slot));
+        slots
+    }
+
+    /// Tests that aligned mappings start at a multiple of their alignment.
+    #[test]
+    fn test_mapping_aligned() {
+        for align in [4096, 65536, 2 * 1024 * 1024] {
+            let mapping: Mapping = Mapping::new_aligned(align, align, 0).unwrap();
+            assert_eq!(mapping.as_ptr() as usize % align, 0);
+            assert_eq!(mapping.len(), align);
+        }
+    }
+
+    /// Tests that slots are returned without losing any, when their last references are dropped by several threads.
+    #[test]
+    fn test_slot_region_concurrent_return() {
+        let region: SlotRegion = region(64);
+        let mut bufs: Vec<DataBuffer> = (0..64).map(|index| region.share(index)).collect();
+        thread::scope(|scope| {
+            while !bufs.is_empty() {
+                let batch: Vec<DataBuffer> = bufs.split_off(bufs.len() - 16);
+                scope.spawn(move || drop(batch));
+            }
+        });
+        let mut slots: Vec<usize> = reclaimed(&region);
+        slots.sort();
+        assert_eq!(slots, (0..64).collect::<Vec<usize>>());
+        assert!(reclaimed(&region).is_empty());
+    }
+
+    /// Tests that a slot is handed out for as long as any data buffer references it.
+    #[test]
+    fn test_slot_region_share() {
+        let region: SlotRegion = region(4);
+        assert_eq!(region.data_len(), 48);
+        assert!(!region.is_shared(1));
+
+        let a: DataBuffer = region.share(1);
+        assert_eq!(a.as_ptr(), region.data_ptr(1) as *const u8);
+        assert_eq!(a.len(), 48);
+        assert!(region.is_shared(1));
+        assert!(!region.is_shared(0) && !region.is_shared(2));
+
+        let b: DataBuffer = a.clone();
+        drop(a);
+        assert!(region.is_shared(1));
+        assert!(reclaimed(&region).is_empty());
+        drop(b);
+        assert!(!region.is_shared(1));
+        assert_eq!(reclaimed(&region), vec![1]);
+    }
+
+    /// Tests that only a data buffer that holds the sole reference to a slot can write to it.
+    #[test]
+    fn test_slot_region_write() {
+        let region: SlotRegion = region(1);
+        let mut a: DataBuffer = region.share(0);
+        a[0] = 42;
+        let b: DataBuffer = a.clone();
+        assert_eq!(b[0], 42);
+        assert!(::std::panic::catch_unwind(::std::panic::AssertUnwindSafe(|| a[0] = 0)).is_err());
+    }
+
+    /// Tests that references that are leaked from data buffers are released, and that over-releasing fails.
+    #[test]
+    fn test_slot_region_release() {
+        let region: SlotRegion = region(2);
+        let a: DataBuffer = region.share(0);
+        let b: DataBuffer = region.share(0);
+        DataBuffer::into_raw_parts(a).unwrap();
+        DataBuffer::into_raw_parts(b).unwrap();
+        assert!(!region.release(0).unwrap());
+        assert!(region.release(0).unwrap());
+        assert!(!region.is_shared(0));
+        assert!(region.release(0).is_err());
+        assert!(region.release(2).is_err());
+    }
+
+    /// Tests that the memory of a region outlives the region while buffers are still handed out.
+    #[test]
+    fn test_slot_region_outlive() {
+        let region: SlotRegion = region(1);
+        let mut a: DataBuffer = region.share(0);
+        a[0] = 7;
+        drop(region);
+        assert_eq!(a[0], 7);
+    }
+
+    /// Tests that addresses are mapped back to their slots.
+    #[test]
+    fn test_slot_region_lookup() {
+        let region: SlotRegion = region(4);
+        let base: *mut u8 = region.as_ptr();
+        for index in 0..4 {
+            assert_eq!(region.lookup(unsafe { base.add(index * 64) }), Some(index));
+            assert_eq!(region.lookup(unsafe { base.add(index * 64 + 63) }), Some(index));
+            assert_eq!(region.lookup(region.data_ptr(index)), Some(index));
+        }
+        assert_eq!(region.lookup(unsafe { base.add(4 * 64) }), None);
+        assert_eq!(region.lookup(base.wrapping_sub(1)), None);
+    }
+}
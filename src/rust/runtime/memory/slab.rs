@@ -0,0 +1,462 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use super::{
+    DataBuffer,
+    FreeList,
+    Mapping,
+    SlotRegion,
+};
+use crate::runtime::{
+    fail::Fail,
+    stats,
+};
+use ::std::{
+    cell::RefCell,
+    collections::HashMap,
+    sync::Arc,
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Sizes of the buffers in each class of a slab allocator.
+const SLAB_SLOT_SIZES: [usize; 6] = [64, 256, 1024, 4096, 16384, 65536];
+
+/// Default number of bytes that a class of a slab allocator maps at once.
+const SLAB_CHUNK_SIZE: usize = 2 * 1024 * 1024;
+
+/// Default maximum number of bytes that a class of a slab allocator holds.
+const SLAB_MAX_CLASS_SIZE: usize = 16 * 1024 * 1024;
+
+/// Size of the huge pages that back slab classes.
+const SLAB_HUGE_PAGE_SIZE: usize = 2 * 1024 * 1024;
+
+/// Size of the regular pages that back slab classes.
+const SLAB_PAGE_SIZE: usize = 4096;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Slab Allocator Configuration
+#[derive(Clone, Copy, Debug)]
+pub struct SlabConfig {
+    /// Number of bytes that a class maps at once, when it runs out of buffers.
+    pub chunk_size: usize,
+    /// Maximum number of bytes that a class holds.
+    pub max_class_size: usize,
+    /// Whether classes are backed by huge pages. Huge pages may be shared with other users (e.g. DPDK), thus they are
+    /// only used if asked for.
+    pub huge_pages: bool,
+}
+
+/// Class of Equally-Sized Buffers
+struct SlabClass {
+    /// Size of each buffer.
+    slot_size: usize,
+    /// Number of buffers in each chunk.
+    chunk_slots: usize,
+    /// Maximum number of buffers.
+    max_slots: usize,
+    /// Memory that backs the buffers, which is mapped one chunk at a time as the class grows.
+    chunks: Vec<SlotRegion>,
+    /// Number of buffers that were handed out at least once. Buffers are handed out in address order at first.
+    nslots: usize,
+    /// Buffers whose last reference went away, which the chunks of the class push without taking any lock.
+    returned: Arc<FreeList>,
+    /// Buffers that were taken back from `returned`, and that are ready to be handed out again.
+    free: Vec<usize>,
+}
+
+/// Occupancy Statistics of a Slab Class
+#[derive(Clone, Copy, Debug)]
+pub struct SlabStats {
+    /// Size of each buffer in the class.
+    pub slot_size: usize,
+    /// Number of buffers that were allocated for the class.
+    pub slots: usize,
+    /// Number of buffers that are ready to be handed out.
+    pub free: usize,
+}
+
+/// Slab Allocator
+///
+/// Hands out buffers for scatter-gather arrays from a few size classes. Each class grows by mapping chunks of memory,
+/// optionally of huge pages, so that the steady state runs without calls to the heap allocator. Buffers are found back
+/// from their address in constant time: chunks are aligned to their size, which is the same for all classes, so the
+/// base address of a chunk, and thus its class, follows from the address of any of its buffers. Since buffers are reference-counted, a buffer that is still shared when
+/// its scatter-gather array is released (e.g. a buffer with a push in flight) is only handed out again once the last
+/// reference to it goes away. The allocator is not thread-safe: each runtime owns one.
+pub struct SlabAllocator {
+    /// Configuration.
+    config: SlabConfig,
+    /// Size of the chunks of all classes, which is a power of two. Chunks are aligned to it.
+    chunk_size: usize,
+    /// Size classes, sorted by buffer size.
+    classes: RefCell<Vec<SlabClass>>,
+    /// Class of each chunk, and index of the chunk in that class, by base address of the chunk.
+    chunks: RefCell<HashMap<usize, (usize, usize)>>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Slab Classes
+impl SlabClass {
+    fn new(slot_size: usize, chunk_size: usize, config: &SlabConfig) -> Self {
+        Self {
+            slot_size,
+            chunk_slots: chunk_size / slot_size,
+            max_slots: config.max_class_size / slot_size,
+            chunks: Vec::new(),
+            nslots: 0,
+            returned: Arc::new(FreeList::new()),
+            free: Vec::new(),
+        }
+    }
+
+    /// Looks for a free buffer in the target class. Buffers that were returned since the last call are taken back
+    /// first, once `free` runs out.
+    fn pop_free(&mut self, chunk_size: usize, chunks: &HashMap<usize, (usize, usize)>) -> Option<usize> {
+        if self.free.is_empty() {
+            let (slot_size, chunk_slots): (usize, usize) = (self.slot_size, self.chunk_slots);
+            let free: &mut Vec<usize> = &mut self.free;
+            self.returned.drain(|addr| {
+                let (base, offset): (usize, usize) = split_addr(addr as usize, chunk_size);
+                let (_, chunk): (usize, usize) = chunks[&base];
+                free.push(chunk * chunk_slots + offset / slot_size);
+            });
+        }
+        self.free.pop()
+    }
+
+    /// Takes a buffer that was never handed out from the target class, after mapping a new chunk if needed. Returns
+    /// `None` if the class is exhausted, or if no memory can be mapped. The base address of a new chunk is passed to
+    /// `on_new_chunk`, along with its index in the class.
+    fn pop_new<F: FnOnce(usize, usize)>(
+        &mut self,
+        chunk_size: usize,
+        config: &SlabConfig,
+        on_new_chunk: F,
+    ) -> Option<usize> {
+        if self.nslots >= self.max_slots {
+            return None;
+        }
+        if self.nslots == self.chunks.len() * self.chunk_slots {
+            let chunk: SlotRegion = self.map_chunk(chunk_size, config)?;
+            on_new_chunk(chunk.as_ptr() as usize, self.chunks.len());
+            self.chunks.push(chunk);
+        }
+        self.nslots += 1;
+        Some(self.nslots - 1)
+    }
+
+    /// Maps a chunk of `chunk_size` bytes, aligned to its size. If the configuration asks for huge pages, these are
+    /// tried first, and regular pages are used if there are not enough of them.
+    fn map_chunk(&self, chunk_size: usize, config: &SlabConfig) -> Option<SlotRegion> {
+        // Huge pages are reserved when they are mapped, so that touching them later does not fail.
+        let memory: Option<Mapping> = if config.huge_pages {
+            match Mapping::new_aligned(chunk_size, chunk_size, libc::MAP_HUGETLB) {
+                Ok(memory) => Some(memory),
+                Err(_) => {
+                    debug!(
+                        "cannot map slab chunk on huge pages, falling back to regular pages (len={:?})",
+                        chunk_size
+                    );
+                    None
+                },
+            }
+        } else {
+            None
+        };
+        let memory: Mapping = match memory {
+            Some(memory) => memory,
+            // Regular pages are only backed once they are touched.
+            None => match Mapping::new_aligned(chunk_size, chunk_size, libc::MAP_NORESERVE) {
+                Ok(memory) => memory,
+                Err(e) => {
+                    warn!("cannot map slab chunk (len={:?}): {:?}", chunk_size, e);
+                    return None;
+                },
+            },
+        };
+        Some(SlotRegion::with_free_list(
+            memory,
+            self.chunk_slots,
+            self.slot_size,
+            0,
+            self.returned.clone(),
+        ))
+    }
+
+    /// Returns the chunk of a buffer in the target class, and the index of the buffer in that chunk.
+    fn chunk(&self, slot: usize) -> (&SlotRegion, usize) {
+        (&self.chunks[slot / self.chunk_slots], slot % self.chunk_slots)
+    }
+}
+
+/// Associate Functions for Slab Allocators
+impl SlabAllocator {
+    /// Creates an empty slab allocator.
+    pub fn new(config: SlabConfig) -> Self {
+        let page_size: usize = if config.huge_pages {
+            SLAB_HUGE_PAGE_SIZE
+        } else {
+            SLAB_PAGE_SIZE
+        };
+        // Chunks span whole pages, and hold at least one buffer of each class.
+        let chunk_size: usize = config
+            .chunk_size
+            .max(SLAB_SLOT_SIZES[SLAB_SLOT_SIZES.len() - 1])
+            .max(page_size)
+            .next_power_of_two();
+        Self {
+            config,
+            chunk_size,
+            classes: RefCell::new(
+                SLAB_SLOT_SIZES
+                    .iter()
+                    .map(|size| SlabClass::new(*size, chunk_size, &config))
+                    .collect(),
+            ),
+            chunks: RefCell::new(HashMap::new()),
+        }
+    }
+
+    /// Allocates a buffer of `size` bytes. Returns `None` if `size` is zero or larger than the largest class, or if the
+    /// class that fits `size` is exhausted.
+    pub fn alloc(&self, size: usize) -> Option<DataBuffer> {
+        if size == 0 || size > SLAB_SLOT_SIZES[SLAB_SLOT_SIZES.len() - 1] {
+            return None;
+        }
+
+        let class_index: usize = SLAB_SLOT_SIZES.partition_point(|slot_size| *slot_size < size);
+        let mut classes = self.classes.borrow_mut();
+        let mut chunks = self.chunks.borrow_mut();
+        let class: &mut SlabClass = &mut classes[class_index];
+        let slot: usize = match class.pop_free(self.chunk_size, &chunks).or_else(|| {
+            class.pop_new(self.chunk_size, &self.config, |base, chunk| {
+                chunks.insert(base, (class_index, chunk));
+            })
+        }) {
+            Some(slot) => slot,
+            None => {
+                stats::record_mempool_exhausted();
+                return None;
+            },
+        };
+
+        let (chunk, index): (&SlotRegion, usize) = class.chunk(slot);
+        let mut dbuf: DataBuffer = chunk.share(index);
+        dbuf.trim(class.slot_size - size);
+        Some(dbuf)
+    }
+
+    /// Returns the size of the buffer that starts at `base`, if it belongs to the target slab allocator.
+    pub fn lookup(&self, base: *const u8) -> Option<usize> {
+        let (class, _): (usize, usize) = self.locate(base)?;
+        Some(self.classes.borrow()[class].slot_size)
+    }
+
+    /// Releases the reference that a scatter-gather array holds to the buffer that starts at `base`, which then goes
+    /// back to its class once no one else references it. Returns `false` if the buffer does not belong to the target
+    /// slab allocator, and fails if it is not handed out (e.g. if it was already released).
+    pub fn release(&self, base: *const u8) -> Result<bool, Fail> {
+        let (class, slot): (usize, usize) = match self.locate(base) {
+            Some(location) => location,
+            None => return Ok(false),
+        };
+        let classes = self.classes.borrow();
+        let (chunk, index): (&SlotRegion, usize) = classes[class].chunk(slot);
+        chunk.release(index)?;
+        Ok(true)
+    }
+
+    /// Takes an additional reference to the buffer that starts at `base`, and returns it as a data buffer. Returns
+    /// `None` if the buffer does not belong to the target slab allocator, or if it is not handed out.
+    pub fn share(&self, base: *const u8) -> Option<DataBuffer> {
+        let (class, slot): (usize, usize) = self.locate(base)?;
+        let classes = self.classes.borrow();
+        let (chunk, index): (&SlotRegion, usize) = classes[class].chunk(slot);
+        if chunk.is_shared(index) {
+            Some(chunk.share(index))
+        } else {
+            None
+        }
+    }
+
+    /// Returns occupancy statistics of each class in the target slab allocator.
+    pub fn stats(&self) -> Vec<SlabStats> {
+        self.classes
+            .borrow()
+            .iter()
+            .map(|class| SlabStats {
+                slot_size: class.slot_size,
+                slots: class.nslots,
+                free: (0..class.nslots)
+                    .filter(|slot| {
+                        let (chunk, index): (&SlotRegion, usize) = class.chunk(*slot);
+                        !chunk.is_shared(index)
+                    })
+                    .count(),
+            })
+            .collect()
+    }
+
+    /// Returns the class of the buffer that starts at `base`, and the index of the buffer in that class, if it was
+    /// handed out by the target slab allocator.
+    fn locate(&self, base: *const u8) -> Option<(usize, usize)> {
+        let (chunk_base, offset): (usize, usize) = split_addr(base as usize, self.chunk_size);
+        let (class_index, chunk): (usize, usize) = *self.chunks.borrow().get(&chunk_base)?;
+        let classes = self.classes.borrow();
+        let class: &SlabClass = &classes[class_index];
+        if offset % class.slot_size != 0 {
+            return None;
+        }
+        let slot: usize = chunk * class.chunk_slots + offset / class.slot_size;
+        if slot < class.nslots {
+            Some((class_index, slot))
+        } else {
+            None
+        }
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Default Trait Implementation for Slab Allocator Configurations
+impl Default for SlabConfig {
+    fn default() -> Self {
+        Self {
+            chunk_size: SLAB_CHUNK_SIZE,
+            max_class_size: SLAB_MAX_CLASS_SIZE,
+            huge_pages: false,
+        }
+    }
+}
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Splits `addr` into the base address of the chunk of `chunk_size` bytes that contains it, and its offset in that
+/// chunk.
+fn split_addr(addr: usize, chunk_size: usize) -> (usize, usize) {
+    (addr & !(chunk_size - 1), addr & (chunk_size - 1))
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        SlabAllocator,
+        SlabConfig,
+    };
+    use crate::runtime::memory::DataBuffer;
+
+    /// Releases a buffer the way scatter-gather arrays do, i.e. by leaking a reference and releasing it later.
+    fn release(slab: &SlabAllocator, dbuf: DataBuffer) {
+        let (dbuf_ptr, _): (*const u8, *const u8) = DataBuffer::into_raw_parts(dbuf).unwrap();
+        assert!(slab.release(dbuf_ptr).unwrap());
+    }
+
+    /// Tests that buffers come from the smallest class that fits them, and that released buffers are recycled.
+    #[test]
+    fn test_slab_alloc_release() {
+        let slab: SlabAllocator = SlabAllocator::new(SlabConfig::default());
+        let a: DataBuffer = slab.alloc(100).unwrap();
+        assert_eq!(a.len(), 100);
+        assert_eq!(slab.lookup(a.as_ptr()), Some(256));
+
+        let a_ptr: *const u8 = a.as_ptr();
+        release(&slab, a);
+        let b: DataBuffer = slab.alloc(200).unwrap();
+        assert_eq!(b.as_ptr(), a_ptr);
+        assert_ne!(slab.alloc(200).unwrap().as_ptr(), a_ptr);
+
+        // Buffers that were already released are not released again.
+        release(&slab, b);
+        assert!(slab.release(a_ptr).is_err());
+
+        // Requests that do not fit in any class are not served.
+        assert!(slab.alloc(0).is_none());
+        assert!(slab.alloc(65537).is_none());
+        let heap: Vec<u8> = vec![0; 64];
+        assert!(!slab.release(heap.as_ptr()).unwrap());
+    }
+
+    /// Tests that a buffer is not handed out again until all references to it are released.
+    #[test]
+    fn test_slab_share() {
+        let slab: SlabAllocator = SlabAllocator::new(SlabConfig::default());
+        let a: DataBuffer = slab.alloc(64).unwrap();
+        let a_ptr: *const u8 = a.as_ptr();
+        let shared: DataBuffer = slab.share(a_ptr).unwrap();
+        release(&slab, a);
+
+        let b: DataBuffer = slab.alloc(64).unwrap();
+        assert_ne!(b.as_ptr(), a_ptr);
+        release(&slab, b);
+
+        drop(shared);
+        let c: DataBuffer = slab.alloc(64).unwrap();
+        let d: DataBuffer = slab.alloc(64).unwrap();
+        assert!(c.as_ptr() == a_ptr || d.as_ptr() == a_ptr);
+        assert_eq!(slab.stats()[0].slots, 2);
+    }
+
+    /// Tests that only the start of a buffer that was handed out maps back to it.
+    #[test]
+    fn test_slab_lookup() {
+        let slab: SlabAllocator = SlabAllocator::new(SlabConfig::default());
+        let a: DataBuffer = slab.alloc(1000).unwrap();
+        let b: DataBuffer = slab.alloc(1000).unwrap();
+        assert_eq!(slab.lookup(a.as_ptr()), Some(1024));
+        assert_eq!(slab.lookup(b.as_ptr()), Some(1024));
+        assert_eq!(slab.lookup(a.as_ptr().wrapping_add(1)), None);
+
+        // Buffers of a class lie next to each other, in a single region.
+        let next: *const u8 = b.as_ptr().wrapping_add(b.as_ptr() as usize - a.as_ptr() as usize);
+        assert_eq!(slab.lookup(next), None);
+        assert_eq!(slab.alloc(1000).unwrap().as_ptr(), next);
+    }
+
+    /// Tests that classes grow one chunk at a time, up to their maximum size.
+    #[test]
+    fn test_slab_chunks() {
+        let config: SlabConfig = SlabConfig {
+            chunk_size: 4096,
+            max_class_size: 3 * 65536,
+            huge_pages: false,
+        };
+        let slab: SlabAllocator = SlabAllocator::new(config);
+        let bufs: Vec<DataBuffer> = (0..3).map(|_| slab.alloc(65536).unwrap()).collect();
+        assert!(slab.alloc(65536).is_none());
+        for buf in &bufs {
+            assert_eq!(slab.lookup(buf.as_ptr()), Some(65536));
+            // Chunks are aligned to their size, which fits at least one buffer of the largest class.
+            assert_eq!(buf.as_ptr() as usize % 65536, 0);
+        }
+
+        // Released buffers are recycled, rather than mapping more chunks.
+        for buf in bufs {
+            release(&slab, buf);
+        }
+        assert_eq!(slab.stats()[5].free, 3);
+        let a: DataBuffer = slab.alloc(65536).unwrap();
+        assert_eq!(slab.lookup(a.as_ptr()), Some(65536));
+        assert_eq!(slab.stats()[5].slots, 3);
+    }
+}
@@ -10,6 +10,7 @@ pub mod logging;
 pub mod memory;
 pub mod network;
 pub mod queue;
+pub mod stats;
 pub mod timer;
 pub mod types;
 pub mod watched;
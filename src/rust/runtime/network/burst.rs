@@ -0,0 +1,141 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use super::consts::{
+    DEFAULT_RECEIVE_BATCH_SIZE,
+    MIN_RECEIVE_BATCH_SIZE,
+    RECEIVE_BATCH_SIZE,
+};
+use ::std::cell::Cell;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Receive Burst Sizer
+///
+/// Decides how many packets a runtime asks the device for on each receive. When adaptive mode is enabled, the burst
+/// size doubles every time a burst comes back full (more packets are likely waiting) and halves every time a burst
+/// comes back empty (the device is idle), staying within [MIN_RECEIVE_BATCH_SIZE] and the configured maximum.
+#[derive(Debug)]
+pub struct RxBurst {
+    /// Current burst size.
+    size: Cell<usize>,
+    /// Maximum burst size.
+    max: usize,
+    /// Adapt burst size to traffic?
+    adaptive: bool,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Receive Burst Sizers
+impl RxBurst {
+    /// Creates a receive burst sizer. The maximum burst size is clamped to [RECEIVE_BATCH_SIZE].
+    pub fn new(max: Option<usize>, adaptive: Option<bool>) -> Self {
+        let max: usize = max
+            .unwrap_or(DEFAULT_RECEIVE_BATCH_SIZE)
+            .clamp(MIN_RECEIVE_BATCH_SIZE, RECEIVE_BATCH_SIZE);
+        let adaptive: bool = adaptive.unwrap_or(false);
+        let size: usize = if adaptive { MIN_RECEIVE_BATCH_SIZE } else { max };
+        Self {
+            size: Cell::new(size),
+            max,
+            adaptive,
+        }
+    }
+
+    /// Returns the number of packets to ask for in the next burst.
+    pub fn size(&self) -> usize {
+        self.size.get()
+    }
+
+    /// Updates the burst size given the number of packets received in the last burst.
+    pub fn update(&self, nreceived: usize) {
+        if !self.adaptive {
+            return;
+        }
+
+        let size: usize = self.size.get();
+        if nreceived >= size {
+            self.size.set((size * 2).min(self.max));
+        } else if nreceived == 0 {
+            self.size.set((size / 2).max(MIN_RECEIVE_BATCH_SIZE));
+        }
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Default Trait Implementation for Receive Burst Sizers
+impl Default for RxBurst {
+    fn default() -> Self {
+        Self::new(None, None)
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::RxBurst;
+    use crate::runtime::network::consts::{
+        DEFAULT_RECEIVE_BATCH_SIZE,
+        MIN_RECEIVE_BATCH_SIZE,
+        RECEIVE_BATCH_SIZE,
+    };
+
+    /// Tests that a fixed burst size does not change with traffic.
+    #[test]
+    fn test_rx_burst_fixed() {
+        let burst: RxBurst = RxBurst::default();
+        assert_eq!(burst.size(), DEFAULT_RECEIVE_BATCH_SIZE);
+        burst.update(DEFAULT_RECEIVE_BATCH_SIZE);
+        assert_eq!(burst.size(), DEFAULT_RECEIVE_BATCH_SIZE);
+        burst.update(0);
+        assert_eq!(burst.size(), DEFAULT_RECEIVE_BATCH_SIZE);
+    }
+
+    /// Tests that the maximum burst size is clamped.
+    #[test]
+    fn test_rx_burst_clamped() {
+        let burst: RxBurst = RxBurst::new(Some(RECEIVE_BATCH_SIZE * 2), None);
+        assert_eq!(burst.size(), RECEIVE_BATCH_SIZE);
+        let burst: RxBurst = RxBurst::new(Some(0), None);
+        assert_eq!(burst.size(), MIN_RECEIVE_BATCH_SIZE);
+    }
+
+    /// Tests that an adaptive burst size grows on full bursts and shrinks on empty bursts.
+    #[test]
+    fn test_rx_burst_adaptive() {
+        let max: usize = MIN_RECEIVE_BATCH_SIZE * 4;
+        let burst: RxBurst = RxBurst::new(Some(max), Some(true));
+        assert_eq!(burst.size(), MIN_RECEIVE_BATCH_SIZE);
+
+        // Grow up to the maximum.
+        for _ in 0..4 {
+            burst.update(burst.size());
+        }
+        assert_eq!(burst.size(), max);
+
+        // Partial bursts keep the current size.
+        burst.update(1);
+        assert_eq!(burst.size(), max);
+
+        // Shrink down to the minimum.
+        for _ in 0..4 {
+            burst.update(0);
+        }
+        assert_eq!(burst.size(), MIN_RECEIVE_BATCH_SIZE);
+    }
+}
@@ -12,6 +12,21 @@ use crate::runtime::network::consts::{
 };
 use ::std::time::Duration;
 
+//==============================================================================
+// Enumerations
+//==============================================================================
+
+/// TCP Congestion Control Algorithms
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum CongestionControlAlgorithm {
+    /// No congestion control.
+    None,
+    /// CUBIC (RFC 8312).
+    Cubic,
+    /// Bottleneck Bandwidth and Round-trip propagation time, with pacing.
+    Bbr,
+}
+
 //==============================================================================
 // Structures
 //==============================================================================
@@ -35,6 +50,14 @@ pub struct TcpConfig {
     rx_checksum_offload: bool,
     /// Offload Checksum to Hardware When Sending?
     tx_checksum_offload: bool,
+    /// Negotiate Selective Acknowledgements and RACK-TLP Loss Recovery?
+    selective_ack: bool,
+    /// Congestion Control Algorithm
+    congestion_control: CongestionControlAlgorithm,
+    /// Offload Segmentation to Hardware When Sending?
+    tx_segmentation_offload: bool,
+    /// Coalesce In-Order Segments When Receiving?
+    rx_segment_coalescing: bool,
 }
 
 //==============================================================================
@@ -53,6 +76,10 @@ impl TcpConfig {
         ack_delay_timeout: Option<Duration>,
         rx_checksum_offload: Option<bool>,
         tx_checksum_offload: Option<bool>,
+        selective_ack: Option<bool>,
+        congestion_control: Option<CongestionControlAlgorithm>,
+        tx_segmentation_offload: Option<bool>,
+        rx_segment_coalescing: Option<bool>,
     ) -> Self {
         let mut options = Self::default();
 
@@ -80,6 +107,18 @@ impl TcpConfig {
         if let Some(value) = tx_checksum_offload {
             options.tx_checksum_offload = value;
         }
+        if let Some(value) = selective_ack {
+            options.selective_ack = value;
+        }
+        if let Some(value) = congestion_control {
+            options.congestion_control = value;
+        }
+        if let Some(value) = tx_segmentation_offload {
+            options.tx_segmentation_offload = value;
+        }
+        if let Some(value) = rx_segment_coalescing {
+            options.rx_segment_coalescing = value;
+        }
 
         options
     }
@@ -124,6 +163,26 @@ impl TcpConfig {
         self.rx_checksum_offload
     }
 
+    /// Gets the selective acknowledgement option in the target [TcpConfig].
+    pub fn get_selective_ack(&self) -> bool {
+        self.selective_ack
+    }
+
+    /// Gets the congestion control algorithm in the target [TcpConfig].
+    pub fn get_congestion_control(&self) -> CongestionControlAlgorithm {
+        self.congestion_control
+    }
+
+    /// Gets the TX hardware segmentation offload option in the target [TcpConfig].
+    pub fn get_tx_segmentation_offload(&self) -> bool {
+        self.tx_segmentation_offload
+    }
+
+    /// Gets the RX segment coalescing option in the target [TcpConfig].
+    pub fn get_rx_segment_coalescing(&self) -> bool {
+        self.rx_segment_coalescing
+    }
+
     /// Sets the advertised maximum segment size in the target [TcpConfig].
     fn set_advertised_mss(mut self, value: usize) -> Self {
         assert!(value >= MIN_MSS);
@@ -184,6 +243,10 @@ impl Default for TcpConfig {
             window_scale: 0,
             rx_checksum_offload: false,
             tx_checksum_offload: false,
+            selective_ack: false,
+            congestion_control: CongestionControlAlgorithm::None,
+            tx_segmentation_offload: false,
+            rx_segment_coalescing: false,
         }
     }
 }
@@ -195,7 +258,10 @@ impl Default for TcpConfig {
 #[cfg(test)]
 mod tests {
     use crate::runtime::network::{
-        config::TcpConfig,
+        config::{
+            CongestionControlAlgorithm,
+            TcpConfig,
+        },
         consts::DEFAULT_MSS,
     };
     use ::std::time::Duration;
@@ -211,5 +277,9 @@ mod tests {
         assert_eq!(config.get_window_scale(), 0);
         assert_eq!(config.get_rx_checksum_offload(), false);
         assert_eq!(config.get_tx_checksum_offload(), false);
+        assert_eq!(config.get_selective_ack(), false);
+        assert_eq!(config.get_congestion_control(), CongestionControlAlgorithm::None);
+        assert_eq!(config.get_tx_segmentation_offload(), false);
+        assert_eq!(config.get_rx_segment_coalescing(), false);
     }
 }
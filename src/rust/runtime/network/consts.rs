@@ -19,7 +19,15 @@ pub const MAX_MSS: usize = u16::max_value() as usize;
 /// TODO: Auto-Discovery MTU Size
 pub const DEFAULT_MSS: usize = 1450;
 
-/// Length of a [crate::memory::Buffer] batch.
-///
-/// TODO: This Should be Generic
-pub const RECEIVE_BATCH_SIZE: usize = 4;
+/// Maximum payload of a TCP packet that the NIC segments for us, so that its IPv4 total length still fits in 16 bits
+/// with the largest IPv4 (20 bytes) and TCP (60 bytes) headers.
+pub const MAX_SEGMENTATION_OFFLOAD_SIZE: usize = u16::max_value() as usize - 20 - 60;
+
+/// Maximum length of a [crate::memory::Buffer] batch.
+pub const RECEIVE_BATCH_SIZE: usize = 128;
+
+/// Minimum length of a [crate::memory::Buffer] batch.
+pub const MIN_RECEIVE_BATCH_SIZE: usize = 4;
+
+/// Default length of a [crate::memory::Buffer] batch.
+pub const DEFAULT_RECEIVE_BATCH_SIZE: usize = 32;
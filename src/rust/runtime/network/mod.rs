@@ -10,15 +10,40 @@ use crate::runtime::{
     network::consts::RECEIVE_BATCH_SIZE,
 };
 use ::arrayvec::ArrayVec;
+use ::std::{
+    net::SocketAddrV4,
+    time::Duration,
+};
 
 //==============================================================================
 // Exports
 //==============================================================================
 
+pub mod burst;
 pub mod config;
 pub mod consts;
+pub mod rss;
 pub mod types;
 
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Segmentation Offload Descriptor
+///
+/// Describes how the NIC should split a large packet into wire-sized segments, each carrying a copy of its headers.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub struct SegmentationOffload {
+    /// Size of the link-layer header.
+    pub l2_len: usize,
+    /// Size of the network-layer header.
+    pub l3_len: usize,
+    /// Size of the transport-layer header.
+    pub l4_len: usize,
+    /// Maximum payload of each segment.
+    pub segment_size: usize,
+}
+
 //==============================================================================
 // Traits
 //==============================================================================
@@ -33,6 +58,11 @@ pub trait PacketBuf {
     fn body_size(&self) -> usize;
     /// Consumes and returns the body of the target [PacketBuf].
     fn take_body(&self) -> Option<Buffer>;
+    /// Returns how the NIC should segment the target [PacketBuf], if it is larger than a segment. Runtimes that do not
+    /// offload segmentation never get such packets.
+    fn segmentation_offload(&self) -> Option<SegmentationOffload> {
+        None
+    }
 }
 
 /// Network Runtime
@@ -42,4 +72,19 @@ pub trait NetworkRuntime {
 
     /// Receives a batch of [PacketBuf].
     fn receive(&self) -> ArrayVec<Buffer, RECEIVE_BATCH_SIZE>;
+
+    /// Flushes packets that were staged for transmission. Runtimes that do not stage packets need not implement this.
+    fn flush(&self) {}
+
+    /// Called between the polls of a wait that has found no work for `idle`, so that the runtime may save power. This
+    /// must return once packets may have arrived or `timeout` expires. If `timeout` is `None`, the wait has no deadline.
+    /// Runtimes that cannot wait for packets need not implement this, in which case waits keep polling.
+    fn idle(&self, _idle: Duration, _timeout: Option<Duration>) {}
+
+    /// Checks if packets that `remote` sends to `local` are received by the target runtime. Runtimes that share a NIC
+    /// with others, each receiving a subset of the flows, answer this so that active opens pick local ports that come
+    /// back to them. Other runtimes receive all flows and need not implement this.
+    fn receives_flow(&self, _local: SocketAddrV4, _remote: SocketAddrV4) -> bool {
+        true
+    }
 }
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use ::std::net::SocketAddrV4;
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Length of a Toeplitz hash key.
+pub const RSS_KEY_LEN: usize = 40;
+
+/// Toeplitz hash key that NICs are programmed with, which is the sample key of the Receive Side Scaling specification.
+/// Flow tables hash with this key too, so that they can reuse the hash that the NIC computes for each packet.
+pub static RSS_KEY: [u8; RSS_KEY_LEN] = [
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b,
+    0xcb, 0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac,
+    0x01, 0xfa,
+];
+
+/// Length of the input of a Toeplitz hash over an IPv4 4-tuple.
+const RSS_INPUT_LEN: usize = 12;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Toeplitz Hasher
+///
+/// Software implementation of the hash function that NICs use for Receive Side Scaling. The contribution of each byte
+/// value at each input position is precomputed, so that hashing an IPv4 4-tuple takes a table lookup per byte.
+pub struct ToeplitzHasher {
+    table: Box<[[u32; 256]; RSS_INPUT_LEN]>,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Toeplitz Hashers
+impl ToeplitzHasher {
+    /// Creates a Toeplitz hasher for a given key.
+    pub fn new(key: &[u8; RSS_KEY_LEN]) -> Self {
+        let mut table: Box<[[u32; 256]; RSS_INPUT_LEN]> = Box::new([[0; 256]; RSS_INPUT_LEN]);
+        for (i, row) in table.iter_mut().enumerate() {
+            // The 32-bit window of the key that lines up with each bit of the byte at position `i`.
+            let window: u64 = u64::from_be_bytes(key[i..(i + 8)].try_into().unwrap());
+            for (value, entry) in row.iter_mut().enumerate() {
+                for bit in 0..8 {
+                    if value & (0x80 >> bit) != 0 {
+                        *entry ^= (window >> (32 - bit)) as u32;
+                    }
+                }
+            }
+        }
+        Self { table }
+    }
+
+    /// Hashes an IPv4 4-tuple, in the order that a NIC reads it from a received packet.
+    pub fn hash_ipv4_tuple(&self, src: &SocketAddrV4, dst: &SocketAddrV4) -> u32 {
+        let mut input: [u8; RSS_INPUT_LEN] = [0; RSS_INPUT_LEN];
+        input[0..4].copy_from_slice(&src.ip().octets());
+        input[4..8].copy_from_slice(&dst.ip().octets());
+        input[8..10].copy_from_slice(&src.port().to_be_bytes());
+        input[10..12].copy_from_slice(&dst.port().to_be_bytes());
+        input
+            .iter()
+            .zip(self.table.iter())
+            .fold(0, |hash, (byte, row)| hash ^ row[*byte as usize])
+    }
+}
+
+/// Default Trait Implementation for Toeplitz Hashers
+impl Default for ToeplitzHasher {
+    fn default() -> Self {
+        Self::new(&RSS_KEY)
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::ToeplitzHasher;
+    use ::std::net::{
+        Ipv4Addr,
+        SocketAddrV4,
+    };
+
+    /// Tests the hasher against the verification suite of the Receive Side Scaling specification.
+    #[test]
+    fn test_toeplitz_hash() {
+        let hasher: ToeplitzHasher = ToeplitzHasher::default();
+        let vectors: [([u8; 4], u16, [u8; 4], u16, u32); 3] = [
+            ([66, 9, 149, 187], 2794, [161, 142, 100, 80], 1766, 0x51ccc178),
+            ([199, 92, 111, 2], 14230, [65, 69, 140, 83], 4739, 0xc626b0ea),
+            ([24, 19, 198, 95], 12898, [12, 22, 207, 184], 38024, 0x5c2b394a),
+        ];
+        for (src_addr, src_port, dst_addr, dst_port, hash) in vectors {
+            let src: SocketAddrV4 = SocketAddrV4::new(Ipv4Addr::from(src_addr), src_port);
+            let dst: SocketAddrV4 = SocketAddrV4::new(Ipv4Addr::from(dst_addr), dst_port);
+            assert_eq!(hasher.hash_ipv4_tuple(&src, &dst), hash);
+        }
+    }
+}
@@ -7,6 +7,7 @@
 
 /// Queue Token
 ///
-/// This is used to uniquely identify operations on IO queues.
+/// This is used to uniquely identify operations on IO queues. It is layout-compatible with `demi_qtoken_t`.
 #[derive(Clone, Display, Copy, Debug, Eq, PartialEq, From, Into, Hash)]
+#[repr(transparent)]
 pub struct QToken(u64);
@@ -0,0 +1,373 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::runtime::types::demi_stats_t;
+use ::std::{
+    ops::Deref,
+    sync::{
+        atomic::{
+            AtomicU64,
+            Ordering,
+        },
+        Arc,
+        Mutex,
+    },
+};
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Runtime Counter
+///
+/// A counter has a single writer, the thread that owns it, so it is updated with a plain load and store instead of a
+/// read-modify-write, and other threads may read it at any time without slowing the writer down.
+#[derive(Default)]
+struct Counter(AtomicU64);
+
+/// Runtime Counters of a Thread
+///
+/// Each thread that runs a LibOS owns its counters, and they are aligned to a cache line so that threads on different
+/// cores never share one.
+#[repr(align(64))]
+#[derive(Default)]
+struct Counters {
+    rx_packets: Counter,
+    rx_bytes: Counter,
+    rx_bursts: Counter,
+    tx_packets: Counter,
+    tx_bytes: Counter,
+    tx_bursts: Counter,
+    mempool_exhausted: Counter,
+    retransmissions: Counter,
+    ooo_depth: Counter,
+    sched_tasks: Counter,
+    sched_polls: Counter,
+    sched_poll_cycles: Counter,
+}
+
+/// Registration of the Runtime Counters of a Thread
+///
+/// When the thread exits, its counters are dropped from the registry. Those that only ever grow are folded into the
+/// retired totals, while gauges (e.g. the number of tasks) describe state that goes away with the thread, and are
+/// dropped.
+struct Registration(Arc<Counters>);
+
+/// Runtime Counters of All Threads
+struct Registry {
+    /// Counters of threads that are running.
+    live: Vec<Arc<Counters>>,
+    /// Sum of the counters of threads that have exited, so that global statistics never go backwards. Gauges are zero.
+    retired: Option<demi_stats_t>,
+}
+
+//==============================================================================
+// Static Variables
+//==============================================================================
+
+/// Counters of all threads.
+static REGISTRY: Mutex<Registry> = Mutex::new(Registry {
+    live: Vec::new(),
+    retired: None,
+});
+
+thread_local! {
+    /// Counters of the calling thread.
+    static COUNTERS: Registration = Registration::new();
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Runtime Counters
+impl Counter {
+    /// Adds `n` to the target counter.
+    #[inline]
+    fn add(&self, n: u64) {
+        self.0
+            .store(self.0.load(Ordering::Relaxed).wrapping_add(n), Ordering::Relaxed);
+    }
+
+    /// Subtracts `n` from the target counter.
+    #[inline]
+    fn sub(&self, n: u64) {
+        self.0
+            .store(self.0.load(Ordering::Relaxed).wrapping_sub(n), Ordering::Relaxed);
+    }
+
+    /// Reads the target counter.
+    fn get(&self) -> u64 {
+        self.0.load(Ordering::Relaxed)
+    }
+}
+
+/// Associate Functions for Runtime Counters of a Thread
+impl Counters {
+    /// Adds the target counters that only ever grow to `stats`.
+    fn collect(&self, stats: &mut demi_stats_t) {
+        stats.rx_packets += self.rx_packets.get();
+        stats.rx_bytes += self.rx_bytes.get();
+        stats.rx_bursts += self.rx_bursts.get();
+        stats.tx_packets += self.tx_packets.get();
+        stats.tx_bytes += self.tx_bytes.get();
+        stats.tx_bursts += self.tx_bursts.get();
+        stats.mempool_exhausted += self.mempool_exhausted.get();
+        stats.retransmissions += self.retransmissions.get();
+        stats.sched_polls += self.sched_polls.get();
+        stats.sched_poll_cycles += self.sched_poll_cycles.get();
+    }
+
+    /// Adds the target gauges to `stats`.
+    fn collect_gauges(&self, stats: &mut demi_stats_t) {
+        stats.ooo_depth = stats.ooo_depth.wrapping_add(self.ooo_depth.get());
+        stats.sched_tasks = stats.sched_tasks.wrapping_add(self.sched_tasks.get());
+    }
+}
+
+/// Associate Functions for Registrations of Runtime Counters
+impl Registration {
+    /// Creates counters for the calling thread and adds them to the registry.
+    fn new() -> Self {
+        let counters: Arc<Counters> = Arc::new(Counters::default());
+        match REGISTRY.lock() {
+            Ok(mut registry) => registry.live.push(counters.clone()),
+            Err(_) => warn!("failed to register runtime counters"),
+        }
+        Self(counters)
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// De-Reference Trait Implementation for Registrations of Runtime Counters
+impl Deref for Registration {
+    type Target = Counters;
+
+    fn deref(&self) -> &Counters {
+        &self.0
+    }
+}
+
+/// Drop Trait Implementation for Registrations of Runtime Counters
+impl Drop for Registration {
+    fn drop(&mut self) {
+        match REGISTRY.lock() {
+            Ok(mut registry) => {
+                registry.live.retain(|counters| !Arc::ptr_eq(counters, &self.0));
+                self.0
+                    .collect(registry.retired.get_or_insert_with(demi_stats_t::default));
+            },
+            Err(_) => warn!("failed to retire runtime counters"),
+        }
+    }
+}
+
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Records a burst of `packets` packets, that add up to `bytes` bytes, that was received.
+#[inline]
+pub fn record_rx_burst(packets: usize, bytes: usize) {
+    if packets > 0 {
+        with_counters(|c| {
+            c.rx_packets.add(packets as u64);
+            c.rx_bytes.add(bytes as u64);
+            c.rx_bursts.add(1);
+        });
+    }
+}
+
+/// Records a burst of `packets` packets, that add up to `bytes` bytes, that was transmitted.
+#[inline]
+pub fn record_tx_burst(packets: usize, bytes: usize) {
+    if packets > 0 {
+        with_counters(|c| {
+            c.tx_packets.add(packets as u64);
+            c.tx_bytes.add(bytes as u64);
+            c.tx_bursts.add(1);
+        });
+    }
+}
+
+/// Records a buffer allocation that failed because a memory pool was exhausted.
+#[inline]
+pub fn record_mempool_exhausted() {
+    with_counters(|c| c.mempool_exhausted.add(1));
+}
+
+/// Records the retransmission of `n` TCP segments.
+#[inline]
+pub fn record_retransmissions(n: usize) {
+    with_counters(|c| c.retransmissions.add(n as u64));
+}
+
+/// Records that a TCP reassembly queue went from holding `before` runs of out-of-order data to holding `after`.
+#[inline]
+pub fn record_ooo_depth(before: usize, after: usize) {
+    if after > before {
+        with_counters(|c| c.ooo_depth.add((after - before) as u64));
+    } else if after < before {
+        with_counters(|c| c.ooo_depth.sub((before - after) as u64));
+    }
+}
+
+/// Records that a task was added to a scheduler.
+#[inline]
+pub fn record_task_inserted() {
+    with_counters(|c| c.sched_tasks.add(1));
+}
+
+/// Records that a task was removed from a scheduler.
+#[inline]
+pub fn record_task_removed() {
+    with_counters(|c| c.sched_tasks.sub(1));
+}
+
+/// Records a poll of a scheduler, that spent `cycles` cycles running tasks.
+#[inline]
+pub fn record_poll(cycles: u64) {
+    with_counters(|c| {
+        c.sched_polls.add(1);
+        c.sched_poll_cycles.add(cycles);
+    });
+}
+
+/// Runs `f` on the counters of the calling thread. Records that come after these counters were destroyed, while the
+/// thread exits (e.g. from the destructor of another thread-local variable), are dropped.
+#[inline]
+fn with_counters<F: FnOnce(&Counters)>(f: F) {
+    let _ = COUNTERS.try_with(|c| f(c));
+}
+
+/// Returns the statistics of the calling thread.
+pub fn local() -> demi_stats_t {
+    let mut stats: demi_stats_t = demi_stats_t::default();
+    COUNTERS.with(|c| {
+        c.collect(&mut stats);
+        c.collect_gauges(&mut stats);
+    });
+    finish(stats)
+}
+
+/// Returns the statistics of all threads.
+pub fn global() -> demi_stats_t {
+    let mut stats: demi_stats_t = demi_stats_t::default();
+    match REGISTRY.lock() {
+        Ok(registry) => {
+            stats = registry.retired.unwrap_or_default();
+            registry.live.iter().for_each(|c| {
+                c.collect(&mut stats);
+                c.collect_gauges(&mut stats);
+            });
+        },
+        Err(_) => warn!("failed to read runtime counters"),
+    }
+    finish(stats)
+}
+
+/// Fills in the fields of `stats` that are derived from others.
+fn finish(mut stats: demi_stats_t) -> demi_stats_t {
+    if stats.rx_bursts > 0 {
+        stats.rx_burst_avg = stats.rx_packets as f64 / stats.rx_bursts as f64;
+    }
+    if stats.tx_bursts > 0 {
+        stats.tx_burst_avg = stats.tx_packets as f64 / stats.tx_bursts as f64;
+    }
+    stats
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        global,
+        local,
+        record_ooo_depth,
+        record_rx_burst,
+        record_task_inserted,
+        record_task_removed,
+        Counters,
+        COUNTERS,
+    };
+    use crate::runtime::types::demi_stats_t;
+    use ::std::{
+        sync::{
+            Arc,
+            Weak,
+        },
+        thread,
+    };
+
+    /// Tests that statistics are kept per thread, and that global statistics add them up.
+    #[test]
+    fn test_stats() {
+        let before: demi_stats_t = global();
+
+        let counters: Weak<Counters> = thread::spawn(|| {
+            record_rx_burst(4, 400);
+            record_rx_burst(2, 200);
+            record_rx_burst(0, 0);
+            record_ooo_depth(0, 3);
+            record_ooo_depth(3, 1);
+            record_task_inserted();
+            record_task_removed();
+            record_task_inserted();
+
+            let stats: demi_stats_t = local();
+            assert_eq!(stats.rx_packets, 6);
+            assert_eq!(stats.rx_bytes, 600);
+            assert_eq!(stats.rx_bursts, 2);
+            assert_eq!(stats.rx_burst_avg, 3.0);
+            assert_eq!(stats.ooo_depth, 1);
+            assert_eq!(stats.sched_tasks, 1);
+
+            // Leave a lot of out-of-order data behind, as if a connection was still open.
+            record_ooo_depth(1, 1 << 40);
+            COUNTERS.with(|c| Arc::downgrade(&c.0))
+        })
+        .join()
+        .unwrap();
+
+        // Counters of threads that exited are dropped from the registry, but they still count.
+        let after: demi_stats_t = global();
+        assert!(after.rx_packets >= before.rx_packets + 6);
+        assert!(after.rx_bytes >= before.rx_bytes + 600);
+        assert!(counters.upgrade().is_none());
+
+        // Gauges of threads that exited are dropped.
+        assert!(after.ooo_depth < 1 << 40);
+    }
+
+    /// Tests that records are dropped, rather than panicking, once the counters of an exiting thread are destroyed.
+    #[test]
+    fn test_stats_thread_exit() {
+        struct Guard;
+        impl Drop for Guard {
+            fn drop(&mut self) {
+                record_rx_burst(1, 100);
+            }
+        }
+        thread_local! {
+            static GUARD: Guard = Guard;
+        }
+
+        // Thread-local variables are destroyed in the reverse order of their creation, so the counters go first.
+        let result: thread::Result<()> = thread::spawn(|| {
+            GUARD.with(|_| ());
+            record_rx_burst(1, 100);
+        })
+        .join();
+        assert!(result.is_ok());
+    }
+}
@@ -1,20 +1,29 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT license.
 
+mod wheel;
+
 //==============================================================================
 // Imports
 //==============================================================================
 
-use crate::collections::intrusive::pairing_heap::{
-    HeapNode,
-    PairingHeap,
+use self::wheel::TimerWheel;
+use crate::collections::intrusive::{
+    double_linked_list::ListNode,
+    pairing_heap::{
+        HeapNode,
+        PairingHeap,
+    },
 };
 use ::futures::future::FusedFuture;
 use ::std::{
     cell::RefCell,
     future::Future,
     marker::PhantomData,
-    ops::Deref,
+    ops::{
+        Deref,
+        DerefMut,
+    },
     pin::Pin,
     rc::Rc,
     task::{
@@ -46,6 +55,25 @@ enum PollState {
     Expired,
 }
 
+/// Data structures that may back a [Timer].
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum TimerBackend {
+    /// Pairing heap, with O(log n) cancellations.
+    Heap,
+    /// Hierarchical timer wheel, with O(1) insertions and cancellations and a resolution of one millisecond.
+    Wheel,
+}
+
+enum TimerQueue {
+    Heap(PairingHeap<TimerQueueEntry>),
+    Wheel(TimerWheel),
+}
+
+enum WaitNode {
+    Heap(HeapNode<TimerQueueEntry>),
+    Wheel(ListNode<TimerQueueEntry>),
+}
+
 //==============================================================================
 // Structures
 //==============================================================================
@@ -54,11 +82,15 @@ struct TimerQueueEntry {
     expiry: Instant,
     task: Option<Waker>,
     state: PollState,
+    /// Expiration tick, when backed by a timer wheel.
+    tick: u64,
+    /// Level and slot, when backed by a timer wheel.
+    wheel_slot: (usize, usize),
 }
 
 struct TimerInner {
     now: Instant,
-    heap: PairingHeap<TimerQueueEntry>,
+    queue: TimerQueue,
 }
 
 pub struct Timer<P: TimerPtr> {
@@ -71,7 +103,7 @@ pub struct TimerRc(pub Rc<Timer<TimerRc>>);
 
 pub struct WaitFuture<P: TimerPtr> {
     ptr: Option<P>,
-    wait_node: HeapNode<TimerQueueEntry>,
+    wait_node: WaitNode,
 }
 
 //==============================================================================
@@ -80,10 +112,15 @@ pub struct WaitFuture<P: TimerPtr> {
 
 impl<P: TimerPtr> Timer<P> {
     pub fn new(now: Instant) -> Self {
-        let inner = TimerInner {
-            now,
-            heap: PairingHeap::new(),
+        Self::with_backend(now, TimerBackend::Heap)
+    }
+
+    pub fn with_backend(now: Instant, backend: TimerBackend) -> Self {
+        let queue: TimerQueue = match backend {
+            TimerBackend::Heap => TimerQueue::Heap(PairingHeap::new()),
+            TimerBackend::Wheel => TimerQueue::Wheel(TimerWheel::new(now)),
         };
+        let inner = TimerInner { now, queue };
         Self {
             inner: RefCell::new(inner),
             _marker: PhantomData,
@@ -92,9 +129,18 @@ impl<P: TimerPtr> Timer<P> {
 
     pub fn advance_clock(&self, now: Instant) {
         let mut inner = self.inner.borrow_mut();
+        let inner: &mut TimerInner = &mut *inner;
         assert!(inner.now <= now);
 
-        while let Some(mut first) = inner.heap.peek_min() {
+        let heap: &mut PairingHeap<TimerQueueEntry> = match inner.queue {
+            TimerQueue::Heap(ref mut heap) => heap,
+            TimerQueue::Wheel(ref mut wheel) => {
+                wheel.advance(now);
+                inner.now = now;
+                return;
+            },
+        };
+        while let Some(mut first) = heap.peek_min() {
             unsafe {
                 let entry = first.as_mut();
                 let first_expiry = entry.expiry;
@@ -105,7 +151,7 @@ impl<P: TimerPtr> Timer<P> {
                 if let Some(task) = entry.task.take() {
                     task.wake();
                 }
-                inner.heap.remove(entry);
+                heap.remove(entry);
             }
         }
         inner.now = now;
@@ -124,10 +170,16 @@ impl<P: TimerPtr> Timer<P> {
             expiry,
             task: None,
             state: PollState::Unregistered,
+            tick: 0,
+            wheel_slot: (0, 0),
+        };
+        let wait_node: WaitNode = match self.inner.borrow().queue {
+            TimerQueue::Heap(_) => WaitNode::Heap(HeapNode::new(entry)),
+            TimerQueue::Wheel(_) => WaitNode::Wheel(ListNode::new(entry)),
         };
         WaitFuture {
             ptr: Some(ptr),
-            wait_node: HeapNode::new(entry),
+            wait_node,
         }
     }
 }
@@ -144,6 +196,50 @@ impl Deref for TimerRc {
     }
 }
 
+impl Deref for WaitNode {
+    type Target = TimerQueueEntry;
+
+    fn deref(&self) -> &TimerQueueEntry {
+        match self {
+            WaitNode::Heap(node) => node,
+            WaitNode::Wheel(node) => node,
+        }
+    }
+}
+
+impl DerefMut for WaitNode {
+    fn deref_mut(&mut self) -> &mut TimerQueueEntry {
+        match self {
+            WaitNode::Heap(node) => node,
+            WaitNode::Wheel(node) => node,
+        }
+    }
+}
+
+impl TimerQueue {
+    /// Inserts a wait node in the target queue.
+    ///
+    /// Safety: `wait_node` should be removed from the queue before it is moved or dropped.
+    unsafe fn insert(&mut self, wait_node: &mut WaitNode) {
+        match (self, wait_node) {
+            (TimerQueue::Heap(heap), WaitNode::Heap(node)) => heap.insert(node),
+            (TimerQueue::Wheel(wheel), WaitNode::Wheel(node)) => wheel.insert(node),
+            _ => unreachable!("wait node does not match timer backend"),
+        }
+    }
+
+    /// Removes a wait node from the target queue.
+    ///
+    /// Safety: `wait_node` should be in the queue.
+    unsafe fn remove(&mut self, wait_node: &mut WaitNode) {
+        match (self, wait_node) {
+            (TimerQueue::Heap(heap), WaitNode::Heap(node)) => heap.remove(node),
+            (TimerQueue::Wheel(wheel), WaitNode::Wheel(node)) => wheel.remove(node),
+            _ => unreachable!("wait node does not match timer backend"),
+        }
+    }
+}
+
 impl TimerPtr for TimerRc {
     fn timer(&self) -> &Timer<Self> {
         &*self.0
@@ -195,7 +291,7 @@ impl<P: TimerPtr> Future for WaitFuture<P> {
                         wait_node.task = Some(cx.waker().clone());
                         wait_node.state = PollState::Registered;
                         unsafe {
-                            inner.heap.insert(wait_node);
+                            inner.queue.insert(wait_node);
                         }
                         Poll::Pending
                     }
@@ -229,7 +325,7 @@ impl<P: TimerPtr> Drop for WaitFuture<P> {
         // Otherwise the timer would access invalid memory.
         if let Some(ptr) = &self.ptr {
             if let PollState::Registered = self.wait_node.state {
-                unsafe { ptr.timer().inner.borrow_mut().heap.remove(&mut self.wait_node) };
+                unsafe { ptr.timer().inner.borrow_mut().queue.remove(&mut self.wait_node) };
                 self.wait_node.state = PollState::Unregistered;
             }
         }
@@ -244,7 +340,13 @@ impl<P: TimerPtr> Drop for WaitFuture<P> {
 mod tests {
     use super::{
         Timer,
+        TimerBackend,
         TimerRc,
+        WaitFuture,
+    };
+    use ::test::{
+        black_box,
+        Bencher,
     };
     use futures::task::noop_waker_ref;
     use std::{
@@ -297,4 +399,82 @@ mod tests {
 
         assert!(Future::poll(Pin::new(&mut wait_future1), &mut ctx).is_ready());
     }
+
+    #[test]
+    fn test_timer_wheel() {
+        let mut ctx = Context::from_waker(noop_waker_ref());
+        let mut now = Instant::now();
+
+        let timer = TimerRc(Rc::new(Timer::with_backend(now, TimerBackend::Wheel)));
+
+        // Timers that expire in different levels of the wheel.
+        let wait_future1 = timer.wait(timer.clone(), Duration::from_millis(10));
+        let wait_future2 = timer.wait(timer.clone(), Duration::from_millis(100));
+        let wait_future3 = timer.wait(timer.clone(), Duration::from_secs(5));
+        futures::pin_mut!(wait_future1);
+        futures::pin_mut!(wait_future2);
+        futures::pin_mut!(wait_future3);
+        assert!(Future::poll(Pin::new(&mut wait_future1), &mut ctx).is_pending());
+        assert!(Future::poll(Pin::new(&mut wait_future2), &mut ctx).is_pending());
+        assert!(Future::poll(Pin::new(&mut wait_future3), &mut ctx).is_pending());
+
+        // Cancelled timers are removed from the wheel.
+        {
+            let wait_future4 = timer.wait(timer.clone(), Duration::from_millis(50));
+            futures::pin_mut!(wait_future4);
+            assert!(Future::poll(Pin::new(&mut wait_future4), &mut ctx).is_pending());
+        }
+
+        now += Duration::from_millis(9);
+        timer.advance_clock(now);
+        assert!(Future::poll(Pin::new(&mut wait_future1), &mut ctx).is_pending());
+
+        now += Duration::from_millis(1);
+        timer.advance_clock(now);
+        assert!(Future::poll(Pin::new(&mut wait_future1), &mut ctx).is_ready());
+        assert!(Future::poll(Pin::new(&mut wait_future2), &mut ctx).is_pending());
+
+        now += Duration::from_millis(90);
+        timer.advance_clock(now);
+        assert!(Future::poll(Pin::new(&mut wait_future2), &mut ctx).is_ready());
+        assert!(Future::poll(Pin::new(&mut wait_future3), &mut ctx).is_pending());
+
+        now += Duration::from_millis(4899);
+        timer.advance_clock(now);
+        assert!(Future::poll(Pin::new(&mut wait_future3), &mut ctx).is_pending());
+
+        now += Duration::from_millis(1);
+        timer.advance_clock(now);
+        assert!(Future::poll(Pin::new(&mut wait_future3), &mut ctx).is_ready());
+    }
+
+    /// Arms many timers, moves the clock forward, and cancels them.
+    fn bench_timer(b: &mut Bencher, backend: TimerBackend) {
+        const NUM_TIMERS: u64 = 1024;
+        let mut ctx = Context::from_waker(noop_waker_ref());
+        let mut now = Instant::now();
+        let timer = TimerRc(Rc::new(Timer::with_backend(now, backend)));
+
+        b.iter(|| {
+            let mut wait_futures: Vec<Pin<Box<WaitFuture<TimerRc>>>> = (0..NUM_TIMERS)
+                .map(|i| Box::pin(timer.wait(timer.clone(), Duration::from_millis(2 + i * 7))))
+                .collect();
+            for wait_future in wait_futures.iter_mut() {
+                black_box(Future::poll(wait_future.as_mut(), &mut ctx).is_pending());
+            }
+            now += Duration::from_millis(1);
+            timer.advance_clock(now);
+            drop(wait_futures);
+        });
+    }
+
+    #[bench]
+    fn bench_timer_heap(b: &mut Bencher) {
+        bench_timer(b, TimerBackend::Heap);
+    }
+
+    #[bench]
+    fn bench_timer_wheel(b: &mut Bencher) {
+        bench_timer(b, TimerBackend::Wheel);
+    }
 }
@@ -0,0 +1,201 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use super::{
+    PollState,
+    TimerQueueEntry,
+};
+use crate::collections::intrusive::double_linked_list::{
+    LinkedList,
+    ListNode,
+};
+use ::std::{
+    mem,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Number of bits of a tick that index the slots of a level.
+const SLOT_BITS: u32 = 6;
+
+/// Number of slots in each level of the wheel.
+const NUM_SLOTS: usize = 1 << SLOT_BITS;
+
+/// Mask for the slot index of a level.
+const SLOT_MASK: u64 = (NUM_SLOTS as u64) - 1;
+
+/// Number of levels in the wheel.
+const NUM_LEVELS: usize = 6;
+
+/// Number of ticks that the wheel spans. Timers that expire later than this are parked in the last level and are
+/// re-inserted as the clock moves on.
+const MAX_TICKS: u64 = 1 << (SLOT_BITS * NUM_LEVELS as u32);
+
+/// Duration of a tick.
+const TICK: Duration = Duration::from_millis(1);
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Level of a Timer Wheel
+struct Level {
+    /// Bitmap of slots that hold at least one timer.
+    occupied: u64,
+    /// Timers, by slot.
+    slots: [LinkedList<TimerQueueEntry>; NUM_SLOTS],
+}
+
+/// Hierarchical Timer Wheel
+///
+/// Timers are kept in intrusive lists, in a slot that is picked by their expiration tick, so arming and cancelling
+/// a timer are both O(1). Level `n` has slots that are `64^n` ticks wide, and a timer lives in the lowest level whose
+/// slots tell it apart from the current tick. As the clock moves on, timers of higher levels cascade down to lower
+/// levels, until they expire in level zero. Timers expire at most one tick after their deadline.
+pub struct TimerWheel {
+    /// Instant of tick zero.
+    origin: Instant,
+    /// Current tick.
+    elapsed: u64,
+    /// Levels of the wheel, from the finest to the coarsest.
+    levels: [Level; NUM_LEVELS],
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Levels of a Timer Wheel
+impl Level {
+    /// Creates an empty level.
+    fn new() -> Self {
+        Self {
+            occupied: 0,
+            slots: ::std::array::from_fn(|_| LinkedList::new()),
+        }
+    }
+}
+
+/// Associate Functions for Timer Wheels
+impl TimerWheel {
+    /// Creates an empty timer wheel whose clock starts at `now`.
+    pub fn new(now: Instant) -> Self {
+        Self {
+            origin: now,
+            elapsed: 0,
+            levels: ::std::array::from_fn(|_| Level::new()),
+        }
+    }
+
+    /// Inserts a timer in the target wheel. The timer should expire later than the current time.
+    ///
+    /// Safety: `node` should be removed from the wheel before it is moved or dropped.
+    pub unsafe fn insert(&mut self, node: &mut ListNode<TimerQueueEntry>) {
+        // Round up, so that timers never expire early.
+        let nanos: u128 = node.expiry.saturating_duration_since(self.origin).as_nanos();
+        let tick_nanos: u128 = TICK.as_nanos();
+        node.tick = ((nanos + tick_nanos - 1) / tick_nanos) as u64;
+        self.place(node);
+    }
+
+    /// Removes a timer from the target wheel.
+    ///
+    /// Safety: `node` should be in the target wheel.
+    pub unsafe fn remove(&mut self, node: &mut ListNode<TimerQueueEntry>) {
+        let (level, slot): (usize, usize) = node.wheel_slot;
+        let level: &mut Level = &mut self.levels[level];
+        level.slots[slot].remove(node);
+        if level.slots[slot].is_empty() {
+            level.occupied &= !(1 << slot);
+        }
+    }
+
+    /// Moves the clock of the target wheel to `now`, and expires all timers whose deadline has passed.
+    pub fn advance(&mut self, now: Instant) {
+        let target: u64 = (now.saturating_duration_since(self.origin).as_nanos() / TICK.as_nanos()) as u64;
+
+        while let Some((level, deadline)) = self.next_expiration() {
+            if deadline > target {
+                break;
+            }
+            self.elapsed = deadline;
+
+            // Expire timers of this slot, or cascade them down to lower levels. Timers are detached from the slot at
+            // once, because timers that are parked in the last level may land in the same slot again.
+            let slot: usize = ((deadline >> (SLOT_BITS * level as u32)) & SLOT_MASK) as usize;
+            self.levels[level].occupied &= !(1 << slot);
+            let mut timers: LinkedList<TimerQueueEntry> =
+                mem::replace(&mut self.levels[level].slots[slot], LinkedList::new());
+            while let Some(node) = timers.remove_first() {
+                let node: *mut ListNode<TimerQueueEntry> = node;
+                unsafe {
+                    if (*node).tick <= self.elapsed {
+                        (*node).state = PollState::Expired;
+                        if let Some(task) = (*node).task.take() {
+                            task.wake();
+                        }
+                    } else {
+                        self.place(&mut *node);
+                    }
+                }
+            }
+        }
+
+        self.elapsed = self.elapsed.max(target);
+    }
+
+    /// Adds a timer to the slot that matches its expiration tick.
+    unsafe fn place(&mut self, node: &mut ListNode<TimerQueueEntry>) {
+        debug_assert!(node.tick > self.elapsed);
+
+        // Pick the lowest level whose slots tell the expiration tick apart from the current tick.
+        let masked: u64 = ((self.elapsed ^ node.tick) | SLOT_MASK).min(MAX_TICKS - 1);
+        let level: usize = ((63 - masked.leading_zeros()) / SLOT_BITS) as usize;
+        let slot: usize = ((node.tick >> (SLOT_BITS * level as u32)) & SLOT_MASK) as usize;
+
+        node.wheel_slot = (level, slot);
+        let level: &mut Level = &mut self.levels[level];
+        level.slots[slot].add_front(node);
+        level.occupied |= 1 << slot;
+    }
+
+    /// Returns the level and the tick of the next slot that should be processed, if any.
+    fn next_expiration(&self) -> Option<(usize, u64)> {
+        let mut next: Option<(usize, u64)> = None;
+        for (i, level) in self.levels.iter().enumerate() {
+            if level.occupied == 0 {
+                continue;
+            }
+
+            let shift: u32 = SLOT_BITS * i as u32;
+            let slot_range: u64 = 1 << shift;
+            let level_range: u64 = slot_range << SLOT_BITS;
+            let now_slot: u32 = ((self.elapsed >> shift) & SLOT_MASK) as u32;
+
+            // The current slot of higher levels only holds timers that are parked there because they expire beyond the
+            // wheel, so look past it. Slots that are behind the first one to look at belong to the next rotation.
+            let first_slot: u32 = if i > 0 { now_slot + 1 } else { now_slot };
+            let slot: u32 =
+                (level.occupied.rotate_right(first_slot).trailing_zeros() + first_slot) & (SLOT_MASK as u32);
+            let mut deadline: u64 = (self.elapsed & !(level_range - 1)) + (slot as u64) * slot_range;
+            if slot < first_slot {
+                deadline += level_range;
+            }
+
+            if next.map_or(true, |(_, next_deadline)| deadline < next_deadline) {
+                next = Some((i, deadline));
+            }
+        }
+        next
+    }
+}
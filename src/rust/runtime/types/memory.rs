@@ -17,7 +17,7 @@ use ::libc::{
 //==============================================================================
 
 /// Maximum Length for Scatter-Gather Arrays
-pub const DEMI_SGARRAY_MAXLEN: usize = 1;
+pub const DEMI_SGARRAY_MAXLEN: usize = 16;
 
 //==============================================================================
 // Structures
@@ -4,6 +4,7 @@
 mod memory;
 mod ops;
 mod queue;
+mod stats;
 
 //==============================================================================
 // Exports
@@ -21,5 +22,9 @@ pub use self::{
         demi_qr_value_t,
         demi_qresult_t,
     },
-    queue::demi_qtoken_t,
+    queue::{
+        demi_qtoken_t,
+        DEMI_QTOKEN_INVALID,
+    },
+    stats::demi_stats_t,
 };
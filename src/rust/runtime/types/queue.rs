@@ -9,3 +9,10 @@
 
 /// Queue Token
 pub type demi_qtoken_t = u64;
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Queue Token that Stands for No Operation
+pub const DEMI_QTOKEN_INVALID: demi_qtoken_t = u64::MAX;
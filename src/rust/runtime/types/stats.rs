@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#![allow(non_camel_case_types)]
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Runtime Statistics
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default)]
+pub struct demi_stats_t {
+    /// Number of packets received.
+    pub rx_packets: u64,
+    /// Number of bytes received.
+    pub rx_bytes: u64,
+    /// Number of bursts of packets received.
+    pub rx_bursts: u64,
+    /// Average number of packets in a receive burst.
+    pub rx_burst_avg: f64,
+    /// Number of packets transmitted.
+    pub tx_packets: u64,
+    /// Number of bytes transmitted.
+    pub tx_bytes: u64,
+    /// Number of bursts of packets transmitted.
+    pub tx_bursts: u64,
+    /// Average number of packets in a transmit burst.
+    pub tx_burst_avg: f64,
+    /// Number of buffer allocations that failed because a memory pool was exhausted.
+    pub mempool_exhausted: u64,
+    /// Number of TCP segments retransmitted.
+    pub retransmissions: u64,
+    /// Number of runs of out-of-order data held in TCP reassembly queues.
+    pub ooo_depth: u64,
+    /// Number of tasks in schedulers.
+    pub sched_tasks: u64,
+    /// Number of times that schedulers were polled.
+    pub sched_polls: u64,
+    /// Number of cycles spent running tasks in schedulers.
+    pub sched_poll_cycles: u64,
+}
@@ -5,6 +5,7 @@ mod future;
 mod handle;
 mod page;
 mod pin_slab;
+mod ready_set;
 mod result;
 pub mod scheduler;
 mod waker64;
@@ -5,10 +5,14 @@
 // Imports
 //==============================================================================
 
-use crate::scheduler::waker64::{
-    Waker64,
-    WAKER_BIT_LENGTH,
+use crate::scheduler::{
+    ready_set::ReadySet,
+    waker64::{
+        Waker64,
+        WAKER_BIT_LENGTH,
+    },
 };
+use ::std::sync::Arc;
 
 //==============================================================================
 // Constants
@@ -33,7 +37,8 @@ pub const WAKER_PAGE_SIZE: usize = 64;
 /// scheduler, so that it may cast back a raw pointer and operate on a specific
 /// future whenever needed.
 ///
-/// TODO: use the unused space in this structure to something useful.
+/// A page that belongs to a scheduler also flags itself in the scheduler's
+/// [ReadySet] whenever one of its futures is notified or dropped.
 #[repr(align(64))]
 pub struct WakerPage {
     /// Reference count for the page.
@@ -44,8 +49,12 @@ pub struct WakerPage {
     completed: Waker64,
     /// Flags whether or not a given future has ben dropped.
     dropped: Waker64,
+    /// Ready set of the scheduler that owns this page, if any.
+    ready_set: Option<Arc<ReadySet>>,
+    /// Index of this page in the scheduler that owns it.
+    page_ix: usize,
     /// Padding required to make the structure 64-byte big.
-    _unused: [u8; 32],
+    _unused: [u8; 16],
 }
 
 //==============================================================================
@@ -54,10 +63,20 @@ pub struct WakerPage {
 
 /// Associate Functions for Waker Page
 impl WakerPage {
+    /// Creates a [WakerPage] that is the `page_ix` page of the scheduler that owns `ready_set`.
+    pub fn new(ready_set: Arc<ReadySet>, page_ix: usize) -> Self {
+        Self {
+            ready_set: Some(ready_set),
+            page_ix,
+            ..Default::default()
+        }
+    }
+
     /// Sets the notification flag for the `ix` future in the target [WakerPage].
     pub fn notify(&self, ix: usize) {
         debug_assert!(ix < WAKER_BIT_LENGTH);
         self.notified.fetch_or(1 << ix);
+        self.mark_ready();
     }
 
     /// Takes out notification flags in the target [WakerPage].
@@ -87,6 +106,7 @@ impl WakerPage {
     pub fn mark_dropped(&self, ix: usize) {
         debug_assert!(ix < WAKER_BIT_LENGTH);
         self.dropped.fetch_or(1 << ix);
+        self.mark_ready();
     }
 
     /// Takes out dropped flags in the target [WakerPage].
@@ -101,15 +121,6 @@ impl WakerPage {
         self.dropped.load() & (1 << ix) != 0
     }
 
-    /// Resets all flags in the target [WakerPage].
-    /// The reference count for the target page is reset to one.
-    pub fn reset(&mut self) {
-        self.refcount.swap(1);
-        self.notified.swap(0);
-        self.completed.swap(0);
-        self.dropped.swap(0);
-    }
-
     /// Initialize flags for the `ix` future in the target [WakerPage].
     /// Notification and dropped flags are reset after this operation.
     pub fn initialize(&self, ix: usize) {
@@ -117,6 +128,7 @@ impl WakerPage {
         self.notified.fetch_or(1 << ix);
         self.completed.fetch_and(!(1 << ix));
         self.dropped.fetch_and(!(1 << ix));
+        self.mark_ready();
     }
 
     /// Clears flags for the `ix` future in the target [WakerPage]
@@ -142,6 +154,13 @@ impl WakerPage {
         self.refcount.fetch_sub(1)
     }
 
+    /// Flags the target [WakerPage] in the ready set of the scheduler that owns it.
+    fn mark_ready(&self) {
+        if let Some(ready_set) = self.ready_set.as_ref() {
+            ready_set.insert(self.page_ix);
+        }
+    }
+
     /// Gets the reference count of the target [WakerPage].
     #[cfg(test)]
     pub fn refcount_get(&self) -> u64 {
@@ -161,6 +180,8 @@ impl Default for WakerPage {
             notified: Waker64::new(0),
             completed: Waker64::new(0),
             dropped: Waker64::new(0),
+            ready_set: None,
+            page_ix: 0,
             _unused: Default::default(),
         }
     }
@@ -47,6 +47,15 @@ impl WakerPageRef {
         Self(waker_page)
     }
 
+    /// Moves `waker_page` to a new allocation that is aligned with its own size, and returns a reference to it.
+    pub fn from_page(waker_page: WakerPage) -> Self {
+        let layout: Layout = Layout::new::<WakerPage>();
+        assert_eq!(layout.align(), WAKER_PAGE_SIZE);
+        let ptr: NonNull<WakerPage> = Global.allocate(layout).expect("Failed to allocate WakerPage").cast();
+        unsafe { ptr::write(ptr.as_ptr(), waker_page) };
+        Self(ptr)
+    }
+
     /// Casts the target [WakerPageRef] into a [NonNull<u8>].
     ///
     /// The reference itself is not intended for reading/writing to
@@ -121,14 +130,7 @@ impl Deref for WakerPageRef {
 /// Default Trait Implementation for Waker Page References
 impl Default for WakerPageRef {
     fn default() -> Self {
-        let layout: Layout = Layout::new::<WakerPage>();
-        assert_eq!(layout.align(), WAKER_PAGE_SIZE);
-        let mut ptr: NonNull<WakerPage> = Global.allocate(layout).expect("Failed to allocate WakerPage").cast();
-        unsafe {
-            let page: &mut WakerPage = ptr.as_mut();
-            page.reset();
-        }
-        Self(ptr)
+        Self::from_page(WakerPage::default())
     }
 }
 
@@ -0,0 +1,185 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+//==============================================================================
+// Imports
+//==============================================================================
+
+use crate::scheduler::waker64::{
+    WAKER_BIT_LENGTH,
+    WAKER_BIT_LENGTH_SHIFT,
+};
+use ::std::{
+    ptr,
+    sync::atomic::{
+        AtomicPtr,
+        AtomicU64,
+        AtomicUsize,
+        Ordering,
+    },
+};
+
+//==============================================================================
+// Constants
+//==============================================================================
+
+/// Number of words in a chunk of a [ReadySet].
+const READY_SET_CHUNK_LEN: usize = 64;
+
+/// Maximum number of chunks in a [ReadySet]. This bounds a scheduler to 64 * 64 * 64 pages, i.e. 16M futures.
+const READY_SET_MAX_CHUNKS: usize = 64;
+
+//==============================================================================
+// Structures
+//==============================================================================
+
+/// Chunk of a Ready Set
+type Chunk = [AtomicU64; READY_SET_CHUNK_LEN];
+
+/// Ready Set
+///
+/// This structure summarizes which [crate::scheduler::page::WakerPage]s of a
+/// scheduler have notified or dropped futures, so that the scheduler only
+/// visits those pages when polling. The ith bit stands for the ith page.
+///
+/// The bitmap is split in chunks of atomic words, that are allocated as the
+/// scheduler adds pages and are not moved until the ready set is dropped.
+/// Thus, pages flag themselves with a single atomic operation, wherever they
+/// are woken up from.
+pub struct ReadySet {
+    /// Chunks of the bitmap of ready pages.
+    chunks: [AtomicPtr<Chunk>; READY_SET_MAX_CHUNKS],
+    /// Number of words that are in use.
+    len: AtomicUsize,
+}
+
+//==============================================================================
+// Associate Functions
+//==============================================================================
+
+/// Associate Functions for Ready Sets
+impl ReadySet {
+    /// Creates an empty ready set.
+    pub fn new() -> Self {
+        Self {
+            chunks: [(); READY_SET_MAX_CHUNKS].map(|_| AtomicPtr::new(ptr::null_mut())),
+            len: AtomicUsize::new(0),
+        }
+    }
+
+    /// Makes room for the `page_ix` page in the target [ReadySet]. This is only called by the scheduler that owns the
+    /// ready set, before the page may flag itself. Returns `false` if the ready set cannot hold that many pages.
+    pub fn reserve(&self, page_ix: usize) -> bool {
+        let word_ix: usize = page_ix >> WAKER_BIT_LENGTH_SHIFT;
+        let chunk_ix: usize = word_ix / READY_SET_CHUNK_LEN;
+        if chunk_ix >= READY_SET_MAX_CHUNKS {
+            return false;
+        }
+        // Allocate all chunks up to that of the page, so that words in use are never missing.
+        for chunk_ptr in self.chunks[..=chunk_ix].iter() {
+            if chunk_ptr.load(Ordering::Acquire).is_null() {
+                let chunk: Box<Chunk> = Box::new([(); READY_SET_CHUNK_LEN].map(|_| AtomicU64::new(0)));
+                chunk_ptr.store(Box::into_raw(chunk), Ordering::Release);
+            }
+        }
+        self.len.fetch_max(word_ix + 1, Ordering::Release);
+        true
+    }
+
+    /// Flags the `page_ix` page as ready in the target [ReadySet]. Room for the page should have been reserved.
+    pub fn insert(&self, page_ix: usize) {
+        let word_ix: usize = page_ix >> WAKER_BIT_LENGTH_SHIFT;
+        self.word(word_ix)
+            .fetch_or(1 << (page_ix & (WAKER_BIT_LENGTH - 1)), Ordering::Release);
+    }
+
+    /// Returns the number of words in the target [ReadySet].
+    pub fn len(&self) -> usize {
+        self.len.load(Ordering::Acquire)
+    }
+
+    /// Checks if no page is flagged as ready in the target [ReadySet].
+    pub fn is_empty(&self) -> bool {
+        (0..self.len()).all(|word_ix| self.word(word_ix).load(Ordering::Acquire) == 0)
+    }
+
+    /// Takes out the flags of the `word_ix` word in the target [ReadySet].
+    /// These flags are reset after this operation.
+    pub fn take(&self, word_ix: usize) -> u64 {
+        self.word(word_ix).swap(0, Ordering::AcqRel)
+    }
+
+    /// Returns the `word_ix` word of the target [ReadySet], which should be in use.
+    fn word(&self, word_ix: usize) -> &AtomicU64 {
+        let chunk: *const Chunk = self.chunks[word_ix / READY_SET_CHUNK_LEN].load(Ordering::Acquire);
+        debug_assert!(!chunk.is_null(), "word_ix={:?} is not in use", word_ix);
+        unsafe { &(*chunk)[word_ix % READY_SET_CHUNK_LEN] }
+    }
+}
+
+//==============================================================================
+// Trait Implementations
+//==============================================================================
+
+/// Drop Trait Implementation for Ready Sets
+impl Drop for ReadySet {
+    fn drop(&mut self) {
+        for chunk in self.chunks.iter_mut() {
+            let chunk: *mut Chunk = *chunk.get_mut();
+            if !chunk.is_null() {
+                drop(unsafe { Box::from_raw(chunk) });
+            }
+        }
+    }
+}
+
+//==============================================================================
+// Unit Tests
+//==============================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::{
+        ReadySet,
+        READY_SET_CHUNK_LEN,
+        READY_SET_MAX_CHUNKS,
+    };
+    use crate::scheduler::waker64::WAKER_BIT_LENGTH;
+
+    #[test]
+    fn test_ready_set() {
+        let ready_set: ReadySet = ReadySet::new();
+        assert_eq!(ready_set.len(), 0);
+        assert!(ready_set.is_empty());
+
+        assert!(ready_set.reserve(1));
+        assert!(ready_set.reserve(65));
+        ready_set.insert(1);
+        ready_set.insert(65);
+        assert_eq!(ready_set.len(), 2);
+        assert!(!ready_set.is_empty());
+        assert_eq!(ready_set.take(0), 1 << 1);
+        assert_eq!(ready_set.take(0), 0);
+        assert_eq!(ready_set.take(1), 1 << 1);
+        assert!(ready_set.is_empty());
+    }
+
+    /// Tests that pages are flagged across chunks, up to the capacity of the ready set.
+    #[test]
+    fn test_ready_set_chunks() {
+        let ready_set: ReadySet = ReadySet::new();
+        let max_pages: usize = READY_SET_MAX_CHUNKS * READY_SET_CHUNK_LEN * WAKER_BIT_LENGTH;
+        let first_page_of_chunk: usize = READY_SET_CHUNK_LEN * WAKER_BIT_LENGTH;
+
+        assert!(ready_set.reserve(first_page_of_chunk));
+        assert!(ready_set.reserve(max_pages - 1));
+        assert!(!ready_set.reserve(max_pages));
+        ready_set.insert(first_page_of_chunk);
+        ready_set.insert(max_pages - 1);
+
+        assert_eq!(ready_set.len(), READY_SET_MAX_CHUNKS * READY_SET_CHUNK_LEN);
+        assert_eq!(ready_set.take(READY_SET_CHUNK_LEN), 1);
+        assert_eq!(ready_set.take(ready_set.len() - 1), 1 << (WAKER_BIT_LENGTH - 1));
+        assert!(ready_set.is_empty());
+    }
+}
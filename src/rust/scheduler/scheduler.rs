@@ -5,24 +5,34 @@
 //!
 //! Our scheduler uses a pinned memory slab to store tasks ([SchedulerFuture]s).
 //! As background tasks are polled, they notify task in our scheduler via the
-//! [crate::page::WakerPage]s.
+//! [crate::page::WakerPage]s. Pages flag themselves in a [ReadySet] when some
+//! of their tasks are notified, so polling only visits pages with work to do.
 
 //==============================================================================
 // Imports
 //==============================================================================
 
-use crate::scheduler::{
-    page::{
-        WakerPageRef,
-        WakerRef,
+use crate::{
+    runtime::{
+        fail::Fail,
+        stats,
+        QToken,
     },
-    pin_slab::PinSlab,
-    waker64::{
-        WAKER_BIT_LENGTH,
-        WAKER_BIT_LENGTH_SHIFT,
+    scheduler::{
+        page::{
+            WakerPage,
+            WakerPageRef,
+            WakerRef,
+        },
+        pin_slab::PinSlab,
+        ready_set::ReadySet,
+        waker64::{
+            WAKER_BIT_LENGTH,
+            WAKER_BIT_LENGTH_SHIFT,
+        },
+        SchedulerFuture,
+        SchedulerHandle,
     },
-    SchedulerFuture,
-    SchedulerHandle,
 };
 use ::bit_iter::BitIter;
 use ::std::{
@@ -35,11 +45,13 @@ use ::std::{
     pin::Pin,
     ptr::NonNull,
     rc::Rc,
+    sync::Arc,
     task::{
         Context,
         Poll,
         Waker,
     },
+    time::SystemTime,
 };
 
 //==============================================================================
@@ -52,6 +64,8 @@ struct Inner<F: Future<Output = ()> + Unpin> {
     slab: PinSlab<F>,
     /// Holds the status tasks.
     pages: Vec<WakerPageRef>,
+    /// Pages that have notified or dropped tasks.
+    ready_set: Arc<ReadySet>,
 }
 
 /// Future Scheduler
@@ -79,7 +93,12 @@ impl<F: Future<Output = ()> + Unpin> Inner<F> {
 
         // Add a new page to hold this future's status if the current page is filled.
         while key >= self.pages.len() << WAKER_BIT_LENGTH_SHIFT {
-            self.pages.push(WakerPageRef::default());
+            if !self.ready_set.reserve(self.pages.len()) {
+                self.slab.remove(key);
+                return None;
+            }
+            let page: WakerPage = WakerPage::new(self.ready_set.clone(), self.pages.len());
+            self.pages.push(WakerPageRef::from_page(page));
         }
         let (page, subpage_ix): (&WakerPageRef, usize) = self.get_page(key as u64);
         page.initialize(subpage_ix);
@@ -96,6 +115,7 @@ impl Scheduler {
         let (page, subpage_ix): (&WakerPageRef, usize) = inner.get_page(key);
         assert!(!page.was_dropped(subpage_ix));
         page.clear(subpage_ix);
+        stats::record_task_removed();
         inner.slab.remove_unpin(key as usize).unwrap()
     }
 
@@ -112,61 +132,147 @@ impl Scheduler {
     pub fn insert<F: SchedulerFuture>(&self, future: F) -> Option<SchedulerHandle> {
         let mut inner: RefMut<Inner<Box<dyn SchedulerFuture>>> = self.inner.borrow_mut();
         let key: u64 = inner.insert(Box::new(future))?;
+        stats::record_task_inserted();
         let (page, _): (&WakerPageRef, usize) = inner.get_page(key);
         Some(SchedulerHandle::new(key, page.clone()))
     }
 
+    /// Waits for at least one of the tasks of `qts` to complete or `abstime` to expire, and then hands all tasks of
+    /// `qts` that have completed by then to `on_completion`, along with their index in `qts`. If `abstime` is `None`,
+    /// this function blocks until some task completes. Each round calls `poll`, to give tasks a chance to complete,
+    /// and then `idle` if no task did. These callbacks and `on_completion` get the state of the caller in `target`.
+    /// All queue tokens are checked upfront, so this never fails after having handed out some tasks. On success, the
+    /// number of tasks that were handed out is returned.
+    pub fn wait_many<T, P, I, F>(
+        &self,
+        target: &mut T,
+        qts: &[QToken],
+        abstime: Option<SystemTime>,
+        mut poll: P,
+        mut idle: I,
+        mut on_completion: F,
+    ) -> Result<usize, Fail>
+    where
+        P: FnMut(&mut T),
+        I: FnMut(&mut T, Option<SystemTime>),
+        F: FnMut(&mut T, usize, SchedulerHandle),
+    {
+        for &qt in qts {
+            match self.from_raw_handle(qt.into()) {
+                Some(mut handle) => handle.take_key(),
+                None => return Err(Fail::new(libc::EINVAL, "invalid queue token")),
+            };
+        }
+
+        loop {
+            // Poll first, so as to give pending operations a chance to complete.
+            poll(target);
+
+            // Drain all operations that have completed.
+            let mut nready: usize = 0;
+            for (i, &qt) in qts.iter().enumerate() {
+                // Retrieve associated schedule handle. This only fails for duplicate queue tokens
+                // whose operation was already taken out in this pass, so skip them.
+                let mut handle: SchedulerHandle = match self.from_raw_handle(qt.into()) {
+                    Some(handle) => handle,
+                    None => continue,
+                };
+
+                if handle.has_completed() {
+                    on_completion(target, i, handle);
+                    nready += 1;
+                } else {
+                    // Return this operation to the scheduling queue by removing the associated key
+                    // (which would otherwise cause the operation to be freed).
+                    handle.take_key();
+                }
+            }
+
+            if nready > 0 {
+                return Ok(nready);
+            }
+
+            if let Some(abstime) = abstime {
+                if SystemTime::now() >= abstime {
+                    return Err(Fail::new(libc::ETIMEDOUT, "timer expired"));
+                }
+            }
+
+            idle(target, abstime);
+        }
+    }
+
+    /// Checks if some task was notified or dropped since it was last polled, i.e. if polling again may make progress.
+    pub fn has_ready(&self) -> bool {
+        !self.inner.borrow().ready_set.is_empty()
+    }
+
     /// Poll all futures which are ready to run again. Tasks in our scheduler are notified when
     /// relevant data or events happen. The relevant event have callback function (the waker) which
     /// they can invoke to notify the scheduler that future should be polled again.
     pub fn poll(&self) {
         let mut inner: RefMut<Inner<Box<dyn SchedulerFuture>>> = self.inner.borrow_mut();
+        let ready_set: Arc<ReadySet> = inner.ready_set.clone();
 
-        // Iterate through pages.
-        for page_ix in 0..inner.pages.len() {
-            let (notified, dropped): (u64, u64) = {
-                let page: &mut WakerPageRef = &mut inner.pages[page_ix];
-                (page.take_notified(), page.take_dropped())
-            };
-            // There is some notified task in this page, so iterate through it.
-            if notified != 0 {
-                for subpage_ix in BitIter::from(notified) {
-                    // Handle notified tasks only.
-                    // Get future using our page indices and poll it!
-                    let ix: usize = (page_ix << WAKER_BIT_LENGTH_SHIFT) + subpage_ix;
-                    let waker: Waker = unsafe {
-                        let raw_waker: NonNull<u8> = inner.pages[page_ix].into_raw_waker_ref(subpage_ix);
-                        Waker::from_raw(WakerRef::new(raw_waker).into())
-                    };
-                    let mut sub_ctx: Context = Context::from_waker(&waker);
-
-                    let pinned_ref: Pin<&mut Box<dyn SchedulerFuture>> = inner.slab.get_pin_mut(ix).unwrap();
-                    let pinned_ptr = unsafe { Pin::into_inner_unchecked(pinned_ref) as *mut _ };
-
-                    // Poll future.
-                    drop(inner);
-                    let pinned_ref = unsafe { Pin::new_unchecked(&mut *pinned_ptr) };
-                    let poll_result: Poll<()> = Future::poll(pinned_ref, &mut sub_ctx);
-                    inner = self.inner.borrow_mut();
-
-                    match poll_result {
-                        Poll::Ready(()) => inner.pages[page_ix].mark_completed(subpage_ix),
-                        Poll::Pending => (),
+        // Only time polls that have work to do, so that idle polls stay cheap.
+        if ready_set.is_empty() {
+            stats::record_poll(0);
+            return;
+        }
+        let start: u64 = cycles();
+
+        // Iterate through pages that have notified or dropped tasks.
+        for word_ix in 0..ready_set.len() {
+            let ready: u64 = ready_set.take(word_ix);
+            for ready_ix in BitIter::from(ready) {
+                let page_ix: usize = (word_ix << WAKER_BIT_LENGTH_SHIFT) + ready_ix;
+                let (notified, dropped): (u64, u64) = {
+                    let page: &mut WakerPageRef = &mut inner.pages[page_ix];
+                    (page.take_notified(), page.take_dropped())
+                };
+                // There is some notified task in this page, so iterate through it.
+                if notified != 0 {
+                    for subpage_ix in BitIter::from(notified) {
+                        // Handle notified tasks only.
+                        // Get future using our page indices and poll it!
+                        let ix: usize = (page_ix << WAKER_BIT_LENGTH_SHIFT) + subpage_ix;
+                        let waker: Waker = unsafe {
+                            let raw_waker: NonNull<u8> = inner.pages[page_ix].into_raw_waker_ref(subpage_ix);
+                            Waker::from_raw(WakerRef::new(raw_waker).into())
+                        };
+                        let mut sub_ctx: Context = Context::from_waker(&waker);
+
+                        let pinned_ref: Pin<&mut Box<dyn SchedulerFuture>> = inner.slab.get_pin_mut(ix).unwrap();
+                        let pinned_ptr = unsafe { Pin::into_inner_unchecked(pinned_ref) as *mut _ };
+
+                        // Poll future.
+                        drop(inner);
+                        let pinned_ref = unsafe { Pin::new_unchecked(&mut *pinned_ptr) };
+                        let poll_result: Poll<()> = Future::poll(pinned_ref, &mut sub_ctx);
+                        inner = self.inner.borrow_mut();
+
+                        match poll_result {
+                            Poll::Ready(()) => inner.pages[page_ix].mark_completed(subpage_ix),
+                            Poll::Pending => (),
+                        }
                     }
                 }
-            }
-            // There is some dropped task in this page, so iterate through it.
-            if dropped != 0 {
-                // Handle dropped tasks only.
-                for subpage_ix in BitIter::from(dropped) {
-                    if subpage_ix != 0 {
-                        let ix: usize = (page_ix << WAKER_BIT_LENGTH_SHIFT) + subpage_ix;
-                        inner.slab.remove(ix);
-                        inner.pages[page_ix].clear(subpage_ix);
+                // There is some dropped task in this page, so iterate through it.
+                if dropped != 0 {
+                    // Handle dropped tasks only.
+                    for subpage_ix in BitIter::from(dropped) {
+                        if subpage_ix != 0 {
+                            let ix: usize = (page_ix << WAKER_BIT_LENGTH_SHIFT) + subpage_ix;
+                            inner.slab.remove(ix);
+                            inner.pages[page_ix].clear(subpage_ix);
+                            stats::record_task_removed();
+                        }
                     }
                 }
             }
         }
+
+        stats::record_poll(cycles().wrapping_sub(start));
     }
 }
 
@@ -181,6 +287,7 @@ impl Default for Scheduler {
         let inner: Inner<Box<dyn SchedulerFuture>> = Inner {
             slab: PinSlab::new(),
             pages: vec![],
+            ready_set: Arc::new(ReadySet::new()),
         };
         Self {
             inner: Rc::new(RefCell::new(inner)),
@@ -188,16 +295,42 @@ impl Default for Scheduler {
     }
 }
 
+//==============================================================================
+// Standalone Functions
+//==============================================================================
+
+/// Reads the time-stamp counter, to time polls.
+#[cfg(target_arch = "x86_64")]
+#[inline(always)]
+fn cycles() -> u64 {
+    unsafe { ::std::arch::x86_64::_rdtsc() }
+}
+
+/// Reads the monotonic clock in nanoseconds, to time polls on targets that have no time-stamp counter.
+#[cfg(not(target_arch = "x86_64"))]
+#[inline(always)]
+fn cycles() -> u64 {
+    let mut ts: libc::timespec = libc::timespec { tv_sec: 0, tv_nsec: 0 };
+    unsafe { libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts) };
+    ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+}
+
 //==============================================================================
 // Unit Tests
 //==============================================================================
 
 #[cfg(test)]
 mod tests {
-    use crate::scheduler::scheduler::{
-        Scheduler,
-        SchedulerFuture,
-        SchedulerHandle,
+    use crate::{
+        runtime::{
+            fail::Fail,
+            QToken,
+        },
+        scheduler::scheduler::{
+            Scheduler,
+            SchedulerFuture,
+            SchedulerHandle,
+        },
     };
     use ::std::{
         any::Any,
@@ -208,6 +341,10 @@ mod tests {
             Poll,
             Waker,
         },
+        time::{
+            Duration,
+            SystemTime,
+        },
     };
     use ::test::{
         black_box,
@@ -252,6 +389,33 @@ mod tests {
         }
     }
 
+    /// A future that never completes. If `spin` is set, it wakes itself up on every poll; otherwise, it is never
+    /// woken up again.
+    struct IdleFuture {
+        spin: bool,
+    }
+
+    impl Future for IdleFuture {
+        type Output = ();
+
+        fn poll(self: Pin<&mut Self>, ctx: &mut Context) -> Poll<Self::Output> {
+            if self.spin {
+                ctx.waker().wake_by_ref();
+            }
+            Poll::Pending
+        }
+    }
+
+    impl SchedulerFuture for IdleFuture {
+        fn as_any(self: Box<Self>) -> Box<dyn Any> {
+            self
+        }
+
+        fn get_future(&self) -> &dyn Future<Output = ()> {
+            todo!()
+        }
+    }
+
     #[bench]
     fn bench_scheduler_insert(b: &mut Bencher) {
         let scheduler: Scheduler = Scheduler::default();
@@ -309,7 +473,7 @@ mod tests {
     #[bench]
     fn bench_scheduler_poll(b: &mut Bencher) {
         let scheduler: Scheduler = Scheduler::default();
-        let mut handles: Vec<SchedulerHandle> = Vec::<SchedulerHandle>::with_capacity(1024);
+        let mut handles: Vec<SchedulerHandle> = Vec::<SchedulerHandle>::with_capacity(65536);
 
         // Insert 1024 futures in the scheduler.
         // Half of them will be ready.
@@ -322,8 +486,122 @@ mod tests {
             handles.push(handle);
         }
 
+        // Insert futures that are parked forever, and one that keeps on running, so that polls have to skip over
+        // many pages without work to do.
+        for _ in 1024..65535 {
+            let handle: SchedulerHandle = match scheduler.insert(IdleFuture { spin: false }) {
+                Some(handle) => handle,
+                None => panic!("insert() failed"),
+            };
+            handles.push(handle);
+        }
+        match scheduler.insert(IdleFuture { spin: true }) {
+            Some(handle) => handles.push(handle),
+            None => panic!("insert() failed"),
+        }
+
         b.iter(|| {
             black_box(scheduler.poll());
         });
     }
+
+    #[test]
+    fn scheduler_poll_idle() {
+        let scheduler: Scheduler = Scheduler::default();
+
+        // Park a page worth of idle futures, and a future that keeps on running.
+        let mut handles: Vec<SchedulerHandle> = Vec::<SchedulerHandle>::with_capacity(65);
+        for _ in 0..64 {
+            handles.push(scheduler.insert(IdleFuture { spin: false }).expect("insert() failed"));
+        }
+        handles.push(scheduler.insert(IdleFuture { spin: true }).expect("insert() failed"));
+        scheduler.poll();
+
+        // Only the page of the running future is ready.
+        assert!(scheduler.has_ready());
+        let ready_set = scheduler.inner.borrow().ready_set.clone();
+        assert_eq!(ready_set.take(0), 1 << 1);
+        assert!(!scheduler.has_ready());
+
+        // A future that is inserted later still gets polled.
+        let handle: SchedulerHandle = scheduler.insert(DummyFuture::new(0)).expect("insert() failed");
+        scheduler.poll();
+        assert_eq!(handle.has_completed(), true);
+    }
+
+    /// Inserts `future` into `scheduler`, and returns the queue token of the resulting task.
+    fn insert_qtoken<F: SchedulerFuture>(scheduler: &Scheduler, future: F) -> QToken {
+        let handle: SchedulerHandle = scheduler.insert(future).expect("insert() failed");
+        QToken::from(handle.into_raw())
+    }
+
+    #[test]
+    fn scheduler_wait_many() {
+        let scheduler: Scheduler = Scheduler::default();
+        let qts: [QToken; 4] = [
+            insert_qtoken(&scheduler, DummyFuture::new(0)),
+            insert_qtoken(&scheduler, IdleFuture { spin: false }),
+            insert_qtoken(&scheduler, DummyFuture::new(2)),
+            insert_qtoken(&scheduler, DummyFuture::new(4)),
+        ];
+
+        // All completed tasks are handed out in one go, along with their index, and the pending one stays put.
+        let mut completed: Vec<(usize, usize)> = Vec::new();
+        let mut npolls: usize = 0;
+        let nready: usize = scheduler
+            .wait_many(
+                &mut completed,
+                &qts,
+                None,
+                |_: &mut Vec<(usize, usize)>| {
+                    npolls += 1;
+                    scheduler.poll();
+                },
+                |_: &mut Vec<(usize, usize)>, _: Option<SystemTime>| panic!("idle() called with completed tasks"),
+                |completed: &mut Vec<(usize, usize)>, i: usize, handle: SchedulerHandle| {
+                    let future: Box<DummyFuture> = scheduler.take(handle).as_any().downcast().unwrap();
+                    completed.push((i, future.val));
+                },
+            )
+            .expect("wait_many() failed");
+        assert_eq!(nready, 3);
+        assert_eq!(npolls, 1);
+        assert_eq!(completed, vec![(0, 0), (2, 2), (3, 4)]);
+
+        // The pending task is still there, and it times out once the deadline has expired.
+        let mut nidles: usize = 0;
+        let abstime: SystemTime = SystemTime::now() + Duration::from_millis(10);
+        let result: Result<usize, Fail> = scheduler.wait_many(
+            &mut completed,
+            &qts[1..2],
+            Some(abstime),
+            |_: &mut Vec<(usize, usize)>| scheduler.poll(),
+            |_: &mut Vec<(usize, usize)>, deadline: Option<SystemTime>| {
+                assert_eq!(deadline, Some(abstime));
+                nidles += 1;
+            },
+            |_: &mut Vec<(usize, usize)>, _: usize, _: SchedulerHandle| panic!("idle task completed"),
+        );
+        assert_eq!(result.err().map(|e| e.errno), Some(libc::ETIMEDOUT));
+        assert!(nidles > 0);
+        assert!(SystemTime::now() >= abstime);
+    }
+
+    #[test]
+    fn scheduler_wait_many_invalid() {
+        let scheduler: Scheduler = Scheduler::default();
+        let qt: QToken = insert_qtoken(&scheduler, DummyFuture::new(0));
+        let invalid: QToken = QToken::from(u64::from(qt) + 1);
+
+        // No task is handed out if some queue token is invalid, even if others have completed.
+        let result: Result<usize, Fail> = scheduler.wait_many(
+            &mut (),
+            &[qt, invalid],
+            None,
+            |_: &mut ()| scheduler.poll(),
+            |_: &mut (), _: Option<SystemTime>| (),
+            |_: &mut (), _: usize, _: SchedulerHandle| panic!("task handed out"),
+        );
+        assert_eq!(result.err().map(|e| e.errno), Some(libc::EINVAL));
+    }
 }
@@ -98,6 +98,19 @@ static bool inval_push(void)
     return (demi_push(qt, qd, sga) != 0);
 }
 
+/**
+ * @brief Issues an invalid system call to demi_push_many().
+ */
+static bool inval_push_many(void)
+{
+    demi_qtoken_t *qts = NULL;
+    int *qds = NULL;
+    demi_sgarray_t *sgas = NULL;
+    int n = -1;
+
+    return (demi_push_many(qts, qds, sgas, n) != 0);
+}
+
 /**
  * @brief Issues an invalid call to demi_pushto().
  */
@@ -123,6 +136,18 @@ static bool inval_pop(void)
     return (demi_pop(qt, qd) != 0);
 }
 
+/**
+ * @brief Issues an invalid system call to demi_pop_many().
+ */
+static bool inval_pop_many(void)
+{
+    demi_qtoken_t *qts = NULL;
+    int *qds = NULL;
+    int n = -1;
+
+    return (demi_pop_many(qts, qds, n) != 0);
+}
+
 /*===================================================================================================================*
  * System Calls in demi/sga.h                                                                                        *
  *===================================================================================================================*/
@@ -188,6 +213,19 @@ static bool inval_wait_any(void)
     return (demi_wait_any(qr, ready_offset, qts, num_qts) != 0);
 }
 
+/**
+ * @brief Issues an invalid system call to demi_wait_many().
+ */
+static bool inval_wait_many(void)
+{
+    demi_qresult_t *qrs = NULL;
+    int *nready = NULL;
+    demi_qtoken_t *qts = NULL;
+    int num_qts = -1;
+
+    return (demi_wait_many(qrs, nready, qts, num_qts, NULL) != 0);
+}
+
 /*===================================================================================================================*
  * main()                                                                                                            *
  *===================================================================================================================*/
@@ -208,7 +246,8 @@ static struct test tests_libos[] = {{inval_socket, "invalid demi_socket()"},   {
                                     {inval_bind, "invalid demi_bind()"},       {inval_close, "invalid_demi_close()"},
                                     {inval_connect, "invalid demi_connect()"}, {inval_listen, "invalid demi_listen()"},
                                     {inval_pop, "invalid demi_pop()"},         {inval_push, "invalid demi_push()"},
-                                    {inval_pushto, "invalid demi_pushto()"}};
+                                    {inval_pushto, "invalid demi_pushto()"},   {inval_pop_many, "invalid demi_pop_many()"},
+                                    {inval_push_many, "invalid demi_push_many()"}};
 
 /**
  * @brief Tests for system calls in demi/sga.h
@@ -221,7 +260,8 @@ static struct test tests_sga[] = {{inval_sgaalloc, "invalid demi_sgaalloc()"},
  */
 static struct test tests_wait[] = {{inval_timedwait, "invalid demi_timedwait()"},
                                    {inval_wait, "invalid demi_wait()"},
-                                   {inval_wait_any, "invalid demi_wait_any()"}};
+                                   {inval_wait_any, "invalid demi_wait_any()"},
+                                   {inval_wait_many, "invalid demi_wait_many()"}};
 
 /**
  * @brief Drives the application.